@@ -1005,34 +1005,47 @@ static void __init init_latest_freq_req(void)
 	}
 }
 
+/* The clusters are queried in one batch, one thread channel each */
 static int __init get_ndiv_limits_tbl_from_bpmp(void)
 {
-	struct mrq_cpu_ndiv_limits_request md;
-	struct mrq_cpu_ndiv_limits_response *nltbl;
+	struct mrq_cpu_ndiv_limits_request md[MAX_CLUSTERS];
+	struct tegra_bpmp_async reqs[MAX_CLUSTERS];
+	uint32_t ids[MAX_CLUSTERS];
 	uint32_t cl;
+	int n = 0;
 	int ret = 0;
+	int i;
 	bool ok = false;
 
+	memset(reqs, 0, sizeof(reqs));
+
 	LOOP_FOR_EACH_CLUSTER(cl) {
 		if (!tfreq_data.pcluster[cl].configured)
 			continue;
-		nltbl = &tfreq_data.pcluster[cl].ndiv_limits_tbl;
-		md.cluster_id = cl;
+		md[n].cluster_id = cl;
+		reqs[n].mrq = MRQ_CPU_NDIV_LIMITS;
+		reqs[n].ob_data = &md[n];
+		reqs[n].ob_sz = sizeof(struct mrq_cpu_ndiv_limits_request);
+		reqs[n].ib_data = &tfreq_data.pcluster[cl].ndiv_limits_tbl;
+		reqs[n].ib_sz = sizeof(struct mrq_cpu_ndiv_limits_response);
+		reqs[n].result = -EINPROGRESS;
+		ids[n++] = cl;
+	}
 
-		ret = tegra_bpmp_send_receive(MRQ_CPU_NDIV_LIMITS, &md,
-				sizeof(struct mrq_cpu_ndiv_limits_request),
-				nltbl,
-				sizeof(struct mrq_cpu_ndiv_limits_response));
+	tegra_bpmp_send_receive_batch(reqs, n);
 
+	/* as before, stop at the first cluster that failed */
+	for (i = 0; i < n; i++) {
+		ret = reqs[i].result;
 		if (ret) {
 			pr_warn("%s: cpufreq: ", __func__);
-			pr_warn("cluster %u: ndiv_limits query failed!\n", cl);
-			goto err_out;
-		} else {
-			ok = true;
+			pr_warn("cluster %u: ndiv_limits query failed!\n",
+				ids[i]);
+			break;
 		}
+		ok = true;
 	}
-err_out:
+
 	return ok ? 0 : ret;
 }
 
@@ -78,6 +78,7 @@ static unsigned int to_reclaim;
 static unsigned int to_complete;
 static unsigned int tch_free;
 static struct semaphore tch_sem;
+static struct tegra_bpmp_async *async_req[NR_MAX_CHANNELS];
 
 static struct completion *bpmp_completion_obj(int ch)
 {
@@ -91,6 +92,28 @@ static struct completion *bpmp_completion_obj(int ch)
 	return completion + i;
 }
 
+static int __bpmp_read_ch(int ch, void *data, int sz);
+
+/*
+ * Called with lock held. The callback runs last so that it may free a
+ * request nobody waits for; tegra_bpmp_wait_async() takes lock before
+ * returning, so a waiter never gets req back while the callback runs.
+ */
+static void bpmp_complete_async(int ch)
+{
+	struct tegra_bpmp_async *req = async_req[ch];
+
+	async_req[ch] = NULL;
+	req->result = __bpmp_read_ch(ch, req->ib_data, req->ib_sz);
+	tch_free |= 1u << ch;
+	up(&tch_sem);
+
+	complete(&req->done);
+
+	if (req->callback)
+		req->callback(req);
+}
+
 static void bpmp_signal_thread(int ch)
 {
 	struct mb_data *p = channel_area[ch].ob;
@@ -109,6 +132,11 @@ static void bpmp_signal_thread(int ch)
 		return;
 	}
 
+	if (async_req[ch]) {
+		bpmp_complete_async(ch);
+		return;
+	}
+
 	w = bpmp_completion_obj(ch);
 	if (!w) {
 		WARN_ON(1);
@@ -194,7 +222,8 @@ static int bpmp_write_ch(int ch, int mrq, int flags, void *data, int sz)
 	return 0;
 }
 
-static int bpmp_write_threaded_ch(int *ch, int mrq, void *data, int sz)
+static int bpmp_write_threaded_ch(int *ch, int mrq, void *data, int sz,
+		struct tegra_bpmp_async *req)
 {
 	unsigned long flags;
 	unsigned int m;
@@ -211,6 +240,9 @@ static int bpmp_write_threaded_ch(int *ch, int mrq, void *data, int sz)
 	} else {
 		m = 1u << *ch;
 		tch_free &= ~m;
+		async_req[*ch] = req;
+		if (req)
+			req->ch = *ch;
 		__bpmp_write_ch(*ch, mrq, DO_ACK | RING_DOORBELL, data, sz);
 		to_complete |= m;
 	}
@@ -425,7 +457,7 @@ int tegra_bpmp_send_receive(int mrq, void *ob_data, int ob_sz,
 		return r;
 	}
 
-	r = bpmp_write_threaded_ch(&ch, mrq, ob_data, ob_sz);
+	r = bpmp_write_threaded_ch(&ch, mrq, ob_data, ob_sz, NULL);
 	if (r)
 		goto out;
 
@@ -445,6 +477,123 @@ out:
 }
 EXPORT_SYMBOL(tegra_bpmp_send_receive);
 
+/*
+ * Issue an MRQ on a free thread channel and return without waiting for the
+ * response. Sleeps while all thread channels are busy. The response is
+ * copied to req->ib_data from the mailbox irq, which then completes the
+ * request and runs req->callback (if any) in irq context.
+ */
+int tegra_bpmp_send_async(struct tegra_bpmp_async *req)
+{
+	int ch;
+	int r;
+
+	if (WARN_ON(irqs_disabled()))
+		return -EPERM;
+
+	if (!bpmp_valid_txfer(req->ob_data, req->ob_sz,
+				req->ib_data, req->ib_sz))
+		return -EINVAL;
+
+	if (!mail_ops)
+		return -ENODEV;
+
+	init_completion(&req->done);
+	req->ch = -1;
+	req->result = -EINPROGRESS;
+
+	r = down_timeout(&tch_sem, usecs_to_jiffies(THREAD_CH_TIMEOUT));
+	if (r) {
+		pr_err("%s() down_timeout return %d\n", __func__, r);
+		pr_err("tch_free 0x%x to_complete 0x%x\n",
+				tch_free, to_complete);
+		return r;
+	}
+
+	/* once written, req may complete (and be freed) at any time */
+	r = bpmp_write_threaded_ch(&ch, req->mrq, req->ob_data,
+			req->ob_sz, req);
+	if (r) {
+		up(&tch_sem);
+		return r;
+	}
+
+	if (mail_ops->ring_doorbell)
+		mail_ops->ring_doorbell(ch);
+
+	return 0;
+}
+EXPORT_SYMBOL(tegra_bpmp_send_async);
+
+/*
+ * Wait for an MRQ issued with tegra_bpmp_send_async() and return its
+ * result. On timeout the channel is reclaimed the same way as for
+ * tegra_bpmp_send_receive() and the callback will not be called.
+ */
+int tegra_bpmp_wait_async(struct tegra_bpmp_async *req)
+{
+	char fmt[MSG_DATA_MIN_SZ * 5] = "";
+	unsigned long flags;
+	unsigned long timeout;
+	unsigned long rt;
+
+	timeout = usecs_to_jiffies(THREAD_CH_TIMEOUT);
+	rt = wait_for_completion_timeout(&req->done, timeout);
+
+	/* the callback runs under lock, after done is completed */
+	spin_lock_irqsave(&lock, flags);
+
+	if (rt || async_req[req->ch] != req) {
+		/* completed, possibly while we were timing out */
+		spin_unlock_irqrestore(&lock, flags);
+		return req->result;
+	}
+
+	async_req[req->ch] = NULL;
+	to_reclaim |= 1u << req->ch;
+	req->result = -ETIMEDOUT;
+
+	spin_unlock_irqrestore(&lock, flags);
+
+	bpmp_format_req(fmt, sizeof(fmt), req->ob_data, req->ob_sz);
+	pr_err("%s() timed out (ch %d mrq %d data <%s>)\n",
+			__func__, req->ch, req->mrq, fmt);
+	WARN_ON(1);
+
+	return -ETIMEDOUT;
+}
+EXPORT_SYMBOL(tegra_bpmp_wait_async);
+
+/*
+ * Issue a set of independent MRQs across all free thread channels and
+ * wait for all of them. Each request's result is stored in req->result;
+ * the return value is the first error encountered, or 0.
+ */
+int tegra_bpmp_send_receive_batch(struct tegra_bpmp_async *reqs, int n)
+{
+	int sent;
+	int ret = 0;
+	int r;
+	int i;
+
+	for (sent = 0; sent < n; sent++) {
+		ret = tegra_bpmp_send_async(&reqs[sent]);
+		if (ret) {
+			reqs[sent].result = ret;
+			break;
+		}
+	}
+
+	for (i = 0; i < sent; i++) {
+		r = tegra_bpmp_wait_async(&reqs[i]);
+		if (r && !ret)
+			ret = r;
+	}
+
+	return ret;
+}
+EXPORT_SYMBOL(tegra_bpmp_send_receive_batch);
+
 int tegra_bpmp_running(void)
 {
 	return mail_ops ? 1 : 0;
@@ -54,6 +54,8 @@ struct tegra_i2c_ivc_multi_dev {
 		unsigned int reads, read_bytes;
 		unsigned int writes, write_bytes;
 		unsigned int errors;
+		unsigned int frame_tables;
+		unsigned int frame_table_errors;
 	} stat;
 };
 
@@ -81,6 +83,7 @@ struct tegra_i2c_rtcpu_sensor {
 	bool in_agg; /* in the middle of aggregation */
 	unsigned int last_addr; /* is_valid if in_agg. last register address */
 	int frame_id; /* is_valid if in_agg. frame ID */
+	unsigned int frame_length_us; /* for frame table timeouts */
 	/* RPC call for I2C_REQUEST_MULTI */
 	unsigned int req_len;
 	u8 *req_cur, *req_last_len;
@@ -224,31 +227,38 @@ EXPORT_SYMBOL(tegra_i2c_rtcpu_register_sensor);
  * I2C transfer
  */
 
-static int tegra_i2c_ivc_multi_xfer(
+static void tegra_i2c_ivc_multi_reset_req(
 	struct tegra_i2c_rtcpu_sensor *sensor)
 {
-	int ret = 0;
-
-	tegra_ivc_channel_runtime_get(sensor->i2c_ivc_dev->chan);
+	sensor->last_addr = (unsigned int) -1;
+	sensor->req_len = CAMRTC_I2C_MULTI_HEADER_SIZE;
+	sensor->req_cur = sensor->rpc_i2c_req_buf +
+		CAMRTC_I2C_MULTI_HEADER_SIZE;
+	sensor->req_last_len = NULL;
+}
 
-	if (sensor->req_len == CAMRTC_I2C_MULTI_HEADER_SIZE) {
-		ret = 0;
-		goto exit;
-	}
+static int tegra_i2c_ivc_multi_prepare_req(
+	struct tegra_i2c_rtcpu_sensor *sensor)
+{
+	int ret;
 
 	if (!sensor->is_registered) {
 		unsigned int req_len = sensor->req_len;
+		u8 *req_cur = sensor->req_cur;
+		u8 *req_last_len = sensor->req_last_len;
 
 		ret = tegra_i2c_ivc_register_sensor(sensor->i2c_ivc_dev->chan,
 			sensor);
 
 		if (ret != 0)
-			goto exit;
+			return ret;
 
-		/* restore len since register sensor inits to a differnet
-		 * value, which is used during first init at boot
+		/* restore buffer state since register sensor inits it to
+		 * a differnet value, which is used during first init at boot
 		 */
 		sensor->req_len = req_len;
+		sensor->req_cur = req_cur;
+		sensor->req_last_len = req_last_len;
 	}
 
 	sensor->rpc_i2c_req_buf[1] = (sensor->frame_id > 0) ?
@@ -256,16 +266,31 @@ static int tegra_i2c_ivc_multi_xfer(
 	sensor->rpc_i2c_req_buf[2] = (sensor->frame_id >> 0) & 0xff;
 	sensor->rpc_i2c_req_buf[3] = (sensor->frame_id >> 8) & 0xff;
 
+	return 0;
+}
+
+static int tegra_i2c_ivc_multi_xfer(
+	struct tegra_i2c_rtcpu_sensor *sensor)
+{
+	int ret = 0;
+
+	tegra_ivc_channel_runtime_get(sensor->i2c_ivc_dev->chan);
+
+	if (sensor->req_len == CAMRTC_I2C_MULTI_HEADER_SIZE) {
+		ret = 0;
+		goto exit;
+	}
+
+	ret = tegra_i2c_ivc_multi_prepare_req(sensor);
+	if (ret != 0)
+		goto exit;
+
 	sensor->rpc_i2c_req.request_len = sensor->req_len;
 	ret = tegra_ivc_rpc_call(sensor->i2c_ivc_dev->chan,
 		&sensor->rpc_i2c_req);
 
 	/* reset request buffer pointers */
-	sensor->last_addr = (unsigned int) -1;
-	sensor->req_len = CAMRTC_I2C_MULTI_HEADER_SIZE;
-	sensor->req_cur = sensor->rpc_i2c_req_buf +
-		CAMRTC_I2C_MULTI_HEADER_SIZE;
-	sensor->req_last_len = NULL;
+	tegra_i2c_ivc_multi_reset_req(sensor);
 
 	if (ret < 0) {
 		++sensor->i2c_ivc_dev->stat.errors;
@@ -317,6 +342,19 @@ int tegra_i2c_rtcpu_set_frame_id(
 }
 EXPORT_SYMBOL(tegra_i2c_rtcpu_set_frame_id);
 
+int tegra_i2c_rtcpu_set_frame_length(
+	struct tegra_i2c_rtcpu_sensor *sensor,
+	unsigned int frame_length_us)
+{
+	if (frame_length_us == 0)
+		return -EINVAL;
+
+	sensor->frame_length_us = frame_length_us;
+
+	return 0;
+}
+EXPORT_SYMBOL(tegra_i2c_rtcpu_set_frame_length);
+
 int tegra_i2c_rtcpu_read_reg8(
 	struct tegra_i2c_rtcpu_sensor *sensor,
 	unsigned int addr,
@@ -365,25 +403,18 @@ int tegra_i2c_rtcpu_read_reg8(
 }
 EXPORT_SYMBOL(tegra_i2c_rtcpu_read_reg8);
 
-int tegra_i2c_rtcpu_write_reg8(
+/* Append a write to the request buffer without sending it */
+static int tegra_i2c_ivc_multi_add_write(
 	struct tegra_i2c_rtcpu_sensor *sensor,
 	unsigned int addr,
 	const u8 *data,
 	unsigned int count)
 {
-	int ret;
-	int this_len;
 	u8 *req;
 
-	this_len = CAMRTC_I2C_MULTI_DATA_OFFSET +
-		sensor->config.reg_bytes + count;
-
-	/* If there is no room, flush current transfer */
-	if (sensor->req_len + this_len > CAMRTC_I2C_REQUEST_MAX_LEN) {
-		ret = tegra_i2c_ivc_multi_xfer(sensor);
-		if (ret != 0)
-			return ret;
-	}
+	if (sensor->req_len + CAMRTC_I2C_MULTI_DATA_OFFSET +
+	    sensor->config.reg_bytes + count > CAMRTC_I2C_REQUEST_MAX_LEN)
+		return -E2BIG;
 
 	/* Write transfer */
 	req = sensor->req_cur;
@@ -427,6 +458,32 @@ int tegra_i2c_rtcpu_write_reg8(
 	sensor->req_len += count;
 	sensor->last_addr = addr + count;
 
+	return 0;
+}
+
+int tegra_i2c_rtcpu_write_reg8(
+	struct tegra_i2c_rtcpu_sensor *sensor,
+	unsigned int addr,
+	const u8 *data,
+	unsigned int count)
+{
+	int ret;
+	int this_len;
+
+	this_len = CAMRTC_I2C_MULTI_DATA_OFFSET +
+		sensor->config.reg_bytes + count;
+
+	/* If there is no room, flush current transfer */
+	if (sensor->req_len + this_len > CAMRTC_I2C_REQUEST_MAX_LEN) {
+		ret = tegra_i2c_ivc_multi_xfer(sensor);
+		if (ret != 0)
+			return ret;
+	}
+
+	ret = tegra_i2c_ivc_multi_add_write(sensor, addr, data, count);
+	if (ret != 0)
+		return ret;
+
 	if (!sensor->in_agg)
 		return tegra_i2c_ivc_multi_xfer(sensor);
 	else
@@ -476,6 +533,175 @@ int tegra_i2c_rtcpu_write_table_8(
 }
 EXPORT_SYMBOL(tegra_i2c_rtcpu_write_table_8);
 
+/*
+ * Frame-synchronized register tables
+ *
+ * A whole table is packed into a single I2C_REQUEST_MULTI message tagged
+ * with a frame ID, and sent without waiting for the response. CamRTC
+ * applies the table as one batch when the frame starts. The completion
+ * callback is called once the response arrives or the request times out.
+ *
+ * CamRTC only responds after the frame has started, so the timeout is
+ * the time to the target frame plus the timeout of a synchronous transfer.
+ */
+
+struct tegra_i2c_ivc_multi_frame_req {
+	struct tegra_i2c_rtcpu_sensor *sensor;
+	int frame_id;
+	tegra_i2c_rtcpu_table_callback callback;
+	void *callback_param;
+};
+
+/* Software interrupt context */
+static void tegra_i2c_ivc_multi_frame_done(
+	int ret,
+	const struct tegra_ivc_rpc_response_frame *rsp,
+	void *param)
+{
+	struct tegra_i2c_ivc_multi_frame_req *frame_req = param;
+	struct tegra_i2c_rtcpu_sensor *sensor = frame_req->sensor;
+	const struct camrtc_rpc_i2c_response *rsp_i2c;
+
+	/* A table CamRTC could not apply is reported in the payload */
+	if (ret >= 0 && rsp->hdr.response_len >= sizeof(rsp_i2c->result)) {
+		rsp_i2c = TEGRA_IVC_RPC_CAST_CPAYLOAD(
+			struct camrtc_rpc_i2c_response, rsp);
+		if (rsp_i2c->result != CAMRTC_I2C_RESPONSE_RESULT_SUCCESS)
+			ret = -EIO;
+	}
+
+	if (ret < 0) {
+		++sensor->i2c_ivc_dev->stat.frame_table_errors;
+		dev_err(&sensor->i2c_ivc_dev->chan->dev,
+			"I2C table for sensor %u at frame %d failed: %d\n",
+			sensor->sensor_id, frame_req->frame_id, ret);
+		ret = -EIO;
+	} else
+		ret = 0;
+
+	if (frame_req->callback)
+		frame_req->callback(ret, frame_req->callback_param);
+
+	tegra_ivc_channel_runtime_put(sensor->i2c_ivc_dev->chan);
+	kfree(frame_req);
+}
+
+int tegra_i2c_rtcpu_write_table_8_frame(
+	struct tegra_i2c_rtcpu_sensor *sensor,
+	const struct reg_8 table[],
+	const struct reg_8 override_list[],
+	int num_override_regs, u16 wait_ms_addr, u16 end_addr,
+	int frame_id, unsigned int frame_distance,
+	tegra_i2c_rtcpu_table_callback callback,
+	void *callback_param)
+{
+	struct tegra_i2c_ivc_multi_frame_req *frame_req;
+	struct tegra_ivc_rpc_call_param rpc_req;
+	const struct reg_8 *next;
+	u64 timeout_ms;
+	int i, ret;
+
+	/* Frame IDs are 16 bits on the wire */
+	if (frame_id <= 0 || frame_distance > U16_MAX)
+		return -EINVAL;
+
+	if (sensor->frame_length_us == 0)
+		return -EINVAL;
+
+	/* The request buffer is shared with the synchronous path */
+	if (sensor->in_agg ||
+	    sensor->req_len != CAMRTC_I2C_MULTI_HEADER_SIZE)
+		return -EBUSY;
+
+	frame_req = kzalloc(sizeof(*frame_req), GFP_KERNEL);
+	if (frame_req == NULL)
+		return -ENOMEM;
+
+	frame_req->sensor = sensor;
+	frame_req->frame_id = frame_id;
+	frame_req->callback = callback;
+	frame_req->callback_param = callback_param;
+
+	sensor->in_agg = true;
+	sensor->last_addr = (unsigned int) -1;
+	sensor->frame_id = frame_id;
+
+	for (next = table; next->addr != end_addr; ++next) {
+		u8 val = next->val;
+
+		/* CamRTC cannot delay in the middle of a batch */
+		if (next->addr == wait_ms_addr) {
+			ret = -EINVAL;
+			goto fail;
+		}
+
+		if (override_list) {
+			for (i = 0; i < num_override_regs; ++i) {
+				if (next->addr == override_list[i].addr) {
+					val = override_list[i].val;
+					break;
+				}
+			}
+		}
+
+		/* The table must fit in one request to be applied at once */
+		ret = tegra_i2c_ivc_multi_add_write(sensor,
+			next->addr, &val, 1);
+		if (ret != 0)
+			goto fail;
+	}
+
+	tegra_ivc_channel_runtime_get(sensor->i2c_ivc_dev->chan);
+
+	ret = tegra_i2c_ivc_multi_prepare_req(sensor);
+	if (ret != 0)
+		goto fail_put;
+
+	/* The request is copied to the IVC frame before the call returns,
+	 * so the buffer can be reused right away. Writes carry no response
+	 * payload.
+	 */
+	rpc_req = sensor->rpc_i2c_req;
+	rpc_req.request_len = sensor->req_len;
+	rpc_req.response_len = 0;
+	rpc_req.response = NULL;
+	rpc_req.callback = tegra_i2c_ivc_multi_frame_done;
+	rpc_req.callback_param = frame_req;
+
+	timeout_ms = DIV_ROUND_UP_ULL((u64) frame_distance *
+		sensor->frame_length_us, USEC_PER_MSEC) +
+		I2C_CAMRTC_RPC_IVC_MULTI_TIMEOUT_MS;
+	rpc_req.timeout_ms = min_t(u64, timeout_ms, U32_MAX);
+
+	ret = tegra_ivc_rpc_call(sensor->i2c_ivc_dev->chan, &rpc_req);
+	if (ret < 0) {
+		++sensor->i2c_ivc_dev->stat.frame_table_errors;
+		dev_err(&sensor->i2c_ivc_dev->chan->dev,
+			"I2C table for sensor %u at frame %d not sent: %d\n",
+			sensor->sensor_id, frame_id, ret);
+		ret = -EIO;
+		goto fail_put;
+	}
+
+	++sensor->i2c_ivc_dev->stat.frame_tables;
+
+	sensor->in_agg = false;
+	sensor->frame_id = -1;
+	tegra_i2c_ivc_multi_reset_req(sensor);
+
+	return 0;
+
+fail_put:
+	tegra_ivc_channel_runtime_put(sensor->i2c_ivc_dev->chan);
+fail:
+	sensor->in_agg = false;
+	sensor->frame_id = -1;
+	tegra_i2c_ivc_multi_reset_req(sensor);
+	kfree(frame_req);
+	return ret;
+}
+EXPORT_SYMBOL(tegra_i2c_rtcpu_write_table_8_frame);
+
 /*
  * IVC channel Debugfs
  */
@@ -506,6 +732,10 @@ static int tegra_i2c_ivc_multi_stat_show(
 	seq_printf(file, "Write requests: %u\n", i2c_ivc_dev->stat.writes);
 	seq_printf(file, "Write bytes: %u\n", i2c_ivc_dev->stat.write_bytes);
 	seq_printf(file, "Errors: %u\n", i2c_ivc_dev->stat.errors);
+	seq_printf(file, "Frame tables: %u\n",
+		i2c_ivc_dev->stat.frame_tables);
+	seq_printf(file, "Frame table errors: %u\n",
+		i2c_ivc_dev->stat.frame_table_errors);
 
 	return 0;
 }
@@ -1,7 +1,7 @@
 /*
  * IVC based Library for I2C services.
  *
- * Copyright (c) 2015-2017, NVIDIA CORPORATION.  All rights reserved.
+ * Copyright (c) 2015-2020, NVIDIA CORPORATION.  All rights reserved.
  *
  * This program is free software; you can redistribute it and/or modify it
  * under the terms and conditions of the GNU General Public License,
@@ -25,6 +25,7 @@
 #include <linux/interrupt.h>
 #include <linux/skbuff.h>
 #include <linux/delay.h>
+#include <linux/i2c.h>
 
 #include "i2c-tegra-hv-common.h"
 
@@ -68,10 +69,13 @@ static inline int _hv_i2c_get_data_ptr_offset(enum i2c_ivc_msg_t type)
 			+ sizeof(struct i2c_ivc_msg_tx_rx_hdr);
 	case I2C_GET_MAX_PAYLOAD_RESPONSE:
 		return I2C_IVC_COMMON_HEADER_LEN;
+	case I2C_BATCH_RESPONSE:
+		return I2C_IVC_COMMON_HEADER_LEN
+			+ sizeof(struct i2c_ivc_msg_batch_hdr);
 	default:
-			WARN(1, "Unsupported message type\n");
+		/* e.g. an older server answering a request it does not know */
+		return -1;
 	}
-	return -1;
 }
 
 static void _hv_i2c_comm_chan_cleanup(struct tegra_hv_i2c_comm_chan *comm_chan)
@@ -207,6 +211,78 @@ int hv_i2c_transfer(struct tegra_hv_i2c_comm_chan *comm_chan, phys_addr_t base,
 	return rv;
 }
 
+/*
+ * hv_i2c_transfer_batch
+ * Send a whole message array to the i2c server as one request. The data of
+ * all read messages comes back in rbuf, in order. Returns -E2BIG without
+ * sending anything if the request does not fit in one frame.
+ */
+int hv_i2c_transfer_batch(struct tegra_hv_i2c_comm_chan *comm_chan,
+		phys_addr_t base, struct i2c_msg *msgs, int num,
+		uint8_t *rbuf, size_t rlen, int *err)
+{
+	/* Using skbs for fast allocation  and deallocation */
+	struct sk_buff *tx_msg_skb = NULL;
+	struct i2c_ivc_msg *tx_msg = NULL;
+	struct i2c_ivc_msg_tx_rx_hdr *hdr;
+	struct device *dev = comm_chan->dev;
+	size_t wlen = 0;
+	uint8_t *data;
+	int msg_len;
+	int rv, i;
+
+	if (num > MAX_BATCH_MSGS)
+		return -E2BIG;
+
+	for (i = 0; i < num; i++)
+		if (!(msgs[i].flags & I2C_M_RD))
+			wlen += msgs[i].len;
+
+	msg_len = I2C_IVC_COMMON_HEADER_LEN
+		  + sizeof(struct i2c_ivc_msg_batch_hdr)
+		  + num * sizeof(struct i2c_ivc_msg_tx_rx_hdr) + wlen;
+	if (msg_len > comm_chan->ivck->frame_size)
+		return -E2BIG;
+
+	tx_msg_skb = alloc_skb(msg_len, GFP_KERNEL);
+	if (!tx_msg_skb) {
+		dev_err(dev, "could not allocate memory\n");
+		return -ENOMEM;
+	}
+
+	tx_msg = (struct i2c_ivc_msg *)skb_put(tx_msg_skb, msg_len);
+	_hv_i2c_prep_msg_generic(comm_chan->id, base, tx_msg);
+
+	i2c_ivc_msg_type(tx_msg) = I2C_BATCH;
+	tx_msg->body.b.fixed.num_msgs = num;
+	tx_msg->body.b.fixed.data_len = wlen;
+
+	hdr = tx_msg->body.b.msgs;
+	data = (uint8_t *)&hdr[num];
+	for (i = 0; i < num; i++, hdr++) {
+		hdr->seq_no = i;
+		hdr->slave_address = msgs[i].addr;
+		hdr->buf_len = msgs[i].len;
+		hdr->flags = 0;
+		/* repeated start between messages, stop after the last */
+		if (i < num - 1)
+			hdr->flags |= HV_I2C_FLAGS_REPEAT_START;
+		if (msgs[i].flags & I2C_M_TEN)
+			hdr->flags |= HV_I2C_FLAGS_10BIT_ADDR;
+		if (msgs[i].flags & I2C_M_RD) {
+			hdr->flags |= HV_I2C_FLAGS_READ;
+		} else {
+			memcpy(data, msgs[i].buf, msgs[i].len);
+			data += msgs[i].len;
+		}
+	}
+
+	rv = _hv_i2c_send_msg(dev, comm_chan, tx_msg, rbuf, err, rlen,
+			       msg_len);
+	kfree_skb(tx_msg_skb);
+	return rv;
+}
+
 int hv_i2c_get_max_payload(struct tegra_hv_i2c_comm_chan *comm_chan,
 		phys_addr_t base, uint32_t *max_payload, int *err)
 {
@@ -396,9 +472,15 @@ static void hv_i2c_work(struct work_struct *work)
 			data_ptr_offset = _hv_i2c_get_data_ptr_offset(
 					i2c_ivc_msg_type(fake_rx_msg));
 			if (data_ptr_offset < 0) {
-				dev_err(comm_chan->dev,
-						"Bad offset for message type %u\n",
+				/* Fail the request rather than let it time out,
+				 * the channel itself is fine
+				 */
+				dev_dbg(comm_chan->dev,
+						"Unsupported response type %u\n",
 						i2c_ivc_msg_type(fake_rx_msg));
+				*comm_chan->rcvd_err = HV_I2C_ERR_UNSUPPORTED;
+				_hv_i2c_comm_chan_cleanup(comm_chan);
+				comm_chan->handler(comm_chan->data);
 				continue;
 			}
 			/* Copy the message to consumer*/
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2015-2017, NVIDIA CORPORATION.  All rights reserved.
+ * Copyright (c) 2015-2020, NVIDIA CORPORATION.  All rights reserved.
  *
  * This program is free software; you can redistribute it and/or modify it
  * under the terms and conditions of the GNU General Public License,
@@ -24,10 +24,14 @@
 typedef void (*i2c_isr_handler)(void *context);
 
 struct tegra_hv_i2c_comm_chan;
+struct i2c_msg;
 
 int hv_i2c_transfer(struct tegra_hv_i2c_comm_chan *comm_chan, phys_addr_t base,
 		int addr, int read, uint8_t *buf, size_t len, int *err,
 		int seq_no, uint32_t flags);
+int hv_i2c_transfer_batch(struct tegra_hv_i2c_comm_chan *comm_chan,
+		phys_addr_t base, struct i2c_msg *msgs, int num,
+		uint8_t *rbuf, size_t rlen, int *err);
 int hv_i2c_get_max_payload(struct tegra_hv_i2c_comm_chan *comm_chan,
 		phys_addr_t base, uint32_t *max_payload, int *err);
 int hv_i2c_comm_chan_cleanup(struct tegra_hv_i2c_comm_chan *comm_chan,
@@ -40,6 +44,7 @@ void *hv_i2c_comm_init(struct device *dev, i2c_isr_handler handler,
 void tegra_hv_i2c_poll_cleanup(struct tegra_hv_i2c_comm_chan *comm_chan);
 
 #define MAX_COMM_CHANS  10
+#define MAX_BATCH_MSGS	16
 
 enum i2c_ivc_msg_t {
 	I2C_READ,
@@ -51,6 +56,9 @@ enum i2c_ivc_msg_t {
 	I2C_CLEANUP,
 	I2C_CLEANUP_RESPONSE,
 	I2C_INVALID,
+	/* appended so that the values above stay unchanged */
+	I2C_BATCH,
+	I2C_BATCH_RESPONSE,
 };
 
 enum i2c_rx_state_t {
@@ -62,11 +70,15 @@ enum i2c_rx_state_t {
 #define HV_I2C_FLAGS_HIGHSPEED_MODE	(1<<22)
 #define HV_I2C_FLAGS_CONT_ON_NAK	(1<<21)
 #define HV_I2C_FLAGS_SEND_START_BYTE	(1<<20)
+#define HV_I2C_FLAGS_READ		(1<<19)
 #define HV_I2C_FLAGS_10BIT_ADDR		(1<<18)
 #define HV_I2C_FLAGS_IE_ENABLE		(1<<17)
 #define HV_I2C_FLAGS_REPEAT_START	(1<<16)
 #define HV_I2C_FLAGS_CONTINUE_XFER	(1<<15)
 
+/* reported to the client when the server answers with an unknown type */
+#define HV_I2C_ERR_UNSUPPORTED		(-1)
+
 struct i2c_ivc_msg_common {
 	uint32_t s_marker;
 	uint32_t msg_type;
@@ -92,11 +104,28 @@ struct i2c_ivc_msg_max_payload {
 	uint32_t max_payload;
 };
 
+struct i2c_ivc_msg_batch_hdr {
+	uint32_t num_msgs;
+	uint32_t data_len;
+};
+
+/*
+ * A request carries num_msgs headers followed by the write data of all
+ * write messages, in order. HV_I2C_FLAGS_READ in a header marks a read.
+ * The response carries the batch header followed by the data of all read
+ * messages, in order.
+ */
+struct i2c_ivc_msg_batch {
+	struct i2c_ivc_msg_batch_hdr fixed;
+	struct i2c_ivc_msg_tx_rx_hdr msgs[0];
+};
+
 struct i2c_ivc_msg {
 	struct i2c_ivc_msg_common hdr;
 	union {
 		struct i2c_ivc_msg_tx_rx m;
 		struct i2c_ivc_msg_max_payload p;
+		struct i2c_ivc_msg_batch b;
 	} body;
 };
 
@@ -1,7 +1,7 @@
 /*
  * drivers/i2c/busses/i2c-tegra-hv.c
  *
- * Copyright (C) 2015-2017 NVIDIA Corporation.  All rights reserved.
+ * Copyright (C) 2015-2020 NVIDIA Corporation.  All rights reserved.
  * Author: Arnab Basu <abasu@nvidia.com>
  *
  * This software is licensed under the terms of the GNU General Public
@@ -48,6 +48,8 @@
  * by this i2c device
  * @completion_timeout: time to wait for reply from server
  * @bus_clk_rate: current i2c bus clock rate (this is currently a dummy value)
+ * @batch_xfer: server accepts a whole message array in one request
+ * @batch_buf: bounce buffer for the read data of a batched transfer
  */
 struct tegra_hv_i2c_dev {
 	struct device *dev;
@@ -58,6 +60,8 @@ struct tegra_hv_i2c_dev {
 	u32 max_payload_size;
 	u32 completion_timeout;
 	u32 bus_clk_rate;
+	bool batch_xfer;
+	u8 *batch_buf;
 };
 
 static void tegra_hv_i2c_isr(void *dev_id)
@@ -66,6 +70,33 @@ static void tegra_hv_i2c_isr(void *dev_id)
 	complete(&i2c_dev->msg_complete);
 }
 
+/* Reset the channel after a failed or timed out request */
+static void tegra_hv_i2c_recover(struct tegra_hv_i2c_dev *i2c_dev)
+{
+	int ret;
+	int j = 0;
+
+	reinit_completion(&i2c_dev->msg_complete);
+	ret = hv_i2c_comm_chan_cleanup(i2c_dev->comm_chan, i2c_dev->base);
+
+	if (ret < 0) {
+		dev_err(i2c_dev->dev, "Failed to send cleanup message\n");
+	}
+
+	while ((ret = wait_for_completion_timeout(&i2c_dev->msg_complete,
+				i2c_dev->completion_timeout * 2)) == 0) {
+		dev_err(i2c_dev->dev, "Cleanup failed after timeout (%d tries)\n",
+				j++);
+		if (j >= 5)
+			break;
+		/* Skipping INIT_COMPLETION on purpose, if completion gets
+		 * signalled in the time between 2 calls to wait_for_completion
+		 * we don't want to overwrite that
+		 */
+	}
+	tegra_hv_i2c_poll_cleanup(i2c_dev->comm_chan);
+}
+
 static int tegra_hv_i2c_xfer_msg(struct tegra_hv_i2c_dev *i2c_dev,
 		struct i2c_msg *msg, int sno, bool more_msgs)
 {
@@ -73,7 +104,6 @@ static int tegra_hv_i2c_xfer_msg(struct tegra_hv_i2c_dev *i2c_dev,
 	int msg_err;
 	int msg_read;
 	int rv;
-	int j = 0;
 	uint32_t flags = 0;
 
 	if (msg->len == 0)
@@ -119,25 +149,80 @@ static int tegra_hv_i2c_xfer_msg(struct tegra_hv_i2c_dev *i2c_dev,
 	dev_dbg(i2c_dev->dev, "received error code %d\n", msg_err);
 	rv = -EIO;
 error:
+	tegra_hv_i2c_recover(i2c_dev);
+
+	return rv;
+}
+
+/*
+ * Send the whole message array to the server in one request, the server
+ * issues repeated starts between the messages and a stop after the last.
+ * Returns -E2BIG or -EOPNOTSUPP without touching the bus when the array
+ * can not be batched, the caller then falls back to per-message requests.
+ */
+static int tegra_hv_i2c_xfer_batch(struct tegra_hv_i2c_dev *i2c_dev,
+		struct i2c_msg msgs[], int num)
+{
+	size_t rlen = 0, wlen = 0;
+	int msg_err;
+	int ret;
+	int rv;
+	int i;
+	u8 *p;
+
+	for (i = 0; i < num; i++) {
+		if (msgs[i].len == 0)
+			return -EOPNOTSUPP;
+		if (msgs[i].flags & I2C_M_RD)
+			rlen += msgs[i].len;
+		else
+			wlen += msgs[i].len;
+	}
+
+	if (rlen > i2c_dev->max_payload_size ||
+			wlen > i2c_dev->max_payload_size)
+		return -E2BIG;
+
+	msg_err = I2C_NO_ERROR;
 	reinit_completion(&i2c_dev->msg_complete);
-	ret = hv_i2c_comm_chan_cleanup(i2c_dev->comm_chan, i2c_dev->base);
 
+	ret = hv_i2c_transfer_batch(i2c_dev->comm_chan, i2c_dev->base, msgs,
+			num, i2c_dev->batch_buf, rlen, &msg_err);
+	if (ret == -E2BIG)
+		return ret;
 	if (ret < 0) {
-		dev_err(i2c_dev->dev, "Failed to send cleanup message\n");
+		dev_err(i2c_dev->dev, "unable to send batch (%d)\n", ret);
+		return ret;
 	}
 
-	while ((ret = wait_for_completion_timeout(&i2c_dev->msg_complete,
-				i2c_dev->completion_timeout * 2)) == 0) {
-		dev_err(i2c_dev->dev, "Cleanup failed after timeout (%d tries)\n",
-				j++);
-		if (j >= 5)
-			break;
-		/* Skipping INIT_COMPLETION on purpose, if completion gets
-		 * signalled in the time between 2 calls to wait_for_completion
-		 * we don't want to overwrite that
-		 */
+	ret = wait_for_completion_timeout(&i2c_dev->msg_complete,
+					i2c_dev->completion_timeout);
+	if (ret == 0) {
+		dev_err(i2c_dev->dev,
+			"i2c batch of %d timed out, addr 0x%04x\n",
+			num, msgs[0].addr);
+		rv = -EBUSY;
+		goto error;
 	}
-	tegra_hv_i2c_poll_cleanup(i2c_dev->comm_chan);
+
+	if (unlikely(msg_err != I2C_NO_ERROR)) {
+		dev_dbg(i2c_dev->dev, "received error code %d\n", msg_err);
+		rv = -EIO;
+		goto error;
+	}
+
+	p = i2c_dev->batch_buf;
+	for (i = 0; i < num; i++) {
+		if (!(msgs[i].flags & I2C_M_RD))
+			continue;
+		memcpy(msgs[i].buf, p, msgs[i].len);
+		p += msgs[i].len;
+	}
+
+	return 0;
+
+error:
+	tegra_hv_i2c_recover(i2c_dev);
 
 	return rv;
 }
@@ -149,6 +234,13 @@ static int tegra_hv_i2c_xfer(struct i2c_adapter *adap, struct i2c_msg msgs[],
 	int i;
 	int ret = 0;
 
+	if (i2c_dev->batch_xfer && num > 1) {
+		ret = tegra_hv_i2c_xfer_batch(i2c_dev, msgs, num);
+		if (ret != -E2BIG && ret != -EOPNOTSUPP)
+			return ret ? ret : num;
+		ret = 0;
+	}
+
 	for (i = 0; i < num; i++) {
 		ret = tegra_hv_i2c_xfer_msg(i2c_dev, &msgs[i], i,
 					    (i < (num - 1)));
@@ -194,6 +286,34 @@ static void tegra_i2c_hv_parse_dt(struct tegra_hv_i2c_dev *i2c_dev)
 		i2c_dev->bus_clk_rate = 100000; /* default clock rate */
 }
 
+/*
+ * Older servers do not know about I2C_BATCH, an empty batch tells us
+ * whether this one does. Their answer has a response type we do not
+ * know either, which fails the request without a timeout or a channel
+ * cleanup.
+ */
+static bool tegra_hv_i2c_probe_batch(struct tegra_hv_i2c_dev *i2c_dev)
+{
+	int err = I2C_NO_ERROR;
+	int ret;
+
+	reinit_completion(&i2c_dev->msg_complete);
+
+	ret = hv_i2c_transfer_batch(i2c_dev->comm_chan, i2c_dev->base, NULL,
+				    0, NULL, 0, &err);
+	if (ret < 0)
+		return false;
+
+	ret = wait_for_completion_timeout(&i2c_dev->msg_complete,
+			i2c_dev->completion_timeout);
+	if (ret == 0) {
+		tegra_hv_i2c_recover(i2c_dev);
+		return false;
+	}
+
+	return err == I2C_NO_ERROR;
+}
+
 /* Match table for of_platform binding */
 static const struct of_device_id tegra_hv_i2c_of_match[] = {
 	{ .compatible = "nvidia,tegra124-i2c-hv", .data = NULL},
@@ -311,6 +431,13 @@ static int tegra_hv_i2c_probe(struct platform_device *pdev)
 		}
 	}
 
+	i2c_dev->batch_buf = devm_kzalloc(&pdev->dev,
+			i2c_dev->max_payload_size, GFP_KERNEL);
+	if (i2c_dev->batch_buf)
+		i2c_dev->batch_xfer = tegra_hv_i2c_probe_batch(i2c_dev);
+	dev_dbg(&pdev->dev, "batched transfers %ssupported\n",
+		i2c_dev->batch_xfer ? "" : "not ");
+
 	ret = i2c_add_numbered_adapter(&i2c_dev->adapter);
 	if (ret) {
 		dev_err(&pdev->dev, "Failed to add I2C adapter\n");
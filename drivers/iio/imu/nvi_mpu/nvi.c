@@ -34,7 +34,7 @@
 
 #include "nvi.h"
 
-#define NVI_DRIVER_VERSION		(345)
+#define NVI_DRIVER_VERSION		(347)
 #define NVI_VENDOR			"Invensense"
 #define NVI_NAME			"mpu6xxx"
 #define NVI_NAME_MPU6050		"mpu6050"
@@ -2712,9 +2712,47 @@ static s32 nvi_matrix(struct nvi_state *st, signed char *matrix,
 		 (matrix[6 + axis] == -1 ? -z : 0)));
 }
 
+static void nvi_batch_flush(struct nvi_state *st, unsigned int dev)
+{
+	struct nvi_batch *b = &st->snsr[dev].batch;
+
+	if (b->n) {
+		st->nvs->handler_batch(st->snsr[dev].nvs_st, b->buf,
+				       NVI_PUSH_DATA_N, b->n, b->ts);
+		b->n = 0;
+	}
+}
+
+static void nvi_batch_flush_all(struct nvi_state *st)
+{
+	unsigned int dev;
+
+	for (dev = 0; dev < DEV_N_AUX; dev++)
+		nvi_batch_flush(st, dev);
+}
+
+/* Samples are collected with their timestamps and pushed as one batch at
+ * the end of the FIFO read or when the batch is full.  A batch never
+ * exceeds the sensor's fifo_max_evnt_cnt.
+ */
+static void nvi_batch_add(struct nvi_state *st, unsigned int dev,
+			  u8 *buf, s64 ts)
+{
+	struct nvi_batch *b = &st->snsr[dev].batch;
+	unsigned int n_max = NVI_BATCH_N;
+
+	if (st->snsr[dev].cfg.fifo_max_evnt_cnt < n_max)
+		n_max = st->snsr[dev].cfg.fifo_max_evnt_cnt;
+	memcpy(&b->buf[b->n * NVI_PUSH_DATA_N], buf, NVI_PUSH_DATA_N);
+	b->ts[b->n] = ts;
+	b->n++;
+	if (b->n >= n_max)
+		nvi_batch_flush(st, dev);
+}
+
 int nvi_push(struct nvi_state *st, unsigned int dev, u8 *buf, s64 ts)
 {
-	u8 buf_le[20];
+	u8 buf_le[NVI_PUSH_DATA_N];
 	s32 val_le[4];
 	s32 val[AXIS_N];
 	u32 u_val;
@@ -2821,14 +2859,24 @@ int nvi_push(struct nvi_state *st, unsigned int dev, u8 *buf, s64 ts)
 	}
 
 	if (ts >= 0) {
-		if (st->sts & (NVI_DBG_SPEW_SNSR << dev)) {
-			sts = st->sts;
-			st->sts |= NVS_STS_SPEW_DATA;
-			st->nvs->handler(st->snsr[dev].nvs_st, buf_le, ts);
-			if (!(sts & NVS_STS_SPEW_DATA))
-				st->sts &= ~NVS_STS_SPEW_DATA;
+		if (st->push_batch && st->nvs->handler_batch &&
+		    st->snsr[dev].cfg.fifo_max_evnt_cnt > 1 &&
+		    !(st->sts & (NVI_DBG_SPEW_SNSR << dev))) {
+			nvi_batch_add(st, dev, buf_le, ts);
 		} else {
-			st->nvs->handler(st->snsr[dev].nvs_st, buf_le, ts);
+			/* keep ordering with any samples already batched */
+			nvi_batch_flush(st, dev);
+			if (st->sts & (NVI_DBG_SPEW_SNSR << dev)) {
+				sts = st->sts;
+				st->sts |= NVS_STS_SPEW_DATA;
+				st->nvs->handler(st->snsr[dev].nvs_st,
+						 buf_le, ts);
+				if (!(sts & NVS_STS_SPEW_DATA))
+					st->sts &= ~NVS_STS_SPEW_DATA;
+			} else {
+				st->nvs->handler(st->snsr[dev].nvs_st,
+						 buf_le, ts);
+			}
 		}
 	}
 #ifdef ENABLE_TRACE
@@ -3083,6 +3131,7 @@ static int nvi_fifo_rd(struct nvi_state *st, int src, unsigned int fifo_n_max,
 		ts_now = 0;
 	}
 
+	st->push_batch = true;
 	while (fifo_n) {
 		buf_n = sizeof(st->buf) - st->buf_i;
 		if (buf_n > fifo_n)
@@ -3090,8 +3139,10 @@ static int nvi_fifo_rd(struct nvi_state *st, int src, unsigned int fifo_n_max,
 		ret = nvi_i2c_r(st, st->hal->reg->fifo_rw.bank,
 				st->hal->reg->fifo_rw.reg,
 				buf_n, &st->buf[st->buf_i]);
-		if (ret)
-			return 0;
+		if (ret) {
+			ret = 0;
+			break;
+		}
 
 		fifo_n -= buf_n;
 		buf_n += st->buf_i;
@@ -3118,6 +3169,8 @@ static int nvi_fifo_rd(struct nvi_state *st, int src, unsigned int fifo_n_max,
 			break;
 	}
 
+	st->push_batch = false;
+	nvi_batch_flush_all(st);
 	return ret;
 }
 
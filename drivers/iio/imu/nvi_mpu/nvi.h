@@ -32,6 +32,8 @@
 #define NVI_IRQ_STORM_MIN_NS		(1000000) /* storm if irq faster 1ms */
 #define NVI_IRQ_STORM_MAX_N		(100) /* max storm irqs b4 dis irq */
 #define NVI_FIFO_SAMPLE_SIZE_MAX	(38)
+#define NVI_PUSH_DATA_N			(20) /* nvi_push sample stride */
+#define NVI_BATCH_N			(32) /* max samples per batch push */
 #define KBUF_SZ				(64)
 #define SRC_MPU				(0)
 #define SRC_GYR				(0)
@@ -437,6 +439,12 @@ struct nvi_hal {
 	struct nvi_dmp *dmp;
 };
 
+struct nvi_batch {
+	unsigned int n;
+	s64 ts[NVI_BATCH_N];
+	u8 buf[NVI_BATCH_N * NVI_PUSH_DATA_N];
+};
+
 struct nvi_snsr {
 	void *nvs_st;
 	struct sensor_cfg cfg;
@@ -456,6 +464,7 @@ struct nvi_snsr {
 	bool ts_reset;
 	bool flush;
 	bool matrix;
+	struct nvi_batch batch;
 };
 
 /**
@@ -504,6 +513,7 @@ struct nvi_state {
 	bool irq_set_irq_wake;
 	bool icm_dmp_war;
 	bool icm_fifo_off;
+	bool push_batch;
 	int pm;
 	u32 dmp_clk_n;
 	s64 ts_now;
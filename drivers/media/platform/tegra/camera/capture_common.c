@@ -17,6 +17,7 @@
 #include <linux/slab.h>
 #include <linux/hashtable.h>
 #include <linux/atomic.h>
+#include <linux/ktime.h>
 #include <media/capture_common.h>
 #include <media/mc_common.h>
 
@@ -55,6 +56,12 @@ struct capture_buffer_table {
 	struct kmem_cache *cache;
 	rwlock_t hlock;
 	DECLARE_HASHTABLE(hhead, 4U);
+	/* mappings kept pinned across requests, most recent first */
+	struct list_head lru;
+	uint32_t cache_size;
+	uint32_t cache_cnt;
+	spinlock_t slock;
+	struct capture_buffer_stats stats;
 };
 
 /* a pinned buffer for capture vi/isp device */
@@ -65,6 +72,8 @@ struct capture_mapping {
 	struct dma_buf_attachment *atch;
 	struct sg_table *sgt;
 	unsigned int flag;
+	struct list_head lru;
+	bool cached;
 };
 
 struct capture_buffer_table *
@@ -81,6 +90,11 @@ create_buffer_table(struct device *dev)
 			tab->dev = dev;
 			hash_init(tab->hhead);
 			rwlock_init(&tab->hlock);
+			INIT_LIST_HEAD(&tab->lru);
+			tab->cache_size = 0U;
+			tab->cache_cnt = 0U;
+			spin_lock_init(&tab->slock);
+			memset(&tab->stats, 0, sizeof(tab->stats));
 		} else {
 			kfree(tab);
 			tab = NULL;
@@ -174,6 +188,22 @@ find_mapping(
 	return NULL;
 }
 
+static void
+account_lookup(struct capture_buffer_table *tab, bool hit, u64 start)
+{
+	u64 delta = ktime_get_ns() - start;
+
+	spin_lock(&tab->slock);
+	if (hit)
+		tab->stats.hits++;
+	else
+		tab->stats.misses++;
+	tab->stats.pin_ns += delta;
+	if (delta > tab->stats.pin_max_ns)
+		tab->stats.pin_max_ns = delta;
+	spin_unlock(&tab->slock);
+}
+
 static struct capture_mapping *
 get_mapping(
 	struct capture_buffer_table *tab,
@@ -182,6 +212,7 @@ get_mapping(
 {
 	struct capture_mapping *pin;
 	struct dma_buf *buf;
+	u64 start = ktime_get_ns();
 	void *err;
 
 	buf = dma_buf_get((int)fd);
@@ -194,6 +225,7 @@ get_mapping(
 	pin = find_mapping(tab, buf, flag);
 	if (pin != NULL) {
 		dma_buf_put(buf);
+		account_lookup(tab, true, start);
 		return pin;
 	}
 
@@ -219,11 +251,15 @@ get_mapping(
 	pin->buf = buf;
 	atomic_set(&pin->refcnt, 1U);
 	INIT_HLIST_NODE(&pin->hnode);
+	INIT_LIST_HEAD(&pin->lru);
+	pin->cached = false;
 
 	write_lock(&tab->hlock);
 	hash_add(tab->hhead, &pin->hnode, (unsigned long)pin->buf);
 	write_unlock(&tab->hlock);
 
+	account_lookup(tab, false, start);
+
 	return pin;
 err2:
 	dma_buf_detach(buf, pin->atch);
@@ -262,6 +298,105 @@ void put_mapping(
 	}
 }
 
+/* caller must hold the table write lock */
+static void
+uncache_mapping_locked(
+	struct capture_buffer_table *tab, struct capture_mapping *pin)
+{
+	list_del_init(&pin->lru);
+	pin->cached = false;
+	tab->cache_cnt--;
+}
+
+static void
+cache_mapping(struct capture_buffer_table *tab, struct capture_mapping *pin)
+{
+	struct capture_mapping *victim = NULL;
+
+	write_lock(&tab->hlock);
+
+	if (tab->cache_size == 0U) {
+		write_unlock(&tab->hlock);
+		return;
+	}
+
+	if (pin->cached) {
+		list_move(&pin->lru, &tab->lru);
+	} else {
+		/* the cache holds its own reference to the mapping */
+		atomic_inc(&pin->refcnt);
+		pin->cached = true;
+		list_add(&pin->lru, &tab->lru);
+		tab->cache_cnt++;
+
+		if (tab->cache_cnt > tab->cache_size) {
+			victim = list_last_entry(&tab->lru,
+					struct capture_mapping, lru);
+			uncache_mapping_locked(tab, victim);
+		}
+	}
+
+	write_unlock(&tab->hlock);
+
+	if (victim != NULL)
+		put_mapping(tab, victim);
+}
+
+static void
+uncache_mapping(struct capture_buffer_table *tab, struct capture_mapping *pin)
+{
+	bool cached;
+
+	write_lock(&tab->hlock);
+	cached = pin->cached;
+	if (cached)
+		uncache_mapping_locked(tab, pin);
+	write_unlock(&tab->hlock);
+
+	if (cached)
+		put_mapping(tab, pin);
+}
+
+void capture_buffer_flush_cache(struct capture_buffer_table *tab)
+{
+	struct capture_mapping *pin;
+
+	do {
+		write_lock(&tab->hlock);
+		pin = list_first_entry_or_null(&tab->lru,
+				struct capture_mapping, lru);
+		if (pin != NULL)
+			uncache_mapping_locked(tab, pin);
+		write_unlock(&tab->hlock);
+
+		if (pin != NULL)
+			put_mapping(tab, pin);
+	} while (pin != NULL);
+}
+
+void capture_buffer_set_cache_size(
+	struct capture_buffer_table *tab, uint32_t size)
+{
+	write_lock(&tab->hlock);
+	tab->cache_size = size;
+	write_unlock(&tab->hlock);
+
+	if (size < tab->cache_cnt)
+		capture_buffer_flush_cache(tab);
+}
+
+void capture_buffer_get_stats(
+	struct capture_buffer_table *tab, struct capture_buffer_stats *stats)
+{
+	spin_lock(&tab->slock);
+	*stats = tab->stats;
+	spin_unlock(&tab->slock);
+
+	read_lock(&tab->hlock);
+	stats->cached = tab->cache_cnt;
+	stats->cache_size = tab->cache_size;
+	read_unlock(&tab->hlock);
+}
 
 static DEFINE_MUTEX(req_lock);
 
@@ -310,6 +445,10 @@ int capture_buffer_request(
 		}
 	}
 
+	/* an unregistered buffer must not stay pinned by the cache */
+	if (!add)
+		uncache_mapping(tab, pin);
+
 	set_mapping_preservation(pin, add);
 	put_mapping(tab, pin);
 
@@ -351,9 +490,12 @@ int capture_common_pin_and_get_iova(struct capture_buffer_table *buf_ctx,
 
 	if (mem_offset >= size) {
 		pr_err("%s: offset is out of bounds\n", __func__);
+		put_mapping(buf_ctx, map);
 		return -EINVAL;
 	}
 
+	cache_mapping(buf_ctx, map);
+
 	*meminfo_base_address = iova + mem_offset;
 	*meminfo_size = size - mem_offset;
 
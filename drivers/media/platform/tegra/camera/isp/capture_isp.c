@@ -13,10 +13,16 @@
  */
 
 #include <linux/completion.h>
+#include <linux/debugfs.h>
+#include <linux/kfifo.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 #include <linux/nospec.h>
 #include <linux/nvhost.h>
 #include <linux/of_platform.h>
+#include <linux/poll.h>
 #include <linux/printk.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
 #include <linux/tegra-capture-ivc.h>
 #include <asm/arch_timer.h>
@@ -33,6 +39,12 @@
 #define CAPTURE_CHANNEL_UNKNOWN_RESP 0xFFFFFFFF
 #define CAPTURE_CHANNEL_ISP_INVALID_ID 0xFFFF
 
+/* surface mappings kept pinned across requests, per channel */
+#define ISP_CAPTURE_PIN_CACHE_SIZE 64U
+
+/* completion events buffered per channel, power of 2 */
+#define ISP_CAPTURE_EVENT_RING_SIZE 256
+
 struct isp_desc_rec {
 	struct capture_common_buf requests;
 	size_t request_buf_size;
@@ -83,6 +95,16 @@ struct isp_capture {
 	struct mutex reset_lock;
 	bool reset_capture_program_flag;
 	bool reset_capture_flag;
+
+	struct dentry *debugfs;
+
+	/* completion event ring, read through the channel fd */
+	DECLARE_KFIFO(events, struct isp_capture_event,
+			ISP_CAPTURE_EVENT_RING_SIZE);
+	spinlock_t events_lock;
+	struct mutex events_read_lock;
+	wait_queue_head_t events_wq;
+	atomic_t events_overruns;
 };
 
 static void isp_capture_ivc_control_callback(const void *ivc_resp,
@@ -123,6 +145,24 @@ static void isp_capture_request_unpin(struct tegra_isp_channel *chan,
 static void isp_capture_program_request_unpin(struct tegra_isp_channel *chan,
 		uint32_t buffer_index);
 
+static void isp_capture_push_event(struct isp_capture *capture,
+		uint32_t type, uint32_t buffer_index)
+{
+	struct isp_capture_event ev = {
+		.type = type,
+		.buffer_index = buffer_index,
+		.timestamp = ktime_get_ns(),
+	};
+	unsigned long flags;
+
+	spin_lock_irqsave(&capture->events_lock, flags);
+	if (!kfifo_put(&capture->events, ev))
+		atomic_set(&capture->events_overruns, 1);
+	spin_unlock_irqrestore(&capture->events_lock, flags);
+
+	wake_up(&capture->events_wq);
+}
+
 static void isp_capture_ivc_status_callback(const void *ivc_resp,
 		const void *pcontext)
 {
@@ -165,6 +205,9 @@ static void isp_capture_ivc_status_callback(const void *ivc_resp,
 			complete(&capture->capture_resp);
 		}
 
+		isp_capture_push_event(capture,
+			ISP_CAPTURE_EVENT_CAPTURE_DONE, buffer_index);
+
 		dev_dbg(chan->isp_dev, "%s: status chan_id %u msg_id %u\n",
 			__func__, status_msg->header.channel_id,
 			status_msg->header.msg_id);
@@ -199,6 +242,9 @@ static void isp_capture_ivc_status_callback(const void *ivc_resp,
 			complete(&capture->capture_program_resp);
 		}
 
+		isp_capture_push_event(capture,
+			ISP_CAPTURE_EVENT_PROGRAM_DONE, buffer_index);
+
 		dev_dbg(chan->isp_dev,
 			"%s: isp_ program status chan_id %u msg_id %u\n",
 			__func__, status_msg->header.channel_id,
@@ -246,6 +292,12 @@ int isp_capture_init(struct tegra_isp_channel *chan)
 	mutex_init(&capture->program_desc_ctx.unpins_list_lock);
 	mutex_init(&capture->reset_lock);
 
+	INIT_KFIFO(capture->events);
+	spin_lock_init(&capture->events_lock);
+	mutex_init(&capture->events_read_lock);
+	init_waitqueue_head(&capture->events_wq);
+	atomic_set(&capture->events_overruns, 0);
+
 	capture->isp_channel = chan;
 	chan->capture_data = capture;
 
@@ -324,6 +376,60 @@ fail:
 	return err;
 }
 
+static int isp_capture_pin_cache_show(struct seq_file *s, void *data)
+{
+	struct isp_capture *capture = s->private;
+	struct capture_buffer_stats stats;
+	uint64_t lookups;
+
+	capture_buffer_get_stats(capture->buffer_ctx, &stats);
+	lookups = stats.hits + stats.misses;
+
+	seq_printf(s, "hits: %llu\n", stats.hits);
+	seq_printf(s, "misses: %llu\n", stats.misses);
+	seq_printf(s, "hit_rate: %llu%%\n", lookups ?
+		div64_u64(stats.hits * 100U, lookups) : 0ULL);
+	seq_printf(s, "pin_avg_ns: %llu\n", lookups ?
+		div64_u64(stats.pin_ns, lookups) : 0ULL);
+	seq_printf(s, "pin_max_ns: %llu\n", stats.pin_max_ns);
+	seq_printf(s, "cached: %u/%u\n", stats.cached, stats.cache_size);
+
+	return 0;
+}
+
+static int isp_capture_pin_cache_open(struct inode *inode, struct file *f)
+{
+	return single_open(f, isp_capture_pin_cache_show, inode->i_private);
+}
+
+static const struct file_operations isp_capture_pin_cache_fops = {
+	.open = isp_capture_pin_cache_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static void isp_capture_debugfs_init(struct tegra_isp_channel *chan)
+{
+	struct isp_capture *capture = chan->capture_data;
+	char name[32];
+
+	if (chan->debugfs == NULL)
+		return;
+
+	snprintf(name, sizeof(name), "pin_cache_ch%u", capture->channel_id);
+	capture->debugfs = debugfs_create_file(name, S_IRUGO, chan->debugfs,
+			capture, &isp_capture_pin_cache_fops);
+}
+
+static void isp_capture_debugfs_remove(struct tegra_isp_channel *chan)
+{
+	struct isp_capture *capture = chan->capture_data;
+
+	debugfs_remove(capture->debugfs);
+	capture->debugfs = NULL;
+}
+
 static int isp_capture_setup_syncpts(struct tegra_isp_channel *chan);
 static void isp_capture_release_syncpts(struct tegra_isp_channel *chan);
 
@@ -454,6 +560,8 @@ int isp_capture_setup(struct tegra_isp_channel *chan,
 		return -ENOMEM;
 	}
 
+	capture_buffer_set_cache_size(buffer_ctx, ISP_CAPTURE_PIN_CACHE_SIZE);
+
 	/* pin the capture descriptor ring buffer to RTCPU */
 	dev_dbg(chan->isp_dev, "%s: descr buffer handle 0x%x\n",
 			__func__, setup->mem);
@@ -639,6 +747,16 @@ int isp_capture_setup(struct tegra_isp_channel *chan,
 
 	capture->buffer_ctx = buffer_ctx;
 
+	/* drop events left over from a previous setup */
+	mutex_lock(&capture->events_read_lock);
+	spin_lock_irq(&capture->events_lock);
+	kfifo_reset(&capture->events);
+	spin_unlock_irq(&capture->events_lock);
+	mutex_unlock(&capture->events_read_lock);
+	atomic_set(&capture->events_overruns, 0);
+
+	isp_capture_debugfs_init(chan);
+
 	return 0;
 
 cb_fail:
@@ -749,6 +867,11 @@ int isp_capture_reset(struct tegra_isp_channel *chan,
 		complete(&capture->capture_resp);
 	}
 
+	capture_buffer_flush_cache(capture->buffer_ctx);
+
+	/* all pending requests are dropped, no further events for them */
+	isp_capture_push_event(capture, ISP_CAPTURE_EVENT_RESET, U32_MAX);
+
 	mutex_unlock(&capture->reset_lock);
 
 	return 0;
@@ -849,6 +972,8 @@ int isp_capture_release(struct tegra_isp_channel *chan,
 		capture_common_release_progress_status_notifier(
 			&capture->progress_status_notifier);
 
+	isp_capture_debugfs_remove(chan);
+
 	destroy_buffer_table(capture->buffer_ctx);
 
 	capture->channel_id = CAPTURE_CHANNEL_ISP_INVALID_ID;
@@ -1179,6 +1304,12 @@ int isp_capture_program_request(struct tegra_isp_channel *chan,
 
 	mutex_unlock(&capture->program_desc_ctx.unpins_list_lock);
 
+	if (err < 0) {
+		dev_err(chan->isp_dev, "%s: get pushbuffer1 iova failed\n",
+			__func__);
+		goto fail;
+	}
+
 	memset(&capture_msg, 0, sizeof(capture_msg));
 	capture_msg.header.msg_id = CAPTURE_ISP_PROGRAM_REQUEST_REQ;
 	capture_msg.header.channel_id = capture->channel_id;
@@ -1191,12 +1322,10 @@ int isp_capture_program_request(struct tegra_isp_channel *chan,
 		dev_err(chan->isp_dev, "IVC program submit failed\n");
 		goto fail;
 	}
-	mutex_unlock(&capture->reset_lock);
 
 	return 0;
 
 fail:
-	mutex_unlock(&capture->reset_lock);
 	isp_capture_program_request_unpin(chan, req->buffer_index);
 	return err;
 }
@@ -1540,6 +1669,104 @@ int isp_capture_request_ex(struct tegra_isp_channel *chan,
 	return ret;
 }
 
+int isp_capture_request_batch(struct tegra_isp_channel *chan,
+		struct isp_capture_req_ex *reqs, uint32_t num_reqs,
+		uint32_t *num_captures, uint32_t *num_programs)
+{
+	uint32_t i;
+	int err = 0;
+
+	*num_captures = 0U;
+	*num_programs = 0U;
+
+	for (i = 0U; i < num_reqs; i++) {
+		if (reqs[i].capture_req.buffer_index != U32_MAX) {
+			err = isp_capture_request(chan, &reqs[i].capture_req);
+			if (err < 0)
+				break;
+		}
+		(*num_captures)++;
+
+		if (reqs[i].program_req.buffer_index != U32_MAX) {
+			err = isp_capture_program_request(chan,
+					&reqs[i].program_req);
+			if (err < 0)
+				break;
+		}
+		(*num_programs)++;
+	}
+
+	return err;
+}
+
+ssize_t isp_capture_read_events(struct tegra_isp_channel *chan,
+		char __user *buf, size_t len, bool nonblock)
+{
+	struct isp_capture *capture = chan->capture_data;
+
+	if (capture == NULL) {
+		dev_err(chan->isp_dev,
+			"%s: isp capture uninitialized\n", __func__);
+		return -ENODEV;
+	}
+
+	if (len < sizeof(struct isp_capture_event))
+		return -EINVAL;
+
+	for (;;) {
+		DEFINE_WAIT(wait);
+		unsigned int copied;
+		int ret;
+
+		if (mutex_lock_interruptible(&capture->events_read_lock))
+			return -ERESTARTSYS;
+
+		ret = kfifo_to_user(&capture->events, buf, len, &copied);
+
+		mutex_unlock(&capture->events_read_lock);
+
+		if (ret)
+			return ret;
+		if (copied > 0)
+			return copied;
+
+		prepare_to_wait(&capture->events_wq, &wait, TASK_INTERRUPTIBLE);
+
+		if (atomic_xchg(&capture->events_overruns, 0))
+			ret = -EOVERFLOW;
+		else if (signal_pending(current))
+			ret = -ERESTARTSYS;
+		else if (nonblock)
+			ret = -EAGAIN;
+		else if (kfifo_is_empty(&capture->events))
+			schedule();
+
+		finish_wait(&capture->events_wq, &wait);
+
+		if (ret)
+			return ret;
+	}
+}
+
+unsigned int isp_capture_poll_events(struct tegra_isp_channel *chan,
+		struct file *file, struct poll_table_struct *table)
+{
+	struct isp_capture *capture = chan->capture_data;
+	unsigned int ret = 0;
+
+	if (capture == NULL)
+		return POLLERR;
+
+	poll_wait(file, &capture->events_wq, table);
+
+	if (!kfifo_is_empty(&capture->events))
+		ret |= POLLIN | POLLRDNORM;
+	if (atomic_read(&capture->events_overruns))
+		ret |= POLLERR;
+
+	return ret;
+}
+
 int isp_capture_set_progress_status_notifier(struct tegra_isp_channel *chan,
 		struct isp_capture_progress_status_req *req)
 {
@@ -20,11 +20,13 @@
 
 #include <asm/ioctls.h>
 #include <linux/cdev.h>
+#include <linux/debugfs.h>
 #include <linux/device.h>
 #include <linux/fs.h>
 #include <linux/of_platform.h>
 #include <linux/module.h>
 #include <linux/nvhost.h>
+#include <linux/poll.h>
 #include <linux/sched.h>
 #include <linux/slab.h>
 #include <linux/stddef.h>
@@ -59,6 +61,8 @@
 		_IOW('I', 10, struct isp_capture_progress_status_req)
 #define ISP_CAPTURE_BUFFER_REQUEST \
 		_IOW('I', 11, struct isp_buffer_req)
+#define ISP_CAPTURE_REQUEST_BATCH \
+		_IOWR('I', 12, struct isp_capture_req_batch)
 
 struct isp_channel_drv {
 	struct device *dev;
@@ -67,6 +71,7 @@ struct isp_channel_drv {
 	struct mutex lock;
 	struct platform_device *ndev;
 	const struct isp_channel_drv_ops *ops;
+	struct dentry *debugfs;
 	struct tegra_isp_channel *channels[];
 };
 
@@ -194,6 +199,40 @@ static long isp_channel_ioctl(struct file *file, unsigned int cmd,
 			dev_err(chan->isp_dev, "isp buffer req failed\n");
 		break;
 	}
+	case _IOC_NR(ISP_CAPTURE_REQUEST_BATCH): {
+		struct isp_capture_req_batch batch;
+		struct isp_capture_req_ex *reqs;
+
+		if (copy_from_user(&batch, ptr, sizeof(batch)))
+			break;
+
+		if (batch.num_reqs == 0U ||
+				batch.num_reqs > ISP_CAPTURE_MAX_BATCH_REQS) {
+			err = -EINVAL;
+			break;
+		}
+
+		reqs = memdup_user((void __user *)(uintptr_t)batch.reqs,
+				batch.num_reqs * sizeof(*reqs));
+		if (IS_ERR(reqs)) {
+			err = PTR_ERR(reqs);
+			break;
+		}
+
+		err = isp_capture_request_batch(chan, reqs, batch.num_reqs,
+				&batch.num_captures_submitted,
+				&batch.num_programs_submitted);
+		kfree(reqs);
+		if (err)
+			dev_err(chan->isp_dev,
+				"isp capture batch failed after %u captures, %u programs\n",
+				batch.num_captures_submitted,
+				batch.num_programs_submitted);
+
+		if (copy_to_user(ptr, &batch, sizeof(batch)))
+			err = -EFAULT;
+		break;
+	}
 	default: {
 		dev_err(chan->isp_dev, "%s:Unknown ioctl\n", __func__);
 		return -ENOIOCTLCMD;
@@ -203,6 +242,23 @@ static long isp_channel_ioctl(struct file *file, unsigned int cmd,
 	return err;
 }
 
+static ssize_t isp_channel_read(struct file *file, char __user *buf,
+				size_t len, loff_t *offset)
+{
+	struct tegra_isp_channel *chan = file->private_data;
+
+	return isp_capture_read_events(chan, buf, len,
+			(file->f_flags & O_NONBLOCK) != 0);
+}
+
+static unsigned int isp_channel_poll(struct file *file,
+				struct poll_table_struct *table)
+{
+	struct tegra_isp_channel *chan = file->private_data;
+
+	return isp_capture_poll_events(chan, file, table);
+}
+
 static int isp_channel_power_on(struct tegra_isp_channel *chan)
 {
 	int ret = 0;
@@ -262,6 +318,7 @@ static int isp_channel_open(struct inode *inode, struct file *file)
 	chan->ndev = chan_drv->ndev;
 	chan->ops = chan_drv->ops;
 	chan->priv = file;
+	chan->debugfs = chan_drv->debugfs;
 
 	err = isp_capture_init(chan);
 	if (err < 0)
@@ -321,6 +378,8 @@ static const struct file_operations isp_channel_fops = {
 #ifdef CONFIG_COMPAT
 	.compat_ioctl = isp_channel_ioctl,
 #endif
+	.read = isp_channel_read,
+	.poll = isp_channel_poll,
 	.open = isp_channel_open,
 	.release = isp_channel_release,
 };
@@ -346,9 +405,14 @@ int isp_channel_drv_register(struct platform_device *ndev,
 	chan_drv->num_channels = MAX_ISP_CHANNELS;
 	mutex_init(&chan_drv->lock);
 
+	chan_drv->debugfs = debugfs_create_dir("capture-isp-channel", NULL);
+	if (IS_ERR_OR_NULL(chan_drv->debugfs))
+		chan_drv->debugfs = NULL;
+
 	mutex_lock(&chdrv_lock);
 	if (WARN_ON(chdrv_ != NULL)) {
 		mutex_unlock(&chdrv_lock);
+		debugfs_remove_recursive(chan_drv->debugfs);
 		kfree(chan_drv);
 		return -EBUSY;
 	}
@@ -383,6 +447,7 @@ void isp_channel_drv_unregister(struct device *dev)
 		device_destroy(isp_channel_class, devt);
 	}
 
+	debugfs_remove_recursive(chan_drv->debugfs);
 	kfree(chan_drv);
 }
 EXPORT_SYMBOL(isp_channel_drv_unregister);
@@ -86,7 +86,8 @@
 #include <linux/iio/buffer_impl.h>
 #endif
 
-#define NVS_IIO_DRIVER_VERSION		(224)
+#define NVS_IIO_DRIVER_VERSION		(226)
+#define NVS_IIO_BATCH_N			(32) /* scans per staged block */
 
 enum NVS_ATTR {
 	NVS_ATTR_ENABLE,
@@ -206,6 +207,8 @@ struct nvs_state {
 	s64 ts_diff;
 	s64 ts;
 	u8 *buf;
+	u8 *buf_batch;
+	unsigned int buf_batch_sz;
 };
 
 struct nvs_iio_ch {
@@ -724,6 +727,130 @@ static int nvs_buf_push(struct iio_dev *indio_dev, unsigned char *data, s64 ts)
 	return ret;
 }
 
+/* Stores n scans of scan_n bytes from data and wakes readers once.
+ * iio_push_to_buffers() wakes the poll queue for every scan, so when the
+ * kfifo is the only buffer and needs no demux the scans go straight to
+ * its store_to.  Otherwise, and on kernels where the buffer internals are
+ * not visible, each scan goes through iio_push_to_buffers().
+ */
+static int nvs_buf_store_n(struct iio_dev *indio_dev, unsigned char *data,
+			   unsigned int scan_n, unsigned int n)
+{
+	unsigned int i;
+	int ret = 0;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 14, 0)
+	struct iio_buffer *buffer = indio_dev->buffer;
+
+	if (list_is_singular(&indio_dev->buffer_list) &&
+	    list_first_entry(&indio_dev->buffer_list, struct iio_buffer,
+			     buffer_list) == buffer &&
+	    bitmap_equal(indio_dev->active_scan_mask, buffer->scan_mask,
+			 indio_dev->masklength)) {
+		for (i = 0; i < n; i++) {
+			ret = buffer->access->store_to(buffer,
+						       &data[i * scan_n]);
+			if (ret)
+				break;
+		}
+		if (i)
+			wake_up_interruptible_poll(&buffer->pollq,
+						   POLLIN | POLLRDNORM);
+		return i ? i : ret;
+	}
+#endif
+
+	for (i = 0; i < n; i++) {
+		ret = iio_push_to_buffers(indio_dev, &data[i * scan_n]);
+		if (ret)
+			break;
+	}
+	return i ? i : ret;
+}
+
+/* Pushes n samples spaced stride bytes apart in data with sample i at
+ * ts[i].  The samples are laid out in one pass into the st->buf_batch
+ * staging block, which is then stored as a whole with one reader wakeup.
+ * A batch larger than the staging block is pushed in several blocks.
+ * On-change, one-shot, debug data lock, first push and spew all need the
+ * per-sample decisions in nvs_buf_push so those fall back to it.
+ */
+static int nvs_buf_push_n(struct iio_dev *indio_dev, unsigned char *data,
+			  unsigned int stride, unsigned int n, s64 *ts)
+{
+	struct nvs_state *st = iio_priv(indio_dev);
+	unsigned int data_chan_n;
+	unsigned int scan_n;
+	unsigned int blk_n;
+	unsigned int src_i;
+	unsigned int ch;
+	unsigned int i;
+	unsigned int pushed = 0;
+	unsigned char *dst;
+	int ret = 0;
+
+	if (!data || !ts)
+		return -EINVAL;
+
+	for (i = 0; i < n; i++) {
+		if (!ts[i])
+			/* flush is only supported through nvs_buf_push */
+			return -EINVAL;
+	}
+
+	scan_n = indio_dev->scan_bytes;
+	if (st->on_change || st->one_shot || st->first_push ||
+	    st->dbg_data_lock || !iio_buffer_enabled(indio_dev) ||
+	    (*st->fn_dev->sts & NVS_STS_SPEW_MSK) || !st->buf_batch ||
+	    !scan_n || scan_n > st->buf_batch_sz) {
+		for (i = 0; i < n; i++) {
+			ret = nvs_buf_push(indio_dev, data, ts[i]);
+			if (ret < 0)
+				return ret;
+
+			data += stride;
+		}
+		return n;
+	}
+
+	if (ts[0] < st->ts)
+		dev_err(st->dev, "%s %s ts_diff=%lld\n",
+			__func__, st->cfg->name, ts[0] - st->ts);
+	data_chan_n = indio_dev->num_channels - 1;
+	while (pushed < n) {
+		blk_n = min(n - pushed, st->buf_batch_sz / scan_n);
+		dst = st->buf_batch;
+		for (i = pushed; i < pushed + blk_n; i++) {
+			src_i = 0;
+			for (ch = 0; ch < data_chan_n; ch++) {
+				if (st->ch[ch].i >= 0) {
+					memcpy(&dst[st->ch[ch].i],
+					       &data[src_i], st->ch[ch].n);
+					src_i += st->ch[ch].n;
+				}
+			}
+			if (indio_dev->buffer->scan_timestamp)
+				memcpy(&dst[st->ch[data_chan_n].i], &ts[i],
+				       st->ch[data_chan_n].n);
+			data += stride;
+			dst += scan_n;
+		}
+
+		ret = nvs_buf_store_n(indio_dev, st->buf_batch, scan_n, blk_n);
+		if (ret <= 0)
+			break;
+
+		pushed += ret;
+		st->ts_diff = ts[pushed - 1] - st->ts;
+		st->ts = ts[pushed - 1]; /* log ts push */
+		if (ret < blk_n)
+			break;
+	}
+	if (pushed)
+		return pushed;
+
+	return ret;
+}
+
 static int nvs_handler(void *handle, void *buffer, s64 ts)
 {
 	struct iio_dev *indio_dev = (struct iio_dev *)handle;
@@ -735,6 +862,17 @@ static int nvs_handler(void *handle, void *buffer, s64 ts)
 	return ret;
 }
 
+static int nvs_handler_batch(void *handle, void *buffer, unsigned int stride,
+			     unsigned int n, s64 *ts)
+{
+	struct iio_dev *indio_dev = (struct iio_dev *)handle;
+	int ret = 0;
+
+	if (indio_dev && n)
+		ret = nvs_buf_push_n(indio_dev, buffer, stride, n, ts);
+	return ret;
+}
+
 static int nvs_enable(struct iio_dev *indio_dev, bool en)
 {
 	struct nvs_state *st = iio_priv(indio_dev);
@@ -1630,6 +1768,20 @@ static int nvs_ch_init(struct nvs_state *st, struct iio_dev *indio_dev)
 	return 0;
 }
 
+static int nvs_buf_alloc(struct nvs_state *st, unsigned int buf_sz)
+{
+	st->buf = devm_kzalloc(st->dev, (size_t)buf_sz, GFP_KERNEL);
+	if (st->buf == NULL)
+		return -ENOMEM;
+
+	/* without the staging block batches are pushed per sample */
+	st->buf_batch = devm_kcalloc(st->dev, NVS_IIO_BATCH_N, buf_sz,
+				     GFP_KERNEL);
+	if (st->buf_batch)
+		st->buf_batch_sz = NVS_IIO_BATCH_N * buf_sz;
+	return 0;
+}
+
 static int nvs_chan(struct iio_dev *indio_dev)
 {
 	struct nvs_state *st = iio_priv(indio_dev);
@@ -1651,8 +1803,7 @@ static int nvs_chan(struct iio_dev *indio_dev)
 		for (i = 0; i < st->cfg->ch_n; i++)
 			nvs_buf_index(indio_dev->channels[i].
 				      scan_type.storagebits / 8, &buf_sz);
-		st->buf = devm_kzalloc(st->dev, buf_sz, GFP_KERNEL);
-		if (st->buf == NULL)
+		if (nvs_buf_alloc(st, buf_sz))
 			return -ENOMEM;
 
 		return nvs_ch_init(st, indio_dev);
@@ -1759,8 +1910,7 @@ static int nvs_chan(struct iio_dev *indio_dev)
 	st->chs[i].scan_index = i;
 	nvs_buf_index(st->chs[i].scan_type.storagebits / 8, &buf_sz);
 	i++;
-	st->buf = devm_kzalloc(st->dev, (size_t)buf_sz, GFP_KERNEL);
-	if (st->buf == NULL)
+	if (nvs_buf_alloc(st, buf_sz))
 		return -ENOMEM;
 
 	indio_dev->channels = st->chs;
@@ -1996,6 +2146,8 @@ static int nvs_probe(void **handle, void *dev_client, struct device *dev,
 			devm_kfree(st->dev, st->ch);
 		if (st->buf)
 			devm_kfree(st->dev, st->buf);
+		if (st->buf_batch)
+			devm_kfree(st->dev, st->buf_batch);
 		nvs_remove(indio_dev);
 		return ret;
 	}
@@ -2017,6 +2169,7 @@ static struct nvs_fn_if nvs_fn_if_iio = {
 	.suspend			= nvs_suspend,
 	.resume				= nvs_resume,
 	.handler			= nvs_handler,
+	.handler_batch			= nvs_handler_batch,
 };
 
 struct nvs_fn_if *nvs_iio(void)
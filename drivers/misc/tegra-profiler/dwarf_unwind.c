@@ -1,7 +1,7 @@
 /*
  * drivers/misc/tegra-profiler/dwarf_unwind.c
  *
- * Copyright (c) 2015-2018, NVIDIA CORPORATION.  All rights reserved.
+ * Copyright (c) 2015-2020, NVIDIA CORPORATION.  All rights reserved.
  *
  * This program is free software; you can redistribute it and/or modify it
  * under the terms and conditions of the GNU General Public License,
@@ -21,6 +21,13 @@
 #include <linux/slab.h>
 #include <linux/uaccess.h>
 #include <linux/err.h>
+#include <linux/hash.h>
+#include <linux/math64.h>
+#include <linux/mutex.h>
+#include <linux/version.h>
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 11, 0))
+#include <linux/sched/clock.h>
+#endif
 
 #include <asm/unaligned.h>
 
@@ -119,6 +126,7 @@ struct stackframe {
 	struct regs_state rs_initial;
 
 	unsigned long cfa;
+	unsigned long pc_row;	/* start of the CFA row that covers pc */
 
 	int mode;
 	int is_sched;
@@ -132,9 +140,52 @@ struct dwarf_cpu_context {
 	int dw_ptr_size;
 };
 
+/*
+ * Resolved unwind rules for one CFA row, i.e. for the pc range
+ * [start, end) of a region.  Only the rules unwind_frame() acts on are kept:
+ * the CFA definition and the CFA-relative saved registers.
+ */
+struct dw_rules {
+	long cfa_offset;
+	int cfa_register;
+
+	u32 cfarel_mask;
+	s32 offset[QUADD_NUM_REGS];
+};
+
+struct dw_rules_entry {
+	pid_t pid;
+	int is_eh;
+	unsigned int gen;
+
+	unsigned long region_id;
+	unsigned long start;
+	unsigned long end;
+
+	struct dw_rules rules;
+};
+
+#define DW_RULES_CACHE_BITS	7
+#define DW_RULES_CACHE_SIZE	(1 << DW_RULES_CACHE_BITS)
+
+struct dw_rules_cache {
+	struct dw_rules_entry entries[DW_RULES_CACHE_SIZE];
+
+	u64 nr_hits;
+	u64 nr_misses;
+
+	u64 nr_samples;
+	u64 total_time;
+};
+
 struct quadd_dwarf_context {
 	struct dwarf_cpu_context __percpu *cpu_ctx;
+	struct dw_rules_cache __percpu *rules_cache;
+	atomic_t rules_gen;
 	atomic_t started;
+
+	/* serializes start/stop against the statistics readers */
+	struct mutex lock;
 };
 
 struct dw_cie {
@@ -831,6 +882,8 @@ dwarf_cfa_exec_insns(struct ex_region_info *ri,
 	c_insn = insn_start;
 
 	while (c_insn < insn_end && sf->pc <= pc) {
+		sf->pc_row = sf->pc;
+
 		insn = read_mmap_data_u8(ri, c_insn++,
 					 secid, &err);
 		if (err)
@@ -1812,10 +1865,105 @@ dwarf_decode(struct ex_region_info *ri,
 	return 0;
 }
 
-static long def_cfa(struct stackframe *sf, struct regs_state *rs)
+static unsigned long rules_cache_hash(pid_t pid, unsigned long pc)
 {
-	int reg = rs->cfa_register;
+	return hash_long(pc ^ (unsigned long)pid, DW_RULES_CACHE_BITS);
+}
+
+static struct dw_rules_entry *
+rules_cache_lookup(struct ex_region_info *ri, unsigned long pc, pid_t pid)
+{
+	struct dw_rules_entry *e;
+	struct dw_rules_cache *cache = this_cpu_ptr(ctx.rules_cache);
+
+	e = &cache->entries[rules_cache_hash(pid, pc)];
 
+	if (e->region_id == ri->id && e->pid == pid &&
+	    e->gen == atomic_read(&ctx.rules_gen) &&
+	    pc >= e->start && pc < e->end) {
+		cache->nr_hits++;
+		return e;
+	}
+
+	cache->nr_misses++;
+	return NULL;
+}
+
+static void
+rules_cache_store(struct ex_region_info *ri, unsigned long pc, pid_t pid,
+		  int is_eh, unsigned long start, unsigned long end,
+		  const struct dw_rules *rules)
+{
+	struct dw_rules_entry *e;
+	struct dw_rules_cache *cache = this_cpu_ptr(ctx.rules_cache);
+
+	e = &cache->entries[rules_cache_hash(pid, pc)];
+
+	e->pid = pid;
+	e->is_eh = is_eh;
+	e->gen = atomic_read(&ctx.rules_gen);
+	e->region_id = ri->id;
+	e->start = start;
+	e->end = end;
+	e->rules = *rules;
+}
+
+/*
+ * Returns 0 if the rules fit the compact cache representation,
+ * otherwise the rules are still filled in but must not be cached.
+ */
+static int
+rules_from_state(struct dw_rules *rules, struct regs_state *rs, int mode)
+{
+	int i, num_regs, cacheable = 1;
+
+	num_regs = (mode == DW_MODE_ARM32) ?
+		QUADD_AARCH32_REGISTERS :
+		QUADD_AARCH64_REGISTERS;
+
+	rules->cfa_register = rs->cfa_register;
+	rules->cfa_offset = rs->cfa_offset;
+	rules->cfarel_mask = 0;
+
+	for (i = 0; i < num_regs; i++) {
+		switch (rs->reg[i].where) {
+		case DW_WHERE_UNDEF:
+			break;
+
+		case DW_WHERE_SAME:
+			break;
+
+		case DW_WHERE_CFAREL:
+			if (rs->reg[i].loc.offset != (s32)rs->reg[i].loc.offset)
+				cacheable = 0;
+
+			rules->cfarel_mask |= 1U << i;
+			rules->offset[i] = rs->reg[i].loc.offset;
+			break;
+
+		default:
+			pr_err_once("[r%d] error: unsupported rule (%d)\n",
+				    i, rs->reg[i].where);
+			break;
+		}
+	}
+
+	return cacheable ? 0 : -ERANGE;
+}
+
+static long
+apply_rules(struct stackframe *sf,
+	    const struct dw_rules *rules,
+	    struct vm_area_struct *vma_sp)
+{
+	int i, reg;
+	long err;
+	unsigned long addr, return_addr, val, user_reg_size;
+	int mode = sf->mode;
+
+	user_reg_size = get_user_reg_size(mode);
+
+	reg = rules->cfa_register;
 	if (reg >= 0) {
 		if (reg >= QUADD_NUM_REGS)
 			return -QUADD_URC_TBL_IS_CORRUPT;
@@ -1824,8 +1972,45 @@ static long def_cfa(struct stackframe *sf, struct regs_state *rs)
 		sf->cfa = sf->vregs[reg];
 	}
 
-	sf->cfa += rs->cfa_offset;
-	pr_debug("cfa += %#lx (%#lx)\n", rs->cfa_offset, sf->cfa);
+	sf->cfa += rules->cfa_offset;
+	pr_debug("cfa += %#lx (%#lx)\n", rules->cfa_offset, sf->cfa);
+
+	for (i = 0; i < QUADD_NUM_REGS; i++) {
+		if (!(rules->cfarel_mask & (1U << i)))
+			continue;
+
+		addr = sf->cfa + rules->offset[i];
+
+		if (!validate_stack_addr(addr, vma_sp, user_reg_size,
+					 mode != DW_MODE_ARM32))
+			return -QUADD_URC_SP_INCORRECT;
+
+		if (mode == DW_MODE_ARM32) {
+			u32 val32;
+
+			err = read_user_data(&val32, (void __user *)addr,
+					     sizeof(u32));
+			val = val32;
+		} else {
+			err = read_user_data(&val, (void __user *)addr,
+					     sizeof(unsigned long));
+		}
+
+		if (err < 0)
+			return err;
+
+		sf->vregs[i] = val;
+		pr_debug("[r%d] DW_WHERE_CFAREL: new val: %#lx\n", i, val);
+	}
+
+	return_addr = sf->vregs[regnum_lr(mode)];
+	pr_debug("return_addr: %#lx\n", return_addr);
+
+	if (!validate_pc_addr(return_addr, user_reg_size))
+		return -QUADD_URC_PC_INCORRECT;
+
+	sf->pc = return_addr;
+	sf->vregs[regnum_sp(mode)] = sf->cfa;
 
 	return 0;
 }
@@ -1837,21 +2022,22 @@ unwind_frame(struct ex_region_info *ri,
 	     int is_eh,
 	     struct task_struct *task)
 {
-	int i, num_regs;
 	long err;
 	unsigned char *insn_end;
-	unsigned long addr, return_addr, val, user_reg_size;
+	unsigned long row_end;
 	struct dw_fde fde;
 	struct dw_cie cie;
-	unsigned long pc = sf->pc;
+	struct dw_rules rules;
+	unsigned long pc = sf->pc, row_start;
 	struct regs_state *rs, *rs_initial;
-	int mode = sf->mode;
+	int cacheable, mode = sf->mode;
 
 	err = dwarf_decode(ri, sf, &cie, &fde, pc, is_eh, task);
 	if (err < 0)
 		return err;
 
 	sf->pc = fde.initial_location;
+	sf->pc_row = fde.initial_location;
 
 	rs = &sf->rs;
 	rs_initial = &sf->rs_initial;
@@ -1879,17 +2065,15 @@ unwind_frame(struct ex_region_info *ri,
 			return err;
 	}
 
+	/* the rules hold until the next advance or the end of the FDE */
+	row_end = sf->pc > pc ? sf->pc :
+		  fde.initial_location + fde.address_range;
+
 	pr_debug("mode: %s\n", (mode == DW_MODE_ARM32) ? "arm32" : "arm64");
 	pr_debug("initial cfa: %#lx\n", sf->cfa);
 
-	user_reg_size = get_user_reg_size(mode);
-
-	err = def_cfa(sf, rs);
-	if (err < 0)
-		return err;
-
-	pr_debug("pc: %#lx, exec pc: %#lx, lr: %#lx\n",
-		 pc, sf->pc, sf->vregs[regnum_lr(mode)]);
+	pr_debug("pc: %#lx, row: %#lx - %#lx, lr: %#lx\n",
+		 pc, sf->pc_row, row_end, sf->vregs[regnum_lr(mode)]);
 
 	pr_debug("sp: %#lx, fp: %#lx, fp_thumb: %#lx\n",
 		 sf->vregs[regnum_sp(mode)],
@@ -1914,65 +2098,20 @@ unwind_frame(struct ex_region_info *ri,
 	pr_debug("cfa_offset: %ld (%#lx)\n",
 		 rs->cfa_offset, rs->cfa_offset);
 	pr_debug("cfa_register: %u\n", rs->cfa_register);
-	pr_debug("new cfa: %#lx\n", sf->cfa);
-
-	num_regs = (mode == DW_MODE_ARM32) ?
-		QUADD_AARCH32_REGISTERS :
-		QUADD_AARCH64_REGISTERS;
-
-	for (i = 0; i < num_regs; i++) {
-		switch (rs->reg[i].where) {
-		case DW_WHERE_UNDEF:
-			break;
-
-		case DW_WHERE_SAME:
-			break;
 
-		case DW_WHERE_CFAREL:
-			addr = sf->cfa + rs->reg[i].loc.offset;
-
-			if (!validate_stack_addr(addr, vma_sp, user_reg_size,
-						 mode != DW_MODE_ARM32))
-				return -QUADD_URC_SP_INCORRECT;
-
-			if (mode == DW_MODE_ARM32) {
-				u32 val32;
-
-				err = read_user_data(&val32,
-						     (void __user *)addr,
-						     sizeof(u32));
-				val = val32;
-			} else {
-				err = read_user_data(&val, (void __user *)addr,
-						     sizeof(unsigned long));
-			}
-
-			if (err < 0)
-				return err;
-
-			sf->vregs[i] = val;
-			pr_debug("[r%d] DW_WHERE_CFAREL: new val: %#lx\n",
-				 i, val);
-
-			break;
-
-		default:
-			pr_err_once("[r%d] error: unsupported rule (%d)\n",
-				    i, rs->reg[i].where);
-			break;
-		}
-	}
-
-	return_addr = sf->vregs[regnum_lr(mode)];
-	pr_debug("return_addr: %#lx\n", return_addr);
+	cacheable = !rules_from_state(&rules, rs, mode);
+	row_start = sf->pc_row;
 
-	if (!validate_pc_addr(return_addr, user_reg_size))
-		return -QUADD_URC_PC_INCORRECT;
+	err = apply_rules(sf, &rules, vma_sp);
+	if (err < 0)
+		return err;
 
-	sf->pc = return_addr;
-	sf->vregs[regnum_sp(mode)] = sf->cfa;
+	/* cache only the rules that produced a valid frame */
+	if (cacheable)
+		rules_cache_store(ri, pc, task_tgid_nr(task), is_eh,
+				  row_start, row_end, &rules);
 
-	return 0;
+	return err;
 }
 
 static void
@@ -1995,6 +2134,7 @@ unwind_backtrace(struct quadd_callchain *cc,
 		int nr_added, is_stack_ok;
 		int __is_eh, __is_debug;
 		struct vm_area_struct *vma_pc;
+		struct dw_rules_entry *rule;
 		unsigned long addr, where = sf->pc;
 		struct mm_struct *mm = task->mm;
 
@@ -2034,6 +2174,19 @@ unwind_backtrace(struct quadd_callchain *cc,
 			prev_ri = ri = &ri_new;
 		}
 
+		rule = rules_cache_lookup(ri, sf->pc, task_tgid_nr(task));
+		if (rule) {
+			is_eh = rule->is_eh;
+
+			err = apply_rules(sf, &rule->rules, vma_sp);
+			if (err < 0) {
+				cc->urc_dwarf = -err;
+				break;
+			}
+
+			goto frame_done;
+		}
+
 		if (!is_fde_entry_exist(ri, sf->pc, &__is_eh,
 					&__is_debug, task)) {
 			pr_debug("eh/debug fde entries are not existed\n");
@@ -2066,6 +2219,7 @@ unwind_backtrace(struct quadd_callchain *cc,
 			}
 		}
 
+frame_done:
 		unw_type = is_eh ? QUADD_UNW_TYPE_DWARF_EH :
 				   QUADD_UNW_TYPE_DWARF_DF;
 
@@ -2132,8 +2286,10 @@ quadd_get_user_cc_dwarf(struct quadd_event_context *event_ctx,
 			struct quadd_callchain *cc)
 {
 	long err;
+	u64 time_start;
 	int mode, nr_prev = cc->nr;
 	unsigned long ip, lr, sp, fp, fp_thumb;
+	struct dw_rules_cache *cache;
 	struct vm_area_struct *vma, *vma_sp;
 	struct ex_region_info ri;
 	struct stackframe *sf;
@@ -2219,9 +2375,15 @@ quadd_get_user_cc_dwarf(struct quadd_event_context *event_ctx,
 		return 0;
 	}
 
+	time_start = local_clock();
+
 	unwind_backtrace(cc, &ri, sf, vma_sp, task);
 	quadd_put_dw_frames(&ri);
 
+	cache = this_cpu_ptr(ctx.rules_cache);
+	cache->total_time += local_clock() - time_start;
+	cache->nr_samples++;
+
 	pr_debug("%s: pid: %u: mode: %s, cc->nr: %d --> %d\n",
 		 __func__, task_tgid_nr(task),
 		 (mode == DW_MODE_ARM32) ? "arm32" : "arm64",
@@ -2230,27 +2392,95 @@ quadd_get_user_cc_dwarf(struct quadd_event_context *event_ctx,
 	return cc->nr;
 }
 
+/*
+ * Cached rules are keyed by region id, which is never reused, so unmapped
+ * regions simply stop matching.  An exec keeps the pid but replaces the
+ * whole image, so drop everything cached until the regions are re-sent.
+ */
+void quadd_dwarf_unwind_invalidate(void)
+{
+	atomic_inc(&ctx.rules_gen);
+}
+
+void quadd_dwarf_unwind_get_stat(unsigned int *hit_rate,
+				 unsigned int *avg_time)
+{
+	int cpu_id;
+	u64 hits = 0, misses = 0, samples = 0, time = 0;
+	struct dw_rules_cache *cache;
+
+	*hit_rate = 0;
+	*avg_time = 0;
+
+	mutex_lock(&ctx.lock);
+
+	if (!atomic_read(&ctx.started)) {
+		mutex_unlock(&ctx.lock);
+		return;
+	}
+
+	for_each_possible_cpu(cpu_id) {
+		cache = per_cpu_ptr(ctx.rules_cache, cpu_id);
+
+		hits += cache->nr_hits;
+		misses += cache->nr_misses;
+		samples += cache->nr_samples;
+		time += cache->total_time;
+	}
+
+	mutex_unlock(&ctx.lock);
+
+	if (hits + misses)
+		*hit_rate = div64_u64(hits * 1000, hits + misses);
+
+	if (samples)
+		*avg_time = div64_u64(time, samples);
+}
+
 int quadd_dwarf_unwind_start(void)
 {
+	int err = 0;
+
+	mutex_lock(&ctx.lock);
+
 	if (!atomic_cmpxchg(&ctx.started, 0, 1)) {
 		ctx.cpu_ctx = alloc_percpu(struct dwarf_cpu_context);
 		if (!ctx.cpu_ctx) {
 			atomic_set(&ctx.started, 0);
-			return -ENOMEM;
+			err = -ENOMEM;
+			goto out;
+		}
+
+		ctx.rules_cache = alloc_percpu(struct dw_rules_cache);
+		if (!ctx.rules_cache) {
+			free_percpu(ctx.cpu_ctx);
+			atomic_set(&ctx.started, 0);
+			err = -ENOMEM;
+			goto out;
 		}
 	}
 
-	return 0;
+out:
+	mutex_unlock(&ctx.lock);
+	return err;
 }
 
 void quadd_dwarf_unwind_stop(void)
 {
-	if (atomic_cmpxchg(&ctx.started, 1, 0))
+	mutex_lock(&ctx.lock);
+
+	if (atomic_cmpxchg(&ctx.started, 1, 0)) {
+		free_percpu(ctx.rules_cache);
 		free_percpu(ctx.cpu_ctx);
+	}
+
+	mutex_unlock(&ctx.lock);
 }
 
 int quadd_dwarf_unwind_init(void)
 {
+	mutex_init(&ctx.lock);
 	atomic_set(&ctx.started, 0);
+	atomic_set(&ctx.rules_gen, 0);
 	return 0;
 }
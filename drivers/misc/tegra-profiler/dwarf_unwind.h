@@ -1,7 +1,7 @@
 /*
  * drivers/misc/tegra-profiler/dwarf_unwind.h
  *
- * Copyright (c) 2015-2017, NVIDIA CORPORATION.  All rights reserved.
+ * Copyright (c) 2015-2020, NVIDIA CORPORATION.  All rights reserved.
  *
  * This program is free software; you can redistribute it and/or modify it
  * under the terms and conditions of the GNU General Public License,
@@ -28,6 +28,10 @@ unsigned int
 quadd_get_user_cc_dwarf(struct quadd_event_context *event_ctx,
 			struct quadd_callchain *cc);
 
+void quadd_dwarf_unwind_invalidate(void);
+void quadd_dwarf_unwind_get_stat(unsigned int *hit_rate,
+				 unsigned int *avg_time);
+
 int quadd_dwarf_unwind_start(void);
 void quadd_dwarf_unwind_stop(void);
 int quadd_dwarf_unwind_init(void);
@@ -68,6 +68,8 @@ struct quadd_unwind_ctx {
 
 	struct list_head mm_ex_list;
 	raw_spinlock_t mm_ex_list_lock;
+
+	atomic_long_t ex_region_id;
 };
 
 struct unwind_idx {
@@ -802,6 +804,7 @@ int quadd_unwind_set_extab(struct quadd_sections *extabs,
 	ri_entry.vm_end = extabs->vm_end;
 	ri_entry.file_hash = extabs->file_hash;
 	ri_entry.mmap = mmap;
+	ri_entry.id = atomic_long_inc_return(&ctx.ex_region_id);
 
 	mmap_ex_entry = kzalloc(sizeof(*mmap_ex_entry), GFP_ATOMIC);
 	if (!mmap_ex_entry) {
@@ -1608,6 +1611,7 @@ int quadd_unwind_init(struct quadd_ctx *quadd_ctx)
 
 	INIT_LIST_HEAD(&ctx.mm_ex_list);
 	raw_spin_lock_init(&ctx.mm_ex_list_lock);
+	atomic_long_set(&ctx.ex_region_id, 0);
 
 	return 0;
 }
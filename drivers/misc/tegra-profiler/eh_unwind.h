@@ -49,6 +49,7 @@ struct ex_region_info {
 	struct quadd_mmap_area *mmap;
 
 	u32 file_hash;
+	unsigned long id;	/* unique per registration, never reused */
 };
 
 unsigned int
@@ -45,6 +45,7 @@
 #include "power_clk.h"
 #include "tegra.h"
 #include "debug.h"
+#include "dwarf_unwind.h"
 
 static struct quadd_hrt_ctx hrt = {
 	.active = ATOMIC_INIT(0),
@@ -897,6 +898,9 @@ void __quadd_event_comm(struct task_struct *task, bool exec)
 	if (!is_profile_process(task))
 		return;
 
+	if (exec)
+		quadd_dwarf_unwind_invalidate();
+
 	put_comm_sample(task, exec);
 }
 
@@ -35,6 +35,7 @@
 #include "version.h"
 #include "quadd_proc.h"
 #include "eh_unwind.h"
+#include "dwarf_unwind.h"
 #include "uncore_events.h"
 
 #ifdef CONFIG_ARCH_TEGRA_19x_SOC
@@ -583,6 +584,10 @@ void quadd_get_state(struct quadd_module_state *state)
 
 	quadd_hrt_get_state(state);
 
+	quadd_dwarf_unwind_get_stat(
+		&state->reserved[QUADD_MOD_STATE_IDX_DW_CACHE_HIT_RATE],
+		&state->reserved[QUADD_MOD_STATE_IDX_DW_UNWIND_AVG_TIME]);
+
 	if (ctx.comm->is_active())
 		status |= QUADD_MOD_STATE_STATUS_IS_ACTIVE;
 
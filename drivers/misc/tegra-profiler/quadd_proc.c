@@ -209,6 +209,11 @@ static int show_status(struct seq_file *f, void *offset)
 	seq_printf(f, "auth:            %s\n", YES_NO(is_auth_open));
 	seq_printf(f, "all samples:     %llu\n", s.nr_all_samples);
 	seq_printf(f, "skipped samples: %llu\n", s.nr_skipped_samples);
+	seq_printf(f, "dwarf cache hit: %u.%u%%\n",
+		   s.reserved[QUADD_MOD_STATE_IDX_DW_CACHE_HIT_RATE] / 10,
+		   s.reserved[QUADD_MOD_STATE_IDX_DW_CACHE_HIT_RATE] % 10);
+	seq_printf(f, "dwarf unwind:    %u ns/sample\n",
+		   s.reserved[QUADD_MOD_STATE_IDX_DW_UNWIND_AVG_TIME]);
 
 	return 0;
 }
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2018, NVIDIA CORPORATION.  All rights reserved.
+ * Copyright (c) 2018-2020, NVIDIA CORPORATION.  All rights reserved.
  *
  * This software is licensed under the terms of the GNU General Public
  * License version 2, as published by the Free Software Foundation, and
@@ -28,11 +28,27 @@
 #include <linux/mutex.h>
 #include <linux/mtd/mtd.h>
 #include <linux/completion.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+#include <linux/bitops.h>
 #include <linux/mtd/partitions.h>
 #include <linux/tegra-ivc.h>
 #include <soc/tegra/chip-id.h>
 #include <tegra_virt_storage_spec.h>
 
+#define MAX_VMTD_REQS 16
+
+struct vmtd_req {
+	struct vs_request vs_req;
+	void *mempool_virt;
+	uint32_t mempool_offset;
+	uint32_t mempool_len;
+	uint32_t id;
+	int32_t status;
+	bool submitted;			/* Sent, response not seen yet */
+	struct completion done;
+};
+
 struct vmtd_dev {
 	struct vs_config_info config;
 	uint64_t size;                   /* Device size in bytes */
@@ -42,11 +58,21 @@ struct vmtd_dev {
 	struct tegra_hv_ivm_cookie *ivmk;
 	struct device *device;
 	void *shared_buffer;
-	struct mutex lock;
+	struct mutex lock;		/* Serializes use of the ivc channel */
 	struct completion msg_complete;
 	void *cmd_frame;
 	struct mtd_info mtd;
 	bool is_setup;
+	struct work_struct work;	/* Drains responses from the channel */
+	struct workqueue_struct *wq;
+	struct vmtd_req reqs[MAX_VMTD_REQS];
+	DECLARE_BITMAP(pending_reqs, MAX_VMTD_REQS);
+	uint32_t inflight_reqs;
+	uint32_t max_requests;
+	struct mutex req_lock;
+	wait_queue_head_t req_wq;	/* Waiters for a free request */
+	bool suspended;
+	struct completion req_queue_empty;
 };
 
 #define IVC_RESET_RETRIES 30
@@ -61,91 +87,295 @@ static irqreturn_t ivc_irq_handler(int irq, void *data)
 	struct vmtd_dev *vmtddev = (struct vmtd_dev *)data;
 
 	complete(&vmtddev->msg_complete);
+
+	/* Data responses are drained once the request table is set up */
+	if (vmtddev->max_requests)
+		queue_work_on(WORK_CPU_UNBOUND, vmtddev->wq, &vmtddev->work);
 	return IRQ_HANDLED;
 }
 
-static int vmtd_send_cmd(struct vmtd_dev *vmtddev, struct vs_request *vs_req)
+/**
+ * vmtd_get_req: Get a handle to a free request and its mempool region.
+ */
+static struct vmtd_req *vmtd_get_req(struct vmtd_dev *vmtddev)
 {
-	/* This while loop exits as long as the remote endpoint cooperates. */
-	while (tegra_hv_ivc_channel_notified(vmtddev->ivck) != 0) {
-		wait_for_completion(&vmtddev->msg_complete);
-	}
+	struct vmtd_req *req = NULL;
+	unsigned long bit;
 
-	while (!tegra_hv_ivc_can_write(vmtddev->ivck)) {
-		wait_for_completion(&vmtddev->msg_complete);
-	}
+	mutex_lock(&vmtddev->req_lock);
 
-	if (tegra_hv_ivc_write(vmtddev->ivck, vs_req,
-		sizeof(struct vs_request)) != sizeof(struct vs_request)) {
-		dev_err(vmtddev->device, "Request sending failed!\n");
-		return -EIO;
+	if (vmtddev->suspended)
+		goto exit;
+
+	bit = find_first_zero_bit(vmtddev->pending_reqs, vmtddev->max_requests);
+	if (bit < vmtddev->max_requests) {
+		req = &vmtddev->reqs[bit];
+		memset(&req->vs_req, 0, sizeof(struct vs_request));
+		req->vs_req.req_id = bit;
+		req->status = 0;
+		req->submitted = false;
+		reinit_completion(&req->done);
+		set_bit(bit, vmtddev->pending_reqs);
+		vmtddev->inflight_reqs++;
 	}
 
-	return 0;
+exit:
+	mutex_unlock(&vmtddev->req_lock);
+	return req;
 }
 
-static int vmtd_get_resp(struct vmtd_dev *vmtddev, struct vs_request *vs_req)
+static struct vmtd_req *vmtd_get_req_by_id(struct vmtd_dev *vmtddev,
+		uint32_t id)
 {
-	/* This while loop exits as long as the remote endpoint cooperates. */
-	while (tegra_hv_ivc_channel_notified(vmtddev->ivck) != 0) {
-		wait_for_completion(&vmtddev->msg_complete);
+	struct vmtd_req *req = NULL;
+
+	if (id >= vmtddev->max_requests)
+		return NULL;
+
+	mutex_lock(&vmtddev->req_lock);
+	if (test_bit(id, vmtddev->pending_reqs))
+		req = &vmtddev->reqs[id];
+	mutex_unlock(&vmtddev->req_lock);
+
+	return req;
+}
+
+/**
+ * vmtd_put_req: Free an active request.
+ */
+static void vmtd_put_req(struct vmtd_dev *vmtddev, struct vmtd_req *req)
+{
+	mutex_lock(&vmtddev->req_lock);
+	if (test_and_clear_bit(req->id, vmtddev->pending_reqs)) {
+		vmtddev->inflight_reqs--;
+		if ((vmtddev->inflight_reqs == 0) && vmtddev->suspended)
+			complete(&vmtddev->req_queue_empty);
+	} else {
+		dev_err(vmtddev->device, "Request index %d is not active!\n",
+			req->id);
+	}
+	mutex_unlock(&vmtddev->req_lock);
+
+	wake_up(&vmtddev->req_wq);
+}
+
+/*
+ * A reset from the peer drops the requests it has not answered yet; fail
+ * them instead of waiting for responses that will never come.
+ */
+static void vmtd_fail_submitted(struct vmtd_dev *vmtddev)
+{
+	struct vmtd_req *req;
+	unsigned long bit;
+
+	mutex_lock(&vmtddev->req_lock);
+	for_each_set_bit(bit, vmtddev->pending_reqs, vmtddev->max_requests) {
+		req = &vmtddev->reqs[bit];
+		if (!req->submitted)
+			continue;
+
+		dev_err(vmtddev->device, "ivc reset, dropping req %lu\n", bit);
+		req->submitted = false;
+		req->status = -EIO;
+		complete(&req->done);
 	}
+	mutex_unlock(&vmtddev->req_lock);
+}
+
+/*
+ * Advance the channel reset handshake, called with vmtddev->lock held.
+ * Returns true once the channel is established.
+ */
+static bool vmtd_channel_ready(struct vmtd_dev *vmtddev)
+{
+	if (tegra_hv_ivc_channel_notified(vmtddev->ivck) == 0)
+		return true;
 
-	while (!tegra_hv_ivc_can_read(vmtddev->ivck)) {
+	vmtd_fail_submitted(vmtddev);
+	return false;
+}
+
+static int vmtd_send_cmd(struct vmtd_dev *vmtddev, struct vs_request *vs_req)
+{
+	/*
+	 * Every interrupt completes msg_complete, so re-arm it before looking
+	 * at the channel; a stale count would turn this into a busy loop.
+	 * This loop exits as long as the remote endpoint cooperates.
+	 */
+	for (;;) {
+		reinit_completion(&vmtddev->msg_complete);
+		if (vmtd_channel_ready(vmtddev) &&
+				tegra_hv_ivc_can_write(vmtddev->ivck))
+			break;
 		wait_for_completion(&vmtddev->msg_complete);
 	}
 
-	if (tegra_hv_ivc_read(vmtddev->ivck, vs_req,
+	if (tegra_hv_ivc_write(vmtddev->ivck, vs_req,
 		sizeof(struct vs_request)) != sizeof(struct vs_request)) {
-		dev_err(vmtddev->device, "Response fetching failed!\n");
+		dev_err(vmtddev->device, "Request sending failed!\n");
 		return -EIO;
 	}
 
 	return 0;
 }
 
-static int vmtd_process_request(struct vmtd_dev *vmtddev,
-	struct vs_request *vs_req)
+static int vmtd_check_resp(struct vmtd_dev *vmtddev,
+	struct vs_request *vs_req, struct vs_request *resp)
 {
 	uint32_t num_bytes = vs_req->mtddev_req.mtd_req.size;
 	loff_t offset = vs_req->mtddev_req.mtd_req.offset;
-	int32_t ret = 0;
 
-	ret = vmtd_send_cmd(vmtddev, vs_req);
-	if (ret != 0) {
-		dev_err(vmtddev->device,
-			"Sending %d failed!\n",
-			vs_req->mtddev_req.req_op);
-		goto fail;
-	}
-
-	vs_req = (struct vs_request *)vmtddev->cmd_frame;
-	ret = vmtd_get_resp(vmtddev, vs_req);
-	if (ret != 0) {
-		dev_err(vmtddev->device,
-			"fetching response failed!\n");
-		goto fail;
-	}
-
-	if ((vs_req->status != 0) ||
-		(vs_req->mtddev_resp.mtd_resp.status != 0)) {
+	if ((resp->status != 0) ||
+		(resp->mtddev_resp.mtd_resp.status != 0)) {
 		dev_err(vmtddev->device,
 			"Response status for offset %llx size %x failed!\n",
 			offset, num_bytes);
-		ret = -EIO;
-		goto fail;
+		return -EIO;
 	}
 
-	if (vs_req->mtddev_resp.mtd_resp.size != num_bytes) {
+	if (resp->mtddev_resp.mtd_resp.size != num_bytes) {
 		dev_err(vmtddev->device,
 			"size mismatch for offset %llx size %x returned %x!\n",
 			offset, num_bytes,
-			vs_req->mtddev_resp.mtd_resp.size);
-		ret = -EIO;
-		goto fail;
+			resp->mtddev_resp.mtd_resp.size);
+		return -EIO;
+	}
+
+	return 0;
+}
+
+/*
+ * Responses may come back in any order; match them to their request by
+ * req_id and wake whoever is waiting on it. The interrupt may also signal
+ * a channel reset, which only makes progress when the channel is polled.
+ */
+static void vmtd_request_work(struct work_struct *ws)
+{
+	struct vmtd_dev *vmtddev = container_of(ws, struct vmtd_dev, work);
+	struct vs_request *resp;
+	struct vmtd_req *req;
+
+	mutex_lock(&vmtddev->lock);
+	if (!vmtd_channel_ready(vmtddev))
+		goto unlock;
+
+	while (tegra_hv_ivc_can_read(vmtddev->ivck)) {
+		resp = (struct vs_request *)
+			tegra_hv_ivc_read_get_next_frame(vmtddev->ivck);
+		if (IS_ERR_OR_NULL(resp)) {
+			dev_err(vmtddev->device, "ivc read failed\n");
+			break;
+		}
+
+		req = vmtd_get_req_by_id(vmtddev, resp->req_id);
+		if ((req == NULL) || !req->submitted) {
+			dev_err(vmtddev->device, "req_id mismatch num %d!\n",
+				resp->req_id);
+		} else {
+			req->submitted = false;
+			req->status = vmtd_check_resp(vmtddev, &req->vs_req,
+					resp);
+			complete(&req->done);
+		}
+
+		if (tegra_hv_ivc_read_advance(vmtddev->ivck)) {
+			dev_err(vmtddev->device, "ivc read advance failed\n");
+			break;
+		}
+	}
+
+unlock:
+	mutex_unlock(&vmtddev->lock);
+}
+
+static int vmtd_submit_req(struct vmtd_dev *vmtddev, struct vmtd_req *req)
+{
+	int ret;
+
+	mutex_lock(&vmtddev->lock);
+	ret = vmtd_send_cmd(vmtddev, &req->vs_req);
+	if (ret == 0)
+		req->submitted = true;
+	mutex_unlock(&vmtddev->lock);
+	if (ret != 0)
+		dev_err(vmtddev->device, "Sending %d failed!\n",
+			req->vs_req.mtddev_req.req_op);
+
+	return ret;
+}
+
+/*
+ * Split [offset, offset + len) into chunks of at most max_io bytes and keep
+ * as many of them in flight as there are free requests. Completions are
+ * consumed in submission order so that reads can be copied straight into
+ * the caller's buffer.
+ */
+static int vmtd_do_io(struct vmtd_dev *vmtddev, enum mtd_cmd_op op,
+		loff_t offset, size_t len, size_t max_io,
+		const u_char *wbuf, u_char *rbuf)
+{
+	struct vmtd_req *inflight[MAX_VMTD_REQS];
+	struct vs_mtd_request *mtd_req;
+	struct vmtd_req *req;
+	uint32_t head = 0, nr = 0;
+	size_t io_size, done = 0;
+	int32_t ret = 0, err;
+
+	while ((done < len && ret == 0) || nr) {
+		if (done < len && ret == 0 && nr < vmtddev->max_requests) {
+			if (nr)
+				req = vmtd_get_req(vmtddev);
+			else
+				wait_event(vmtddev->req_wq,
+					(req = vmtd_get_req(vmtddev)) != NULL);
+
+			if (req != NULL) {
+				io_size = min3(max_io, len - done,
+						(size_t)req->mempool_len);
+				req->vs_req.type = VS_DATA_REQ;
+				req->vs_req.mtddev_req.req_op = op;
+				mtd_req = &req->vs_req.mtddev_req.mtd_req;
+				mtd_req->offset = offset + done;
+				mtd_req->size = io_size;
+				mtd_req->data_offset = req->mempool_offset;
+
+				if (wbuf)
+					memcpy(req->mempool_virt, wbuf + done,
+						io_size);
+
+				ret = vmtd_submit_req(vmtddev, req);
+				if (ret != 0) {
+					vmtd_put_req(vmtddev, req);
+					continue;
+				}
+
+				inflight[(head + nr) % MAX_VMTD_REQS] = req;
+				nr++;
+				done += io_size;
+				continue;
+			}
+		}
+
+		req = inflight[head];
+		head = (head + 1) % MAX_VMTD_REQS;
+		nr--;
+
+		wait_for_completion(&req->done);
+		err = req->status;
+		mtd_req = &req->vs_req.mtddev_req.mtd_req;
+		if (err != 0)
+			dev_err(vmtddev->device,
+				"op %d for offset %llx size %x failed!\n",
+				op, mtd_req->offset, mtd_req->size);
+		else if (rbuf)
+			memcpy(rbuf + (mtd_req->offset - offset),
+				req->mempool_virt, mtd_req->size);
+
+		if (ret == 0)
+			ret = err;
+		vmtd_put_req(vmtddev, req);
 	}
 
-fail:
 	return ret;
 }
 
@@ -154,8 +384,11 @@ static int vmtd_get_configinfo(struct vmtd_dev *vmtddev,
 {
 	struct vs_request *vs_req = (struct vs_request *)vmtddev->cmd_frame;
 
-	/* This while loop exits as long as the remote endpoint cooperates. */
-	while (!tegra_hv_ivc_can_read(vmtddev->ivck)) {
+	/* This loop exits as long as the remote endpoint cooperates. */
+	for (;;) {
+		reinit_completion(&vmtddev->msg_complete);
+		if (tegra_hv_ivc_can_read(vmtddev->ivck))
+			break;
 		wait_for_completion(&vmtddev->msg_complete);
 	}
 
@@ -182,10 +415,7 @@ static int vmtd_read(struct mtd_info *mtd, loff_t from, size_t len,
 		size_t *retlen, u_char *buf)
 {
 	struct vmtd_dev *vmtddev = mtd_to_vmtd(mtd);
-	struct vs_request *vs_req;
 	size_t remaining_size = len;
-	size_t read_size;
-	u_char *buf_addr = buf;
 	loff_t offset = from;
 	int32_t ret = 0;
 
@@ -200,37 +430,11 @@ static int vmtd_read(struct mtd_info *mtd, loff_t from, size_t len,
 		return -EPERM;
 	}
 
-	mutex_lock(&vmtddev->lock);
-	while (remaining_size) {
-		read_size = min(
-			(size_t)vmtddev->config.mtd_config.max_read_bytes_per_io,
-				remaining_size);
-		vs_req = (struct vs_request *)vmtddev->cmd_frame;
-		vs_req->type = VS_DATA_REQ;
-		vs_req->mtddev_req.req_op = VS_MTD_READ;
-		vs_req->mtddev_req.mtd_req.offset = offset;
-		vs_req->mtddev_req.mtd_req.size = read_size;
-		vs_req->mtddev_req.mtd_req.data_offset = 0;
-		vs_req->req_id = 0;
-
-		ret = vmtd_process_request(vmtddev, vs_req);
-		if (ret != 0)
-		{
-			dev_err(vmtddev->device,
-				"Read for offset %llx size %lx failed!\n",
-				offset, read_size);
-			goto fail;
-		}
+	ret = vmtd_do_io(vmtddev, VS_MTD_READ, offset, remaining_size,
+		vmtddev->config.mtd_config.max_read_bytes_per_io, NULL, buf);
+	if (ret == 0)
+		*retlen = len;
 
-		memcpy(buf_addr, vmtddev->shared_buffer, read_size);
-		buf_addr += read_size;
-		offset += read_size;
-		remaining_size -= read_size;
-	}
-	*retlen = len;
-
-fail:
-	mutex_unlock(&vmtddev->lock);
 	return ret;
 }
 
@@ -242,10 +446,7 @@ static int vmtd_write(struct mtd_info *mtd, loff_t to, size_t len,
 		size_t *retlen, const u_char *buf)
 {
 	struct vmtd_dev *vmtddev = mtd_to_vmtd(mtd);
-	struct vs_request *vs_req;
 	size_t remaining_size = len;
-	size_t write_size;
-	const u_char *buf_addr = buf;
 	loff_t offset = to;
 	int32_t ret = 0;
 
@@ -259,38 +460,11 @@ static int vmtd_write(struct mtd_info *mtd, loff_t to, size_t len,
 		return -EPERM;
 	}
 
-	mutex_lock(&vmtddev->lock);
-	while (remaining_size) {
-		write_size = min(
-			(size_t)vmtddev->config.mtd_config.max_write_bytes_per_io,
-				remaining_size);
-		vs_req = (struct vs_request *)vmtddev->cmd_frame;
-		vs_req->type = VS_DATA_REQ;
-		vs_req->mtddev_req.req_op = VS_MTD_WRITE;
-		vs_req->mtddev_req.mtd_req.offset = offset;
-		vs_req->mtddev_req.mtd_req.size = write_size;
-		vs_req->mtddev_req.mtd_req.data_offset = 0;
-		vs_req->req_id = 0;
-
-		memcpy(vmtddev->shared_buffer, buf_addr, write_size);
-
-		ret = vmtd_process_request(vmtddev, vs_req);
-		if (ret != 0)
-		{
-			dev_err(vmtddev->device,
-				"write for offset %llx size %lx failed!\n",
-				offset, write_size);
-			goto fail;
-		}
-
-		buf_addr += write_size;
-		offset += write_size;
-		remaining_size -= write_size;
-	}
-	*retlen = len;
+	ret = vmtd_do_io(vmtddev, VS_MTD_WRITE, offset, remaining_size,
+		vmtddev->config.mtd_config.max_write_bytes_per_io, buf, NULL);
+	if (ret == 0)
+		*retlen = len;
 
-fail:
-	mutex_unlock(&vmtddev->lock);
 	return ret;
 }
 
@@ -302,6 +476,7 @@ static int vmtd_erase(struct mtd_info *mtd, struct erase_info *instr)
 {
 	struct vmtd_dev * vmtddev = mtd_to_vmtd(mtd);
 	struct vs_request *vs_req;
+	struct vmtd_req *req;
 	int32_t ret = 0;
 
 	dev_dbg(vmtddev->device, "%s from 0x%08x, len %llx\n",
@@ -314,25 +489,27 @@ static int vmtd_erase(struct mtd_info *mtd, struct erase_info *instr)
 		return -EPERM;
 	}
 
-	mutex_lock(&vmtddev->lock);
-	vs_req = (struct vs_request *)vmtddev->cmd_frame;
+	wait_event(vmtddev->req_wq, (req = vmtd_get_req(vmtddev)) != NULL);
+	vs_req = &req->vs_req;
 
 	vs_req->type = VS_DATA_REQ;
 	vs_req->mtddev_req.req_op = VS_MTD_ERASE;
 	vs_req->mtddev_req.mtd_req.offset = instr->addr;
 	vs_req->mtddev_req.mtd_req.size = instr->len;
 	vs_req->mtddev_req.mtd_req.data_offset = 0;
-	vs_req->req_id = 0;
 
-	ret = vmtd_process_request(vmtddev, vs_req);
+	ret = vmtd_submit_req(vmtddev, req);
+	if (ret == 0) {
+		wait_for_completion(&req->done);
+		ret = req->status;
+	}
+	vmtd_put_req(vmtddev, req);
 	if (ret != 0) {
 		dev_err(vmtddev->device,
 			"Erase for offset %llx size %llx failed!\n",
 			instr->addr, instr->len);
-		mutex_unlock(&vmtddev->lock);
 		goto fail;
 	}
-	mutex_unlock(&vmtddev->lock);
 
 	mtd_erase_callback(instr);
 
@@ -350,8 +527,19 @@ static int tegra_virt_mtd_suspend(struct device *dev)
 	struct vmtd_dev *vmtddev = dev_get_drvdata(dev);
 
 	if (vmtddev->is_setup) {
-		mutex_lock(&vmtddev->lock);
+		mutex_lock(&vmtddev->req_lock);
+		vmtddev->suspended = true;
+
+		/* Mark the queue as empty if inflight requests are 0 */
+		if (vmtddev->inflight_reqs == 0)
+			complete(&vmtddev->req_queue_empty);
+		mutex_unlock(&vmtddev->req_lock);
+
+		wait_for_completion(&vmtddev->req_queue_empty);
 		disable_irq(vmtddev->ivck->irq);
+
+		flush_workqueue(vmtddev->wq);
+
 		/* Reset the channel */
 		tegra_hv_ivc_channel_reset(vmtddev->ivck);
 	}
@@ -363,8 +551,13 @@ static int tegra_virt_mtd_resume(struct device *dev)
 	struct vmtd_dev *vmtddev = dev_get_drvdata(dev);
 
 	if (vmtddev->is_setup) {
+		mutex_lock(&vmtddev->req_lock);
+		vmtddev->suspended = false;
+		reinit_completion(&vmtddev->req_queue_empty);
+		mutex_unlock(&vmtddev->req_lock);
+
 		enable_irq(vmtddev->ivck->irq);
-		mutex_unlock(&vmtddev->lock);
+		wake_up_all(&vmtddev->req_wq);
 	}
 	return 0;
 }
@@ -376,10 +569,53 @@ static const struct dev_pm_ops tegra_hv_vmtd_pm_ops = {
 };
 #endif /* CONFIG_PM_SLEEP */
 
-static int vmtd_setup_device(struct vmtd_dev *vmtddev)
+/*
+ * Carve the mempool into one data region per request so that several
+ * requests can be in flight at once, each identified by its req_id.
+ */
+static void vmtd_setup_reqs(struct vmtd_dev *vmtddev)
 {
-	mutex_init(&vmtddev->lock);
+	struct vmtd_req *req;
+	uint32_t max_io_bytes;
+	uint32_t max_requests;
+	uint32_t req_id;
+
+	max_io_bytes = max(vmtddev->config.mtd_config.max_read_bytes_per_io,
+			vmtddev->config.mtd_config.max_write_bytes_per_io);
+	if (max_io_bytes == 0)
+		max_io_bytes = vmtddev->ivmk->size;
+
+	max_requests = vmtddev->ivmk->size / max_io_bytes;
+	if (max_requests > MAX_VMTD_REQS)
+		max_requests = MAX_VMTD_REQS;
+
+	if (vmtddev->ivck->nframes < max_requests) {
+		dev_info(vmtddev->device,
+			"IVC frames %d less than possible max requests %d!\n",
+			vmtddev->ivck->nframes, max_requests);
+		max_requests = vmtddev->ivck->nframes;
+	}
+
+	if (max_requests == 0)
+		max_requests = 1;
+
+	for (req_id = 0; req_id < max_requests; req_id++) {
+		req = &vmtddev->reqs[req_id];
+		req->mempool_virt = (void *)((uintptr_t)vmtddev->shared_buffer +
+			(uintptr_t)(req_id * max_io_bytes));
+		req->mempool_offset = req_id * max_io_bytes;
+		req->mempool_len = max_io_bytes;
+		req->id = req_id;
+		init_completion(&req->done);
+	}
+
+	vmtddev->max_requests = max_requests;
+	dev_info(vmtddev->device, "%d requests of %d bytes in flight\n",
+		max_requests, max_io_bytes);
+}
 
+static int vmtd_setup_device(struct vmtd_dev *vmtddev)
+{
 	vmtddev->mtd.name = "virt_mtd";
 	vmtddev->mtd.type = MTD_NORFLASH;
 	vmtddev->mtd.writesize = 1;
@@ -410,6 +646,8 @@ static int vmtd_setup_device(struct vmtd_dev *vmtddev)
 			vmtddev->ivmk->size;
 	}
 
+	vmtd_setup_reqs(vmtddev);
+
 	vmtddev->mtd.dev.parent = vmtddev->device;
 	vmtddev->mtd.writebufsize = 1;
 
@@ -440,7 +678,9 @@ static int32_t vmtd_init_device(struct vmtd_dev *vmtddev)
 	dev_info(vmtddev->device, "send config cmd to ivc #%d\n",
 		vmtddev->ivc_id);
 
+	mutex_lock(&vmtddev->lock);
 	ret = vmtd_send_cmd(vmtddev, vs_req);
+	mutex_unlock(&vmtddev->lock);
 	if (ret != 0) {
 		dev_err(vmtddev->device, "Sending %d failed!\n",
 				vs_req->type);
@@ -556,13 +796,26 @@ static int tegra_virt_mtd_probe(struct platform_device *pdev)
 		goto free_mempool;
 	}
 
+	mutex_init(&vmtddev->lock);
 	init_completion(&vmtddev->msg_complete);
+	init_completion(&vmtddev->req_queue_empty);
+	init_waitqueue_head(&vmtddev->req_wq);
+	mutex_init(&vmtddev->req_lock);
+	INIT_WORK(&vmtddev->work, vmtd_request_work);
+
+	vmtddev->wq = alloc_workqueue("vmtd_req_wq",
+		WQ_UNBOUND | WQ_HIGHPRI | WQ_MEM_RECLAIM, 1);
+	if (vmtddev->wq == NULL) {
+		dev_err(dev, "Failed to allocate workqueue\n");
+		ret = -ENOMEM;
+		goto free_mempool;
+	}
 
 	if (devm_request_irq(vmtddev->device, vmtddev->ivck->irq,
 		ivc_irq_handler, 0, "vmtd", vmtddev)) {
 		dev_err(dev, "Failed to request irq %d\n", vmtddev->ivck->irq);
 		ret = -EINVAL;
-		goto free_mempool;
+		goto free_wq;
 	}
 
 	tegra_hv_ivc_channel_reset(vmtddev->ivck);
@@ -570,11 +823,17 @@ static int tegra_virt_mtd_probe(struct platform_device *pdev)
 	if (vmtd_init_device(vmtddev) != 0) {
 		dev_err(dev, "Failed to initialize mtd device\n");
 		ret = -EINVAL;
-		goto free_mempool;
+		goto free_irq;
 	}
 
 	return 0;
 
+free_irq:
+	devm_free_irq(vmtddev->device, vmtddev->ivck->irq, vmtddev);
+
+free_wq:
+	destroy_workqueue(vmtddev->wq);
+
 free_mempool:
 	tegra_hv_mempool_unreserve(vmtddev->ivmk);
 
@@ -588,6 +847,8 @@ static int tegra_virt_mtd_remove(struct platform_device *pdev)
 {
 	struct vmtd_dev *vmtddev = platform_get_drvdata(pdev);
 
+	devm_free_irq(vmtddev->device, vmtddev->ivck->irq, vmtddev);
+	destroy_workqueue(vmtddev->wq);
 	tegra_hv_ivc_unreserve(vmtddev->ivck);
 	tegra_hv_mempool_unreserve(vmtddev->ivmk);
 
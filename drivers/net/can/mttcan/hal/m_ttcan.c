@@ -456,6 +456,12 @@ void ttcan_tx_trigger_msg_transmit(struct ttcan_controller *ttcan, u8 index)
 	ttcan_write32(ttcan, ADR_MTTCAN_TXBAR, (1 << index));
 }
 
+/* Request transmission of all buffers set in mask with one TXBAR write */
+void ttcan_tx_trigger_msgs_transmit(struct ttcan_controller *ttcan, u32 mask)
+{
+	ttcan_write32(ttcan, ADR_MTTCAN_TXBAR, mask);
+}
+
 int ttcan_tx_msg_buffer_write(struct ttcan_controller *ttcan,
 			      struct ttcanfd_frame *ttcanfd)
 {
@@ -526,15 +532,19 @@ int ttcan_set_tx_buffer_addr(struct ttcan_controller *ttcan)
 }
 
 /* Queue Message in Tx Queue
+ * unrequested: Tx buffers written but not yet requested through TXBAR,
+ * the new message goes after them so that all can be requested at once
  * Return
  *	-ve in case of error
  *      idx written buffer index
  */
 int ttcan_tx_fifo_queue_msg(struct ttcan_controller *ttcan,
-			    struct ttcanfd_frame *ttcanfd)
+			    struct ttcanfd_frame *ttcanfd, u32 unrequested)
 {
-	u32 txfqs_reg;
-	u32 put_idx;
+	u32 base = ttcan->tx_config.ded_buff_num;
+	u32 size = ttcan->tx_config.fifo_q_num;
+	u32 txfqs_reg, free;
+	u32 put_idx, n;
 
 	txfqs_reg = ttcan_read32(ttcan, ADR_MTTCAN_TXFQS);
 
@@ -542,8 +552,26 @@ int ttcan_tx_fifo_queue_msg(struct ttcan_controller *ttcan,
 	if (txfqs_reg & MTT_TXFQS_TFQF_MASK)
 		return -ENOMEM;
 
-	/* Test if Tx index is previously reserved in SW */
 	put_idx = (txfqs_reg & MTT_TXFQS_TFQPI_MASK) >> MTT_TXFQS_TFQPI_SHIFT;
+
+	unrequested &= GENMASK(base + size - 1, base);
+	if (unrequested && (ttcan->tx_config.flags & 0x1)) {
+		/* Tx Queue: any buffer without a pending request */
+		free = ~ttcan_read32(ttcan, ADR_MTTCAN_TXBRP);
+		free &= ~ttcan->tx_object & GENMASK(base + size - 1, base);
+		if (!free)
+			return -ENOMEM;
+		put_idx = ffs(free) - 1;
+	} else if (unrequested) {
+		/* Tx FIFO: consecutive elements from the put index on */
+		n = hweight32(unrequested);
+		if (n >= ((txfqs_reg & MTT_TXFQS_TFFL_MASK) >>
+			  MTT_TXFQS_TFFL_SHIFT))
+			return -ENOMEM;
+		put_idx = base + (put_idx - base + n) % size;
+	}
+
+	/* Test if Tx index is previously reserved in SW */
 	if (ttcan->tx_object & (1 << put_idx))
 		return -ENOMEM;
 
@@ -566,9 +594,15 @@ int ttcan_tx_fifo_full(struct ttcan_controller *ttcan)
 
 static int process_rx_mesg(struct ttcan_controller *ttcan, u32 addr)
 {
-	struct ttcanfd_frame ttcanfd;
-	ttcan_read_rx_msg_ram(ttcan, addr, &ttcanfd);
-	return add_msg_controller_list(ttcan, &ttcanfd, &ttcan->rx_b, BUFFER);
+	struct ttcanfd_frame *ttcanfd;
+
+	ttcanfd = ttcan_rx_ring_get_slot(&ttcan->rx_b);
+	if (!ttcanfd)
+		return -ENOMEM;
+
+	ttcan_read_rx_msg_ram(ttcan, addr, ttcanfd);
+	ttcan_rx_ring_commit(&ttcan->rx_b);
+	return 0;
 }
 
 int ttcan_read_rx_buffer(struct ttcan_controller *ttcan)
@@ -655,7 +689,7 @@ unsigned int ttcan_read_txevt_fifo(struct ttcan_controller *ttcan)
 unsigned int ttcan_read_rx_fifo0(struct ttcan_controller *ttcan)
 {
 	u32 rxf0s_reg;
-	struct ttcanfd_frame ttcanfd;
+	struct ttcanfd_frame *ttcanfd;
 	u32 read_addr;
 	int q_read = 0;
 	unsigned int msgs_read = 0;
@@ -686,12 +720,13 @@ unsigned int ttcan_read_rx_fifo0(struct ttcan_controller *ttcan)
 		pr_debug("%s:fifo0: read_addr %x FOGI %x\n", __func__,
 			 read_addr, get_idx);
 
-		ttcan_read_rx_msg_ram(ttcan, read_addr, &ttcanfd);
-		if (add_msg_controller_list(ttcan, &ttcanfd,
-					    &ttcan->rx_q0, FIFO_0) < 0) {
-			pr_err("%s: failed to add to list\n", __func__);
+		ttcanfd = ttcan_rx_ring_get_slot(&ttcan->rx_q0);
+		if (!ttcanfd) {
+			pr_err_ratelimited("%s: rx ring full\n", __func__);
 			return msgs_read;
 		}
+		ttcan_read_rx_msg_ram(ttcan, read_addr, ttcanfd);
+		ttcan_rx_ring_commit(&ttcan->rx_q0);
 		ttcan_write32(ttcan, ADR_MTTCAN_RXF0A, get_idx);
 		rxf0s_reg = ttcan_read32(ttcan, ADR_MTTCAN_RXF0S);
 		msgs_read++;
@@ -702,7 +737,7 @@ unsigned int ttcan_read_rx_fifo0(struct ttcan_controller *ttcan)
 unsigned int ttcan_read_rx_fifo1(struct ttcan_controller *ttcan)
 {
 	u32 rxf1s_reg;
-	struct ttcanfd_frame ttcanfd;
+	struct ttcanfd_frame *ttcanfd;
 	u32 read_addr;
 	int q_read = 0;
 	int msgs_read = 0;
@@ -732,12 +767,13 @@ unsigned int ttcan_read_rx_fifo1(struct ttcan_controller *ttcan)
 		pr_debug("%s:fifo1: read_addr %x FOGI %x\n", __func__,
 			 read_addr, get_idx);
 
-		ttcan_read_rx_msg_ram(ttcan, read_addr, &ttcanfd);
-		if (add_msg_controller_list(ttcan, &ttcanfd,
-					    &ttcan->rx_q1, FIFO_1) < 0) {
-			pr_err("%s: failed to add to list\n", __func__);
+		ttcanfd = ttcan_rx_ring_get_slot(&ttcan->rx_q1);
+		if (!ttcanfd) {
+			pr_err_ratelimited("%s: rx ring full\n", __func__);
 			return msgs_read;
 		}
+		ttcan_read_rx_msg_ram(ttcan, read_addr, ttcanfd);
+		ttcan_rx_ring_commit(&ttcan->rx_q1);
 		ttcan_write32(ttcan, ADR_MTTCAN_RXF1A, get_idx);
 		rxf1s_reg = ttcan_read32(ttcan, ADR_MTTCAN_RXF1S);
 		msgs_read++;
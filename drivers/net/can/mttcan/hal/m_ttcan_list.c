@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2015, NVIDIA CORPORATION.  All rights reserved.
+ * Copyright (c) 2015-2020, NVIDIA CORPORATION.  All rights reserved.
  *
  * This program is free software; you can redistribute it and/or modify it
  * under the terms and conditions of the GNU General Public License,
@@ -24,54 +24,75 @@ inline int is_msg_list_full(struct ttcan_controller *ttcan,
 	return ttcan->list_status & rxtype & 0xFF;
 }
 
-int add_msg_controller_list(struct ttcan_controller *ttcan,
-			    struct ttcanfd_frame *ttcanfd,
-			    struct list_head *rx_q,
-			    enum ttcan_rx_type rxtype)
+static int ttcan_rx_ring_init(struct device *dev, struct ttcan_rx_ring *ring)
 {
+	ring->msg = devm_kcalloc(dev, TTCAN_RX_RING_SIZE,
+				 sizeof(struct ttcanfd_frame), GFP_KERNEL);
+	if (!ring->msg)
+		return -ENOMEM;
 
-	struct ttcan_rx_msg_list *msg_list;
+	ring->head = 0;
+	ring->tail = 0;
+	ring->hwm = 0;
+	ring->full = 0;
 
-	msg_list = (struct ttcan_rx_msg_list *)
-		kzalloc(sizeof(struct ttcan_rx_msg_list), GFP_KERNEL);
-	if (msg_list == NULL) {
-		pr_err("%s: memory allocation failed\n", __func__);
-		return -ENOMEM;
-	}
+	return 0;
+}
 
-	INIT_LIST_HEAD(&msg_list->recv_list);
+int ttcan_rx_ring_alloc(struct device *dev, struct ttcan_controller *ttcan)
+{
+	int err;
 
-	memcpy(&msg_list->msg, ttcanfd, sizeof(struct ttcanfd_frame));
+	err = ttcan_rx_ring_init(dev, &ttcan->rx_q0);
+	if (err)
+		return err;
 
-	spin_lock(&ttcan->lock);
+	err = ttcan_rx_ring_init(dev, &ttcan->rx_q1);
+	if (err)
+		return err;
 
-	if (is_msg_list_full(ttcan, rxtype)) {
-		pr_err("%s: mesg list is full\n", __func__);
-		kfree(msg_list);
-		spin_unlock(&ttcan->lock);
-		return -ENOMEM;
-	}
+	return ttcan_rx_ring_init(dev, &ttcan->rx_b);
+}
+
+/* Producer: next free slot to read message RAM into, NULL if ring full */
+struct ttcanfd_frame *ttcan_rx_ring_get_slot(struct ttcan_rx_ring *ring)
+{
+	unsigned int tail = smp_load_acquire(&ring->tail);
 
-	list_add_tail(&msg_list->recv_list, rx_q);
-
-	switch (rxtype) {
-	case BUFFER:
-		if (++ttcan->rxb_mem >= TTCAN_MAX_LIST_MEMBERS)
-			ttcan->list_status |= BUFFER;
-		break;
-	case FIFO_0:
-		if (++ttcan->rxq0_mem >= TTCAN_MAX_LIST_MEMBERS)
-			ttcan->list_status |= FIFO_0;
-		break;
-	case FIFO_1:
-		if (++ttcan->rxq1_mem >= TTCAN_MAX_LIST_MEMBERS)
-			ttcan->list_status |= FIFO_1;
-	default:
-		break;
+	if (ring->head - tail >= TTCAN_RX_RING_SIZE) {
+		ring->full++;
+		return NULL;
 	}
-	spin_unlock(&ttcan->lock);
 
-	return 0;
+	return &ring->msg[ring->head & (TTCAN_RX_RING_SIZE - 1)];
+}
+
+/* Producer: publish the slot returned by ttcan_rx_ring_get_slot() */
+void ttcan_rx_ring_commit(struct ttcan_rx_ring *ring)
+{
+	unsigned int used = ring->head + 1 - READ_ONCE(ring->tail);
+
+	if (used > ring->hwm)
+		ring->hwm = used;
+
+	smp_store_release(&ring->head, ring->head + 1);
+}
+
+/* Consumer: oldest queued frame, NULL if ring empty */
+struct ttcanfd_frame *ttcan_rx_ring_peek(struct ttcan_rx_ring *ring)
+{
+	unsigned int head = smp_load_acquire(&ring->head);
+
+	if (head == ring->tail)
+		return NULL;
+
+	return &ring->msg[ring->tail & (TTCAN_RX_RING_SIZE - 1)];
+}
+
+/* Consumer: hand the frame returned by ttcan_rx_ring_peek() back */
+void ttcan_rx_ring_release(struct ttcan_rx_ring *ring)
+{
+	smp_store_release(&ring->tail, ring->tail + 1);
 }
 
 int add_event_controller_list(struct ttcan_controller *ttcan,
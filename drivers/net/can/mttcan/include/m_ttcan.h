@@ -103,6 +103,11 @@
 #define GFC_RRFS_REJECT		1U
 #define GFC_RRFE_REJECT		1U
 
+/* Filter Type */
+#define MTTCAN_FLTR_RANGE	0U
+#define MTTCAN_FLTR_DUAL	1U
+#define MTTCAN_FLTR_CLASSIC	2U
+
 /* Filter Element Configuration */
 #define FEC_RXFIFO_0            1U
 #define FEC_RXFIFO_1            2U
@@ -276,9 +281,19 @@ struct ttcan_filter_config {
 	u32 xtd_fltr_size;
 };
 
-struct ttcan_rx_msg_list {
-	struct ttcanfd_frame msg;
-	struct list_head recv_list;
+#define TTCAN_RX_RING_SIZE	128	/* power of 2 */
+
+/*
+ * Preallocated single producer / single consumer ring of received
+ * frames. head is advanced by the Rx FIFO/buffer reader, tail by the
+ * skb builder; both run free and are masked on access.
+ */
+struct ttcan_rx_ring {
+	struct ttcanfd_frame *msg;
+	unsigned int head;
+	unsigned int tail;
+	unsigned int hwm;	/* max frames ever queued */
+	u64 full;		/* times a frame was left in HW, ring full */
 };
 
 struct ttcan_txevt_msg_list {
@@ -294,9 +309,9 @@ struct ttcan_controller {
 	struct ttcan_rxbuff_config rx_config;
 	struct ttcan_filter_config fltr_config;
 	struct ttcan_mram_elem mram_cfg[MRAM_ELEMS];
-	struct list_head rx_q0;
-	struct list_head rx_q1;
-	struct list_head rx_b;
+	struct ttcan_rx_ring rx_q0;
+	struct ttcan_rx_ring rx_q1;
+	struct ttcan_rx_ring rx_b;
 	struct list_head tx_evt;
 	void __iomem *base;	/* controller regs space should be remapped. */
 	void __iomem *xbase;    /* extra registers are mapped */
@@ -313,9 +328,6 @@ struct ttcan_controller {
 	u32 tdc_offset;
 	unsigned long tx_object;
 	unsigned long tx_obj_cancelled;
-	int rxq0_mem;
-	int rxq1_mem;
-	int rxb_mem;
 	int evt_mem;
 	u16 list_status;	/* bit 0: 1=Full; */
 	u16 resv0;
@@ -453,7 +465,7 @@ int ttcan_tx_fifo_full(struct ttcan_controller *ttcan);
 bool ttcan_tx_buffers_full(struct ttcan_controller *ttcan);
 
 int ttcan_tx_fifo_queue_msg(struct ttcan_controller *ttcan,
-			    struct ttcanfd_frame *ttcanfd);
+			    struct ttcanfd_frame *ttcanfd, u32 unrequested);
 int ttcan_tx_fifo_get_free_element(struct ttcan_controller *ttcan);
 
 int ttcan_tx_buf_req_pending(struct ttcan_controller *ttcan, u8 index);
@@ -461,6 +473,7 @@ void ttcan_tx_ded_msg_write(struct ttcan_controller *ttcan,
 			    struct ttcanfd_frame *ttcanfd,
 			    u8 index);
 void ttcan_tx_trigger_msg_transmit(struct ttcan_controller *ttcan, u8 index);
+void ttcan_tx_trigger_msgs_transmit(struct ttcan_controller *ttcan, u32 mask);
 int ttcan_tx_msg_buffer_write(struct ttcan_controller *ttcan,
 				struct ttcanfd_frame *ttcanfd);
 
@@ -554,9 +567,11 @@ int ttcan_set_tur_config(struct ttcan_controller *ttcan, u16 denominator,
 void ttcan_prog_trigger_mem(struct ttcan_controller *ttcan, void *tmc_shadow);
 
 /* list APIs */
-int add_msg_controller_list(struct ttcan_controller *ttcan,
-	struct ttcanfd_frame *ttcanfd, struct list_head *rx_q,
-	enum ttcan_rx_type rxtype);
+int ttcan_rx_ring_alloc(struct device *dev, struct ttcan_controller *ttcan);
+struct ttcanfd_frame *ttcan_rx_ring_get_slot(struct ttcan_rx_ring *ring);
+void ttcan_rx_ring_commit(struct ttcan_rx_ring *ring);
+struct ttcanfd_frame *ttcan_rx_ring_peek(struct ttcan_rx_ring *ring);
+void ttcan_rx_ring_release(struct ttcan_rx_ring *ring);
 
 int add_event_controller_list(struct ttcan_controller *ttcan,
 				struct mttcan_tx_evt_element *txevt,
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2015-2018, NVIDIA CORPORATION. All rights reserved.
+ * Copyright (c) 2015-2020, NVIDIA CORPORATION. All rights reserved.
  *
  * This program is free software; you can redistribute it and/or modify it
  * under the terms and conditions of the GNU General Public License,
@@ -70,6 +70,10 @@
 /* block period in ms */
 #define TX_BLOCK_PERIOD		200
 #define TSC_REF_CLK_RATE	31250000
+/* driver managed Rx acceptance filters */
+#define MTTCAN_MAX_RX_FLTR	128
+#define MTTCAN_RX_FLTR_STD	BIT(0)
+#define MTTCAN_RX_FLTR_XTD	BIT(1)
 
 struct tegra_mttcan_soc_info {
 	bool set_can_core_clk;
@@ -83,6 +87,12 @@ struct can_gpio {
 	int active_low;
 };
 
+struct mttcan_rx_fltr {
+	u32 id;
+	u32 mask;
+	bool xtd;
+};
+
 struct mttcan_priv {
 	struct can_priv can;
 	struct ttcan_controller *ttcan;
@@ -122,6 +132,16 @@ struct mttcan_priv {
 	u32 mram_param[MTT_CAN_MAX_MRAM_ELEMS];
 	u32 tx_conf[MTT_MAX_TX_CONF]; /*<txb, txq, txq_mode, txb_dsize>*/
 	u32 rx_conf[MTT_MAX_RX_CONF]; /*<rxb_dsize, rxq0_dsize, rxq1_dsize>*/
+	struct mttcan_rx_fltr rx_fltr[MTTCAN_MAX_RX_FLTR];
+	struct mttcan_rx_fltr rx_fltr_elem[MTTCAN_MAX_RX_FLTR]; /* compiled */
+	u32 rx_fltr_cnt;
+	u32 rx_fltr_std; /* elements at the top of the std filter RAM */
+	u32 rx_fltr_xtd; /* elements at the top of the xtd filter RAM */
+	u32 rx_fltr_anf; /* ID types whose non matching frames are rejected */
+	u32 rx_fltr_sw; /* ID types left partly to the socket filters */
+	u32 tx_bar_pending; /* written Tx buffers awaiting TXBAR */
+	u64 tx_frames; /* frames requested through TXBAR */
+	u64 tx_triggers; /* TXBAR writes */
 	bool poll;
 	bool hwts_rx_en;
 	u32 resp;
@@ -129,4 +149,5 @@ struct mttcan_priv {
 
 int mttcan_create_sys_files(struct device *dev);
 void mttcan_delete_sys_files(struct device *dev);
+u32 mttcan_rx_fltr_gfc(const struct mttcan_priv *priv);
 #endif
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2015-2019, NVIDIA CORPORATION. All rights reserved.
+ * Copyright (c) 2015-2020, NVIDIA CORPORATION. All rights reserved.
  *
  * References are taken from "Bosch C_CAN controller" at
  * "drivers/net/can/c_can/c_can.c"
@@ -139,7 +139,7 @@ static __init int mttcan_hw_reinit(const struct mttcan_priv *priv)
 	if (err)
 		return err;
 
-	err = ttcan_set_gfc(ttcan, priv->gfc_reg);
+	err = ttcan_set_gfc(ttcan, mttcan_rx_fltr_gfc(priv));
 	if (err)
 		return err;
 
@@ -282,8 +282,8 @@ static void mttcan_rx_hwtstamp(struct mttcan_priv *priv,
 	hwtstamps->hwtstamp = ns_to_ktime(ns);
 }
 
-static int mttcan_hpm_do_receive(struct net_device *dev,
-				 struct ttcanfd_frame *msg)
+static int mttcan_do_receive(struct net_device *dev,
+			     struct ttcanfd_frame *msg)
 {
 	struct mttcan_priv *priv = netdev_priv(dev);
 	struct net_device_stats *stats = &dev->stats;
@@ -321,79 +321,20 @@ static int mttcan_hpm_do_receive(struct net_device *dev,
 }
 
 static int mttcan_read_rcv_list(struct net_device *dev,
-				struct list_head *rcv,
-				enum ttcan_rx_type rx_type,
-				int rec_msgs, int quota)
+				struct ttcan_rx_ring *ring, int quota)
 {
-	unsigned int pushed;
-	unsigned long flags;
-	struct mttcan_priv *priv = netdev_priv(dev);
-	struct ttcan_rx_msg_list *rx;
-	struct net_device_stats *stats = &dev->stats;
-	struct list_head *cur, *next, rx_q;
-
-	if (list_empty(rcv))
-		return 0;
-
-	INIT_LIST_HEAD(&rx_q);
-
-	spin_lock_irqsave(&priv->ttcan->lock, flags);
-	switch (rx_type) {
-	case BUFFER:
-		priv->ttcan->rxb_mem = 0;
-		priv->ttcan->list_status &= ~(BUFFER & 0xFF);
-		break;
-	case FIFO_0:
-		priv->ttcan->rxq0_mem = 0;
-		priv->ttcan->list_status &= ~(FIFO_0 & 0xFF);
-		break;
-	case FIFO_1:
-		priv->ttcan->rxq1_mem = 0;
-		priv->ttcan->list_status &= ~(FIFO_1 & 0xFF);
-	default:
-		break;
-	}
-	list_splice_init(rcv, &rx_q);
-	spin_unlock_irqrestore(&priv->ttcan->lock, flags);
+	struct ttcanfd_frame *msg;
+	int received = 0;
 
-	pushed = rec_msgs;
-	list_for_each_safe(cur, next, &rx_q) {
-		struct sk_buff *skb;
-		struct canfd_frame *fd_frame;
-		struct can_frame *frame;
-		if (!quota--)
+	while (quota-- > 0) {
+		msg = ttcan_rx_ring_peek(ring);
+		if (!msg)
 			break;
-		list_del_init(cur);
-
-		rx = list_entry(cur, struct ttcan_rx_msg_list, recv_list);
-		if (rx->msg.flags & CAN_FD_FLAG) {
-			skb = alloc_canfd_skb(dev, &fd_frame);
-			if (!skb) {
-				stats->rx_dropped += pushed;
-				return 0;
-			}
-			memcpy(fd_frame, &rx->msg, sizeof(struct canfd_frame));
-			stats->rx_bytes += fd_frame->len;
-		} else {
-			skb = alloc_can_skb(dev, &frame);
-			if (!skb) {
-				stats->rx_dropped += pushed;
-				return 0;
-			}
-			frame->can_id =  rx->msg.can_id;
-			frame->can_dlc = rx->msg.d_len;
-			memcpy(frame->data, &rx->msg.data, frame->can_dlc);
-			stats->rx_bytes += frame->can_dlc;
-		}
 
-		if (priv->hwts_rx_en)
-			mttcan_rx_hwtstamp(priv, skb, &rx->msg);
-		kfree(rx);
-		netif_receive_skb(skb);
-		stats->rx_packets++;
-		pushed--;
+		received += mttcan_do_receive(dev, msg);
+		ttcan_rx_ring_release(ring);
 	}
-	return rec_msgs - pushed;
+	return received;
 }
 
 static int mttcan_state_change(struct net_device *dev,
@@ -580,6 +521,7 @@ static void mttcan_tx_complete(struct net_device *dev)
 	struct net_device_stats *stats = &dev->stats;
 	u32 msg_no;
 	u32 completed_tx;
+	unsigned int pkts = 0, bytes = 0;
 
 	spin_lock(&priv->tx_lock);
 	completed_tx = ttcan_read_tx_complete_reg(ttcan);
@@ -590,13 +532,19 @@ static void mttcan_tx_complete(struct net_device *dev)
 	while (completed_tx) {
 		msg_no = ffs(completed_tx) - 1;
 		can_get_echo_skb(dev, msg_no);
-		can_led_event(dev, CAN_LED_EVENT_TX);
 		clear_bit(msg_no, &ttcan->tx_object);
-		stats->tx_packets++;
-		stats->tx_bytes += ttcan->tx_buf_dlc[msg_no];
+		pkts++;
+		bytes += ttcan->tx_buf_dlc[msg_no];
 		completed_tx &= ~(1U << msg_no);
 	}
 
+	if (pkts) {
+		can_led_event(dev, CAN_LED_EVENT_TX);
+		stats->tx_packets += pkts;
+		stats->tx_bytes += bytes;
+		netdev_completed_queue(dev, pkts, bytes);
+	}
+
 	if (netif_queue_stopped(dev))
 		netif_wake_queue(dev);
 	spin_unlock(&priv->tx_lock);
@@ -608,6 +556,7 @@ static void mttcan_tx_cancelled(struct net_device *dev)
 	struct ttcan_controller *ttcan = priv->ttcan;
 	struct net_device_stats *stats = &dev->stats;
 	u32 buff_bit, cancelled_reg, cancelled_msg, msg_no;
+	unsigned int pkts = 0, bytes = 0;
 
 	spin_lock(&priv->tx_lock);
 	cancelled_reg = ttcan_read_tx_cancelled_reg(ttcan);
@@ -628,19 +577,23 @@ static void mttcan_tx_cancelled(struct net_device *dev)
 			clear_bit(msg_no, &ttcan->tx_object);
 			cancelled_msg &= ~(buff_bit);
 			stats->tx_aborted_errors++;
+			pkts++;
+			bytes += ttcan->tx_buf_dlc[msg_no];
 		} else {
 			pr_debug("%s TCF %x ttcan->tx_object %lx\n", __func__,
 					cancelled_msg, ttcan->tx_object);
 			break;
 		}
 	}
+
+	if (pkts)
+		netdev_completed_queue(dev, pkts, bytes);
 	spin_unlock(&priv->tx_lock);
 }
 
 static int mttcan_poll_ir(struct napi_struct *napi, int quota)
 {
 	int work_done = 0;
-	int rec_msgs = 0;
 	struct net_device *dev = napi->dev;
 	struct mttcan_priv *priv = netdev_priv(dev);
 	u32 ir, ack, ttir, ttack, psr;
@@ -725,8 +678,8 @@ static int mttcan_poll_ir(struct napi_struct *napi, int quota)
 			ack = MTT_IR_HPM_MASK;
 			ttcan_ir_write(priv->ttcan, ack);
 			if (ttcan_read_hp_mesgs(priv->ttcan, &ttcanfd))
-				work_done += mttcan_hpm_do_receive(dev,
-								   &ttcanfd);
+				work_done += mttcan_do_receive(dev,
+							       &ttcanfd);
 			pr_debug("%s: hp mesg received\n", __func__);
 		}
 
@@ -734,10 +687,9 @@ static int mttcan_poll_ir(struct napi_struct *napi, int quota)
 		if (ir & MTT_IR_DRX_MASK) {
 			ack = MTT_IR_DRX_MASK;
 			ttcan_ir_write(priv->ttcan, ack);
-			rec_msgs = ttcan_read_rx_buffer(priv->ttcan);
+			ttcan_read_rx_buffer(priv->ttcan);
 			work_done +=
 			    mttcan_read_rcv_list(dev, &priv->ttcan->rx_b,
-						 BUFFER, rec_msgs,
 						 quota - work_done);
 			pr_debug("%s: buffer mesg received\n", __func__);
 
@@ -769,11 +721,10 @@ static int mttcan_poll_ir(struct napi_struct *napi, int quota)
 					MTT_IR_RF1N_MASK);
 				ttcan_ir_write(priv->ttcan, ack);
 
-				rec_msgs = ttcan_read_rx_fifo1(priv->ttcan);
+				ttcan_read_rx_fifo1(priv->ttcan);
 				work_done +=
 				    mttcan_read_rcv_list(dev,
 							 &priv->ttcan->rx_q1,
-							 FIFO_1, rec_msgs,
 							 quota - work_done);
 				pr_debug("%s: msg received in Q1\n", __func__);
 			}
@@ -783,11 +734,10 @@ static int mttcan_poll_ir(struct napi_struct *napi, int quota)
 					MTT_IR_RF0W_MASK |
 					MTT_IR_RF0N_MASK);
 				ttcan_ir_write(priv->ttcan, ack);
-				rec_msgs = ttcan_read_rx_fifo0(priv->ttcan);
+				ttcan_read_rx_fifo0(priv->ttcan);
 				work_done +=
 				    mttcan_read_rcv_list(dev,
 							 &priv->ttcan->rx_q0,
-							 FIFO_0, rec_msgs,
 							 quota - work_done);
 				pr_debug("%s: msg received in Q0\n", __func__);
 			}
@@ -1101,10 +1051,32 @@ static void mttcan_stop(struct mttcan_priv *priv)
 	ttcan_set_config_change_enable(priv->ttcan);
 }
 
+/* Forget all Tx buffers, their echo skbs are gone */
+static void mttcan_tx_reset(struct net_device *dev)
+{
+	struct mttcan_priv *priv = netdev_priv(dev);
+
+	spin_lock_bh(&priv->tx_lock);
+	priv->ttcan->tx_object = 0;
+	priv->tx_bar_pending = 0;
+	spin_unlock_bh(&priv->tx_lock);
+	netdev_reset_queue(dev);
+}
+
 static int mttcan_set_mode(struct net_device *dev, enum can_mode mode)
 {
+	struct mttcan_priv *priv = netdev_priv(dev);
+
 	switch (mode) {
 	case CAN_MODE_START:
+		/* can_restart() has flushed the echo skbs: withdraw what is
+		 * still requested and start over as mttcan_open() does
+		 */
+		spin_lock_bh(&priv->tx_lock);
+		ttcan_set_tx_cancel_request(priv->ttcan,
+					    priv->ttcan->tx_object);
+		spin_unlock_bh(&priv->tx_lock);
+		mttcan_tx_reset(dev);
 		mttcan_start(dev);
 		netif_wake_queue(dev);
 		break;
@@ -1259,6 +1231,9 @@ static int mttcan_open(struct net_device *dev)
 	napi_enable(&priv->napi);
 	can_led_event(dev, CAN_LED_EVENT_OPEN);
 
+	/* echo skbs were flushed by close_candev(), nothing is in flight */
+	mttcan_tx_reset(dev);
+
 	mttcan_start(dev);
 	netif_start_queue(dev);
 
@@ -1288,6 +1263,27 @@ static int mttcan_close(struct net_device *dev)
 	return 0;
 }
 
+static inline bool mttcan_xmit_more(struct sk_buff *skb)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 2, 0)
+	return netdev_xmit_more();
+#else
+	return skb->xmit_more;
+#endif
+}
+
+/* Request all written but not yet requested Tx buffers, tx_lock held */
+static void mttcan_tx_flush(struct mttcan_priv *priv)
+{
+	if (!priv->tx_bar_pending)
+		return;
+
+	ttcan_tx_trigger_msgs_transmit(priv->ttcan, priv->tx_bar_pending);
+	priv->tx_frames += hweight32(priv->tx_bar_pending);
+	priv->tx_triggers++;
+	priv->tx_bar_pending = 0;
+}
+
 static netdev_tx_t mttcan_start_xmit(struct sk_buff *skb,
 				     struct net_device *dev)
 {
@@ -1308,7 +1304,15 @@ static netdev_tx_t mttcan_start_xmit(struct sk_buff *skb,
 			(struct ttcanfd_frame *)frame);
 	if (msg_no < 0)
 		msg_no = ttcan_tx_fifo_queue_msg(priv->ttcan,
-				(struct ttcanfd_frame *)frame);
+				(struct ttcanfd_frame *)frame,
+				priv->tx_bar_pending);
+
+	/* out of room behind the pending buffers, request them and retry */
+	if (msg_no < 0 && priv->tx_bar_pending) {
+		mttcan_tx_flush(priv);
+		msg_no = ttcan_tx_fifo_queue_msg(priv->ttcan,
+				(struct ttcanfd_frame *)frame, 0);
+	}
 
 	if (msg_no < 0) {
 		netif_stop_queue(dev);
@@ -1317,16 +1321,25 @@ static netdev_tx_t mttcan_start_xmit(struct sk_buff *skb,
 	}
 	can_put_echo_skb(skb, dev, msg_no);
 
-	/* Set go bit for non-TTCAN messages */
-	if (!priv->tt_param[0])
-		ttcan_tx_trigger_msg_transmit(priv->ttcan, msg_no);
-
 	/* State management for Tx complete/cancel processing */
 	if (test_and_set_bit(msg_no, &priv->ttcan->tx_object) &&
 		printk_ratelimit())
 		netdev_err(dev, "Writing to occupied echo_skb buffer\n");
 	clear_bit(msg_no, &priv->ttcan->tx_obj_cancelled);
 
+	netdev_sent_queue(dev, priv->ttcan->tx_buf_dlc[msg_no]);
+
+	/*
+	 * Set go bit for non-TTCAN messages, batched into one TXBAR write
+	 * while the stack has more frames queued for us
+	 */
+	if (!priv->tt_param[0]) {
+		priv->tx_bar_pending |= 1U << msg_no;
+		if (!mttcan_xmit_more(skb) ||
+		    netif_xmit_stopped(netdev_get_tx_queue(dev, 0)))
+			mttcan_tx_flush(priv);
+	}
+
 	spin_unlock_bh(&priv->tx_lock);
 
 	return NETDEV_TX_OK;
@@ -1472,11 +1485,64 @@ static const struct net_device_ops mttcan_netdev_ops = {
 	.ndo_do_ioctl = mttcan_ioctl,
 };
 
+static const char mttcan_gstrings_stats[][ETH_GSTRING_LEN] = {
+	"rx_b_ring_hwm",
+	"rx_q0_ring_hwm",
+	"rx_q1_ring_hwm",
+	"rx_b_ring_full",
+	"rx_q0_ring_full",
+	"rx_q1_ring_full",
+	"tx_frames_triggered",
+	"tx_triggers",
+};
+
+#define MTTCAN_STATS_LEN	ARRAY_SIZE(mttcan_gstrings_stats)
+
+static int mttcan_get_sset_count(struct net_device *dev, int sset)
+{
+	switch (sset) {
+	case ETH_SS_STATS:
+		return MTTCAN_STATS_LEN;
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
+static void mttcan_get_strings(struct net_device *dev, u32 sset, u8 *data)
+{
+	if (sset == ETH_SS_STATS)
+		memcpy(data, mttcan_gstrings_stats,
+		       sizeof(mttcan_gstrings_stats));
+}
+
+static void mttcan_get_ethtool_stats(struct net_device *dev,
+				     struct ethtool_stats *stats, u64 *data)
+{
+	struct mttcan_priv *priv = netdev_priv(dev);
+	struct ttcan_controller *ttcan = priv->ttcan;
+
+	data[0] = READ_ONCE(ttcan->rx_b.hwm);
+	data[1] = READ_ONCE(ttcan->rx_q0.hwm);
+	data[2] = READ_ONCE(ttcan->rx_q1.hwm);
+	data[3] = READ_ONCE(ttcan->rx_b.full);
+	data[4] = READ_ONCE(ttcan->rx_q0.full);
+	data[5] = READ_ONCE(ttcan->rx_q1.full);
+	data[6] = READ_ONCE(priv->tx_frames);
+	data[7] = READ_ONCE(priv->tx_triggers);
+}
+
+static const struct ethtool_ops mttcan_ethtool_ops = {
+	.get_sset_count = mttcan_get_sset_count,
+	.get_strings = mttcan_get_strings,
+	.get_ethtool_stats = mttcan_get_ethtool_stats,
+};
+
 static int register_mttcan_dev(struct net_device *dev)
 {
 	int err;
 
 	dev->netdev_ops = &mttcan_netdev_ops;
+	dev->ethtool_ops = &mttcan_ethtool_ops;
 	err = register_candev(dev);
 	if (!err)
 		devm_can_led_init(dev);
@@ -1765,11 +1831,14 @@ static int mttcan_probe(struct platform_device *pdev)
 	priv->ttcan->mram_base = mesg_ram->start;
 	priv->ttcan->id = priv->instance;
 	priv->ttcan->mram_vbase = mram_addr;
-	INIT_LIST_HEAD(&priv->ttcan->rx_q0);
-	INIT_LIST_HEAD(&priv->ttcan->rx_q1);
-	INIT_LIST_HEAD(&priv->ttcan->rx_b);
 	INIT_LIST_HEAD(&priv->ttcan->tx_evt);
 
+	ret = ttcan_rx_ring_alloc(priv->device, priv->ttcan);
+	if (ret) {
+		dev_err(priv->device, "cannot allocate rx rings\n");
+		goto exit_free_device;
+	}
+
 	platform_set_drvdata(pdev, dev);
 	SET_NETDEV_DEV(dev, &pdev->dev);
 
@@ -112,11 +112,284 @@ static ssize_t store_gfc_fltr(struct device *dev,
 	gfc |= (rrfe << MTT_GFC_RRFE_SHIFT) & MTT_GFC_RRFE_MASK;
 
 	priv->gfc_reg = gfc;
-	ttcan_set_gfc(priv->ttcan, gfc);
+	ttcan_set_gfc(priv->ttcan, mttcan_rx_fltr_gfc(priv));
 
 	return count;
 }
 
+/*
+ * Driver managed acceptance filters: the IDs in rx_fltr[] are compiled
+ * into classic id/mask filter elements routed to an Rx FIFO and placed
+ * at the top of the filter RAM, below them the std_filter/xtd_filter
+ * elements keep their indices and their precedence. Non matching frames
+ * of an ID type are rejected by the controller once the table covers
+ * that type. Entries that do not fit are merged into wider elements and
+ * the CAN_RAW socket filters drop the extra IDs; with no element left
+ * for a type at all, that type is filtered in software only.
+ */
+
+/* IDs accepted by a filter element of the given mask */
+static u64 mttcan_rx_fltr_span(u32 mask, u32 width)
+{
+	return 1ULL << (width - hweight32(mask));
+}
+
+/* IDs accepted by the merge of a and b that neither of them accepts */
+static u64 mttcan_rx_fltr_cost(const struct mttcan_rx_fltr *a,
+	const struct mttcan_rx_fltr *b, u32 width)
+{
+	u32 mask = a->mask & b->mask & ~(a->id ^ b->id);
+	u64 both = 0;
+
+	if (!((a->id ^ b->id) & a->mask & b->mask))
+		both = mttcan_rx_fltr_span(a->mask | b->mask, width);
+
+	return mttcan_rx_fltr_span(mask, width) + both -
+		mttcan_rx_fltr_span(a->mask, width) -
+		mttcan_rx_fltr_span(b->mask, width);
+}
+
+/*
+ * Merge the cheapest pairs of elements until at most room are left.
+ * Elements already covered by another one are folded in any case.
+ * Returns the number of elements, *wide is set if any were widened.
+ */
+static u32 mttcan_rx_fltr_merge(struct mttcan_rx_fltr *e, u32 n, u32 room,
+	u32 width, bool *wide)
+{
+	u32 i, j, bi, bj;
+	u64 cost, best;
+
+	while (n > 1) {
+		best = U64_MAX;
+		bi = 0;
+		bj = 0;
+		for (i = 0; i < n && best; i++)
+			for (j = i + 1; j < n && best; j++) {
+				cost = mttcan_rx_fltr_cost(&e[i], &e[j], width);
+				if (cost < best) {
+					best = cost;
+					bi = i;
+					bj = j;
+				}
+			}
+		if (best && n <= room)
+			break;
+
+		e[bi].mask &= e[bj].mask & ~(e[bi].id ^ e[bj].id);
+		e[bi].id &= e[bi].mask;
+		e[bj] = e[--n];
+		if (best)
+			*wide = true;
+	}
+
+	return n;
+}
+
+/* Build the elements for one ID type into e[], returns their number */
+static u32 mttcan_rx_fltr_build(struct mttcan_priv *priv, bool xtd,
+	struct mttcan_rx_fltr *e, u32 room)
+{
+	u32 lim = xtd ? CAN_EFF_MASK : CAN_SFF_MASK;
+	u32 type = xtd ? MTTCAN_RX_FLTR_XTD : MTTCAN_RX_FLTR_STD;
+	bool wide = false;
+	u32 i, n = 0;
+
+	for (i = 0; i < priv->rx_fltr_cnt; i++) {
+		if (priv->rx_fltr[i].xtd != xtd)
+			continue;
+		e[n].mask = priv->rx_fltr[i].mask & lim;
+		e[n].id = priv->rx_fltr[i].id & e[n].mask;
+		e[n].xtd = xtd;
+		n++;
+	}
+
+	/* no entry of this type: none of its frames is wanted */
+	if (!n) {
+		priv->rx_fltr_anf |= type;
+		return 0;
+	}
+
+	if (!room) {
+		priv->rx_fltr_sw |= type;
+		return 0;
+	}
+
+	n = mttcan_rx_fltr_merge(e, n, room, hweight32(lim), &wide);
+	priv->rx_fltr_anf |= type;
+	if (wide)
+		priv->rx_fltr_sw |= type;
+
+	return n;
+}
+
+/* GFC as set through gfc_filter, with the overrides of the table */
+u32 mttcan_rx_fltr_gfc(const struct mttcan_priv *priv)
+{
+	u32 gfc = priv->gfc_reg;
+
+	if (priv->rx_fltr_anf & MTTCAN_RX_FLTR_STD) {
+		gfc &= ~MTT_GFC_ANFS_MASK;
+		gfc |= (GFC_ANFS_REJECT << MTT_GFC_ANFS_SHIFT) &
+			MTT_GFC_ANFS_MASK;
+	}
+	if (priv->rx_fltr_anf & MTTCAN_RX_FLTR_XTD) {
+		gfc &= ~MTT_GFC_ANFE_MASK;
+		gfc |= (GFC_ANFE_REJECT << MTT_GFC_ANFE_SHIFT) &
+			MTT_GFC_ANFE_MASK;
+	}
+
+	return gfc;
+}
+
+static int mttcan_rx_fltr_compile(struct mttcan_priv *priv)
+{
+	struct ttcan_controller *ttcan = priv->ttcan;
+	struct mttcan_rx_fltr *e = priv->rx_fltr_elem;
+	u32 num_std = ttcan->mram_cfg[MRAM_SIDF].num;
+	u32 num_xtd = ttcan->mram_cfg[MRAM_XIDF].num;
+	u32 room_std = 0, room_xtd = 0;
+	u32 i, base;
+	u8 fec = 0;
+
+	/* disable the elements programmed so far */
+	for (i = num_std - priv->rx_fltr_std; i < num_std; i++)
+		ttcan_set_std_id_filter(ttcan, priv->std_shadow, i, 0, 0, 0, 0);
+	for (i = num_xtd - priv->rx_fltr_xtd; i < num_xtd; i++)
+		ttcan_set_xtd_id_filter(ttcan, priv->xtd_shadow, i, 0, 0, 0, 0);
+	priv->rx_fltr_std = 0;
+	priv->rx_fltr_xtd = 0;
+	priv->rx_fltr_anf = 0;
+	priv->rx_fltr_sw = 0;
+
+	if (!priv->rx_fltr_cnt)
+		goto gfc;
+
+	if (ttcan->mram_cfg[MRAM_RXF0].num)
+		fec = FEC_RXFIFO_0;
+	else if (ttcan->mram_cfg[MRAM_RXF1].num)
+		fec = FEC_RXFIFO_1;
+
+	if (fec) {
+		room_std = num_std - ttcan->fltr_config.std_fltr_size;
+		room_xtd = num_xtd - ttcan->fltr_config.xtd_fltr_size;
+	}
+
+	priv->rx_fltr_std = mttcan_rx_fltr_build(priv, false, e, room_std);
+	priv->rx_fltr_xtd = mttcan_rx_fltr_build(priv, true,
+		e + priv->rx_fltr_std, room_xtd);
+
+	base = num_std - priv->rx_fltr_std;
+	for (i = 0; i < priv->rx_fltr_std; i++, e++)
+		ttcan_set_std_id_filter(ttcan, priv->std_shadow, base + i,
+			MTTCAN_FLTR_CLASSIC, fec, e->id, e->mask);
+	base = num_xtd - priv->rx_fltr_xtd;
+	for (i = 0; i < priv->rx_fltr_xtd; i++, e++)
+		ttcan_set_xtd_id_filter(ttcan, priv->xtd_shadow, base + i,
+			MTTCAN_FLTR_CLASSIC, fec, e->id, e->mask);
+
+	if (priv->rx_fltr_sw)
+		dev_warn(priv->device,
+			"rx filters exceed filter RAM, partly filtering in software\n");
+gfc:
+	return ttcan_set_gfc(ttcan, mttcan_rx_fltr_gfc(priv));
+}
+
+static const char *mttcan_rx_fltr_mode(struct mttcan_priv *priv, u32 type,
+	u32 elems)
+{
+	if (!(priv->rx_fltr_anf & type))
+		return priv->rx_fltr_cnt ? "software" : "off";
+	if (!elems)
+		return "rejected";
+	return priv->rx_fltr_sw & type ? "hardware, widened" : "hardware";
+}
+
+static ssize_t show_rx_fltr(struct device *dev,
+	struct device_attribute *devattr, char *buf)
+{
+	struct mttcan_priv *priv = netdev_priv(to_net_dev(dev));
+	ssize_t total;
+	u32 i;
+
+	total = scnprintf(buf, PAGE_SIZE,
+			"Rx filters: %u\nstd: %u elements (%s)\nxtd: %u elements (%s)\n",
+			priv->rx_fltr_cnt,
+			priv->rx_fltr_std, mttcan_rx_fltr_mode(priv,
+				MTTCAN_RX_FLTR_STD, priv->rx_fltr_std),
+			priv->rx_fltr_xtd, mttcan_rx_fltr_mode(priv,
+				MTTCAN_RX_FLTR_XTD, priv->rx_fltr_xtd));
+	/* stop once the sysfs page is full */
+	for (i = 0; i < priv->rx_fltr_cnt && total < PAGE_SIZE - 1; i++)
+		total += scnprintf(buf + total, PAGE_SIZE - total,
+			"%u. id=0x%x mask=0x%x %s\n", i,
+			priv->rx_fltr[i].id, priv->rx_fltr[i].mask,
+			priv->rx_fltr[i].xtd ? "xtd" : "std");
+	return total;
+}
+
+static ssize_t store_rx_fltr(struct device *dev,
+	struct device_attribute *devattr,
+	const char *buf, size_t count)
+{
+	struct net_device *ndev = to_net_dev(dev);
+	struct mttcan_priv *priv = netdev_priv(ndev);
+	unsigned int id = 0, mask = 0, xtd = 0;
+	u32 lim, i;
+	char cmd[8];
+	int ret;
+
+	if (ndev->flags & IFF_UP) {
+		dev_err(dev, "Rx filters cannot be changed, device is running\n");
+		return -EBUSY;
+	}
+
+	/* usage: add/del id=ID mask=MASK xtd=0/1, clear */
+	ret = sscanf(buf, "%7s id=%X mask=%X xtd=%u", cmd, &id, &mask, &xtd);
+	if (ret == 1 && !strcmp(cmd, "clear")) {
+		if (!priv->rx_fltr_cnt)
+			return count;
+		priv->rx_fltr_cnt = 0;
+		ret = mttcan_rx_fltr_compile(priv);
+		return ret ? ret : count;
+	}
+
+	lim = xtd ? CAN_EFF_MASK : CAN_SFF_MASK;
+	if (ret != 4 || xtd > 1 || id > lim || mask > lim) {
+		dev_err(dev, "Invalid Rx filter\n");
+		pr_err("usage: add/del id=IDh mask=MASKh xtd=0/1, or clear\n");
+		return -EINVAL;
+	}
+
+	for (i = 0; i < priv->rx_fltr_cnt; i++)
+		if (priv->rx_fltr[i].id == id && priv->rx_fltr[i].mask == mask
+		    && priv->rx_fltr[i].xtd == xtd)
+			break;
+
+	if (!strcmp(cmd, "add")) {
+		if (i < priv->rx_fltr_cnt)
+			return count;
+		if (priv->rx_fltr_cnt >= MTTCAN_MAX_RX_FLTR) {
+			dev_err(dev, "Rx filter table full\n");
+			return -ENOSPC;
+		}
+		priv->rx_fltr[i].id = id;
+		priv->rx_fltr[i].mask = mask;
+		priv->rx_fltr[i].xtd = xtd;
+		priv->rx_fltr_cnt++;
+	} else if (!strcmp(cmd, "del")) {
+		if (i == priv->rx_fltr_cnt)
+			return -ENOENT;
+		priv->rx_fltr[i] = priv->rx_fltr[--priv->rx_fltr_cnt];
+	} else {
+		dev_err(dev, "Invalid Rx filter command\n");
+		return -EINVAL;
+	}
+
+	ret = mttcan_rx_fltr_compile(priv);
+	return ret ? ret : count;
+}
+
 static ssize_t show_xidam(struct device *dev,
 	struct device_attribute *devattr, char *buf)
 {
@@ -214,8 +487,10 @@ static ssize_t store_std_fltr(struct device *dev,
 
 	cur_filter_size = priv->ttcan->fltr_config.std_fltr_size;
 
-	if ((idx > cur_filter_size) || (idx == -1)) {
-		if (cur_filter_size >= priv->ttcan->mram_cfg[MRAM_SIDF].num) {
+	/* the top rx_fltr_std elements belong to the rx_filter table */
+	if ((idx >= cur_filter_size) || (idx == -1)) {
+		if (cur_filter_size >= priv->ttcan->mram_cfg[MRAM_SIDF].num -
+		    priv->rx_fltr_std) {
 			dev_err(dev, "Max Invalid std filter Index\n");
 			return -ENOSPC;
 		}
@@ -279,8 +554,10 @@ static ssize_t store_xtd_fltr(struct device *dev,
 
 	cur_filter_size = priv->ttcan->fltr_config.xtd_fltr_size;
 
-	if ((idx > cur_filter_size) || (idx == -1)) {
-		if (cur_filter_size >= priv->ttcan->mram_cfg[MRAM_XIDF].num) {
+	/* the top rx_fltr_xtd elements belong to the rx_filter table */
+	if ((idx >= cur_filter_size) || (idx == -1)) {
+		if (cur_filter_size >= priv->ttcan->mram_cfg[MRAM_XIDF].num -
+		    priv->rx_fltr_xtd) {
 			dev_err(dev, "Max Invalid xtd filter Index\n");
 			return -ENOSPC;
 		}
@@ -671,6 +948,8 @@ static DEVICE_ATTR(xtd_filter, S_IRUGO | S_IWUSR, show_xtd_fltr,
 	store_xtd_fltr);
 static DEVICE_ATTR(gfc_filter, S_IRUGO | S_IWUSR, show_gfc_fltr,
 	store_gfc_fltr);
+static DEVICE_ATTR(rx_filter, S_IRUGO | S_IWUSR, show_rx_fltr,
+	store_rx_fltr);
 static DEVICE_ATTR(xidam, S_IRUGO | S_IWUSR, show_xidam, store_xidam);
 static DEVICE_ATTR(tx_cancel, S_IRUGO | S_IWUSR, show_tx_cancel,
 	store_tx_cancel);
@@ -690,6 +969,7 @@ static struct attribute *mttcan_attr[] = {
 	&dev_attr_std_filter.attr,
 	&dev_attr_xtd_filter.attr,
 	&dev_attr_gfc_filter.attr,
+	&dev_attr_rx_filter.attr,
 	&dev_attr_xidam.attr,
 	&dev_attr_tx_cancel.attr,
 	&dev_attr_ttrmc.attr,
@@ -13,6 +13,7 @@
 
 #include <linux/dma-iommu.h>
 #include <linux/etherdevice.h>
+#include <linux/hrtimer.h>
 #include <linux/module.h>
 #include <linux/netdevice.h>
 #include <linux/nvhost.h>
@@ -27,6 +28,12 @@
 
 #define BAR0_SIZE SZ_4M
 
+#if ENABLE_DMA
+/* Delay before reaping DMA write completions of a tx burst */
+#define TVNET_TX_COAL_US	50
+#define TVNET_DMA_TIMEOUT_MS	1000
+#endif
+
 enum bar0_amap_type {
 	META_DATA,
 	SIMPLE_IRQ,
@@ -46,6 +53,15 @@ struct bar0_amap {
 	dma_addr_t phy;
 };
 
+#if ENABLE_DMA
+struct tvnet_ep_tx_desc {
+	struct sk_buff *skb;
+	dma_addr_t src_iova;
+	u64 dst_iova;
+	int len;
+};
+#endif
+
 struct irqsp_data {
 	struct nvhost_interrupt_syncpt *is;
 	struct work_struct reprime_work;
@@ -74,6 +90,13 @@ struct pci_epf_tvnet {
 	struct list_head h2ep_empty_list;
 #if ENABLE_DMA
 	struct dma_desc_cnt desc_cnt;
+	/* To serialize DMA write submission and completion */
+	spinlock_t dma_tx_lock;
+	struct tvnet_ep_tx_desc *tx_desc;
+	/* jiffies of the last DMA write progress */
+	unsigned long tx_progress;
+	struct hrtimer tx_timer;
+	struct napi_struct tx_napi;
 #endif
 	/* To protect h2ep empty list */
 	spinlock_t h2ep_empty_lock;
@@ -414,6 +437,39 @@ static void tvnet_ep_rcv_link_down_ack(struct pci_epf_tvnet *tvnet)
 	tvnet_ep_update_link_sm(tvnet);
 }
 
+#if ENABLE_DMA
+static void tvnet_ep_dma_tx_unmap(struct pci_epf_tvnet *tvnet,
+				  struct tvnet_ep_tx_desc *tx_desc)
+{
+	struct device *cdev = tvnet->epf->epc->dev.parent;
+
+	dma_unmap_single(cdev, tx_desc->src_iova, tx_desc->len,
+			 DMA_TO_DEVICE);
+	dev_consume_skb_any(tx_desc->skb);
+	tx_desc->skb = NULL;
+}
+
+/* Drop in-flight packets, their EP2H empty buffers are lost */
+static void tvnet_ep_dma_tx_drop(struct pci_epf_tvnet *tvnet)
+{
+	struct dma_desc_cnt *desc_cnt = &tvnet->desc_cnt;
+	struct tvnet_dma_desc *ep_dma_virt =
+				(struct tvnet_dma_desc *)tvnet->ep_dma_virt;
+	u32 desc_ridx;
+
+	while (desc_cnt->rd_cnt != desc_cnt->wr_cnt) {
+		desc_ridx = desc_cnt->rd_cnt % DMA_DESC_COUNT;
+		ep_dma_virt[desc_ridx].ctrl_reg.ctrl_e.cb = 0;
+		tvnet_ep_dma_tx_unmap(tvnet, &tvnet->tx_desc[desc_ridx]);
+		tvnet->ndev->stats.tx_dropped++;
+		desc_cnt->rd_cnt++;
+	}
+	mb();
+
+	desc_cnt->rd_cnt = desc_cnt->wr_cnt = 0;
+}
+#endif
+
 static int tvnet_ep_open(struct net_device *ndev)
 {
 	struct device *fdev = ndev->dev.parent;
@@ -428,6 +484,9 @@ static int tvnet_ep_open(struct net_device *ndev)
 	if (tvnet->rx_link_state == DIR_LINK_STATE_DOWN)
 		tvnet_ep_user_link_up_req(tvnet);
 	napi_enable(&tvnet->napi);
+#if ENABLE_DMA
+	napi_enable(&tvnet->tx_napi);
+#endif
 	mutex_unlock(&tvnet->link_state_lock);
 
 	return 0;
@@ -441,6 +500,13 @@ static int tvnet_ep_close(struct net_device *ndev)
 
 	mutex_lock(&tvnet->link_state_lock);
 	napi_disable(&tvnet->napi);
+#if ENABLE_DMA
+	napi_disable(&tvnet->tx_napi);
+	hrtimer_cancel(&tvnet->tx_timer);
+	spin_lock_bh(&tvnet->dma_tx_lock);
+	tvnet_ep_dma_tx_drop(tvnet);
+	spin_unlock_bh(&tvnet->dma_tx_lock);
+#endif
 	if (tvnet->rx_link_state == DIR_LINK_STATE_UP)
 		tvnet_ep_user_link_down_req(tvnet);
 
@@ -484,14 +550,180 @@ static int tvnet_ep_change_mtu(struct net_device *ndev, int new_mtu)
 	return 0;
 }
 
+#if ENABLE_DMA
+/*
+ * Return the index of the first write descriptor which is not complete yet.
+ * The channel LLP register tracks the element being processed, and once the
+ * channel stops it points to the element whose CB did not match CCS.
+ */
+static u32 tvnet_ep_dma_tx_done_idx(struct pci_epf_tvnet *tvnet,
+				    bool *stopped)
+{
+	u64 llp;
+	u32 val;
+
+	val = dma_channel_rd(tvnet->dma_base, DMA_WR_DATA_CH,
+			     DMA_CH_CONTROL1_OFF_WRCH);
+	*stopped = ((val & DMA_CH_CONTROL1_OFF_WRCH_CS_MASK) >>
+		    DMA_CH_CONTROL1_OFF_WRCH_CS_SHIFT) ==
+		   DMA_CH_CONTROL1_OFF_WRCH_CS_STOPPED;
+
+	llp = dma_channel_rd(tvnet->dma_base, DMA_WR_DATA_CH,
+			     DMA_LLP_HIGH_OFF_WRCH);
+	llp = (llp << 32) | dma_channel_rd(tvnet->dma_base, DMA_WR_DATA_CH,
+					   DMA_LLP_LOW_OFF_WRCH);
+	llp -= tvnet->ep_dma_iova;
+
+	/* The link element at the end of the ring wraps to the first one */
+	return (u32)(llp / sizeof(struct tvnet_dma_desc)) % DMA_DESC_COUNT;
+}
+
+static void tvnet_ep_dma_tx_reset(struct pci_epf_tvnet *tvnet)
+{
+	dev_err(tvnet->fdev, "dma took more time, reset dma engine\n");
+	dma_common_wr(tvnet->dma_base, DMA_WRITE_ENGINE_EN_OFF_DISABLE,
+		      DMA_WRITE_ENGINE_EN_OFF);
+	mdelay(1);
+
+	tvnet_ep_dma_tx_drop(tvnet);
+
+	/* Restart the write channel from the head of the desc ring */
+	dma_channel_wr(tvnet->dma_base, DMA_WR_DATA_CH,
+		       lower_32_bits(tvnet->ep_dma_iova),
+		       DMA_LLP_LOW_OFF_WRCH);
+	dma_channel_wr(tvnet->dma_base, DMA_WR_DATA_CH,
+		       upper_32_bits(tvnet->ep_dma_iova),
+		       DMA_LLP_HIGH_OFF_WRCH);
+	dma_common_wr(tvnet->dma_base, DMA_WRITE_ENGINE_EN_OFF_ENABLE,
+		      DMA_WRITE_ENGINE_EN_OFF);
+}
+
+/*
+ * Retire completed DMA writes: push their dst buffers to the EP2H full ring
+ * and raise a single data irq for the whole batch. Returns the number of
+ * descriptors still in flight.
+ */
+static u32 tvnet_ep_dma_tx_reclaim(struct pci_epf_tvnet *tvnet, int budget)
+{
+	struct ep_ring_buf *ep_ring_buf = &tvnet->ep_ring_buf;
+	struct data_msg *ep2h_full_msg = ep_ring_buf->ep2h_full_msgs;
+	struct dma_desc_cnt *desc_cnt = &tvnet->desc_cnt;
+	struct tvnet_dma_desc *ep_dma_virt =
+				(struct tvnet_dma_desc *)tvnet->ep_dma_virt;
+	struct pci_epc *epc = tvnet->epf->epc;
+	struct net_device *ndev = tvnet->ndev;
+	struct tvnet_ep_tx_desc *tx_desc;
+	u32 desc_ridx, done_idx, pending, done, wr_idx, i;
+	bool stopped;
+
+	spin_lock_bh(&tvnet->dma_tx_lock);
+
+	pending = desc_cnt->wr_cnt - desc_cnt->rd_cnt;
+	if (!pending)
+		goto unlock;
+
+	dma_common_wr(tvnet->dma_base, BIT(DMA_WR_DATA_CH),
+		      DMA_WRITE_INT_CLEAR_OFF);
+
+	desc_ridx = desc_cnt->rd_cnt % DMA_DESC_COUNT;
+	done_idx = tvnet_ep_dma_tx_done_idx(tvnet, &stopped);
+	done = (done_idx + DMA_DESC_COUNT - desc_ridx) % DMA_DESC_COUNT;
+	if (done > pending)
+		done = 0;
+	done = min_t(u32, done, budget);
+
+	for (i = 0; i < done; i++) {
+		desc_ridx = desc_cnt->rd_cnt % DMA_DESC_COUNT;
+		tx_desc = &tvnet->tx_desc[desc_ridx];
+
+		/* Clear DMA cycle bit and increment rd_cnt */
+		ep_dma_virt[desc_ridx].ctrl_reg.ctrl_e.cb = 0;
+		desc_cnt->rd_cnt++;
+
+		/* Push dst to EP2H full ring */
+		wr_idx = tvnet_ivc_get_wr_cnt(&tvnet->ep2h_full) % RING_COUNT;
+		ep2h_full_msg[wr_idx].u.full_buffer.packet_size = tx_desc->len;
+		ep2h_full_msg[wr_idx].u.full_buffer.pcie_address =
+							tx_desc->dst_iova;
+		tvnet_ivc_advance_wr(&tvnet->ep2h_full);
+
+		ndev->stats.tx_packets++;
+		ndev->stats.tx_bytes += tx_desc->len;
+		tvnet_ep_dma_tx_unmap(tvnet, tx_desc);
+	}
+	pending -= done;
+
+	if (done) {
+		mb();
+		tvnet->tx_progress = jiffies;
+		/* Let host populate EP2H_EMPTY_BUF ring and consume EP2H_FULL */
+		pci_epc_raise_irq(epc, PCI_EPC_IRQ_MSIX, 0);
+		pci_epc_raise_irq(epc, PCI_EPC_IRQ_MSIX, 1);
+	} else if (time_after(jiffies, tvnet->tx_progress +
+			      msecs_to_jiffies(TVNET_DMA_TIMEOUT_MS))) {
+		tvnet_ep_dma_tx_reset(tvnet);
+		pending = 0;
+	}
+
+	/*
+	 * The channel may have fetched a descriptor before its CB was set and
+	 * stopped there, ring the doorbell again for the remaining ones.
+	 */
+	if (pending && stopped)
+		dma_common_wr8(tvnet->dma_base, DMA_WR_DATA_CH,
+			       DMA_WRITE_DOORBELL_OFF);
+
+unlock:
+	spin_unlock_bh(&tvnet->dma_tx_lock);
+
+	if (netif_queue_stopped(ndev) &&
+	    (tvnet->os_link_state == OS_LINK_STATE_UP) &&
+	    tvnet_ivc_rd_available(&tvnet->ep2h_empty))
+		netif_wake_queue(ndev);
+
+	return pending;
+}
+
+static enum hrtimer_restart tvnet_ep_tx_timer(struct hrtimer *t)
+{
+	struct pci_epf_tvnet *tvnet = container_of(t, struct pci_epf_tvnet,
+						   tx_timer);
+
+	napi_schedule(&tvnet->tx_napi);
+
+	return HRTIMER_NORESTART;
+}
+
+static void tvnet_ep_tx_timer_arm(struct pci_epf_tvnet *tvnet)
+{
+	if (!hrtimer_active(&tvnet->tx_timer))
+		hrtimer_start(&tvnet->tx_timer,
+			      ns_to_ktime(TVNET_TX_COAL_US * NSEC_PER_USEC),
+			      HRTIMER_MODE_REL);
+}
+
+static int tvnet_ep_tx_poll(struct napi_struct *napi, int budget)
+{
+	struct pci_epf_tvnet *tvnet = container_of(napi, struct pci_epf_tvnet,
+						   tx_napi);
+
+	u32 pending;
+
+	pending = tvnet_ep_dma_tx_reclaim(tvnet, DMA_DESC_COUNT);
+	napi_complete(napi);
+	if (pending)
+		tvnet_ep_tx_timer_arm(tvnet);
+
+	return 0;
+}
+#endif
+
 static netdev_tx_t tvnet_ep_start_xmit(struct sk_buff *skb,
 				    struct net_device *ndev)
 {
 	struct device *fdev = ndev->dev.parent;
 	struct pci_epf_tvnet *tvnet = dev_get_drvdata(fdev);
 	struct host_ring_buf *host_ring_buf = &tvnet->host_ring_buf;
-	struct ep_ring_buf *ep_ring_buf = &tvnet->ep_ring_buf;
-	struct data_msg *ep2h_full_msg = ep_ring_buf->ep2h_full_msgs;
 	struct skb_shared_info *info = skb_shinfo(skb);
 	struct data_msg *ep2h_empty_msg = host_ring_buf->ep2h_empty_msgs;
 	struct pci_epf *epf = tvnet->epf;
@@ -501,13 +733,19 @@ static netdev_tx_t tvnet_ep_start_xmit(struct sk_buff *skb,
 	struct dma_desc_cnt *desc_cnt = &tvnet->desc_cnt;
 	struct tvnet_dma_desc *ep_dma_virt =
 				(struct tvnet_dma_desc *)tvnet->ep_dma_virt;
-	u32 desc_widx, desc_ridx, val, ctrl_d;
-	unsigned long timeout;
+	struct tvnet_ep_tx_desc *tx_desc;
+	u32 desc_widx, ctrl_d, inflight;
+#else
+	struct ep_ring_buf *ep_ring_buf = &tvnet->ep_ring_buf;
+	struct data_msg *ep2h_full_msg = ep_ring_buf->ep2h_full_msgs;
+	u64 dst_masked, dst_off;
+	u32 wr_idx;
+	int ret, dst_len;
 #endif
 	dma_addr_t src_iova;
-	u32 rd_idx, wr_idx;
-	u64 dst_masked, dst_off, dst_iova;
-	int ret, dst_len, len;
+	u32 rd_idx;
+	u64 dst_iova;
+	int len;
 
 	/*TODO Not expecting skb frags, remove this after testing */
 	WARN_ON(info->nr_frags);
@@ -520,19 +758,38 @@ static netdev_tx_t tvnet_ep_start_xmit(struct sk_buff *skb,
 		return NETDEV_TX_BUSY;
 	}
 
-	/* Check if EP2H_FULL_BUF available to write */
-	if (tvnet_ivc_full(&tvnet->ep2h_full)) {
+#if ENABLE_DMA
+	spin_lock(&tvnet->dma_tx_lock);
+	inflight = desc_cnt->wr_cnt - desc_cnt->rd_cnt;
+
+	/*
+	 * Check if EP2H_FULL_BUF available to write, in-flight DMA writes
+	 * take their full entry on completion.
+	 */
+	if (tvnet_ivc_rd_available(&tvnet->ep2h_full) + inflight >=
+	    RING_COUNT) {
+		spin_unlock(&tvnet->dma_tx_lock);
 		pci_epc_raise_irq(epc, PCI_EPC_IRQ_MSIX, 1);
 		dev_dbg(fdev, "%s: No EP2H full buf, stop tx\n", __func__);
 		netif_stop_queue(ndev);
+		tvnet_ep_tx_timer_arm(tvnet);
 		return NETDEV_TX_BUSY;
 	}
 
-#if ENABLE_DMA
 	/* Check if dma desc available */
-	if ((desc_cnt->wr_cnt - desc_cnt->rd_cnt) >= DMA_DESC_COUNT) {
+	if (inflight >= DMA_DESC_COUNT) {
+		spin_unlock(&tvnet->dma_tx_lock);
 		dev_dbg(fdev, "%s: dma descs are not available\n", __func__);
 		netif_stop_queue(ndev);
+		tvnet_ep_tx_timer_arm(tvnet);
+		return NETDEV_TX_BUSY;
+	}
+#else
+	/* Check if EP2H_FULL_BUF available to write */
+	if (tvnet_ivc_full(&tvnet->ep2h_full)) {
+		pci_epc_raise_irq(epc, PCI_EPC_IRQ_MSIX, 1);
+		dev_dbg(fdev, "%s: No EP2H full buf, stop tx\n", __func__);
+		netif_stop_queue(ndev);
 		return NETDEV_TX_BUSY;
 	}
 #endif
@@ -542,6 +799,9 @@ static netdev_tx_t tvnet_ep_start_xmit(struct sk_buff *skb,
 	src_iova = dma_map_single(cdev, skb->data, len, DMA_TO_DEVICE);
 	if (dma_mapping_error(cdev, src_iova)) {
 		dev_err(fdev, "%s: dma_map_single failed\n", __func__);
+#if ENABLE_DMA
+		spin_unlock(&tvnet->dma_tx_lock);
+#endif
 		dev_kfree_skb_any(skb);
 		return NETDEV_TX_OK;
 	}
@@ -549,6 +809,8 @@ static netdev_tx_t tvnet_ep_start_xmit(struct sk_buff *skb,
 	/* Get EP2H empty msg */
 	rd_idx = tvnet_ivc_get_rd_cnt(&tvnet->ep2h_empty) % RING_COUNT;
 	dst_iova = ep2h_empty_msg[rd_idx].u.empty_buffer.pcie_address;
+
+#if !ENABLE_DMA
 	dst_len = ep2h_empty_msg[rd_idx].u.empty_buffer.buffer_len;
 
 	/*
@@ -566,18 +828,27 @@ static netdev_tx_t tvnet_ep_start_xmit(struct sk_buff *skb,
 		dev_kfree_skb_any(skb);
 		return NETDEV_TX_OK;
 	}
+#endif
 
 	/*
 	 * Advance read count after all failure cases completed, to avoid
 	 * dangling buffer at host.
 	 */
 	tvnet_ivc_advance_rd(&tvnet->ep2h_empty);
-	/* Raise an interrupt to let host populate EP2H_EMPTY_BUF ring */
-	pci_epc_raise_irq(epc, PCI_EPC_IRQ_MSIX, 0);
 
 #if ENABLE_DMA
-	/* Trigger DMA write from src_iova to dst_iova */
+	/*
+	 * Trigger DMA write from src_iova to dst_iova. The eDMA writes to the
+	 * PCIe address directly, so no outbound ATU window is needed. The skb
+	 * is released and the dst handed to host once the write completes.
+	 */
 	desc_widx = desc_cnt->wr_cnt % DMA_DESC_COUNT;
+	tx_desc = &tvnet->tx_desc[desc_widx];
+	tx_desc->skb = skb;
+	tx_desc->src_iova = src_iova;
+	tx_desc->dst_iova = dst_iova;
+	tx_desc->len = len;
+
 	ep_dma_virt[desc_widx].size = len;
 	ep_dma_virt[desc_widx].sar_low = lower_32_bits(src_iova);
 	ep_dma_virt[desc_widx].sar_high = upper_32_bits(src_iova);
@@ -592,40 +863,17 @@ static netdev_tx_t tvnet_ep_start_xmit(struct sk_buff *skb,
 	/* DMA write should not go out of order wrt CB bit set */
 	mb();
 
-	timeout = jiffies + msecs_to_jiffies(1000);
-	dma_common_wr8(tvnet->dma_base, DMA_WR_DATA_CH, DMA_WRITE_DOORBELL_OFF);
+	if (!inflight)
+		tvnet->tx_progress = jiffies;
 	desc_cnt->wr_cnt++;
+	dma_common_wr8(tvnet->dma_base, DMA_WR_DATA_CH, DMA_WRITE_DOORBELL_OFF);
+	spin_unlock(&tvnet->dma_tx_lock);
 
-	while (true) {
-		val = dma_common_rd(tvnet->dma_base, DMA_WRITE_INT_STATUS_OFF);
-		if (val == BIT(DMA_WR_DATA_CH)) {
-			dma_common_wr(tvnet->dma_base, val,
-				      DMA_WRITE_INT_CLEAR_OFF);
-			break;
-		}
-		if (time_after(jiffies, timeout)) {
-			dev_err(fdev, "dma took more time, reset dma engine\n");
-			dma_common_wr(tvnet->dma_base,
-				      DMA_WRITE_ENGINE_EN_OFF_DISABLE,
-				      DMA_WRITE_ENGINE_EN_OFF);
-			mdelay(1);
-			dma_common_wr(tvnet->dma_base,
-				      DMA_WRITE_ENGINE_EN_OFF_ENABLE,
-				      DMA_WRITE_ENGINE_EN_OFF);
-			desc_cnt->wr_cnt--;
-			pci_epc_unmap_addr(epc, tvnet->tx_dst_pci_addr);
-			dma_unmap_single(cdev, src_iova, len, DMA_TO_DEVICE);
-			return NETDEV_TX_BUSY;
-		}
-	}
-
-	desc_ridx = tvnet->desc_cnt.rd_cnt % DMA_DESC_COUNT;
-	/* Clear DMA cycle bit and increment rd_cnt */
-	ep_dma_virt[desc_ridx].ctrl_reg.ctrl_e.cb = 0;
-	mb();
-
-	tvnet->desc_cnt.rd_cnt++;
+	tvnet_ep_tx_timer_arm(tvnet);
 #else
+	/* Raise an interrupt to let host populate EP2H_EMPTY_BUF ring */
+	pci_epc_raise_irq(epc, PCI_EPC_IRQ_MSIX, 0);
+
 	/* Copy skb->data to host dst address, use CPU virt addr */
 	memcpy((void *)(tvnet->tx_dst_va + dst_off), skb->data, len);
 	/*
@@ -633,7 +881,6 @@ static netdev_tx_t tvnet_ep_start_xmit(struct sk_buff *skb,
 	 * written to dst before adding it to full buffer
 	 */
 	mb();
-#endif
 
 	/* Push dst to EP2H full ring */
 	wr_idx = tvnet_ivc_get_wr_cnt(&tvnet->ep2h_full) % RING_COUNT;
@@ -646,6 +893,7 @@ static netdev_tx_t tvnet_ep_start_xmit(struct sk_buff *skb,
 	pci_epc_unmap_addr(epc, tvnet->tx_dst_pci_addr);
 	dma_unmap_single(cdev, src_iova, len, DMA_TO_DEVICE);
 	dev_kfree_skb_any(skb);
+#endif
 
 	return NETDEV_TX_OK;
 }
@@ -754,10 +1002,12 @@ static int tvnet_ep_process_h2ep_msg(struct pci_epf_tvnet *tvnet)
 static void tvnet_ep_setup_dma(struct pci_epf_tvnet *tvnet)
 {
 	dma_addr_t iova = tvnet->bar0_amap[HOST_DMA].iova;
-	struct dma_desc_cnt *desc_cnt = &tvnet->desc_cnt;
 	u32 val;
 
-	desc_cnt->rd_cnt = desc_cnt->wr_cnt = 0;
+	/* Drop DMA writes left in flight across a link down */
+	spin_lock_bh(&tvnet->dma_tx_lock);
+	tvnet_ep_dma_tx_drop(tvnet);
+	spin_unlock_bh(&tvnet->dma_tx_lock);
 
 	/* Enable linked list mode and set CCS for write channel-0 */
 	val = dma_channel_rd(tvnet->dma_base, DMA_WR_DATA_CH,
@@ -1346,6 +1596,16 @@ static int tvnet_ep_pci_epf_bind(struct pci_epf *epf)
 		goto free_host_dma;
 	}
 
+#if ENABLE_DMA
+	tvnet->tx_desc = devm_kcalloc(fdev, DMA_DESC_COUNT,
+				      sizeof(*tvnet->tx_desc), GFP_KERNEL);
+	if (!tvnet->tx_desc) {
+		dev_err(fdev, "tx desc mem alloc failed\n");
+		ret = -ENOMEM;
+		goto free_pci_mem;
+	}
+#endif
+
 	/* Register network device */
 	ndev = alloc_etherdev(0);
 	if (!ndev) {
@@ -1359,6 +1619,13 @@ static int tvnet_ep_pci_epf_bind(struct pci_epf *epf)
 	SET_NETDEV_DEV(ndev, fdev);
 	ndev->netdev_ops = &tvnet_netdev_ops;
 	netif_napi_add(ndev, &tvnet->napi, tvnet_ep_poll, TVNET_NAPI_WEIGHT);
+#if ENABLE_DMA
+	netif_napi_add(ndev, &tvnet->tx_napi, tvnet_ep_tx_poll,
+		       TVNET_NAPI_WEIGHT);
+	spin_lock_init(&tvnet->dma_tx_lock);
+	hrtimer_init(&tvnet->tx_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	tvnet->tx_timer.function = tvnet_ep_tx_timer;
+#endif
 
 	ndev->mtu = TVNET_DEFAULT_MTU;
 
@@ -1422,6 +1689,9 @@ fail_clear_bar:
 fail_unreg_netdev:
 	unregister_netdev(ndev);
 fail_free_netdev:
+#if ENABLE_DMA
+	netif_napi_del(&tvnet->tx_napi);
+#endif
 	netif_napi_del(&tvnet->napi);
 	free_netdev(ndev);
 free_pci_mem:
@@ -1451,12 +1721,21 @@ static void tvnet_ep_pci_epf_unbind(struct pci_epf *epf)
 
 	cancel_work_sync(&tvnet->ctrl_irqsp->reprime_work);
 	cancel_work_sync(&tvnet->data_irqsp->reprime_work);
+#if ENABLE_DMA
+	hrtimer_cancel(&tvnet->tx_timer);
+	spin_lock_bh(&tvnet->dma_tx_lock);
+	tvnet_ep_dma_tx_drop(tvnet);
+	spin_unlock_bh(&tvnet->dma_tx_lock);
+#endif
 	pci_epc_stop(epc);
 	pci_epc_clear_bar(epc, BAR_0);
 	dma_free_coherent(cdev,
 			  ((RING_COUNT + 1) * sizeof(struct tvnet_dma_desc)),
 			  tvnet->ep_dma_virt, tvnet->ep_dma_iova);
 	unregister_netdev(tvnet->ndev);
+#if ENABLE_DMA
+	netif_napi_del(&tvnet->tx_napi);
+#endif
 	netif_napi_del(&tvnet->napi);
 	free_netdev(tvnet->ndev);
 	pci_epc_mem_free_addr(epc, tvnet->tx_dst_pci_addr, tvnet->tx_dst_va,
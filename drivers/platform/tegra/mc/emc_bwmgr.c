@@ -1,5 +1,5 @@
 /**
- * Copyright (c) 2015-2019, NVIDIA CORPORATION. All rights reserved.
+ * Copyright (c) 2015-2020, NVIDIA CORPORATION. All rights reserved.
  *
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License version 2 as
@@ -21,6 +21,10 @@
 #include <linux/debugfs.h>
 #include <linux/thermal.h>
 #include <linux/version.h>
+#include <linux/workqueue.h>
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 #include <soc/tegra/chip-id.h>
 
 #define CREATE_TRACE_POINTS
@@ -52,6 +56,33 @@ struct tegra_bwmgr_client {
 	int refcount;
 };
 
+/*
+ * Running aggregates over all clients, updated on every vote so that
+ * bwmgr_update_clk() does not have to walk the client table.  Sums are kept
+ * unclamped and clamped to emc_max_rate when the rate is calculated.
+ */
+struct bwmgr_aggr {
+	unsigned long bw;
+	unsigned long iso_bw_nvdis;	/* DISP0 + DISP1 + DISP2 */
+	unsigned long iso_bw_vi;	/* CAMERA */
+	unsigned long iso_bw_other;	/* other ISO clients */
+	u64 iso_client_flags;
+	unsigned long non_iso_cap;	/* min of client caps */
+	unsigned long iso_cap;		/* min of client iso caps */
+	unsigned long floor;		/* max of client floors */
+};
+
+struct bwmgr_stats {
+	u64 votes;
+	u64 transitions;
+	u64 skipped;
+	u64 coalesced;
+	/* snapshot at the previous clients_info read, for rates */
+	u64 last_votes;
+	u64 last_transitions;
+	ktime_t last_read;
+};
+
 /* TODO: Manage client state in a dynamic list */
 static struct {
 	struct tegra_bwmgr_client bwmgr_client[TEGRA_BWMGR_CLIENT_COUNT];
@@ -63,6 +94,15 @@ static struct {
 	bool status;
 	struct bwmgr_ops *ops;
 	bool override;
+	struct bwmgr_aggr aggr;
+	/* last rate handed to clk_set_rate, 0 when unknown */
+	unsigned long req_rate;
+	/* optional coalescing window, 0 applies the rate immediately */
+	u32 coalesce_up_us;
+	u32 coalesce_down_us;
+	struct delayed_work coalesce_work;
+	unsigned long coalesce_deadline;
+	struct bwmgr_stats stats;
 } bwmgr;
 
 static struct dram_refresh_alrt {
@@ -192,14 +232,119 @@ static inline bool bwmgr_unlock(void)
 	return true;
 }
 
+/* call with bwmgr lock held except during init */
+static void bwmgr_aggr_rescan(void)
+{
+	int i;
+	struct bwmgr_aggr *aggr = &bwmgr.aggr;
+	struct tegra_bwmgr_client *client;
+
+	memset(aggr, 0, sizeof(*aggr));
+	aggr->non_iso_cap = bwmgr.emc_max_rate;
+	aggr->iso_cap = bwmgr.emc_max_rate;
+
+	for (i = 0; i < TEGRA_BWMGR_CLIENT_COUNT; i++) {
+		client = bwmgr.bwmgr_client + i;
+
+		aggr->bw += client->bw;
+		if (client->iso_bw > 0) {
+			aggr->iso_client_flags |= BIT_ULL(i);
+
+			if ((i == TEGRA_BWMGR_CLIENT_DISP0) ||
+					(i == TEGRA_BWMGR_CLIENT_DISP1) ||
+					(i == TEGRA_BWMGR_CLIENT_DISP2))
+				aggr->iso_bw_nvdis += client->iso_bw;
+			else if (i == TEGRA_BWMGR_CLIENT_CAMERA)
+				aggr->iso_bw_vi += client->iso_bw;
+			else
+				aggr->iso_bw_other += client->iso_bw;
+		}
+
+		aggr->non_iso_cap = min(aggr->non_iso_cap, client->cap);
+		aggr->iso_cap = min(aggr->iso_cap, client->iso_cap);
+		aggr->floor = max(aggr->floor, client->floor);
+	}
+}
+
+/*
+ * call with bwmgr lock held
+ * Updates one client request and the running aggregates in O(1).  Only when
+ * the client that holds the lowest cap or the highest floor relaxes it does
+ * the aggregate have to be rescanned.
+ */
+static void bwmgr_client_set(struct tegra_bwmgr_client *handle,
+		enum tegra_bwmgr_request_type req, unsigned long val)
+{
+	int i = handle - bwmgr.bwmgr_client;
+	struct bwmgr_aggr *aggr = &bwmgr.aggr;
+	unsigned long *iso_sum;
+	bool rescan = false;
+
+	switch (req) {
+	case TEGRA_BWMGR_SET_EMC_FLOOR:
+		if (val >= aggr->floor)
+			aggr->floor = val;
+		else if (handle->floor == aggr->floor)
+			rescan = true;
+		handle->floor = val;
+		break;
+
+	case TEGRA_BWMGR_SET_EMC_CAP:
+		if (val <= aggr->non_iso_cap)
+			aggr->non_iso_cap = val;
+		else if (handle->cap == aggr->non_iso_cap)
+			rescan = true;
+		handle->cap = val;
+		break;
+
+	case TEGRA_BWMGR_SET_EMC_ISO_CAP:
+		if (val <= aggr->iso_cap)
+			aggr->iso_cap = val;
+		else if (handle->iso_cap == aggr->iso_cap)
+			rescan = true;
+		handle->iso_cap = val;
+		break;
+
+	case TEGRA_BWMGR_SET_EMC_SHARED_BW:
+		aggr->bw = aggr->bw - handle->bw + val;
+		handle->bw = val;
+		break;
+
+	case TEGRA_BWMGR_SET_EMC_SHARED_BW_ISO:
+		if ((i == TEGRA_BWMGR_CLIENT_DISP0) ||
+				(i == TEGRA_BWMGR_CLIENT_DISP1) ||
+				(i == TEGRA_BWMGR_CLIENT_DISP2))
+			iso_sum = &aggr->iso_bw_nvdis;
+		else if (i == TEGRA_BWMGR_CLIENT_CAMERA)
+			iso_sum = &aggr->iso_bw_vi;
+		else
+			iso_sum = &aggr->iso_bw_other;
+
+		*iso_sum = *iso_sum - handle->iso_bw + val;
+		handle->iso_bw = val;
+		if (val > 0)
+			aggr->iso_client_flags |= BIT_ULL(i);
+		else
+			aggr->iso_client_flags &= ~BIT_ULL(i);
+		break;
+
+	default:
+		break;
+	}
+
+	if (rescan)
+		bwmgr_aggr_rescan();
+}
+
 /* call with bwmgr lock held except during init*/
 static void purge_client(struct tegra_bwmgr_client *handle)
 {
-	handle->bw = 0;
-	handle->iso_bw = 0;
-	handle->cap = bwmgr.emc_max_rate;
-	handle->iso_cap = bwmgr.emc_max_rate;
-	handle->floor = 0;
+	bwmgr_client_set(handle, TEGRA_BWMGR_SET_EMC_SHARED_BW, 0);
+	bwmgr_client_set(handle, TEGRA_BWMGR_SET_EMC_SHARED_BW_ISO, 0);
+	bwmgr_client_set(handle, TEGRA_BWMGR_SET_EMC_CAP, bwmgr.emc_max_rate);
+	bwmgr_client_set(handle, TEGRA_BWMGR_SET_EMC_ISO_CAP,
+			bwmgr.emc_max_rate);
+	bwmgr_client_set(handle, TEGRA_BWMGR_SET_EMC_FLOOR, 0);
 	handle->refcount = 0;
 }
 
@@ -215,64 +360,23 @@ static unsigned long tegra_bwmgr_apply_efficiency(
 }
 
 /* call with bwmgr lock held */
-static int bwmgr_update_clk(void)
+static unsigned long bwmgr_calc_rate(void)
 {
-	int i;
-	unsigned long bw = 0;
-	unsigned long iso_bw = 0; // iso_bw_guarantee
-	unsigned long iso_bw_nvdis = 0; //DISP0 + DISP1 + DISP2
-	unsigned long iso_bw_vi = 0; //CAMERA
-	unsigned long iso_bw_other_clients = 0; //Other ISO clients
-	unsigned long non_iso_cap = bwmgr.emc_max_rate;
-	unsigned long iso_cap = bwmgr.emc_max_rate;
-	unsigned long floor = 0;
+	struct bwmgr_aggr *aggr = &bwmgr.aggr;
+	unsigned long max_rate = bwmgr.emc_max_rate;
+	unsigned long bw = min(aggr->bw, max_rate);
+	unsigned long iso_bw_nvdis = min(aggr->iso_bw_nvdis, max_rate);
+	unsigned long iso_bw_vi = min(aggr->iso_bw_vi, max_rate);
+	unsigned long iso_bw_other_clients = min(aggr->iso_bw_other, max_rate);
+	unsigned long iso_bw; // iso_bw_guarantee
+	unsigned long non_iso_cap = aggr->non_iso_cap;
+	unsigned long iso_cap = aggr->iso_cap;
+	unsigned long floor = aggr->floor;
 	unsigned long iso_bw_min;
-	u64 iso_client_flags = 0;
-	int ret = 0;
-
-	/* sizeof(iso_client_flags) */
-	BUILD_BUG_ON(TEGRA_BWMGR_CLIENT_COUNT > 64);
-	/* check that lock is held */
-	if (unlikely(bwmgr.task != current)) {
-		pr_err("bwmgr: %s called without lock\n", __func__);
-		return -EINVAL;
-	}
-
-	if (bwmgr.override)
-		return 0;
-
-	for (i = 0; i < TEGRA_BWMGR_CLIENT_COUNT; i++) {
-		bw += bwmgr.bwmgr_client[i].bw;
-		bw = min(bw, bwmgr.emc_max_rate);
 
-		if (bwmgr.bwmgr_client[i].iso_bw > 0) {
-			iso_client_flags |= BIT(i);
+	iso_bw = min(iso_bw_nvdis + iso_bw_vi + iso_bw_other_clients,
+			max_rate);
 
-			if ((i == TEGRA_BWMGR_CLIENT_DISP0) ||
-					(i == TEGRA_BWMGR_CLIENT_DISP1) ||
-					(i == TEGRA_BWMGR_CLIENT_DISP2)) {
-				iso_bw_nvdis += bwmgr.bwmgr_client[i].iso_bw;
-				iso_bw_nvdis = min(iso_bw_nvdis,
-							bwmgr.emc_max_rate);
-			} else if (i == TEGRA_BWMGR_CLIENT_CAMERA) {
-				iso_bw_vi += bwmgr.bwmgr_client[i].iso_bw;
-				iso_bw_vi = min(iso_bw_vi, bwmgr.emc_max_rate);
-			} else {
-				iso_bw_other_clients +=
-						bwmgr.bwmgr_client[i].iso_bw;
-				iso_bw_other_clients = min(iso_bw_other_clients,
-							bwmgr.emc_max_rate);
-			}
-
-			iso_bw = iso_bw_nvdis + iso_bw_vi +
-						iso_bw_other_clients;
-			iso_bw = min(iso_bw, bwmgr.emc_max_rate);
-		}
-
-		non_iso_cap = min(non_iso_cap, bwmgr.bwmgr_client[i].cap);
-		iso_cap = min(iso_cap, bwmgr.bwmgr_client[i].iso_cap);
-		floor = max(floor, bwmgr.bwmgr_client[i].floor);
-	}
 	debug_info.bw = bw;
 	debug_info.iso_bw = iso_bw;
 	debug_info.floor = floor;
@@ -280,24 +384,112 @@ static int bwmgr_update_clk(void)
 	debug_info.non_iso_cap = non_iso_cap;
 	bw += iso_bw;
 	bw = tegra_bwmgr_apply_efficiency(
-			bw, iso_bw, bwmgr.emc_max_rate,
-			iso_client_flags, &iso_bw_min,
+			bw, iso_bw, max_rate,
+			aggr->iso_client_flags, &iso_bw_min,
 			iso_bw_nvdis, iso_bw_vi);
 	debug_info.total_bw_aftr_eff = bw;
 	debug_info.iso_bw_aftr_eff = iso_bw_min;
-	floor = min(floor, bwmgr.emc_max_rate);
+	floor = min(floor, max_rate);
 	bw = max(bw, floor);
 	bw = min(bw, min(iso_cap, max(non_iso_cap, iso_bw_min)));
 	debug_info.calc_freq = bw;
 	debug_info.req_freq = bw;
 
-	ret = clk_set_rate(bwmgr.emc_clk, bw);
-	if (ret)
+	return bw;
+}
+
+/* call with bwmgr lock held */
+static int bwmgr_set_rate(unsigned long rate)
+{
+	int ret;
+
+	if (rate == bwmgr.req_rate) {
+		bwmgr.stats.skipped++;
+		return 0;
+	}
+
+	ret = clk_set_rate(bwmgr.emc_clk, rate);
+	if (ret) {
 		pr_err
 		("bwmgr: clk_set_rate failed for freq %lu Hz with errno %d\n",
-				bw, ret);
+				rate, ret);
+		bwmgr.req_rate = 0;
+		return ret;
+	}
 
-	return ret;
+	bwmgr.req_rate = rate;
+	bwmgr.stats.transitions++;
+	return 0;
+}
+
+static void bwmgr_coalesce_work_fn(struct work_struct *work)
+{
+	if (!bwmgr_lock()) {
+		pr_err("bwmgr: %s failed\n", __func__);
+		return;
+	}
+
+	if (!bwmgr.override && !clk_update_disabled)
+		bwmgr_set_rate(bwmgr_calc_rate());
+
+	if (!bwmgr_unlock())
+		pr_err("bwmgr: %s failed\n", __func__);
+}
+
+/*
+ * call with bwmgr lock held
+ * Defers the rate change by the up or down coalescing window.  Pending work
+ * is only ever pulled in, never pushed out, so a continuous stream of votes
+ * still results in one EMC change per window.
+ */
+static void bwmgr_coalesce(unsigned long rate)
+{
+	u32 window_us = rate > bwmgr.req_rate ?
+		bwmgr.coalesce_up_us : bwmgr.coalesce_down_us;
+	unsigned long delay = usecs_to_jiffies(window_us);
+	unsigned long deadline = jiffies + delay;
+
+	bwmgr.stats.coalesced++;
+
+	if (!delayed_work_pending(&bwmgr.coalesce_work)) {
+		bwmgr.coalesce_deadline = deadline;
+		schedule_delayed_work(&bwmgr.coalesce_work, delay);
+	} else if (time_before(deadline, bwmgr.coalesce_deadline)) {
+		bwmgr.coalesce_deadline = deadline;
+		mod_delayed_work(system_wq, &bwmgr.coalesce_work, delay);
+	}
+}
+
+/* call with bwmgr lock held */
+static int bwmgr_update_clk(void)
+{
+	unsigned long rate;
+	u32 window_us;
+
+	/* sizeof(iso_client_flags) */
+	BUILD_BUG_ON(TEGRA_BWMGR_CLIENT_COUNT > 64);
+	/* check that lock is held */
+	if (unlikely(bwmgr.task != current)) {
+		pr_err("bwmgr: %s called without lock\n", __func__);
+		return -EINVAL;
+	}
+
+	if (bwmgr.override)
+		return 0;
+
+	rate = bwmgr_calc_rate();
+
+	/* first request and errors are never deferred */
+	if (rate != bwmgr.req_rate && bwmgr.req_rate) {
+		window_us = rate > bwmgr.req_rate ?
+			bwmgr.coalesce_up_us : bwmgr.coalesce_down_us;
+		if (window_us) {
+			bwmgr_coalesce(rate);
+			return 0;
+		}
+	}
+
+	return bwmgr_set_rate(rate);
 }
 
 struct tegra_bwmgr_client *tegra_bwmgr_register(
@@ -449,46 +641,33 @@ int tegra_bwmgr_set_emc(struct tegra_bwmgr_client *handle, unsigned long val,
 			val, bwmgr_req_to_name(req));
 #endif /* CONFIG_TRACEPOINTS */
 
+	bwmgr.stats.votes++;
+
 	switch (req) {
 	case TEGRA_BWMGR_SET_EMC_FLOOR:
-		if (handle->floor != val) {
-			handle->floor = val;
-			update_clk = true;
-		}
+		update_clk = handle->floor != val;
 		break;
 
 	case TEGRA_BWMGR_SET_EMC_CAP:
 		if (val == 0)
 			val = bwmgr.emc_max_rate;
 
-		if (handle->cap != val) {
-			handle->cap = val;
-			update_clk = true;
-		}
+		update_clk = handle->cap != val;
 		break;
 
 	case TEGRA_BWMGR_SET_EMC_ISO_CAP:
 		if (val == 0)
 			val = bwmgr.emc_max_rate;
 
-		if (handle->iso_cap != val) {
-			handle->iso_cap = val;
-			update_clk = true;
-		}
+		update_clk = handle->iso_cap != val;
 		break;
 
 	case TEGRA_BWMGR_SET_EMC_SHARED_BW:
-		if (handle->bw != val) {
-			handle->bw = val;
-			update_clk = true;
-		}
+		update_clk = handle->bw != val;
 		break;
 
 	case TEGRA_BWMGR_SET_EMC_SHARED_BW_ISO:
-		if (handle->iso_bw != val) {
-			handle->iso_bw = val;
-			update_clk = true;
-		}
+		update_clk = handle->iso_bw != val;
 		break;
 
 	default:
@@ -502,6 +681,9 @@ int tegra_bwmgr_set_emc(struct tegra_bwmgr_client *handle, unsigned long val,
 		return -EINVAL;
 	}
 
+	if (update_clk)
+		bwmgr_client_set(handle, req, val);
+
 	if (update_clk && !clk_update_disabled)
 		ret = bwmgr_update_clk();
 
@@ -845,6 +1027,10 @@ int __init bwmgr_init(void)
 
 	for (i = 0; i < TEGRA_BWMGR_CLIENT_COUNT; i++)
 		purge_client(bwmgr.bwmgr_client + i);
+	bwmgr_aggr_rescan();
+
+	INIT_DELAYED_WORK(&bwmgr.coalesce_work, bwmgr_coalesce_work_fn);
+	bwmgr.stats.last_read = ktime_get();
 
 	bwmgr_debugfs_init();
 	pmqos_bwmgr_init();
@@ -863,6 +1049,8 @@ void __exit bwmgr_exit(void)
 {
 	int i;
 
+	cancel_delayed_work_sync(&bwmgr.coalesce_work);
+
 	for (i = 0; i < TEGRA_BWMGR_CLIENT_COUNT; i++)
 		purge_client(bwmgr.bwmgr_client + i);
 
@@ -957,6 +1145,8 @@ static int bwmgr_debugfs_emc_rate_set(void *data, u64 val)
 		bwmgr_update_clk();
 	} else if (bwmgr.emc_clk) {
 		bwmgr.override = true;
+		/* the clock no longer matches what bwmgr requested */
+		bwmgr.req_rate = 0;
 		ret = clk_set_rate(bwmgr.emc_clk, val);
 	}
 
@@ -1073,6 +1263,8 @@ static int bwmgr_debugfs_iso_bw_get(void *data, u64 *val)
 static int bwmgr_clients_info_show(struct seq_file *s, void *data)
 {
 	int i;
+	s64 interval_us;
+	ktime_t now;
 
 	if (!bwmgr_lock()) {
 		pr_err("bwmgr: %s failed\n", __func__);
@@ -1113,6 +1305,26 @@ static int bwmgr_clients_info_show(struct seq_file *s, void *data)
 				 debug_info.req_freq / 1000);
 	seq_printf(s, "EMC current rate                                : %lu (Khz)\n",
 				 tegra_bwmgr_get_emc_rate() / 1000);
+
+	now = ktime_get();
+	interval_us = max_t(s64, ktime_us_delta(now, bwmgr.stats.last_read), 1);
+	seq_printf(s, "Votes (total / per sec since last read)         : %llu / %llu\n",
+			bwmgr.stats.votes,
+			div64_u64((bwmgr.stats.votes -
+				bwmgr.stats.last_votes) * USEC_PER_SEC,
+				interval_us));
+	seq_printf(s, "EMC transitions (total / per sec since last read): %llu / %llu\n",
+			bwmgr.stats.transitions,
+			div64_u64((bwmgr.stats.transitions -
+				bwmgr.stats.last_transitions) * USEC_PER_SEC,
+				interval_us));
+	seq_printf(s, "Updates skipped, rate unchanged                 : %llu\n",
+			bwmgr.stats.skipped);
+	seq_printf(s, "Updates coalesced                               : %llu\n",
+			bwmgr.stats.coalesced);
+	bwmgr.stats.last_votes = bwmgr.stats.votes;
+	bwmgr.stats.last_transitions = bwmgr.stats.transitions;
+	bwmgr.stats.last_read = now;
 	if (!bwmgr_unlock()) {
 		pr_err("bwmgr: %s failed\n", __func__);
 		return -EINVAL;
@@ -1183,6 +1395,12 @@ static void bwmgr_debugfs_init(void)
 		debugfs_node_dram_channels = debugfs_create_file(
 			"num_dram_channels", S_IRUSR, debugfs_dir, NULL,
 			 &fops_debugfs_dram_channels);
+		debugfs_create_u32(
+			"coalesce_up_us", S_IRUSR | S_IWUSR, debugfs_dir,
+			&bwmgr.coalesce_up_us);
+		debugfs_create_u32(
+			"coalesce_down_us", S_IRUSR | S_IWUSR, debugfs_dir,
+			&bwmgr.coalesce_down_us);
 	} else
 		pr_err("bwmgr: error creating bwmgr debugfs dir.\n");
 
@@ -1,7 +1,7 @@
 /*
  * arch/arm/mach-tegra/isomgr.c
  *
- * Copyright (c) 2012-2018, NVIDIA CORPORATION. All rights reserved.
+ * Copyright (c) 2012-2020, NVIDIA CORPORATION. All rights reserved.
  *
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License version 2 as
@@ -631,6 +631,205 @@ u32 tegra_isomgr_realize(tegra_isomgr_handle handle)
 }
 EXPORT_SYMBOL(tegra_isomgr_realize);
 
+/* client state touched by reserve/realize, saved for txn rollback */
+struct isomgr_txn_save {
+	s32 rsvd_bw;
+	s32 real_bw;
+	s32 lti;
+	s32 lto;
+	s32 rsvd_mf;
+	s32 real_mf;
+	s32 sleep_bw;
+	bool realize;
+};
+
+static void isomgr_txn_save(struct isomgr_client *cp,
+			    struct isomgr_txn_save *sv)
+{
+	sv->rsvd_bw = cp->rsvd_bw;
+	sv->real_bw = cp->real_bw;
+	sv->lti = cp->lti;
+	sv->lto = cp->lto;
+	sv->rsvd_mf = cp->rsvd_mf;
+	sv->real_mf = cp->real_mf;
+	sv->sleep_bw = cp->sleep_bw;
+	sv->realize = cp->realize;
+}
+
+static void isomgr_txn_restore(struct isomgr_client *cp,
+			       struct isomgr_txn_save *sv)
+{
+	cp->rsvd_bw = sv->rsvd_bw;
+	cp->real_bw = sv->real_bw;
+	cp->lti = sv->lti;
+	cp->lto = sv->lto;
+	cp->rsvd_mf = sv->rsvd_mf;
+	cp->real_mf = sv->real_mf;
+	cp->sleep_bw = sv->sleep_bw;
+	cp->realize = sv->realize;
+}
+
+/* call with isomgr_lock held. */
+static bool isomgr_txn_stage(struct isomgr_client *cp, int client,
+			     u32 ubw, u32 ult)
+{
+	s32 bw = ubw;
+	u32 mf;
+
+	if (unlikely(cp->realize))
+		return false;
+
+	if (unlikely(!cp->renegotiate && bw > cp->dedi_bw))
+		return false;
+
+	if (isomgr.ops->isomgr_plat_reserve &&
+	    !isomgr.ops->isomgr_plat_reserve(cp, bw,
+				(enum tegra_iso_client)client))
+		return false;
+
+	mf = mc_min_freq(ubw, ult);
+	cp->lti = ult;
+	cp->lto = mc_dvfs_latency(mf);
+	cp->rsvd_mf = mf;
+	cp->rsvd_bw = bw;
+
+	return true;
+}
+
+static int __tegra_isomgr_commit(struct tegra_isomgr_txn_entry *entries,
+				 int n)
+{
+	struct isomgr_txn_save sv[TEGRA_ISO_CLIENT_COUNT];
+	struct isomgr_client *cp;
+	s32 avail_bw, sleep_bw;
+	bool seen[TEGRA_ISO_CLIENT_COUNT] = { false };
+	int client;
+	int ret = -EINVAL;
+	int held = 0;
+	int i;
+
+	if (unlikely(n <= 0 || n > TEGRA_ISO_CLIENT_COUNT))
+		return -EINVAL;
+
+	for (i = 0; i < n; i++) {
+		cp = (struct isomgr_client *)entries[i].handle;
+		client = cp - &isomgr_clients[0];
+		if (unlikely(!cp || !is_client_valid(client) ||
+			     cp->magic != ISOMGR_MAGIC || seen[client])) {
+			pr_err("bad handle %p\n", entries[i].handle);
+			return -EINVAL;
+		}
+		seen[client] = true;
+		entries[i].lto = 0;
+	}
+
+	if (!isomgr_lock()) {
+		pr_err("isomgr: %s failed\n", __func__);
+		return -EINVAL;
+	}
+
+	for (held = 0; held < n; held++) {
+		cp = (struct isomgr_client *)entries[held].handle;
+		if (unlikely(!OBJ_REF_INC_NOT_ZERO(&cp->kref.refcount)))
+			goto put;
+	}
+
+	avail_bw = isomgr.avail_bw;
+	sleep_bw = isomgr.sleep_bw;
+	for (i = 0; i < n; i++)
+		isomgr_txn_save(entries[i].handle, &sv[i]);
+
+	/*
+	 * Stage every reservation first. On t19x each plat_reserve sees the
+	 * rsvd_mf staged before it, so the set is validated as a whole here.
+	 * Pre-t19x plat_reserve checks avail_bw, which only plat_realize
+	 * consumes; there a set that does not fit is caught by the realize
+	 * pass below and rolled back.
+	 */
+	for (i = 0; i < n; i++) {
+		cp = (struct isomgr_client *)entries[i].handle;
+		client = cp - &isomgr_clients[0];
+		trace_tegra_isomgr_reserve(cp, entries[i].bw, entries[i].lt,
+			cname[client], "txn_enter");
+		if (!isomgr_txn_stage(cp, client, entries[i].bw,
+				      entries[i].lt)) {
+			ret = -ENOMEM;
+			goto rollback;
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		cp = (struct isomgr_client *)entries[i].handle;
+		client = cp - &isomgr_clients[0];
+		if (isomgr.ops->isomgr_plat_realize &&
+		    !isomgr.ops->isomgr_plat_realize(cp)) {
+			ret = -ENOMEM;
+			goto rollback;
+		}
+		cp->realize = false;
+		entries[i].lto = cp->lto;
+	}
+
+	/* one EMC update for the whole set */
+	update_mc_clock();
+
+	for (i = 0; i < n; i++) {
+		cp = (struct isomgr_client *)entries[i].handle;
+		trace_tegra_isomgr_realize(cp, cname[cp - &isomgr_clients[0]],
+			"txn_exit");
+	}
+	ret = 0;
+	goto put;
+
+rollback:
+	for (i = 0; i < n; i++) {
+		cp = (struct isomgr_client *)entries[i].handle;
+		isomgr_txn_restore(cp, &sv[i]);
+		entries[i].lto = 0;
+		trace_tegra_isomgr_realize(cp, cname[cp - &isomgr_clients[0]],
+			"txn_rollback");
+	}
+	isomgr.avail_bw = avail_bw;
+	isomgr.sleep_bw = sleep_bw;
+
+put:
+	for (i = 0; i < held; i++) {
+		cp = (struct isomgr_client *)entries[i].handle;
+		kref_put(&cp->kref, unregister_iso_client);
+	}
+	if (!isomgr_unlock())
+		pr_err("isomgr: %s failed\n", __func__);
+
+	return ret;
+}
+
+/**
+ * tegra_isomgr_commit - reserve and realize bw for several clients at once.
+ *
+ * @entries	handle, bw (KBps) and lt (usec) for each client. On success
+ *		the dvfs latency thresh of each client is returned in lto.
+ * @n		number of entries, each client may appear only once.
+ *
+ * Either every entry is realized, followed by a single EMC update, or the
+ * state of all clients is rolled back and nothing is applied.
+ *
+ * @retval  0 all reservations realized.
+ * @retval -ENOMEM the set does not fit in the available iso bw.
+ * @retval -EINVAL invalid or unregistered handle.
+ */
+int tegra_isomgr_commit(struct tegra_isomgr_txn_entry *entries, int n)
+{
+	int i;
+
+	if (test_mode) {
+		for (i = 0; i < n; i++)
+			entries[i].lto = 1;
+		return 0;
+	}
+	return __tegra_isomgr_commit(entries, n);
+}
+EXPORT_SYMBOL(tegra_isomgr_commit);
+
 static int __tegra_isomgr_set_margin(enum tegra_iso_client client,
 					u32 bw, bool wait)
 {
@@ -1099,6 +1298,12 @@ u32 test_tegra_isomgr_realize(tegra_isomgr_handle handle)
 }
 EXPORT_SYMBOL(test_tegra_isomgr_realize);
 
+int test_tegra_isomgr_commit(struct tegra_isomgr_txn_entry *entries, int n)
+{
+	return __tegra_isomgr_commit(entries, n);
+}
+EXPORT_SYMBOL(test_tegra_isomgr_commit);
+
 int test_tegra_isomgr_set_margin(enum tegra_iso_client client,
 				u32 bw, bool wait)
 {
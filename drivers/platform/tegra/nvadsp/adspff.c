@@ -25,6 +25,9 @@
 #include <linux/debugfs.h>
 #include <linux/platform_device.h>
 #include <linux/list.h>
+#include <linux/kfifo.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 
 #include <linux/tegra_nvadsp.h>
 
@@ -33,6 +36,15 @@
 
 
 #define ADSPFF_MAX_OPEN_FILES	(32)
+#define ADSPFF_CMD_FIFO_SIZE	(64)
+#define ADSPFF_RA_SIZE		(32 * 1024)
+
+/* one read-ahead window: file bytes [off, off + len) */
+struct adspff_ra_buf {
+	uint8_t *data;
+	unsigned long long off;
+	uint32_t len;
+};
 
 struct file_struct {
 	struct file *fp;
@@ -41,11 +53,36 @@ struct file_struct {
 	unsigned long long wr_offset;
 	unsigned long long rd_offset;
 	struct list_head list;
+	/*
+	 * read-ahead: ra[ra_cur] is being served to ADSP while
+	 * ra[!ra_cur] is filled by ra_work
+	 */
+	struct adspff_ra_buf ra[2];
+	unsigned int ra_cur;
+	bool ra_failed;
+	struct work_struct ra_work;
+};
+
+struct adspff_stats {
+	u64 fread;
+	u64 fread_hit;
+	u64 fread_stall;
+	u64 bytes_prefetched;
+	u64 bytes_from_cache;
 };
 
 static struct list_head file_list;
 static spinlock_t adspff_lock;
 static int open_count;
+static struct workqueue_struct *adspff_wq;
+static struct adspff_stats adspff_stats;
+
+/* mailbox commands pending for adspff kthread */
+static DEFINE_KFIFO(adspff_cmd_fifo, uint32_t, ADSPFF_CMD_FIFO_SIZE);
+
+/* only ever used from adspff kthread */
+static union adspff_message_t adspff_msg;
+static union adspff_message_t adspff_msg_recv;
 
 /******************************************************************************
 * Kernel file functions
@@ -128,6 +165,8 @@ uint32_t file_size(struct file *file)
 static struct adspff_shared_state_t *adspff;
 static struct nvadsp_mbox rx_mbox;
 
+static void adspff_ra_release(struct file_struct *file);
+
 /**																*
  * w  - open for writing (file need not exist)					*
  * a  - open for appending (file need not exist)				*
@@ -202,23 +241,14 @@ static struct file_struct *check_file_opened(const char *path)
 
 void adspff_fopen(void)
 {
-	union adspff_message_t *message;
-	union adspff_message_t *msg_recv;
+	union adspff_message_t *message = &adspff_msg;
+	union adspff_message_t *msg_recv = &adspff_msg_recv;
 	unsigned int flags = 0;
 	int ret = 0;
 	struct file_struct *file;
 
-
-	message = kzalloc(sizeof(union adspff_message_t), GFP_KERNEL);
-	if (!message)
-		return;
-
-
-	msg_recv = kzalloc(sizeof(union adspff_message_t), GFP_KERNEL);
-	if (!msg_recv) {
-		kfree(message);
-		return;
-	}
+	memset(message, 0, sizeof(*message));
+	memset(msg_recv, 0, sizeof(*msg_recv));
 
 	message->msgq_msg.size = MSGQ_MSG_SIZE(struct fopen_msg_t);
 
@@ -227,8 +257,6 @@ void adspff_fopen(void)
 
 	if (ret < 0) {
 		pr_err("fopen Dequeue failed %d.", ret);
-		kfree(message);
-		kfree(msg_recv);
 		return;
 	}
 
@@ -266,19 +294,15 @@ void adspff_fopen(void)
 		pr_err("fopen Enqueue failed %d.", ret);
 
 		if (file) {
+			adspff_ra_release(file);
 			file_close(file->fp);
 			file->fp = NULL;
 		}
-
-		kfree(message);
-		kfree(msg_recv);
 		return;
 	}
 
 	nvadsp_mbox_send(&rx_mbox, adspff_cmd_fopen_recv,
 				NVADSP_MBOX_SMSG, 0, 0);
-	kfree(message);
-	kfree(msg_recv);
 }
 
 static inline unsigned int is_read_file(struct file_struct *file)
@@ -293,14 +317,10 @@ static inline unsigned int is_write_file(struct file_struct *file)
 
 void adspff_fclose(void)
 {
-	union adspff_message_t *message;
+	union adspff_message_t *message = &adspff_msg;
 	struct file_struct *file = NULL;
 	int32_t ret = 0;
 
-	message = kzalloc(sizeof(union adspff_message_t), GFP_KERNEL);
-	if (!message)
-		return;
-
 	message->msgq_msg.size = MSGQ_MSG_SIZE(struct fclose_msg_t);
 
 	ret = msgq_dequeue_message(&adspff->msgq_send.msgq,
@@ -308,7 +328,6 @@ void adspff_fclose(void)
 
 	if (ret < 0) {
 		pr_err("fclose Dequeue failed %d.", ret);
-		kfree(message);
 		return;
 	}
 
@@ -321,18 +340,16 @@ void adspff_fclose(void)
 				file->wr_offset = 0;
 		}
 	}
-	kfree(message);
 }
 
 void adspff_fsize(void)
 {
-	union adspff_message_t *msg_recv;
+	union adspff_message_t *msg_recv = &adspff_msg_recv;
 	union adspff_message_t message;
 	struct file_struct *file = NULL;
 	int32_t ret = 0;
 	uint32_t size = 0;
 
-	msg_recv = kzalloc(sizeof(union adspff_message_t), GFP_KERNEL);
 	msg_recv->msgq_msg.size = MSGQ_MSG_SIZE(struct ack_msg_t);
 
 	message.msgq_msg.size = MSGQ_MSG_SIZE(struct fsize_msg_t);
@@ -341,7 +358,6 @@ void adspff_fsize(void)
 
 	if (ret < 0) {
 		pr_err("fsize Dequeue failed %d.", ret);
-		kfree(msg_recv);
 		return;
 	}
 	file = (struct file_struct *)message.msg.payload.fsize_msg.file;
@@ -356,28 +372,22 @@ void adspff_fsize(void)
 
 	if (ret < 0) {
 		pr_err("fsize Enqueue failed %d.", ret);
-		kfree(msg_recv);
 		return;
 	}
 	nvadsp_mbox_send(&rx_mbox, adspff_cmd_ack,
 			NVADSP_MBOX_SMSG, 0, 0);
-	kfree(msg_recv);
 }
 
 void adspff_fwrite(void)
 {
 	union adspff_message_t message;
-	union adspff_message_t *msg_recv;
+	union adspff_message_t *msg_recv = &adspff_msg_recv;
 	struct file_struct *file = NULL;
 	int ret = 0;
 	uint32_t size = 0;
 	uint32_t bytes_to_write = 0;
 	uint32_t bytes_written = 0;
 
-	msg_recv = kzalloc(sizeof(union adspff_message_t), GFP_KERNEL);
-	if (!msg_recv)
-		return;
-
 	msg_recv->msgq_msg.size = MSGQ_MSG_SIZE(struct ack_msg_t);
 
 	message.msgq_msg.size = MSGQ_MSG_SIZE(struct fwrite_msg_t);
@@ -385,7 +395,6 @@ void adspff_fwrite(void)
 				(msgq_message_t *)&message);
 	if (ret < 0) {
 		pr_err("fwrite Dequeue failed %d.", ret);
-		kfree(msg_recv);
 		return;
 	}
 
@@ -414,18 +423,159 @@ void adspff_fwrite(void)
 
 	if (ret < 0) {
 		pr_err("adspff: fwrite Enqueue failed %d.", ret);
-		kfree(msg_recv);
 		return;
 	}
 	nvadsp_mbox_send(&rx_mbox, adspff_cmd_ack,
 			NVADSP_MBOX_SMSG, 0, 0);
-	kfree(msg_recv);
+}
+
+/******************************************************************************
+* Read-ahead
+******************************************************************************/
+
+static void adspff_ra_work_fn(struct work_struct *work)
+{
+	struct file_struct *file =
+		container_of(work, struct file_struct, ra_work);
+	struct adspff_ra_buf *buf = &file->ra[!file->ra_cur];
+	unsigned long long off = buf->off;
+	int32_t ret;
+
+	ret = file_read(file->fp, &off, buf->data, ADSPFF_RA_SIZE);
+	if (ret > 0) {
+		buf->len = ret;
+		adspff_stats.bytes_prefetched += ret;
+	}
+}
+
+/* caller makes sure ra_work is idle */
+static void adspff_ra_kick(struct file_struct *file, unsigned long long off)
+{
+	struct adspff_ra_buf *buf = &file->ra[!file->ra_cur];
+
+	buf->off = off;
+	buf->len = 0;
+	queue_work(adspff_wq, &file->ra_work);
+}
+
+static bool adspff_ra_prepare(struct file_struct *file)
+{
+	/* files ADSP can write to are read synchronously */
+	if (file->flags != O_RDONLY || file->ra_failed || !adspff_wq)
+		return false;
+
+	if (file->ra[0].data)
+		return true;
+
+	file->ra[0].data = vmalloc(ADSPFF_RA_SIZE);
+	file->ra[1].data = vmalloc(ADSPFF_RA_SIZE);
+	if (!file->ra[0].data || !file->ra[1].data) {
+		vfree(file->ra[0].data);
+		vfree(file->ra[1].data);
+		file->ra[0].data = NULL;
+		file->ra[1].data = NULL;
+		file->ra_failed = true;
+		pr_warn("read-ahead disabled for %s\n", file->file_name);
+		return false;
+	}
+
+	file->ra[0].len = 0;
+	file->ra[1].len = 0;
+	file->ra_cur = 0;
+	INIT_WORK(&file->ra_work, adspff_ra_work_fn);
+
+	return true;
+}
+
+static void adspff_ra_release(struct file_struct *file)
+{
+	if (!file->ra[0].data)
+		return;
+
+	cancel_work_sync(&file->ra_work);
+	vfree(file->ra[0].data);
+	vfree(file->ra[1].data);
+	file->ra[0].data = NULL;
+	file->ra[1].data = NULL;
+}
+
+static inline bool adspff_ra_contains(struct adspff_ra_buf *buf,
+				      unsigned long long off)
+{
+	return off >= buf->off && off < buf->off + buf->len;
+}
+
+static uint32_t adspff_read_sync(struct file_struct *file,
+				 uint8_t *data, uint32_t size)
+{
+	int32_t ret;
+
+	ret = file_read(file->fp, &file->rd_offset, data, size);
+
+	return ret > 0 ? ret : 0;
+}
+
+/*
+ * Read size bytes at file->rd_offset into data, from the read-ahead
+ * windows when possible. Returns the number of bytes read.
+ */
+static uint32_t adspff_read(struct file_struct *file,
+			    uint8_t *data, uint32_t size)
+{
+	struct adspff_ra_buf *buf;
+	uint32_t copied = 0;
+	uint32_t n;
+	bool stalled = false;
+
+	if (!adspff_ra_prepare(file)) {
+		adspff_stats.fread_stall++;
+		return adspff_read_sync(file, data, size);
+	}
+
+	while (copied < size) {
+		buf = &file->ra[file->ra_cur];
+		if (adspff_ra_contains(buf, file->rd_offset)) {
+			n = min_t(unsigned long long, size - copied,
+				  buf->off + buf->len - file->rd_offset);
+			memcpy(data + copied,
+			       buf->data + (file->rd_offset - buf->off), n);
+			file->rd_offset += n;
+			copied += n;
+			adspff_stats.bytes_from_cache += n;
+			continue;
+		}
+
+		/* current window consumed, switch to the prefetched one */
+		if (flush_work(&file->ra_work))
+			stalled = true;
+
+		buf = &file->ra[!file->ra_cur];
+		if (adspff_ra_contains(buf, file->rd_offset)) {
+			file->ra_cur = !file->ra_cur;
+			adspff_ra_kick(file, buf->off + buf->len);
+			continue;
+		}
+
+		/* cold start, seek or EOF: read the rest synchronously */
+		stalled = true;
+		copied += adspff_read_sync(file, data + copied, size - copied);
+		file->ra[file->ra_cur].len = 0;
+		adspff_ra_kick(file, file->rd_offset);
+		break;
+	}
+
+	if (stalled)
+		adspff_stats.fread_stall++;
+	else
+		adspff_stats.fread_hit++;
+
+	return copied;
 }
 
 void adspff_fread(void)
 {
-	union adspff_message_t *message;
-	union adspff_message_t *msg_recv;
+	union adspff_message_t *message = &adspff_msg;
+	union adspff_message_t *msg_recv = &adspff_msg_recv;
 	struct file_struct *file = NULL;
 	uint32_t bytes_free;
 	uint32_t wi = adspff->read_buf.write_index;
@@ -441,15 +591,6 @@ void adspff_fread(void)
 		bytes_free = ri - wi - 1;
 		can_wrap = 0;
 	}
-	message = kzalloc(sizeof(union adspff_message_t), GFP_KERNEL);
-	if (!message)
-		return;
-
-	msg_recv = kzalloc(sizeof(union adspff_message_t), GFP_KERNEL);
-	if (!msg_recv) {
-		kfree(message);
-		return;
-	}
 
 	msg_recv->msgq_msg.size = MSGQ_MSG_SIZE(struct ack_msg_t);
 	message->msgq_msg.size = MSGQ_MSG_SIZE(struct fread_msg_t);
@@ -459,13 +600,12 @@ void adspff_fread(void)
 
 	if (ret < 0) {
 		pr_err("fread Dequeue failed %d.", ret);
-		kfree(message);
-		kfree(msg_recv);
 		return;
 	}
 
 	file = (struct file_struct *)message->msg.payload.fread_msg.file;
 	size = message->msg.payload.fread_msg.size;
+	adspff_stats.fread++;
 	if (bytes_free < size) {
 		size_read = 0;
 		goto send_ack;
@@ -474,22 +614,16 @@ void adspff_fread(void)
 	if (can_wrap) {
 		uint32_t bytes_to_read = (size < (ADSPFF_SHARED_BUFFER_SIZE - wi)) ?
 			size : (ADSPFF_SHARED_BUFFER_SIZE - wi);
-		ret = file_read(file->fp, &file->rd_offset,
+		size_read = adspff_read(file,
 				adspff->read_buf.data + wi, bytes_to_read);
-		size_read = ret;
-		if (ret < bytes_to_read)
+		if (size_read < bytes_to_read)
 			goto send_ack;
-		if ((size - bytes_to_read) > 0) {
-			ret = file_read(file->fp, &file->rd_offset,
-					adspff->read_buf.data, size - bytes_to_read);
-			size_read += ret;
-			goto send_ack;
-		}
+		if ((size - bytes_to_read) > 0)
+			size_read += adspff_read(file, adspff->read_buf.data,
+					size - bytes_to_read);
 	} else {
-		ret = file_read(file->fp, &file->rd_offset,
+		size_read = adspff_read(file,
 				adspff->read_buf.data + wi, size);
-		size_read = ret;
-		goto send_ack;
 	}
 send_ack:
 	msg_recv->msg.payload.ack_msg.size = size_read;
@@ -498,8 +632,6 @@ send_ack:
 
 	if (ret < 0) {
 		pr_err("fread Enqueue failed %d.", ret);
-		kfree(message);
-		kfree(msg_recv);
 		return;
 	}
 	adspff->read_buf.write_index =
@@ -507,42 +639,31 @@ send_ack:
 
 	nvadsp_mbox_send(&rx_mbox, adspff_cmd_ack,
 			NVADSP_MBOX_SMSG, 0, 0);
-	kfree(message);
-	kfree(msg_recv);
 }
 
-
 static const struct sched_param param = {
 	.sched_priority = MAX_RT_PRIO - 1,
 };
 static struct task_struct *adspff_kthread;
-static struct list_head adspff_kthread_msgq_head;
 static wait_queue_head_t  wait_queue;
 
-struct adspff_kthread_msg {
-	uint32_t msg_id;
-	struct list_head list;
-};
-
 
 static int adspff_kthread_fn(void *data)
 {
 	int ret = 0;
-	struct adspff_kthread_msg *kmsg;
-	unsigned long flags;
+	uint32_t msg_id;
 
 	while (1) {
 
 		ret = wait_event_interruptible(wait_queue, kthread_should_stop()
-				 || !list_empty(&adspff_kthread_msgq_head));
+				 || !kfifo_is_empty(&adspff_cmd_fifo));
 
 		if (kthread_should_stop())
 			do_exit(0);
 
-		if (!list_empty(&adspff_kthread_msgq_head)) {
-			kmsg = list_first_entry(&adspff_kthread_msgq_head,
-					struct adspff_kthread_msg, list);
-			switch (kmsg->msg_id) {
+		while (kfifo_out_spinlocked(&adspff_cmd_fifo, &msg_id, 1,
+					    &adspff_lock)) {
+			switch (msg_id) {
 			case adspff_cmd_fopen:
 				adspff_fopen();
 				break;
@@ -560,12 +681,8 @@ static int adspff_kthread_fn(void *data)
 				break;
 			default:
 				pr_warn("adspff: kthread unsupported msg %d\n",
-					kmsg->msg_id);
+					msg_id);
 			}
-			spin_lock_irqsave(&adspff_lock, flags);
-			list_del(&kmsg->list);
-			spin_unlock_irqrestore(&adspff_lock, flags);
-			kfree(kmsg);
 		}
 	}
 
@@ -580,40 +697,43 @@ static int adspff_kthread_fn(void *data)
 static int adspff_msg_handler(uint32_t msg, void *data)
 {
 	unsigned long flags;
-	struct adspff_kthread_msg *kmsg;
 
 	spin_lock_irqsave(&adspff_lock, flags);
-	kmsg = kzalloc(sizeof(*kmsg), GFP_ATOMIC);
-	if (!kmsg) {
+	if (!kfifo_put(&adspff_cmd_fifo, msg)) {
 		spin_unlock_irqrestore(&adspff_lock, flags);
+		pr_err("adspff: command fifo full, dropping msg %u\n", msg);
 		return -ENOMEM;
 	}
 
-	kmsg->msg_id = msg;
-	list_add_tail(&kmsg->list, &adspff_kthread_msgq_head);
-
 	wake_up(&wait_queue);
 	spin_unlock_irqrestore(&adspff_lock, flags);
 
 	return 0;
 }
 
-static int adspff_set(void *data, u64 val)
+static void adspff_release_files(void)
 {
 	struct file_struct *file;
 	struct list_head *pos, *n;
 
-	if (val != 1)
-		return 0;
 	list_for_each_safe(pos, n, &file_list) {
 		file = list_entry(pos, struct file_struct, list);
 		list_del(pos);
+		adspff_ra_release(file);
 		if (file->fp)
 			file_close(file->fp);
 		kfree(file);
 	}
 
 	open_count = 0;
+}
+
+static int adspff_set(void *data, u64 val)
+{
+	if (val != 1)
+		return 0;
+
+	adspff_release_files();
 
 	return 0;
 }
@@ -635,6 +755,30 @@ static int adspff_debugfs_init(struct nvadsp_drv_data *drv)
 	if (!d)
 		return ret;
 
+	d = debugfs_create_u64("fread", S_IRUGO, dir, &adspff_stats.fread);
+	if (!d)
+		return ret;
+
+	d = debugfs_create_u64("fread_hit", S_IRUGO, dir,
+			&adspff_stats.fread_hit);
+	if (!d)
+		return ret;
+
+	d = debugfs_create_u64("fread_stall", S_IRUGO, dir,
+			&adspff_stats.fread_stall);
+	if (!d)
+		return ret;
+
+	d = debugfs_create_u64("bytes_prefetched", S_IRUGO, dir,
+			&adspff_stats.bytes_prefetched);
+	if (!d)
+		return ret;
+
+	d = debugfs_create_u64("bytes_from_cache", S_IRUGO, dir,
+			&adspff_stats.bytes_from_cache);
+	if (!d)
+		return ret;
+
 	return 0;
 }
 
@@ -671,9 +815,12 @@ int adspff_init(struct platform_device *pdev)
 	if (ret)
 		pr_warn("adspff: failed to create debugfs entry\n");
 
-	INIT_LIST_HEAD(&adspff_kthread_msgq_head);
 	INIT_LIST_HEAD(&file_list);
 
+	adspff_wq = alloc_workqueue("adspff_ra", WQ_UNBOUND | WQ_HIGHPRI, 0);
+	if (!adspff_wq)
+		pr_warn("adspff: read-ahead disabled\n");
+
 	// kthread inIt
 	init_waitqueue_head(&wait_queue);
 	adspff_kthread = kthread_create(adspff_kthread_fn,
@@ -690,4 +837,8 @@ void adspff_exit(void)
 	nvadsp_mbox_close(&rx_mbox);
 	kthread_stop(adspff_kthread);
 	put_task_struct(adspff_kthread);
+	/* no more commands: stop read-ahead and drop every open slot */
+	adspff_release_files();
+	if (adspff_wq)
+		destroy_workqueue(adspff_wq);
 }
@@ -509,7 +509,7 @@ static int move_module(struct adsp_module *mod, struct load_info *info)
 	int i;
 
 	mod->handle = dram_app_mem_request(info->name, mod->size);
-	if (!mod->handle) {
+	if (IS_ERR_OR_NULL(mod->handle)) {
 		dev_err(dev, "cannot allocate memory for app %s\n", info->name);
 		return -ENOMEM;
 	}
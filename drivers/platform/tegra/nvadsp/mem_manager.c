@@ -3,7 +3,7 @@
  *
  * memory manager
  *
- * Copyright (C) 2014-2018 NVIDIA Corporation. All rights reserved.
+ * Copyright (C) 2014-2020 NVIDIA Corporation. All rights reserved.
  *
  * This software is licensed under the terms of the GNU General Public
  * License version 2, as published by the Free Software Foundation, and
@@ -18,7 +18,7 @@
 
 #define pr_fmt(fmt) "%s : %d, " fmt, __func__, __LINE__
 
-#include <linux/list.h>
+#include <linux/rbtree.h>
 #include <linux/slab.h>
 #include <linux/string.h>
 #include <linux/err.h>
@@ -28,32 +28,130 @@
 
 static void clear_alloc_list(struct mem_manager_info *mm_info);
 
+static void chunk_addr_insert(struct rb_root *root, struct mem_chunk *mc)
+{
+	struct rb_node **link = &root->rb_node, *parent = NULL;
+	struct mem_chunk *entry;
+
+	while (*link) {
+		parent = *link;
+		entry = rb_entry(parent, struct mem_chunk, addr_node);
+		if (mc->address < entry->address)
+			link = &parent->rb_left;
+		else
+			link = &parent->rb_right;
+	}
+
+	rb_link_node(&mc->addr_node, parent, link);
+	rb_insert_color(&mc->addr_node, root);
+}
+
+static void chunk_size_insert(struct rb_root *root, struct mem_chunk *mc)
+{
+	struct rb_node **link = &root->rb_node, *parent = NULL;
+	struct mem_chunk *entry;
+
+	while (*link) {
+		parent = *link;
+		entry = rb_entry(parent, struct mem_chunk, size_node);
+		if (mc->size < entry->size ||
+		    (mc->size == entry->size && mc->address < entry->address))
+			link = &parent->rb_left;
+		else
+			link = &parent->rb_right;
+	}
+
+	rb_link_node(&mc->size_node, parent, link);
+	rb_insert_color(&mc->size_node, root);
+}
+
+/* smallest free chunk that can hold size, lowest address on a tie */
+static struct mem_chunk *chunk_best_fit(struct rb_root *root, size_t size)
+{
+	struct rb_node *node = root->rb_node;
+	struct mem_chunk *entry, *best = NULL;
+
+	while (node) {
+		entry = rb_entry(node, struct mem_chunk, size_node);
+		if (entry->size >= size) {
+			best = entry;
+			node = node->rb_left;
+		} else {
+			node = node->rb_right;
+		}
+	}
+
+	return best;
+}
+
+/* first chunk in an address tree above address */
+static struct mem_chunk *chunk_addr_next(struct rb_root *root,
+					 unsigned long address)
+{
+	struct rb_node *node = root->rb_node;
+	struct mem_chunk *entry, *next = NULL;
+
+	while (node) {
+		entry = rb_entry(node, struct mem_chunk, addr_node);
+		if (entry->address > address) {
+			next = entry;
+			node = node->rb_left;
+		} else {
+			node = node->rb_right;
+		}
+	}
+
+	return next;
+}
+
+static struct mem_chunk *chunk_addr_find(struct rb_root *root,
+					 unsigned long address)
+{
+	struct rb_node *node = root->rb_node;
+	struct mem_chunk *entry;
+
+	while (node) {
+		entry = rb_entry(node, struct mem_chunk, addr_node);
+		if (address < entry->address)
+			node = node->rb_left;
+		else if (address > entry->address)
+			node = node->rb_right;
+		else
+			return entry;
+	}
+
+	return NULL;
+}
+
 void *mem_request(void *mem_handle, const char *name, size_t size)
 {
 	unsigned long flags;
 	struct mem_manager_info *mm_info =
 		(struct mem_manager_info *)mem_handle;
-	struct mem_chunk *mc_iterator = NULL, *best_match_chunk = NULL;
+	struct mem_chunk *best_match_chunk = NULL;
 	struct mem_chunk *new_mc = NULL;
 
+	/*
+	 * A zero sized chunk would share its address with the next
+	 * allocation, and chunks are looked up by address.
+	 */
+	if (!size) {
+		pr_err("%s : zero sized request from %s\n",
+		       mm_info->name, name);
+		return ERR_PTR(-EINVAL);
+	}
+
 	spin_lock_irqsave(&mm_info->lock, flags);
 
 	/* Is mem full? */
-	if (list_empty(mm_info->free_list)) {
+	if (RB_EMPTY_ROOT(&mm_info->free_root)) {
 		pr_err("%s : memory full\n", mm_info->name);
 		spin_unlock_irqrestore(&mm_info->lock, flags);
 		return ERR_PTR(-ENOMEM);
 	}
 
 	/* Find the best size match */
-	list_for_each_entry(mc_iterator, mm_info->free_list, node) {
-		if (mc_iterator->size >= size) {
-			if (best_match_chunk == NULL)
-				best_match_chunk = mc_iterator;
-			else if (mc_iterator->size < best_match_chunk->size)
-				best_match_chunk = mc_iterator;
-		}
-	}
+	best_match_chunk = chunk_best_fit(&mm_info->free_size_root, size);
 
 	/* Is free node found? */
 	if (best_match_chunk == NULL) {
@@ -64,108 +162,94 @@ void *mem_request(void *mem_handle, const char *name, size_t size)
 
 	/* Is it exact match? */
 	if (best_match_chunk->size == size) {
-		list_del(&best_match_chunk->node);
-		list_for_each_entry(mc_iterator, mm_info->alloc_list, node) {
-			if (best_match_chunk->address < mc_iterator->address) {
-				list_add_tail(&best_match_chunk->node,
-						&mc_iterator->node);
-				strlcpy(best_match_chunk->name, name,
-						NAME_SIZE);
-				spin_unlock_irqrestore(&mm_info->lock, flags);
-				return best_match_chunk;
-			}
-		}
-		list_add(&best_match_chunk->node, mm_info->alloc_list);
+		rb_erase(&best_match_chunk->addr_node, &mm_info->free_root);
+		rb_erase(&best_match_chunk->size_node,
+			 &mm_info->free_size_root);
 		strlcpy(best_match_chunk->name, name, NAME_SIZE);
+		chunk_addr_insert(&mm_info->alloc_root, best_match_chunk);
 		spin_unlock_irqrestore(&mm_info->lock, flags);
 		return best_match_chunk;
-	} else {
-		new_mc = kzalloc(sizeof(struct mem_chunk), GFP_ATOMIC);
-		if (unlikely(!new_mc)) {
-			pr_err("failed to allocate memory for mem_chunk\n");
+	}
+
+	new_mc = kzalloc(sizeof(struct mem_chunk), GFP_ATOMIC);
+	if (unlikely(!new_mc)) {
+		pr_err("failed to allocate memory for mem_chunk\n");
 
-			spin_unlock_irqrestore(&mm_info->lock, flags);
-			return ERR_PTR(-ENOMEM);
-		}
-		new_mc->address = best_match_chunk->address;
-		new_mc->size = size;
-		strlcpy(new_mc->name, name, NAME_SIZE);
-		best_match_chunk->address += size;
-		best_match_chunk->size -= size;
-		list_for_each_entry(mc_iterator, mm_info->alloc_list, node) {
-			if (new_mc->address < mc_iterator->address) {
-				list_add_tail(&new_mc->node,
-						&mc_iterator->node);
-				spin_unlock_irqrestore(&mm_info->lock, flags);
-				return new_mc;
-			}
-		}
-		list_add_tail(&new_mc->node, mm_info->alloc_list);
 		spin_unlock_irqrestore(&mm_info->lock, flags);
-		return new_mc;
+		return ERR_PTR(-ENOMEM);
 	}
+	new_mc->address = best_match_chunk->address;
+	new_mc->size = size;
+	strlcpy(new_mc->name, name, NAME_SIZE);
+
+	/* the remainder keeps its place in address order, not in size order */
+	rb_erase(&best_match_chunk->size_node, &mm_info->free_size_root);
+	best_match_chunk->address += size;
+	best_match_chunk->size -= size;
+	chunk_size_insert(&mm_info->free_size_root, best_match_chunk);
+
+	chunk_addr_insert(&mm_info->alloc_root, new_mc);
+	spin_unlock_irqrestore(&mm_info->lock, flags);
+	return new_mc;
 }
 
 /*
- * Find the node with sepcified address and remove it from list
+ * Find the node with sepcified address and remove it from alloc tree,
+ * merging it with the adjacent free chunks
  */
 bool mem_release(void *mem_handle, void *handle)
 {
 	unsigned long flags;
 	struct mem_manager_info *mm_info =
 		(struct mem_manager_info *)mem_handle;
-	struct mem_chunk *mc_curr = NULL, *mc_prev = NULL;
+	struct mem_chunk *mc_next = NULL, *mc_prev = NULL;
 	struct mem_chunk *mc_free = (struct mem_chunk *)handle;
+	struct rb_node *node;
 
 	pr_debug(" addr = %lu, size = %lu, name = %s\n",
 			mc_free->address, mc_free->size, mc_free->name);
 
 	spin_lock_irqsave(&mm_info->lock, flags);
 
-	list_for_each_entry(mc_curr, mm_info->free_list, node) {
-		if (mc_free->address < mc_curr->address) {
-
-			strlcpy(mc_free->name, "FREE", NAME_SIZE);
-
-			/* adjacent next free node */
-			if (mc_curr->address ==
-				(mc_free->address + mc_free->size)) {
-
-				mc_curr->address = mc_free->address;
-				mc_curr->size += mc_free->size;
-				list_del(&mc_free->node);
-				kfree(mc_free);
-
-				/* and adjacent prev free node */
-				if ((mc_prev != NULL) &&
-				   ((mc_prev->address + mc_prev->size) ==
-						mc_curr->address)) {
-
-					mc_prev->size += mc_curr->size;
-					list_del(&mc_curr->node);
-					kfree(mc_curr);
-				}
-			}
-			/* adjacent prev free node */
-			else if ((mc_prev != NULL) &&
-				((mc_prev->address + mc_prev->size) ==
-						mc_free->address)) {
-
-				mc_prev->size += mc_free->size;
-				list_del(&mc_free->node);
-				kfree(mc_free);
-			} else {
-				list_del(&mc_free->node);
-				list_add_tail(&mc_free->node,
-						&mc_curr->node);
-			}
-			spin_unlock_irqrestore(&mm_info->lock, flags);
-			return true;
-		}
-		mc_prev = mc_curr;
+	if (chunk_addr_find(&mm_info->alloc_root,
+			    mc_free->address) != mc_free) {
+		spin_unlock_irqrestore(&mm_info->lock, flags);
+		return false;
 	}
+
+	rb_erase(&mc_free->addr_node, &mm_info->alloc_root);
+	strlcpy(mc_free->name, "FREE", NAME_SIZE);
+
+	mc_next = chunk_addr_next(&mm_info->free_root, mc_free->address);
+	node = mc_next ? rb_prev(&mc_next->addr_node) :
+			 rb_last(&mm_info->free_root);
+	if (node)
+		mc_prev = rb_entry(node, struct mem_chunk, addr_node);
+
+	/* adjacent prev free node */
+	if (mc_prev &&
+	    (mc_prev->address + mc_prev->size) == mc_free->address) {
+		rb_erase(&mc_prev->size_node, &mm_info->free_size_root);
+		mc_prev->size += mc_free->size;
+		kfree(mc_free);
+		mc_free = mc_prev;
+	} else {
+		chunk_addr_insert(&mm_info->free_root, mc_free);
+	}
+
+	/* adjacent next free node */
+	if (mc_next &&
+	    mc_next->address == (mc_free->address + mc_free->size)) {
+		rb_erase(&mc_next->addr_node, &mm_info->free_root);
+		rb_erase(&mc_next->size_node, &mm_info->free_size_root);
+		mc_free->size += mc_next->size;
+		kfree(mc_next);
+	}
+
+	chunk_size_insert(&mm_info->free_size_root, mc_free);
+
 	spin_unlock_irqrestore(&mm_info->lock, flags);
-	return false;
+	return true;
 }
 
 inline unsigned long mem_get_address(void *handle)
@@ -179,17 +263,22 @@ void mem_print(void *mem_handle)
 	struct mem_manager_info *mm_info =
 		(struct mem_manager_info *)mem_handle;
 	struct mem_chunk *mc_iterator = NULL;
+	struct rb_node *node;
 
 	pr_info("------------------------------------\n");
 	pr_info("%s ALLOCATED\n", mm_info->name);
-	list_for_each_entry(mc_iterator, mm_info->alloc_list, node) {
+	for (node = rb_first(&mm_info->alloc_root); node;
+	     node = rb_next(node)) {
+		mc_iterator = rb_entry(node, struct mem_chunk, addr_node);
 		pr_info("  addr = %lu, size = %lu, name = %s\n",
 			mc_iterator->address, mc_iterator->size,
 			mc_iterator->name);
 	}
 
 	pr_info("%s FREE\n", mm_info->name);
-	list_for_each_entry(mc_iterator, mm_info->free_list, node) {
+	for (node = rb_first(&mm_info->free_root); node;
+	     node = rb_next(node)) {
+		mc_iterator = rb_entry(node, struct mem_chunk, addr_node);
 		pr_info("  addr = %lu, size = %lu, name = %s\n",
 			mc_iterator->address, mc_iterator->size,
 			mc_iterator->name);
@@ -203,17 +292,22 @@ void mem_dump(void *mem_handle, struct seq_file *s)
 	struct mem_manager_info *mm_info =
 		(struct mem_manager_info *)mem_handle;
 	struct mem_chunk *mc_iterator = NULL;
+	struct rb_node *node;
 
 	seq_puts(s, "---------------------------------------\n");
 	seq_printf(s, "%s ALLOCATED\n", mm_info->name);
-	list_for_each_entry(mc_iterator, mm_info->alloc_list, node) {
+	for (node = rb_first(&mm_info->alloc_root); node;
+	     node = rb_next(node)) {
+		mc_iterator = rb_entry(node, struct mem_chunk, addr_node);
 		seq_printf(s, "  addr = %lu, size = %lu, name = %s\n",
 			mc_iterator->address, mc_iterator->size,
 			mc_iterator->name);
 	}
 
 	seq_printf(s, "%s FREE\n", mm_info->name);
-	list_for_each_entry(mc_iterator, mm_info->free_list, node) {
+	for (node = rb_first(&mm_info->free_root); node;
+	     node = rb_next(node)) {
+		mc_iterator = rb_entry(node, struct mem_chunk, addr_node);
 		seq_printf(s, "  addr = %lu, size = %lu, name = %s\n",
 			mc_iterator->address, mc_iterator->size,
 			mc_iterator->name);
@@ -224,11 +318,11 @@ void mem_dump(void *mem_handle, struct seq_file *s)
 
 static void clear_alloc_list(struct mem_manager_info *mm_info)
 {
-	struct list_head *curr, *next;
+	struct rb_node *node;
 	struct mem_chunk *mc = NULL;
 
-	list_for_each_safe(curr, next, mm_info->alloc_list) {
-		mc = list_entry(curr, struct mem_chunk, node);
+	while ((node = rb_first(&mm_info->alloc_root))) {
+		mc = rb_entry(node, struct mem_chunk, addr_node);
 		pr_debug("  addr = %lu, size = %lu, name = %s\n",
 			mc->address, mc->size,
 			mc->name);
@@ -239,7 +333,6 @@ static void clear_alloc_list(struct mem_manager_info *mm_info)
 void *create_mem_manager(const char *name, unsigned long start_address,
 				unsigned long size)
 {
-	void *ret = NULL;
 	struct mem_chunk *mc;
 	struct mem_manager_info *mm_info =
 			kzalloc(sizeof(struct mem_manager_info), GFP_KERNEL);
@@ -250,67 +343,43 @@ void *create_mem_manager(const char *name, unsigned long start_address,
 
 	strlcpy(mm_info->name, name, NAME_SIZE);
 
-	mm_info->alloc_list = kzalloc(sizeof(struct list_head), GFP_KERNEL);
-	if (unlikely(!mm_info->alloc_list)) {
-		pr_err("failed to allocate memory for alloc_list\n");
-		ret = ERR_PTR(-ENOMEM);
-		goto free_mm_info;
-	}
-
-	mm_info->free_list = kzalloc(sizeof(struct list_head), GFP_KERNEL);
-	if (unlikely(!mm_info->free_list)) {
-		pr_err("failed to allocate memory for free_list\n");
-		ret = ERR_PTR(-ENOMEM);
-		goto free_alloc_list;
-	}
-
-	INIT_LIST_HEAD(mm_info->alloc_list);
-	INIT_LIST_HEAD(mm_info->free_list);
+	mm_info->alloc_root = RB_ROOT;
+	mm_info->free_root = RB_ROOT;
+	mm_info->free_size_root = RB_ROOT;
 
 	mm_info->start_address = start_address;
 	mm_info->size = size;
 
-	/* Add whole memory to free list */
+	/* Add whole memory to free tree */
 	mc = kzalloc(sizeof(struct mem_chunk), GFP_KERNEL);
 	if (unlikely(!mc)) {
 		pr_err("failed to allocate memory for mem_chunk\n");
-		ret = ERR_PTR(-ENOMEM);
-		goto free_free_list;
+		kfree(mm_info);
+		return ERR_PTR(-ENOMEM);
 	}
 
 	mc->address = mm_info->start_address;
 	mc->size = mm_info->size;
 	strlcpy(mc->name, "FREE", NAME_SIZE);
-	list_add(&mc->node, mm_info->free_list);
+	chunk_addr_insert(&mm_info->free_root, mc);
+	chunk_size_insert(&mm_info->free_size_root, mc);
 	spin_lock_init(&mm_info->lock);
 
 	return (void *)mm_info;
-
-free_free_list:
-	kfree(mm_info->free_list);
-free_alloc_list:
-	kfree(mm_info->alloc_list);
-free_mm_info:
-	kfree(mm_info);
-
-	return ret;
 }
 
 void destroy_mem_manager(void *mem_handle)
 {
 	struct mem_manager_info *mm_info =
 		(struct mem_manager_info *)mem_handle;
-	struct mem_chunk *mc_last = NULL;
+	struct mem_chunk *mc, *next;
 
 	/* Clear all allocated memory */
 	clear_alloc_list(mm_info);
 
-	mc_last = list_entry((mm_info->free_list)->next,
-			struct mem_chunk, node);
-	list_del(&mc_last->node);
+	rbtree_postorder_for_each_entry_safe(mc, next, &mm_info->free_root,
+					     addr_node)
+		kfree(mc);
 
-	kfree(mc_last);
-	kfree(mm_info->alloc_list);
-	kfree(mm_info->free_list);
 	kfree(mm_info);
 }
@@ -1,7 +1,7 @@
 /*
  * Header file for memory manager
  *
- * Copyright (c) 2014, NVIDIA CORPORATION.  All rights reserved.
+ * Copyright (c) 2014-2020, NVIDIA CORPORATION.  All rights reserved.
  *
  * This program is free software; you can redistribute it and/or modify it
  * under the terms and conditions of the GNU General Public License,
@@ -17,19 +17,27 @@
 #define __TEGRA_NVADSP_MEM_MANAGER_H
 
 #include <linux/sizes.h>
+#include <linux/rbtree.h>
 
 #define NAME_SIZE SZ_16
 
+/*
+ * A chunk is either allocated, and then linked by address in alloc_root,
+ * or free, and then linked both by address in free_root and by
+ * (size, address) in free_size_root for best-fit lookup.
+ */
 struct mem_chunk {
-	struct list_head node;
+	struct rb_node addr_node;
+	struct rb_node size_node;
 	char name[NAME_SIZE];
 	unsigned long address;
 	unsigned long size;
 };
 
 struct mem_manager_info {
-	struct list_head *alloc_list;
-	struct list_head *free_list;
+	struct rb_root alloc_root;
+	struct rb_root free_root;
+	struct rb_root free_size_root;
 	char name[NAME_SIZE];
 	unsigned long start_address;
 	unsigned long size;
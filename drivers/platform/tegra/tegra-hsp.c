@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2014-2018, NVIDIA CORPORATION.  All rights reserved.
+ * Copyright (c) 2014-2020, NVIDIA CORPORATION.  All rights reserved.
  *
  * This program is free software; you can redistribute it and/or modify it
  * under the terms and conditions of the GNU General Public License,
@@ -22,6 +22,10 @@
 #include <linux/module.h>
 #include <linux/slab.h>
 #include <linux/debugfs.h>
+#include <linux/rculist.h>
+#include <linux/srcu.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 
 #include <linux/tegra-hsp.h>
 
@@ -45,17 +49,44 @@ struct hsp_top {
 
 static DEFINE_SPINLOCK(hsp_top_lock);
 
-struct db_handler_info {
+struct tegra_hsp_db_handler {
+	struct list_head	node;
+	int			master;
+	unsigned int		flags;
 	db_handler_t	handler;
 	void			*data;
+	unsigned long		pending;
+};
+
+/*
+ * Handler lists are walked locklessly: under RCU in the hard IRQ handler
+ * and under SRCU in the IRQ thread, which runs the deferred handlers.
+ * Writers serialize on db_handlers_lock.
+ */
+struct db_master_info {
+	struct list_head	handlers;
+	/* handler registered with tegra_hsp_db_add_handler() */
+	struct tegra_hsp_db_handler	*legacy;
+	/* statistics, updated in hard IRQ context */
+	u64			intr_count;
+	u64			deferred_count;
+	u64			coalesced_count;
+	/* rate sampling, protected by db_handlers_lock */
+	u64			last_count;
+	ktime_t			last_time;
 };
 
 static struct hsp_top hsp_top = { .status = HSP_INIT_PENDING };
 static void __iomem *db_bases[HSP_NR_DBS];
 
 static DEFINE_MUTEX(db_handlers_lock);
+DEFINE_STATIC_SRCU(db_srcu);
 static int db_irq;
-static struct db_handler_info db_handlers[HSP_LAST_MASTER + 1];
+static struct db_master_info db_masters[HSP_LAST_MASTER + 1];
+/* masters with deferred handlers to run in the IRQ thread */
+static unsigned long db_deferred;
+/* masters raised from software by the test mode */
+static unsigned long db_test_pending;
 
 static const char * const master_names[] = {
 	[HSP_MASTER_SECURE_CCPLEX] = "SECURE_CCPLEX",
@@ -115,20 +146,61 @@ static irqreturn_t dbell_irq(int irq, void *data)
 {
 	ulong reg;
 	int master;
-	struct db_handler_info *info;
+	bool wake = false;
+	struct db_master_info *m;
+	struct tegra_hsp_db_handler *info;
 
 	reg = (ulong)hsp_readl(db_bases[HSP_DB_CCPLEX], HSP_DB_REG_PENDING);
 	hsp_writel(db_bases[HSP_DB_CCPLEX], HSP_DB_REG_PENDING, reg);
 
+	if (unlikely(READ_ONCE(db_test_pending)))
+		reg |= xchg(&db_test_pending, 0);
+
+	rcu_read_lock();
 	for_each_set_bit(master, &reg, HSP_LAST_MASTER + 1) {
-		info = &db_handlers[master];
 		if (unlikely(!is_master_valid(master))) {
 			pr_warn("invalid master from HW.\n");
 			continue;
 		}
-		if (info->handler)
-			info->handler(info->data);
+		m = &db_masters[master];
+		m->intr_count++;
+		list_for_each_entry_rcu(info, &m->handlers, node) {
+			if (!(info->flags & TEGRA_HSP_DB_F_DEFERRED)) {
+				info->handler(info->data);
+				continue;
+			}
+			/* A run is already queued: coalesce into it */
+			if (test_and_set_bit(0, &info->pending)) {
+				m->coalesced_count++;
+				continue;
+			}
+			m->deferred_count++;
+			set_bit(master, &db_deferred);
+			wake = true;
+		}
 	}
+	rcu_read_unlock();
+
+	return wake ? IRQ_WAKE_THREAD : IRQ_HANDLED;
+}
+
+static irqreturn_t dbell_thread(int irq, void *data)
+{
+	ulong reg;
+	int master, idx;
+	struct tegra_hsp_db_handler *info;
+
+	reg = xchg(&db_deferred, 0);
+
+	idx = srcu_read_lock(&db_srcu);
+	for_each_set_bit(master, &reg, HSP_LAST_MASTER + 1) {
+		list_for_each_entry_rcu(info, &db_masters[master].handlers,
+				node) {
+			if (test_and_clear_bit(0, &info->pending))
+				info->handler(info->data);
+		}
+	}
+	srcu_read_unlock(&db_srcu, idx);
 
 	return IRQ_HANDLED;
 }
@@ -207,32 +279,111 @@ int tegra_hsp_db_can_ring(enum tegra_hsp_doorbell dbell)
 }
 EXPORT_SYMBOL(tegra_hsp_db_can_ring);
 
+/**
+ * tegra_hsp_db_subscribe: add a handler to the CCPLEX doorbell of <master>
+ * @master:	master id
+ * @handler:	handler to be called when <master> rings CCPLEX
+ * @data:	custom data
+ * @flags:	TEGRA_HSP_DB_F_* flags
+ *
+ * Several handlers may be subscribed to one master. Handlers are called
+ * in hard IRQ context, unless TEGRA_HSP_DB_F_DEFERRED is set: then they
+ * are called from the IRQ thread, and doorbells rung while a call is
+ * pending are coalesced into it. Deferred handlers may sleep.
+ *
+ * Returns a handle for tegra_hsp_db_unsubscribe(), or an ERR_PTR.
+ */
+struct tegra_hsp_db_handler *tegra_hsp_db_subscribe(int master,
+	db_handler_t handler, void *data, unsigned int flags)
+{
+	struct tegra_hsp_db_handler *info;
+
+	if (!handler || master < HSP_FIRST_MASTER ||
+			master > HSP_LAST_MASTER || !is_master_valid(master))
+		return ERR_PTR(-EINVAL);
+
+	if (unlikely(db_irq <= 0))
+		return ERR_PTR(-ENODEV);
+
+	info = kzalloc(sizeof(*info), GFP_KERNEL);
+	if (info == NULL)
+		return ERR_PTR(-ENOMEM);
+
+	info->master = master;
+	info->flags = flags;
+	info->handler = handler;
+	info->data = data;
+
+	mutex_lock(&db_handlers_lock);
+	list_add_tail_rcu(&info->node, &db_masters[master].handlers);
+	mutex_unlock(&db_handlers_lock);
+
+	return info;
+}
+EXPORT_SYMBOL(tegra_hsp_db_subscribe);
+
+/**
+ * tegra_hsp_db_unsubscribe: remove a doorbell handler
+ * @info:	handle returned by tegra_hsp_db_subscribe()
+ *
+ * Waits until no call to the handler is running. Must not be called
+ * from the handler itself.
+ */
+void tegra_hsp_db_unsubscribe(struct tegra_hsp_db_handler *info)
+{
+	if (IS_ERR_OR_NULL(info))
+		return;
+
+	mutex_lock(&db_handlers_lock);
+	list_del_rcu(&info->node);
+	if (db_masters[info->master].legacy == info)
+		db_masters[info->master].legacy = NULL;
+	mutex_unlock(&db_handlers_lock);
+
+	synchronize_rcu();
+	synchronize_srcu(&db_srcu);
+	kfree(info);
+}
+EXPORT_SYMBOL(tegra_hsp_db_unsubscribe);
+
 /**
  * tegra_hsp_db_add_handler: register an CCPLEX doorbell IRQ handler
  * @ master:	master id
  * @ handler:	IRQ handler
  * @ data:		custom data
  *
+ * Only one handler per master can be registered this way.
+ * Use tegra_hsp_db_subscribe() to share a master.
+ *
  * Returns 0 if successful.
  */
 int tegra_hsp_db_add_handler(int master, db_handler_t handler, void *data)
 {
+	struct tegra_hsp_db_handler *info;
+
 	if (!handler || !is_master_valid(master))
 		return -EINVAL;
 
 	if (unlikely(db_irq <= 0))
 		return -ENODEV;
 
+	info = kzalloc(sizeof(*info), GFP_KERNEL);
+	if (info == NULL)
+		return -ENOMEM;
+
+	info->master = master;
+	info->handler = handler;
+	info->data = data;
+
 	mutex_lock(&db_handlers_lock);
-	if (likely(db_handlers[master].handler != NULL)) {
+	if (likely(db_masters[master].legacy != NULL)) {
 		mutex_unlock(&db_handlers_lock);
+		kfree(info);
 		return -EBUSY;
 	}
 
-	disable_irq(db_irq);
-	db_handlers[master].handler = handler;
-	db_handlers[master].data = data;
-	enable_irq(db_irq);
+	db_masters[master].legacy = info;
+	list_add_tail_rcu(&info->node, &db_masters[master].handlers);
 	mutex_unlock(&db_handlers_lock);
 
 	return 0;
@@ -247,6 +398,8 @@ EXPORT_SYMBOL(tegra_hsp_db_add_handler);
  */
 int tegra_hsp_db_del_handler(int master)
 {
+	struct tegra_hsp_db_handler *info;
+
 	if (!is_master_valid(master))
 		return -EINVAL;
 
@@ -254,13 +407,12 @@ int tegra_hsp_db_del_handler(int master)
 		return -ENODEV;
 
 	mutex_lock(&db_handlers_lock);
-	WARN_ON(db_handlers[master].handler == NULL);
-	disable_irq(db_irq);
-	db_handlers[master].handler = NULL;
-	db_handlers[master].data = NULL;
-	enable_irq(db_irq);
+	info = db_masters[master].legacy;
+	WARN_ON(info == NULL);
 	mutex_unlock(&db_handlers_lock);
 
+	tegra_hsp_db_unsubscribe(info);
+
 	return 0;
 }
 EXPORT_SYMBOL(tegra_hsp_db_del_handler);
@@ -384,14 +536,66 @@ static int hsp_dbg_masters_show(struct seq_file *s, void *data)
 static int hsp_dbg_handlers_show(struct seq_file *s, void *data)
 {
 	int m;
-	seq_printf(s, "%-20s%-30s\n", "master", "handler");
-	seq_printf(s, "--------------------------------------------------\n");
+	struct tegra_hsp_db_handler *info;
+	seq_printf(s, "%-20s%-40s%-10s\n", "master", "handler", "mode");
+	seq_printf(s, "----------------------------------------"
+		"--------------------------------\n");
+	mutex_lock(&db_handlers_lock);
 	for_each_valid_master(m)
-		seq_printf(s, "%-20s%-30pS\n", master_names[m],
-			db_handlers[m].handler);
+		list_for_each_entry(info, &db_masters[m].handlers, node)
+			seq_printf(s, "%-20s%-40pS%-10s\n", master_names[m],
+				info->handler,
+				(info->flags & TEGRA_HSP_DB_F_DEFERRED) ?
+					"deferred" : "irq");
+	mutex_unlock(&db_handlers_lock);
+	return 0;
+}
+
+/* Interrupt rates are averaged over the time since the previous read */
+static int hsp_dbg_stats_show(struct seq_file *s, void *data)
+{
+	int m;
+	u64 count, rate, delta;
+	ktime_t now = ktime_get();
+	struct db_master_info *info;
+	seq_printf(s, "%-20s%-14s%-14s%-14s%-10s\n", "master", "interrupts",
+		"deferred", "coalesced", "rate/s");
+	seq_printf(s, "----------------------------------------"
+		"--------------------------------\n");
+	mutex_lock(&db_handlers_lock);
+	for_each_valid_master(m) {
+		info = &db_masters[m];
+		count = READ_ONCE(info->intr_count);
+		delta = ktime_to_ns(ktime_sub(now, info->last_time));
+		rate = 0;
+		if (ktime_to_ns(info->last_time) != 0 && delta != 0)
+			rate = div64_u64((count - info->last_count) *
+				NSEC_PER_SEC, delta);
+		info->last_count = count;
+		info->last_time = now;
+		seq_printf(s, "%-20s%-14llu%-14llu%-14llu%-10llu\n",
+			master_names[m], count,
+			READ_ONCE(info->deferred_count),
+			READ_ONCE(info->coalesced_count), rate);
+	}
+	mutex_unlock(&db_handlers_lock);
 	return 0;
 }
 
+/* Test mode: dispatch a doorbell from <master> without the remote side.
+ * The doorbell IRQ is raised in software, so the regular dispatch path
+ * (including deferred handlers and statistics) is exercised.
+ */
+static int hsp_dbg_test_trigger_store(void *data, u64 val)
+{
+	if (!hsp_ready() || val < HSP_FIRST_MASTER || val > HSP_LAST_MASTER ||
+			!is_master_valid((int)val))
+		return -EINVAL;
+
+	set_bit((int)val, &db_test_pending);
+	return irq_set_irqchip_state(db_irq, IRQCHIP_STATE_PENDING, true);
+}
+
 DEFINE_SIMPLE_ATTRIBUTE(enable_master_fops,
 	hsp_dbg_enable_master_show, hsp_dbg_enable_master_store, "%llx\n");
 DEFINE_SIMPLE_ATTRIBUTE(ring_fops,
@@ -404,6 +608,8 @@ DEFINE_SIMPLE_ATTRIBUTE(raw_fops,
 	hsp_dbg_raw_show, hsp_dbg_raw_store, "%llx\n");
 DEFINE_SIMPLE_ATTRIBUTE(intr_count_fops,
 	hsp_dbg_intr_count_show, hsp_dbg_intr_count_store, "%lld\n");
+DEFINE_SIMPLE_ATTRIBUTE(test_trigger_fops,
+	NULL, hsp_dbg_test_trigger_store, "%lld\n");
 
 #define DEFINE_DBG_OPEN(name) \
 static int hsp_dbg_##name##_open(struct inode *inode, struct file *file) \
@@ -420,6 +626,7 @@ static const struct file_operations name##_fops = { \
 DEFINE_DBG_OPEN(doorbells);
 DEFINE_DBG_OPEN(masters);
 DEFINE_DBG_OPEN(handlers);
+DEFINE_DBG_OPEN(stats);
 
 struct debugfs_entry {
 	const char *name;
@@ -437,6 +644,8 @@ static struct debugfs_entry hsp_dbg_attrs[] = {
 	{ "masters", &masters_fops, S_IRUGO },
 	{ "handlers", &handlers_fops, S_IRUGO },
 	{ "intr_count", &intr_count_fops, S_IRUGO },
+	{ "stats", &stats_fops, S_IRUGO },
+	{ "test_trigger", &test_trigger_fops, S_IWUSR },
 	{ NULL, NULL, 0 }
 };
 
@@ -520,7 +729,11 @@ int tegra_hsp_init(void)
 		pr_debug("tegra-hsp: db[%d]: %p\n", i, db_bases[i]);
 	}
 
-	ret = request_irq(irq, dbell_irq, IRQF_NO_SUSPEND, "hsp", NULL);
+	for (i = 0; i <= HSP_LAST_MASTER; i++)
+		INIT_LIST_HEAD(&db_masters[i].handlers);
+
+	ret = request_threaded_irq(irq, dbell_irq, dbell_thread,
+			IRQF_NO_SUSPEND, "hsp", NULL);
 	if (ret) {
 		pr_err("tegra-hsp: request_irq() failed (%d)\n", ret);
 		goto out;
@@ -1,7 +1,7 @@
 /*
  * Inter-VM Communication
  *
- * Copyright (C) 2014-2016, NVIDIA CORPORATION. All rights reserved.
+ * Copyright (C) 2014-2020, NVIDIA CORPORATION. All rights reserved.
  *
  * This file is licensed under the terms of the GNU General Public License
  * version 2.  This program is licensed "as is" without any warranty of any
@@ -11,6 +11,7 @@
 
 #include <linux/tegra-ivc.h>
 #include <linux/tegra-ivc-instance.h>
+#include <linux/tegra-ivc-frames.h>
 #include <linux/module.h>
 #include <linux/uaccess.h>
 #include <linux/err.h>
@@ -269,6 +270,28 @@ uint32_t tegra_ivc_tx_frames_available(struct ivc *ivc)
 }
 EXPORT_SYMBOL(tegra_ivc_tx_frames_available);
 
+uint32_t tegra_ivc_rx_frames_available(struct ivc *ivc)
+{
+	uint32_t count;
+
+	if (ivc->tx_channel->state != ivc_state_established)
+		return 0;
+
+	ivc_invalidate_counter(ivc, ivc->rx_handle +
+			offsetof(struct ivc_channel_header, w_count));
+	count = ivc_channel_avail_count(ivc, ivc->rx_channel);
+
+	/*
+	 * Order observation of w_count before any reads of the frames it
+	 * covers. An over-full channel is reported as empty, matching
+	 * ivc_channel_empty().
+	 */
+	ivc_rmb();
+
+	return count > ivc->nframes ? 0 : count;
+}
+EXPORT_SYMBOL(tegra_ivc_rx_frames_available);
+
 static void *ivc_frame_pointer(struct ivc *ivc, struct ivc_channel_header *ch,
 		uint32_t frame)
 {
@@ -33,6 +33,9 @@
 #include <linux/file.h>
 #include <linux/poll.h>
 #include <linux/kfifo.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
 #include <uapi/linux/tegra-gte-ioctl.h>
 
 #define GTE_SUSPEND	0
@@ -135,6 +138,9 @@ static LIST_HEAD(gte_devices);
 #define GTE_EVENT_UNREGISTERING		1
 
 #define GTE_EV_FIFO_EL			32
+#define GTE_EV_FIFO_MAX_EL		1024
+/* ring header is padded to a cache line, events follow */
+#define GTE_EV_RING_DATA_OFFSET		64
 #define GTE_MAX_EV_NAME_SZ		9
 
 struct gte_slices {
@@ -177,6 +183,7 @@ struct tegra_gte_dev {
 
 struct tegra_gte_ev_el {
 	int dir;
+	u32 seq;
 	u64 tsc;
 };
 
@@ -185,6 +192,7 @@ struct tegra_gte_event_info {
 	unsigned long flags;
 	atomic_t usage;
 	atomic_t dropped_evs;
+	u32 seq;
 	spinlock_t lock; /* Sync ev_fifo accesses */
 	struct mutex ev_lock;
 	struct kobject kobj;
@@ -339,6 +347,7 @@ int tegra_gte_unregister_event(struct tegra_gte_ev_desc *data)
 	atomic_dec(&gte_dev->usage);
 	atomic_set(&ev->usage, 0);
 	atomic_set(&ev->dropped_evs, 0);
+	ev->seq = 0;
 	memset(&ev->pv, 0, sizeof(ev->pv));
 	kobject_put(&ev->kobj);
 	memset(&ev->kobj, 0, sizeof(ev->kobj));
@@ -374,7 +383,7 @@ static void tegra_gte_map_to_ev_id(u32 eid, struct tegra_gte_dev *gdev,
 
 static struct tegra_gte_ev_desc *__gte_register_event(u32 eid, u32 gid,
 						struct tegra_gte_dev *gte_dev,
-						bool is_aon_gte)
+						bool is_aon_gte, u32 nr_els)
 {
 	u32 slice, sl_bit_shift, ev_bit, offset, val, reg;
 	int ret, sysfs_created;
@@ -415,7 +424,7 @@ static struct tegra_gte_ev_desc *__gte_register_event(u32 eid, u32 gid,
 	ev_bit = offset & (32 - 1);
 
 	if (kfifo_alloc(&ev[offset].ev_fifo,
-	    GTE_EV_FIFO_EL * sizeof(struct tegra_gte_ev_el), GFP_KERNEL)) {
+	    nr_els * sizeof(struct tegra_gte_ev_el), GFP_KERNEL)) {
 		dev_err(gte_dev->pdev, "Fifo allocation failed");
 		ret = -ENOMEM;
 		goto error_unlock;
@@ -531,7 +540,8 @@ struct tegra_gte_ev_desc *tegra_gte_register_event(struct device_node *np,
 		offset = ev_id;
 	}
 
-	return __gte_register_event(offset, ev_id, gte_dev, aon_gte);
+	return __gte_register_event(offset, ev_id, gte_dev, aon_gte,
+				    GTE_EV_FIFO_EL);
 }
 EXPORT_SYMBOL(tegra_gte_register_event);
 
@@ -577,6 +587,7 @@ int tegra_gte_retrieve_event(const struct tegra_gte_ev_desc *data,
 	}
 
 	hts->dir = el.dir;
+	hts->seq = el.seq;
 	hts->ts_raw = el.tsc;
 	hts->ts_ns = el.tsc << GTE_TS_NS_SHIFT;
 	atomic_dec(&ev->usage);
@@ -602,9 +613,70 @@ struct gte_uspace_event_state {
 	wait_queue_head_t wait;
 	struct mutex read_lock;
 	DECLARE_KFIFO(events, struct tegra_gte_hts_event_data, GTE_EV_FIFO_EL);
+	/* mmap'able ring, replaces the events fifo when set */
+	struct tegra_gte_hts_ring_hdr *ring;
+	struct tegra_gte_hts_event_data *ring_ev;
+	u32 ring_size;
+	/* producer index, the copy in the shared header is not trusted */
+	u32 ring_head;
 	struct tegra_gte_ev_desc *gte_data;
 };
 
+static bool gte_event_empty(struct gte_uspace_event_state *le)
+{
+	if (le->ring)
+		return le->ring_head == READ_ONCE(le->ring->tail);
+
+	return kfifo_is_empty(&le->events);
+}
+
+static bool gte_event_push(struct gte_uspace_event_state *le,
+			   const struct tegra_gte_hts_event_data *ge)
+{
+	struct tegra_gte_hts_ring_hdr *hdr = le->ring;
+	u32 head = le->ring_head;
+
+	if (!hdr)
+		return kfifo_put(&le->events, *ge);
+
+	if (head - smp_load_acquire(&hdr->tail) >= le->ring_size) {
+		WRITE_ONCE(hdr->dropped, READ_ONCE(hdr->dropped) + 1);
+		return false;
+	}
+
+	le->ring_ev[head & (le->ring_size - 1)] = *ge;
+	le->ring_head = head + 1;
+	smp_store_release(&hdr->head, le->ring_head);
+
+	return true;
+}
+
+/*
+ * read() on a ring backed event file consumes from the ring, so it must not
+ * be mixed with a userspace consumer of the mapping.
+ */
+static int gte_event_ring_to_user(struct gte_uspace_event_state *le,
+				  char __user *buf, size_t count,
+				  unsigned int *copied)
+{
+	struct tegra_gte_hts_ring_hdr *hdr = le->ring;
+	u32 head = smp_load_acquire(&hdr->head);
+	u32 tail = READ_ONCE(hdr->tail);
+	size_t sz = sizeof(struct tegra_gte_hts_event_data);
+
+	*copied = 0;
+	while (tail != head && count - *copied >= sz) {
+		if (copy_to_user(buf + *copied,
+				 &le->ring_ev[tail & (le->ring_size - 1)], sz))
+			return -EFAULT;
+		*copied += sz;
+		tail++;
+	}
+	smp_store_release(&hdr->tail, tail);
+
+	return 0;
+}
+
 static unsigned int gte_event_poll(struct file *filep,
 				   struct poll_table_struct *wait)
 {
@@ -613,7 +685,7 @@ static unsigned int gte_event_poll(struct file *filep,
 
 	poll_wait(filep, &le->wait, wait);
 
-	if (!kfifo_is_empty(&le->events))
+	if (!gte_event_empty(le))
 		events = POLLIN | POLLRDNORM;
 
 	return events;
@@ -632,19 +704,22 @@ static ssize_t gte_event_read(struct file *filep, char __user *buf,
 		return -EINVAL;
 
 	do {
-		if (kfifo_is_empty(&le->events)) {
+		if (gte_event_empty(le)) {
 			if (filep->f_flags & O_NONBLOCK)
 				return -EAGAIN;
 
 			ret = wait_event_interruptible(le->wait,
-					!kfifo_is_empty(&le->events));
+					!gte_event_empty(le));
 			if (ret)
 				return ret;
 		}
 
 		if (mutex_lock_interruptible(&le->read_lock))
 			return -ERESTARTSYS;
-		ret = kfifo_to_user(&le->events, buf, count, &copied);
+		if (le->ring)
+			ret = gte_event_ring_to_user(le, buf, count, &copied);
+		else
+			ret = kfifo_to_user(&le->events, buf, count, &copied);
 		mutex_unlock(&le->read_lock);
 
 		if (ret)
@@ -674,59 +749,117 @@ static int gte_event_release(struct inode *inode, struct file *filep)
 	gpio_free(le->gpio_in);
 	kfree(le->irqname);
 	kfree(le->label);
+	vfree(le->ring);
 	kfree(le);
 	put_device(&gdev->c_dev);
 	return 0;
 }
 
+static int gte_event_mmap(struct file *filep, struct vm_area_struct *vma)
+{
+	struct gte_uspace_event_state *le = filep->private_data;
+
+	if (!le->ring)
+		return -ENODEV;
+
+	if (vma->vm_pgoff)
+		return -EINVAL;
+
+	return remap_vmalloc_range(vma, le->ring, 0);
+}
+
 static const struct file_operations gte_event_fileops = {
 	.release = gte_event_release,
 	.read = gte_event_read,
 	.poll = gte_event_poll,
+	.mmap = gte_event_mmap,
 	.owner = THIS_MODULE,
 	.llseek = noop_llseek,
 };
 
+/*
+ * Edges may come in faster than this thread runs, drain everything the GTE
+ * has queued for the event and wake readers once per batch.
+ */
 static irqreturn_t gte_event_irq_thread(int irq, void *p)
 {
-	int ret;
 	struct gte_uspace_event_state *le = p;
 	struct tegra_gte_hts_event_data ge;
 	struct tegra_gte_ev_detail hw;
+	bool queued = false;
 
 	memset(&ge, 0, sizeof(ge));
-	ret = tegra_gte_retrieve_event(le->gte_data, &hw);
-	if (ret == 0) {
+	while (tegra_gte_retrieve_event(le->gte_data, &hw) == 0) {
 		ge.timestamp = hw.ts_ns;
 		ge.dir = hw.dir;
-	} else {
-		dev_dbg(le->gdev->pdev, "failed to retrieve event\n");
-		return IRQ_HANDLED;
+		ge.seq = hw.seq;
+		if (gte_event_push(le, &ge))
+			queued = true;
 	}
 
-	ret = kfifo_put(&le->events, ge);
-	if (ret != 0)
+	if (queued)
 		wake_up_poll(&le->wait, POLLIN);
+	else
+		dev_dbg(le->gdev->pdev, "failed to retrieve event\n");
 
 	return IRQ_HANDLED;
 }
 
+static int gte_event_ring_alloc(struct gte_uspace_event_state *le,
+				u32 ring_size)
+{
+	size_t sz = GTE_EV_RING_DATA_OFFSET +
+		    ring_size * sizeof(struct tegra_gte_hts_event_data);
+
+	le->ring = vmalloc_user(PAGE_ALIGN(sz));
+	if (!le->ring)
+		return -ENOMEM;
+
+	le->ring->size = ring_size;
+	le->ring->data_offset = GTE_EV_RING_DATA_OFFSET;
+	le->ring_ev = (void *)le->ring + GTE_EV_RING_DATA_OFFSET;
+	le->ring_size = ring_size;
+
+	return 0;
+}
+
 #define GPIOEVENT_REQUEST_VALID_FLAGS (TEGRA_GTE_EVENT_RISING_EDGE | \
 				       TEGRA_GTE_EVENT_FALLING_EDGE)
 
-static int gte_event_create(struct tegra_gte_dev *gdev, void __user *ip)
+static int gte_event_create(struct tegra_gte_dev *gdev, void __user *ip,
+			    bool use_ring)
 {
+	struct tegra_gte_hts_event_ring_req ringreq;
 	struct tegra_gte_hts_event_req eventreq;
 	struct gte_uspace_event_state *le;
 	struct file *file;
 	int offset;
 	u32 eflags;
+	u32 nr_els = GTE_EV_FIFO_EL;
+	int fflags = O_RDONLY | O_CLOEXEC;
 	int fd;
 	int ret;
 	int irqflags = 0;
 
-	if (copy_from_user(&eventreq, ip, sizeof(eventreq)))
+	if (use_ring) {
+		if (copy_from_user(&ringreq, ip, sizeof(ringreq)))
+			return -EFAULT;
+
+		if (!is_power_of_2(ringreq.ring_size) ||
+		    ringreq.ring_size > TEGRA_GTE_HTS_RING_MAX) {
+			dev_err(gdev->pdev, "Invalid ring size %u\n",
+				ringreq.ring_size);
+			return -EINVAL;
+		}
+		eventreq.global_gpio_pin = ringreq.global_gpio_pin;
+		eventreq.eventflags = ringreq.eventflags;
+		nr_els = clamp_t(u32, ringreq.ring_size, GTE_EV_FIFO_EL,
+				 GTE_EV_FIFO_MAX_EL);
+		/* the consumer writes the ring tail through the mapping */
+		fflags = O_RDWR | O_CLOEXEC;
+	} else if (copy_from_user(&eventreq, ip, sizeof(eventreq))) {
 		return -EFAULT;
+	}
 
 	if (!gdev->mp) {
 		dev_err(gdev->pdev, "no controller node\n");
@@ -756,6 +889,12 @@ static int gte_event_create(struct tegra_gte_dev *gdev, void __user *ip)
 
 	le->gdev = gdev;
 
+	if (use_ring) {
+		ret = gte_event_ring_alloc(le, ringreq.ring_size);
+		if (ret)
+			goto out_free_le;
+	}
+
 	le->label = kzalloc(GTE_MAX_EV_NAME_SZ, GFP_KERNEL);
 	if (!le->label) {
 		ret = -ENOMEM;
@@ -814,14 +953,14 @@ static int gte_event_create(struct tegra_gte_dev *gdev, void __user *ip)
 	init_waitqueue_head(&le->wait);
 	mutex_init(&le->read_lock);
 
-	fd = get_unused_fd_flags(O_RDONLY | O_CLOEXEC);
+	fd = get_unused_fd_flags(fflags);
 	if (fd < 0) {
 		ret = fd;
 		goto out_free_irq;
 	}
 
 	file = anon_inode_getfile("gte-gpio-event", &gte_event_fileops, le,
-				  O_RDONLY | O_CLOEXEC);
+				  fflags);
 	if (IS_ERR(file)) {
 		ret = PTR_ERR(file);
 		dev_err(gdev->pdev, "failed to create file\n");
@@ -829,15 +968,21 @@ static int gte_event_create(struct tegra_gte_dev *gdev, void __user *ip)
 	}
 
 	eventreq.fd = fd;
+	ringreq.fd = fd;
 
-	le->gte_data = __gte_register_event(offset, le->gpio_in, gdev, true);
+	le->gte_data = __gte_register_event(offset, le->gpio_in, gdev, true,
+					    nr_els);
 	if (IS_ERR(le->gte_data)) {
 		ret = PTR_ERR(le->gte_data);
 		dev_err(gdev->pdev, "failed gte register event\n");
 		goto out_put_file;
 	}
 
-	if (copy_to_user(ip, &eventreq, sizeof(eventreq))) {
+	if (use_ring)
+		ret = copy_to_user(ip, &ringreq, sizeof(ringreq));
+	else
+		ret = copy_to_user(ip, &eventreq, sizeof(eventreq));
+	if (ret) {
 		dev_err(gdev->pdev, "failed to copy user\n");
 		ret = -EFAULT;
 		goto out_put_file;
@@ -859,6 +1004,7 @@ out_free_name:
 out_free_label:
 	kfree(le->label);
 out_free_le:
+	vfree(le->ring);
 	kfree(le);
 	put_device(&gdev->c_dev);
 	return ret;
@@ -873,7 +1019,9 @@ static long gte_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 		return -ENODEV;
 
 	if (cmd == TEGRA_GTE_HTS_CREATE_GPIO_EV_IOCTL)
-		return gte_event_create(gdev, ip);
+		return gte_event_create(gdev, ip, false);
+	if (cmd == TEGRA_GTE_HTS_CREATE_GPIO_EV_RING_IOCTL)
+		return gte_event_create(gdev, ip, true);
 
 	return -EINVAL;
 }
@@ -957,6 +1105,8 @@ static void tegra_gte_read_fifo(struct tegra_gte_dev *gte)
 			if (test_bit(GTE_EVENT_REGISTERED, &ev[ev_id].flags)) {
 				ts.tsc = tsc;
 				ts.dir = dir;
+				/* dropped events still consume a number */
+				ts.seq = ev[ev_id].seq++;
 				dev_dbg(gte->pdev, "ISR for ev id:%d, ts:%llu",
 					ev_id, tsc);
 				if (kfifo_avail(&ev[ev_id].ev_fifo) >=
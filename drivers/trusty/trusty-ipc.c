@@ -1,6 +1,6 @@
 /*
  * Copyright (C) 2015 Google, Inc.
- * Copyright (c) 2016-2018, NVIDIA CORPORATION. All rights reserved.
+ * Copyright (c) 2016-2020, NVIDIA CORPORATION. All rights reserved.
  *
  * This software is licensed under the terms of the GNU General Public
  * License version 2, as published by the Free Software Foundation, and
@@ -30,6 +30,9 @@
 #endif /* LINUX_VERSION_CODE >= KERNEL_VERSION(4, 14, 0) */
 #include <linux/compat.h>
 #include <linux/uio.h>
+#include <linux/dma-buf.h>
+#include <linux/mm.h>
+#include <linux/scatterlist.h>
 
 #include <linux/virtio.h>
 #include <linux/virtio_ids.h>
@@ -54,8 +57,48 @@
 
 #define TIPC_MIN_LOCAL_ADDR		1024
 
+/* virtio feature: secure side accepts messages with memory references */
+#define TIPC_F_SHM_REF			1
+
+#define TIPC_MSG_FLAG_SHM		0x1
+
+#define TIPC_MAX_SHM_CNT		16
+#define TIPC_MAX_SHM_PAGES		4096 /* per channel */
+
+/*
+ * struct tipc_shm - memory shared by reference along with a message
+ * @fd: dma-buf fd, or -1 to share the user memory at @addr
+ * @flags: TIPC_SHM_WRITABLE if the secure side may write to it
+ * @addr: user address, or offset into the dma-buf
+ * @size: number of bytes to share
+ */
+struct tipc_shm {
+	__s32 fd;
+	__u32 flags;
+	__u64 addr;
+	__u64 size;
+};
+
+#define TIPC_SHM_WRITABLE		0x1
+
+/*
+ * struct tipc_send_msg_req - send a message with memory references
+ * @iov: user pointer to an iovec array holding the inline payload
+ * @iov_cnt: number of entries in @iov
+ * @shm: user pointer to a tipc_shm array
+ * @shm_cnt: number of entries in @shm
+ */
+struct tipc_send_msg_req {
+	__u64 iov;
+	__u64 iov_cnt;
+	__u64 shm;
+	__u64 shm_cnt;
+};
+
 #define TIPC_IOC_MAGIC			'r'
 #define TIPC_IOC_CONNECT		_IOW(TIPC_IOC_MAGIC, 0x80, char *)
+#define TIPC_IOC_SEND_MSG		_IOW(TIPC_IOC_MAGIC, 0x81, \
+					     struct tipc_send_msg_req)
 #if defined(CONFIG_COMPAT)
 #define TIPC_IOC_CONNECT_COMPAT		_IOW(TIPC_IOC_MAGIC, 0x80, \
 					     compat_uptr_t)
@@ -84,6 +127,7 @@ enum tipc_ctrl_msg_types {
 	TIPC_CTRL_MSGTYPE_CONN_REQ,
 	TIPC_CTRL_MSGTYPE_CONN_RSP,
 	TIPC_CTRL_MSGTYPE_DISC_REQ,
+	TIPC_CTRL_MSGTYPE_SHM_RELEASE,
 };
 
 struct tipc_ctrl_msg {
@@ -108,6 +152,50 @@ struct tipc_disc_req_body {
 	u32 target;
 } __packed;
 
+struct tipc_shm_release_body {
+	u32 target;
+	u32 reserved;
+	u64 id;
+} __packed;
+
+/*
+ * Payload of a message with TIPC_MSG_FLAG_SHM set: inline_len bytes of
+ * data, then shm_cnt struct tipc_shm_ref starting at the next 8 byte
+ * boundary. Each reference lists the pages backing it, encoded the same
+ * way as other memory handed to the secure side. Ids are unique per
+ * device. The pages stay shared, even after the channel is closed, until
+ * the secure side sends TIPC_CTRL_MSGTYPE_SHM_RELEASE for the id.
+ */
+struct tipc_shm_msg_hdr {
+	u32 inline_len;
+	u32 shm_cnt;
+	u8 data[0];
+} __packed;
+
+struct tipc_shm_ref {
+	u64 id;
+	u64 size;
+	u32 offset;
+	u32 flags;
+	u32 page_cnt;
+	u32 reserved;
+	u64 pages[0];
+} __packed;
+
+struct tipc_shm_obj {
+	struct list_head node;
+	u64 id;
+	u32 flags;
+	u32 offset;
+	u64 size;
+	size_t nr_pages;
+	struct page **pages;
+	bool user_pages;
+	struct dma_buf *dmabuf;
+	struct dma_buf_attachment *attach;
+	struct sg_table *sgt;
+};
+
 struct tipc_cdev_node {
 	struct cdev cdev;
 	struct device *dev;
@@ -136,6 +224,9 @@ struct tipc_virtio_dev {
 	enum tipc_device_state state;
 	struct tipc_cdev_node cdev_node;
 	char   cdev_name[MAX_DEV_NAME_LEN];
+	struct mutex shm_lock; /* protects shm_orphans and shm_next_id */
+	struct list_head shm_orphans; /* of freed channels, not yet released */
+	u64 shm_next_id;
 };
 
 enum tipc_chan_state {
@@ -157,6 +248,8 @@ struct tipc_chan {
 	u32 max_msg_size;
 	u32 max_msg_cnt;
 	char srv_name[MAX_SRV_NAME_LEN];
+	struct list_head shm_list; /* shared by reference, under lock */
+	size_t shm_pages;
 };
 
 static struct class *tipc_class;
@@ -234,16 +327,209 @@ static inline void mb_reset(struct tipc_msg_buf *mb)
 	mb->rpos = 0;
 }
 
+static void _shm_obj_free(struct tipc_shm_obj *obj)
+{
+	size_t i;
+
+	if (obj->user_pages) {
+		for (i = 0; i < obj->nr_pages; i++) {
+			if (obj->flags & TIPC_SHM_WRITABLE)
+				set_page_dirty_lock(obj->pages[i]);
+			put_page(obj->pages[i]);
+		}
+	}
+
+	if (obj->dmabuf) {
+		if (obj->sgt)
+			dma_buf_unmap_attachment(obj->attach, obj->sgt,
+						 DMA_BIDIRECTIONAL);
+		if (obj->attach)
+			dma_buf_detach(obj->dmabuf, obj->attach);
+		dma_buf_put(obj->dmabuf);
+	}
+
+	kfree(obj->pages);
+	kfree(obj);
+}
+
+static int _shm_obj_pin_user(struct tipc_shm_obj *obj, u64 addr)
+{
+	int ret;
+	size_t pinned = 0;
+
+	while (pinned < obj->nr_pages) {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 2, 0)
+		ret = get_user_pages_fast(addr + (pinned << PAGE_SHIFT),
+				obj->nr_pages - pinned,
+				(obj->flags & TIPC_SHM_WRITABLE) ? FOLL_WRITE : 0,
+				obj->pages + pinned);
+#else
+		ret = get_user_pages_fast(addr + (pinned << PAGE_SHIFT),
+				obj->nr_pages - pinned,
+				!!(obj->flags & TIPC_SHM_WRITABLE),
+				obj->pages + pinned);
+#endif
+		if (ret <= 0)
+			break;
+		pinned += ret;
+	}
+
+	if (pinned == obj->nr_pages)
+		return 0;
+
+	while (pinned)
+		put_page(obj->pages[--pinned]);
+
+	return -EFAULT;
+}
+
+static int _shm_obj_map_dmabuf(struct tipc_shm_obj *obj, struct device *dev,
+			       int fd, u64 offset)
+{
+	struct sg_page_iter piter;
+	size_t skip = offset >> PAGE_SHIFT;
+	size_t n = 0;
+
+	obj->dmabuf = dma_buf_get(fd);
+	if (IS_ERR(obj->dmabuf)) {
+		int ret = PTR_ERR(obj->dmabuf);
+
+		obj->dmabuf = NULL;
+		return ret;
+	}
+
+	if (offset + obj->size > obj->dmabuf->size)
+		return -EINVAL;
+
+	obj->attach = dma_buf_attach(obj->dmabuf, dev);
+	if (IS_ERR(obj->attach)) {
+		int ret = PTR_ERR(obj->attach);
+
+		obj->attach = NULL;
+		return ret;
+	}
+
+	obj->sgt = dma_buf_map_attachment(obj->attach, DMA_BIDIRECTIONAL);
+	if (IS_ERR(obj->sgt)) {
+		int ret = PTR_ERR(obj->sgt);
+
+		obj->sgt = NULL;
+		return ret;
+	}
+
+	for_each_sg_page(obj->sgt->sgl, &piter, obj->sgt->orig_nents, skip) {
+		if (n == obj->nr_pages)
+			break;
+		obj->pages[n++] = sg_page_iter_page(&piter);
+	}
+
+	return n == obj->nr_pages ? 0 : -EINVAL;
+}
+
+static struct tipc_shm_obj *_shm_obj_import(struct device *dev,
+					    const struct tipc_shm *req)
+{
+	struct tipc_shm_obj *obj;
+	int ret;
+
+	if (!req->size || (req->flags & ~TIPC_SHM_WRITABLE))
+		return ERR_PTR(-EINVAL);
+
+	obj = kzalloc(sizeof(*obj), GFP_KERNEL);
+	if (!obj)
+		return ERR_PTR(-ENOMEM);
+
+	obj->flags = req->flags;
+	obj->size = req->size;
+	obj->offset = offset_in_page(req->addr);
+	obj->nr_pages = DIV_ROUND_UP(obj->offset + req->size, PAGE_SIZE);
+
+	if (obj->nr_pages > TIPC_MAX_SHM_PAGES) {
+		ret = -E2BIG;
+		goto err;
+	}
+
+	obj->pages = kcalloc(obj->nr_pages, sizeof(*obj->pages), GFP_KERNEL);
+	if (!obj->pages) {
+		ret = -ENOMEM;
+		goto err;
+	}
+
+	if (req->fd < 0) {
+		ret = _shm_obj_pin_user(obj, req->addr & PAGE_MASK);
+		obj->user_pages = !ret;
+	} else {
+		ret = _shm_obj_map_dmabuf(obj, dev, req->fd, req->addr);
+	}
+	if (ret)
+		goto err;
+
+	return obj;
+
+err:
+	_shm_obj_free(obj);
+	return ERR_PTR(ret);
+}
+
+static size_t _shm_ref_size(struct tipc_shm_obj *obj)
+{
+	return sizeof(struct tipc_shm_ref) + obj->nr_pages * sizeof(u64);
+}
+
+static int _shm_obj_encode(struct tipc_shm_obj *obj, struct tipc_shm_ref *ref)
+{
+	pgprot_t pgprot = (obj->flags & TIPC_SHM_WRITABLE) ?
+			  PAGE_KERNEL : PAGE_KERNEL_RO;
+	struct ns_mem_page_info pg_inf;
+	size_t i;
+	int ret;
+
+	ref->id = obj->id;
+	ref->size = obj->size;
+	ref->offset = obj->offset;
+	ref->flags = obj->flags;
+	ref->page_cnt = obj->nr_pages;
+	ref->reserved = 0;
+
+	for (i = 0; i < obj->nr_pages; i++) {
+		ret = trusty_encode_page_info(&pg_inf, obj->pages[i], pgprot);
+		if (ret)
+			return ret;
+		ref->pages[i] = pg_inf.attr;
+	}
+
+	return 0;
+}
+
 static void _free_vds(struct kref *kref)
 {
 	struct tipc_virtio_dev *vds =
 		container_of(kref, struct tipc_virtio_dev, refcount);
+	struct tipc_shm_obj *obj, *tmp;
+
+	/*
+	 * The secure side never released these, so it may still map them.
+	 * Leak the pages rather than hand them back to the kernel.
+	 */
+	list_for_each_entry_safe(obj, tmp, &vds->shm_orphans, node) {
+		pr_warn("%s: leaking %zu unreleased shm pages\n", __func__,
+			obj->nr_pages);
+		kfree(obj->pages);
+		kfree(obj);
+	}
+
 	kfree(vds);
 }
 
 static void _free_chan(struct kref *kref)
 {
 	struct tipc_chan *ch = container_of(kref, struct tipc_chan, refcount);
+	struct tipc_virtio_dev *vds = ch->vds;
+
+	/* shared pages stay pinned until the secure side releases them */
+	mutex_lock(&vds->shm_lock);
+	list_splice_tail_init(&ch->shm_list, &vds->shm_orphans);
+	mutex_unlock(&vds->shm_lock);
 
 	if (ch->ops && ch->ops->handle_release)
 		ch->ops->handle_release(ch->ops_arg);
@@ -463,6 +749,7 @@ static struct tipc_chan *vds_create_channel(struct tipc_virtio_dev *vds,
 	chan->ops_arg = ops_arg;
 	mutex_init(&chan->lock);
 	kref_init(&chan->refcount);
+	INIT_LIST_HEAD(&chan->shm_list);
 	chan->state = TIPC_DISCONNECTED;
 
 	ret = vds_add_channel(vds, chan);
@@ -475,14 +762,15 @@ static struct tipc_chan *vds_create_channel(struct tipc_virtio_dev *vds,
 	return chan;
 }
 
-static void fill_msg_hdr(struct tipc_msg_buf *mb, u32 src, u32 dst)
+static void fill_msg_hdr(struct tipc_msg_buf *mb, u32 src, u32 dst,
+			 u16 flags)
 {
 	struct tipc_msg_hdr *hdr = mb_get_data(mb, sizeof(*hdr));
 
 	hdr->src = src;
 	hdr->dst = dst;
 	hdr->len = mb_avail_data(mb);
-	hdr->flags = 0;
+	hdr->flags = flags;
 	hdr->reserved = 0;
 }
 
@@ -556,22 +844,37 @@ void tipc_chan_put_txbuf(struct tipc_chan *chan, struct tipc_msg_buf *mb)
 }
 EXPORT_SYMBOL(tipc_chan_put_txbuf);
 
-int tipc_chan_queue_msg(struct tipc_chan *chan, struct tipc_msg_buf *mb)
+/*
+ * Queue a message, objects on @shm_list become owned by the channel once
+ * the message is queued.
+ */
+static int _chan_queue_msg(struct tipc_chan *chan, struct tipc_msg_buf *mb,
+			   u16 flags, struct list_head *shm_list)
 {
+	struct tipc_shm_obj *obj;
+	size_t pages = 0;
 	int err;
 
-	if (!is_trusty_dev_enabled())
-		return -ENODEV;
+	if (shm_list)
+		list_for_each_entry(obj, shm_list, node)
+			pages += obj->nr_pages;
 
 	mutex_lock(&chan->lock);
 	switch (chan->state) {
 	case TIPC_CONNECTED:
-		fill_msg_hdr(mb, chan->local, chan->remote);
+		if (chan->shm_pages + pages > TIPC_MAX_SHM_PAGES) {
+			err = -ENOSPC;
+			break;
+		}
+		fill_msg_hdr(mb, chan->local, chan->remote, flags);
 		err = vds_queue_txbuf(chan->vds, mb);
 		if (err) {
 			/* this should never happen */
 			pr_err("%s: failed to queue tx buffer (%d)\n",
 			       __func__, err);
+		} else if (shm_list) {
+			list_splice_tail_init(shm_list, &chan->shm_list);
+			chan->shm_pages += pages;
 		}
 		break;
 	case TIPC_DISCONNECTED:
@@ -589,6 +892,14 @@ int tipc_chan_queue_msg(struct tipc_chan *chan, struct tipc_msg_buf *mb)
 	mutex_unlock(&chan->lock);
 	return err;
 }
+
+int tipc_chan_queue_msg(struct tipc_chan *chan, struct tipc_msg_buf *mb)
+{
+	if (!is_trusty_dev_enabled())
+		return -ENODEV;
+
+	return _chan_queue_msg(chan, mb, 0, NULL);
+}
 EXPORT_SYMBOL(tipc_chan_queue_msg);
 
 
@@ -623,7 +934,7 @@ int tipc_chan_connect(struct tipc_chan *chan, const char *name)
 		/* save service name we are connecting to */
 		strcpy(chan->srv_name, body->name);
 
-		fill_msg_hdr(txbuf, chan->local, TIPC_CTRL_ADDR);
+		fill_msg_hdr(txbuf, chan->local, TIPC_CTRL_ADDR, 0);
 		err = vds_queue_txbuf(chan->vds, txbuf);
 		if (err) {
 			/* this should never happen */
@@ -689,7 +1000,7 @@ int tipc_chan_shutdown(struct tipc_chan *chan)
 		msg->body_len = sizeof(*body);
 		body->target = chan->remote;
 
-		fill_msg_hdr(txbuf, chan->local, TIPC_CTRL_ADDR);
+		fill_msg_hdr(txbuf, chan->local, TIPC_CTRL_ADDR, 0);
 		err = vds_queue_txbuf(chan->vds, txbuf);
 		if (err) {
 			/* this should never happen */
@@ -952,6 +1263,133 @@ static int dn_connect_ioctl(struct tipc_dn_chan *dn, char __user *usr_name)
 	return dn_wait_for_reply(dn, REPLY_TIMEOUT);
 }
 
+static int dn_send_msg_ioctl(struct file *filp, struct tipc_dn_chan *dn,
+			     void __user *usr_req, bool compat)
+{
+	struct iovec iovstack[UIO_FASTIOV], *iov = iovstack;
+	struct tipc_chan *chan = dn->chan;
+	struct tipc_virtio_dev *vds = chan->vds;
+	long timeout = TXBUF_TIMEOUT;
+	struct tipc_shm_obj *obj, *tmp;
+	struct tipc_send_msg_req req;
+	struct tipc_shm_msg_hdr *hdr;
+	struct tipc_shm *shm = NULL;
+	struct tipc_msg_buf *txbuf;
+	struct device *dev = NULL;
+	struct iov_iter iter;
+	LIST_HEAD(shm_list);
+	size_t len, pad;
+	ssize_t ret;
+	u32 i;
+
+	if (!is_trusty_dev_enabled())
+		return -ENODEV;
+
+	if (copy_from_user(&req, usr_req, sizeof(req)))
+		return -EFAULT;
+
+	if (req.shm_cnt > TIPC_MAX_SHM_CNT)
+		return -EINVAL;
+
+	mutex_lock(&vds->lock);
+	if (vds->vdev && virtio_has_feature(vds->vdev, TIPC_F_SHM_REF))
+		dev = &vds->vdev->dev;
+	mutex_unlock(&vds->lock);
+	if (!dev)
+		return -EOPNOTSUPP;
+
+#if defined(CONFIG_COMPAT)
+	if (compat)
+		ret = compat_import_iovec(WRITE,
+			(const struct compat_iovec __user *)
+			u64_to_user_ptr(req.iov),
+			req.iov_cnt, UIO_FASTIOV, &iov, &iter);
+	else
+#endif
+		ret = import_iovec(WRITE, u64_to_user_ptr(req.iov),
+				   req.iov_cnt, UIO_FASTIOV, &iov, &iter);
+	if (ret < 0)
+		return ret;
+
+	if (req.shm_cnt) {
+		shm = memdup_user(u64_to_user_ptr(req.shm),
+				  req.shm_cnt * sizeof(*shm));
+		if (IS_ERR(shm)) {
+			ret = PTR_ERR(shm);
+			shm = NULL;
+			goto out;
+		}
+	}
+
+	if (filp->f_flags & O_NONBLOCK)
+		timeout = 0;
+
+	txbuf = tipc_chan_get_txbuf_timeout(chan, timeout);
+	if (IS_ERR(txbuf)) {
+		ret = PTR_ERR(txbuf);
+		goto out;
+	}
+
+	/* inline data, padded so that the references are 8 byte aligned */
+	len = iov_iter_count(&iter);
+	pad = ALIGN(len, sizeof(u64)) - len;
+	if (sizeof(*hdr) + len + pad > mb_avail_space(txbuf)) {
+		ret = -EMSGSIZE;
+		goto err_put_txbuf;
+	}
+
+	hdr = mb_put_data(txbuf, sizeof(*hdr));
+	hdr->inline_len = len;
+	hdr->shm_cnt = req.shm_cnt;
+
+	if (copy_from_iter(mb_put_data(txbuf, len), len, &iter) != len) {
+		ret = -EFAULT;
+		goto err_put_txbuf;
+	}
+	memset(mb_put_data(txbuf, pad), 0, pad);
+
+	for (i = 0; i < req.shm_cnt; i++) {
+		obj = _shm_obj_import(dev, &shm[i]);
+		if (IS_ERR(obj)) {
+			ret = PTR_ERR(obj);
+			goto err_free_shm;
+		}
+		list_add_tail(&obj->node, &shm_list);
+
+		if (_shm_ref_size(obj) > mb_avail_space(txbuf)) {
+			ret = -EMSGSIZE;
+			goto err_free_shm;
+		}
+
+		/* ids are unique per device, they outlive the channel */
+		mutex_lock(&vds->shm_lock);
+		obj->id = ++vds->shm_next_id;
+		mutex_unlock(&vds->shm_lock);
+
+		ret = _shm_obj_encode(obj, mb_put_data(txbuf,
+						       _shm_ref_size(obj)));
+		if (ret)
+			goto err_free_shm;
+	}
+
+	ret = _chan_queue_msg(chan, txbuf, TIPC_MSG_FLAG_SHM, &shm_list);
+	if (ret)
+		goto err_free_shm;
+
+	ret = len;
+	goto out;
+
+err_free_shm:
+	list_for_each_entry_safe(obj, tmp, &shm_list, node)
+		_shm_obj_free(obj);
+err_put_txbuf:
+	tipc_chan_put_txbuf(chan, txbuf);
+out:
+	kfree(shm);
+	kfree(iov);
+	return ret;
+}
+
 static long tipc_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 {
 	int ret;
@@ -964,6 +1402,9 @@ static long tipc_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 	case TIPC_IOC_CONNECT:
 		ret = dn_connect_ioctl(dn, (char __user *)arg);
 		break;
+	case TIPC_IOC_SEND_MSG:
+		ret = dn_send_msg_ioctl(filp, dn, (void __user *)arg, false);
+		break;
 	default:
 		pr_warn("%s: Unhandled ioctl cmd: 0x%x\n",
 			__func__, cmd);
@@ -987,6 +1428,9 @@ static long tipc_compat_ioctl(struct file *filp,
 	case TIPC_IOC_CONNECT_COMPAT:
 		ret = dn_connect_ioctl(dn, user_req);
 		break;
+	case TIPC_IOC_SEND_MSG:
+		ret = dn_send_msg_ioctl(filp, dn, user_req, true);
+		break;
 	default:
 		pr_warn("%s: Unhandled ioctl cmd: 0x%x\n",
 			__func__, cmd);
@@ -1395,6 +1839,56 @@ static void _handle_disc_req(struct tipc_virtio_dev *vds,
 	}
 }
 
+static void _handle_shm_release(struct tipc_virtio_dev *vds,
+				struct tipc_shm_release_body *req, size_t len)
+{
+	struct tipc_shm_obj *obj, *found = NULL;
+	struct tipc_chan *chan;
+
+	if (sizeof(*req) != len) {
+		dev_err(&vds->vdev->dev, "%s: Invalid request length %zd\n",
+			__func__, len);
+		return;
+	}
+
+	dev_dbg(&vds->vdev->dev, "%s: release shm %llu for addr 0x%x\n",
+		__func__, req->id, req->target);
+
+	chan = vds_lookup_channel(vds, req->target);
+	if (chan) {
+		mutex_lock(&chan->lock);
+		list_for_each_entry(obj, &chan->shm_list, node) {
+			if (obj->id == req->id) {
+				list_del(&obj->node);
+				chan->shm_pages -= obj->nr_pages;
+				found = obj;
+				break;
+			}
+		}
+		mutex_unlock(&chan->lock);
+		kref_put(&chan->refcount, _free_chan);
+	}
+
+	/* the channel may already be gone */
+	if (!found) {
+		mutex_lock(&vds->shm_lock);
+		list_for_each_entry(obj, &vds->shm_orphans, node) {
+			if (obj->id == req->id) {
+				list_del(&obj->node);
+				found = obj;
+				break;
+			}
+		}
+		mutex_unlock(&vds->shm_lock);
+	}
+
+	if (found)
+		_shm_obj_free(found);
+	else
+		dev_warn(&vds->vdev->dev, "%s: unknown shm id %llu\n",
+			 __func__, req->id);
+}
+
 static void _handle_ctrl_msg(struct tipc_virtio_dev *vds,
 			     void *data, int len, u32 src)
 {
@@ -1430,6 +1924,12 @@ static void _handle_ctrl_msg(struct tipc_virtio_dev *vds,
 				 msg->body_len);
 	break;
 
+	case TIPC_CTRL_MSGTYPE_SHM_RELEASE:
+		_handle_shm_release(vds,
+				    (struct tipc_shm_release_body *)msg->body,
+				    msg->body_len);
+	break;
+
 	default:
 		dev_warn(&vds->vdev->dev,
 			 "%s: Unexpected message type: %d\n",
@@ -1562,6 +2062,8 @@ static int tipc_virtio_probe(struct virtio_device *vdev)
 	init_waitqueue_head(&vds->sendq);
 	INIT_LIST_HEAD(&vds->free_buf_list);
 	idr_init(&vds->addr_idr);
+	mutex_init(&vds->shm_lock);
+	INIT_LIST_HEAD(&vds->shm_orphans);
 
 	/* set default max message size and alignment */
 	memset(&config, 0, sizeof(config));
@@ -1655,6 +2157,7 @@ static struct virtio_device_id tipc_virtio_id_table[] = {
 
 static unsigned int features[] = {
 	0,
+	TIPC_F_SHM_REF,
 };
 
 static struct virtio_driver virtio_tipc_driver = {
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2016-2019, NVIDIA CORPORATION.  All rights reserved.
+ * Copyright (c) 2016-2020, NVIDIA CORPORATION.  All rights reserved.
  *
  * This program is free software; you can redistribute it and/or modify it
  * under the terms and conditions of the GNU General Public License,
@@ -24,6 +24,9 @@
 #include <linux/of_address.h>
 #include <linux/of_irq.h>
 #include <linux/irqreturn.h>
+#include <linux/kfifo.h>
+#include <linux/ktime.h>
+#include <linux/workqueue.h>
 #include <asm/io.h>
 
 #define HSP_INT_IE_0		0x100
@@ -39,6 +42,9 @@
  */
 #define MAGIC_SYSRQ_CHAR	0x1f
 
+/* bytes buffered for the TX worker, must be a power of two */
+#define TX_FIFO_SIZE		16384
+
 static u8 __iomem *top0_mbox01_base;
 static u8 __iomem *spe_mbox_reg;
 static u8 __iomem *top0_cmn_base;
@@ -53,6 +59,18 @@ static void tegra_combined_uart_console_write(struct console *co,
 
 static DEFINE_SPINLOCK(tx_lock);
 
+/*
+ * Output is queued in tx_fifo and pushed to the SPE mailbox from tx_work so
+ * that writers never spin on the mailbox with interrupts off. Only early
+ * boot (before probe) and oops/panic output is written synchronously.
+ */
+static void tegra_combined_uart_tx_work(struct work_struct *work);
+static DEFINE_KFIFO(tx_fifo, unsigned char, TX_FIFO_SIZE);
+static DECLARE_WORK(tx_work, tegra_combined_uart_tx_work);
+static bool tx_async;
+static atomic_t tx_dropped_bytes = ATOMIC_INIT(0);
+static u64 tx_max_spin_ns;
+
 /*
  * This function does nothing. This function is used to fill in the function
  * pointers in struct uart_ops tegra_combined_uart_ops, which we don't
@@ -87,6 +105,7 @@ static void tegra_combined_uart_enable_sm_irq(void)
 
 static int tegra_combined_uart_suspend(struct device *dev)
 {
+	flush_work(&tx_work);
 	tegra_combined_uart_disable_sm_irq();
 
 	return 0;
@@ -108,11 +127,41 @@ static int uart_shutdown(struct uart_port *port)
 	return 0;
 }
 
+/*
+ * Moves as much of the TTY xmit buffer as fits into tx_fifo, the rest is
+ * picked up by tx_work once it has made room. Called with port->lock held.
+ */
+static void tegra_combined_uart_fill_tx_fifo(struct uart_port *port)
+{
+	struct circ_buf *xmit = &port->state->xmit;
+	unsigned char c;
+
+	spin_lock(&tx_lock);
+	while (!uart_circ_empty(xmit) && kfifo_avail(&tx_fifo) >= 2) {
+		c = xmit->buf[xmit->tail];
+		if (c == '\n')
+			kfifo_put(&tx_fifo, '\r');
+		kfifo_put(&tx_fifo, c);
+		xmit->tail = (xmit->tail + 1) & (UART_XMIT_SIZE - 1);
+		port->icount.tx++;
+	}
+	spin_unlock(&tx_lock);
+
+	if (uart_circ_chars_pending(xmit) < WAKEUP_CHARS)
+		uart_write_wakeup(port);
+}
+
 static void tegra_combined_uart_start_tx(struct uart_port *port)
 {
+	struct circ_buf *xmit = &port->state->xmit;
 	unsigned long tail;
 	unsigned long count;
-	struct circ_buf *xmit = &port->state->xmit;
+
+	if (tx_async) {
+		tegra_combined_uart_fill_tx_fifo(port);
+		queue_work(system_unbound_wq, &tx_work);
+		return;
+	}
 
 	while (true) {
 		tail = (unsigned long)&xmit->buf[xmit->tail];
@@ -178,6 +227,98 @@ static u32 update_and_send_mbox(u32 mbox_val, char c)
 	return mbox_val;
 }
 
+static void flush_mbox(u32 mbox_val)
+{
+	if ((mbox_val >> NUM_BYTES_FIELD_BIT) & 0x3) {
+		while (readl(spe_mbox_reg) & BIT(INTR_TRIGGER_BIT))
+			cpu_relax();
+		writel(mbox_val, spe_mbox_reg);
+	}
+}
+
+/*
+ * Sends one packet from the TX worker. The mailbox is polled with
+ * interrupts enabled and without tx_lock, tx_work being its only user
+ * outside of oops.
+ */
+static void tegra_combined_uart_send_packet(const unsigned char *buf,
+					    unsigned int n)
+{
+	u32 mbox_val = BIT(INTR_TRIGGER_BIT);
+	ktime_t start = ktime_get();
+	u64 spin;
+	unsigned int i;
+
+	for (i = 0; i < n; i++)
+		mbox_val |= buf[i] << (i * 8);
+	mbox_val |= n << NUM_BYTES_FIELD_BIT;
+
+	while (readl(spe_mbox_reg) & BIT(INTR_TRIGGER_BIT)) {
+		if (need_resched())
+			cond_resched();
+		else
+			cpu_relax();
+	}
+
+	spin = ktime_to_ns(ktime_sub(ktime_get(), start));
+	if (spin > READ_ONCE(tx_max_spin_ns))
+		WRITE_ONCE(tx_max_spin_ns, spin);
+
+	writel(mbox_val, spe_mbox_reg);
+}
+
+static void tegra_combined_uart_tx_work(struct work_struct *work)
+{
+	struct uart_port *port = &tegra_combined_uart_port;
+	unsigned char buf[3];
+	unsigned long flags;
+	unsigned int n;
+
+	while (true) {
+		spin_lock_irqsave(&tx_lock, flags);
+		n = kfifo_out(&tx_fifo, buf, sizeof(buf));
+		spin_unlock_irqrestore(&tx_lock, flags);
+
+		if (!n) {
+			/* pull in what start_tx could not fit */
+			if (!port->state)
+				break;
+			spin_lock_irqsave(&port->lock, flags);
+			if (!uart_circ_empty(&port->state->xmit))
+				tegra_combined_uart_fill_tx_fifo(port);
+			spin_unlock_irqrestore(&port->lock, flags);
+			if (kfifo_is_empty(&tx_fifo))
+				break;
+			continue;
+		}
+
+		tegra_combined_uart_send_packet(buf, n);
+		cond_resched();
+	}
+}
+
+/* Queues console output, counting what does not fit as dropped */
+static void tegra_combined_uart_queue_write(const char *s,
+					    unsigned int count)
+{
+	unsigned long flags;
+	unsigned int i;
+
+	spin_lock_irqsave(&tx_lock, flags);
+	for (i = 0; i < count; i++) {
+		if (kfifo_avail(&tx_fifo) < (s[i] == '\n' ? 2 : 1)) {
+			atomic_add(count - i, &tx_dropped_bytes);
+			break;
+		}
+		if (s[i] == '\n')
+			kfifo_put(&tx_fifo, '\r');
+		kfifo_put(&tx_fifo, s[i]);
+	}
+	spin_unlock_irqrestore(&tx_lock, flags);
+
+	queue_work(system_unbound_wq, &tx_work);
+}
+
 /*
  * This function splits the string to be printed (const char *s) into multiple
  * packets. Each packet contains a max of 3 characters. Packets are sent to the
@@ -190,10 +331,20 @@ static void tegra_combined_uart_console_write(struct console *co,
 {
 	u32 mbox_val = BIT(INTR_TRIGGER_BIT);
 	unsigned long flags;
+	unsigned char c;
 	unsigned int i;
 
+	if (tx_async && !oops_in_progress) {
+		tegra_combined_uart_queue_write(s, count);
+		return;
+	}
+
 	spin_lock_irqsave(&tx_lock, flags);
 
+	/* keep output ordered, send whatever tx_work has not yet */
+	while (kfifo_get(&tx_fifo, &c))
+		mbox_val = update_and_send_mbox(mbox_val, c);
+
 	/* Loop for processing each 3 char packet */
 	for (i = 0; i < count; i++) {
 		if (s[i] == '\n')
@@ -201,11 +352,7 @@ static void tegra_combined_uart_console_write(struct console *co,
 		mbox_val = update_and_send_mbox(mbox_val, s[i]);
 	}
 
-	if ((mbox_val >> NUM_BYTES_FIELD_BIT) & 0x3) {
-		while (readl(spe_mbox_reg) & BIT(INTR_TRIGGER_BIT))
-			cpu_relax();
-		writel(mbox_val, spe_mbox_reg);
-	}
+	flush_mbox(mbox_val);
 
 	spin_unlock_irqrestore(&tx_lock, flags);
 }
@@ -259,6 +406,31 @@ static int tegra_combined_uart_startup(struct uart_port *port)
 	return ret;
 }
 
+static ssize_t tx_dropped_bytes_show(struct device *dev,
+				     struct device_attribute *attr, char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%d\n",
+			atomic_read(&tx_dropped_bytes));
+}
+static DEVICE_ATTR_RO(tx_dropped_bytes);
+
+static ssize_t tx_max_spin_ns_show(struct device *dev,
+				   struct device_attribute *attr, char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%llu\n", READ_ONCE(tx_max_spin_ns));
+}
+static DEVICE_ATTR_RO(tx_max_spin_ns);
+
+static struct attribute *tegra_combined_uart_attrs[] = {
+	&dev_attr_tx_dropped_bytes.attr,
+	&dev_attr_tx_max_spin_ns.attr,
+	NULL,
+};
+
+static const struct attribute_group tegra_combined_uart_attr_group = {
+	.attrs = tegra_combined_uart_attrs,
+};
+
 static int tegra_combined_uart_probe(struct platform_device *pdev)
 {
 	int ret;
@@ -306,6 +478,12 @@ static int tegra_combined_uart_probe(struct platform_device *pdev)
 		goto err_irq;
 	}
 
+	if (sysfs_create_group(&pdev->dev.kobj,
+			       &tegra_combined_uart_attr_group))
+		dev_warn(&pdev->dev, "failed to create TX stats\n");
+
+	tx_async = true;
+
 	return ret;
 
 err_irq:
@@ -323,6 +501,9 @@ err_mapping:
 
 static int tegra_combined_uart_remove(struct platform_device *pdev)
 {
+	tx_async = false;
+	flush_work(&tx_work);
+	sysfs_remove_group(&pdev->dev.kobj, &tegra_combined_uart_attr_group);
 	uart_remove_one_port(&tegra_combined_uart_driver,
 				&tegra_combined_uart_port);
 	uart_unregister_driver(&tegra_combined_uart_driver);
@@ -344,7 +525,7 @@ MODULE_DEVICE_TABLE(of, tegra_combined_uart_of_match);
 
 static unsigned int tegra_combined_uart_tx_empty(struct uart_port *port)
 {
-	return TIOCSER_TEMT;
+	return kfifo_is_empty(&tx_fifo) ? TIOCSER_TEMT : 0;
 }
 
 static struct uart_ops tegra_combined_uart_ops = {
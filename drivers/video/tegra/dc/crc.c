@@ -1,7 +1,7 @@
 /*
  * crc.c: CRC functions for tegradc EXT device
  *
- * Copyright (c) 2017-2019, NVIDIA CORPORATION, All rights reserved.
+ * Copyright (c) 2017-2020, NVIDIA CORPORATION, All rights reserved.
  *
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -20,6 +20,12 @@
 #include <linux/slab.h>
 #include <linux/mutex.h>
 #include <linux/string.h>
+#include <linux/kfifo.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/poll.h>
+#include <linux/uaccess.h>
+#include <linux/wait.h>
 
 #include "dc.h"
 #include "dc_priv_defs.h"
@@ -703,11 +709,165 @@ long tegra_dc_crc_get(struct tegra_dc *dc, struct tegra_dc_ext_crc_arg *arg)
 	return ret;
 }
 
+/* Queue a record for @crc_ele to every CRC stream of the head. Records are
+ * queued whether or not the frame matched a flip, so that clients see every
+ * frame
+ */
+static void tegra_dc_crc_stream_push(struct tegra_dc *dc,
+				     struct tegra_dc_crc_buf_ele *crc_ele,
+				     u64 timestamp)
+{
+	struct tegra_dc_ext_crc_record rec;
+	struct tegra_dc_crc_stream *stream;
+	unsigned long flags;
+	u8 id;
+
+	spin_lock_irqsave(&dc->crc_stream_lock, flags);
+
+	if (list_empty(&dc->crc_streams)) {
+		dc->crc_seq++;
+		spin_unlock_irqrestore(&dc->crc_stream_lock, flags);
+		return;
+	}
+
+	memset(&rec, 0, sizeof(rec));
+	rec.seq = dc->crc_seq++;
+	rec.flip_id = dc->crc_last_flip_id;
+	rec.timestamp = timestamp;
+
+	if (crc_ele->rg.valid) {
+		rec.valid |= BIT(TEGRA_DC_EXT_CRC_TYPE_RG);
+		rec.rg_crc = crc_ele->rg.crc;
+	}
+
+	if (crc_ele->sor.valid) {
+		rec.valid |= BIT(TEGRA_DC_EXT_CRC_TYPE_OR);
+		rec.or_crc = crc_ele->sor.crc;
+	}
+
+	if (crc_ele->comp.valid) {
+		rec.valid |= BIT(TEGRA_DC_EXT_CRC_TYPE_COMP);
+		rec.comp_crc = crc_ele->comp.crc;
+	}
+
+	for (id = 0; id < TEGRA_DC_MAX_CRC_REGIONS; id++) {
+		if (crc_ele->regional[id].valid) {
+			rec.regional_valid |= BIT(id);
+			rec.regional_crc[id] = crc_ele->regional[id].crc;
+		}
+	}
+
+	list_for_each_entry(stream, &dc->crc_streams, node) {
+		rec.dropped = stream->dropped;
+		if (kfifo_put(&stream->fifo, rec))
+			stream->dropped = 0;
+		else
+			stream->dropped++;
+
+		wake_up(&stream->wq);
+	}
+
+	spin_unlock_irqrestore(&dc->crc_stream_lock, flags);
+}
+
+struct tegra_dc_crc_stream *tegra_dc_crc_stream_enable(struct tegra_dc *dc,
+					struct tegra_dc_ext_crc_stream_arg *arg)
+{
+	struct tegra_dc_crc_stream *stream;
+	u32 ring_size = arg->ring_size;
+	unsigned long flags;
+	int ret;
+
+	if (ring_size > TEGRA_DC_EXT_CRC_STREAM_MAX_RING_SIZE)
+		return ERR_PTR(-EINVAL);
+
+	if (!ring_size)
+		ring_size = TEGRA_DC_EXT_CRC_STREAM_DEFAULT_RING_SIZE;
+
+	stream = kzalloc(sizeof(*stream), GFP_KERNEL);
+	if (!stream)
+		return ERR_PTR(-ENOMEM);
+
+	ret = kfifo_alloc(&stream->fifo, roundup_pow_of_two(ring_size),
+			  GFP_KERNEL);
+	if (ret) {
+		kfree(stream);
+		return ERR_PTR(ret);
+	}
+
+	init_waitqueue_head(&stream->wq);
+	mutex_init(&stream->lock);
+
+	spin_lock_irqsave(&dc->crc_stream_lock, flags);
+	list_add_tail(&stream->node, &dc->crc_streams);
+	spin_unlock_irqrestore(&dc->crc_stream_lock, flags);
+
+	return stream;
+}
+
+void tegra_dc_crc_stream_disable(struct tegra_dc *dc,
+				 struct tegra_dc_crc_stream *stream)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&dc->crc_stream_lock, flags);
+	list_del(&stream->node);
+	spin_unlock_irqrestore(&dc->crc_stream_lock, flags);
+
+	kfifo_free(&stream->fifo);
+	mutex_destroy(&stream->lock);
+	kfree(stream);
+}
+
+/* Copy as many whole records as fit in @len. Blocks until at least one
+ * record is available unless @nonblock is set
+ */
+ssize_t tegra_dc_crc_stream_read(struct tegra_dc_crc_stream *stream,
+				 char __user *buf, size_t len, bool nonblock)
+{
+	unsigned int copied;
+	int ret;
+
+	if (len < sizeof(struct tegra_dc_ext_crc_record))
+		return -EINVAL;
+
+	for (;;) {
+		if (mutex_lock_interruptible(&stream->lock))
+			return -ERESTARTSYS;
+
+		ret = kfifo_to_user(&stream->fifo, buf, len, &copied);
+
+		mutex_unlock(&stream->lock);
+
+		if (ret)
+			return ret;
+		if (copied > 0)
+			return copied;
+		if (nonblock)
+			return -EAGAIN;
+
+		ret = wait_event_interruptible(stream->wq,
+					       !kfifo_is_empty(&stream->fifo));
+		if (ret)
+			return ret;
+	}
+}
+
+unsigned int tegra_dc_crc_stream_poll(struct tegra_dc_crc_stream *stream,
+				      struct file *filp,
+				      struct poll_table_struct *wait)
+{
+	poll_wait(filp, &stream->wq, wait);
+
+	return kfifo_is_empty(&stream->fifo) ? 0 : POLLIN | POLLRDNORM;
+}
+
 int tegra_dc_crc_process(struct tegra_dc *dc)
 {
 	int ret = 0, matched = 0;
 	struct tegra_dc_crc_buf_ele crc_ele;
 	struct tegra_dc_flip_buf_ele *flip_ele;
+	u64 timestamp = ktime_get_ns();
 
 	memset(&crc_ele, 0, sizeof(crc_ele));
 
@@ -725,6 +885,7 @@ int tegra_dc_crc_process(struct tegra_dc *dc)
 	/* Before doing any work, check if there are flips to match */
 	if (!dc->flip_buf.size) {
 		mutex_unlock(&dc->flip_buf.lock);
+		tegra_dc_crc_stream_push(dc, &crc_ele, timestamp);
 		return 0;
 	}
 
@@ -752,9 +913,15 @@ int tegra_dc_crc_process(struct tegra_dc *dc)
 		mutex_lock(&dc->crc_buf.lock);
 		tegra_dc_ring_buf_add(&dc->crc_buf, &crc_ele, NULL);
 		mutex_unlock(&dc->crc_buf.lock);
+
+		/* Flips are matched in the order they were queued */
+		dc->crc_last_flip_id = crc_ele.matching_flips[matched - 1].id;
 	}
 
 	mutex_unlock(&dc->flip_buf.lock);
+
+	tegra_dc_crc_stream_push(dc, &crc_ele, timestamp);
+
 	return ret;
 }
 
@@ -6590,6 +6590,8 @@ static int tegra_dc_probe(struct platform_device *ndev)
 	mutex_init(&dc->msrmnt_info.lock);
 	init_completion(&dc->frame_end_complete);
 	init_completion(&dc->crc_complete);
+	INIT_LIST_HEAD(&dc->crc_streams);
+	spin_lock_init(&dc->crc_stream_lock);
 	init_completion(&dc->hpd_complete);
 	init_waitqueue_head(&dc->wq);
 	init_waitqueue_head(&dc->timestamp_wq);
@@ -6,7 +6,7 @@
  * Author:
  *	Erik Gilling <konkers@google.com>
  *
- * Copyright (c) 2010-2019, NVIDIA CORPORATION, All rights reserved.
+ * Copyright (c) 2010-2020, NVIDIA CORPORATION, All rights reserved.
  *
  * This software is licensed under the terms of the GNU General Public
  * License version 2, as published by the Free Software Foundation, and
@@ -1204,4 +1204,17 @@ long tegra_dc_crc_disable(struct tegra_dc *dc,
 			  struct tegra_dc_ext_crc_arg *arg);
 long tegra_dc_crc_get(struct tegra_dc *dc, struct tegra_dc_ext_crc_arg *arg);
 
+/* APIs related to CRC streaming */
+struct tegra_dc_crc_stream;
+struct poll_table_struct;
+struct tegra_dc_crc_stream *tegra_dc_crc_stream_enable(struct tegra_dc *dc,
+					struct tegra_dc_ext_crc_stream_arg *arg);
+void tegra_dc_crc_stream_disable(struct tegra_dc *dc,
+				 struct tegra_dc_crc_stream *stream);
+ssize_t tegra_dc_crc_stream_read(struct tegra_dc_crc_stream *stream,
+				 char __user *buf, size_t len, bool nonblock);
+unsigned int tegra_dc_crc_stream_poll(struct tegra_dc_crc_stream *stream,
+				      struct file *filp,
+				      struct poll_table_struct *wait);
+
 #endif
@@ -25,6 +25,7 @@
 #include <linux/fb.h>
 #include <linux/clk.h>
 #include <linux/completion.h>
+#include <linux/kfifo.h>
 #ifdef CONFIG_SWITCH
 #include <linux/switch.h>
 #endif
@@ -376,6 +377,22 @@ struct tegra_dc_ring_buf {
 	struct mutex lock;
 };
 
+/*
+ * tegra_dc_crc_stream - Stream of every collected CRC to a userspace client
+ * @node    - Entry in the list of streams of the DC head
+ * @fifo    - Records waiting to be read by the client
+ * @wq      - Wait queue for readers blocked on an empty @fifo
+ * @dropped - Records dropped since the last successfully queued record
+ * @lock    - Serializes readers of @fifo
+ */
+struct tegra_dc_crc_stream {
+	struct list_head node;
+	DECLARE_KFIFO_PTR(fifo, struct tegra_dc_ext_crc_record);
+	wait_queue_head_t wq;
+	u32 dropped;
+	struct mutex lock;
+};
+
 /*
  * tegra_dc_crc_ref_count - Reference counts for various CRC features
  *                ### Note ###
@@ -670,6 +687,10 @@ struct tegra_dc {
 	struct tegra_dc_ring_buf crc_buf; /* Buffer to save HW generated CRCs */
 	struct tegra_dc_crc_ref_cnt crc_ref_cnt;
 	bool crc_initialized;
+	struct list_head crc_streams; /* Clients streaming every CRC */
+	spinlock_t crc_stream_lock;
+	u64 crc_seq; /* Number of CRCs collected */
+	u64 crc_last_flip_id; /* Most recently matched flip */
 	struct tegra_dc_latency_measurement_data msrmnt_info;
 
 #if defined(CONFIG_TEGRA_DC_FAKE_PANEL_SUPPORT)
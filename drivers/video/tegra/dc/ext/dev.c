@@ -1,7 +1,7 @@
 /*
  * dev.c: Device interface for tegradc ext.
  *
- * Copyright (c) 2011-2019, NVIDIA CORPORATION, All rights reserved.
+ * Copyright (c) 2011-2020, NVIDIA CORPORATION, All rights reserved.
  *
  * Author: Robert Morell <rmorell@nvidia.com>
  * Some code based on fbdev extensions written by:
@@ -29,6 +29,7 @@
 #include <linux/version.h>
 #include <linux/string.h>
 #include <linux/nospec.h>
+#include <linux/poll.h>
 #include <linux/version.h>
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 14, 0)
 #include <linux/types.h>
@@ -3568,6 +3569,35 @@ free_and_ret:
 		return ret;
 	}
 
+	case TEGRA_DC_EXT_CRC_STREAM_ENABLE:
+	{
+		struct tegra_dc_ext_crc_stream_arg args;
+		struct tegra_dc_crc_stream *stream;
+		struct tegra_dc *dc = user->ext->dc;
+
+		if (copy_from_user(&args, user_arg, sizeof(args)))
+			return -EFAULT;
+
+		mutex_lock(&user->crc_stream_lock);
+
+		if (user->crc_stream) {
+			mutex_unlock(&user->crc_stream_lock);
+			return -EBUSY;
+		}
+
+		stream = tegra_dc_crc_stream_enable(dc, &args);
+		if (IS_ERR(stream)) {
+			mutex_unlock(&user->crc_stream_lock);
+			return PTR_ERR(stream);
+		}
+
+		/* Pairs with READ_ONCE() in the read and poll handlers */
+		smp_store_release(&user->crc_stream, stream);
+
+		mutex_unlock(&user->crc_stream_lock);
+		return 0;
+	}
+
 	default:
 		return -EINVAL;
 	}
@@ -3585,6 +3615,7 @@ static int tegra_dc_open(struct inode *inode, struct file *filp)
 
 	ext = container_of(inode->i_cdev, struct tegra_dc_ext, cdev);
 	user->ext = ext;
+	mutex_init(&user->crc_stream_lock);
 
 	atomic_inc(&ext->users_count);
 
@@ -3627,6 +3658,9 @@ static int tegra_dc_release(struct inode *inode, struct file *filp)
 	if (ext->cursor.user == user)
 		tegra_dc_ext_put_cursor(user);
 
+	if (user->crc_stream)
+		tegra_dc_crc_stream_disable(ext->dc, user->crc_stream);
+
 	kfree(user);
 
 	open_count = atomic_dec_return(&dc_open_count);
@@ -3653,6 +3687,30 @@ static int tegra_dc_release(struct inode *inode, struct file *filp)
 	return 0;
 }
 
+static ssize_t tegra_dc_read(struct file *filp, char __user *buf,
+			     size_t len, loff_t *offset)
+{
+	struct tegra_dc_ext_user *user = filp->private_data;
+	struct tegra_dc_crc_stream *stream = READ_ONCE(user->crc_stream);
+
+	if (!stream)
+		return -EPERM;
+
+	return tegra_dc_crc_stream_read(stream, buf, len,
+					filp->f_flags & O_NONBLOCK);
+}
+
+static unsigned int tegra_dc_poll(struct file *filp, poll_table *wait)
+{
+	struct tegra_dc_ext_user *user = filp->private_data;
+	struct tegra_dc_crc_stream *stream = READ_ONCE(user->crc_stream);
+
+	if (!stream)
+		return POLLERR;
+
+	return tegra_dc_crc_stream_poll(stream, filp, wait);
+}
+
 static int tegra_dc_ext_setup_windows(struct tegra_dc_ext *ext)
 {
 	int i, ret;
@@ -3697,6 +3755,8 @@ static const struct file_operations tegra_dc_devops = {
 	.owner =		THIS_MODULE,
 	.open =			tegra_dc_open,
 	.release =		tegra_dc_release,
+	.read =			tegra_dc_read,
+	.poll =			tegra_dc_poll,
 	.unlocked_ioctl =	tegra_dc_ioctl,
 #ifdef CONFIG_COMPAT
 	.compat_ioctl =		tegra_dc_ioctl,
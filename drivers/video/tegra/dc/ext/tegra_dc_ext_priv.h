@@ -1,7 +1,7 @@
 /*
  * tegra_dc_ext_priv.h: Declarations for tegradc ext interface.
  *
- * Copyright (c) 2011-2019, NVIDIA CORPORATION, All rights reserved.
+ * Copyright (c) 2011-2020, NVIDIA CORPORATION, All rights reserved.
  *
  * Author: Robert Morell <rmorell@nvidia.com>
  *
@@ -33,6 +33,8 @@ struct tegra_dc_ext;
 
 struct tegra_dc_ext_user {
 	struct tegra_dc_ext	*ext;
+	struct tegra_dc_crc_stream *crc_stream;
+	struct mutex		crc_stream_lock;
 };
 
 struct tegra_dc_dmabuf {
@@ -26,6 +26,7 @@
 #include <linux/export.h>
 #include <linux/delay.h>
 #include <linux/nospec.h>
+#include <linux/bitmap.h>
 #include <trace/events/nvhost.h>
 #include <soc/tegra/chip-id.h>
 #include "nvhost_syncpt.h"
@@ -802,28 +803,53 @@ static int nvhost_syncpt_timeline_attr(struct nvhost_master *host,
 
 bool nvhost_is_syncpt_assigned(struct nvhost_syncpt *sp, u32 id)
 {
-	bool assigned;
+	return test_bit(id, sp->assigned);
+}
 
-	mutex_lock(&sp->syncpt_mutex);
-	assigned = sp->assigned[id];
-	mutex_unlock(&sp->syncpt_mutex);
+/**
+ * returns first syncpt id in [start, end) that is neither assigned nor
+ * set aside in a client pool, or 0
+ */
+static u32 __nvhost_find_free_syncpt(struct nvhost_syncpt *sp,
+					u32 start, u32 end)
+{
+	u32 id = start;
 
-	return assigned;
+	while ((id = find_next_zero_bit(sp->assigned, end, id)) < end) {
+		if (!test_bit(id, sp->pooled))
+			return id;
+		id++;
+	}
+
+	return 0;
 }
 
 /**
- * performs a sequential search and returns first free syncpt id
+ * returns a free syncpt id, preferring the given pool. The global search
+ * resumes after the last id handed out so that recently freed syncpts are
+ * not recycled immediately.
  */
-static u32 nvhost_find_free_syncpt(struct nvhost_syncpt *sp)
+static u32 nvhost_find_free_syncpt(struct nvhost_syncpt *sp,
+				   struct nvhost_syncpt_pool *pool)
 {
-	u32 i;
+	u32 base = NVHOST_FREE_SYNCPT_BASE(sp);
+	u32 limit = nvhost_syncpt_pts_limit(sp);
+	u32 hint = clamp(sp->free_hint, base, limit);
+	u32 id;
 
-	for (i = NVHOST_FREE_SYNCPT_BASE(sp);
-		i < nvhost_syncpt_pts_limit(sp); ++i)
-		if (!sp->assigned[i])
-			return i;
+	if (pool) {
+		for_each_set_bit(id, pool->ids, limit)
+			if (!test_bit(id, sp->assigned))
+				return id;
+	}
 
-	return 0;
+	id = __nvhost_find_free_syncpt(sp, hint, limit);
+	if (!id)
+		id = __nvhost_find_free_syncpt(sp, base, hint);
+	if (id)
+		sp->free_hint = id + 1;
+
+	return id;
 }
 
 /**
@@ -833,10 +859,10 @@ static int nvhost_reserve_syncpt(struct nvhost_syncpt *sp, u32 id,
 					bool client_managed)
 {
 	/* is it already reserved ? */
-	if (!nvhost_syncpt_is_valid_pt(sp, id) || sp->assigned[id])
+	if (!nvhost_syncpt_is_valid_pt(sp, id) || test_bit(id, sp->assigned))
 		return -EINVAL;
 
-	sp->assigned[id] = true;
+	set_bit(id, sp->assigned);
 	sp->client_managed[id] = client_managed;
 
 	return 0;
@@ -848,7 +874,7 @@ static int nvhost_reserve_syncpt(struct nvhost_syncpt *sp, u32 id,
 static int nvhost_syncpt_assign_name(struct nvhost_syncpt *sp, u32 id,
 					const char *syncpt_name)
 {
-	if (id < NVHOST_FREE_SYNCPT_BASE(sp) || !sp->assigned[id]) {
+	if (id < NVHOST_FREE_SYNCPT_BASE(sp) || !test_bit(id, sp->assigned)) {
 		nvhost_err(&syncpt_to_dev(sp)->dev->dev,
 			   "invalid syncpoint id %u", id);
 		return -EINVAL;
@@ -859,89 +885,117 @@ static int nvhost_syncpt_assign_name(struct nvhost_syncpt *sp, u32 id,
 	return 0;
 }
 
-static u32 nvhost_get_syncpt(struct platform_device *pdev,
-			     bool client_managed,
-			     const char *syncpt_name)
+/**
+ * allocates one syncpt, called with syncpt_mutex held. Returns -EAGAIN
+ * if no syncpt is free.
+ */
+static int __nvhost_get_syncpt(struct platform_device *pdev,
+			       struct nvhost_syncpt *sp,
+			       struct nvhost_syncpt_pool *pool,
+			       bool client_managed,
+			       const char *syncpt_name, u32 *syncpt_id)
 {
+	struct device *d = &syncpt_to_dev(sp)->dev->dev;
 	u32 id;
-	int err = 0;
-	int ret = 0;
-	struct nvhost_master *host = nvhost_get_host(pdev);
-	struct nvhost_syncpt *sp = &host->syncpt;
-	struct device *d = &host->dev->dev;
-	unsigned long timeout = jiffies + NVHOST_SYNCPT_FREE_WAIT_TIMEOUT;
-
-	mutex_lock(&sp->syncpt_mutex);
-
-	/* find a syncpt which is free */
-	do {
-		id = nvhost_find_free_syncpt(sp);
-		if (id)
-			break;
-		mutex_unlock(&sp->syncpt_mutex);
-		schedule();
-		mdelay(1);
-		mutex_lock(&sp->syncpt_mutex);
-	} while (!time_after(jiffies, timeout));
+	int err;
 
-	if (!id) {
-		mutex_unlock(&sp->syncpt_mutex);
-		nvhost_err(d, "failed to find free syncpt");
-		return 0;
-	}
+	id = nvhost_find_free_syncpt(sp, pool);
+	if (!id)
+		return -EAGAIN;
 
 	/* if we get one, then reserve it */
 	err = nvhost_reserve_syncpt(sp, id, client_managed);
 	if (err) {
 		nvhost_err(d, "syncpt reservation failed");
-		mutex_unlock(&sp->syncpt_mutex);
-		return 0;
+		return err;
 	}
 
 	/* assign a name for debugging purpose */
 	err = nvhost_syncpt_assign_name(sp, id, syncpt_name);
 	if (err) {
 		nvhost_err(d, "syncpt name assignment failed");
-		mutex_unlock(&sp->syncpt_mutex);
-		return 0;
+		return err;
 	}
 
-	ret = nvhost_syncpt_get_ref(sp, id);
-	if (ret != 1) {
-		nvhost_err(d, "syncpt found with invalid refcount %d", ret);
+	err = nvhost_syncpt_get_ref(sp, id);
+	if (err != 1) {
+		nvhost_err(d, "syncpt found with invalid refcount %d", err);
 		nvhost_syncpt_put_ref(sp, id);
-		mutex_unlock(&sp->syncpt_mutex);
-		return 0;
+		return -EINVAL;
 	}
 
 	if (syncpt_op().alloc)
 		syncpt_op().alloc(pdev, id);
 
+	*syncpt_id = id;
+
+	return 0;
+}
+
+static u32 nvhost_get_syncpt(struct platform_device *pdev,
+			     struct nvhost_syncpt_pool *pool,
+			     bool client_managed,
+			     const char *syncpt_name)
+{
+	u32 id = 0;
+	int err;
+	struct nvhost_master *host = nvhost_get_host(pdev);
+	struct nvhost_syncpt *sp = &host->syncpt;
+	struct device *d = &host->dev->dev;
+	unsigned long timeout = jiffies + NVHOST_SYNCPT_FREE_WAIT_TIMEOUT;
+
+	mutex_lock(&sp->syncpt_mutex);
+
+	/* find a syncpt which is free */
+	do {
+		err = __nvhost_get_syncpt(pdev, sp, pool, client_managed,
+					  syncpt_name, &id);
+		if (err != -EAGAIN)
+			break;
+		mutex_unlock(&sp->syncpt_mutex);
+		schedule();
+		mdelay(1);
+		mutex_lock(&sp->syncpt_mutex);
+	} while (!time_after(jiffies, timeout));
+
 	mutex_unlock(&sp->syncpt_mutex);
 
-	return id;
+	if (err == -EAGAIN)
+		nvhost_err(d, "failed to find free syncpt");
+
+	return err ? 0 : id;
 }
 
-/**
- * Interface to get a new free (host managed) syncpt dynamically
- */
-u32 nvhost_get_syncpt_host_managed(struct platform_device *pdev,
+static const char *nvhost_syncpt_host_managed_name(
+					struct platform_device *pdev,
 					u32 param,
 					const char *syncpt_name)
 {
 	struct nvhost_device_data *pdata = platform_get_drvdata(pdev);
-	u32 id;
 
 	if (syncpt_name)
-		syncpt_name = kasprintf(GFP_KERNEL, "%s", syncpt_name);
+		return kasprintf(GFP_KERNEL, "%s", syncpt_name);
 	else if (pdata->resource_policy == RESOURCE_PER_CHANNEL_INSTANCE)
-		syncpt_name = kasprintf(GFP_KERNEL, "%s_%s_%d",
+		return kasprintf(GFP_KERNEL, "%s_%s_%d",
 				dev_name(&pdev->dev), current->comm, param);
 	else
-		syncpt_name = kasprintf(GFP_KERNEL, "%s_%d",
-					dev_name(&pdev->dev), param);
+		return kasprintf(GFP_KERNEL, "%s_%d",
+				dev_name(&pdev->dev), param);
+}
 
-	id = nvhost_get_syncpt(pdev, false, syncpt_name);
+/**
+ * Interface to get a new free (host managed) syncpt dynamically
+ */
+u32 nvhost_get_syncpt_host_managed(struct platform_device *pdev,
+					u32 param,
+					const char *syncpt_name)
+{
+	u32 id;
+
+	syncpt_name = nvhost_syncpt_host_managed_name(pdev, param,
+						      syncpt_name);
+
+	id = nvhost_get_syncpt(pdev, NULL, false, syncpt_name);
 	if (!id) {
 		nvhost_err(&pdev->dev, "failed to get syncpt");
 		kfree(syncpt_name);
@@ -952,6 +1006,56 @@ u32 nvhost_get_syncpt_host_managed(struct platform_device *pdev,
 }
 EXPORT_SYMBOL_GPL(nvhost_get_syncpt_host_managed);
 
+/**
+ * Interface to get several host managed syncpts at once. Either all
+ * count syncpts are allocated or none is.
+ */
+int nvhost_get_syncpts_host_managed(struct platform_device *pdev,
+				    u32 param, u32 *ids, u32 count)
+{
+	struct nvhost_master *host = nvhost_get_host(pdev);
+	struct nvhost_syncpt *sp = &host->syncpt;
+	const char **names;
+	int err = 0;
+	u32 i, n = 0;
+
+	names = kcalloc(count, sizeof(*names), GFP_KERNEL);
+	if (!names)
+		return -ENOMEM;
+
+	for (i = 0; i < count; i++) {
+		names[i] = nvhost_syncpt_host_managed_name(pdev, param + i,
+							   NULL);
+		if (!names[i]) {
+			err = -ENOMEM;
+			goto free_names;
+		}
+	}
+
+	mutex_lock(&sp->syncpt_mutex);
+	for (n = 0; n < count; n++) {
+		err = __nvhost_get_syncpt(pdev, sp, NULL, false, names[n],
+					  &ids[n]);
+		if (err)
+			break;
+	}
+	mutex_unlock(&sp->syncpt_mutex);
+
+	if (err) {
+		nvhost_err(&pdev->dev, "failed to get %u syncpts", count);
+		/* names of allocated syncpts are freed with them */
+		nvhost_syncpt_put_refs_ext(pdev, ids, n);
+	}
+
+free_names:
+	for (i = n; i < count; i++)
+		kfree(names[i]);
+	kfree(names);
+
+	return err;
+}
+EXPORT_SYMBOL_GPL(nvhost_get_syncpts_host_managed);
+
 /**
  * Interface to get a new free (client managed) syncpt dynamically
  */
@@ -965,7 +1069,7 @@ u32 nvhost_get_syncpt_client_managed(struct platform_device *pdev,
 	else
 		syncpt_name = kasprintf(GFP_KERNEL, "%s", syncpt_name);
 
-	id = nvhost_get_syncpt(pdev, true, syncpt_name);
+	id = nvhost_get_syncpt(pdev, NULL, true, syncpt_name);
 	if (!id) {
 		nvhost_err(&pdev->dev, "failed to get syncpt");
 		kfree(syncpt_name);
@@ -976,6 +1080,103 @@ u32 nvhost_get_syncpt_client_managed(struct platform_device *pdev,
 }
 EXPORT_SYMBOL_GPL(nvhost_get_syncpt_client_managed);
 
+/**
+ * Sets aside count free syncpts for pdev. Syncpts in the pool are skipped
+ * by the regular allocators and return to the pool when freed.
+ */
+struct nvhost_syncpt_pool *nvhost_syncpt_pool_create(
+					struct platform_device *pdev,
+					u32 count)
+{
+	struct nvhost_master *host = nvhost_get_host(pdev);
+	struct nvhost_syncpt *sp = &host->syncpt;
+	struct nvhost_syncpt_pool *pool;
+	u32 nb_pts = nvhost_syncpt_nb_hw_pts(sp);
+	u32 i, id;
+
+	pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+	if (!pool)
+		return ERR_PTR(-ENOMEM);
+
+	pool->ids = kcalloc(BITS_TO_LONGS(nb_pts), sizeof(unsigned long),
+			    GFP_KERNEL);
+	if (!pool->ids) {
+		kfree(pool);
+		return ERR_PTR(-ENOMEM);
+	}
+	pool->pdev = pdev;
+
+	mutex_lock(&sp->syncpt_mutex);
+	for (i = 0; i < count; i++) {
+		id = nvhost_find_free_syncpt(sp, NULL);
+		if (!id)
+			break;
+		set_bit(id, sp->pooled);
+		set_bit(id, pool->ids);
+	}
+
+	if (i < count) {
+		for_each_set_bit(id, pool->ids, nb_pts)
+			clear_bit(id, sp->pooled);
+		mutex_unlock(&sp->syncpt_mutex);
+		nvhost_err(&pdev->dev, "failed to reserve %u syncpts", count);
+		kfree(pool->ids);
+		kfree(pool);
+		return ERR_PTR(-EBUSY);
+	}
+	mutex_unlock(&sp->syncpt_mutex);
+
+	return pool;
+}
+EXPORT_SYMBOL_GPL(nvhost_syncpt_pool_create);
+
+/**
+ * Returns the pool's syncpts to the global allocator. Syncpts still in
+ * use stay assigned until their last reference is dropped.
+ */
+void nvhost_syncpt_pool_destroy(struct nvhost_syncpt_pool *pool)
+{
+	struct nvhost_syncpt *sp;
+	u32 id;
+
+	if (IS_ERR_OR_NULL(pool))
+		return;
+
+	sp = &nvhost_get_host(pool->pdev)->syncpt;
+
+	mutex_lock(&sp->syncpt_mutex);
+	for_each_set_bit(id, pool->ids, nvhost_syncpt_nb_hw_pts(sp))
+		clear_bit(id, sp->pooled);
+	mutex_unlock(&sp->syncpt_mutex);
+
+	kfree(pool->ids);
+	kfree(pool);
+}
+EXPORT_SYMBOL_GPL(nvhost_syncpt_pool_destroy);
+
+/**
+ * Interface to get a host managed syncpt from a pool, falls back to the
+ * global allocator once the pool is exhausted
+ */
+u32 nvhost_syncpt_pool_get(struct nvhost_syncpt_pool *pool, u32 param,
+			   const char *syncpt_name)
+{
+	u32 id;
+
+	syncpt_name = nvhost_syncpt_host_managed_name(pool->pdev, param,
+						      syncpt_name);
+
+	id = nvhost_get_syncpt(pool->pdev, pool, false, syncpt_name);
+	if (!id) {
+		nvhost_err(&pool->pdev->dev, "failed to get syncpt");
+		kfree(syncpt_name);
+		return 0;
+	}
+
+	return id;
+}
+EXPORT_SYMBOL_GPL(nvhost_syncpt_pool_get);
+
 /**
  * API to mark in-use syncpt as free
  */
@@ -990,7 +1191,7 @@ static void nvhost_free_syncpt(struct nvhost_syncpt *sp, u32 id)
 			id);
 		return;
 	}
-	if (!sp->assigned[id]) {
+	if (!test_bit(id, sp->assigned)) {
 		nvhost_warn(d, "trying to free unused syncpt %u\n", id);
 		return;
 	}
@@ -1009,16 +1210,15 @@ static void nvhost_free_syncpt(struct nvhost_syncpt *sp, u32 id)
 	if (syncpt_op().release)
 		syncpt_op().release(sp, id);
 
+	/* the name moves over instead of being copied */
 	kfree(sp->last_used_by[id]);
-	sp->last_used_by[id] = kasprintf(GFP_KERNEL, "%s",
-					sp->syncpt_names[id]);
+	sp->last_used_by[id] = sp->syncpt_names[id];
+	sp->syncpt_names[id] = NULL;
 
 	/* set to default state */
 	nvhost_syncpt_set_min_eq_max(sp, id);
-	sp->assigned[id] = false;
 	sp->client_managed[id] = false;
-	kfree(sp->syncpt_names[id]);
-	sp->syncpt_names[id] = NULL;
+	clear_bit(id, sp->assigned);
 
 	mutex_unlock(&sp->syncpt_mutex);
 }
@@ -1027,17 +1227,17 @@ static void nvhost_reserve_syncpts(struct nvhost_syncpt *sp)
 {
 	mutex_lock(&sp->syncpt_mutex);
 
-	sp->assigned[NVSYNCPT_VBLANK0] = true;
+	set_bit(NVSYNCPT_VBLANK0, sp->assigned);
 	sp->client_managed[NVSYNCPT_VBLANK0] = true;
 	sp->syncpt_names[NVSYNCPT_VBLANK0] = "vblank0";
 	nvhost_syncpt_get_ref(sp, NVSYNCPT_VBLANK0);
 
-	sp->assigned[NVSYNCPT_VBLANK1] = true;
+	set_bit(NVSYNCPT_VBLANK1, sp->assigned);
 	sp->client_managed[NVSYNCPT_VBLANK1] = true;
 	sp->syncpt_names[NVSYNCPT_VBLANK1] = "vblank1";
 	nvhost_syncpt_get_ref(sp, NVSYNCPT_VBLANK1);
 
-	sp->assigned[NVSYNCPT_AVP_0] = true;
+	set_bit(NVSYNCPT_AVP_0, sp->assigned);
 	sp->client_managed[NVSYNCPT_AVP_0] = true;
 	sp->syncpt_names[NVSYNCPT_AVP_0] = "avp";
 	nvhost_syncpt_get_ref(sp, NVSYNCPT_AVP_0);
@@ -1111,6 +1311,17 @@ void nvhost_syncpt_put_ref_ext(struct platform_device *pdev, u32 id)
 }
 EXPORT_SYMBOL_GPL(nvhost_syncpt_put_ref_ext);
 
+void nvhost_syncpt_put_refs_ext(struct platform_device *pdev,
+				const u32 *ids, u32 count)
+{
+	struct nvhost_syncpt *sp = &nvhost_get_host(pdev)->syncpt;
+	u32 i;
+
+	for (i = 0; i < count; i++)
+		nvhost_syncpt_put_ref(sp, ids[i]);
+}
+EXPORT_SYMBOL_GPL(nvhost_syncpt_put_refs_ext);
+
 int nvhost_syncpt_init(struct platform_device *dev,
 		struct nvhost_syncpt *sp)
 {
@@ -1120,7 +1331,10 @@ int nvhost_syncpt_init(struct platform_device *dev,
 	int err = 0;
 
 	/* Allocate structs for min, max and base values */
-	sp->assigned = kzalloc(sizeof(bool) * nb_pts, GFP_KERNEL);
+	sp->assigned = kcalloc(BITS_TO_LONGS(nb_pts), sizeof(unsigned long),
+			       GFP_KERNEL);
+	sp->pooled = kcalloc(BITS_TO_LONGS(nb_pts), sizeof(unsigned long),
+			     GFP_KERNEL);
 	sp->client_managed = kzalloc(sizeof(bool) * nb_pts, GFP_KERNEL);
 	sp->in_use_ch = kzalloc(sizeof(int) * nb_pts, GFP_KERNEL);
 	sp->syncpt_names = kzalloc(sizeof(char *) * nb_pts, GFP_KERNEL);
@@ -1152,7 +1366,8 @@ int nvhost_syncpt_init(struct platform_device *dev,
 		host->info.pts_limit = host->info.pts_base + size;
 	}
 
-	if (!(sp->assigned && sp->client_managed && sp->min_val && sp->max_val
+	if (!(sp->assigned && sp->pooled && sp->client_managed
+		     && sp->min_val && sp->max_val
 		     && sp->lock_counts && sp->in_use_ch && sp->ref)) {
 		nvhost_err(&dev->dev, "syncpt in a wrong state");
 		/* frees happen in the deinit */
@@ -1205,7 +1420,7 @@ int nvhost_syncpt_init(struct platform_device *dev,
 			goto fail;
 
 		/* initialize syncpt status */
-		sp->assigned[i] = false;
+		clear_bit(i, sp->assigned);
 		sp->in_use_ch[i] = NVHOST_SYNCPT_IN_USE_CH_NONE;
 		if (nvhost_syncpt_is_valid_pt(sp, i))
 			sp->client_managed[i] = false;
@@ -1308,6 +1523,9 @@ void nvhost_syncpt_deinit(struct nvhost_syncpt *sp)
 	kfree(sp->assigned);
 	sp->assigned = NULL;
 
+	kfree(sp->pooled);
+	sp->pooled = NULL;
+
 	nvhost_syncpt_deinit_timeline(sp);
 }
 
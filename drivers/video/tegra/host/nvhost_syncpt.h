@@ -46,8 +46,18 @@ struct nvhost_syncpt_attr {
 	int id;
 };
 
+/* syncpts set aside for one client, see nvhost_syncpt_pool_create() */
+struct nvhost_syncpt_pool {
+	struct platform_device *pdev;
+	unsigned long *ids;
+};
+
 struct nvhost_syncpt {
-	bool	*assigned;
+	unsigned long *assigned;
+	/* ids held in a client pool, skipped by the global search */
+	unsigned long *pooled;
+	/* where the next global search starts */
+	u32	free_hint;
 	bool	*client_managed;
 	int	*in_use_ch;
 	struct kobject *kobj;
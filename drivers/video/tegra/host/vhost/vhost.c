@@ -24,6 +24,9 @@
 #include "vhost.h"
 #include "../host1x/host1x.h"
 
+/* set when the server echoes request tags, see vhost_tags_init() */
+static bool vhost_pb_tagged;
+
 static inline int vhost_comm_init(struct platform_device *pdev,
 					  bool channel_management_in_guest)
 {
@@ -43,9 +46,47 @@ static inline void vhost_comm_deinit(bool channel_management_in_guest)
 		channel_management_in_guest ?
 		1 : ARRAY_SIZE(queue_sizes);
 
+	vhost_pb_tagged = false;
 	tegra_gr_comm_deinit(TEGRA_VHOST_QUEUE_CMD, num_queues);
 }
 
+/*
+ * Servers that ack TEGRA_VHOST_CMD_TAGS echo the request tag, so command
+ * and pushbuffer responses can be matched out of order. With any other
+ * server the queues stay untagged and allow one request in flight.
+ */
+static int vhost_tags_init(u64 handle, bool channel_management_in_guest)
+{
+	struct tegra_vhost_cmd_msg msg;
+	int err;
+
+	/* the tag must not overlap any command's parameters */
+	BUILD_BUG_ON(offsetof(struct tegra_vhost_cmd_msg, params) +
+		sizeof(struct tegra_vhost_channel_regrdwr_params) >
+		TEGRA_VHOST_CMD_TAG_OFFSET);
+
+	msg.cmd = TEGRA_VHOST_CMD_TAGS;
+	msg.handle = handle;
+	err = vhost_sendrecv(&msg);
+	if (err || msg.ret)
+		return -ENOSYS;
+
+	err = tegra_gr_comm_set_tag_offset(TEGRA_VHOST_QUEUE_CMD,
+				TEGRA_VHOST_CMD_TAG_OFFSET);
+	if (err || channel_management_in_guest)
+		return err;
+
+	err = tegra_gr_comm_set_tag_offset(TEGRA_VHOST_QUEUE_PB,
+				TEGRA_VHOST_CMD_TAG_OFFSET);
+	vhost_pb_tagged = !err;
+	return err;
+}
+
+bool vhost_pb_is_tagged(void)
+{
+	return vhost_pb_tagged;
+}
+
 int vhost_virt_moduleid(int moduleid)
 {
 	switch (moduleid) {
@@ -133,7 +174,7 @@ int vhost_sendrecv(struct tegra_vhost_cmd_msg *msg)
 	void *data = msg;
 	int err;
 
-	err = tegra_gr_comm_sendrecv(tegra_gr_comm_get_server_vmid(),
+	err = tegra_gr_comm_sendrecv_tagged(tegra_gr_comm_get_server_vmid(),
 				TEGRA_VHOST_QUEUE_CMD, &handle, &data, &size);
 	if (!err) {
 		WARN_ON(size < size_out);
@@ -204,6 +245,15 @@ int nvhost_virt_init(struct platform_device *dev, int moduleid)
 		goto fail;
 	}
 
+	if (moduleid == NVHOST_MODULE_NONE &&
+	    vhost_tags_init(virt_ctx->handle, channel_management_in_guest))
+		dev_info(&dev->dev, "tagged requests not available\n");
+
+	/* Syncpoint reads fall back to RPC if the server has no shadow */
+	if (moduleid == NVHOST_MODULE_NONE &&
+	    vhost_syncpt_shadow_init(virt_ctx))
+		dev_info(&dev->dev, "syncpoint shadow not available\n");
+
 	nvhost_set_virt_data(dev, virt_ctx);
 	return 0;
 
@@ -219,6 +269,7 @@ void nvhost_virt_deinit(struct platform_device *dev)
 
 	if (virt_ctx) {
 		/* FIXME: add virt disconnect */
+		vhost_syncpt_shadow_deinit(virt_ctx);
 		vhost_comm_deinit(host->info.vmserver_owns_engines);
 		kfree(virt_ctx);
 	}
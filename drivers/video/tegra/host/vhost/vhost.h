@@ -1,7 +1,7 @@
 /*
  * Tegra Graphics Host Virtualization Support
  *
- * Copyright (c) 2014-2018, NVIDIA Corporation.  All rights reserved.
+ * Copyright (c) 2014-2020, NVIDIA Corporation.  All rights reserved.
  *
  * This program is free software; you can redistribute it and/or modify it
  * under the terms and conditions of the GNU General Public License,
@@ -23,9 +23,16 @@
 
 #include "chip_support.h"
 
+struct tegra_vhost_syncpt_shadow;
+
 struct nvhost_virt_ctx {
 	u64 handle;
 	struct task_struct *syncpt_handler;
+	/* server maintained syncpoint values, NULL if not supported */
+	struct tegra_vhost_syncpt_shadow __iomem *syncpt_shadow;
+	u32 syncpt_shadow_num;
+	/* claim on the CMD queue mempool that holds the shadow */
+	void *syncpt_shadow_oob;
 };
 
 #ifdef CONFIG_TEGRA_GRHOST_VHOST
@@ -50,7 +57,10 @@ void vhost_init_host1x_syncpt_ops(struct nvhost_syncpt_ops *ops);
 void vhost_init_host1x_cdma_ops(struct nvhost_cdma_ops *ops);
 void vhost_init_host1x_debug_ops(struct nvhost_debug_ops *ops);
 int vhost_syncpt_get_range(u64 handle, u32 *base, u32 *size);
+int vhost_syncpt_shadow_init(struct nvhost_virt_ctx *ctx);
+void vhost_syncpt_shadow_deinit(struct nvhost_virt_ctx *ctx);
 int vhost_sendrecv(struct tegra_vhost_cmd_msg *msg);
+bool vhost_pb_is_tagged(void);
 int vhost_virt_moduleid(int moduleid);
 int vhost_moduleid_virt_to_hw(int moduleid);
 u32 vhost_channel_alloc_clientid(u64 handle, u32 moduleid);
@@ -1,7 +1,7 @@
 /*
  * Tegra Graphics Virtualization Host cdma for HOST1X
  *
- * Copyright (c) 2014-2018, NVIDIA Corporation. All rights reserved.
+ * Copyright (c) 2014-2020, NVIDIA Corporation. All rights reserved.
  *
  * This program is free software; you can redistribute it and/or modify it
  * under the terms and conditions of the GNU General Public License,
@@ -43,13 +43,28 @@ static int vhost_pb_sendrecv(struct tegra_vhost_cmd_msg *msg, size_t size_in,
 	return err;
 }
 
+/*
+ * With a tagging server submits are not waited for: job completion is
+ * tracked through the syncpoint increments, so the response only reports
+ * errors.
+ */
+static void vhost_channel_submit_done(void *priv, void *data, size_t size)
+{
+	struct tegra_vhost_cmd_msg *msg = data;
+
+	if (size < sizeof(*msg) || msg->ret)
+		pr_err("%s: server rejected job %u\n", __func__,
+			(u32)(uintptr_t)priv);
+}
+
 static int vhost_channel_submit(u64 handle, struct nvhost_job *job,
 		u32 *pb_base, u32 start, u32 end, u32 job_id)
 {
 	struct tegra_vhost_cmd_msg *msg;
 	struct tegra_vhost_channel_submit_params *p;
 	u32 num_entries, i;
-	size_t size;
+	size_t size, buf_size;
+	void *buf;
 	char *ptr;
 	u32 *ptr32;
 	int err;
@@ -58,9 +73,14 @@ static int vhost_channel_submit(u64 handle, struct nvhost_job *job,
 	num_entries = ((end - start) & (PUSH_BUFFER_SIZE - 1)) / 8;
 
 	size = sizeof(*msg) + 8 * (num_entries + job->num_syncpts);
-	msg = kmalloc(size, GFP_KERNEL);
-	if (!msg)
+	buf = tegra_gr_comm_get_buf(TEGRA_VHOST_QUEUE_PB, (void **)&msg,
+				&buf_size);
+	if (!buf)
+		return -1;
+	if (size > buf_size) {
+		tegra_gr_comm_release(buf);
 		return -1;
+	}
 
 	msg->cmd = TEGRA_VHOST_CMD_HOST1X_CDMA_SUBMIT;
 	msg->handle = handle;
@@ -94,11 +114,18 @@ static int vhost_channel_submit(u64 handle, struct nvhost_job *job,
 		*ptr32++ = sp->fence;
 	}
 
-	err = vhost_pb_sendrecv(msg, size, sizeof(*msg));
+	if (vhost_pb_is_tagged()) {
+		err = tegra_gr_comm_send_async(tegra_gr_comm_get_server_vmid(),
+					TEGRA_VHOST_QUEUE_PB, msg, size,
+					vhost_channel_submit_done,
+					(void *)(uintptr_t)job_id);
+	} else {
+		err = vhost_pb_sendrecv(msg, size, sizeof(*msg));
+		err = err || msg->ret;
+	}
 
-	err = (err || msg->ret) ? -1 : 0;
-	kfree(msg);
-	return err;
+	tegra_gr_comm_release(buf);
+	return err ? -1 : 0;
 }
 
 static void vhost_cdma_start(struct nvhost_cdma *cdma)
@@ -1,7 +1,7 @@
 /*
  * Tegra Graphics Virtualization Host Syncpoints for HOST1X
  *
- * Copyright (c) 2014-2016, NVIDIA Corporation. All rights reserved.
+ * Copyright (c) 2014-2020, NVIDIA Corporation. All rights reserved.
  *
  * This program is free software; you can redistribute it and/or modify it
  * under the terms and conditions of the GNU General Public License,
@@ -16,6 +16,8 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <linux/io.h>
+
 #include "nvhost_syncpt.h"
 #include "vhost.h"
 #include "../host1x/host1x.h"
@@ -77,6 +79,79 @@ static u32 vhost_syncpt_read(u64 handle, u32 id)
 	return p->val;
 }
 
+int vhost_syncpt_shadow_init(struct nvhost_virt_ctx *ctx)
+{
+	struct tegra_vhost_cmd_msg msg;
+	struct tegra_vhost_syncpt_shadow_params *p = &msg.params.syncpt_shadow;
+	void *handle, *ptr;
+	size_t size;
+	int err;
+
+	/* the server writes the shadow for as long as the guest runs */
+	handle = tegra_gr_comm_oob_claim(tegra_gr_comm_get_server_vmid(),
+				TEGRA_VHOST_QUEUE_CMD, &ptr, &size);
+	if (!handle)
+		return -ENOSYS;
+
+	if (size <= sizeof(struct tegra_vhost_syncpt_shadow)) {
+		err = -ENOMEM;
+		goto fail;
+	}
+
+	msg.cmd = TEGRA_VHOST_CMD_SYNCPT_SHADOW;
+	msg.handle = ctx->handle;
+	p->offset = 0;
+	p->size = size;
+	p->num_syncpts = 0;
+	err = vhost_sendrecv(&msg);
+	if (err || msg.ret) {
+		err = -ENOSYS;
+		goto fail;
+	}
+
+	if (!p->num_syncpts ||
+	    p->num_syncpts > (size - sizeof(struct tegra_vhost_syncpt_shadow)) /
+				sizeof(u32)) {
+		err = -EINVAL;
+		goto fail;
+	}
+
+	ctx->syncpt_shadow = ptr;
+	ctx->syncpt_shadow_num = p->num_syncpts;
+	ctx->syncpt_shadow_oob = handle;
+	return 0;
+
+fail:
+	tegra_gr_comm_oob_unclaim(handle);
+	return err;
+}
+
+void vhost_syncpt_shadow_deinit(struct nvhost_virt_ctx *ctx)
+{
+	if (!ctx->syncpt_shadow_oob)
+		return;
+
+	ctx->syncpt_shadow = NULL;
+	tegra_gr_comm_oob_unclaim(ctx->syncpt_shadow_oob);
+	ctx->syncpt_shadow_oob = NULL;
+}
+
+static bool vhost_syncpt_shadow_read(struct nvhost_virt_ctx *ctx, u32 id,
+				u32 *val)
+{
+	struct tegra_vhost_syncpt_shadow __iomem *shadow = ctx->syncpt_shadow;
+
+	/* the header is the server's word on which ids it maintains */
+	if (!shadow || id >= ctx->syncpt_shadow_num ||
+	    id >= readl(&shadow->num_syncpts))
+		return false;
+
+	*val = readl(&shadow->val[id]);
+	/* order the read before any use of data guarded by the syncpt */
+	rmb();
+	return true;
+}
+
 static u32 vhost_syncpt_update_min(struct nvhost_syncpt *sp, u32 id)
 {
 	struct nvhost_master *dev = syncpt_to_dev(sp);
@@ -85,7 +160,13 @@ static u32 vhost_syncpt_update_min(struct nvhost_syncpt *sp, u32 id)
 
 	do {
 		old = nvhost_syncpt_read_min(sp, id);
-		live = vhost_syncpt_read(ctx->handle, id);
+		/*
+		 * The shadow is only trusted if it has not fallen behind the
+		 * cached minimum; otherwise ask the server.
+		 */
+		if (!vhost_syncpt_shadow_read(ctx, id, &live) ||
+		    (s32)(live - old) < 0)
+			live = vhost_syncpt_read(ctx->handle, id);
 	} while ((u32)atomic_cmpxchg(&sp->min_val[id], old, live) != old);
 
 	return live;
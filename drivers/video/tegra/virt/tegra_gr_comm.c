@@ -1,7 +1,7 @@
 /*
  * Tegra Graphics Virtualization Communication Framework
  *
- * Copyright (c) 2013-2018, NVIDIA Corporation. All rights reserved.
+ * Copyright (c) 2013-2020, NVIDIA Corporation. All rights reserved.
  *
  * This program is free software; you can redistribute it and/or modify it
  * under the terms and conditions of the GNU General Public License,
@@ -29,6 +29,9 @@
 #include <linux/kthread.h>
 #include <linux/io.h>
 #include <linux/interrupt.h>
+#include <linux/bitops.h>
+#include <linux/completion.h>
+#include <linux/spinlock.h>
 #include <linux/tegra-ivc.h>
 #include <linux/tegra_gr_comm.h>
 #include <linux/module.h>
@@ -36,6 +39,15 @@
 #define NUM_QUEUES   5
 #define NUM_CONTEXTS 1
 
+/*
+ * Tagged requests: the low byte of a tag is the slot index plus one, the
+ * upper bits a per-queue sequence number, so a late response to a timed
+ * out request never matches a recycled slot. Tag 0 means untagged.
+ */
+#define GR_COMM_MAX_TAGS      32
+#define GR_COMM_TAG_SLOT_MASK 0xff
+#define GR_COMM_TAG_TIMEOUT   (10 * HZ)
+
 struct gr_comm_ivc_context {
 	u32 peer;
 	wait_queue_head_t wq;
@@ -48,6 +60,8 @@ struct gr_comm_ivc_context {
 struct gr_comm_mempool_context {
 	struct tegra_hv_ivm_cookie *cookie;
 	void __iomem *ptr;
+	/* held by tegra_gr_comm_oob_claim() */
+	bool claimed;
 };
 
 struct gr_comm_element {
@@ -58,11 +72,27 @@ struct gr_comm_element {
 	struct gr_comm_queue *queue;
 };
 
+struct gr_comm_tag {
+	u32 tag;
+	struct gr_comm_element *element;
+	struct completion done;
+	tegra_gr_comm_callback_t callback;
+	void *priv;
+};
+
 struct gr_comm_queue {
 	struct semaphore sem;
 	struct mutex lock;
 	struct mutex resp_lock;
 	struct mutex mempool_lock;
+	struct mutex send_lock;
+	spinlock_t tag_lock;
+	wait_queue_head_t tag_wq;
+	struct gr_comm_tag tags[GR_COMM_MAX_TAGS];
+	unsigned long tag_map;
+	size_t tag_offset;
+	u32 tag_seq;
+	bool tagged;
 	struct list_head pending;
 	struct list_head free;
 	size_t size;
@@ -109,6 +139,7 @@ static void free_mempool(u32 queue_start, u32 queue_end)
 		if (!tmp)
 			continue;
 
+		WARN_ON(tmp->claimed);
 		if (tmp->ptr)
 			iounmap(tmp->ptr);
 
@@ -142,19 +173,16 @@ static void free_ivc(u32 queue_start, u32 queue_end)
 	}
 }
 
-static int queue_add(struct gr_comm_queue *queue, const char *data,
-		u32 peer, struct tegra_hv_ivc_cookie *ivck)
+/* called with queue->lock held */
+static struct gr_comm_element *queue_get_element(struct gr_comm_queue *queue)
 {
 	struct gr_comm_element *element;
 
-	mutex_lock(&queue->lock);
 	if (list_empty(&queue->free)) {
 		element = kmem_cache_alloc(queue->element_cache,
 					GFP_KERNEL);
-		if (!element) {
-			mutex_unlock(&queue->lock);
-			return -ENOMEM;
-		}
+		if (!element)
+			return NULL;
 		element->data = (char *)element + sizeof(*element);
 		element->queue = queue;
 	} else {
@@ -163,6 +191,124 @@ static int queue_add(struct gr_comm_queue *queue, const char *data,
 		list_del(&element->list);
 	}
 
+	return element;
+}
+
+static inline u32 *queue_tag_ptr(struct gr_comm_queue *queue, void *data)
+{
+	return (u32 *)((char *)data + queue->tag_offset);
+}
+
+static struct gr_comm_tag *__queue_get_tag(struct gr_comm_queue *queue,
+		tegra_gr_comm_callback_t callback, void *priv)
+{
+	struct gr_comm_tag *t = NULL;
+	u32 slot;
+
+	spin_lock(&queue->tag_lock);
+	slot = find_first_zero_bit(&queue->tag_map, GR_COMM_MAX_TAGS);
+	if (slot < GR_COMM_MAX_TAGS) {
+		set_bit(slot, &queue->tag_map);
+		t = &queue->tags[slot];
+		t->tag = (++queue->tag_seq << 8) | (slot + 1);
+		t->element = NULL;
+		t->callback = callback;
+		t->priv = priv;
+		reinit_completion(&t->done);
+	}
+	spin_unlock(&queue->tag_lock);
+
+	return t;
+}
+
+static struct gr_comm_tag *queue_get_tag(struct gr_comm_queue *queue,
+		tegra_gr_comm_callback_t callback, void *priv)
+{
+	struct gr_comm_tag *t = NULL;
+
+	if (!wait_event_timeout(queue->tag_wq,
+			(t = __queue_get_tag(queue, callback, priv)) != NULL,
+			GR_COMM_TAG_TIMEOUT))
+		return NULL;
+
+	return t;
+}
+
+/* called with queue->tag_lock held */
+static void __queue_put_tag(struct gr_comm_queue *queue,
+		struct gr_comm_tag *t)
+{
+	t->tag = 0;
+	t->element = NULL;
+	t->callback = NULL;
+	clear_bit(t - queue->tags, &queue->tag_map);
+}
+
+static void queue_put_tag(struct gr_comm_queue *queue, struct gr_comm_tag *t)
+{
+	spin_lock(&queue->tag_lock);
+	__queue_put_tag(queue, t);
+	spin_unlock(&queue->tag_lock);
+	wake_up(&queue->tag_wq);
+}
+
+/*
+ * Hand a received message to the tagged request it answers. Returns false
+ * for untagged messages, which go to the pending list as before.
+ */
+static bool queue_dispatch_tagged(struct gr_comm_queue *queue,
+		struct gr_comm_element *element)
+{
+	u32 tag = *queue_tag_ptr(queue, element->data);
+	u32 slot = (tag & GR_COMM_TAG_SLOT_MASK) - 1;
+	tegra_gr_comm_callback_t callback;
+	struct gr_comm_tag *t;
+	void *priv;
+
+	if (!tag)
+		return false;
+
+	spin_lock(&queue->tag_lock);
+	if (slot >= GR_COMM_MAX_TAGS || queue->tags[slot].tag != tag) {
+		spin_unlock(&queue->tag_lock);
+		dev_warn(&queue->ivc_ctx->pdev->dev,
+			"%s dropping response with stale tag 0x%x\n",
+			__func__, tag);
+		tegra_gr_comm_release(element);
+		return true;
+	}
+
+	t = &queue->tags[slot];
+	callback = t->callback;
+	if (!callback) {
+		t->element = element;
+		complete(&t->done);
+		spin_unlock(&queue->tag_lock);
+		return true;
+	}
+
+	priv = t->priv;
+	__queue_put_tag(queue, t);
+	spin_unlock(&queue->tag_lock);
+	wake_up(&queue->tag_wq);
+
+	callback(priv, element->data, element->size);
+	tegra_gr_comm_release(element);
+	return true;
+}
+
+static int queue_add(struct gr_comm_queue *queue, const char *data,
+		u32 peer, struct tegra_hv_ivc_cookie *ivck)
+{
+	struct gr_comm_element *element;
+
+	mutex_lock(&queue->lock);
+	element = queue_get_element(queue);
+	if (!element) {
+		mutex_unlock(&queue->lock);
+		return -ENOMEM;
+	}
+
 	element->sender = peer;
 	element->size = queue->size;
 	if (ivck) {
@@ -176,6 +322,12 @@ static int queue_add(struct gr_comm_queue *queue, const char *data,
 		/* local msg */
 		memcpy(element->data, data, element->size);
 	}
+	mutex_unlock(&queue->lock);
+
+	if (ivck && queue->tagged && queue_dispatch_tagged(queue, element))
+		return 0;
+
+	mutex_lock(&queue->lock);
 	list_add_tail(&element->list, &queue->pending);
 	mutex_unlock(&queue->lock);
 	up(&queue->sem);
@@ -374,6 +526,13 @@ int tegra_gr_comm_init(struct platform_device *pdev, u32 elems,
 		mutex_init(&queue->lock);
 		mutex_init(&queue->resp_lock);
 		mutex_init(&queue->mempool_lock);
+		mutex_init(&queue->send_lock);
+		spin_lock_init(&queue->tag_lock);
+		init_waitqueue_head(&queue->tag_wq);
+		for (j = 0; j < GR_COMM_MAX_TAGS; ++j)
+			init_completion(&queue->tags[j].done);
+		queue->tag_map = 0;
+		queue->tagged = false;
 		INIT_LIST_HEAD(&queue->free);
 		INIT_LIST_HEAD(&queue->pending);
 		queue->size = size;
@@ -441,6 +600,12 @@ void tegra_gr_comm_deinit(u32 queue_start, u32 num_queues)
 	if (queue_end > NUM_QUEUES)
 		return;
 
+	/*
+	 * Stop the receive threads first: an async callback may still be
+	 * returning its element to the free list.
+	 */
+	free_ivc(queue_start, queue_end);
+
 	for (i = queue_start; i < queue_end; ++i) {
 		struct gr_comm_queue *queue = &comm_context.queue[i];
 
@@ -457,9 +622,9 @@ void tegra_gr_comm_deinit(u32 queue_start, u32 num_queues)
 			kmem_cache_free(queue->element_cache, tmp);
 		}
 		kmem_cache_destroy(queue->element_cache);
+		queue->tagged = false;
 		queue->valid = false;
 	}
-	free_ivc(queue_start, queue_end);
 	free_mempool(queue_start, queue_end);
 }
 EXPORT_SYMBOL(tegra_gr_comm_deinit);
@@ -486,11 +651,13 @@ int tegra_gr_comm_send(u32 peer, u32 index, void *data,
 	if (!ivc_ctx || ivc_ctx->peer != peer)
 		return -EINVAL;
 
+	mutex_lock(&queue->send_lock);
 	if (!tegra_hv_ivc_can_write(ivc_ctx->cookie)) {
 		ret = wait_event_timeout(ivc_ctx->wq,
 				tegra_hv_ivc_can_write(ivc_ctx->cookie),
 				msecs_to_jiffies(500));
 		if (!ret) {
+			mutex_unlock(&queue->send_lock);
 			dev_err(&ivc_ctx->pdev->dev,
 				"%s timeout waiting for buffer\n", __func__);
 			return -ENOMEM;
@@ -498,6 +665,7 @@ int tegra_gr_comm_send(u32 peer, u32 index, void *data,
 	}
 
 	ret = tegra_hv_ivc_write(ivc_ctx->cookie, data, size);
+	mutex_unlock(&queue->send_lock);
 	return (ret != size) ? -ENOMEM : 0;
 }
 EXPORT_SYMBOL(tegra_gr_comm_send);
@@ -561,6 +729,138 @@ fail:
 }
 EXPORT_SYMBOL(tegra_gr_comm_sendrecv);
 
+int tegra_gr_comm_set_tag_offset(u32 index, size_t offset)
+{
+	struct gr_comm_queue *queue;
+
+	if (index >= NUM_QUEUES)
+		return -EINVAL;
+
+	queue = &comm_context.queue[index];
+	if (!queue->valid || !queue->ivc_ctx ||
+		offset + sizeof(u32) > queue->size)
+		return -EINVAL;
+
+	queue->tag_offset = offset;
+	queue->tagged = true;
+	return 0;
+}
+EXPORT_SYMBOL(tegra_gr_comm_set_tag_offset);
+
+/*
+ * Like tegra_gr_comm_sendrecv(), but the response is matched by tag so
+ * several callers may have requests in flight on the same queue.
+ */
+int tegra_gr_comm_sendrecv_tagged(u32 peer, u32 index, void **handle,
+			void **data, size_t *size)
+{
+	struct gr_comm_element *element;
+	struct gr_comm_queue *queue;
+	struct gr_comm_tag *t;
+	int err;
+
+	if (index >= NUM_QUEUES)
+		return -EINVAL;
+
+	queue = &comm_context.queue[index];
+	if (!queue->valid)
+		return -EINVAL;
+
+	if (!queue->tagged || peer == TEGRA_GR_COMM_ID_SELF)
+		return tegra_gr_comm_sendrecv(peer, index, handle, data, size);
+
+	t = queue_get_tag(queue, NULL, NULL);
+	if (!t)
+		return -EBUSY;
+
+	*queue_tag_ptr(queue, *data) = t->tag;
+	err = tegra_gr_comm_send(peer, index, *data, *size);
+	if (!err && !wait_for_completion_timeout(&t->done,
+						GR_COMM_TAG_TIMEOUT))
+		err = -ETIMEDOUT;
+
+	spin_lock(&queue->tag_lock);
+	element = t->element;
+	__queue_put_tag(queue, t);
+	spin_unlock(&queue->tag_lock);
+	wake_up(&queue->tag_wq);
+
+	/* the response may have raced with the timeout */
+	if (!element) {
+		if (err == -ETIMEDOUT)
+			dev_err(&queue->ivc_ctx->pdev->dev,
+				"%s: timeout for response!\n", __func__);
+		return err;
+	}
+
+	*handle = element;
+	*data = element->data;
+	*size = element->size;
+	return 0;
+}
+EXPORT_SYMBOL(tegra_gr_comm_sendrecv_tagged);
+
+/*
+ * Send a tagged request without waiting for the response. The callback
+ * runs from the receive thread once the response arrives; the data it is
+ * passed is only valid for the duration of the call.
+ */
+int tegra_gr_comm_send_async(u32 peer, u32 index, void *data, size_t size,
+			tegra_gr_comm_callback_t callback, void *priv)
+{
+	struct gr_comm_queue *queue;
+	struct gr_comm_tag *t;
+	int err;
+
+	if (index >= NUM_QUEUES || !callback)
+		return -EINVAL;
+
+	queue = &comm_context.queue[index];
+	if (!queue->valid || !queue->tagged ||
+		peer == TEGRA_GR_COMM_ID_SELF)
+		return -EINVAL;
+
+	t = queue_get_tag(queue, callback, priv);
+	if (!t)
+		return -EBUSY;
+
+	*queue_tag_ptr(queue, data) = t->tag;
+	err = tegra_gr_comm_send(peer, index, data, size);
+	if (err)
+		queue_put_tag(queue, t);
+
+	return err;
+}
+EXPORT_SYMBOL(tegra_gr_comm_send_async);
+
+/*
+ * Borrow a message buffer of the queue's element size from the
+ * preallocated pool. Return it with tegra_gr_comm_release().
+ */
+void *tegra_gr_comm_get_buf(u32 index, void **data, size_t *size)
+{
+	struct gr_comm_element *element;
+	struct gr_comm_queue *queue;
+
+	if (index >= NUM_QUEUES)
+		return NULL;
+
+	queue = &comm_context.queue[index];
+	if (!queue->valid)
+		return NULL;
+
+	mutex_lock(&queue->lock);
+	element = queue_get_element(queue);
+	mutex_unlock(&queue->lock);
+	if (!element)
+		return NULL;
+
+	*data = element->data;
+	*size = queue->size;
+	return element;
+}
+EXPORT_SYMBOL(tegra_gr_comm_get_buf);
+
 void tegra_gr_comm_release(void *handle)
 {
 	struct gr_comm_element *element =
@@ -590,6 +890,10 @@ void *tegra_gr_comm_oob_get_ptr(u32 peer, u32 index,
 		return NULL;
 
 	mutex_lock(&queue->mempool_lock);
+	if (mempool_ctx->claimed) {
+		mutex_unlock(&queue->mempool_lock);
+		return NULL;
+	}
 	*size = mempool_ctx->cookie->size;
 	*ptr = mempool_ctx->ptr;
 	return queue;
@@ -603,3 +907,32 @@ void tegra_gr_comm_oob_put_ptr(void *handle)
 	mutex_unlock(&queue->mempool_lock);
 }
 EXPORT_SYMBOL(tegra_gr_comm_oob_put_ptr);
+
+/*
+ * Claim the mempool of a queue beyond a single get/put, for memory the
+ * server keeps writing to. Until tegra_gr_comm_oob_unclaim(), no one else
+ * gets the pointer from tegra_gr_comm_oob_get_ptr() or this function.
+ */
+void *tegra_gr_comm_oob_claim(u32 peer, u32 index, void **ptr, size_t *size)
+{
+	struct gr_comm_queue *queue;
+
+	queue = tegra_gr_comm_oob_get_ptr(peer, index, ptr, size);
+	if (!queue)
+		return NULL;
+
+	queue->mempool_ctx->claimed = true;
+	mutex_unlock(&queue->mempool_lock);
+	return queue;
+}
+EXPORT_SYMBOL(tegra_gr_comm_oob_claim);
+
+void tegra_gr_comm_oob_unclaim(void *handle)
+{
+	struct gr_comm_queue *queue = (struct gr_comm_queue *)handle;
+
+	mutex_lock(&queue->mempool_lock);
+	queue->mempool_ctx->claimed = false;
+	mutex_unlock(&queue->mempool_lock);
+}
+EXPORT_SYMBOL(tegra_gr_comm_oob_unclaim);
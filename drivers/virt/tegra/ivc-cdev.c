@@ -1,7 +1,7 @@
 /*
  * IVC character device driver
  *
- * Copyright (C) 2014-2018, NVIDIA CORPORATION. All rights reserved.
+ * Copyright (C) 2014-2020, NVIDIA CORPORATION. All rights reserved.
  *
  * This file is licensed under the terms of the GNU General Public License
  * version 2.  This program is licensed "as is" without any warranty of any
@@ -11,6 +11,7 @@
 
 #include <linux/tegra-ivc.h>
 #include <linux/tegra-ivc-instance.h>
+#include <linux/tegra-ivc-frames.h>
 #include <linux/module.h>
 #include <linux/init.h>
 #include <linux/workqueue.h>
@@ -20,6 +21,10 @@
 #include <linux/device.h>
 #include <linux/slab.h>
 #include <linux/sched.h>
+#include <linux/mm.h>
+#include <linux/uaccess.h>
+#include <linux/eventfd.h>
+#include <uapi/linux/nvhvivc_cdev_ioctl.h>
 
 #include "tegra_hv.h"
 
@@ -39,6 +44,13 @@ struct ivc_dev {
 
 	/* File mode */
 	wait_queue_head_t	wq;
+	struct eventfd_ctx	*efd;
+
+	/* mmap layout of the queue pair, map_size is 0 if not mappable */
+	phys_addr_t		map_pa;
+	size_t			map_size;
+	size_t			rx_offset;
+	size_t			tx_offset;
 	/*
 	 * Lock for synchronizing access to the IVC channel between the threaded
 	 * IRQ handler's notification processing and file ops.
@@ -57,6 +69,8 @@ static irqreturn_t ivc_dev_handler(int irq, void *data)
 
 	mutex_lock(&ivc->file_lock);
 	tegra_ivc_channel_notified(tegra_hv_ivc_convert_cookie(ivc->ivck));
+	if (ivc->efd)
+		eventfd_signal(ivc->efd, 1);
 	mutex_unlock(&ivc->file_lock);
 
 	/* simple implementation, just kick all waiters */
@@ -128,6 +142,11 @@ static int ivc_dev_release(struct inode *inode, struct file *filp)
 
 	devm_free_irq(ivc->device, ivck->irq, ivc);
 
+	if (ivc->efd) {
+		eventfd_ctx_put(ivc->efd);
+		ivc->efd = NULL;
+	}
+
 	ivc->ivck = NULL;
 
 	/*
@@ -258,6 +277,172 @@ static unsigned int ivc_dev_poll(struct file *filp, poll_table *wait)
 	return mask;
 }
 
+static int ivc_dev_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	struct ivc_dev *ivcd = filp->private_data;
+	size_t map_region_sz;
+
+	BUG_ON(!ivcd);
+
+	if (ivcd->map_size == 0)
+		return -EINVAL;
+
+	/* fail if userspace attempts to partially map the queue pair */
+	map_region_sz = vma->vm_end - vma->vm_start;
+	if (vma->vm_pgoff != 0 || map_region_sz != ivcd->map_size)
+		return -EINVAL;
+
+	if (remap_pfn_range(vma, vma->vm_start, ivcd->map_pa >> PAGE_SHIFT,
+			map_region_sz, vma->vm_page_prot))
+		return -EAGAIN;
+
+	return 0;
+}
+
+static int ivc_dev_get_info(struct ivc_dev *ivcd, void __user *arg)
+{
+	struct tegra_ivc_cdev_info ci = {
+		.frame_size	= ivcd->qd->frame_size,
+		.nframes	= ivcd->qd->nframes,
+		.rx_offset	= ivcd->rx_offset,
+		.tx_offset	= ivcd->tx_offset,
+		.map_size	= ivcd->map_size,
+	};
+
+	if (copy_to_user(arg, &ci, sizeof(ci)))
+		return -EFAULT;
+
+	return 0;
+}
+
+/*
+ * The ACQUIRE ioctls only report ring positions; the frames themselves are
+ * accessed through the mapping. RELEASE and COMMIT advance the channel one
+ * frame at a time, but tegra_ivc only notifies the peer on the empty to
+ * non-empty and full to non-full transitions, so a whole batch costs at
+ * most one doorbell.
+ */
+static int ivc_dev_frames(struct ivc_dev *ivcd, unsigned int cmd,
+		void __user *arg)
+{
+	struct ivc *ivc = tegra_hv_ivc_convert_cookie(ivcd->ivck);
+	struct tegra_ivc_cdev_frames fr;
+	uint32_t avail, i = 0;
+	int ret = 0;
+
+	if (copy_from_user(&fr, arg, sizeof(fr)))
+		return -EFAULT;
+
+	if (fr.count > ivcd->qd->nframes)
+		return -EINVAL;
+
+	mutex_lock(&ivcd->file_lock);
+
+	switch (cmd) {
+	case TEGRA_IVC_CDEV_IOCTL_RX_ACQUIRE:
+		avail = tegra_ivc_rx_frames_available(ivc);
+		fr.index = ivc->r_pos;
+		fr.count = min(fr.count, avail);
+		break;
+
+	case TEGRA_IVC_CDEV_IOCTL_TX_ACQUIRE:
+		avail = tegra_ivc_can_write(ivc) ?
+			tegra_ivc_tx_frames_available(ivc) : 0;
+		fr.index = ivc->w_pos;
+		fr.count = min(fr.count, avail);
+		break;
+
+	case TEGRA_IVC_CDEV_IOCTL_RX_RELEASE:
+		for (i = 0; i < fr.count; i++) {
+			ret = tegra_ivc_read_advance(ivc);
+			if (ret < 0)
+				break;
+		}
+		break;
+
+	case TEGRA_IVC_CDEV_IOCTL_TX_COMMIT:
+		for (i = 0; i < fr.count; i++) {
+			ret = tegra_ivc_write_advance(ivc);
+			if (ret < 0)
+				break;
+		}
+		break;
+	}
+
+	mutex_unlock(&ivcd->file_lock);
+
+	/* like read/write, report the frames done before an error */
+	if ((cmd == TEGRA_IVC_CDEV_IOCTL_RX_RELEASE ||
+	     cmd == TEGRA_IVC_CDEV_IOCTL_TX_COMMIT) && i > 0) {
+		fr.count = i;
+		ret = 0;
+	}
+
+	if (ret < 0)
+		return ret;
+
+	if (copy_to_user(arg, &fr, sizeof(fr)))
+		return -EFAULT;
+
+	return 0;
+}
+
+static int ivc_dev_set_eventfd(struct ivc_dev *ivcd, void __user *arg)
+{
+	struct eventfd_ctx *efd = NULL, *old;
+	__s32 fd;
+
+	if (copy_from_user(&fd, arg, sizeof(fd)))
+		return -EFAULT;
+
+	if (fd >= 0) {
+		efd = eventfd_ctx_fdget(fd);
+		if (IS_ERR(efd))
+			return PTR_ERR(efd);
+	}
+
+	mutex_lock(&ivcd->file_lock);
+	old = ivcd->efd;
+	ivcd->efd = efd;
+	mutex_unlock(&ivcd->file_lock);
+
+	if (old)
+		eventfd_ctx_put(old);
+
+	return 0;
+}
+
+static long ivc_dev_ioctl(struct file *filp, unsigned int cmd,
+		unsigned long arg)
+{
+	struct ivc_dev *ivcd = filp->private_data;
+	void __user *uarg = (void __user *)arg;
+
+	BUG_ON(!ivcd);
+
+	/* validate the cmd */
+	if (_IOC_TYPE(cmd) != TEGRA_IVC_CDEV_IOCTL_MAGIC ||
+			_IOC_NR(cmd) > TEGRA_IVC_CDEV_IOCTL_NUMBER_MAX)
+		return -ENOTTY;
+
+	switch (cmd) {
+	case TEGRA_IVC_CDEV_IOCTL_GET_INFO:
+		return ivc_dev_get_info(ivcd, uarg);
+
+	case TEGRA_IVC_CDEV_IOCTL_RX_ACQUIRE:
+	case TEGRA_IVC_CDEV_IOCTL_RX_RELEASE:
+	case TEGRA_IVC_CDEV_IOCTL_TX_ACQUIRE:
+	case TEGRA_IVC_CDEV_IOCTL_TX_COMMIT:
+		return ivc_dev_frames(ivcd, cmd, uarg);
+
+	case TEGRA_IVC_CDEV_IOCTL_SET_EVENTFD:
+		return ivc_dev_set_eventfd(ivcd, uarg);
+
+	default:
+		return -ENOTTY;
+	}
+}
+
 static const struct file_operations ivc_fops = {
 	.owner		= THIS_MODULE,
 	.open		= ivc_dev_open,
@@ -266,6 +451,11 @@ static const struct file_operations ivc_fops = {
 	.read		= ivc_dev_read,
 	.write		= ivc_dev_write,
 	.poll		= ivc_dev_poll,
+	.mmap		= ivc_dev_mmap,
+	.unlocked_ioctl	= ivc_dev_ioctl,
+#ifdef CONFIG_COMPAT
+	.compat_ioctl	= ivc_dev_ioctl,
+#endif
 };
 
 static ssize_t id_show(struct device *dev,
@@ -341,6 +531,51 @@ static uint32_t max_qid;
 static struct ivc_dev *ivc_dev_array;
 static struct class *ivc_class;
 
+/*
+ * Work out where the queue pair lives in physical memory so that it can be
+ * handed to userspace. The mapping is only offered when the pair occupies
+ * whole pages on its own; rounding out to page boundaries would expose
+ * neighbouring queues.
+ */
+static void __init ivc_setup_map(struct ivc_dev *ivc)
+{
+	const struct tegra_hv_queue_data *qd = ivc->qd;
+	int guestid = tegra_hv_get_vmid();
+	uint32_t other, i;
+	phys_addr_t pa = 0;
+	bool rx_first;
+
+	other = qd->peers[0] == guestid ? qd->peers[1] : qd->peers[0];
+
+	for (i = 0; i < info->nr_areas; i++) {
+		const struct ivc_shared_area *area =
+				ivc_shared_area_addr(info, i);
+
+		if (area->guest == other) {
+			pa = area->pa + qd->offset;
+			break;
+		}
+	}
+
+	if (i == info->nr_areas || !PAGE_ALIGNED(pa) ||
+			!PAGE_ALIGNED(qd->size * 2))
+		return;
+
+	/* same rule as tegra_hv uses to lay out the pair */
+	if (qd->peers[0] == qd->peers[1])
+		rx_first = (qd->id & 1) == 0;
+	else
+		rx_first = guestid == qd->peers[0];
+
+	/* frames follow the channel header at the start of each queue */
+	ivc->map_pa = pa;
+	ivc->map_size = qd->size * 2;
+	ivc->rx_offset = rx_first ? 0 : qd->size;
+	ivc->tx_offset = rx_first ? qd->size : 0;
+	ivc->rx_offset += tegra_ivc_total_queue_size(0);
+	ivc->tx_offset += tegra_ivc_total_queue_size(0);
+}
+
 static int __init add_ivc(int i)
 {
 	const struct tegra_hv_queue_data *qd = &ivc_info_queue_array(info)[i];
@@ -350,6 +585,7 @@ static int __init add_ivc(int i)
 	ivc->minor = qd->id;
 	ivc->dev = MKDEV(MAJOR(ivc_dev), qd->id);
 	ivc->qd = qd;
+	ivc_setup_map(ivc);
 
 	cdev_init(&ivc->cdev, &ivc_fops);
 	snprintf(ivc->name, sizeof(ivc->name) - 1, "ivc%d", qd->id);
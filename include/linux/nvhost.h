@@ -47,6 +47,7 @@ struct nvhost_device_profile;
 struct mem_mgr;
 struct nvhost_as_moduleops;
 struct nvhost_ctrl_sync_fence_info;
+struct nvhost_syncpt_pool;
 struct nvhost_sync_timeline;
 struct nvhost_sync_pt;
 enum nvdev_fence_kind;
@@ -519,6 +520,49 @@ static inline void nvhost_syncpt_put_ref_ext(struct platform_device *pdev,
 	host1x_syncpt_free(syncpt);
 }
 
+static inline void nvhost_syncpt_put_refs_ext(struct platform_device *pdev,
+					      const u32 *ids, u32 count)
+{
+	u32 i;
+
+	for (i = 0; i < count; i++)
+		nvhost_syncpt_put_ref_ext(pdev, ids[i]);
+}
+
+static inline int nvhost_get_syncpts_host_managed(
+				struct platform_device *pdev,
+				u32 param, u32 *ids, u32 count)
+{
+	u32 i;
+
+	for (i = 0; i < count; i++) {
+		ids[i] = nvhost_get_syncpt_host_managed(pdev, param + i, NULL);
+		if (!ids[i]) {
+			nvhost_syncpt_put_refs_ext(pdev, ids, i);
+			return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
+static inline struct nvhost_syncpt_pool *nvhost_syncpt_pool_create(
+				struct platform_device *pdev, u32 count)
+{
+	return ERR_PTR(-ENOSYS);
+}
+
+static inline void nvhost_syncpt_pool_destroy(
+				struct nvhost_syncpt_pool *pool)
+{
+}
+
+static inline u32 nvhost_syncpt_pool_get(struct nvhost_syncpt_pool *pool,
+					 u32 param, const char *syncpt_name)
+{
+	return 0;
+}
+
 static inline bool nvhost_syncpt_is_valid_pt_ext(struct platform_device *dev,
 						 u32 id)
 {
@@ -763,8 +807,17 @@ u32 nvhost_get_syncpt_client_managed(struct platform_device *pdev,
 				const char *syncpt_name);
 u32 nvhost_get_syncpt_host_managed(struct platform_device *pdev,
 				   u32 param, const char *syncpt_name);
+int nvhost_get_syncpts_host_managed(struct platform_device *pdev,
+				    u32 param, u32 *ids, u32 count);
+struct nvhost_syncpt_pool *nvhost_syncpt_pool_create(
+				struct platform_device *pdev, u32 count);
+void nvhost_syncpt_pool_destroy(struct nvhost_syncpt_pool *pool);
+u32 nvhost_syncpt_pool_get(struct nvhost_syncpt_pool *pool, u32 param,
+			   const char *syncpt_name);
 void nvhost_syncpt_get_ref_ext(struct platform_device *pdev, u32 id);
 void nvhost_syncpt_put_ref_ext(struct platform_device *pdev, u32 id);
+void nvhost_syncpt_put_refs_ext(struct platform_device *pdev,
+				const u32 *ids, u32 count);
 const char *nvhost_syncpt_get_name(struct platform_device *dev, int id);
 u32 nvhost_syncpt_incr_max_ext(struct platform_device *dev, u32 id, u32 incrs);
 void nvhost_syncpt_cpu_incr_ext(struct platform_device *dev, u32 id);
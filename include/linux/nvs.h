@@ -474,6 +474,23 @@ struct nvs_fn_if {
 	int (*suspend)(void *handle);
 	int (*resume)(void *handle);
 	int (*handler)(void *handle, void *buffer, s64 ts);
+/**
+ * handler_batch - push multiple samples in one call (optional)
+ * @handle: NVS handle from probe
+ * @buffer: n samples, each laid out as for handler
+ * @stride: byte offset between consecutive samples in buffer
+ * @n: number of samples
+ * @ts: n timestamps, ts[i] belonging to sample i
+ *
+ * Returns the number of samples pushed or a negative error code.
+ *
+ * Readers are woken once for the whole batch where the backend allows
+ * it.  Flushes are not supported here and must still go through handler
+ * with ts = 0.  May be NULL in which case handler must be called per
+ * sample.
+ */
+	int (*handler_batch)(void *handle, void *buffer, unsigned int stride,
+			     unsigned int n, s64 *ts);
 };
 
 extern const char * const nvs_float_significances[];
@@ -1,7 +1,7 @@
 /*
  * include/mach/isomgr.h
  *
- * Copyright (c) 2012-2018, NVIDIA CORPORATION.  All rights reserved.
+ * Copyright (c) 2012-2020, NVIDIA CORPORATION.  All rights reserved.
  *
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License version 2 as
@@ -32,6 +32,14 @@
 typedef void (*tegra_isomgr_renegotiate)(void *priv,
 					 u32 avail_bw); /* KB/sec */
 
+/* one client's request in a tegra_isomgr_commit() transaction */
+struct tegra_isomgr_txn_entry {
+	tegra_isomgr_handle handle;
+	u32 bw;			/* KB/sec */
+	u32 lt;			/* usec */
+	u32 lto;		/* out: dvfs thresh usec */
+};
+
 struct isoclient_info {
 	enum tegra_iso_client client;
 	char *name;
@@ -144,6 +152,9 @@ u32 tegra_isomgr_reserve(tegra_isomgr_handle handle,
 /* Realize client reservation - apply settings, rval is dvfs thresh usec */
 u32 tegra_isomgr_realize(tegra_isomgr_handle handle);
 
+/* Reserve and realize several clients atomically, with one EMC update */
+int tegra_isomgr_commit(struct tegra_isomgr_txn_entry *entries, int n);
+
 /* This sets bw aside for the client specified. */
 int tegra_isomgr_set_margin(enum tegra_iso_client client, u32 bw, bool wait);
 
@@ -186,6 +197,16 @@ static inline u32 tegra_isomgr_realize(tegra_isomgr_handle handle)
 	return 1;
 }
 
+static inline int tegra_isomgr_commit(struct tegra_isomgr_txn_entry *entries,
+				      int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		entries[i].lto = 1;
+	return 0;
+}
+
 static inline int tegra_isomgr_set_margin(enum tegra_iso_client client, u32 bw)
 {
 	return 0;
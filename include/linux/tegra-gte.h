@@ -28,6 +28,7 @@ struct tegra_gte_ev_detail {
 	u64 ts_raw; /* raw counter value */
 	u64 ts_ns; /* counter value converted into nano seconds */
 	int dir; /* direction of the event */
+	u32 seq; /* per event sequence number, gaps mean dropped events */
 };
 
 #ifdef CONFIG_TEGRA_HTS_GTE
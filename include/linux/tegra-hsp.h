@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2014-2018, NVIDIA CORPORATION.  All rights reserved.
+ * Copyright (c) 2014-2020, NVIDIA CORPORATION.  All rights reserved.
  *
  * This program is free software; you can redistribute it and/or modify it
  * under the terms and conditions of the GNU General Public License,
@@ -80,6 +80,16 @@ int tegra_hsp_db_add_handler(int master, db_handler_t handler, void *data);
 
 int tegra_hsp_db_del_handler(int master);
 
+/* Call the handler from the IRQ thread, coalescing doorbells */
+#define TEGRA_HSP_DB_F_DEFERRED		(1U << 0)
+
+struct tegra_hsp_db_handler;
+
+struct tegra_hsp_db_handler *tegra_hsp_db_subscribe(int master,
+	db_handler_t handler, void *data, unsigned int flags);
+
+void tegra_hsp_db_unsubscribe(struct tegra_hsp_db_handler *handler);
+
 #define tegra_hsp_find_master(mask, master)	((mask) & (1 << (master)))
 
 struct tegra_hsp_sm_pair;
@@ -0,0 +1,24 @@
+/*
+ * Copyright (c) 2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#ifndef _LINUX_TEGRA_IVC_FRAMES_H
+#define _LINUX_TEGRA_IVC_FRAMES_H
+
+#include <linux/types.h>
+
+struct ivc;
+
+/* Number of frames the peer has written and we have not released yet */
+uint32_t tegra_ivc_rx_frames_available(struct ivc *ivc);
+
+#endif
@@ -1,7 +1,7 @@
 /*
  * Tegra Graphics Virtualization Communication Framework
  *
- * Copyright (c) 2013-2018, NVIDIA Corporation. All rights reserved.
+ * Copyright (c) 2013-2020, NVIDIA Corporation. All rights reserved.
  *
  * This program is free software; you can redistribute it and/or modify it
  * under the terms and conditions of the GNU General Public License,
@@ -23,6 +23,9 @@
 
 #define TEGRA_GR_COMM_ID_SELF (0xFF)
 
+typedef void (*tegra_gr_comm_callback_t)(void *priv, void *data,
+					size_t size);
+
 #ifdef CONFIG_TEGRA_GR_VIRTUALIZATION
 int tegra_gr_comm_init(struct platform_device *pdev, u32 elems,
 		const size_t *queue_sizes, u32 queue_start, u32 num_queues);
@@ -33,11 +36,19 @@ int tegra_gr_comm_recv(u32 index, void **handle, void **data,
 		size_t *size, u32 *sender);
 int tegra_gr_comm_sendrecv(u32 peer, u32 index, void **handle,
 			void **data, size_t *size);
+int tegra_gr_comm_set_tag_offset(u32 index, size_t offset);
+int tegra_gr_comm_sendrecv_tagged(u32 peer, u32 index, void **handle,
+			void **data, size_t *size);
+int tegra_gr_comm_send_async(u32 peer, u32 index, void *data, size_t size,
+			tegra_gr_comm_callback_t callback, void *priv);
+void *tegra_gr_comm_get_buf(u32 index, void **data, size_t *size);
 void tegra_gr_comm_release(void *handle);
 u32 tegra_gr_comm_get_server_vmid(void);
 void *tegra_gr_comm_oob_get_ptr(u32 peer, u32 index,
 				void **ptr, size_t *size);
 void tegra_gr_comm_oob_put_ptr(void *handle);
+void *tegra_gr_comm_oob_claim(u32 peer, u32 index, void **ptr, size_t *size);
+void tegra_gr_comm_oob_unclaim(void *handle);
 #else
 static inline int tegra_gr_comm_init(struct platform_device *pdev,
 				u32 elems,
@@ -71,6 +82,32 @@ static inline int tegra_gr_comm_sendrecv(u32 peer, u32 index,
 	return -ENOSYS;
 }
 
+static inline int tegra_gr_comm_set_tag_offset(u32 index, size_t offset)
+{
+	return -ENOSYS;
+}
+
+static inline int tegra_gr_comm_sendrecv_tagged(u32 peer, u32 index,
+					void **handle, void **data,
+					size_t *size)
+{
+	return -ENOSYS;
+}
+
+static inline int tegra_gr_comm_send_async(u32 peer, u32 index,
+					void *data, size_t size,
+					tegra_gr_comm_callback_t callback,
+					void *priv)
+{
+	return -ENOSYS;
+}
+
+static inline void *tegra_gr_comm_get_buf(u32 index, void **data,
+					size_t *size)
+{
+	return NULL;
+}
+
 static inline void tegra_gr_comm_release(void *handle) {}
 
 static inline u32 tegra_gr_comm_get_server_vmid(void)
@@ -85,6 +122,14 @@ static inline void *tegra_gr_comm_oob_get_ptr(u32 peer,
 }
 
 static inline void tegra_gr_comm_oob_put_ptr(void *handle) {}
+
+static inline void *tegra_gr_comm_oob_claim(u32 peer, u32 index,
+					void **ptr, size_t *size)
+{
+	return NULL;
+}
+
+static inline void tegra_gr_comm_oob_unclaim(void *handle) {}
 #endif
 
 #endif
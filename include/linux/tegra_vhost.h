@@ -1,7 +1,7 @@
 /*
  * Tegra Host Virtualization Interfaces to Server
  *
- * Copyright (c) 2014-2018, NVIDIA Corporation. All rights reserved.
+ * Copyright (c) 2014-2020, NVIDIA Corporation. All rights reserved.
  *
  * This program is free software; you can redistribute it and/or modify it
  * under the terms and conditions of the GNU General Public License,
@@ -64,6 +64,8 @@ enum {
 	TEGRA_VHOST_CMD_RESUME,
 	TEGRA_VHOST_CMD_PROD_APPLY, /* WAR */
 	TEGRA_VHOST_CMD_CIL_SW_RESET, /* WAR */
+	TEGRA_VHOST_CMD_SYNCPT_SHADOW,
+	TEGRA_VHOST_CMD_TAGS,
 };
 
 struct tegra_vhost_connect_params {
@@ -127,6 +129,28 @@ struct tegra_vhost_cil_sw_reset_params {
 	u32 enable;
 };
 
+/*
+ * Ask the server to publish syncpoint values in the CMD queue's mempool,
+ * starting at offset. The server returns the number of syncpoints it will
+ * maintain in num_syncpts.
+ */
+struct tegra_vhost_syncpt_shadow_params {
+	u32 offset;
+	u32 size;
+	u32 num_syncpts;
+};
+
+/*
+ * Layout of the syncpoint shadow. It is written only by the server, which
+ * must update val[id] before delivering any TEGRA_VHOST_EVENT_SYNCPT_INTR
+ * for id and before replying to a SYNCPT_WRITE or SYNCPT_CPU_INCR on it.
+ */
+struct tegra_vhost_syncpt_shadow {
+	u32 num_syncpts;
+	u32 reserved;
+	u32 val[];
+};
+
 struct tegra_vhost_cmd_msg {
 	u32 cmd;
 	int ret;
@@ -143,9 +167,19 @@ struct tegra_vhost_cmd_msg {
 		struct tegra_vhost_channel_regrdwr_params regrdwr;
 		struct tegra_vhost_prod_apply_params prod_apply;
 		struct tegra_vhost_cil_sw_reset_params cil_sw_reset;
+		struct tegra_vhost_syncpt_shadow_params syncpt_shadow;
 	} params;
 };
 
+/*
+ * Once the server has acked TEGRA_VHOST_CMD_TAGS, it echoes the last word
+ * of params, which is padding for every command, in each CMD and PB queue
+ * response. The guest puts a request tag there to match responses out of
+ * order. The message layout is the same whether or not tags are in use.
+ */
+#define TEGRA_VHOST_CMD_TAG_OFFSET \
+	(sizeof(struct tegra_vhost_cmd_msg) - sizeof(u32))
+
 enum {
 	TEGRA_VHOST_EVENT_SYNCPT_INTR = 0,
 	TEGRA_VHOST_EVENT_CHAN_TIMEOUT_INTR,
@@ -85,6 +85,7 @@
 #define DMA_CH_CONTROL1_OFF_WRCH_CCS		BIT(8)
 #define DMA_CH_CONTROL1_OFF_WRCH_CS_MASK	GENMASK(6, 5)
 #define DMA_CH_CONTROL1_OFF_WRCH_CS_SHIFT	5
+#define DMA_CH_CONTROL1_OFF_WRCH_CS_STOPPED	3
 #define DMA_CH_CONTROL1_OFF_WRCH_RIE		BIT(4)
 #define DMA_CH_CONTROL1_OFF_WRCH_LIE		BIT(3)
 #define DMA_CH_CONTROL1_OFF_WRCH_LLP		BIT(2)
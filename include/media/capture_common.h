@@ -49,6 +49,39 @@ struct capture_mapping;
 void put_mapping(
 	struct capture_buffer_table *t, struct capture_mapping *pin);
 
+/* buffer lookup statistics for a buffer table */
+struct capture_buffer_stats {
+	uint64_t hits; /**< lookups served by an existing mapping */
+	uint64_t misses; /**< lookups which had to pin the buffer */
+	uint64_t pin_ns; /**< total time spent in lookups */
+	uint64_t pin_max_ns; /**< slowest lookup */
+	uint32_t cached; /**< mappings currently held by the cache */
+	uint32_t cache_size; /**< cache capacity, 0 if disabled */
+};
+
+/**
+ * @brief Keep up to @a size surface mappings pinned after their last
+ * request completes, so that buffers cycled through a capture queue are
+ * not re-pinned for every request. Least recently used mappings are
+ * released first. A size of 0 disables the cache.
+ *
+ * @param[in,out]	tab	Surface buffer management table
+ * @param[in]		size	Max number of cached mappings
+ */
+void capture_buffer_set_cache_size(
+	struct capture_buffer_table *tab, uint32_t size);
+
+/**
+ * @brief Drop all mappings held by the cache. Mappings still used by a
+ * pending request are released when that request is unpinned.
+ *
+ * @param[in,out]	tab	Surface buffer management table
+ */
+void capture_buffer_flush_cache(struct capture_buffer_table *tab);
+
+void capture_buffer_get_stats(
+	struct capture_buffer_table *tab, struct capture_buffer_stats *stats);
+
 /* buffer details including dma_buf and iova etc. */
 struct capture_common_buf {
 	struct dma_buf *buf;
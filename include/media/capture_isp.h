@@ -1,7 +1,7 @@
 /*
  * Tegra ISP capture operations
  *
- * Copyright (c) 2017-2019, NVIDIA CORPORATION.  All rights reserved.
+ * Copyright (c) 2017-2020, NVIDIA CORPORATION.  All rights reserved.
  *
  * Author: Sudhir Vyas <svyas@nvidia.com>
  *
@@ -25,6 +25,8 @@
 #define __ISP_CAPTURE_ALIGN __aligned(8)
 
 struct tegra_isp_channel;
+struct file;
+struct poll_table_struct;
 
 struct capture_isp_reloc {
 	uint32_t num_relocs;
@@ -94,6 +96,39 @@ struct isp_buffer_req {
 	uint32_t flag;
 } __ISP_CAPTURE_ALIGN;
 
+/** @brief max number of requests submitted by one batch ioctl */
+#define ISP_CAPTURE_MAX_BATCH_REQS	(32U)
+
+/*
+ * Batch of capture and/or program requests. A buffer_index of U32_MAX
+ * skips that half of an entry, so programs can be queued ahead of the
+ * frames that use them.
+ *
+ * The capture half of an entry is submitted before its program half.
+ * num_captures_submitted and num_programs_submitted return how many
+ * leading entries had that half submitted (or skipped). On a failure
+ * the two differ by one if the capture half of the failing entry went
+ * through, and that request will complete like any other.
+ */
+struct isp_capture_req_batch {
+	uint32_t num_reqs;
+	uint32_t num_captures_submitted;
+	uint32_t num_programs_submitted;
+	uint32_t __pad;
+	uint64_t reqs; /* struct isp_capture_req_ex[num_reqs] */
+} __ISP_CAPTURE_ALIGN;
+
+/* Completion events, read() from the channel fd */
+#define ISP_CAPTURE_EVENT_CAPTURE_DONE	(1U)
+#define ISP_CAPTURE_EVENT_PROGRAM_DONE	(2U)
+#define ISP_CAPTURE_EVENT_RESET		(3U)
+
+struct isp_capture_event {
+	uint32_t type;
+	uint32_t buffer_index;
+	uint64_t timestamp; /* CLOCK_MONOTONIC, ns */
+} __ISP_CAPTURE_ALIGN;
+
 int isp_capture_init(struct tegra_isp_channel *chan);
 void isp_capture_shutdown(struct tegra_isp_channel *chan);
 int isp_capture_setup(struct tegra_isp_channel *chan,
@@ -117,4 +152,11 @@ int isp_capture_set_progress_status_notifier(struct tegra_isp_channel *chan,
 		struct isp_capture_progress_status_req *req);
 int isp_capture_buffer_request(
 	struct tegra_isp_channel *chan, struct isp_buffer_req *req);
+int isp_capture_request_batch(struct tegra_isp_channel *chan,
+		struct isp_capture_req_ex *reqs, uint32_t num_reqs,
+		uint32_t *num_captures, uint32_t *num_programs);
+ssize_t isp_capture_read_events(struct tegra_isp_channel *chan,
+		char __user *buf, size_t len, bool nonblock);
+unsigned int isp_capture_poll_events(struct tegra_isp_channel *chan,
+		struct file *file, struct poll_table_struct *table);
 #endif
@@ -3,7 +3,7 @@
  *
  * ISP channel driver header
  *
- * Copyright (c) 2017 NVIDIA Corporation.  All rights reserved.
+ * Copyright (c) 2017-2020 NVIDIA Corporation.  All rights reserved.
  *
  * This program is free software; you can redistribute it and/or modify it
  * under the terms and conditions of the GNU General Public License,
@@ -24,6 +24,7 @@
 #include <linux/of_platform.h>
 
 struct isp_channel_drv;
+struct dentry;
 
 struct isp_channel_drv_ops {
 	int (*alloc_syncpt)(struct platform_device *pdev, const char *name,
@@ -50,6 +51,7 @@ struct tegra_isp_channel {
 	void *priv;
 	struct isp_capture *capture_data;
 	const struct isp_channel_drv_ops *ops;
+	struct dentry *debugfs;
 };
 
 #endif //__ISP_CHANNEL_H__
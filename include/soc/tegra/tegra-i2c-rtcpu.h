@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2017 NVIDIA CORPORATION.  All rights reserved.
+ * Copyright (c) 2017-2020 NVIDIA CORPORATION.  All rights reserved.
  *
  * This program is free software; you can redistribute it and/or modify it
  * under the terms and conditions of the GNU General Public License,
@@ -23,6 +23,9 @@ struct tegra_i2c_rtcpu_config {
 	unsigned int reg_bytes;
 };
 
+/* Completion of a frame-synchronized table, called in softirq context */
+typedef void (*tegra_i2c_rtcpu_table_callback)(int ret, void *param);
+
 /*
  * Sensor registration
  */
@@ -61,6 +64,11 @@ int tegra_i2c_rtcpu_set_frame_id(
 	struct tegra_i2c_rtcpu_sensor *sensor,
 	int frame_id);
 
+/* Frame length of the sensor's current mode, in microseconds */
+int tegra_i2c_rtcpu_set_frame_length(
+	struct tegra_i2c_rtcpu_sensor *sensor,
+	unsigned int frame_length_us);
+
 /* Read one or more bytes from a sensor */
 int tegra_i2c_rtcpu_read_reg8(
 	struct tegra_i2c_rtcpu_sensor *sensor,
@@ -82,13 +90,32 @@ int tegra_i2c_rtcpu_write_table_8(
 	const struct reg_8 override_list[],
 	int num_override_regs, u16 wait_ms_addr, u16 end_addr);
 
+/* Queue a table to be applied by CamRTC at a frame, without waiting.
+ * The table must fit in one request and cannot contain delays: a
+ * wait_ms_addr entry makes it fail with -EINVAL.
+ * frame_distance is the number of frames until frame_id starts. The
+ * callback reports a timeout if no response arrives within that many
+ * frame lengths plus the synchronous transfer timeout, so the frame
+ * length must have been set.
+ */
+int tegra_i2c_rtcpu_write_table_8_frame(
+	struct tegra_i2c_rtcpu_sensor *sensor,
+	const struct reg_8 table[],
+	const struct reg_8 override_list[],
+	int num_override_regs, u16 wait_ms_addr, u16 end_addr,
+	int frame_id, unsigned int frame_distance,
+	tegra_i2c_rtcpu_table_callback callback,
+	void *callback_param);
+
 #else
 
 #define tegra_i2c_rtcpu_aggregate(...) (0)
 #define tegra_i2c_rtcpu_set_frame_id(...) (0)
+#define tegra_i2c_rtcpu_set_frame_length(...) (0)
 #define tegra_i2c_rtcpu_read_reg8(...) (-ENODEV)
 #define tegra_i2c_rtcpu_write_reg8(...) (-ENODEV)
 #define tegra_i2c_rtcpu_write_table_8(...) (-ENODEV)
+#define tegra_i2c_rtcpu_write_table_8_frame(...) (-ENODEV)
 
 #endif
 
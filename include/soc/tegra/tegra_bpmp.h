@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2013-2018, NVIDIA CORPORATION.  All rights reserved.
+ * Copyright (c) 2013-2020, NVIDIA CORPORATION.  All rights reserved.
  *
  * This program is free software; you can redistribute it and/or modify it
  * under the terms and conditions of the GNU General Public License,
@@ -18,15 +18,42 @@
 #define _SOC_TEGRA_TEGRA_BPMP_H
 
 #include <linux/kernel.h>
+#include <linux/completion.h>
 
 typedef void (*bpmp_mrq_handler)(int mrq, void *data, int ch);
 
+/*
+ * An MRQ in flight on a thread channel. The caller fills in mrq, the
+ * buffers and optionally callback/cookie; the remaining fields are owned
+ * by the mail layer until the request completes. The callback runs in
+ * irq context and must not sleep or issue further MRQs. It is the last
+ * use of the request by the mail layer, so it may free a request that
+ * nobody waits for. Such a request has no timeout: its thread channel
+ * stays claimed until BPMP answers.
+ */
+struct tegra_bpmp_async {
+	int mrq;
+	void *ob_data;
+	int ob_sz;
+	void *ib_data;
+	int ib_sz;
+	void (*callback)(struct tegra_bpmp_async *req);
+	void *cookie;
+
+	int result;
+	int ch;
+	struct completion done;
+};
+
 #ifdef CONFIG_NV_TEGRA_BPMP
 int tegra_bpmp_running(void);
 int tegra_bpmp_send_receive_atomic(int mrq, void *ob_data, int ob_sz,
 		void *ib_data, int ib_sz);
 int tegra_bpmp_send_receive(int mrq, void *ob_data, int ob_sz,
 		void *ib_data, int ib_sz);
+int tegra_bpmp_send_async(struct tegra_bpmp_async *req);
+int tegra_bpmp_wait_async(struct tegra_bpmp_async *req);
+int tegra_bpmp_send_receive_batch(struct tegra_bpmp_async *reqs, int n);
 int tegra_bpmp_request_mrq(int mrq, bpmp_mrq_handler handler, void *data);
 int tegra_bpmp_cancel_mrq(int mrq);
 int tegra_bpmp_request_module_mrq(uint32_t module_base,
@@ -50,6 +77,12 @@ static inline int tegra_bpmp_send_receive_atomic(int mrq, void *ob_data,
 		int ob_sz, void *ib_data, int ib_sz) { return -ENODEV; }
 static inline int tegra_bpmp_send_receive(int mrq, void *ob_data, int ob_sz,
 		void *ib_data, int ib_sz) { return -ENODEV; }
+static inline int tegra_bpmp_send_async(struct tegra_bpmp_async *req)
+{ return -ENODEV; }
+static inline int tegra_bpmp_wait_async(struct tegra_bpmp_async *req)
+{ return -ENODEV; }
+static inline int tegra_bpmp_send_receive_batch(struct tegra_bpmp_async *reqs,
+		int n) { return -ENODEV; }
 static inline int tegra_bpmp_request_mrq(int mrq, bpmp_mrq_handler handler,
 		void *data) { return -ENODEV; }
 static inline int tegra_bpmp_cancel_mrq(int mrq) { return -ENODEV; }
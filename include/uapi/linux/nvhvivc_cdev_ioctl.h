@@ -0,0 +1,81 @@
+/*
+ * include/uapi/linux/nvhvivc_cdev_ioctl.h
+ *
+ * Declarations for Tegra Hypervisor ivc character device ioctls
+ *
+ * Copyright (c) 2020 NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This file is licensed under the terms of the GNU General Public License
+ * version 2.  This program is licensed "as is" without any warranty of any
+ * kind, whether express or implied.
+ *
+ */
+#ifndef __UAPI_NVHVIVC_CDEV_IOCTL_H__
+#define __UAPI_NVHVIVC_CDEV_IOCTL_H__
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+/* ivc character device IOCTL magic number */
+#define TEGRA_IVC_CDEV_IOCTL_MAGIC 0xA7
+
+/*
+ * Layout of the queue pair as seen through mmap() of the device node.
+ *
+ * Frame i of the receive ring is at rx_offset + i * frame_size, frame i of
+ * the transmit ring at tx_offset + i * frame_size. map_size is 0 when the
+ * queue pair cannot be mapped without exposing neighbouring queues, in
+ * which case only read()/write() are available.
+ */
+struct tegra_ivc_cdev_info {
+	__u32 frame_size;
+	__u32 nframes;
+	__u64 rx_offset;
+	__u64 tx_offset;
+	__u64 map_size;
+};
+
+/*
+ * Frame range handed between the driver and userspace.
+ *
+ * For the ACQUIRE ioctls count is the maximum number of frames wanted on
+ * input and the number of frames granted on output; index is the ring
+ * index of the first granted frame and the range may wrap around nframes.
+ * For RX_RELEASE and TX_COMMIT count is the number of frames to hand back
+ * on input and the number actually handed back on output, which is less
+ * only if an error stopped the batch part-way; index is ignored.
+ */
+struct tegra_ivc_cdev_frames {
+	__u32 index;
+	__u32 count;
+};
+
+/* IOCTL definitions */
+
+/* query queue geometry and mmap layout */
+#define TEGRA_IVC_CDEV_IOCTL_GET_INFO \
+	_IOR(TEGRA_IVC_CDEV_IOCTL_MAGIC, 1, struct tegra_ivc_cdev_info)
+
+/* get a range of received frames */
+#define TEGRA_IVC_CDEV_IOCTL_RX_ACQUIRE \
+	_IOWR(TEGRA_IVC_CDEV_IOCTL_MAGIC, 2, struct tegra_ivc_cdev_frames)
+
+/* return consumed receive frames to the peer */
+#define TEGRA_IVC_CDEV_IOCTL_RX_RELEASE \
+	_IOWR(TEGRA_IVC_CDEV_IOCTL_MAGIC, 3, struct tegra_ivc_cdev_frames)
+
+/* get a range of free transmit frames */
+#define TEGRA_IVC_CDEV_IOCTL_TX_ACQUIRE \
+	_IOWR(TEGRA_IVC_CDEV_IOCTL_MAGIC, 4, struct tegra_ivc_cdev_frames)
+
+/* publish filled transmit frames to the peer */
+#define TEGRA_IVC_CDEV_IOCTL_TX_COMMIT \
+	_IOWR(TEGRA_IVC_CDEV_IOCTL_MAGIC, 5, struct tegra_ivc_cdev_frames)
+
+/* signal an eventfd on every channel notification, -1 to detach */
+#define TEGRA_IVC_CDEV_IOCTL_SET_EVENTFD \
+	_IOW(TEGRA_IVC_CDEV_IOCTL_MAGIC, 6, __s32)
+
+#define TEGRA_IVC_CDEV_IOCTL_NUMBER_MAX 6
+
+#endif /* __UAPI_NVHVIVC_CDEV_IOCTL_H__ */
@@ -40,15 +40,60 @@ struct tegra_gte_hts_event_req {
 	int fd;
 };
 
+/**
+ * Information about a GPIO event request backed by an mmap'able ring
+ * @global_gpio_pin: global gpio pin number to monitor event
+ * @eventflags: desired flags for the desired GPIO event line, such as
+ * EVENT_RISING_EDGE or EVENT_FALLING_EDGE
+ * @ring_size: number of events the ring holds, power of two up to
+ * TEGRA_GTE_HTS_RING_MAX
+ * @fd: if successful this field will contain a valid anonymous file handle
+ * after a HTS_CREATE_GPIO_EV_RING_IOCTL operation, zero or negative value
+ * means error
+ */
+struct tegra_gte_hts_event_ring_req {
+	__u32 global_gpio_pin;
+	__u32 eventflags;
+	__u32 ring_size;
+	int fd;
+};
+
+#define TEGRA_GTE_HTS_RING_MAX		65536
+
 /**
  * struct hts_event_data - event data
  * @timestamp: hardware timestamp in nanosecond
  * @dir: direction of the event
+ * @seq: per event sequence number, a gap between two consecutive events
+ * means the events in between were dropped
  */
 
 struct tegra_gte_hts_event_data {
 	__u64 timestamp;
 	int dir;
+	__u32 seq;
+};
+
+/**
+ * struct tegra_gte_hts_ring_hdr - head of the mmap'ed event ring
+ * @head: index of the next event the kernel writes, updated with release
+ * semantics after the event is stored
+ * @tail: index of the next event userspace reads, written by userspace
+ * once it is done with the events before it
+ * @size: number of events in the ring
+ * @data_offset: offset of the first struct tegra_gte_hts_event_data from
+ * the start of the mapping
+ * @dropped: events lost because the ring was full
+ *
+ * Indices run freely, the slot of index i is i & (size - 1).
+ */
+struct tegra_gte_hts_ring_hdr {
+	__u32 head;
+	__u32 tail;
+	__u32 size;
+	__u32 data_offset;
+	__u32 dropped;
+	__u32 reserved[3];
 };
 
 /**
@@ -58,4 +103,11 @@ struct tegra_gte_hts_event_data {
 					_IOWR(0xB5, 0x0, \
 					      struct tegra_gte_hts_event_req)
 
+/**
+ * Ring event request IOCTL command, the returned fd can be mmap'ed
+ */
+#define TEGRA_GTE_HTS_CREATE_GPIO_EV_RING_IOCTL \
+					_IOWR(0xB5, 0x1, \
+					      struct tegra_gte_hts_event_ring_req)
+
 #endif
@@ -21,7 +21,7 @@
 #include <linux/types.h>
 
 #define QUADD_SAMPLES_VERSION	49
-#define QUADD_IO_VERSION	28
+#define QUADD_IO_VERSION	29
 
 #define QUADD_IO_VERSION_DYNAMIC_RB		5
 #define QUADD_IO_VERSION_RB_MAX_FILL_COUNT	6
@@ -47,6 +47,7 @@
 #define QUADD_IO_VERSION_EXTABLES_PID		26
 #define QUADD_IO_VERSION_SAMPLING_CNTRL		27
 #define QUADD_IO_VERSION_UNCORE_EVENTS		28
+#define QUADD_IO_VERSION_DWARF_CACHE_STAT	29
 
 #define QUADD_SAMPLE_VERSION_THUMB_MODE_FLAG	17
 #define QUADD_SAMPLE_VERSION_GROUP_SAMPLES	18
@@ -574,6 +575,8 @@ struct quadd_comm_cap_for_cpu {
 enum {
 	QUADD_MOD_STATE_IDX_RB_MAX_FILL_COUNT = 0,
 	QUADD_MOD_STATE_IDX_STATUS,
+	QUADD_MOD_STATE_IDX_DW_CACHE_HIT_RATE,	/* per mille */
+	QUADD_MOD_STATE_IDX_DW_UNWIND_AVG_TIME,	/* ns per sample */
 };
 
 #define QUADD_MOD_STATE_STATUS_IS_ACTIVE	(1 << 0)
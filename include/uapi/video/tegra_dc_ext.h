@@ -1380,6 +1380,20 @@ struct tegra_dc_ext_scanline_info {
 #define TEGRA_DC_EXT_CRC_GET \
 	_IOWR('D', 0x28, struct tegra_dc_ext_crc_arg)
 
+/* Stream every CRC collected on this head to the calling fd. Once enabled,
+ * read() on the fd returns whole struct tegra_dc_ext_crc_record entries in
+ * collection order, and poll() reports POLLIN while records are pending.
+ * CRC collection itself still has to be enabled with TEGRA_DC_EXT_CRC_ENABLE.
+ * The stream stays enabled until the fd is closed.
+ *
+ * Returns
+ * -EINVAL   if arg.ring_size exceeds TEGRA_DC_EXT_CRC_STREAM_MAX_RING_SIZE
+ * -EBUSY    if the stream is already enabled on this fd
+ * -ENOMEM   if the ring could not be allocated
+ */
+#define TEGRA_DC_EXT_CRC_STREAM_ENABLE \
+	_IOW('D', 0x29, struct tegra_dc_ext_crc_stream_arg)
+
 enum tegra_dc_ext_control_output_type {
 	TEGRA_DC_EXT_DSI,
 	TEGRA_DC_EXT_LVDS,
@@ -1667,6 +1681,46 @@ struct tegra_dc_ext_crc_arg {
 	__u8 reserved[32]; /* unused - must be 0 */
 } __attribute__((__packed__));
 
+#define TEGRA_DC_EXT_CRC_STREAM_DEFAULT_RING_SIZE 256
+#define TEGRA_DC_EXT_CRC_STREAM_MAX_RING_SIZE 4096
+
+/*
+ * tegra_dc_ext_crc_stream_arg - The argument to CRC_STREAM_ENABLE IOCTL
+ * @ring_size - Number of records buffered in the kernel, rounded up to a
+ *              power of 2. 0 selects TEGRA_DC_EXT_CRC_STREAM_DEFAULT_RING_SIZE
+ * @reserved  - Easier way to extend the data structure
+ */
+struct tegra_dc_ext_crc_stream_arg {
+	__u32 ring_size;
+	__u8 reserved[28]; /* unused - must be 0 */
+} __attribute__((__packed__));
+
+/*
+ * tegra_dc_ext_crc_record - One CRC collected at a frame end
+ * @seq            - Sequence number of the collected CRC on this head
+ * @flip_id        - ID of the most recent flip contained in the frame, or 0
+ *                   if no flip has been matched yet
+ * @timestamp      - CLOCK_MONOTONIC time of collection, in ns
+ * @dropped        - Number of records dropped just before this one because
+ *                   the ring was full
+ * @valid          - Bitmask of (1 << TEGRA_DC_EXT_CRC_TYPE_*) for the valid
+ *                   rg_crc, or_crc and comp_crc members
+ * @regional_valid - Bitmask of region IDs with a valid regional CRC
+ */
+struct tegra_dc_ext_crc_record {
+	__u64 seq;
+	__u64 flip_id;
+	__u64 timestamp;
+	__u32 dropped;
+	__u32 valid;
+	__u32 rg_crc;
+	__u32 or_crc;
+	__u32 comp_crc;
+	__u32 regional_valid;
+	__u32 regional_crc[TEGRA_DC_EXT_MAX_REGIONS];
+	__u32 reserved;
+};
+
 #define TEGRA_DC_EXT_CONTROL_GET_NUM_OUTPUTS \
 	_IOR('C', 0x00, __u32)
 #define TEGRA_DC_EXT_CONTROL_GET_OUTPUT_PROPERTIES \
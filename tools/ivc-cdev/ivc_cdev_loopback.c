@@ -0,0 +1,742 @@
+/*
+ * ivc_cdev_loopback - loopback test and benchmark for the IVC character
+ * device (drivers/virt/tegra/ivc-cdev.c) on top of the IVC core
+ * (drivers/platform/tegra/tegra-ivc.c), built in userspace against
+ * ivc_shim.h.
+ *
+ * Copyright (c) 2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Example Usage:
+ *	ivc_cdev_loopback			run the loopback tests
+ *	ivc_cdev_loopback -b			compare the data paths
+ *	ivc_cdev_loopback -b -n 100000		same with more frames
+ *
+ * One queue pair is laid out in page aligned memory and published through
+ * a fake hypervisor info page, so ivc_init() sets up the device node and
+ * its mmap layout as it would for a real guest. The device end is driven
+ * through its file operations; the peer end is a second struct ivc over
+ * the same memory, driven directly through the IVC core. Doorbells in
+ * either direction are queued and delivered by pump(), the device end's
+ * through the irq handler it registered.
+ */
+
+#include <getopt.h>
+#include <time.h>
+
+#include "tegra-ivc.c"
+#include "ivc-cdev.c"
+
+int shim_quiet;
+unsigned long shim_copied;
+
+static int failures;
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s:%d: check failed: %s\n", \
+				__func__, __LINE__, #cond); \
+			failures++; \
+			return -1; \
+		} \
+	} while (0)
+
+/*
+ * Queue pair and hypervisor
+ */
+#define LOCAL_VMID	1
+#define PEER_VMID	2
+#define QUEUE_ID	0
+#define NFRAMES		16
+#define FRAME_SIZE	256
+#define QUEUE_SIZE	(2 * PAGE_SIZE)
+
+static char *shm;
+static struct ivc local_ivc, peer_ivc;
+static struct tegra_hv_ivc_cookie cookie = {
+	.irq = 42,
+	.peer_vmid = PEER_VMID,
+	.nframes = NFRAMES,
+	.frame_size = FRAME_SIZE,
+};
+static bool reserved;
+
+static struct {
+	struct ivc_info_page page;
+	struct ivc_shared_area area;
+	struct tegra_hv_queue_data qd;
+} info_page = {
+	.page = { .nr_queues = 1, .nr_areas = 1 },
+	.area = { .guest = PEER_VMID, .size = 2 * QUEUE_SIZE },
+	.qd = {
+		.id = QUEUE_ID,
+		.peers = { LOCAL_VMID, PEER_VMID },
+		.size = QUEUE_SIZE,
+		.nframes = NFRAMES,
+		.frame_size = FRAME_SIZE,
+	},
+};
+
+const struct ivc_info_page *tegra_hv_get_ivc_info(void)
+{
+	return &info_page.page;
+}
+
+int tegra_hv_get_vmid(void)
+{
+	return LOCAL_VMID;
+}
+
+struct tegra_hv_ivc_cookie *tegra_hv_ivc_reserve(struct device_node *dn,
+		int id, const void *ops)
+{
+	if (id != QUEUE_ID)
+		return ERR_PTR(-ENODEV);
+	if (reserved)
+		return ERR_PTR(-EBUSY);
+
+	reserved = true;
+	return &cookie;
+}
+
+int tegra_hv_ivc_unreserve(struct tegra_hv_ivc_cookie *ivck)
+{
+	reserved = false;
+	return 0;
+}
+
+struct ivc *tegra_hv_ivc_convert_cookie(struct tegra_hv_ivc_cookie *ivck)
+{
+	return &local_ivc;
+}
+
+/*
+ * Doorbells. Handling one may ring the other, so they are queued and
+ * delivered by pump() until both ends are quiet.
+ */
+static struct {
+	unsigned long to_peer;
+	unsigned long to_local;
+} bells;
+static bool local_irq_pending, peer_irq_pending;
+static irq_handler_t irq_thread_fn;
+static void *irq_dev_id;
+
+static void local_notify(struct ivc *ivc)
+{
+	bells.to_peer++;
+	peer_irq_pending = true;
+}
+
+static void peer_notify(struct ivc *ivc)
+{
+	bells.to_local++;
+	local_irq_pending = true;
+}
+
+int devm_request_threaded_irq(struct device *dev, unsigned int irq,
+			      irq_handler_t handler, irq_handler_t thread_fn,
+			      unsigned long flags, const char *name,
+			      void *dev_id)
+{
+	if (irq != cookie.irq || irq_thread_fn)
+		return -EINVAL;
+
+	irq_thread_fn = thread_fn;
+	irq_dev_id = dev_id;
+	return 0;
+}
+
+void devm_free_irq(struct device *dev, unsigned int irq, void *dev_id)
+{
+	irq_thread_fn = NULL;
+	irq_dev_id = NULL;
+}
+
+static void pump(void)
+{
+	while (local_irq_pending || peer_irq_pending) {
+		if (local_irq_pending) {
+			local_irq_pending = false;
+			if (irq_thread_fn)
+				irq_thread_fn(cookie.irq, irq_dev_id);
+		}
+		if (peer_irq_pending) {
+			peer_irq_pending = false;
+			tegra_ivc_channel_notified(&peer_ivc);
+		}
+	}
+}
+
+struct eventfd_ctx {
+	int fd;
+	int refs;
+	u64 count;
+};
+
+static struct eventfd_ctx efd = { .fd = 7 };
+
+struct eventfd_ctx *eventfd_ctx_fdget(int fd)
+{
+	if (fd != efd.fd)
+		return ERR_PTR(-EBADF);
+
+	efd.refs++;
+	return &efd;
+}
+
+void eventfd_ctx_put(struct eventfd_ctx *ctx)
+{
+	ctx->refs--;
+}
+
+u64 eventfd_signal(struct eventfd_ctx *ctx, u64 n)
+{
+	ctx->count += n;
+	return n;
+}
+
+static unsigned long mapped_pfn;
+
+int remap_pfn_range(struct vm_area_struct *vma, unsigned long addr,
+		    unsigned long pfn, unsigned long size, pgprot_t prot)
+{
+	mapped_pfn = pfn;
+	return 0;
+}
+
+/*
+ * Device node
+ */
+static struct file filp = { .f_flags = O_NONBLOCK };
+static struct inode inode;
+static char *map;
+static struct tegra_ivc_cdev_info ci;
+
+static long ioc(unsigned int cmd, void *arg)
+{
+	return ivc_fops.unlocked_ioctl(&filp, cmd, (unsigned long)arg);
+}
+
+static int frames_ioc(unsigned int cmd, u32 count, u32 *index)
+{
+	struct tegra_ivc_cdev_frames fr = { .count = count };
+	long ret = ioc(cmd, &fr);
+
+	if (ret < 0)
+		return ret;
+	if (index)
+		*index = fr.index;
+	return fr.count;
+}
+
+static char *rx_frame(u32 i)
+{
+	return map + ci.rx_offset + (i % ci.nframes) * ci.frame_size;
+}
+
+static char *tx_frame(u32 i)
+{
+	return map + ci.tx_offset + (i % ci.nframes) * ci.frame_size;
+}
+
+/* Open the device and bring the channel up, returns 0 or -errno */
+static int open_dev(void)
+{
+	struct vm_area_struct vma = { .vm_start = 0x10000 };
+	int ret;
+
+	ret = ivc_fops.open(&inode, &filp);
+	if (ret)
+		return ret;
+
+	tegra_ivc_channel_reset(&peer_ivc);
+	pump();
+	if (tegra_ivc_channel_notified(&local_ivc) ||
+	    tegra_ivc_channel_notified(&peer_ivc))
+		return -ECONNRESET;
+
+	if (ioc(TEGRA_IVC_CDEV_IOCTL_GET_INFO, &ci))
+		return -EIO;
+
+	vma.vm_end = vma.vm_start + ci.map_size;
+	ret = ivc_fops.mmap(&filp, &vma);
+	if (ret)
+		return ret;
+	map = (char *)(mapped_pfn << PAGE_SHIFT);
+
+	memset(&bells, 0, sizeof(bells));
+	return 0;
+}
+
+static void close_dev(void)
+{
+	ivc_fops.release(&inode, &filp);
+}
+
+static int setup(void)
+{
+	struct ivc_dev *ivcd;
+	int ret;
+
+	shm = aligned_alloc(PAGE_SIZE, 2 * QUEUE_SIZE);
+	if (!shm)
+		return -ENOMEM;
+	memset(shm, 0, 2 * QUEUE_SIZE);
+	info_page.area.pa = (uintptr_t)shm;
+
+	/* the device end receives on the first queue, see ivc_setup_map() */
+	ret = tegra_ivc_init(&local_ivc, (uintptr_t)shm,
+			     (uintptr_t)shm + QUEUE_SIZE, NFRAMES, FRAME_SIZE,
+			     NULL, local_notify);
+	if (!ret)
+		ret = tegra_ivc_init(&peer_ivc, (uintptr_t)shm + QUEUE_SIZE,
+				     (uintptr_t)shm, NFRAMES, FRAME_SIZE,
+				     NULL, peer_notify);
+	if (!ret)
+		ret = ivc_init();
+	if (ret)
+		return ret;
+
+	ivcd = &ivc_dev_array[0];
+	inode.i_cdev = &ivcd->cdev;
+	return 0;
+}
+
+static void fill(char *p, u32 seq)
+{
+	memset(p, seq & 0xff, FRAME_SIZE);
+	memcpy(p, &seq, sizeof(seq));
+}
+
+static bool check_frame(const char *p, u32 seq)
+{
+	u32 got;
+
+	memcpy(&got, p, sizeof(got));
+	return got == seq && (u8)p[FRAME_SIZE - 1] == (seq & 0xff);
+}
+
+/*
+ * Tests
+ */
+
+static int test_layout(void)
+{
+	struct vm_area_struct vma = { .vm_start = 0x10000 };
+
+	CHECK(ci.frame_size == FRAME_SIZE);
+	CHECK(ci.nframes == NFRAMES);
+	CHECK(ci.map_size == 2 * QUEUE_SIZE);
+	CHECK(map == shm);
+	CHECK(rx_frame(0) == (char *)local_ivc.rx_channel +
+	      tegra_ivc_total_queue_size(0));
+	CHECK(tx_frame(0) == (char *)local_ivc.tx_channel +
+	      tegra_ivc_total_queue_size(0));
+
+	/* the pair is mapped whole or not at all */
+	vma.vm_end = vma.vm_start + QUEUE_SIZE;
+	CHECK(ivc_fops.mmap(&filp, &vma) == -EINVAL);
+	vma.vm_end = vma.vm_start + ci.map_size;
+	vma.vm_pgoff = 1;
+	CHECK(ivc_fops.mmap(&filp, &vma) == -EINVAL);
+	return 0;
+}
+
+/* peer to device: frames are read in place and released in one go */
+static int test_rx_batch(void)
+{
+	char buf[FRAME_SIZE];
+	u32 index, i;
+
+	for (i = 0; i < 5; i++) {
+		fill(buf, 100 + i);
+		CHECK(tegra_ivc_write(&peer_ivc, buf, FRAME_SIZE) ==
+		      FRAME_SIZE);
+	}
+	CHECK(bells.to_local == 1);
+	pump();
+
+	CHECK(frames_ioc(TEGRA_IVC_CDEV_IOCTL_RX_ACQUIRE, NFRAMES, &index) ==
+	      5);
+	CHECK(index == local_ivc.r_pos);
+	for (i = 0; i < 5; i++)
+		CHECK(check_frame(rx_frame(index + i), 100 + i));
+
+	/* acquire does not consume */
+	CHECK(frames_ioc(TEGRA_IVC_CDEV_IOCTL_RX_ACQUIRE, 2, NULL) == 2);
+	CHECK(frames_ioc(TEGRA_IVC_CDEV_IOCTL_RX_RELEASE, 5, NULL) == 5);
+	CHECK(frames_ioc(TEGRA_IVC_CDEV_IOCTL_RX_ACQUIRE, NFRAMES, NULL) ==
+	      0);
+	CHECK(tegra_ivc_tx_frames_available(&peer_ivc) == NFRAMES);
+	return 0;
+}
+
+/* device to peer: frames are filled in place and committed in one go */
+static int test_tx_batch(void)
+{
+	char buf[FRAME_SIZE];
+	u32 index, i;
+
+	CHECK(frames_ioc(TEGRA_IVC_CDEV_IOCTL_TX_ACQUIRE, 6, &index) == 6);
+	CHECK(index == local_ivc.w_pos);
+	for (i = 0; i < 6; i++)
+		fill(tx_frame(index + i), 200 + i);
+	CHECK(!tegra_ivc_can_read(&peer_ivc));
+
+	CHECK(frames_ioc(TEGRA_IVC_CDEV_IOCTL_TX_COMMIT, 6, NULL) == 6);
+	CHECK(bells.to_peer == 1);
+	pump();
+
+	for (i = 0; i < 6; i++) {
+		CHECK(tegra_ivc_read(&peer_ivc, buf, FRAME_SIZE) ==
+		      FRAME_SIZE);
+		CHECK(check_frame(buf, 200 + i));
+	}
+	CHECK(!tegra_ivc_can_read(&peer_ivc));
+	return 0;
+}
+
+/* ranges wrap around the end of the ring in both directions */
+static int test_wrap(void)
+{
+	char buf[FRAME_SIZE];
+	u32 start = local_ivc.w_pos, index, seq = 300, n, i, round;
+
+	for (round = 0; round < 3 * NFRAMES; round++) {
+		n = 1 + round % 7;
+
+		CHECK(frames_ioc(TEGRA_IVC_CDEV_IOCTL_TX_ACQUIRE, n, &index) ==
+		      n);
+		for (i = 0; i < n; i++)
+			fill(tx_frame(index + i), seq + i);
+		CHECK(frames_ioc(TEGRA_IVC_CDEV_IOCTL_TX_COMMIT, n, NULL) ==
+		      n);
+		pump();
+
+		/* the peer echoes them back */
+		for (i = 0; i < n; i++) {
+			CHECK(tegra_ivc_read(&peer_ivc, buf, FRAME_SIZE) ==
+			      FRAME_SIZE);
+			CHECK(tegra_ivc_write(&peer_ivc, buf, FRAME_SIZE) ==
+			      FRAME_SIZE);
+		}
+		pump();
+
+		CHECK(frames_ioc(TEGRA_IVC_CDEV_IOCTL_RX_ACQUIRE, NFRAMES,
+				 &index) == n);
+		for (i = 0; i < n; i++)
+			CHECK(check_frame(rx_frame(index + i), seq + i));
+		CHECK(frames_ioc(TEGRA_IVC_CDEV_IOCTL_RX_RELEASE, n, NULL) ==
+		      n);
+		seq += n;
+	}
+
+	CHECK(local_ivc.w_pos == (start + seq - 300) % NFRAMES);
+	return 0;
+}
+
+/* a full ring is handed back with one doorbell, and no more is granted */
+static int test_full(void)
+{
+	char buf[FRAME_SIZE];
+	u32 i;
+
+	CHECK(frames_ioc(TEGRA_IVC_CDEV_IOCTL_TX_ACQUIRE, NFRAMES, NULL) ==
+	      NFRAMES);
+	CHECK(frames_ioc(TEGRA_IVC_CDEV_IOCTL_TX_COMMIT, NFRAMES, NULL) ==
+	      NFRAMES);
+	CHECK(frames_ioc(TEGRA_IVC_CDEV_IOCTL_TX_ACQUIRE, NFRAMES, NULL) ==
+	      0);
+	CHECK(!(ivc_fops.poll(&filp, NULL) & POLLOUT));
+
+	/* committing past what is free stops at a full ring */
+	pump();
+	CHECK(tegra_ivc_read(&peer_ivc, buf, FRAME_SIZE) == FRAME_SIZE);
+	CHECK(frames_ioc(TEGRA_IVC_CDEV_IOCTL_TX_COMMIT, 3, NULL) == 1);
+	CHECK(frames_ioc(TEGRA_IVC_CDEV_IOCTL_TX_COMMIT, 1, NULL) ==
+	      -ENOMEM);
+	for (i = 0; i < NFRAMES; i++)
+		CHECK(tegra_ivc_read(&peer_ivc, buf, FRAME_SIZE) ==
+		      FRAME_SIZE);
+	pump();
+
+	for (i = 0; i < NFRAMES; i++)
+		CHECK(tegra_ivc_write(&peer_ivc, buf, FRAME_SIZE) ==
+		      FRAME_SIZE);
+	pump();
+	memset(&bells, 0, sizeof(bells));
+	CHECK(frames_ioc(TEGRA_IVC_CDEV_IOCTL_RX_RELEASE, NFRAMES, NULL) ==
+	      NFRAMES);
+	CHECK(bells.to_peer == 1);
+	CHECK(frames_ioc(TEGRA_IVC_CDEV_IOCTL_RX_RELEASE, 1, NULL) ==
+	      -ENOMEM);
+
+	CHECK(frames_ioc(TEGRA_IVC_CDEV_IOCTL_RX_ACQUIRE, NFRAMES + 1,
+			 NULL) == -EINVAL);
+	return 0;
+}
+
+static int test_eventfd(void)
+{
+	char buf[FRAME_SIZE] = { 0 };
+	__s32 fd = efd.fd;
+
+	efd.count = 0;
+	CHECK(ioc(TEGRA_IVC_CDEV_IOCTL_SET_EVENTFD, &fd) == 0);
+	CHECK(efd.refs == 1);
+
+	CHECK(tegra_ivc_write(&peer_ivc, buf, FRAME_SIZE) == FRAME_SIZE);
+	CHECK(tegra_ivc_write(&peer_ivc, buf, FRAME_SIZE) == FRAME_SIZE);
+	pump();
+	CHECK(efd.count == 1);
+	CHECK(ivc_fops.poll(&filp, NULL) & POLLIN);
+	CHECK(frames_ioc(TEGRA_IVC_CDEV_IOCTL_RX_RELEASE, 2, NULL) == 2);
+
+	fd = 3;
+	CHECK(ioc(TEGRA_IVC_CDEV_IOCTL_SET_EVENTFD, &fd) == -EBADF);
+	CHECK(efd.refs == 1);
+
+	fd = -1;
+	CHECK(ioc(TEGRA_IVC_CDEV_IOCTL_SET_EVENTFD, &fd) == 0);
+	CHECK(efd.refs == 0);
+	CHECK(tegra_ivc_write(&peer_ivc, buf, FRAME_SIZE) == FRAME_SIZE);
+	pump();
+	CHECK(efd.count == 1);
+	CHECK(frames_ioc(TEGRA_IVC_CDEV_IOCTL_RX_RELEASE, 1, NULL) == 1);
+	return 0;
+}
+
+/* nothing is granted while the peer resets the channel */
+static int test_reset(void)
+{
+	char buf[FRAME_SIZE] = { 0 };
+
+	CHECK(tegra_ivc_write(&peer_ivc, buf, FRAME_SIZE) == FRAME_SIZE);
+	tegra_ivc_channel_reset(&peer_ivc);
+	CHECK(frames_ioc(TEGRA_IVC_CDEV_IOCTL_RX_ACQUIRE, NFRAMES, NULL) ==
+	      1);
+
+	/* the device end sees SYNC and clears its counters */
+	local_irq_pending = true;
+	peer_irq_pending = false;
+	irq_thread_fn(cookie.irq, irq_dev_id);
+	CHECK(frames_ioc(TEGRA_IVC_CDEV_IOCTL_RX_ACQUIRE, NFRAMES, NULL) ==
+	      0);
+	CHECK(frames_ioc(TEGRA_IVC_CDEV_IOCTL_TX_ACQUIRE, NFRAMES, NULL) ==
+	      0);
+
+	pump();
+	CHECK(!tegra_ivc_channel_notified(&local_ivc));
+	CHECK(frames_ioc(TEGRA_IVC_CDEV_IOCTL_TX_ACQUIRE, NFRAMES, NULL) ==
+	      NFRAMES);
+	return 0;
+}
+
+static int test_exclusive(void)
+{
+	struct file other = { .f_flags = O_NONBLOCK };
+
+	CHECK(ivc_fops.open(&inode, &other) == -EBUSY);
+	CHECK(ioc(_IOR(0xA6, 1, int), NULL) == -ENOTTY);
+	return 0;
+}
+
+static int run_tests(void)
+{
+	int ret;
+
+	ret = open_dev();
+	if (ret) {
+		fprintf(stderr, "open failed: %d\n", ret);
+		return 1;
+	}
+
+	ret = test_layout();
+	ret |= test_rx_batch();
+	ret |= test_tx_batch();
+	ret |= test_wrap();
+	ret |= test_full();
+	ret |= test_eventfd();
+	ret |= test_reset();
+	ret |= test_exclusive();
+
+	close_dev();
+
+	if (ret || failures) {
+		printf("FAIL: %d check(s) failed\n", failures);
+		return 1;
+	}
+
+	printf("PASS\n");
+	return 0;
+}
+
+/*
+ * Benchmark: device to peer transfer through write() one frame per call,
+ * write() of whole batches, and the mapped ring with TX_ACQUIRE and
+ * TX_COMMIT. The peer drains the ring after every call.
+ */
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+enum bench_path {
+	PATH_WRITE_FRAME,
+	PATH_WRITE_BATCH,
+	PATH_MMAP,
+};
+
+static const char * const path_name[] = {
+	"write/frame", "write/batch", "mmap",
+};
+
+static int bench_one(enum bench_path path, u32 batch, u32 frames)
+{
+	static char src[NFRAMES * FRAME_SIZE], dst[FRAME_SIZE];
+	unsigned long calls = 0;
+	u32 sent = 0, index = 0, i, n;
+	loff_t pos = 0;
+	double t;
+	long ret;
+
+	memset(&bells, 0, sizeof(bells));
+	shim_copied = 0;
+
+	t = now_ns();
+	while (sent < frames) {
+		n = min(batch, frames - sent);
+
+		switch (path) {
+		case PATH_WRITE_FRAME:
+			for (i = 0; i < n; i++) {
+				fill(src, sent + i);
+				ret = ivc_fops.write(&filp, src, FRAME_SIZE,
+						     &pos);
+				calls++;
+				if (ret != FRAME_SIZE)
+					return -1;
+			}
+			break;
+		case PATH_WRITE_BATCH:
+			for (i = 0; i < n; i++)
+				fill(src + i * FRAME_SIZE, sent + i);
+			ret = ivc_fops.write(&filp, src, n * FRAME_SIZE, &pos);
+			calls++;
+			if (ret != n * FRAME_SIZE)
+				return -1;
+			break;
+		case PATH_MMAP:
+			if (frames_ioc(TEGRA_IVC_CDEV_IOCTL_TX_ACQUIRE, n,
+				       &index) != n)
+				return -1;
+			for (i = 0; i < n; i++)
+				fill(tx_frame(index + i), sent + i);
+			if (frames_ioc(TEGRA_IVC_CDEV_IOCTL_TX_COMMIT, n,
+				       NULL) != n)
+				return -1;
+			calls += 2;
+			break;
+		}
+
+		pump();
+		for (i = 0; i < n; i++) {
+			if (tegra_ivc_read(&peer_ivc, dst, FRAME_SIZE) !=
+			    FRAME_SIZE || !check_frame(dst, sent + i))
+				return -1;
+		}
+		pump();
+		sent += n;
+	}
+	t = (now_ns() - t) / frames;
+
+	printf("%-12s %6u %12.3f %12.3f %12.1f %10.1f\n", path_name[path],
+	       batch, (double)calls / frames, (double)bells.to_peer / frames,
+	       (double)shim_copied / frames, t);
+	return 0;
+}
+
+static int run_bench(u32 frames)
+{
+	static const u32 batches[] = { 1, 4, 16 };
+	enum bench_path path;
+	u32 b;
+
+	if (open_dev()) {
+		fprintf(stderr, "open failed\n");
+		return 1;
+	}
+
+	printf("%-12s %6s %12s %12s %12s %10s\n", "path", "batch",
+	       "calls/frame", "bells/frame", "copied/frame", "ns/frame");
+	for (path = PATH_WRITE_FRAME; path <= PATH_MMAP; path++) {
+		for (b = 0; b < sizeof(batches) / sizeof(batches[0]); b++) {
+			if (path == PATH_WRITE_FRAME && batches[b] > 1)
+				continue;
+			if (bench_one(path, batches[b], frames)) {
+				fprintf(stderr, "%s: transfer failed\n",
+					path_name[path]);
+				return 1;
+			}
+		}
+	}
+
+	close_dev();
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-b [-n frames]]\n"
+		"  -b  run the benchmark instead of the tests\n"
+		"  -n  frames per data path (default 20000)\n",
+		prog);
+}
+
+int main(int argc, char **argv)
+{
+	int c, bench = 0, frames = 20000;
+
+	while ((c = getopt(argc, argv, "bn:h")) != -1) {
+		switch (c) {
+		case 'b':
+			bench = 1;
+			break;
+		case 'n':
+			frames = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return c == 'h' ? 0 : 1;
+		}
+	}
+
+	if (setup()) {
+		fprintf(stderr, "setup failed\n");
+		return 1;
+	}
+
+	if (!bench)
+		return run_tests();
+
+	if (frames <= 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	return run_bench(frames);
+}
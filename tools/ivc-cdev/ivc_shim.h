@@ -0,0 +1,371 @@
+/*
+ * Userspace stand-ins for the kernel facilities used by the IVC core
+ * (drivers/platform/tegra/tegra-ivc.c) and the IVC character device
+ * (drivers/virt/tegra/ivc-cdev.c). Hypervisor, irq, eventfd and mmap
+ * hooks are provided by the test.
+ *
+ * Copyright (c) 2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#ifndef _IVC_SHIM_H
+#define _IVC_SHIM_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <asm/types.h>
+#include <asm/ioctl.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef uint64_t dma_addr_t;
+typedef uint64_t phys_addr_t;
+
+#define __user
+#define __init
+#define __iomem
+#define __packed		__attribute__((packed))
+
+#define EXPORT_SYMBOL(sym)	extern typeof(sym) sym
+#define THIS_MODULE		NULL
+#define module_init(fn) \
+	static int (*shim_module_init)(void) __attribute__((unused)) = fn
+
+#define container_of(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+#define min(a, b)		((a) < (b) ? (a) : (b))
+
+#define BUG()			abort()
+#define BUG_ON(cond)		do { if (cond) abort(); } while (0)
+
+#define MAX_ERRNO	4095
+
+static inline void *ERR_PTR(long error)
+{
+	return (void *)error;
+}
+
+static inline long PTR_ERR(const void *ptr)
+{
+	return (long)ptr;
+}
+
+static inline bool IS_ERR(const void *ptr)
+{
+	return (unsigned long)ptr >= (unsigned long)-MAX_ERRNO;
+}
+
+static inline bool IS_ERR_OR_NULL(const void *ptr)
+{
+	return !ptr || IS_ERR(ptr);
+}
+
+/* set by the test to silence expected errors */
+extern int shim_quiet;
+
+#define pr_err(fmt, ...) \
+	do { \
+		if (!shim_quiet) \
+			fprintf(stderr, fmt, ##__VA_ARGS__); \
+	} while (0)
+#define pr_debug(fmt, ...)	do { } while (0)
+#define dev_err(dev, fmt, ...) \
+	do { (void)(dev); pr_err(fmt, ##__VA_ARGS__); } while (0)
+
+/*
+ * Memory ordering. Both ends of a queue run in this process, but keep
+ * the barriers real so that the accesses stay where the driver put them.
+ */
+#define ACCESS_ONCE(x)		(*(volatile typeof(x) *)&(x))
+#define mb()			__atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define rmb()			__atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define wmb()			__atomic_thread_fence(__ATOMIC_RELEASE)
+
+/*
+ * The queues are plain memory, user copies are plain copies. Bytes copied
+ * are counted so the benchmark can compare the data paths.
+ */
+extern unsigned long shim_copied;
+
+static inline unsigned long copy_to_user(void *to, const void *from,
+					 unsigned long n)
+{
+	memcpy(to, from, n);
+	shim_copied += n;
+	return 0;
+}
+
+static inline unsigned long copy_from_user(void *to, const void *from,
+					   unsigned long n)
+{
+	memcpy(to, from, n);
+	shim_copied += n;
+	return 0;
+}
+
+/* no peer device, the queues are never DMA mapped */
+struct device {
+	const char *name;
+	void *drvdata;
+};
+
+enum dma_data_direction {
+	DMA_BIDIRECTIONAL,
+	DMA_TO_DEVICE,
+	DMA_FROM_DEVICE,
+};
+
+#define DMA_ERROR_CODE		(~(dma_addr_t)0)
+#define dma_map_single(d, p, s, dir)		((void)(s), DMA_ERROR_CODE)
+#define dma_unmap_single(d, h, s, dir)		do { } while (0)
+#define dma_sync_single_for_cpu(d, h, s, dir)	do { } while (0)
+#define dma_sync_single_for_device(d, h, s, dir) do { } while (0)
+
+/*
+ * IVC core, as declared by tegra-ivc.h and tegra-ivc-instance.h, which
+ * are not part of this tree
+ */
+#define IVC_ALIGN		64
+
+struct ivc_channel_header;
+
+struct ivc {
+	struct ivc_channel_header *rx_channel, *tx_channel;
+	uint32_t w_pos, r_pos;
+	void (*notify)(struct ivc *);
+	uint32_t nframes, frame_size;
+	struct device *peer_device;
+	dma_addr_t rx_handle, tx_handle;
+};
+
+int tegra_ivc_init(struct ivc *ivc, uintptr_t rx_base, uintptr_t tx_base,
+		unsigned nframes, unsigned frame_size,
+		struct device *peer_device, void (*notify)(struct ivc *));
+int tegra_ivc_can_read(struct ivc *ivc);
+int tegra_ivc_can_write(struct ivc *ivc);
+uint32_t tegra_ivc_tx_frames_available(struct ivc *ivc);
+int tegra_ivc_read(struct ivc *ivc, void *buf, size_t max_read);
+int tegra_ivc_read_user(struct ivc *ivc, void *buf, size_t max_read);
+int tegra_ivc_read_advance(struct ivc *ivc);
+int tegra_ivc_write(struct ivc *ivc, const void *buf, size_t size);
+int tegra_ivc_write_user(struct ivc *ivc, const void *buf, size_t size);
+int tegra_ivc_write_advance(struct ivc *ivc);
+void tegra_ivc_channel_reset(struct ivc *ivc);
+int tegra_ivc_channel_notified(struct ivc *ivc);
+unsigned tegra_ivc_total_queue_size(unsigned queue_size);
+
+struct tegra_hv_ivc_cookie {
+	int irq;
+	int peer_vmid;
+	int nframes;
+	int frame_size;
+};
+
+struct device_node;
+
+struct tegra_hv_ivc_cookie *tegra_hv_ivc_reserve(struct device_node *dn,
+		int id, const void *ops);
+int tegra_hv_ivc_unreserve(struct tegra_hv_ivc_cookie *ivck);
+struct ivc *tegra_hv_ivc_convert_cookie(struct tegra_hv_ivc_cookie *ivck);
+
+/*
+ * Locks and wait queues. A blocking wait would never return here, the
+ * test only uses O_NONBLOCK files.
+ */
+struct mutex {
+	pthread_mutex_t lock;
+};
+
+#define mutex_init(m)		pthread_mutex_init(&(m)->lock, NULL)
+#define mutex_lock(m)		pthread_mutex_lock(&(m)->lock)
+#define mutex_unlock(m)		pthread_mutex_unlock(&(m)->lock)
+
+typedef struct {
+	unsigned long wakeups;
+} wait_queue_head_t;
+
+#define ERESTARTSYS		512
+#define init_waitqueue_head(wq)	((wq)->wakeups = 0)
+#define wake_up_interruptible_all(wq)	((wq)->wakeups++)
+#define wait_event_interruptible(wq, cond)	((cond) ? 0 : -ERESTARTSYS)
+
+typedef struct {
+	int unused;
+} poll_table;
+
+#define poll_wait(filp, wq, wait)	do { } while (0)
+
+/*
+ * Interrupts and eventfd, routed by the test
+ */
+typedef int irqreturn_t;
+typedef irqreturn_t (*irq_handler_t)(int, void *);
+
+#define IRQ_HANDLED		1
+#define IRQ_WAKE_THREAD		2
+
+int devm_request_threaded_irq(struct device *dev, unsigned int irq,
+			      irq_handler_t handler, irq_handler_t thread_fn,
+			      unsigned long flags, const char *name,
+			      void *dev_id);
+void devm_free_irq(struct device *dev, unsigned int irq, void *dev_id);
+
+struct eventfd_ctx;
+
+struct eventfd_ctx *eventfd_ctx_fdget(int fd);
+void eventfd_ctx_put(struct eventfd_ctx *ctx);
+u64 eventfd_signal(struct eventfd_ctx *ctx, u64 n);
+
+/*
+ * Files and mappings
+ */
+#define PAGE_SHIFT		12
+#define PAGE_SIZE		(1UL << PAGE_SHIFT)
+#define PAGE_ALIGNED(x)		(((x) & (PAGE_SIZE - 1)) == 0)
+
+typedef unsigned long pgprot_t;
+
+struct vm_area_struct {
+	unsigned long vm_start;
+	unsigned long vm_end;
+	unsigned long vm_pgoff;
+	pgprot_t vm_page_prot;
+};
+
+int remap_pfn_range(struct vm_area_struct *vma, unsigned long addr,
+		    unsigned long pfn, unsigned long size, pgprot_t prot);
+
+struct cdev {
+	const struct file_operations *ops;
+};
+
+struct inode {
+	struct cdev *i_cdev;
+};
+
+struct file {
+	void *private_data;
+	unsigned int f_flags;
+};
+
+struct file_operations {
+	void *owner;
+	int (*open)(struct inode *, struct file *);
+	int (*release)(struct inode *, struct file *);
+	loff_t (*llseek)(struct file *, loff_t, int);
+	ssize_t (*read)(struct file *, char *, size_t, loff_t *);
+	ssize_t (*write)(struct file *, const char *, size_t, loff_t *);
+	unsigned int (*poll)(struct file *, poll_table *);
+	int (*mmap)(struct file *, struct vm_area_struct *);
+	long (*unlocked_ioctl)(struct file *, unsigned int, unsigned long);
+	long (*compat_ioctl)(struct file *, unsigned int, unsigned long);
+};
+
+static inline loff_t noop_llseek(struct file *file, loff_t offset,
+				 int whence)
+{
+	return 0;
+}
+
+/*
+ * Character device and sysfs registration, just enough for ivc_init()
+ */
+#define MKDEV(ma, mi)		(((ma) << 20) | (mi))
+#define MAJOR(dev)		((dev) >> 20)
+
+struct attribute {
+	const char *name;
+};
+
+struct device_attribute {
+	struct attribute attr;
+	ssize_t (*show)(struct device *dev, struct device_attribute *attr,
+			char *buf);
+};
+
+#define DEVICE_ATTR_RO(_name) \
+	struct device_attribute dev_attr_##_name = { \
+		.attr = { .name = #_name }, \
+		.show = _name##_show, \
+	}
+
+struct attribute_group {
+	struct attribute **attrs;
+};
+
+#define ATTRIBUTE_GROUPS(_name) \
+	static const struct attribute_group _name##_group = { \
+		.attrs = _name##_attrs, \
+	}; \
+	static const struct attribute_group *_name##_groups[] = { \
+		&_name##_group, NULL, \
+	}
+
+struct class {
+	const struct attribute_group **dev_groups;
+};
+
+#define GFP_KERNEL		0
+#define kcalloc(n, size, flags)	calloc(n, size)
+#define kfree(ptr)		free(ptr)
+
+static inline void cdev_init(struct cdev *cdev,
+			     const struct file_operations *fops)
+{
+	cdev->ops = fops;
+}
+
+#define cdev_add(cdev, dev, count)		0
+#define cdev_del(cdev)				do { } while (0)
+#define alloc_chrdev_region(dev, first, count, name) \
+	(*(dev) = MKDEV(240, 0), 0)
+#define unregister_chrdev_region(dev, count)	do { } while (0)
+
+static inline struct class *class_create(void *owner, const char *name)
+{
+	return calloc(1, sizeof(struct class));
+}
+
+#define class_destroy(cls)			free(cls)
+
+static inline struct device *device_create(struct class *cls,
+					   struct device *parent, dev_t devt,
+					   void *drvdata, const char *fmt, ...)
+{
+	struct device *dev = calloc(1, sizeof(*dev));
+
+	if (!dev)
+		return ERR_PTR(-ENOMEM);
+	dev->name = fmt;
+	dev->drvdata = drvdata;
+	return dev;
+}
+
+#define device_del(dev)				free(dev)
+#define dev_set_drvdata(dev, data)		((dev)->drvdata = (data))
+#define dev_get_drvdata(dev)			((dev)->drvdata)
+#define dev_name(dev)				((dev)->name)
+
+#endif /* _IVC_SHIM_H */
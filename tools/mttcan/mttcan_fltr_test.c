@@ -0,0 +1,654 @@
+/*
+ * mttcan_fltr_test - loopback test and benchmark for the mttcan rx_filter
+ * table (drivers/net/can/mttcan/native/m_ttcan_sys.c), built in userspace
+ * against mttcan_shim.h.
+ *
+ * Copyright (c) 2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Example Usage:
+ *	mttcan_fltr_test			run the loopback tests
+ *	mttcan_fltr_test -s 7			same with another random seed
+ *	mttcan_fltr_test -b -n 1000		benchmark the table compile
+ *
+ * The filters are set up through the sysfs store handlers, which write
+ * the filter elements into a message RAM buffer and the GFC into a
+ * register variable. Frames are then looped back through a model of the
+ * controller's acceptance filtering, which only looks at what was
+ * written there, and the frames that reach the CPU are counted.
+ */
+
+#include <getopt.h>
+#include <time.h>
+
+#include "m_ttcan.h"
+#include "m_ttcan_fltr.c"
+#include "m_ttcan_sys.c"
+
+int shim_quiet;
+int shim_errors;
+
+/*
+ * Controller registers used by m_ttcan_sys.c
+ */
+static u32 gfc_hw, xidam_hw = CAN_EFF_MASK;
+
+int ttcan_set_gfc(struct ttcan_controller *ttcan, u32 regval)
+{
+	gfc_hw = regval;
+	return 0;
+}
+
+u32 ttcan_get_gfc(struct ttcan_controller *ttcan)
+{
+	return gfc_hw;
+}
+
+int ttcan_set_xidam(struct ttcan_controller *ttcan, u32 regval)
+{
+	xidam_hw = regval;
+	return 0;
+}
+
+u32 ttcan_get_xidam(struct ttcan_controller *ttcan)
+{
+	return xidam_hw;
+}
+
+/* registers the filter tests do not touch */
+u32 ttcan_get_cccr(struct ttcan_controller *ttcan) { return 0; }
+u32 ttcan_get_ttmlm(struct ttcan_controller *ttcan) { return 0; }
+u32 ttcan_get_ttocf(struct ttcan_controller *ttcan) { return 0; }
+u32 ttcan_get_ttrmc(struct ttcan_controller *ttcan) { return 0; }
+u32 ttcan_get_tttmc(struct ttcan_controller *ttcan) { return 0; }
+u64 ttcan_get_trigger_mem(struct ttcan_controller *ttcan, int idx) { return 0; }
+u32 ttcan_read_tx_cancelled_reg(struct ttcan_controller *ttcan) { return 0; }
+void ttcan_reset_config_change_enable(struct ttcan_controller *ttcan) { }
+int ttcan_set_config_change_enable(struct ttcan_controller *ttcan) { return 0; }
+void ttcan_set_txbar(struct ttcan_controller *ttcan, u32 value) { }
+void ttcan_set_tttmc(struct ttcan_controller *ttcan, u32 value) { }
+void ttcan_set_tx_cancel_request(struct ttcan_controller *ttcan, u32 txbcr) { }
+void ttcan_set_ref_mesg(struct ttcan_controller *ttcan, u32 id, u32 rmps,
+			u32 xtd) { }
+int ttcan_set_matrix_limits(struct ttcan_controller *ttcan, u32 entt,
+			    u32 txew, u32 css, u32 ccm) { return 0; }
+void ttcan_set_tt_config(struct ttcan_controller *ttcan, u32 evtp, u32 ecc,
+			 u32 egtf, u32 awl, u32 eecs, u32 irto, u32 ldsdl,
+			 u32 tm, u32 gen, u32 om) { }
+int ttcan_set_trigger_mem(struct ttcan_controller *ttcan, void *tmc_shadow,
+			  int trig_index, u16 time_mark, u16 cycle_code,
+			  u8 tmin, u8 tmex, u16 trig_type, u8 filter_type,
+			  u8 mesg_num) { return 0; }
+
+/*
+ * Device set up the way mttcan_hw_init() leaves it
+ */
+#define SIDF_OFF	0x000
+#define XIDF_OFF	0x400
+#define MRAM_BYTES	0x800
+
+static u32 mram[MRAM_BYTES / 4];
+static u8 std_shadow[128 * SIDF_ELEM_SIZE];
+static u8 xtd_shadow[64 * XIDF_ELEM_SIZE];
+static struct ttcan_controller ttcan;
+static struct mttcan_priv priv;
+static struct net_device ndev = { .dev = { .name = "can0" }, .priv = &priv };
+
+static void setup(u32 nstd, u32 nxtd, u32 nrxf0, u32 nrxf1)
+{
+	memset(mram, 0, sizeof(mram));
+	memset(std_shadow, 0, sizeof(std_shadow));
+	memset(xtd_shadow, 0, sizeof(xtd_shadow));
+	memset(&ttcan, 0, sizeof(ttcan));
+	memset(&priv, 0, sizeof(priv));
+
+	ttcan.mram_vbase = (void __iomem *)mram;
+	ttcan.mram_cfg[MRAM_SIDF].off = SIDF_OFF;
+	ttcan.mram_cfg[MRAM_SIDF].num = nstd;
+	ttcan.mram_cfg[MRAM_XIDF].off = XIDF_OFF;
+	ttcan.mram_cfg[MRAM_XIDF].num = nxtd;
+	ttcan.mram_cfg[MRAM_RXF0].num = nrxf0;
+	ttcan.mram_cfg[MRAM_RXF1].num = nrxf1;
+
+	priv.ttcan = &ttcan;
+	priv.std_shadow = std_shadow;
+	priv.xtd_shadow = xtd_shadow;
+
+	/* accept non matching frames into FIFO 0, reject remote frames */
+	priv.gfc_reg = (GFC_ANFS_RXFIFO_0 << MTT_GFC_ANFS_SHIFT) |
+		(GFC_ANFE_RXFIFO_0 << MTT_GFC_ANFE_SHIFT) |
+		(GFC_RRFS_REJECT << MTT_GFC_RRFS_SHIFT) |
+		(GFC_RRFE_REJECT << MTT_GFC_RRFE_SHIFT);
+	gfc_hw = priv.gfc_reg;
+	xidam_hw = CAN_EFF_MASK;
+	ndev.flags = 0;
+}
+
+static int sysfs_write(struct device_attribute *attr, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+/* Returns 0 or the negative error of the store handler */
+static int sysfs_write(struct device_attribute *attr, const char *fmt, ...)
+{
+	char buf[128];
+	va_list ap;
+	ssize_t ret;
+
+	va_start(ap, fmt);
+	vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+
+	shim_quiet = 1;
+	ret = attr->store(&ndev.dev, attr, buf, strlen(buf));
+	shim_quiet = 0;
+
+	return ret < 0 ? (int)ret : 0;
+}
+
+#define rx_filter(fmt, ...) \
+	sysfs_write(&dev_attr_rx_filter, fmt, ##__VA_ARGS__)
+
+/*
+ * Acceptance filtering as done by the controller: filter elements are
+ * evaluated in index order, the first match decides, and frames that
+ * match nothing are handled as the GFC says.
+ */
+static bool hw_accept(u32 id, bool xtd)
+{
+	u32 num = ttcan.mram_cfg[xtd ? MRAM_XIDF : MRAM_SIDF].num;
+	u32 type, fec, id1, id2, anf, i;
+	bool match;
+
+	if (xtd)
+		id &= xidam_hw;
+
+	for (i = 0; i < num; i++) {
+		if (xtd) {
+			u32 f0 = mram[(XIDF_OFF + i * XIDF_ELEM_SIZE) / 4];
+			u32 f1 = mram[(XIDF_OFF + i * XIDF_ELEM_SIZE) / 4 + 1];
+
+			fec = (f0 & MTT_XTD_FLTR_F0_EFEC_MASK) >>
+				MTT_XTD_FLTR_F0_EFEC_SHIFT;
+			id1 = (f0 & MTT_XTD_FLTR_F0_EFID1_MASK) >>
+				MTT_XTD_FLTR_F0_EFID1_SHIFT;
+			type = (f1 & MTT_XTD_FLTR_F1_EFT_MASK) >>
+				MTT_XTD_FLTR_F1_EFT_SHIFT;
+			id2 = (f1 & MTT_XTD_FLTR_F1_EFID2_MASK) >>
+				MTT_XTD_FLTR_F1_EFID2_SHIFT;
+		} else {
+			u32 f = mram[(SIDF_OFF + i * SIDF_ELEM_SIZE) / 4];
+
+			type = (f & MTT_STD_FLTR_SFT_MASK) >>
+				MTT_STD_FLTR_SFT_SHIFT;
+			fec = (f & MTT_STD_FLTR_SFEC_MASK) >>
+				MTT_STD_FLTR_SFEC_SHIFT;
+			id1 = (f & MTT_STD_FLTR_SFID1_MASK) >>
+				MTT_STD_FLTR_SFID1_SHIFT;
+			id2 = (f & MTT_STD_FLTR_SFID2_MASK) >>
+				MTT_STD_FLTR_SFID2_SHIFT;
+		}
+
+		if (!fec)
+			continue;
+
+		switch (type) {
+		case MTTCAN_FLTR_RANGE:
+			match = id1 <= id && id <= id2;
+			break;
+		case MTTCAN_FLTR_DUAL:
+			match = id == id1 || id == id2;
+			break;
+		case MTTCAN_FLTR_CLASSIC:
+			match = (id & id2) == (id1 & id2);
+			break;
+		default:
+			/* std: element disabled, xtd: range without XIDAM */
+			match = xtd && id1 <= id && id <= id2;
+			break;
+		}
+		if (!match)
+			continue;
+
+		/* 3: reject, 4: set priority only and go on */
+		if (fec == 3)
+			return false;
+		if (fec != 4)
+			return true;
+	}
+
+	if (xtd)
+		anf = (gfc_hw & MTT_GFC_ANFE_MASK) >> MTT_GFC_ANFE_SHIFT;
+	else
+		anf = (gfc_hw & MTT_GFC_ANFS_MASK) >> MTT_GFC_ANFS_SHIFT;
+
+	return anf != GFC_ANFS_REJECT && anf != 2;
+}
+
+/* What the CAN_RAW socket filters ask for */
+static bool wanted(u32 id, bool xtd)
+{
+	u32 i;
+
+	for (i = 0; i < priv.rx_fltr_cnt; i++) {
+		struct mttcan_rx_fltr *f = &priv.rx_fltr[i];
+
+		if (f->xtd == xtd && !((id ^ f->id) & f->mask))
+			return true;
+	}
+
+	return false;
+}
+
+static int failures;
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s:%d: check failed: %s\n", \
+				__func__, __LINE__, #cond); \
+			failures++; \
+			return -1; \
+		} \
+	} while (0)
+
+struct loopback_stats {
+	unsigned long sent;
+	unsigned long wanted;
+	unsigned long to_cpu;
+	unsigned long lost;	/* wanted, but not delivered */
+	unsigned long extra;	/* delivered, but not wanted */
+};
+
+static void loopback_one(struct loopback_stats *st, u32 id, bool xtd)
+{
+	bool want = wanted(id, xtd);
+	bool cpu = hw_accept(id, xtd);
+
+	st->sent++;
+	st->wanted += want;
+	st->to_cpu += cpu;
+	st->lost += want && !cpu;
+	st->extra += cpu && !want;
+}
+
+static unsigned int rnd_state = 1;
+
+static u32 rnd(void)
+{
+	/* xorshift32, reproducible across libcs */
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 17;
+	rnd_state ^= rnd_state << 5;
+	return rnd_state;
+}
+
+/*
+ * All standard IDs, the table's own extended IDs and their neighbours,
+ * and nxtd random extended IDs.
+ */
+static void loopback(struct loopback_stats *st, unsigned int nxtd)
+{
+	u32 i, id;
+
+	memset(st, 0, sizeof(*st));
+	for (id = 0; id <= CAN_SFF_MASK; id++)
+		loopback_one(st, id, false);
+	for (i = 0; i < priv.rx_fltr_cnt; i++) {
+		if (!priv.rx_fltr[i].xtd)
+			continue;
+		id = priv.rx_fltr[i].id;
+		loopback_one(st, id, true);
+		loopback_one(st, (id + 1) & CAN_EFF_MASK, true);
+		loopback_one(st, (id - 1) & CAN_EFF_MASK, true);
+	}
+	for (i = 0; i < nxtd; i++)
+		loopback_one(st, rnd() & CAN_EFF_MASK, true);
+}
+
+static const char *show(struct device_attribute *attr)
+{
+	static char page[PAGE_SIZE];
+
+	attr->show(&ndev.dev, attr, page);
+	return page;
+}
+
+/*
+ * Tests
+ */
+
+static int test_exact(void)
+{
+	struct loopback_stats st;
+
+	setup(8, 4, 16, 0);
+	CHECK(rx_filter("add id=123 mask=7FF xtd=0") == 0);
+	CHECK(rx_filter("add id=200 mask=7F0 xtd=0") == 0);
+	CHECK(rx_filter("add id=12345 mask=1FFFFFFF xtd=1") == 0);
+	CHECK(rx_filter("add id=1000000 mask=1FFFFF00 xtd=1") == 0);
+	CHECK(priv.rx_fltr_std == 2 && priv.rx_fltr_xtd == 2);
+	CHECK(strstr(show(&dev_attr_rx_filter), "std: 2 elements (hardware)"));
+
+	/* only the wanted frames reach the CPU */
+	loopback(&st, 100000);
+	CHECK(hw_accept(0x123, false) && hw_accept(0x20F, false));
+	CHECK(!hw_accept(0x210, false) && !hw_accept(0x12346, true));
+	CHECK(st.lost == 0 && st.extra == 0);
+	CHECK(st.to_cpu == st.wanted);
+
+	/* entries of one type do not let frames of the other type through */
+	CHECK(rx_filter("del id=12345 mask=1FFFFFFF xtd=1") == 0);
+	CHECK(rx_filter("del id=1000000 mask=1FFFFF00 xtd=1") == 0);
+	CHECK(priv.rx_fltr_xtd == 0);
+	CHECK(!hw_accept(0x12345, true));
+	CHECK(strstr(show(&dev_attr_rx_filter), "xtd: 0 elements (rejected)"));
+
+	/* and clearing the table accepts everything again */
+	CHECK(rx_filter("clear") == 0);
+	CHECK(gfc_hw == priv.gfc_reg);
+	loopback(&st, 1000);
+	CHECK(st.to_cpu == st.sent);
+
+	CHECK(rx_filter("del id=1 mask=7FF xtd=0") == -ENOENT);
+	ndev.flags = IFF_UP;
+	CHECK(rx_filter("add id=1 mask=7FF xtd=0") == -EBUSY);
+	return 0;
+}
+
+/* entries that do not fit are merged into wider elements */
+static int test_widen(void)
+{
+	struct loopback_stats st;
+	u32 i;
+
+	setup(4, 2, 16, 0);
+	for (i = 0; i < 16; i++)
+		CHECK(rx_filter("add id=%X mask=7FF xtd=0",
+				0x100 + i * 3) == 0);
+	for (i = 0; i < 5; i++)
+		CHECK(rx_filter("add id=%X mask=1FFFFFFF xtd=1",
+				0x18DA00F1 + (i << 8)) == 0);
+	CHECK(priv.rx_fltr_std == 4 && priv.rx_fltr_xtd == 2);
+	CHECK(strstr(show(&dev_attr_rx_filter),
+		     "std: 4 elements (hardware, widened)"));
+
+	/* nothing wanted is lost, and most unwanted frames are still cut */
+	loopback(&st, 100000);
+	CHECK(st.lost == 0);
+	CHECK(st.extra > 0);
+	CHECK(st.to_cpu < st.sent / 10);
+
+	/* covered entries are folded even when there is room */
+	setup(8, 2, 16, 0);
+	CHECK(rx_filter("add id=100 mask=700 xtd=0") == 0);
+	CHECK(rx_filter("add id=123 mask=7FF xtd=0") == 0);
+	CHECK(rx_filter("add id=123 mask=7F0 xtd=0") == 0);
+	CHECK(priv.rx_fltr_std == 1);
+	CHECK(strstr(show(&dev_attr_rx_filter), "std: 1 elements (hardware)"));
+	loopback(&st, 1000);
+	CHECK(st.lost == 0 && st.extra == 0);
+	return 0;
+}
+
+/* std_filter/xtd_filter elements keep their indices and precedence */
+static int test_manual(void)
+{
+	struct loopback_stats st;
+	u8 shadow[sizeof(std_shadow)];
+	u32 ram[2];
+
+	setup(6, 2, 16, 16);
+	CHECK(sysfs_write(&dev_attr_std_filter,
+			  "sft=2 sfec=3 sfid1=123 sfid2=7FF") == 0);
+	CHECK(sysfs_write(&dev_attr_std_filter,
+			  "sft=2 sfec=2 sfid1=400 sfid2=7FF") == 0);
+	memcpy(ram, &mram[SIDF_OFF / 4], sizeof(ram));
+	memcpy(shadow, std_shadow, sizeof(shadow));
+
+	CHECK(rx_filter("add id=100 mask=700 xtd=0") == 0);
+	CHECK(rx_filter("add id=500 mask=7FF xtd=0") == 0);
+	CHECK(!memcmp(ram, &mram[SIDF_OFF / 4], sizeof(ram)));
+
+	/* the manual reject wins, the manual accept still goes through */
+	CHECK(!hw_accept(0x123, false));
+	CHECK(hw_accept(0x124, false));
+	CHECK(hw_accept(0x400, false));
+	CHECK(hw_accept(0x500, false));
+	CHECK(!hw_accept(0x501, false));
+
+	/* manual filters may only grow into the elements left over */
+	CHECK(sysfs_write(&dev_attr_std_filter,
+			  "sft=2 sfec=1 sfid1=600 sfid2=7FF") == 0);
+	CHECK(sysfs_write(&dev_attr_std_filter,
+			  "sft=2 sfec=1 sfid1=601 sfid2=7FF") == 0);
+	CHECK(sysfs_write(&dev_attr_std_filter,
+			  "sft=2 sfec=1 sfid1=602 sfid2=7FF") == -ENOSPC);
+	CHECK(sysfs_write(&dev_attr_std_filter,
+			  "sft=2 sfec=1 sfid1=602 sfid2=7FF idx=4") == -ENOSPC);
+	CHECK(ttcan.fltr_config.std_fltr_size == 4);
+	CHECK(hw_accept(0x500, false));
+
+	/* a later compile keeps clear of them, merging as needed */
+	CHECK(rx_filter("add id=701 mask=7FF xtd=0") == 0);
+	CHECK(priv.rx_fltr_std == 2);
+	CHECK(strstr(show(&dev_attr_rx_filter), "(hardware, widened)"));
+	CHECK(hw_accept(0x600, false) && hw_accept(0x701, false));
+
+	/* clearing the table leaves the manual filters as they were */
+	memcpy(shadow, std_shadow, 4 * SIDF_ELEM_SIZE);
+	CHECK(rx_filter("clear") == 0);
+	CHECK(!memcmp(shadow, std_shadow, 4 * SIDF_ELEM_SIZE));
+	CHECK(!hw_accept(0x123, false));
+	loopback(&st, 1000);
+	CHECK(st.to_cpu == st.sent - 1);
+
+	/* no element left for a type: that type stays with the sockets */
+	setup(2, 2, 16, 0);
+	CHECK(sysfs_write(&dev_attr_std_filter,
+			  "sft=2 sfec=3 sfid1=1 sfid2=7FF") == 0);
+	CHECK(sysfs_write(&dev_attr_std_filter,
+			  "sft=2 sfec=3 sfid1=2 sfid2=7FF") == 0);
+	CHECK(rx_filter("add id=10 mask=7FF xtd=0") == 0);
+	CHECK(rx_filter("add id=10 mask=1FFFFFFF xtd=1") == 0);
+	CHECK(strstr(show(&dev_attr_rx_filter), "std: 0 elements (software)"));
+	CHECK(hw_accept(0x11, false) && !hw_accept(0x11, true));
+	loopback(&st, 1000);
+	CHECK(st.lost == 0);
+	return 0;
+}
+
+/* the table overrides the GFC, it does not snapshot it */
+static int test_gfc(void)
+{
+	u32 user;
+
+	setup(4, 4, 16, 16);
+	CHECK(rx_filter("add id=10 mask=7FF xtd=0") == 0);
+	CHECK(sysfs_write(&dev_attr_gfc_filter,
+			  "anfs=1 anfe=1 rrfs=0 rrfe=1") == 0);
+	user = priv.gfc_reg;
+
+	/* non matching frames stay rejected while the table is set */
+	CHECK(((gfc_hw & MTT_GFC_ANFS_MASK) >> MTT_GFC_ANFS_SHIFT) ==
+	      GFC_ANFS_REJECT);
+	CHECK(!(gfc_hw & MTT_GFC_RRFS_MASK));
+	CHECK(!hw_accept(0x11, false));
+	CHECK(gfc_hw == mttcan_rx_fltr_gfc(&priv));
+
+	/* and the last gfc_filter setting comes back once it is cleared */
+	CHECK(rx_filter("clear") == 0);
+	CHECK(gfc_hw == user);
+	CHECK(mttcan_rx_fltr_gfc(&priv) == user);
+	return 0;
+}
+
+/* random tables, RAM sizes and manual filters: nothing wanted is lost */
+static int test_random(unsigned int seed, int rounds)
+{
+	struct loopback_stats st;
+	u32 nstd, nxtd, i, n, id, mask, xtd, lim;
+	int r;
+
+	rnd_state = seed ? seed : 1;
+	for (r = 0; r < rounds; r++) {
+		nstd = rnd() % 9;
+		nxtd = rnd() % 5;
+		setup(nstd, nxtd, rnd() % 2 ? 16 : 0, 16);
+
+		n = rnd() % 3;
+		for (i = 0; i < n && i < nstd; i++)
+			CHECK(sysfs_write(&dev_attr_std_filter,
+				"sft=2 sfec=%u sfid1=%X sfid2=7FF",
+				rnd() % 2 ? 2 : 3, rnd() & CAN_SFF_MASK) == 0);
+
+		n = 1 + rnd() % MTTCAN_MAX_RX_FLTR;
+		for (i = 0; i < n; i++) {
+			xtd = rnd() % 4 == 0;
+			lim = xtd ? CAN_EFF_MASK : CAN_SFF_MASK;
+			id = rnd() & lim;
+			mask = lim;
+			if (rnd() % 3 == 0)
+				mask &= ~(rnd() & rnd() & lim);
+			CHECK(rx_filter("add id=%X mask=%X xtd=%u",
+					id, mask, xtd) == 0);
+		}
+		CHECK(priv.rx_fltr_std + ttcan.fltr_config.std_fltr_size <=
+		      nstd);
+		CHECK(priv.rx_fltr_xtd + ttcan.fltr_config.xtd_fltr_size <=
+		      nxtd);
+
+		/* manual rejects are not part of what the sockets want */
+		for (i = 0; i < ttcan.fltr_config.std_fltr_size; i++)
+			if ((mram[SIDF_OFF / 4 + i] & MTT_STD_FLTR_SFEC_MASK) >>
+			    MTT_STD_FLTR_SFEC_SHIFT == 3)
+				mram[SIDF_OFF / 4 + i] = 0;
+		loopback(&st, 2000);
+		CHECK(st.lost == 0);
+
+		CHECK(rx_filter("clear") == 0);
+		CHECK(gfc_hw == priv.gfc_reg);
+	}
+
+	return 0;
+}
+
+static int run_tests(unsigned int seed)
+{
+	int ret = 0;
+
+	ret |= test_exact();
+	ret |= test_widen();
+	ret |= test_manual();
+	ret |= test_gfc();
+	ret |= test_random(seed, 300);
+
+	if (ret || failures) {
+		printf("FAIL: %d check(s) failed\n", failures);
+		return 1;
+	}
+
+	printf("PASS\n");
+	return 0;
+}
+
+/*
+ * Benchmark: cost of a table compile and the share of unwanted frames
+ * that still reach the CPU, for a full table and growing filter RAM
+ */
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int run_bench(unsigned int seed, int iters)
+{
+	static const u32 ram[] = { 0, 4, 16, 64, 128 };
+	struct loopback_stats st;
+	double t;
+	u32 i, r;
+	int it;
+
+	printf("%8s %10s %10s %10s %10s\n", "elements", "compile_us",
+	       "to_cpu", "wanted", "extra");
+	for (r = 0; r < sizeof(ram) / sizeof(ram[0]); r++) {
+		setup(ram[r], 0, 16, 0);
+		rnd_state = seed ? seed : 1;
+		for (i = 0; i < MTTCAN_MAX_RX_FLTR; i++)
+			if (rx_filter("add id=%X mask=7FF xtd=0",
+				      rnd() & CAN_SFF_MASK)) {
+				fprintf(stderr, "add failed\n");
+				return 1;
+			}
+
+		shim_quiet = 1;
+		t = now_us();
+		for (it = 0; it < iters; it++)
+			mttcan_rx_fltr_compile(&priv);
+		t = (now_us() - t) / iters;
+		shim_quiet = 0;
+
+		loopback(&st, 0);
+		printf("%8u %10.1f %10lu %10lu %10lu\n", ram[r], t,
+		       st.to_cpu, st.wanted, st.extra);
+		if (st.lost) {
+			fprintf(stderr, "%lu wanted frames lost\n", st.lost);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-s seed] [-b [-n iterations]]\n"
+		"  -s  random seed (default 1)\n"
+		"  -b  run the benchmark instead of the tests\n"
+		"  -n  table compiles per filter RAM size (default 200)\n",
+		prog);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int seed = 1;
+	int c, bench = 0, iters = 200;
+
+	while ((c = getopt(argc, argv, "bn:s:h")) != -1) {
+		switch (c) {
+		case 'b':
+			bench = 1;
+			break;
+		case 'n':
+			iters = atoi(optarg);
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+			return c == 'h' ? 0 : 1;
+		}
+	}
+
+	if (!bench)
+		return run_tests(seed);
+
+	if (iters <= 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	return run_bench(seed, iters);
+}
@@ -0,0 +1,195 @@
+/*
+ * Userspace stand-ins for the kernel facilities used by the mttcan
+ * headers, the sysfs attributes in native/m_ttcan_sys.c and the filter
+ * element helpers in hal/m_ttcan_ram.c.
+ *
+ * Copyright (c) 2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#ifndef _MTTCAN_SHIM_H
+#define _MTTCAN_SHIM_H
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef unsigned long long u64;
+typedef int32_t s32;
+typedef long long s64;
+
+#define __iomem
+#define __init
+#define __aligned(x)		__attribute__((__aligned__(x)))
+
+#define LINUX_VERSION_CODE		KERNEL_VERSION(4, 14, 0)
+#define KERNEL_VERSION(a, b, c)		(((a) << 16) + ((b) << 8) + (c))
+
+#define BIT(nr)			(1UL << (nr))
+#define GENMASK(h, l) \
+	((~0UL << (l)) & (~0UL >> (8 * sizeof(long) - 1 - (h))))
+#define U64_MAX			(~0ULL)
+#define PAGE_SIZE		4096
+#define hweight32(w)		__builtin_popcount(w)
+
+#define container_of(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+#define speculation_barrier()	do { } while (0)
+
+/*
+ * Logging. Errors are counted so that a test can tell an expected
+ * failure from one the driver complained about.
+ */
+extern int shim_quiet;
+extern int shim_errors;
+
+#define shim_log(fmt, ...) \
+	do { \
+		if (!shim_quiet) \
+			fprintf(stderr, fmt, ##__VA_ARGS__); \
+	} while (0)
+
+#define pr_err(fmt, ...) \
+	do { shim_errors++; shim_log(fmt, ##__VA_ARGS__); } while (0)
+#define pr_info(fmt, ...)	shim_log(fmt, ##__VA_ARGS__)
+#define pr_debug(fmt, ...)	do { } while (0)
+#define dev_err(d, fmt, ...)	pr_err(fmt, ##__VA_ARGS__)
+#define dev_warn(d, fmt, ...)	shim_log(fmt, ##__VA_ARGS__)
+#define dev_info(d, fmt, ...)	shim_log(fmt, ##__VA_ARGS__)
+
+static inline int scnprintf(char *buf, size_t size, const char *fmt, ...)
+	__attribute__((format(printf, 3, 4)));
+
+static inline int scnprintf(char *buf, size_t size, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(buf, size, fmt, ap);
+	va_end(ap);
+
+	if (n < 0 || !size)
+		return 0;
+	return (size_t)n < size ? n : (int)size - 1;
+}
+
+/* MMIO, the controller registers and message RAM are plain memory here */
+static inline u32 readl(const volatile void *addr)
+{
+	return *(const volatile u32 *)addr;
+}
+
+static inline void writel(u32 val, volatile void *addr)
+{
+	*(volatile u32 *)addr = val;
+}
+
+/* CAN */
+#define CAN_SFF_MASK		0x000007FFU
+#define CAN_EFF_MASK		0x1FFFFFFFU
+
+static inline u8 can_dlc2len(u8 dlc)
+{
+	static const u8 len[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8,
+				  12, 16, 20, 24, 32, 48, 64 };
+
+	return len[dlc & 0xF];
+}
+
+static inline u8 can_len2dlc(u8 len)
+{
+	u8 dlc = 0;
+
+	while (dlc < 15 && can_dlc2len(dlc) < len)
+		dlc++;
+	return dlc;
+}
+
+/* types embedded in the driver structures, only their size matters */
+typedef struct { int v; } spinlock_t;
+typedef struct { int v; } raw_spinlock_t;
+typedef u64 cycle_t;
+
+struct list_head {
+	struct list_head *next, *prev;
+};
+
+struct can_priv { int state; };
+struct delayed_work { int pending; };
+struct napi_struct { int weight; };
+struct timer_list { unsigned long expires; };
+struct cyclecounter { u64 mask; };
+struct timecounter { u64 nsec; };
+struct hwtstamp_config { int flags; };
+struct mbox_client { void *dev; };
+struct completion { unsigned int done; };
+struct clk;
+struct mbox_chan;
+
+/* devices and sysfs */
+struct device {
+	const char *name;
+};
+
+#define IFF_UP			0x1
+
+struct net_device {
+	struct device dev;
+	unsigned int flags;
+	void *priv;
+};
+
+#define to_net_dev(d)		container_of(d, struct net_device, dev)
+#define netdev_priv(ndev)	((ndev)->priv)
+
+struct attribute {
+	const char *name;
+	unsigned short mode;
+};
+
+struct device_attribute {
+	struct attribute attr;
+	ssize_t (*show)(struct device *dev, struct device_attribute *attr,
+			char *buf);
+	ssize_t (*store)(struct device *dev, struct device_attribute *attr,
+			 const char *buf, size_t count);
+};
+
+struct attribute_group {
+	const char *name;
+	struct attribute **attrs;
+};
+
+#define S_IRUGO			0444
+#define S_IWUSR			0200
+
+#define DEVICE_ATTR(_name, _mode, _show, _store) \
+	struct device_attribute dev_attr_##_name = { \
+		.attr = { .name = #_name, .mode = _mode }, \
+		.show = _show, \
+		.store = _store, \
+	}
+
+#define sysfs_create_group(kobj, grp)	0
+#define sysfs_remove_group(kobj, grp)	do { } while (0)
+
+#endif /* _MTTCAN_SHIM_H */
@@ -0,0 +1,452 @@
+/*
+ * mttcan_tx_test - test and benchmark for the batched TXBAR writes of the
+ * mttcan Tx FIFO/Queue (ttcan_tx_fifo_queue_msg() in
+ * drivers/net/can/mttcan/hal/m_ttcan.c), built in userspace against
+ * mttcan_shim.h.
+ *
+ * Copyright (c) 2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Example Usage:
+ *	mttcan_tx_test			run the tests
+ *	mttcan_tx_test -s 7		same with another random seed
+ *	mttcan_tx_test -b		TXBAR writes per frame by burst size
+ *
+ * The HAL function runs against a model of the controller's Tx FIFO and
+ * Queue: TXFQS and TXBRP are refreshed from the model before each call,
+ * and TXBAR writes are checked the way the controller takes them. The
+ * xmit side mirrors mttcan_start_xmit() and mttcan_tx_flush(), which
+ * are not built here.
+ */
+
+#include <getopt.h>
+#include <time.h>
+
+#include "m_ttcan.h"
+#include "m_ttcan_txq.c"
+
+int shim_quiet;
+int shim_errors;
+
+static int failures;
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s:%d: check failed: %s\n", \
+				__func__, __LINE__, #cond); \
+			failures++; \
+			return -1; \
+		} \
+	} while (0)
+
+/*
+ * Controller model
+ */
+#define TX_BUFS		32
+
+static u32 regs[0x100];
+static struct ttcan_controller ttcan;
+
+static struct {
+	bool queue;
+	u32 base, size;
+	u32 get, put, fill;	/* FIFO mode */
+	u32 txbrp;
+	u32 order[TX_BUFS];	/* FIFO mode: requested buffers, oldest first */
+	u32 buf_id[TX_BUFS];	/* can_id written to each buffer */
+	u32 txbar_writes;
+	bool bad_txbar;
+} hw;
+
+void ttcan_tx_ded_msg_write(struct ttcan_controller *ttcan,
+			    struct ttcanfd_frame *ttcanfd, u8 index)
+{
+	hw.buf_id[index] = ttcanfd->can_id;
+}
+
+/* what ttcan_read32() sees next */
+static void hw_sync(void)
+{
+	u32 txfqs, i;
+
+	if (hw.queue) {
+		for (i = hw.base; i < hw.base + hw.size; i++)
+			if (!(hw.txbrp & BIT(i)))
+				break;
+		txfqs = i < hw.base + hw.size ?
+			i << MTT_TXFQS_TFQPI_SHIFT : MTT_TXFQS_TFQF_MASK;
+	} else {
+		txfqs = (hw.size - hw.fill) << MTT_TXFQS_TFFL_SHIFT;
+		txfqs |= hw.put << MTT_TXFQS_TFQPI_SHIFT;
+		if (hw.fill == hw.size)
+			txfqs |= MTT_TXFQS_TFQF_MASK;
+	}
+
+	regs[ADR_MTTCAN_TXFQS / 4] = txfqs;
+	regs[ADR_MTTCAN_TXBRP / 4] = hw.txbrp;
+}
+
+/*
+ * A FIFO takes a request only for the elements from the put index on,
+ * in order; a Queue for any buffer without a pending request.
+ */
+static void hw_txbar(u32 bits)
+{
+	u32 n = hweight32(bits), i;
+
+	hw.txbar_writes++;
+	if (!bits || (bits & hw.txbrp) ||
+	    (bits & ~(u32)GENMASK(hw.base + hw.size - 1, hw.base))) {
+		hw.bad_txbar = true;
+		return;
+	}
+
+	if (!hw.queue) {
+		if (hw.fill + n > hw.size) {
+			hw.bad_txbar = true;
+			return;
+		}
+		for (i = 0; i < n; i++) {
+			if (!(bits & BIT(hw.put))) {
+				hw.bad_txbar = true;
+				return;
+			}
+			hw.order[(hw.get - hw.base + hw.fill + i) % hw.size] =
+				hw.put;
+			hw.put = hw.base + (hw.put - hw.base + 1) % hw.size;
+		}
+		hw.fill += n;
+	}
+	hw.txbrp |= bits;
+}
+
+/* frames put on the bus, in order */
+static u32 sent_id[4096];
+static u32 nsent;
+
+/* transmit one frame and complete it the way mttcan_tx_complete() does */
+static bool hw_transmit(void)
+{
+	u32 idx;
+
+	if (!hw.txbrp)
+		return false;
+
+	if (hw.queue) {
+		idx = __builtin_ctz(hw.txbrp);
+	} else {
+		idx = hw.order[hw.get - hw.base];
+		hw.get = hw.base + (hw.get - hw.base + 1) % hw.size;
+		hw.fill--;
+	}
+
+	hw.txbrp &= ~BIT(idx);
+	ttcan.tx_object &= ~BIT(idx);
+	sent_id[nsent++ % 4096] = hw.buf_id[idx];
+	return true;
+}
+
+static void setup(bool queue, u32 ded, u32 size)
+{
+	memset(regs, 0, sizeof(regs));
+	memset(&ttcan, 0, sizeof(ttcan));
+	memset(&hw, 0, sizeof(hw));
+
+	ttcan.base = (void __iomem *)regs;
+	ttcan.tx_config.flags = queue;
+	ttcan.tx_config.ded_buff_num = ded;
+	ttcan.tx_config.fifo_q_num = size;
+
+	hw.queue = queue;
+	hw.base = ded;
+	hw.size = size;
+	hw.get = hw.put = ded;
+	nsent = 0;
+}
+
+/*
+ * Driver side, as in mttcan_start_xmit() and mttcan_tx_flush()
+ */
+static u32 tx_bar_pending;
+
+static void tx_flush(void)
+{
+	if (!tx_bar_pending)
+		return;
+
+	hw_txbar(tx_bar_pending);
+	tx_bar_pending = 0;
+}
+
+static int queue_msg(struct ttcanfd_frame *frame, u32 unrequested)
+{
+	hw_sync();
+	return ttcan_tx_fifo_queue_msg(&ttcan, frame, unrequested);
+}
+
+/* Returns 0 or -EBUSY for NETDEV_TX_BUSY */
+static int xmit(u32 id, bool more)
+{
+	struct ttcanfd_frame frame = { .can_id = id };
+	int msg_no;
+
+	msg_no = queue_msg(&frame, tx_bar_pending);
+	if (msg_no < 0 && tx_bar_pending) {
+		tx_flush();
+		msg_no = queue_msg(&frame, 0);
+	}
+
+	if (msg_no < 0) {
+		tx_flush();
+		return -EBUSY;
+	}
+
+	ttcan.tx_object |= BIT(msg_no);
+	tx_bar_pending |= BIT(msg_no);
+	if (!more)
+		tx_flush();
+
+	return 0;
+}
+
+/* send a burst of n frames with ids from id on, as with xmit_more */
+static u32 burst(u32 id, u32 n)
+{
+	u32 i;
+
+	for (i = 0; i < n; i++)
+		if (xmit(id + i, i + 1 < n))
+			break;
+	return i;
+}
+
+/*
+ * Tests
+ */
+
+static int test_fifo_batch(void)
+{
+	u32 i;
+
+	setup(false, 0, 8);
+	CHECK(burst(0x100, 5) == 5);
+	CHECK(hw.txbar_writes == 1);
+	CHECK(!hw.bad_txbar);
+	CHECK(hw.txbrp == 0x1f);
+
+	while (hw_transmit())
+		;
+	CHECK(nsent == 5);
+	for (i = 0; i < 5; i++)
+		CHECK(sent_id[i] == 0x100 + i);
+	CHECK(!ttcan.tx_object);
+	return 0;
+}
+
+/* the batch runs over the end of the FIFO, behind dedicated buffers */
+static int test_fifo_wrap(void)
+{
+	u32 i;
+
+	setup(false, 2, 8);
+	CHECK(burst(0x100, 6) == 6);
+	for (i = 0; i < 6; i++)
+		CHECK(hw_transmit());
+	CHECK(hw.put == 8);
+
+	CHECK(burst(0x200, 5) == 5);
+	CHECK(hw.txbar_writes == 2);
+	CHECK(!hw.bad_txbar);
+	CHECK(hw.put == 5);
+
+	while (hw_transmit())
+		;
+	CHECK(nsent == 11);
+	for (i = 0; i < 5; i++)
+		CHECK(sent_id[6 + i] == 0x200 + i);
+	return 0;
+}
+
+/* frames beyond the free level are requested first, then the FIFO fills */
+static int test_fifo_full(void)
+{
+	setup(false, 0, 8);
+	CHECK(burst(0x100, 3) == 3);
+	CHECK(hw_transmit());
+
+	CHECK(burst(0x200, 10) == 6);
+	CHECK(!hw.bad_txbar);
+	CHECK(hw.fill == 8);
+	CHECK(!tx_bar_pending);
+
+	while (hw_transmit())
+		;
+	CHECK(nsent == 9);
+	CHECK(sent_id[2] == 0x102 && sent_id[3] == 0x200);
+	CHECK(sent_id[8] == 0x205);
+	return 0;
+}
+
+static int test_queue_batch(void)
+{
+	setup(true, 0, 8);
+	CHECK(burst(0x100, 3) == 3);
+	CHECK(hw_transmit());
+	CHECK(burst(0x200, 6) == 6);
+	CHECK(hw.txbar_writes == 2);
+	CHECK(!hw.bad_txbar);
+	CHECK(hw.txbrp == 0xff);
+
+	CHECK(xmit(0x300, false) == -EBUSY);
+	while (hw_transmit())
+		;
+	CHECK(nsent == 9);
+	CHECK(!ttcan.tx_object);
+	return 0;
+}
+
+static unsigned int rnd_state = 1;
+
+static u32 rnd(void)
+{
+	/* xorshift32, reproducible across libcs */
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 17;
+	rnd_state ^= rnd_state << 5;
+	return rnd_state;
+}
+
+/* random bursts against random completions, nothing lost or reordered */
+static int test_random(bool queue, unsigned int seed, int rounds)
+{
+	u32 id = 0, n, sent, i;
+	int r;
+
+	rnd_state = seed ? seed : 1;
+	setup(queue, rnd() % 4, 4 + rnd() % 13);
+
+	for (r = 0; r < rounds; r++) {
+		n = 1 + rnd() % 20;
+		sent = burst(id, n);
+		id += sent;
+		CHECK(!hw.bad_txbar);
+		CHECK(!tx_bar_pending);
+		for (n = rnd() % 12; n && hw_transmit(); n--)
+			;
+	}
+	while (hw_transmit())
+		;
+
+	CHECK(nsent == id);
+	CHECK(!ttcan.tx_object);
+	if (!queue)
+		for (i = 0; i < id && i < 4096; i++)
+			CHECK(sent_id[i] == i);
+	return 0;
+}
+
+static int run_tests(unsigned int seed)
+{
+	int ret = 0;
+	int i;
+
+	ret |= test_fifo_batch();
+	ret |= test_fifo_wrap();
+	ret |= test_fifo_full();
+	ret |= test_queue_batch();
+	for (i = 0; i < 50; i++) {
+		ret |= test_random(false, seed + i, 100);
+		ret |= test_random(true, seed + i, 100);
+	}
+
+	if (ret || failures) {
+		printf("FAIL: %d check(s) failed\n", failures);
+		return 1;
+	}
+
+	printf("PASS\n");
+	return 0;
+}
+
+/*
+ * Benchmark: TXBAR writes per frame when the stack hands over bursts of
+ * a given size, with the bus draining one frame per xmit
+ */
+static int run_bench(int frames)
+{
+	static const u32 bursts[] = { 1, 2, 4, 8, 16 };
+	u32 b, i, id;
+	int mode;
+
+	printf("%6s %6s %12s\n", "mode", "burst", "txbar/frame");
+	for (mode = 0; mode < 2; mode++) {
+		for (b = 0; b < sizeof(bursts) / sizeof(bursts[0]); b++) {
+			setup(mode, 0, 16);
+			for (id = 0; nsent < frames; ) {
+				id += burst(id, bursts[b]);
+				for (i = 0; i < bursts[b]; i++)
+					hw_transmit();
+			}
+			if (hw.bad_txbar) {
+				fprintf(stderr, "bad TXBAR write\n");
+				return 1;
+			}
+			printf("%6s %6u %12.3f\n", mode ? "queue" : "fifo",
+			       bursts[b], (double)hw.txbar_writes / nsent);
+		}
+	}
+
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-s seed] [-b [-n frames]]\n"
+		"  -s  random seed (default 1)\n"
+		"  -b  run the benchmark instead of the tests\n"
+		"  -n  frames per burst size (default 100000)\n",
+		prog);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int seed = 1;
+	int c, bench = 0, frames = 100000;
+
+	while ((c = getopt(argc, argv, "bn:s:h")) != -1) {
+		switch (c) {
+		case 'b':
+			bench = 1;
+			break;
+		case 'n':
+			frames = atoi(optarg);
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+			return c == 'h' ? 0 : 1;
+		}
+	}
+
+	if (!bench)
+		return run_tests(seed);
+
+	if (frames <= 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	return run_bench(frames);
+}
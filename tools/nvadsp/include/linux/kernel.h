@@ -0,0 +1,56 @@
+/*
+ * Minimal userspace stand-ins for the kernel facilities used by the
+ * nvadsp memory manager, so it can be built and tested as plain C.
+ *
+ * Copyright (c) 2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#ifndef _SHIM_LINUX_KERNEL_H
+#define _SHIM_LINUX_KERNEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#define likely(x)	__builtin_expect(!!(x), 1)
+#define unlikely(x)	__builtin_expect(!!(x), 0)
+
+#define container_of(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+#ifndef pr_fmt
+#define pr_fmt(fmt) fmt
+#endif
+
+/* set by the test to silence expected allocation failures */
+extern int shim_quiet;
+
+#define pr_err(fmt, ...) \
+	do { \
+		if (!shim_quiet) \
+			fprintf(stderr, pr_fmt(fmt), ##__VA_ARGS__); \
+	} while (0)
+#define pr_info(fmt, ...)	printf(fmt, ##__VA_ARGS__)
+#define pr_debug(fmt, ...)	do { } while (0)
+
+/* the allocator is exercised from a single thread */
+typedef struct {
+	int locked;
+} spinlock_t;
+
+#define spin_lock_init(l)	((l)->locked = 0)
+#define spin_lock_irqsave(l, flags) \
+	do { (void)(flags); (l)->locked = 1; } while (0)
+#define spin_unlock_irqrestore(l, flags) \
+	do { (void)(flags); (l)->locked = 0; } while (0)
+
+#endif /* _SHIM_LINUX_KERNEL_H */
@@ -0,0 +1,655 @@
+/*
+ * mem_manager_test - unit test and trace replay benchmark for the nvadsp
+ * memory manager (drivers/platform/tegra/nvadsp/mem_manager.c), built in
+ * userspace against the shims in include/linux.
+ *
+ * Copyright (c) 2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Example Usage:
+ *	mem_manager_test			run the unit tests
+ *	mem_manager_test -b -n 1000000		benchmark a generated trace
+ *	mem_manager_test -b -t <trace>		benchmark a recorded trace
+ *
+ * A trace has one operation per line:
+ *	a <id> <size>		allocate <size> bytes as <id>
+ *	f <id>			free the allocation <id>
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "mem_manager.c"
+
+int shim_quiet;
+
+static int failures;
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s:%d: check failed: %s\n", \
+				__func__, __LINE__, #cond); \
+			failures++; \
+			return -1; \
+		} \
+	} while (0)
+
+/*
+ * Invariant checks
+ */
+
+/* Returns the black height of the subtree, -1 if it is not a valid rbtree */
+static int rb_check(const struct rb_node *node, const struct rb_node *parent)
+{
+	int lh, rh;
+
+	if (!node)
+		return 1;
+	if (node->rb_parent != parent)
+		return -1;
+	if (node->rb_color == RB_RED &&
+	    ((node->rb_left && node->rb_left->rb_color == RB_RED) ||
+	     (node->rb_right && node->rb_right->rb_color == RB_RED)))
+		return -1;
+
+	lh = rb_check(node->rb_left, node);
+	rh = rb_check(node->rb_right, node);
+	if (lh < 0 || rh < 0 || lh != rh)
+		return -1;
+
+	return lh + (node->rb_color == RB_BLACK);
+}
+
+static int rb_valid(const struct rb_root *root)
+{
+	if (root->rb_node && root->rb_node->rb_color != RB_BLACK)
+		return 0;
+	return rb_check(root->rb_node, NULL) > 0;
+}
+
+static int check_invariants(struct mem_manager_info *mm)
+{
+	unsigned long end = mm->start_address + mm->size;
+	unsigned long covered = 0, prev_end = 0;
+	struct rb_node *fn, *an, *sn;
+	struct mem_chunk *fc, *ac, *sc, *prev = NULL;
+	unsigned int nr_free = 0, nr_size = 0;
+
+	CHECK(rb_valid(&mm->alloc_root));
+	CHECK(rb_valid(&mm->free_root));
+	CHECK(rb_valid(&mm->free_size_root));
+
+	/* free chunks: in range, ordered, never adjacent (coalesced) */
+	for (fn = rb_first(&mm->free_root); fn; fn = rb_next(fn)) {
+		fc = rb_entry(fn, struct mem_chunk, addr_node);
+		CHECK(fc->size > 0);
+		CHECK(fc->address >= mm->start_address);
+		CHECK(fc->address + fc->size <= end);
+		if (prev)
+			CHECK(prev->address + prev->size < fc->address);
+		prev = fc;
+		nr_free++;
+	}
+
+	/* size index: same chunks, ordered by (size, address) */
+	prev = NULL;
+	for (sn = rb_first(&mm->free_size_root); sn; sn = rb_next(sn)) {
+		sc = rb_entry(sn, struct mem_chunk, size_node);
+		CHECK(chunk_addr_find(&mm->free_root, sc->address) == sc);
+		if (prev)
+			CHECK(prev->size < sc->size ||
+			      (prev->size == sc->size &&
+			       prev->address < sc->address));
+		prev = sc;
+		nr_size++;
+	}
+	CHECK(nr_size == nr_free);
+
+	/* free and allocated chunks tile the region without overlap */
+	fn = rb_first(&mm->free_root);
+	an = rb_first(&mm->alloc_root);
+	prev_end = mm->start_address;
+	while (fn || an) {
+		fc = fn ? rb_entry(fn, struct mem_chunk, addr_node) : NULL;
+		ac = an ? rb_entry(an, struct mem_chunk, addr_node) : NULL;
+
+		if (fc && (!ac || fc->address < ac->address)) {
+			CHECK(fc->address == prev_end);
+			prev_end += fc->size;
+			covered += fc->size;
+			fn = rb_next(fn);
+		} else {
+			CHECK(ac->size > 0);
+			CHECK(ac->address == prev_end);
+			prev_end += ac->size;
+			covered += ac->size;
+			an = rb_next(an);
+		}
+	}
+	CHECK(covered == mm->size);
+
+	return 0;
+}
+
+/* Reference best fit: scan all free chunks in address order */
+static long expected_fit(struct mem_manager_info *mm, size_t size)
+{
+	struct rb_node *node;
+	struct mem_chunk *mc, *best = NULL;
+
+	for (node = rb_first(&mm->free_root); node; node = rb_next(node)) {
+		mc = rb_entry(node, struct mem_chunk, addr_node);
+		if (mc->size >= size && (!best || mc->size < best->size))
+			best = mc;
+	}
+
+	return best ? (long)best->address : -1;
+}
+
+static void *checked_request(struct mem_manager_info *mm, size_t size)
+{
+	long expect = expected_fit(mm, size);
+	void *handle = mem_request(mm, "test", size);
+
+	if (expect < 0) {
+		if (!IS_ERR(handle)) {
+			fprintf(stderr, "request of %zu should fail\n", size);
+			failures++;
+		}
+		return handle;
+	}
+
+	if (IS_ERR(handle) ||
+	    mem_get_address(handle) != (unsigned long)expect) {
+		fprintf(stderr, "request of %zu: expected %#lx, got %s%#lx\n",
+			size, expect, IS_ERR(handle) ? "error " : "",
+			IS_ERR(handle) ? (unsigned long)-PTR_ERR(handle) :
+			mem_get_address(handle));
+		failures++;
+	}
+
+	return handle;
+}
+
+/*
+ * Unit tests
+ */
+
+#define TEST_BASE	0x80300000UL
+#define TEST_SIZE	SZ_1M
+
+static int test_fill_and_drain(void)
+{
+	struct mem_manager_info *mm;
+	void *h[16];
+	int i;
+
+	mm = create_mem_manager("fill", TEST_BASE, TEST_SIZE);
+	CHECK(!IS_ERR(mm));
+
+	for (i = 0; i < 16; i++) {
+		h[i] = checked_request(mm, TEST_SIZE / 16);
+		CHECK(!IS_ERR(h[i]));
+		CHECK(mem_get_address(h[i]) ==
+		      TEST_BASE + i * TEST_SIZE / 16);
+	}
+	CHECK(RB_EMPTY_ROOT(&mm->free_root));
+	CHECK(check_invariants(mm) == 0);
+
+	shim_quiet = 1;
+	CHECK(IS_ERR(mem_request(mm, "full", 1)));
+	shim_quiet = 0;
+
+	/* release out of order, everything coalesces back into one chunk */
+	for (i = 0; i < 16; i += 2)
+		CHECK(mem_release(mm, h[i]));
+	CHECK(check_invariants(mm) == 0);
+	for (i = 1; i < 16; i += 2)
+		CHECK(mem_release(mm, h[i]));
+	CHECK(check_invariants(mm) == 0);
+
+	CHECK(RB_EMPTY_ROOT(&mm->alloc_root));
+	CHECK(rb_first(&mm->free_root) == rb_last(&mm->free_root));
+
+	destroy_mem_manager(mm);
+	return 0;
+}
+
+static int test_best_fit(void)
+{
+	struct mem_manager_info *mm;
+	void *h[8], *fit;
+
+	mm = create_mem_manager("fit", TEST_BASE, TEST_SIZE);
+	CHECK(!IS_ERR(mm));
+
+	/* holes of 4K, 1K and 2K separated by allocated chunks */
+	h[0] = checked_request(mm, SZ_1K * 4);
+	h[1] = checked_request(mm, SZ_1K);
+	h[2] = checked_request(mm, SZ_1K);
+	h[3] = checked_request(mm, SZ_1K);
+	h[4] = checked_request(mm, SZ_1K * 2);
+	h[5] = checked_request(mm, SZ_1K);
+	CHECK(mem_release(mm, h[0]));
+	CHECK(mem_release(mm, h[2]));
+	CHECK(mem_release(mm, h[4]));
+	CHECK(check_invariants(mm) == 0);
+
+	/* smallest hole that fits wins, exact fit takes the whole chunk */
+	fit = checked_request(mm, SZ_1K);
+	CHECK(!IS_ERR(fit));
+	CHECK(mem_get_address(fit) == TEST_BASE + SZ_1K * 5);
+	CHECK(check_invariants(mm) == 0);
+
+	h[6] = checked_request(mm, SZ_1K + 1);
+	CHECK(!IS_ERR(h[6]));
+	CHECK(mem_get_address(h[6]) == TEST_BASE + SZ_1K * 7);
+	CHECK(check_invariants(mm) == 0);
+
+	h[7] = checked_request(mm, SZ_1K * 3);
+	CHECK(!IS_ERR(h[7]));
+	CHECK(mem_get_address(h[7]) == TEST_BASE);
+	CHECK(check_invariants(mm) == 0);
+
+	destroy_mem_manager(mm);
+	return 0;
+}
+
+static int test_coalesce(void)
+{
+	struct mem_manager_info *mm;
+	void *a, *b, *c, *d;
+
+	mm = create_mem_manager("merge", TEST_BASE, TEST_SIZE);
+	CHECK(!IS_ERR(mm));
+
+	a = checked_request(mm, SZ_1K);
+	b = checked_request(mm, SZ_1K);
+	c = checked_request(mm, SZ_1K);
+	d = checked_request(mm, SZ_1K);
+
+	/* merge with the previous free chunk only */
+	CHECK(mem_release(mm, a));
+	CHECK(mem_release(mm, b));
+	CHECK(check_invariants(mm) == 0);
+
+	/* merge with the next free chunk only */
+	CHECK(mem_release(mm, d));
+	CHECK(check_invariants(mm) == 0);
+
+	/* merge with both neighbours */
+	CHECK(mem_release(mm, c));
+	CHECK(check_invariants(mm) == 0);
+	CHECK(rb_first(&mm->free_root) == rb_last(&mm->free_root));
+
+	destroy_mem_manager(mm);
+	return 0;
+}
+
+static int test_release_unknown(void)
+{
+	struct mem_manager_info *mm;
+	struct mem_chunk bogus = { .address = TEST_BASE, .size = SZ_1K };
+	void *a;
+
+	mm = create_mem_manager("bogus", TEST_BASE, TEST_SIZE);
+	CHECK(!IS_ERR(mm));
+
+	/* not allocated at all */
+	CHECK(!mem_release(mm, &bogus));
+
+	/* same address as a live allocation, but a different handle */
+	a = checked_request(mm, SZ_1K);
+	CHECK(!mem_release(mm, &bogus));
+	CHECK(check_invariants(mm) == 0);
+	CHECK(mem_release(mm, a));
+
+	destroy_mem_manager(mm);
+	return 0;
+}
+
+static int test_zero_size(void)
+{
+	struct mem_manager_info *mm;
+	void *a, *z;
+
+	mm = create_mem_manager("zero", TEST_BASE, TEST_SIZE);
+	CHECK(!IS_ERR(mm));
+
+	/* rejected whether or not memory is left, nothing is changed */
+	shim_quiet = 1;
+	z = mem_request(mm, "zero", 0);
+	shim_quiet = 0;
+	CHECK(IS_ERR(z) && PTR_ERR(z) == -EINVAL);
+	CHECK(RB_EMPTY_ROOT(&mm->alloc_root));
+	CHECK(check_invariants(mm) == 0);
+
+	a = checked_request(mm, TEST_SIZE);
+	CHECK(!IS_ERR(a));
+	shim_quiet = 1;
+	z = mem_request(mm, "zero", 0);
+	shim_quiet = 0;
+	CHECK(IS_ERR(z) && PTR_ERR(z) == -EINVAL);
+	CHECK(check_invariants(mm) == 0);
+	CHECK(mem_release(mm, a));
+
+	destroy_mem_manager(mm);
+	return 0;
+}
+
+static size_t random_size(void)
+{
+	/* mostly small, some app sized allocations */
+	switch (rand() % 8) {
+	case 0:
+		return 1 + rand() % SZ_64K;
+	case 1:
+	case 2:
+		return (1 + rand() % 16) * SZ_1K;
+	default:
+		return 1 + rand() % 512;
+	}
+}
+
+static int test_random(unsigned int seed, int ops)
+{
+	struct mem_manager_info *mm;
+	void *live[512] = { NULL };
+	int i, slot, failed = failures;
+
+	srand(seed);
+
+	mm = create_mem_manager("random", TEST_BASE, TEST_SIZE);
+	CHECK(!IS_ERR(mm));
+
+	shim_quiet = 1;
+	for (i = 0; i < ops; i++) {
+		slot = rand() % 512;
+
+		if (live[slot]) {
+			CHECK(mem_release(mm, live[slot]));
+			live[slot] = NULL;
+		} else {
+			live[slot] = checked_request(mm, random_size());
+			if (IS_ERR(live[slot]))
+				live[slot] = NULL;
+		}
+
+		if (failures != failed || check_invariants(mm)) {
+			fprintf(stderr, "seed %u, op %d\n", seed, i);
+			shim_quiet = 0;
+			return -1;
+		}
+	}
+	shim_quiet = 0;
+
+	destroy_mem_manager(mm);
+	return 0;
+}
+
+static int run_tests(unsigned int seed)
+{
+	int ret = 0;
+
+	ret |= test_fill_and_drain();
+	ret |= test_best_fit();
+	ret |= test_coalesce();
+	ret |= test_release_unknown();
+	ret |= test_zero_size();
+	ret |= test_random(seed, 20000);
+
+	if (ret || failures) {
+		printf("FAIL: %d check(s) failed\n", failures);
+		return 1;
+	}
+
+	printf("PASS\n");
+	return 0;
+}
+
+/*
+ * Trace replay benchmark
+ */
+
+struct trace_op {
+	char type;
+	unsigned int id;
+	size_t size;
+};
+
+static struct trace_op *load_trace(const char *path, int *nr_ops,
+				   unsigned int *max_id)
+{
+	struct trace_op *ops = NULL;
+	int nr = 0, cap = 0;
+	char line[128];
+	FILE *fp;
+
+	fp = fopen(path, "r");
+	if (!fp) {
+		perror(path);
+		return NULL;
+	}
+
+	*max_id = 0;
+	while (fgets(line, sizeof(line), fp)) {
+		struct trace_op op = { 0 };
+		char type;
+
+		if (sscanf(line, " %c", &type) != 1 || type == '#')
+			continue;
+
+		if (type == 'a' &&
+		    sscanf(line, " a %u %zu", &op.id, &op.size) == 2)
+			op.type = 'a';
+		else if (type == 'f' && sscanf(line, " f %u", &op.id) == 1)
+			op.type = 'f';
+		else {
+			fprintf(stderr, "%s: bad line: %s", path, line);
+			continue;
+		}
+
+		if (nr == cap) {
+			cap = cap ? cap * 2 : 1024;
+			ops = realloc(ops, cap * sizeof(*ops));
+			if (!ops) {
+				fclose(fp);
+				return NULL;
+			}
+		}
+		if (op.id > *max_id)
+			*max_id = op.id;
+		ops[nr++] = op;
+	}
+
+	fclose(fp);
+	*nr_ops = nr;
+	return ops;
+}
+
+/* Steady state of <live> allocations with random frees and reallocations */
+static struct trace_op *gen_trace(int nr_ops, unsigned int live,
+				  unsigned int seed, unsigned int *max_id)
+{
+	struct trace_op *ops;
+	unsigned int *ids, next_id = 0, slot;
+	int i = 0;
+
+	ops = calloc(nr_ops, sizeof(*ops));
+	ids = calloc(live, sizeof(*ids));
+	if (!ops || !ids) {
+		free(ops);
+		free(ids);
+		return NULL;
+	}
+
+	srand(seed);
+
+	for (slot = 0; slot < live && i < nr_ops; slot++, i++) {
+		ids[slot] = next_id++;
+		ops[i] = (struct trace_op){ 'a', ids[slot], random_size() };
+	}
+
+	while (i + 1 < nr_ops) {
+		slot = rand() % live;
+		ops[i++] = (struct trace_op){ 'f', ids[slot], 0 };
+		ids[slot] = next_id++;
+		ops[i++] = (struct trace_op){ 'a', ids[slot], random_size() };
+	}
+
+	free(ids);
+	*max_id = next_id;
+	return ops;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int run_bench(const struct trace_op *ops, int nr_ops,
+		     unsigned int max_id, unsigned long size)
+{
+	struct mem_manager_info *mm;
+	struct rb_node *node;
+	void **handles;
+	unsigned int nr_free, max_free = 0;
+	uint64_t t_alloc = 0, t_free = 0, t;
+	int i, nr_alloc = 0, nr_rel = 0, nr_fail = 0;
+
+	handles = calloc(max_id + 1, sizeof(*handles));
+	mm = create_mem_manager("bench", TEST_BASE, size);
+	if (!handles || IS_ERR(mm))
+		return 1;
+
+	shim_quiet = 1;
+	for (i = 0; i < nr_ops; i++) {
+		const struct trace_op *op = &ops[i];
+
+		if (op->type == 'a') {
+			t = now_ns();
+			handles[op->id] = mem_request(mm, "bench", op->size);
+			t_alloc += now_ns() - t;
+			nr_alloc++;
+			if (IS_ERR(handles[op->id])) {
+				handles[op->id] = NULL;
+				nr_fail++;
+			}
+		} else if (handles[op->id]) {
+			t = now_ns();
+			mem_release(mm, handles[op->id]);
+			t_free += now_ns() - t;
+			handles[op->id] = NULL;
+			nr_rel++;
+		}
+
+		if ((i & 1023) == 0) {
+			nr_free = 0;
+			for (node = rb_first(&mm->free_root); node;
+			     node = rb_next(node))
+				nr_free++;
+			if (nr_free > max_free)
+				max_free = nr_free;
+		}
+	}
+	shim_quiet = 0;
+
+	printf("ops: %d, allocs: %d (%d failed), frees: %d\n",
+	       nr_ops, nr_alloc, nr_fail, nr_rel);
+	printf("alloc: %.1f ns/op, free: %.1f ns/op\n",
+	       nr_alloc ? (double)t_alloc / nr_alloc : 0.0,
+	       nr_rel ? (double)t_free / nr_rel : 0.0);
+	printf("peak free chunks: %u\n", max_free);
+
+	if (check_invariants(mm)) {
+		printf("FAIL: allocator state is inconsistent\n");
+		return 1;
+	}
+
+	destroy_mem_manager(mm);
+	free(handles);
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-s seed] [-b [-t trace | -n ops -l live] [-m MiB]]\n"
+		"  -s  random seed (default 1)\n"
+		"  -b  run the benchmark instead of the unit tests\n"
+		"  -t  replay a trace file\n"
+		"  -n  number of operations of the generated trace\n"
+		"  -l  live allocations of the generated trace\n"
+		"  -m  size of the managed region in MiB (default 64)\n",
+		prog);
+}
+
+int main(int argc, char **argv)
+{
+	const char *trace = NULL;
+	unsigned int seed = 1, live = 4096, max_id = 0;
+	unsigned long size_mb = 64;
+	int c, bench = 0, nr_ops = 1000000, ret;
+	struct trace_op *ops;
+
+	while ((c = getopt(argc, argv, "bt:n:l:m:s:h")) != -1) {
+		switch (c) {
+		case 'b':
+			bench = 1;
+			break;
+		case 't':
+			trace = optarg;
+			break;
+		case 'n':
+			nr_ops = atoi(optarg);
+			break;
+		case 'l':
+			live = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			size_mb = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+			return c == 'h' ? 0 : 1;
+		}
+	}
+
+	if (!bench)
+		return run_tests(seed);
+
+	if (nr_ops <= 0 || live == 0 || size_mb == 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (trace)
+		ops = load_trace(trace, &nr_ops, &max_id);
+	else
+		ops = gen_trace(nr_ops, live, seed, &max_id);
+	if (!ops)
+		return 1;
+
+	ret = run_bench(ops, nr_ops, max_id, size_mb * SZ_1M);
+	free(ops);
+	return ret;
+}
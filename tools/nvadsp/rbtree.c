@@ -0,0 +1,308 @@
+/*
+ * Userspace red-black tree backing the rbtree shim, see
+ * include/linux/rbtree.h.
+ *
+ * Copyright (c) 2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#include <linux/rbtree.h>
+
+static inline int is_black(const struct rb_node *node)
+{
+	return !node || node->rb_color == RB_BLACK;
+}
+
+static void rb_replace_child(struct rb_root *root, struct rb_node *old,
+			     struct rb_node *new)
+{
+	struct rb_node *parent = old->rb_parent;
+
+	if (!parent)
+		root->rb_node = new;
+	else if (parent->rb_left == old)
+		parent->rb_left = new;
+	else
+		parent->rb_right = new;
+
+	if (new)
+		new->rb_parent = parent;
+}
+
+static void rb_rotate_left(struct rb_root *root, struct rb_node *node)
+{
+	struct rb_node *right = node->rb_right;
+
+	node->rb_right = right->rb_left;
+	if (right->rb_left)
+		right->rb_left->rb_parent = node;
+
+	rb_replace_child(root, node, right);
+	right->rb_left = node;
+	node->rb_parent = right;
+}
+
+static void rb_rotate_right(struct rb_root *root, struct rb_node *node)
+{
+	struct rb_node *left = node->rb_left;
+
+	node->rb_left = left->rb_right;
+	if (left->rb_right)
+		left->rb_right->rb_parent = node;
+
+	rb_replace_child(root, node, left);
+	left->rb_right = node;
+	node->rb_parent = left;
+}
+
+void rb_insert_color(struct rb_node *node, struct rb_root *root)
+{
+	struct rb_node *parent, *gparent, *uncle;
+
+	while ((parent = node->rb_parent) && parent->rb_color == RB_RED) {
+		/* a red parent is never the root */
+		gparent = parent->rb_parent;
+
+		if (parent == gparent->rb_left) {
+			uncle = gparent->rb_right;
+			if (!is_black(uncle)) {
+				parent->rb_color = RB_BLACK;
+				uncle->rb_color = RB_BLACK;
+				gparent->rb_color = RB_RED;
+				node = gparent;
+				continue;
+			}
+			if (node == parent->rb_right) {
+				rb_rotate_left(root, parent);
+				node = parent;
+				parent = node->rb_parent;
+			}
+			parent->rb_color = RB_BLACK;
+			gparent->rb_color = RB_RED;
+			rb_rotate_right(root, gparent);
+		} else {
+			uncle = gparent->rb_left;
+			if (!is_black(uncle)) {
+				parent->rb_color = RB_BLACK;
+				uncle->rb_color = RB_BLACK;
+				gparent->rb_color = RB_RED;
+				node = gparent;
+				continue;
+			}
+			if (node == parent->rb_left) {
+				rb_rotate_right(root, parent);
+				node = parent;
+				parent = node->rb_parent;
+			}
+			parent->rb_color = RB_BLACK;
+			gparent->rb_color = RB_RED;
+			rb_rotate_left(root, gparent);
+		}
+	}
+
+	root->rb_node->rb_color = RB_BLACK;
+}
+
+/* node may be NULL, in which case parent locates it */
+static void rb_erase_color(struct rb_node *node, struct rb_node *parent,
+			   struct rb_root *root)
+{
+	struct rb_node *sibling;
+
+	while (node != root->rb_node && is_black(node)) {
+		if (node == parent->rb_left) {
+			sibling = parent->rb_right;
+			if (!is_black(sibling)) {
+				sibling->rb_color = RB_BLACK;
+				parent->rb_color = RB_RED;
+				rb_rotate_left(root, parent);
+				sibling = parent->rb_right;
+			}
+			if (is_black(sibling->rb_left) &&
+			    is_black(sibling->rb_right)) {
+				sibling->rb_color = RB_RED;
+				node = parent;
+				parent = node->rb_parent;
+				continue;
+			}
+			if (is_black(sibling->rb_right)) {
+				sibling->rb_left->rb_color = RB_BLACK;
+				sibling->rb_color = RB_RED;
+				rb_rotate_right(root, sibling);
+				sibling = parent->rb_right;
+			}
+			sibling->rb_color = parent->rb_color;
+			parent->rb_color = RB_BLACK;
+			sibling->rb_right->rb_color = RB_BLACK;
+			rb_rotate_left(root, parent);
+		} else {
+			sibling = parent->rb_left;
+			if (!is_black(sibling)) {
+				sibling->rb_color = RB_BLACK;
+				parent->rb_color = RB_RED;
+				rb_rotate_right(root, parent);
+				sibling = parent->rb_left;
+			}
+			if (is_black(sibling->rb_left) &&
+			    is_black(sibling->rb_right)) {
+				sibling->rb_color = RB_RED;
+				node = parent;
+				parent = node->rb_parent;
+				continue;
+			}
+			if (is_black(sibling->rb_left)) {
+				sibling->rb_right->rb_color = RB_BLACK;
+				sibling->rb_color = RB_RED;
+				rb_rotate_left(root, sibling);
+				sibling = parent->rb_left;
+			}
+			sibling->rb_color = parent->rb_color;
+			parent->rb_color = RB_BLACK;
+			sibling->rb_left->rb_color = RB_BLACK;
+			rb_rotate_right(root, parent);
+		}
+		node = root->rb_node;
+		break;
+	}
+
+	if (node)
+		node->rb_color = RB_BLACK;
+}
+
+void rb_erase(struct rb_node *node, struct rb_root *root)
+{
+	struct rb_node *child, *parent, *succ;
+	int color = node->rb_color;
+
+	if (!node->rb_left) {
+		child = node->rb_right;
+		parent = node->rb_parent;
+		rb_replace_child(root, node, child);
+	} else if (!node->rb_right) {
+		child = node->rb_left;
+		parent = node->rb_parent;
+		rb_replace_child(root, node, child);
+	} else {
+		succ = node->rb_right;
+		while (succ->rb_left)
+			succ = succ->rb_left;
+
+		color = succ->rb_color;
+		child = succ->rb_right;
+
+		if (succ->rb_parent == node) {
+			parent = succ;
+		} else {
+			parent = succ->rb_parent;
+			rb_replace_child(root, succ, child);
+			succ->rb_right = node->rb_right;
+			succ->rb_right->rb_parent = succ;
+		}
+
+		rb_replace_child(root, node, succ);
+		succ->rb_left = node->rb_left;
+		succ->rb_left->rb_parent = succ;
+		succ->rb_color = node->rb_color;
+	}
+
+	if (color == RB_BLACK)
+		rb_erase_color(child, parent, root);
+}
+
+struct rb_node *rb_first(const struct rb_root *root)
+{
+	struct rb_node *node = root->rb_node;
+
+	if (!node)
+		return NULL;
+	while (node->rb_left)
+		node = node->rb_left;
+	return node;
+}
+
+struct rb_node *rb_last(const struct rb_root *root)
+{
+	struct rb_node *node = root->rb_node;
+
+	if (!node)
+		return NULL;
+	while (node->rb_right)
+		node = node->rb_right;
+	return node;
+}
+
+struct rb_node *rb_next(const struct rb_node *node)
+{
+	struct rb_node *parent;
+
+	if (node->rb_right) {
+		node = node->rb_right;
+		while (node->rb_left)
+			node = node->rb_left;
+		return (struct rb_node *)node;
+	}
+
+	while ((parent = node->rb_parent) && node == parent->rb_right)
+		node = parent;
+
+	return parent;
+}
+
+struct rb_node *rb_prev(const struct rb_node *node)
+{
+	struct rb_node *parent;
+
+	if (node->rb_left) {
+		node = node->rb_left;
+		while (node->rb_right)
+			node = node->rb_right;
+		return (struct rb_node *)node;
+	}
+
+	while ((parent = node->rb_parent) && node == parent->rb_left)
+		node = parent;
+
+	return parent;
+}
+
+static struct rb_node *rb_left_deepest_node(const struct rb_node *node)
+{
+	for (;;) {
+		if (node->rb_left)
+			node = node->rb_left;
+		else if (node->rb_right)
+			node = node->rb_right;
+		else
+			return (struct rb_node *)node;
+	}
+}
+
+struct rb_node *rb_first_postorder(const struct rb_root *root)
+{
+	if (!root->rb_node)
+		return NULL;
+
+	return rb_left_deepest_node(root->rb_node);
+}
+
+struct rb_node *rb_next_postorder(const struct rb_node *node)
+{
+	const struct rb_node *parent;
+
+	if (!node)
+		return NULL;
+
+	parent = node->rb_parent;
+	if (parent && node == parent->rb_left && parent->rb_right)
+		return rb_left_deepest_node(parent->rb_right);
+
+	return (struct rb_node *)parent;
+}
@@ -0,0 +1,574 @@
+/*
+ * syncpt_alloc_test - unit test and contention benchmark for the nvhost
+ * syncpt allocator (drivers/video/tegra/host/nvhost_syncpt.c), built in
+ * userspace against syncpt_shim.h.
+ *
+ * Copyright (c) 2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Example Usage:
+ *	syncpt_alloc_test			run the unit tests
+ *	syncpt_alloc_test -b -t 8 -n 100000	benchmark with up to 8 threads
+ *	syncpt_alloc_test -b -f 400		same with 400 syncpts held
+ *
+ * The benchmark runs 1, 2, 4, ... threads that each allocate and free
+ * syncpts in a loop, singly, in batches and from a private pool, and
+ * reports the aggregate rate. -f keeps that many syncpts allocated for
+ * the whole run so that the free search has to skip over them.
+ */
+
+#define _GNU_SOURCE
+
+#include <getopt.h>
+#include <string.h>
+
+#include "syncpt_shim.h"
+#include "nvhost_syncpt_alloc.c"
+
+#define NB_PTS		576
+#define BATCH		4
+
+int shim_quiet;
+int shim_warnings;
+struct nvhost_master *shim_host;
+struct nvhost_syncpt_ops shim_syncpt_op;
+
+static struct platform_device pdev = {
+	.dev = { .name = "host1x_client" },
+};
+static struct nvhost_device_data pdata;
+static struct nvhost_master host;
+static struct nvhost_syncpt *sp = &host.syncpt;
+
+static int released;
+
+static int count_release(struct nvhost_syncpt *sp, u32 id)
+{
+	__atomic_add_fetch(&released, 1, __ATOMIC_RELAXED);
+	return 0;
+}
+
+static int failures;
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s:%d: check failed: %s\n", \
+				__func__, __LINE__, #cond); \
+			failures++; \
+			return -1; \
+		} \
+	} while (0)
+
+/*
+ * Fixture: a host1x with NB_PTS syncpts and the boot time reservations
+ * nvhost_syncpt_init() makes.
+ */
+static void setup(void)
+{
+	memset(&host, 0, sizeof(host));
+	host.dev = &pdev;
+	host.info.nb_hw_pts = NB_PTS;
+	host.info.pts_limit = NB_PTS;
+	pdev.drvdata = &pdata;
+	shim_host = &host;
+	shim_syncpt_op.release = count_release;
+	released = 0;
+
+	sp->assigned = calloc(BITS_TO_LONGS(NB_PTS), sizeof(unsigned long));
+	sp->pooled = calloc(BITS_TO_LONGS(NB_PTS), sizeof(unsigned long));
+	sp->client_managed = calloc(NB_PTS, sizeof(bool));
+	sp->in_use_ch = calloc(NB_PTS, sizeof(int));
+	sp->min_val = calloc(NB_PTS, sizeof(atomic_t));
+	sp->max_val = calloc(NB_PTS, sizeof(atomic_t));
+	sp->ref = calloc(NB_PTS, sizeof(atomic_t));
+	sp->syncpt_names = calloc(NB_PTS, sizeof(char *));
+	sp->last_used_by = calloc(NB_PTS, sizeof(char *));
+	mutex_init(&sp->syncpt_mutex);
+
+	nvhost_reserve_syncpts(sp);
+	shim_warnings = 0;
+}
+
+static bool is_reserved(u32 id)
+{
+	return id == NVSYNCPT_AVP_0 || id == NVSYNCPT_VBLANK0 ||
+		id == NVSYNCPT_VBLANK1;
+}
+
+static void teardown(void)
+{
+	u32 id;
+
+	for (id = 0; id < NB_PTS; id++) {
+		if (!is_reserved(id))
+			kfree(sp->syncpt_names[id]);
+		kfree(sp->last_used_by[id]);
+	}
+
+	free(sp->assigned);
+	free(sp->pooled);
+	free(sp->client_managed);
+	free(sp->in_use_ch);
+	free(sp->min_val);
+	free(sp->max_val);
+	free(sp->ref);
+	free(sp->syncpt_names);
+	free(sp->last_used_by);
+}
+
+/* syncpts the global allocator may hand out */
+static u32 count_free(void)
+{
+	u32 id, n = 0;
+
+	for (id = NVHOST_FREE_SYNCPT_BASE(sp); id < NB_PTS; id++)
+		if (!test_bit(id, sp->assigned) && !test_bit(id, sp->pooled))
+			n++;
+
+	return n;
+}
+
+/* takes every free syncpt, returns how many or -1 on a bad id */
+static int fill(u32 *ids)
+{
+	unsigned long seen[BITS_TO_LONGS(NB_PTS)] = { 0 };
+	int n = 0;
+	u32 id;
+
+	shim_quiet = 1;
+	while ((id = nvhost_get_syncpt_host_managed(&pdev, n, NULL))) {
+		if (id >= NB_PTS || id < NVHOST_FREE_SYNCPT_BASE(sp) ||
+		    is_reserved(id) || test_bit(id, seen) ||
+		    nvhost_syncpt_read_ref(sp, id) != 1 ||
+		    !sp->syncpt_names[id]) {
+			n = -1;
+			break;
+		}
+		set_bit(id, seen);
+		ids[n++] = id;
+	}
+	shim_quiet = 0;
+
+	return n;
+}
+
+/*
+ * Unit tests
+ */
+
+static int test_exhaust(void)
+{
+	u32 ids[NB_PTS];
+	u32 nfree = count_free();
+	int i, n;
+
+	/* the three boot time reservations and id 0 are never handed out */
+	CHECK(nfree == NB_PTS - 4);
+
+	n = fill(ids);
+	CHECK(n == nfree);
+	CHECK(count_free() == 0);
+	/* the failed search reports once in get_syncpt and once above it */
+	CHECK(shim_warnings == 2);
+
+	shim_warnings = 0;
+	nvhost_syncpt_put_refs_ext(&pdev, ids, n);
+	CHECK(shim_warnings == 0);
+	CHECK(count_free() == nfree);
+	CHECK(released == n);
+	for (i = 0; i < n; i++)
+		CHECK(!nvhost_is_syncpt_assigned(sp, ids[i]));
+
+	return 0;
+}
+
+static int test_hint(void)
+{
+	u32 a, b, c;
+
+	/* a freed id is not reissued right away */
+	a = nvhost_get_syncpt_host_managed(&pdev, 0, NULL);
+	CHECK(a);
+	nvhost_syncpt_put_ref(sp, a);
+	b = nvhost_get_syncpt_host_managed(&pdev, 0, NULL);
+	CHECK(b == a + 1);
+	nvhost_syncpt_put_ref(sp, b);
+
+	/* the search wraps around past the last id */
+	mutex_lock(&sp->syncpt_mutex);
+	sp->free_hint = NB_PTS;
+	mutex_unlock(&sp->syncpt_mutex);
+	c = nvhost_get_syncpt_host_managed(&pdev, 0, NULL);
+	CHECK(c == NVHOST_FREE_SYNCPT_BASE(sp));
+	nvhost_syncpt_put_ref(sp, c);
+
+	CHECK(shim_warnings == 0);
+
+	return 0;
+}
+
+static int test_free_state(void)
+{
+	u32 id;
+
+	id = nvhost_get_syncpt_client_managed(&pdev, "camera");
+	CHECK(id);
+	CHECK(nvhost_is_syncpt_assigned(sp, id));
+	CHECK(nvhost_syncpt_client_managed(sp, id));
+	CHECK(!strcmp(sp->syncpt_names[id], "camera"));
+
+	atomic_set(&sp->max_val[id], 5);
+	nvhost_syncpt_put_ref(sp, id);
+
+	/* the name moves to last_used_by, the rest is back to defaults */
+	CHECK(!nvhost_is_syncpt_assigned(sp, id));
+	CHECK(!nvhost_syncpt_client_managed(sp, id));
+	CHECK(!sp->syncpt_names[id]);
+	CHECK(sp->last_used_by[id] && !strcmp(sp->last_used_by[id], "camera"));
+	CHECK(nvhost_syncpt_min_eq_max(sp, id));
+	CHECK(released == 1);
+
+	/* freeing twice warns and changes nothing */
+	shim_quiet = 1;
+	nvhost_free_syncpt(sp, id);
+	shim_quiet = 0;
+	CHECK(shim_warnings == 1);
+	CHECK(released == 1);
+
+	return 0;
+}
+
+static int test_batch(void)
+{
+	u32 ids[NB_PTS], batch[BATCH];
+	u32 nfree = count_free();
+	int n, err;
+
+	/* leave BATCH - 1 syncpts free */
+	n = fill(ids);
+	CHECK(n == nfree);
+	nvhost_syncpt_put_refs_ext(&pdev, ids + n - (BATCH - 1), BATCH - 1);
+	n -= BATCH - 1;
+	CHECK(count_free() == BATCH - 1);
+
+	/* a batch that does not fit allocates nothing */
+	shim_quiet = 1;
+	err = nvhost_get_syncpts_host_managed(&pdev, 0, batch, BATCH);
+	shim_quiet = 0;
+	CHECK(err == -EAGAIN);
+	CHECK(count_free() == BATCH - 1);
+
+	err = nvhost_get_syncpts_host_managed(&pdev, 0, batch, BATCH - 1);
+	CHECK(!err);
+	CHECK(count_free() == 0);
+	CHECK(batch[0] != batch[1] && batch[1] != batch[2] &&
+	      batch[0] != batch[2]);
+
+	nvhost_syncpt_put_refs_ext(&pdev, batch, BATCH - 1);
+	nvhost_syncpt_put_refs_ext(&pdev, ids, n);
+	CHECK(count_free() == nfree);
+
+	return 0;
+}
+
+static int test_pool(void)
+{
+	struct nvhost_syncpt_pool *pool;
+	u32 ids[NB_PTS], got[BATCH + 1];
+	u32 nfree = count_free();
+	u32 id;
+	int i, n;
+
+	pool = nvhost_syncpt_pool_create(&pdev, BATCH);
+	CHECK(!IS_ERR_OR_NULL(pool));
+	CHECK(count_free() == nfree - BATCH);
+
+	/* the pool is used first, then the global allocator */
+	for (i = 0; i < BATCH + 1; i++) {
+		got[i] = nvhost_syncpt_pool_get(pool, i, NULL);
+		CHECK(got[i]);
+		CHECK(test_bit(got[i], pool->ids) == (i < BATCH));
+	}
+
+	/* a freed pooled syncpt goes back to its pool only */
+	nvhost_syncpt_put_ref(sp, got[0]);
+	CHECK(test_bit(got[0], sp->pooled));
+	n = fill(ids);
+	CHECK(n == nfree - BATCH - 1);
+	for (i = 0; i < n; i++)
+		CHECK(!test_bit(ids[i], pool->ids));
+	id = nvhost_syncpt_pool_get(pool, 0, NULL);
+	CHECK(id == got[0]);
+	nvhost_syncpt_put_refs_ext(&pdev, ids, n);
+
+	/* ids in use stay assigned past pool_destroy */
+	nvhost_syncpt_pool_destroy(pool);
+	CHECK(count_free() == nfree - BATCH - 1);
+	for (i = 0; i < BATCH + 1; i++) {
+		CHECK(!test_bit(got[i], sp->pooled));
+		nvhost_syncpt_put_ref(sp, got[i]);
+	}
+	CHECK(count_free() == nfree);
+
+	/* a pool that cannot be filled leaves nothing set aside */
+	shim_quiet = 1;
+	pool = nvhost_syncpt_pool_create(&pdev, nfree + 1);
+	shim_quiet = 0;
+	CHECK(PTR_ERR(pool) == -EBUSY);
+	CHECK(count_free() == nfree);
+
+	return 0;
+}
+
+/*
+ * Concurrent allocation. Every id handed out is claimed in owner[], so
+ * an id given to two threads at once is caught.
+ */
+
+struct worker {
+	pthread_t thread;
+	int index;
+	long iterations;
+	bool check;
+	struct nvhost_syncpt_pool *pool;
+	long errors;
+	double ops;
+};
+
+static int owner[NB_PTS];
+static pthread_barrier_t start;
+
+static void claim(struct worker *w, u32 id)
+{
+	if (!id || (w->check &&
+		    __atomic_exchange_n(&owner[id], w->index + 1,
+					__ATOMIC_RELAXED)))
+		w->errors++;
+}
+
+static void unclaim(struct worker *w, u32 id)
+{
+	if (w->check &&
+	    __atomic_exchange_n(&owner[id], 0, __ATOMIC_RELAXED) !=
+	    w->index + 1)
+		w->errors++;
+}
+
+static void *worker_fn(void *data)
+{
+	struct worker *w = data;
+	u32 ids[BATCH];
+	long i;
+	int j;
+
+	pthread_barrier_wait(&start);
+
+	for (i = 0; i < w->iterations; i++) {
+		ids[0] = nvhost_get_syncpt_host_managed(&pdev, i, NULL);
+		claim(w, ids[0]);
+		if (nvhost_is_syncpt_assigned(sp, ids[0]) != true)
+			w->errors++;
+		unclaim(w, ids[0]);
+		nvhost_syncpt_put_ref(sp, ids[0]);
+
+		if (nvhost_get_syncpts_host_managed(&pdev, i, ids, BATCH)) {
+			w->errors++;
+			continue;
+		}
+		for (j = 0; j < BATCH; j++)
+			claim(w, ids[j]);
+		for (j = 0; j < BATCH; j++)
+			unclaim(w, ids[j]);
+		nvhost_syncpt_put_refs_ext(&pdev, ids, BATCH);
+
+		if (w->pool) {
+			ids[0] = nvhost_syncpt_pool_get(w->pool, i, NULL);
+			claim(w, ids[0]);
+			unclaim(w, ids[0]);
+			nvhost_syncpt_put_ref(sp, ids[0]);
+		}
+	}
+
+	return NULL;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* returns the number of errors, or -1 if a thread could not be started */
+static long run_workers(int nthreads, long iterations, bool check,
+			bool pools, double *rate)
+{
+	struct worker *w = calloc(nthreads, sizeof(*w));
+	long errors = 0;
+	double t;
+	int i;
+
+	if (!w)
+		return -1;
+
+	pthread_barrier_init(&start, NULL, nthreads + 1);
+	for (i = 0; i < nthreads; i++) {
+		w[i].index = i;
+		w[i].iterations = iterations;
+		w[i].check = check;
+		w[i].pool = pools ? nvhost_syncpt_pool_create(&pdev, 1) : NULL;
+		if (IS_ERR(w[i].pool))
+			w[i].pool = NULL;
+		pthread_create(&w[i].thread, NULL, worker_fn, &w[i]);
+	}
+
+	pthread_barrier_wait(&start);
+	t = now();
+	for (i = 0; i < nthreads; i++)
+		pthread_join(w[i].thread, NULL);
+	t = now() - t;
+
+	for (i = 0; i < nthreads; i++) {
+		errors += w[i].errors;
+		nvhost_syncpt_pool_destroy(w[i].pool);
+	}
+	pthread_barrier_destroy(&start);
+	free(w);
+
+	/* one single, one batch and one pool allocation per iteration */
+	if (rate)
+		*rate = nthreads * iterations * (1 + BATCH + pools) / t;
+
+	return errors;
+}
+
+static int test_concurrent(void)
+{
+	u32 nfree = count_free();
+
+	CHECK(run_workers(8, 2000, true, true, NULL) == 0);
+	CHECK(count_free() == nfree);
+	CHECK(shim_warnings == 0);
+
+	return 0;
+}
+
+static int run_tests(void)
+{
+	static const struct {
+		const char *name;
+		int (*fn)(void);
+	} tests[] = {
+		{ "exhaust", test_exhaust },
+		{ "hint", test_hint },
+		{ "free_state", test_free_state },
+		{ "batch", test_batch },
+		{ "pool", test_pool },
+		{ "concurrent", test_concurrent },
+	};
+	size_t i;
+
+	for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+		setup();
+		if (tests[i].fn())
+			fprintf(stderr, "%s: FAIL\n", tests[i].name);
+		teardown();
+	}
+
+	printf("%s\n", failures ? "FAIL" : "PASS");
+
+	return failures ? 1 : 0;
+}
+
+/*
+ * Benchmark
+ */
+
+static int run_bench(int max_threads, long iterations, int held)
+{
+	u32 *ids = calloc(NB_PTS, sizeof(*ids));
+	double rate;
+	long errors;
+	int i, n;
+
+	if (!ids)
+		return 1;
+
+	setup();
+
+	for (n = 0; n < held; n++) {
+		ids[n] = nvhost_get_syncpt_host_managed(&pdev, n, NULL);
+		if (!ids[n]) {
+			fprintf(stderr, "cannot hold %d syncpts\n", held);
+			return 1;
+		}
+	}
+
+	printf("%d syncpts, %d held, %ld iterations per thread\n",
+	       NB_PTS, held, iterations);
+	printf("%8s %16s %16s\n", "threads", "global ops/s", "+pool ops/s");
+
+	for (i = 1; i <= max_threads; i *= 2) {
+		printf("%8d", i);
+		errors = run_workers(i, iterations, false, false, &rate);
+		printf(" %16.0f", rate);
+		errors += run_workers(i, iterations, false, true, &rate);
+		printf(" %16.0f\n", rate);
+		if (errors) {
+			fprintf(stderr, "%ld allocation errors\n", errors);
+			return 1;
+		}
+	}
+
+	nvhost_syncpt_put_refs_ext(&pdev, ids, n);
+	teardown();
+	free(ids);
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	long iterations = 100000;
+	int max_threads = 8;
+	bool bench = false;
+	int held = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "bf:n:t:")) != -1) {
+		switch (opt) {
+		case 'b':
+			bench = true;
+			break;
+		case 'f':
+			held = atoi(optarg);
+			break;
+		case 'n':
+			iterations = atol(optarg);
+			break;
+		case 't':
+			max_threads = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr,
+				"usage: %s [-b [-t threads] [-n iterations] [-f held]]\n",
+				argv[0]);
+			return 2;
+		}
+	}
+
+	if (bench)
+		return run_bench(max_threads, iterations, held);
+
+	return run_tests();
+}
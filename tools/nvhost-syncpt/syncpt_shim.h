@@ -0,0 +1,367 @@
+/*
+ * Userspace stand-ins for the nvhost and kernel facilities used by the
+ * syncpt allocator section of nvhost_syncpt.c.
+ *
+ * Copyright (c) 2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#ifndef _SYNCPT_SHIM_H
+#define _SYNCPT_SHIM_H
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef uint32_t u32;
+
+#define container_of(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+#define clamp(val, lo, hi)	((val) < (lo) ? (lo) : (val) > (hi) ? (hi) : (val))
+
+#define EXPORT_SYMBOL_GPL(sym)	extern typeof(sym) sym
+
+#define MAX_ERRNO	4095
+
+static inline void *ERR_PTR(long error)
+{
+	return (void *)error;
+}
+
+static inline long PTR_ERR(const void *ptr)
+{
+	return (long)ptr;
+}
+
+static inline bool IS_ERR(const void *ptr)
+{
+	return (unsigned long)ptr >= (unsigned long)-MAX_ERRNO;
+}
+
+static inline bool IS_ERR_OR_NULL(const void *ptr)
+{
+	return !ptr || IS_ERR(ptr);
+}
+
+/*
+ * Logging. Errors and warnings are counted so that a test can tell an
+ * expected failure from one the allocator complained about.
+ */
+extern int shim_quiet;
+extern int shim_warnings;
+
+#define nvhost_err(d, fmt, ...) \
+	do { \
+		(void)(d); \
+		__atomic_add_fetch(&shim_warnings, 1, __ATOMIC_RELAXED); \
+		if (!shim_quiet) \
+			fprintf(stderr, fmt "\n", ##__VA_ARGS__); \
+	} while (0)
+#define nvhost_warn(d, fmt, ...)	nvhost_err(d, fmt, ##__VA_ARGS__)
+
+#define WARN_ON(cond) \
+({ \
+	bool __c = !!(cond); \
+	if (__c) \
+		nvhost_err(NULL, "WARN_ON(%s)", #cond); \
+	__c; \
+})
+
+/* one jiffy is one millisecond */
+#define HZ			1000
+#define MAX_SCHEDULE_TIMEOUT	LONG_MAX
+
+static inline unsigned long shim_jiffies(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000;
+}
+
+#define jiffies			shim_jiffies()
+#define time_after(a, b)	((long)((b) - (a)) < 0)
+#define schedule()		sched_yield()
+#define mdelay(ms)		usleep((ms) * 1000)
+
+/*
+ * Allocation
+ */
+#define GFP_KERNEL		0
+#define kzalloc(size, flags)	calloc(1, size)
+#define kcalloc(n, size, flags)	calloc(n, size)
+#define kfree(ptr)		free((void *)(ptr))
+
+static inline char *kasprintf(int gfp, const char *fmt, ...)
+{
+	va_list ap;
+	char *s;
+
+	va_start(ap, fmt);
+	if (vasprintf(&s, fmt, ap) < 0)
+		s = NULL;
+	va_end(ap);
+
+	return s;
+}
+
+/*
+ * Bitmaps. Bits are changed atomically and read with relaxed loads, as
+ * nvhost_is_syncpt_assigned() reads them without syncpt_mutex.
+ */
+#define BITS_PER_LONG		(8 * sizeof(long))
+#define BITS_TO_LONGS(nr)	(((nr) + BITS_PER_LONG - 1) / BITS_PER_LONG)
+
+static inline unsigned long shim_word(const unsigned long *addr,
+				      unsigned long nr)
+{
+	return __atomic_load_n(&addr[nr / BITS_PER_LONG], __ATOMIC_RELAXED);
+}
+
+static inline bool test_bit(unsigned long nr, const unsigned long *addr)
+{
+	return (shim_word(addr, nr) >> (nr % BITS_PER_LONG)) & 1;
+}
+
+static inline void set_bit(unsigned long nr, unsigned long *addr)
+{
+	__atomic_fetch_or(&addr[nr / BITS_PER_LONG],
+			  1UL << (nr % BITS_PER_LONG), __ATOMIC_RELAXED);
+}
+
+static inline void clear_bit(unsigned long nr, unsigned long *addr)
+{
+	__atomic_fetch_and(&addr[nr / BITS_PER_LONG],
+			   ~(1UL << (nr % BITS_PER_LONG)), __ATOMIC_RELAXED);
+}
+
+static inline unsigned long shim_find_next(const unsigned long *addr,
+					   unsigned long size,
+					   unsigned long offset,
+					   unsigned long invert)
+{
+	unsigned long word;
+
+	while (offset < size) {
+		word = (shim_word(addr, offset) ^ invert) >>
+			(offset % BITS_PER_LONG);
+		if (word) {
+			offset += __builtin_ctzl(word);
+			return offset < size ? offset : size;
+		}
+		offset = (offset / BITS_PER_LONG + 1) * BITS_PER_LONG;
+	}
+
+	return size;
+}
+
+#define find_next_bit(addr, size, offset) \
+	shim_find_next(addr, size, offset, 0)
+#define find_next_zero_bit(addr, size, offset) \
+	shim_find_next(addr, size, offset, ~0UL)
+
+#define for_each_set_bit(bit, addr, size) \
+	for ((bit) = find_next_bit((addr), (size), 0); \
+	     (bit) < (size); \
+	     (bit) = find_next_bit((addr), (size), (bit) + 1))
+
+/*
+ * Atomics and locks
+ */
+typedef struct {
+	int counter;
+} atomic_t;
+
+#define atomic_read(v)		__atomic_load_n(&(v)->counter, __ATOMIC_SEQ_CST)
+#define atomic_set(v, i)	__atomic_store_n(&(v)->counter, i, __ATOMIC_SEQ_CST)
+#define atomic_inc_return(v)	__atomic_add_fetch(&(v)->counter, 1, __ATOMIC_SEQ_CST)
+#define atomic_dec_and_test(v)	(__atomic_sub_fetch(&(v)->counter, 1, __ATOMIC_SEQ_CST) == 0)
+
+struct mutex {
+	pthread_mutex_t lock;
+};
+
+#define mutex_init(m)		pthread_mutex_init(&(m)->lock, NULL)
+#define mutex_lock(m)		pthread_mutex_lock(&(m)->lock)
+#define mutex_unlock(m)		pthread_mutex_unlock(&(m)->lock)
+
+/*
+ * Devices
+ */
+struct device {
+	const char *name;
+};
+
+struct platform_device {
+	struct device dev;
+	void *drvdata;
+};
+
+#define dev_name(d)			((d)->name)
+#define platform_get_drvdata(pdev)	((pdev)->drvdata)
+
+static struct {
+	char comm[16];
+} shim_current = { "syncpt_test" };
+#define current		(&shim_current)
+
+enum nvhost_resource_policy {
+	RESOURCE_PER_DEVICE = 0,
+	RESOURCE_PER_CHANNEL_INSTANCE,
+};
+
+struct nvhost_device_data {
+	enum nvhost_resource_policy resource_policy;
+};
+
+/*
+ * nvhost syncpt state, reduced to what the allocator touches
+ */
+#define NVSYNCPT_INVALID	(-1)
+#define NVSYNCPT_AVP_0		(10)
+#define NVSYNCPT_VBLANK0	(26)
+#define NVSYNCPT_VBLANK1	(27)
+
+#define NVHOST_FREE_SYNCPT_BASE(sp)	(nvhost_syncpt_pts_base(sp) + 1)
+/* kept short so that exhaustion tests do not stall */
+#define NVHOST_SYNCPT_FREE_WAIT_TIMEOUT	(HZ / 50)
+#define NVHOST_SYNCPT_IN_USE_CH_NONE	(-1)
+
+struct nvhost_syncpt_pool {
+	struct platform_device *pdev;
+	unsigned long *ids;
+};
+
+struct nvhost_syncpt {
+	unsigned long *assigned;
+	unsigned long *pooled;
+	u32 free_hint;
+	bool *client_managed;
+	int *in_use_ch;
+	struct mutex syncpt_mutex;
+	atomic_t *min_val;
+	atomic_t *max_val;
+	atomic_t *ref;
+	const char **syncpt_names;
+	const char **last_used_by;
+};
+
+struct nvhost_chip_info {
+	int nb_hw_pts;
+	int pts_base;
+	int pts_limit;
+};
+
+struct nvhost_master {
+	struct platform_device *dev;
+	struct nvhost_syncpt syncpt;
+	struct nvhost_chip_info info;
+};
+
+#define syncpt_to_dev(sp)	container_of(sp, struct nvhost_master, syncpt)
+
+/* the single host1x instance, set up by the test */
+extern struct nvhost_master *shim_host;
+
+static inline struct nvhost_master *nvhost_get_host(
+					struct platform_device *pdev)
+{
+	return shim_host;
+}
+
+struct nvhost_syncpt_ops {
+	int (*mark_used)(struct nvhost_syncpt *, u32 chid, u32 syncptid);
+	int (*mark_unused)(struct nvhost_syncpt *, u32 syncptid);
+	int (*alloc)(struct platform_device *pdev, u32 syncpt_id);
+	int (*release)(struct nvhost_syncpt *sp, u32 syncpt_id);
+};
+
+extern struct nvhost_syncpt_ops shim_syncpt_op;
+#define syncpt_op()	shim_syncpt_op
+
+static inline int nvhost_syncpt_nb_hw_pts(struct nvhost_syncpt *sp)
+{
+	return syncpt_to_dev(sp)->info.nb_hw_pts;
+}
+
+static inline int nvhost_syncpt_pts_base(struct nvhost_syncpt *sp)
+{
+	return syncpt_to_dev(sp)->info.pts_base;
+}
+
+static inline int nvhost_syncpt_pts_limit(struct nvhost_syncpt *sp)
+{
+	return syncpt_to_dev(sp)->info.pts_limit;
+}
+
+static inline bool nvhost_syncpt_is_valid_pt(struct nvhost_syncpt *sp,
+					     u32 id)
+{
+	return id >= nvhost_syncpt_pts_base(sp) &&
+		id < nvhost_syncpt_pts_limit(sp) && id != NVSYNCPT_INVALID;
+}
+
+static inline int nvhost_syncpt_client_managed(struct nvhost_syncpt *sp,
+					       u32 id)
+{
+	return sp->client_managed[id];
+}
+
+static inline u32 nvhost_syncpt_read_max(struct nvhost_syncpt *sp, u32 id)
+{
+	return (u32)atomic_read(&sp->max_val[id]);
+}
+
+static inline bool nvhost_syncpt_min_eq_max(struct nvhost_syncpt *sp, u32 id)
+{
+	return atomic_read(&sp->min_val[id]) == atomic_read(&sp->max_val[id]);
+}
+
+static inline void nvhost_syncpt_set_min_eq_max(struct nvhost_syncpt *sp,
+						u32 id)
+{
+	atomic_set(&sp->min_val[id], atomic_read(&sp->max_val[id]));
+}
+
+/* the hardware catches up at once */
+static inline int nvhost_syncpt_wait_timeout(struct nvhost_syncpt *sp,
+					     u32 id, u32 thresh, u32 timeout,
+					     u32 *value, void *ts,
+					     bool interruptible)
+{
+	atomic_set(&sp->min_val[id], thresh);
+	return 0;
+}
+
+static inline const char *nvhost_syncpt_get_name(struct platform_device *pdev,
+						 int id)
+{
+	return nvhost_get_host(pdev)->syncpt.syncpt_names[id];
+}
+
+/* defined in the allocator section */
+int nvhost_syncpt_get_ref(struct nvhost_syncpt *sp, u32 id);
+int nvhost_syncpt_read_ref(struct nvhost_syncpt *sp, u32 id);
+void nvhost_syncpt_put_ref(struct nvhost_syncpt *sp, u32 id);
+void nvhost_syncpt_put_refs_ext(struct platform_device *pdev,
+				const u32 *ids, u32 count);
+
+#endif /* _SYNCPT_SHIM_H */
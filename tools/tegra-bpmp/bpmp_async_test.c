@@ -0,0 +1,529 @@
+/*
+ * bpmp_async_test - test and benchmark for the asynchronous MRQ API of
+ * the BPMP mail layer (drivers/firmware/tegra/mail.c) against the mock
+ * mail_ops backend in mail_mock.c, built in userspace against bpmp_shim.h.
+ *
+ * Copyright (c) 2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Example Usage:
+ *	bpmp_async_test				run the tests
+ *	bpmp_async_test -b			serial vs batched MRQs
+ *	bpmp_async_test -b -l 500 -s 20 -n 64	slower transport and firmware
+ */
+
+#include <getopt.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "mail.c"
+#include "mail_mock.c"
+
+int shim_quiet;
+unsigned int shim_warnings;
+__thread int shim_irqs_off;
+
+static int failures;
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s:%d: check failed: %s\n", \
+				__func__, __LINE__, #cond); \
+			failures++; \
+			return -1; \
+		} \
+	} while (0)
+
+#define MRQ_ECHO	MRQ_CPU_NDIV_LIMITS
+
+/* BPMP initiated MRQs, never signalled by the mock */
+void bpmp_handle_mail(int mrq, int ch)
+{
+	abort();
+}
+
+int bpmp_mailman_init(void)
+{
+	return 0;
+}
+
+static void sleep_us(unsigned int us)
+{
+	struct timespec ts = {
+		.tv_sec = us / 1000000,
+		.tv_nsec = (us % 1000000) * 1000L,
+	};
+
+	nanosleep(&ts, NULL);
+}
+
+static unsigned int free_channels(void)
+{
+	unsigned int count;
+
+	pthread_mutex_lock(&tch_sem.lock);
+	count = tch_sem.count;
+	pthread_mutex_unlock(&tch_sem.lock);
+
+	return count;
+}
+
+/* every thread channel back in the pool, nothing left in flight */
+static bool idle(void)
+{
+	unsigned long flags;
+	bool r;
+
+	spin_lock_irqsave(&lock, flags);
+	r = tch_free == (1u << MOCK_THREAD_CH_CNT) - 1 && !to_complete &&
+		!to_reclaim;
+	spin_unlock_irqrestore(&lock, flags);
+
+	return r && free_channels() == MOCK_THREAD_CH_CNT;
+}
+
+static bool wait_idle(void)
+{
+	int i;
+
+	for (i = 0; i < 2000 && !idle(); i++)
+		sleep_us(1000);
+
+	return idle();
+}
+
+static int test_sync(void)
+{
+	struct mrq_ping_request ping = { .challenge = 0x12345678 };
+	struct mrq_ping_response pong = { 0 };
+	unsigned long flags;
+
+	CHECK(tegra_bpmp_send_receive(MRQ_PING, &ping, sizeof(ping),
+				      &pong, sizeof(pong)) == 0);
+	CHECK(pong.reply == ping.challenge << 1);
+
+	/* the atomic path polls its per-cpu channel */
+	pong.reply = 0;
+	flags = shim_irqs_off++;
+	CHECK(tegra_bpmp_send_receive_atomic(MRQ_PING, &ping, sizeof(ping),
+					     &pong, sizeof(pong)) == 0);
+	shim_irqs_off = flags;
+	CHECK(pong.reply == ping.challenge << 1);
+
+	CHECK(wait_idle());
+	return 0;
+}
+
+/*
+ * A waiter and a callback on the same request: the callback sees the
+ * request completed and has finished before tegra_bpmp_wait_async()
+ * hands the request back.
+ */
+static volatile int callback_runs;
+static volatile int callback_saw_done;
+
+static void slow_callback(struct tegra_bpmp_async *req)
+{
+	callback_saw_done = req->done.done != 0;
+	sleep_us(2000);
+	callback_runs++;
+}
+
+static int test_async_wait(void)
+{
+	struct mrq_ping_request ping = { .challenge = 0x80000001 };
+	struct mrq_ping_response pong = { 0 };
+	struct tegra_bpmp_async req = {
+		.mrq = MRQ_PING,
+		.ob_data = &ping,
+		.ob_sz = sizeof(ping),
+		.ib_data = &pong,
+		.ib_sz = sizeof(pong),
+		.callback = slow_callback,
+	};
+
+	callback_runs = 0;
+	callback_saw_done = 0;
+
+	CHECK(tegra_bpmp_send_async(&req) == 0);
+	CHECK(req.ch >= 0 && req.ch < MOCK_THREAD_CH_CNT);
+	CHECK(tegra_bpmp_wait_async(&req) == 0);
+	CHECK(callback_runs == 1);
+	CHECK(callback_saw_done);
+	/* carry bit dropped */
+	CHECK(pong.reply == 2);
+
+	CHECK(wait_idle());
+	return 0;
+}
+
+/* three times as many MRQs as there are thread channels */
+static int test_batch(void)
+{
+	enum { N = 3 * MOCK_THREAD_CH_CNT + 1 };
+	struct mrq_ping_request ping[N];
+	struct mrq_ping_response pong[N];
+	struct tegra_bpmp_async reqs[N];
+	int i;
+
+	memset(reqs, 0, sizeof(reqs));
+	for (i = 0; i < N; i++) {
+		ping[i].challenge = 1000 + i;
+		pong[i].reply = 0;
+		reqs[i].mrq = MRQ_PING;
+		reqs[i].ob_data = &ping[i];
+		reqs[i].ob_sz = sizeof(ping[i]);
+		reqs[i].ib_data = &pong[i];
+		reqs[i].ib_sz = sizeof(pong[i]);
+	}
+
+	mock.latency_us = 1000;
+	CHECK(tegra_bpmp_send_receive_batch(reqs, N) == 0);
+	mock.latency_us = 0;
+	for (i = 0; i < N; i++) {
+		CHECK(reqs[i].result == 0);
+		CHECK(pong[i].reply == ping[i].challenge << 1);
+	}
+
+	CHECK(wait_idle());
+	return 0;
+}
+
+/* the requests of a batch are in flight together */
+static int test_batch_overlap(void)
+{
+	struct mrq_ping_request ping = { .challenge = 7 };
+	struct mrq_ping_response pong[MOCK_THREAD_CH_CNT];
+	struct tegra_bpmp_async reqs[MOCK_THREAD_CH_CNT];
+	ktime_t t;
+	int i;
+
+	memset(reqs, 0, sizeof(reqs));
+	for (i = 0; i < MOCK_THREAD_CH_CNT; i++) {
+		reqs[i].mrq = MRQ_PING;
+		reqs[i].ob_data = &ping;
+		reqs[i].ob_sz = sizeof(ping);
+		reqs[i].ib_data = &pong[i];
+		reqs[i].ib_sz = sizeof(pong[i]);
+	}
+
+	mock.latency_us = 50000;
+	t = ktime_get();
+	CHECK(tegra_bpmp_send_receive_batch(reqs, MOCK_THREAD_CH_CNT) == 0);
+	t = ktime_get() - t;
+	mock.latency_us = 0;
+
+	/* one latency for all of them, not one each */
+	CHECK(t < 2 * 50000 * 1000LL);
+
+	CHECK(wait_idle());
+	return 0;
+}
+
+static int test_batch_error(void)
+{
+	u8 data[4][MSG_DATA_MIN_SZ];
+	u8 resp[4][MSG_DATA_MIN_SZ];
+	struct tegra_bpmp_async reqs[4];
+	int i;
+
+	memset(reqs, 0, sizeof(reqs));
+	for (i = 0; i < 4; i++) {
+		memset(data[i], 0x10 + i, sizeof(data[i]));
+		memset(resp[i], 0, sizeof(resp[i]));
+		reqs[i].mrq = i == 2 ? MRQ_PING : MRQ_ECHO;
+		reqs[i].ob_data = data[i];
+		reqs[i].ob_sz = sizeof(data[i]);
+		reqs[i].ib_data = resp[i];
+		reqs[i].ib_sz = sizeof(resp[i]);
+	}
+
+	mock.fail_mrq = MRQ_PING;
+	mock.fail_code = BPMP_EINVAL;
+	CHECK(tegra_bpmp_send_receive_batch(reqs, 4) == -BPMP_EINVAL);
+	mock.fail_mrq = -1;
+
+	for (i = 0; i < 4; i++) {
+		if (i == 2) {
+			CHECK(reqs[i].result == -BPMP_EINVAL);
+			continue;
+		}
+		CHECK(reqs[i].result == 0);
+		CHECK(memcmp(resp[i], data[i], sizeof(data[i])) == 0);
+	}
+
+	/* invalid requests fail before anything is sent */
+	reqs[1].ob_sz = MSG_DATA_MIN_SZ + 1;
+	CHECK(tegra_bpmp_send_receive_batch(reqs, 4) == -EINVAL);
+	CHECK(reqs[1].result == -EINVAL);
+	CHECK(reqs[0].result == 0);
+
+	CHECK(wait_idle());
+	return 0;
+}
+
+/*
+ * Fire and forget: nobody waits, the callback frees the request. The
+ * mail layer must not touch it afterwards, which ASan checks.
+ */
+struct forget {
+	struct tegra_bpmp_async req;
+	struct mrq_ping_request ping;
+	struct mrq_ping_response pong;
+};
+
+static int forget_done;
+static int forget_bad;
+
+static void forget_callback(struct tegra_bpmp_async *req)
+{
+	struct forget *f = req->cookie;
+
+	if (req->result || f->pong.reply != f->ping.challenge << 1)
+		__atomic_fetch_add(&forget_bad, 1, __ATOMIC_RELAXED);
+	memset(f, 0xa5, sizeof(*f));
+	free(f);
+	__atomic_fetch_add(&forget_done, 1, __ATOMIC_RELEASE);
+}
+
+static int test_fire_and_forget(void)
+{
+	enum { N = 4 * MOCK_THREAD_CH_CNT };
+	struct forget *f;
+	int i;
+
+	forget_done = 0;
+	forget_bad = 0;
+
+	for (i = 0; i < N; i++) {
+		f = calloc(1, sizeof(*f));
+		CHECK(f);
+		f->ping.challenge = 0x100 + i;
+		f->req.mrq = MRQ_PING;
+		f->req.ob_data = &f->ping;
+		f->req.ob_sz = sizeof(f->ping);
+		f->req.ib_data = &f->pong;
+		f->req.ib_sz = sizeof(f->pong);
+		f->req.callback = forget_callback;
+		f->req.cookie = f;
+		CHECK(tegra_bpmp_send_async(&f->req) == 0);
+	}
+
+	for (i = 0; i < 2000; i++) {
+		if (__atomic_load_n(&forget_done, __ATOMIC_ACQUIRE) == N)
+			break;
+		sleep_us(1000);
+	}
+	CHECK(forget_done == N);
+	CHECK(forget_bad == 0);
+
+	CHECK(wait_idle());
+	return 0;
+}
+
+/*
+ * An unanswered MRQ times out without its callback, its channel stays
+ * claimed until the late answer arrives and is then reclaimed.
+ */
+static void never_callback(struct tegra_bpmp_async *req)
+{
+	callback_runs++;
+}
+
+static int test_timeout(void)
+{
+	struct mrq_ping_request ping = { .challenge = 3 };
+	struct mrq_ping_response pong = { 0 };
+	struct tegra_bpmp_async req = {
+		.mrq = MRQ_PING,
+		.ob_data = &ping,
+		.ob_sz = sizeof(ping),
+		.ib_data = &pong,
+		.ib_sz = sizeof(pong),
+		.callback = never_callback,
+	};
+	unsigned int warnings = shim_warnings;
+	unsigned int mul = timeout_mul;
+	int i;
+
+	callback_runs = 0;
+	timeout_mul = 1;
+	mock.drop_mrq = MRQ_PING;
+
+	shim_quiet = 1;
+	CHECK(tegra_bpmp_send_async(&req) == 0);
+	CHECK(tegra_bpmp_wait_async(&req) == -ETIMEDOUT);
+	shim_quiet = 0;
+	timeout_mul = mul;
+
+	CHECK(req.result == -ETIMEDOUT);
+	CHECK(shim_warnings == warnings + 1);
+	CHECK(free_channels() == MOCK_THREAD_CH_CNT - 1);
+
+	/* the other channels still work meanwhile */
+	pong.reply = 0;
+	CHECK(tegra_bpmp_send_receive(MRQ_PING, &ping, sizeof(ping),
+				      &pong, sizeof(pong)) == 0);
+	CHECK(pong.reply == 6);
+
+	pong.reply = 0;
+	mock_release();
+	for (i = 0; i < 2000 && free_channels() < MOCK_THREAD_CH_CNT; i++)
+		sleep_us(1000);
+
+	CHECK(wait_idle());
+	CHECK(callback_runs == 0);
+	/* the late answer is not copied into the abandoned request */
+	CHECK(pong.reply == 0);
+	CHECK(shim_warnings == warnings + 1);
+	return 0;
+}
+
+/*
+ * Benchmark: n independent pings issued one tegra_bpmp_send_receive()
+ * at a time, then as one batch.
+ */
+static double run_serial(int n)
+{
+	struct mrq_ping_request ping;
+	struct mrq_ping_response pong;
+	ktime_t t = ktime_get();
+	int i;
+
+	for (i = 0; i < n; i++) {
+		ping.challenge = i;
+		if (tegra_bpmp_send_receive(MRQ_PING, &ping, sizeof(ping),
+					    &pong, sizeof(pong)))
+			return -1;
+	}
+
+	return (ktime_get() - t) / 1e3;
+}
+
+static double run_batch(int n)
+{
+	struct mrq_ping_request *ping = calloc(n, sizeof(*ping));
+	struct mrq_ping_response *pong = calloc(n, sizeof(*pong));
+	struct tegra_bpmp_async *reqs = calloc(n, sizeof(*reqs));
+	double us = -1;
+	ktime_t t;
+	int i;
+
+	if (!ping || !pong || !reqs)
+		goto out;
+
+	for (i = 0; i < n; i++) {
+		ping[i].challenge = i;
+		reqs[i].mrq = MRQ_PING;
+		reqs[i].ob_data = &ping[i];
+		reqs[i].ob_sz = sizeof(ping[i]);
+		reqs[i].ib_data = &pong[i];
+		reqs[i].ib_sz = sizeof(pong[i]);
+	}
+
+	t = ktime_get();
+	if (!tegra_bpmp_send_receive_batch(reqs, n))
+		us = (ktime_get() - t) / 1e3;
+
+out:
+	free(ping);
+	free(pong);
+	free(reqs);
+	return us;
+}
+
+static int bench(int n, unsigned int latency_us, unsigned int service_us)
+{
+	double serial, batch;
+
+	mock.latency_us = latency_us;
+	mock.service_us = service_us;
+
+	serial = run_serial(n);
+	batch = run_batch(n);
+	CHECK(serial > 0 && batch > 0);
+
+	printf("%d pings, %u thread channels, latency %u us, service %u us\n",
+	       n, MOCK_THREAD_CH_CNT, latency_us, service_us);
+	printf("%8s %10s %10s\n", "mode", "total us", "us/MRQ");
+	printf("%8s %10.0f %10.1f\n", "serial", serial, serial / n);
+	printf("%8s %10.0f %10.1f\n", "batch", batch, batch / n);
+	return 0;
+}
+
+static void watchdog(int sig)
+{
+	static const char msg[] = "FAIL: timed out\n";
+
+	if (write(STDERR_FILENO, msg, sizeof(msg) - 1) < 0)
+		_exit(2);
+	_exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int latency_us = 100;
+	unsigned int service_us = 5;
+	bool do_bench = false;
+	int n = 256;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "bl:n:s:")) != -1) {
+		switch (opt) {
+		case 'b':
+			do_bench = true;
+			break;
+		case 'l':
+			latency_us = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			n = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			service_us = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr,
+				"usage: %s [-b] [-l latency_us] [-s service_us] [-n count]\n",
+				argv[0]);
+			return 2;
+		}
+	}
+
+	signal(SIGALRM, watchdog);
+	if (bpmp_mail_init(&mock_chcfg, &mock_mail_ops, NULL)) {
+		fprintf(stderr, "mail init failed\n");
+		return 1;
+	}
+
+	if (do_bench) {
+		alarm(600);
+		if (n < 1)
+			n = 1;
+		failures = bench(n, latency_us, service_us) ? 1 : 0;
+		mock_disconnect();
+		return failures;
+	}
+
+	alarm(60);
+	test_sync();
+	test_async_wait();
+	test_batch();
+	test_batch_overlap();
+	test_batch_error();
+	test_fire_and_forget();
+	test_timeout();
+
+	mock_disconnect();
+	printf("%s\n", failures ? "FAIL" : "PASS");
+	return failures ? 1 : 0;
+}
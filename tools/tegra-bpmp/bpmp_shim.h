@@ -0,0 +1,261 @@
+/*
+ * Userspace stand-ins for the kernel facilities used by the BPMP mail
+ * layer (drivers/firmware/tegra/mail.c). Locks, semaphores and
+ * completions are backed by pthreads so that the firmware thread of the
+ * mock mail_ops backend can complete requests the way the mailbox irq
+ * does.
+ *
+ * Copyright (c) 2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#ifndef _BPMP_SHIM_H
+#define _BPMP_SHIM_H
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef uint64_t dma_addr_t;
+typedef unsigned int gfp_t;
+typedef unsigned short umode_t;
+
+#define __iomem
+#define __packed		__attribute__((packed))
+
+#define EXPORT_SYMBOL(sym)	extern typeof(sym) sym
+
+#define ETIME			62
+
+/* set by the test to silence expected errors */
+extern int shim_quiet;
+extern unsigned int shim_warnings;
+
+static inline void shim_log(bool show, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (!show)
+		return;
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+}
+
+#define pr_err(fmt, ...)	shim_log(!shim_quiet, fmt, ##__VA_ARGS__)
+#define pr_warn(fmt, ...)	shim_log(!shim_quiet, fmt, ##__VA_ARGS__)
+#define pr_info(fmt, ...)	do { } while (0)
+
+#define WARN_ON(cond) ({ \
+	int __c = !!(cond); \
+	if (__c) { \
+		shim_warnings++; \
+		shim_log(!shim_quiet, "WARNING at %s:%d\n", \
+			 __func__, __LINE__); \
+	} \
+	__c; \
+})
+#define WARN_ON_ONCE(cond)	WARN_ON(cond)
+
+#define __ffs(x)		((unsigned long)__builtin_ctzl(x))
+
+#define GFP_KERNEL		0
+#define kcalloc(n, size, flags)	calloc(n, size)
+#define kfree(ptr)		free(ptr)
+
+#define memcpy_fromio(d, s, n)	memcpy(d, s, n)
+#define memcpy_toio(d, s, n)	memcpy(d, s, n)
+
+struct device_node;
+struct dentry;
+struct file_operations;
+struct platform_device;
+
+/*
+ * Interrupt state. The firmware thread raises it around its calls into
+ * bpmp_handle_irq(), spin_lock_irqsave() raises it for the lock holder.
+ */
+extern __thread int shim_irqs_off;
+
+#define irqs_disabled()		(shim_irqs_off != 0)
+#define smp_processor_id()	0U
+
+typedef struct {
+	pthread_mutex_t m;
+} spinlock_t;
+
+#define DEFINE_SPINLOCK(x)	spinlock_t x = { PTHREAD_MUTEX_INITIALIZER }
+#define DEFINE_RAW_SPINLOCK(x)	DEFINE_SPINLOCK(x)
+
+#define spin_lock(l)		pthread_mutex_lock(&(l)->m)
+#define spin_unlock(l)		pthread_mutex_unlock(&(l)->m)
+#define raw_spin_lock(l)	spin_lock(l)
+#define raw_spin_unlock(l)	spin_unlock(l)
+#define spin_lock_irqsave(l, flags) \
+	do { \
+		(flags) = shim_irqs_off++; \
+		spin_lock(l); \
+	} while (0)
+#define spin_unlock_irqrestore(l, flags) \
+	do { \
+		spin_unlock(l); \
+		shim_irqs_off = (flags); \
+	} while (0)
+
+/* jiffies are milliseconds */
+#define HZ			1000
+#define USEC_PER_SEC		1000000UL
+
+static inline unsigned long usecs_to_jiffies(unsigned long us)
+{
+	return (us + 999) / 1000;
+}
+
+static inline unsigned int jiffies_to_usecs(unsigned long j)
+{
+	return j * 1000;
+}
+
+static inline void shim_deadline(struct timespec *ts, unsigned long j)
+{
+	clock_gettime(CLOCK_REALTIME, ts);
+	ts->tv_sec += j / 1000;
+	ts->tv_nsec += (j % 1000) * 1000000L;
+	if (ts->tv_nsec >= 1000000000L) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000L;
+	}
+}
+
+static inline unsigned long shim_left(const struct timespec *ts)
+{
+	struct timespec now;
+	long ms;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	ms = (ts->tv_sec - now.tv_sec) * 1000 +
+		(ts->tv_nsec - now.tv_nsec) / 1000000L;
+	return ms > 0 ? ms : 1;
+}
+
+typedef int64_t ktime_t;
+
+static inline ktime_t ktime_get(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ktime_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static inline int64_t ktime_us_delta(ktime_t later, ktime_t earlier)
+{
+	return (later - earlier) / 1000;
+}
+
+struct completion {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	unsigned int done;
+};
+
+static inline void init_completion(struct completion *x)
+{
+	pthread_mutex_init(&x->lock, NULL);
+	pthread_cond_init(&x->cond, NULL);
+	x->done = 0;
+}
+
+static inline void complete(struct completion *x)
+{
+	pthread_mutex_lock(&x->lock);
+	x->done++;
+	pthread_cond_broadcast(&x->cond);
+	pthread_mutex_unlock(&x->lock);
+}
+
+static inline unsigned long wait_for_completion_timeout(struct completion *x,
+							unsigned long timeout)
+{
+	struct timespec ts;
+	unsigned long left = 0;
+	int r = 0;
+
+	shim_deadline(&ts, timeout);
+	pthread_mutex_lock(&x->lock);
+	while (!x->done && r != ETIMEDOUT)
+		r = pthread_cond_timedwait(&x->cond, &x->lock, &ts);
+	if (x->done) {
+		x->done--;
+		left = shim_left(&ts);
+	}
+	pthread_mutex_unlock(&x->lock);
+	return left;
+}
+
+struct semaphore {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	unsigned int count;
+};
+
+static inline void sema_init(struct semaphore *sem, int val)
+{
+	pthread_mutex_init(&sem->lock, NULL);
+	pthread_cond_init(&sem->cond, NULL);
+	sem->count = val;
+}
+
+static inline void up(struct semaphore *sem)
+{
+	pthread_mutex_lock(&sem->lock);
+	sem->count++;
+	pthread_cond_signal(&sem->cond);
+	pthread_mutex_unlock(&sem->lock);
+}
+
+static inline int down_timeout(struct semaphore *sem, unsigned long timeout)
+{
+	struct timespec ts;
+	int r = 0;
+
+	shim_deadline(&ts, timeout);
+	pthread_mutex_lock(&sem->lock);
+	while (!sem->count && r != ETIMEDOUT)
+		r = pthread_cond_timedwait(&sem->cond, &sem->lock, &ts);
+	if (sem->count) {
+		sem->count--;
+		r = 0;
+	} else {
+		r = -ETIME;
+	}
+	pthread_mutex_unlock(&sem->lock);
+	return r;
+}
+
+static inline bool tegra_platform_is_silicon(void)
+{
+	return true;
+}
+
+#endif /* _BPMP_SHIM_H */
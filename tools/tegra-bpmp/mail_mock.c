@@ -0,0 +1,266 @@
+/*
+ * Mock mail_ops backend for the BPMP mail layer
+ *
+ * Copyright (c) 2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * The mailboxes are plain memory and a firmware thread plays BPMP: it
+ * picks up signalled channels once their transport latency has passed,
+ * spends a serial service time on each, writes the response, acks the
+ * channel and, for doorbell requests, calls bpmp_handle_irq() the way
+ * the inbound mailbox irq does. MRQ_PING is answered per the ABI, any
+ * other MRQ echoes its request data. Single MRQs can be failed or left
+ * unanswered to drive the error and timeout paths.
+ */
+
+#define MOCK_THREAD_CH_CNT	4
+
+static const struct channel_cfg mock_chcfg = {
+	.channel_mask = 0x3f,
+	.per_cpu_ch_0 = 4,
+	.per_cpu_ch_cnt = 1,
+	.thread_ch_0 = 0,
+	.thread_ch_cnt = MOCK_THREAD_CH_CNT,
+	.ib_ch_0 = 5,
+	.ib_ch_cnt = 1,
+};
+
+enum {
+	MOCK_FREE,
+	MOCK_REQUEST,
+	MOCK_DROPPED,
+	MOCK_ACKED,
+};
+
+struct mock_ch {
+	struct mb_data ob;
+	struct mb_data ib;
+	int state;
+	ktime_t due;
+};
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t thread;
+	bool stop;
+
+	struct mock_ch ch[NR_MAX_CHANNELS];
+
+	/* transport latency, overlaps across channels */
+	unsigned int latency_us;
+	/* firmware time per MRQ, serial */
+	unsigned int service_us;
+	/* answer this MRQ with -fail_code */
+	int fail_mrq;
+	int fail_code;
+	/* leave the next request for this MRQ unanswered */
+	int drop_mrq;
+
+	unsigned long served;
+	unsigned long doorbells;
+} mock = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+	.fail_mrq = -1,
+	.drop_mrq = -1,
+};
+
+static void mock_respond(struct mock_ch *c)
+{
+	struct mrq_ping_request ping;
+	struct mrq_ping_response pong;
+
+	if (c->ob.code == mock.fail_mrq) {
+		c->ib.code = -mock.fail_code;
+		return;
+	}
+
+	c->ib.code = 0;
+	if (c->ob.code == MRQ_PING) {
+		memcpy(&ping, c->ob.data, sizeof(ping));
+		pong.reply = ping.challenge << 1;
+		memcpy(c->ib.data, &pong, sizeof(pong));
+	} else {
+		memcpy(c->ib.data, c->ob.data, sizeof(c->ib.data));
+	}
+}
+
+static void *mock_firmware(void *arg)
+{
+	struct timespec ts;
+	struct mock_ch *c;
+	ktime_t now;
+	int ring;
+	int i;
+
+	pthread_mutex_lock(&mock.lock);
+
+	while (!mock.stop) {
+		c = NULL;
+		for (i = 0; i < NR_MAX_CHANNELS; i++) {
+			if (mock.ch[i].state != MOCK_REQUEST)
+				continue;
+			if (!c || mock.ch[i].due < c->due)
+				c = &mock.ch[i];
+		}
+
+		if (!c) {
+			pthread_cond_wait(&mock.cond, &mock.lock);
+			continue;
+		}
+
+		now = ktime_get();
+		if (c->due > now) {
+			shim_deadline(&ts, 0);
+			ts.tv_nsec += c->due - now;
+			ts.tv_sec += ts.tv_nsec / 1000000000L;
+			ts.tv_nsec %= 1000000000L;
+			pthread_cond_timedwait(&mock.cond, &mock.lock, &ts);
+			continue;
+		}
+
+		if (c->ob.code == mock.drop_mrq) {
+			mock.drop_mrq = -1;
+			c->state = MOCK_DROPPED;
+			continue;
+		}
+
+		pthread_mutex_unlock(&mock.lock);
+
+		if (mock.service_us) {
+			ts.tv_sec = 0;
+			ts.tv_nsec = mock.service_us * 1000L;
+			nanosleep(&ts, NULL);
+		}
+		mock_respond(c);
+		ring = c->ob.flags & RING_DOORBELL;
+
+		pthread_mutex_lock(&mock.lock);
+		c->state = MOCK_ACKED;
+		mock.served++;
+		pthread_mutex_unlock(&mock.lock);
+
+		if (ring) {
+			shim_irqs_off++;
+			bpmp_handle_irq(0);
+			shim_irqs_off--;
+		}
+
+		pthread_mutex_lock(&mock.lock);
+	}
+
+	pthread_mutex_unlock(&mock.lock);
+
+	return NULL;
+}
+
+/* answer the requests left unanswered by drop_mrq */
+static void mock_release(void)
+{
+	int i;
+
+	pthread_mutex_lock(&mock.lock);
+	for (i = 0; i < NR_MAX_CHANNELS; i++) {
+		if (mock.ch[i].state == MOCK_DROPPED) {
+			mock.ch[i].state = MOCK_REQUEST;
+			mock.ch[i].due = ktime_get();
+		}
+	}
+	pthread_cond_signal(&mock.cond);
+	pthread_mutex_unlock(&mock.lock);
+}
+
+static int mock_state(int ch)
+{
+	int state;
+
+	pthread_mutex_lock(&mock.lock);
+	state = mock.ch[ch].state;
+	pthread_mutex_unlock(&mock.lock);
+
+	return state;
+}
+
+static void mock_set_state(int ch, int state)
+{
+	pthread_mutex_lock(&mock.lock);
+	mock.ch[ch].state = state;
+	if (state == MOCK_REQUEST) {
+		mock.ch[ch].due = ktime_get() + mock.latency_us * 1000LL;
+		pthread_cond_signal(&mock.cond);
+	}
+	pthread_mutex_unlock(&mock.lock);
+}
+
+static bool mock_master_free(const struct mail_ops *ops, int ch)
+{
+	return mock_state(ch) == MOCK_FREE;
+}
+
+static void mock_free_master(const struct mail_ops *ops, int ch)
+{
+	mock_set_state(ch, MOCK_FREE);
+}
+
+static bool mock_master_acked(const struct mail_ops *ops, int ch)
+{
+	return mock_state(ch) == MOCK_ACKED;
+}
+
+static void mock_signal_slave(const struct mail_ops *ops, int ch)
+{
+	mock_set_state(ch, MOCK_REQUEST);
+}
+
+/* BPMP never initiates MRQs here */
+static bool mock_slave_signalled(const struct mail_ops *ops, int ch)
+{
+	return false;
+}
+
+static void mock_ring_doorbell(int ch)
+{
+	__atomic_fetch_add(&mock.doorbells, 1, __ATOMIC_RELAXED);
+}
+
+static int mock_connect(const struct channel_cfg *cfg,
+		const struct mail_ops *ops, struct device_node *of_node)
+{
+	int i;
+
+	for (i = 0; i < NR_MAX_CHANNELS; i++) {
+		channel_area[i].ob = &mock.ch[i].ob;
+		channel_area[i].ib = &mock.ch[i].ib;
+	}
+
+	return pthread_create(&mock.thread, NULL, mock_firmware, NULL) ?
+		-ENOMEM : 0;
+}
+
+static void mock_disconnect(void)
+{
+	pthread_mutex_lock(&mock.lock);
+	mock.stop = true;
+	pthread_cond_signal(&mock.cond);
+	pthread_mutex_unlock(&mock.lock);
+	pthread_join(mock.thread, NULL);
+}
+
+static const struct mail_ops mock_mail_ops = {
+	.connect = mock_connect,
+	.master_free = mock_master_free,
+	.free_master = mock_free_master,
+	.master_acked = mock_master_acked,
+	.signal_slave = mock_signal_slave,
+	.slave_signalled = mock_slave_signalled,
+	.ring_doorbell = mock_ring_doorbell,
+};
@@ -0,0 +1,1113 @@
+/*
+ * gr_comm_loopback - unit test and benchmark for the graphics
+ * virtualization communication framework
+ * (drivers/video/tegra/virt/tegra_gr_comm.c), built in userspace against
+ * the shims in include/linux and a loopback vhost server.
+ *
+ * Copyright (c) 2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Example Usage:
+ *	gr_comm_loopback			run the unit tests
+ *	gr_comm_loopback -b			benchmark with 1 to 8 threads
+ *	gr_comm_loopback -b -l 100 -n 2000	100 us server latency,
+ *						2000 requests per thread
+ *
+ * The server answers each request a fixed latency after it is read from
+ * the IVC queue (with -j, a random latency of up to twice that, so
+ * responses are reordered) and can work on many requests at once, like a
+ * server with several engines behind it.
+ *
+ * With loop_syncpt_server set, the server also answers syncpoint reads
+ * and publishes a syncpoint shadow in the CMD queue mempool, so that the
+ * shadow code of vhost_syncpt.c, cut out by the Makefile, runs against it.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include <linux/kernel.h>
+#include <linux/tegra_vhost.h>
+
+#include "tegra_gr_comm.c"
+
+int shim_quiet;
+unsigned int shim_warnings;
+
+static int failures;
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s:%d: check failed: %s\n", \
+				__func__, __LINE__, #cond); \
+			failures++; \
+			return -1; \
+		} \
+	} while (0)
+
+/*
+ * Loopback server
+ */
+
+#define LOOP_PEER		1
+#define LOOP_NR_CHANS		2
+#define LOOP_NFRAMES		16
+#define LOOP_MAX_INFLIGHT	64
+
+struct loop_ring {
+	char *frames;
+	unsigned int head;	/* frames written */
+	unsigned int tail;	/* frames read */
+};
+
+struct loop_req {
+	u64 due;
+	char *frame;
+};
+
+struct loop_chan {
+	struct tegra_hv_ivc_cookie cookie;
+	pthread_mutex_t lock;
+	pthread_cond_t server_cond;
+	pthread_cond_t irq_cond;
+	struct loop_ring to_server;
+	struct loop_ring to_guest;
+	struct loop_req inflight[LOOP_MAX_INFLIGHT];
+	unsigned int num_inflight;
+	unsigned int irq_pending;
+	irq_handler_t thread_fn;
+	void *dev_id;
+	pthread_t server_thread;
+	pthread_t irq_thread;
+	bool irq_running;
+	bool stop;
+	/* statistics */
+	unsigned long requests;
+	unsigned long reordered;
+	u32 last_tag;
+};
+
+static struct loop_chan loop_chans[LOOP_NR_CHANS];
+static struct device_node *loop_dn = (struct device_node *)&loop_chans;
+
+/* server behaviour */
+static unsigned int loop_latency_us = 20;
+static bool loop_jitter;
+static bool loop_echo_tags = true;
+
+/* CMD queue mempool, none if the size is 0 */
+static size_t loop_mempool_size;
+static struct tegra_hv_ivm_cookie loop_mempool;
+
+/* syncpoint server */
+#define LOOP_NR_SYNCPTS		16
+
+static bool loop_syncpt_server;
+/* syncpoints published in the shadow, 0 for a server without one */
+static u32 loop_shadow_num;
+static struct tegra_vhost_syncpt_shadow *loop_shadow;
+static u32 loop_syncpt_val[LOOP_NR_SYNCPTS];
+static unsigned long loop_syncpt_reads;
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static u64 loop_latency_ns(void)
+{
+	u64 ns = (u64)loop_latency_us * 1000;
+
+	if (loop_jitter)
+		ns = ns * (rand() % 201) / 100;
+	return ns;
+}
+
+static bool ring_full(const struct loop_chan *c, const struct loop_ring *r)
+{
+	return r->head - r->tail == (unsigned int)c->cookie.nframes;
+}
+
+static bool ring_empty(const struct loop_ring *r)
+{
+	return r->head == r->tail;
+}
+
+static char *ring_frame(const struct loop_chan *c, const struct loop_ring *r,
+			unsigned int idx)
+{
+	return r->frames + (idx % c->cookie.nframes) * c->cookie.frame_size;
+}
+
+/* called with c->lock held */
+static void loop_raise_irq(struct loop_chan *c)
+{
+	c->irq_pending = 1;
+	pthread_cond_signal(&c->irq_cond);
+}
+
+/* the server side of the syncpoint commands */
+static void loop_answer_syncpt(struct tegra_vhost_cmd_msg *msg)
+{
+	struct tegra_vhost_syncpt_shadow_params *sh =
+		&msg->params.syncpt_shadow;
+	struct tegra_vhost_syncpt_params *p = &msg->params.syncpt;
+	u32 i;
+
+	switch (msg->cmd) {
+	case TEGRA_VHOST_CMD_SYNCPT_SHADOW:
+		if (!loop_shadow_num || !loop_mempool.ipa) {
+			msg->ret = -ENOSYS;
+			break;
+		}
+		loop_shadow = (void *)(uintptr_t)(loop_mempool.ipa +
+						  sh->offset);
+		loop_shadow->num_syncpts = loop_shadow_num;
+		for (i = 0; i < loop_shadow_num && i < LOOP_NR_SYNCPTS; i++)
+			loop_shadow->val[i] = loop_syncpt_val[i];
+		sh->num_syncpts = loop_shadow_num;
+		break;
+	case TEGRA_VHOST_CMD_SYNCPT_READ:
+		if (p->id >= LOOP_NR_SYNCPTS) {
+			msg->ret = -EINVAL;
+			break;
+		}
+		p->val = loop_syncpt_val[p->id];
+		loop_syncpt_reads++;
+		break;
+	}
+}
+
+/* the syncpoint moves on the server, and in the shadow if it has one */
+static void loop_syncpt_set(u32 id, u32 val)
+{
+	loop_syncpt_val[id] = val;
+	if (loop_shadow && id < loop_shadow->num_syncpts)
+		loop_shadow->val[id] = val;
+}
+
+/*
+ * Answer a request the way a vhost server does: the response is the
+ * request with ret filled in. A server without tag support builds its
+ * response from scratch and leaves the tag word zero.
+ */
+static void loop_answer(struct loop_chan *c, char *frame)
+{
+	struct tegra_vhost_cmd_msg *msg = (struct tegra_vhost_cmd_msg *)frame;
+	u32 *tag = (u32 *)(frame + TEGRA_VHOST_CMD_TAG_OFFSET);
+
+	msg->ret = 0;
+	if (loop_syncpt_server && c == &loop_chans[TEGRA_VHOST_QUEUE_CMD])
+		loop_answer_syncpt(msg);
+	if (!loop_echo_tags)
+		*tag = 0;
+	else if (*tag < c->last_tag)
+		c->reordered++;
+	c->last_tag = *tag;
+	c->requests++;
+}
+
+static void *loop_server(void *arg)
+{
+	struct loop_chan *c = arg;
+	unsigned int i, first;
+	struct timespec ts;
+	u64 now, due;
+
+	pthread_mutex_lock(&c->lock);
+	while (!c->stop) {
+		now = now_ns();
+
+		/* take new requests */
+		while (!ring_empty(&c->to_server) &&
+		       c->num_inflight < LOOP_MAX_INFLIGHT) {
+			struct loop_req *req = &c->inflight[c->num_inflight++];
+
+			memcpy(req->frame, ring_frame(c, &c->to_server,
+						      c->to_server.tail),
+			       c->cookie.frame_size);
+			c->to_server.tail++;
+			req->due = now + loop_latency_ns();
+			loop_raise_irq(c);
+		}
+
+		/* answer the requests that are due, earliest first */
+		while (c->num_inflight && !ring_full(c, &c->to_guest)) {
+			struct loop_req tmp;
+
+			first = 0;
+			for (i = 1; i < c->num_inflight; i++)
+				if (c->inflight[i].due < c->inflight[first].due)
+					first = i;
+			if (c->inflight[first].due > now)
+				break;
+
+			loop_answer(c, c->inflight[first].frame);
+			memcpy(ring_frame(c, &c->to_guest, c->to_guest.head),
+			       c->inflight[first].frame, c->cookie.frame_size);
+			c->to_guest.head++;
+			loop_raise_irq(c);
+
+			tmp = c->inflight[first];
+			c->inflight[first] = c->inflight[--c->num_inflight];
+			c->inflight[c->num_inflight] = tmp;
+		}
+
+		/* sleep until a request arrives or the next one is due */
+		due = 0;
+		if (c->num_inflight && !ring_full(c, &c->to_guest)) {
+			due = c->inflight[0].due;
+			for (i = 1; i < c->num_inflight; i++)
+				if (c->inflight[i].due < due)
+					due = c->inflight[i].due;
+		}
+		if (due) {
+			ts.tv_sec = due / 1000000000ULL;
+			ts.tv_nsec = due % 1000000000ULL;
+			pthread_cond_timedwait(&c->server_cond, &c->lock, &ts);
+		} else {
+			pthread_cond_wait(&c->server_cond, &c->lock);
+		}
+	}
+	pthread_mutex_unlock(&c->lock);
+
+	return NULL;
+}
+
+static void *loop_irq_thread(void *arg)
+{
+	struct loop_chan *c = arg;
+
+	pthread_mutex_lock(&c->lock);
+	for (;;) {
+		while (!c->irq_pending && c->irq_running)
+			pthread_cond_wait(&c->irq_cond, &c->lock);
+		if (!c->irq_running)
+			break;
+		c->irq_pending = 0;
+		pthread_mutex_unlock(&c->lock);
+		c->thread_fn(c->cookie.irq, c->dev_id);
+		pthread_mutex_lock(&c->lock);
+	}
+	pthread_mutex_unlock(&c->lock);
+
+	return NULL;
+}
+
+static void loop_start(void)
+{
+	pthread_condattr_t attr;
+	int i, j;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+
+	for (i = 0; i < LOOP_NR_CHANS; i++) {
+		struct loop_chan *c = &loop_chans[i];
+		int frame_size = i == TEGRA_VHOST_QUEUE_CMD ?
+			sizeof(struct tegra_vhost_cmd_msg) : 4096;
+
+		memset(c, 0, sizeof(*c));
+		c->cookie.irq = i;
+		c->cookie.peer_vmid = LOOP_PEER;
+		c->cookie.nframes = LOOP_NFRAMES;
+		c->cookie.frame_size = frame_size;
+		c->to_server.frames = calloc(LOOP_NFRAMES, frame_size);
+		c->to_guest.frames = calloc(LOOP_NFRAMES, frame_size);
+		for (j = 0; j < LOOP_MAX_INFLIGHT; j++)
+			c->inflight[j].frame = calloc(1, frame_size);
+		pthread_mutex_init(&c->lock, NULL);
+		pthread_cond_init(&c->server_cond, &attr);
+		pthread_cond_init(&c->irq_cond, NULL);
+		pthread_create(&c->server_thread, NULL, loop_server, c);
+	}
+
+	pthread_condattr_destroy(&attr);
+
+	memset(&loop_mempool, 0, sizeof(loop_mempool));
+	if (loop_mempool_size) {
+		loop_mempool.ipa = (uintptr_t)calloc(1, loop_mempool_size);
+		loop_mempool.size = loop_mempool_size;
+		loop_mempool.peer_vmid = LOOP_PEER;
+	}
+	loop_shadow = NULL;
+	loop_syncpt_reads = 0;
+}
+
+static void loop_stop(void)
+{
+	int i, j;
+
+	for (i = 0; i < LOOP_NR_CHANS; i++) {
+		struct loop_chan *c = &loop_chans[i];
+
+		pthread_mutex_lock(&c->lock);
+		c->stop = true;
+		pthread_cond_signal(&c->server_cond);
+		pthread_mutex_unlock(&c->lock);
+		pthread_join(c->server_thread, NULL);
+
+		free(c->to_server.frames);
+		free(c->to_guest.frames);
+		for (j = 0; j < LOOP_MAX_INFLIGHT; j++)
+			free(c->inflight[j].frame);
+	}
+
+	free((void *)(uintptr_t)loop_mempool.ipa);
+}
+
+/*
+ * Kernel interfaces backed by the loopback server
+ */
+
+int of_property_read_u32_index(const struct device_node *np,
+			       const char *propname, u32 index, u32 *out)
+{
+	unsigned int queue;
+
+	if (sscanf(propname, "mempool%u", &queue) == 1) {
+		if (queue != TEGRA_VHOST_QUEUE_CMD || !loop_mempool_size)
+			return -EINVAL;
+		*out = queue;
+		return 0;
+	}
+
+	if (sscanf(propname, "ivc-queue%u", &queue) != 1 ||
+	    queue >= LOOP_NR_CHANS)
+		return -EINVAL;
+
+	*out = queue;
+	return 0;
+}
+
+struct device_node *of_parse_phandle(const struct device_node *np,
+				     const char *propname, int index)
+{
+	return loop_dn;
+}
+
+int request_threaded_irq(unsigned int irq, irq_handler_t handler,
+			 irq_handler_t thread_fn, unsigned long flags,
+			 const char *name, void *dev_id)
+{
+	struct loop_chan *c = &loop_chans[irq];
+
+	c->thread_fn = thread_fn;
+	c->dev_id = dev_id;
+	c->irq_running = true;
+	return pthread_create(&c->irq_thread, NULL, loop_irq_thread, c);
+}
+
+void free_irq(unsigned int irq, void *dev_id)
+{
+	struct loop_chan *c = &loop_chans[irq];
+
+	pthread_mutex_lock(&c->lock);
+	c->irq_running = false;
+	pthread_cond_signal(&c->irq_cond);
+	pthread_mutex_unlock(&c->lock);
+	pthread_join(c->irq_thread, NULL);
+}
+
+struct tegra_hv_ivc_cookie *tegra_hv_ivc_reserve(struct device_node *dn,
+		int id, const void *ops)
+{
+	return &loop_chans[id].cookie;
+}
+
+int tegra_hv_ivc_unreserve(struct tegra_hv_ivc_cookie *ivck)
+{
+	return 0;
+}
+
+static struct loop_chan *to_chan(struct tegra_hv_ivc_cookie *ivck)
+{
+	return container_of(ivck, struct loop_chan, cookie);
+}
+
+int tegra_hv_ivc_write(struct tegra_hv_ivc_cookie *ivck, const void *buf,
+		int size)
+{
+	struct loop_chan *c = to_chan(ivck);
+
+	if (size > ivck->frame_size)
+		return -E2BIG;
+
+	pthread_mutex_lock(&c->lock);
+	if (ring_full(c, &c->to_server)) {
+		pthread_mutex_unlock(&c->lock);
+		return -ENOMEM;
+	}
+	memcpy(ring_frame(c, &c->to_server, c->to_server.head), buf, size);
+	c->to_server.head++;
+	pthread_cond_signal(&c->server_cond);
+	pthread_mutex_unlock(&c->lock);
+
+	return size;
+}
+
+int tegra_hv_ivc_read(struct tegra_hv_ivc_cookie *ivck, void *buf, int size)
+{
+	struct loop_chan *c = to_chan(ivck);
+
+	if (size > ivck->frame_size)
+		return -E2BIG;
+
+	pthread_mutex_lock(&c->lock);
+	if (ring_empty(&c->to_guest)) {
+		pthread_mutex_unlock(&c->lock);
+		return -ENOMEM;
+	}
+	memcpy(buf, ring_frame(c, &c->to_guest, c->to_guest.tail), size);
+	c->to_guest.tail++;
+	pthread_cond_signal(&c->server_cond);
+	pthread_mutex_unlock(&c->lock);
+
+	return size;
+}
+
+int tegra_hv_ivc_can_read(struct tegra_hv_ivc_cookie *ivck)
+{
+	struct loop_chan *c = to_chan(ivck);
+	int ret;
+
+	pthread_mutex_lock(&c->lock);
+	ret = !ring_empty(&c->to_guest);
+	pthread_mutex_unlock(&c->lock);
+
+	return ret;
+}
+
+int tegra_hv_ivc_can_write(struct tegra_hv_ivc_cookie *ivck)
+{
+	struct loop_chan *c = to_chan(ivck);
+	int ret;
+
+	pthread_mutex_lock(&c->lock);
+	ret = !ring_full(c, &c->to_server);
+	pthread_mutex_unlock(&c->lock);
+
+	return ret;
+}
+
+int tegra_hv_ivc_channel_notified(struct tegra_hv_ivc_cookie *ivck)
+{
+	return 0;
+}
+
+void tegra_hv_ivc_channel_reset(struct tegra_hv_ivc_cookie *ivck)
+{
+}
+
+struct tegra_hv_ivm_cookie *tegra_hv_mempool_reserve(unsigned int id)
+{
+	return loop_mempool.ipa ? &loop_mempool : ERR_PTR(-ENODEV);
+}
+
+int tegra_hv_mempool_unreserve(struct tegra_hv_ivm_cookie *ck)
+{
+	return 0;
+}
+
+/*
+ * Guest side, set up the way vhost does it
+ */
+
+static struct platform_device loop_pdev;
+
+static int comm_init(bool tagged)
+{
+	size_t queue_sizes[] = { TEGRA_VHOST_QUEUE_SIZES };
+	int err;
+
+	loop_start();
+	err = tegra_gr_comm_init(&loop_pdev, LOOP_NR_CHANS, queue_sizes,
+				TEGRA_VHOST_QUEUE_CMD, LOOP_NR_CHANS);
+	if (err || !tagged)
+		return err;
+
+	err = tegra_gr_comm_set_tag_offset(TEGRA_VHOST_QUEUE_CMD,
+				TEGRA_VHOST_CMD_TAG_OFFSET);
+	if (!err)
+		err = tegra_gr_comm_set_tag_offset(TEGRA_VHOST_QUEUE_PB,
+				TEGRA_VHOST_CMD_TAG_OFFSET);
+	return err;
+}
+
+static void comm_deinit(void)
+{
+	tegra_gr_comm_deinit(TEGRA_VHOST_QUEUE_CMD, LOOP_NR_CHANS);
+	loop_stop();
+}
+
+/* vhost_sendrecv() */
+static int cmd_sendrecv(struct tegra_vhost_cmd_msg *msg, bool tagged)
+{
+	void *handle;
+	size_t size = sizeof(*msg);
+	void *data = msg;
+	int err;
+
+	if (tagged)
+		err = tegra_gr_comm_sendrecv_tagged(LOOP_PEER,
+				TEGRA_VHOST_QUEUE_CMD, &handle, &data, &size);
+	else
+		err = tegra_gr_comm_sendrecv(LOOP_PEER,
+				TEGRA_VHOST_QUEUE_CMD, &handle, &data, &size);
+	if (!err) {
+		memcpy(msg, data, sizeof(*msg));
+		tegra_gr_comm_release(handle);
+	}
+
+	return err;
+}
+
+/*
+ * The syncpoint shadow of vhost_syncpt.c, from vhost_syncpt_read() up to
+ * vhost_syncpt_cpu_incr(), with just enough of nvhost around it
+ */
+
+#define INVALID_REG_VAL		0xdeadcafe
+
+/* as in vhost.h */
+struct nvhost_virt_ctx {
+	u64 handle;
+	struct tegra_vhost_syncpt_shadow __iomem *syncpt_shadow;
+	u32 syncpt_shadow_num;
+	void *syncpt_shadow_oob;
+};
+
+typedef struct {
+	int counter;
+} atomic_t;
+
+static inline int atomic_cmpxchg(atomic_t *v, int old, int new)
+{
+	__atomic_compare_exchange_n(&v->counter, &old, new, false,
+				    __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+	return old;
+}
+
+struct nvhost_master {
+	struct nvhost_virt_ctx *dev;
+};
+
+struct nvhost_syncpt {
+	atomic_t min_val[LOOP_NR_SYNCPTS];
+	struct nvhost_master host;
+};
+
+#define syncpt_to_dev(sp)		(&(sp)->host)
+#define nvhost_get_virt_data(ctx)	(ctx)
+#define nvhost_syncpt_read_min(sp, id) \
+	__atomic_load_n(&(sp)->min_val[id].counter, __ATOMIC_SEQ_CST)
+
+static int vhost_sendrecv(struct tegra_vhost_cmd_msg *msg)
+{
+	return cmd_sendrecv(msg, true);
+}
+
+#include "vhost_syncpt_shadow.c"
+
+struct cmd_thread {
+	pthread_t thread;
+	unsigned int id;
+	unsigned int count;
+	bool tagged;
+	unsigned int mismatches;
+	int err;
+};
+
+static void *cmd_thread_fn(void *arg)
+{
+	struct cmd_thread *t = arg;
+	struct tegra_vhost_cmd_msg msg;
+	unsigned int i;
+
+	for (i = 0; i < t->count; i++) {
+		memset(&msg, 0, sizeof(msg));
+		msg.cmd = TEGRA_VHOST_CMD_SYNCPT_READ;
+		msg.ret = -1;
+		msg.handle = (u64)t->id << 32 | i;
+		msg.params.regrdwr.regs[REGRDWR_ARRAY_SIZE - 1] = ~i;
+
+		t->err = cmd_sendrecv(&msg, t->tagged);
+		if (t->err)
+			break;
+		if (msg.ret || msg.handle != ((u64)t->id << 32 | i) ||
+		    msg.params.regrdwr.regs[REGRDWR_ARRAY_SIZE - 1] != ~i)
+			t->mismatches++;
+	}
+
+	return NULL;
+}
+
+/* runs nr_threads callers of count requests each, returns the time in ns */
+static u64 run_cmd_threads(unsigned int nr_threads, unsigned int count,
+			   bool tagged, unsigned int *mismatches, int *err)
+{
+	struct cmd_thread *t = calloc(nr_threads, sizeof(*t));
+	unsigned int i;
+	u64 start;
+
+	*mismatches = 0;
+	*err = 0;
+	start = now_ns();
+	for (i = 0; i < nr_threads; i++) {
+		t[i].id = i;
+		t[i].count = count;
+		t[i].tagged = tagged;
+		pthread_create(&t[i].thread, NULL, cmd_thread_fn, &t[i]);
+	}
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(t[i].thread, NULL);
+		*mismatches += t[i].mismatches;
+		if (t[i].err)
+			*err = t[i].err;
+	}
+	start = now_ns() - start;
+	free(t);
+
+	return start;
+}
+
+/* vhost_channel_submit() with a tagging server */
+
+#define SUBMIT_PAYLOAD	256
+
+static unsigned int async_done;
+static unsigned int async_bad;
+static unsigned char *async_seen;
+
+static void submit_done(void *priv, void *data, size_t size)
+{
+	struct tegra_vhost_cmd_msg *msg = data;
+	unsigned int id = (unsigned int)(uintptr_t)priv;
+	unsigned char *payload = (unsigned char *)(msg + 1);
+
+	if (size < sizeof(*msg) + SUBMIT_PAYLOAD || msg->ret ||
+	    msg->params.cdma_submit.job_id != id ||
+	    payload[0] != (unsigned char)id ||
+	    payload[SUBMIT_PAYLOAD - 1] != (unsigned char)~id)
+		__atomic_add_fetch(&async_bad, 1, __ATOMIC_SEQ_CST);
+	if (async_seen)
+		async_seen[id]++;
+	__atomic_add_fetch(&async_done, 1, __ATOMIC_SEQ_CST);
+}
+
+static int submit_async(unsigned int id)
+{
+	struct tegra_vhost_cmd_msg *msg;
+	unsigned char *payload;
+	size_t buf_size;
+	void *buf;
+	int err;
+
+	buf = tegra_gr_comm_get_buf(TEGRA_VHOST_QUEUE_PB, (void **)&msg,
+				&buf_size);
+	if (!buf)
+		return -ENOMEM;
+
+	memset(msg, 0, sizeof(*msg));
+	msg->cmd = TEGRA_VHOST_CMD_HOST1X_CDMA_SUBMIT;
+	msg->params.cdma_submit.job_id = id;
+	payload = (unsigned char *)(msg + 1);
+	memset(payload, 0, SUBMIT_PAYLOAD);
+	payload[0] = id;
+	payload[SUBMIT_PAYLOAD - 1] = ~id;
+
+	err = tegra_gr_comm_send_async(LOOP_PEER, TEGRA_VHOST_QUEUE_PB, msg,
+				sizeof(*msg) + SUBMIT_PAYLOAD, submit_done,
+				(void *)(uintptr_t)id);
+	tegra_gr_comm_release(buf);
+
+	return err;
+}
+
+struct submit_thread {
+	pthread_t thread;
+	unsigned int first;
+	unsigned int count;
+	int err;
+};
+
+static void *submit_thread_fn(void *arg)
+{
+	struct submit_thread *t = arg;
+	unsigned int i;
+
+	for (i = 0; i < t->count && !t->err; i++)
+		t->err = submit_async(t->first + i);
+
+	return NULL;
+}
+
+static bool wait_async(unsigned int count)
+{
+	u64 deadline = now_ns() + 10000000000ULL;
+
+	while (__atomic_load_n(&async_done, __ATOMIC_SEQ_CST) < count) {
+		if (now_ns() > deadline)
+			return false;
+		sched_yield();
+	}
+	return true;
+}
+
+static u64 run_submit_threads(unsigned int nr_threads, unsigned int count,
+			      int *err)
+{
+	struct submit_thread *t = calloc(nr_threads, sizeof(*t));
+	unsigned int i;
+	u64 start;
+
+	async_done = 0;
+	async_bad = 0;
+	*err = 0;
+	start = now_ns();
+	for (i = 0; i < nr_threads; i++) {
+		t[i].first = i * count;
+		t[i].count = count;
+		pthread_create(&t[i].thread, NULL, submit_thread_fn, &t[i]);
+	}
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(t[i].thread, NULL);
+		if (t[i].err)
+			*err = t[i].err;
+	}
+	if (!wait_async(nr_threads * count))
+		*err = -ETIMEDOUT;
+	start = now_ns() - start;
+	free(t);
+
+	return start;
+}
+
+/*
+ * Unit tests
+ */
+
+/* an old server and untagged queues: one request in flight at a time */
+static int test_untagged(void)
+{
+	unsigned int mismatches;
+	int err;
+
+	loop_echo_tags = false;
+	loop_jitter = false;
+	CHECK(!comm_init(false));
+	run_cmd_threads(4, 50, false, &mismatches, &err);
+	comm_deinit();
+	loop_echo_tags = true;
+
+	CHECK(!err);
+	CHECK(!mismatches);
+	CHECK(loop_chans[TEGRA_VHOST_QUEUE_CMD].requests == 200);
+	return 0;
+}
+
+/* responses reordered by the server still reach the right caller */
+static int test_tagged_reorder(void)
+{
+	unsigned long reordered;
+	unsigned int mismatches;
+	int err;
+
+	loop_jitter = true;
+	CHECK(!comm_init(true));
+	run_cmd_threads(8, 200, true, &mismatches, &err);
+	reordered = loop_chans[TEGRA_VHOST_QUEUE_CMD].reordered;
+	comm_deinit();
+	loop_jitter = false;
+
+	CHECK(!err);
+	CHECK(!mismatches);
+	CHECK(loop_chans[TEGRA_VHOST_QUEUE_CMD].requests == 1600);
+	/* otherwise the test did not exercise out of order matching */
+	CHECK(reordered > 0);
+	return 0;
+}
+
+/* every async submit completes exactly once, with its own payload */
+static int test_async(void)
+{
+	const unsigned int nr_threads = 4, count = 250;
+	unsigned int i;
+	int err;
+
+	async_seen = calloc(nr_threads * count, 1);
+	loop_jitter = true;
+	CHECK(!comm_init(true));
+	run_submit_threads(nr_threads, count, &err);
+	comm_deinit();
+	loop_jitter = false;
+
+	CHECK(!err);
+	CHECK(!async_bad);
+	for (i = 0; i < nr_threads * count; i++)
+		CHECK(async_seen[i] == 1);
+	free(async_seen);
+	async_seen = NULL;
+	return 0;
+}
+
+/* async sends need tag matching, and pooled buffers are queue sized */
+static int test_async_untagged(void)
+{
+	struct tegra_vhost_cmd_msg *msg;
+	size_t size;
+	void *buf;
+
+	CHECK(!comm_init(false));
+	buf = tegra_gr_comm_get_buf(TEGRA_VHOST_QUEUE_PB, (void **)&msg,
+				&size);
+	CHECK(buf);
+	CHECK(size == 4096);
+	CHECK(tegra_gr_comm_send_async(LOOP_PEER, TEGRA_VHOST_QUEUE_PB, msg,
+				sizeof(*msg), submit_done, NULL) == -EINVAL);
+	tegra_gr_comm_release(buf);
+	comm_deinit();
+	return 0;
+}
+
+static struct nvhost_virt_ctx shadow_ctx;
+static struct nvhost_syncpt shadow_sp;
+
+static int shadow_init(void)
+{
+	memset(&shadow_ctx, 0, sizeof(shadow_ctx));
+	memset(&shadow_sp, 0, sizeof(shadow_sp));
+	memset(loop_syncpt_val, 0, sizeof(loop_syncpt_val));
+	shadow_ctx.handle = 1;
+	shadow_sp.host.dev = &shadow_ctx;
+	loop_syncpt_server = true;
+	shim_warnings = 0;
+
+	if (comm_init(true))
+		return -EIO;
+	return vhost_syncpt_shadow_init(&shadow_ctx);
+}
+
+static void shadow_deinit(void)
+{
+	vhost_syncpt_shadow_deinit(&shadow_ctx);
+	comm_deinit();
+	loop_syncpt_server = false;
+	loop_mempool_size = 0;
+	loop_shadow_num = 0;
+}
+
+/* the mempool can be had again, i.e. no one holds a claim on it */
+static bool mempool_free(void)
+{
+	void *handle, *ptr;
+	size_t size;
+
+	handle = tegra_gr_comm_oob_get_ptr(LOOP_PEER, TEGRA_VHOST_QUEUE_CMD,
+				&ptr, &size);
+	if (handle)
+		tegra_gr_comm_oob_put_ptr(handle);
+	return handle;
+}
+
+/* syncpoints are read from the shadow while it covers them */
+static int test_syncpt_shadow(void)
+{
+	unsigned long reads;
+	void *ptr;
+	size_t size;
+
+	loop_mempool_size = 4096;
+	loop_shadow_num = 8;
+	CHECK(!shadow_init());
+	CHECK(shadow_ctx.syncpt_shadow);
+	CHECK(shadow_ctx.syncpt_shadow_num == 8);
+
+	/* the server writes the shadow until deinit, it stays claimed */
+	CHECK(!mempool_free());
+	CHECK(!tegra_gr_comm_oob_claim(LOOP_PEER, TEGRA_VHOST_QUEUE_CMD,
+				&ptr, &size));
+
+	reads = loop_syncpt_reads;
+	loop_syncpt_set(3, 5);
+	CHECK(vhost_syncpt_update_min(&shadow_sp, 3) == 5);
+	CHECK(loop_syncpt_reads == reads);
+
+	/* ids past the shadow are read from the server */
+	loop_syncpt_set(12, 7);
+	CHECK(vhost_syncpt_update_min(&shadow_sp, 12) == 7);
+	CHECK(loop_syncpt_reads == reads + 1);
+
+	/* so is a shadow that is behind the cached minimum */
+	shadow_sp.min_val[3].counter = 9;
+	loop_syncpt_val[3] = 9;
+	CHECK(vhost_syncpt_update_min(&shadow_sp, 3) == 9);
+	CHECK(loop_syncpt_reads == reads + 2);
+
+	/* and ids the server has dropped from the shadow header */
+	loop_syncpt_set(3, 10);
+	loop_shadow->num_syncpts = 2;
+	loop_syncpt_val[3] = 11;
+	CHECK(vhost_syncpt_update_min(&shadow_sp, 3) == 11);
+	CHECK(loop_syncpt_reads == reads + 3);
+
+	vhost_syncpt_shadow_deinit(&shadow_ctx);
+	CHECK(!shadow_ctx.syncpt_shadow);
+	CHECK(mempool_free());
+	shadow_deinit();
+	CHECK(!shim_warnings);
+	return 0;
+}
+
+/* without a usable shadow, the mempool is left alone and reads use RPC */
+static int test_syncpt_shadow_fallback(void)
+{
+	/* no mempool */
+	CHECK(shadow_init() == -ENOSYS);
+	loop_syncpt_set(1, 4);
+	CHECK(vhost_syncpt_update_min(&shadow_sp, 1) == 4);
+	CHECK(loop_syncpt_reads == 1);
+	shadow_deinit();
+
+	/* a server without shadow support */
+	loop_mempool_size = 4096;
+	CHECK(shadow_init() == -ENOSYS);
+	CHECK(!shadow_ctx.syncpt_shadow);
+	CHECK(mempool_free());
+	shadow_deinit();
+
+	/* a server that claims more syncpoints than the mempool holds */
+	loop_mempool_size = 4096;
+	loop_shadow_num = 4096;
+	CHECK(shadow_init() == -EINVAL);
+	CHECK(!shadow_ctx.syncpt_shadow);
+	CHECK(mempool_free());
+	shadow_deinit();
+	CHECK(!shim_warnings);
+	return 0;
+}
+
+static void run_tests(void)
+{
+	test_untagged();
+	test_tagged_reorder();
+	test_async();
+	test_async_untagged();
+	test_syncpt_shadow();
+	test_syncpt_shadow_fallback();
+}
+
+/*
+ * Benchmark
+ */
+
+static void bench(unsigned int count)
+{
+	static const unsigned int threads[] = { 1, 2, 4, 8 };
+	unsigned int i, mismatches;
+	u64 ns;
+	int err;
+
+	printf("server latency %u us%s, %u requests per thread\n",
+	       loop_latency_us, loop_jitter ? " (jittered)" : "", count);
+	printf("%-10s %8s %12s %12s\n", "mode", "threads", "req/s",
+	       "us/req");
+
+	for (i = 0; i < ARRAY_SIZE(threads); i++) {
+		unsigned int total = threads[i] * count;
+
+		if (comm_init(false)) {
+			fprintf(stderr, "comm init failed\n");
+			failures++;
+			return;
+		}
+		ns = run_cmd_threads(threads[i], count, false, &mismatches,
+				     &err);
+		comm_deinit();
+		if (err || mismatches)
+			failures++;
+		printf("%-10s %8u %12.0f %12.2f\n", "sendrecv", threads[i],
+		       total * 1e9 / ns, ns / 1e3 / total);
+
+		comm_init(true);
+		ns = run_cmd_threads(threads[i], count, true, &mismatches,
+				     &err);
+		comm_deinit();
+		if (err || mismatches)
+			failures++;
+		printf("%-10s %8u %12.0f %12.2f\n", "tagged", threads[i],
+		       total * 1e9 / ns, ns / 1e3 / total);
+
+		comm_init(true);
+		ns = run_submit_threads(threads[i], count, &err);
+		comm_deinit();
+		if (err || async_bad)
+			failures++;
+		printf("%-10s %8u %12.0f %12.2f\n", "async", threads[i],
+		       total * 1e9 / ns, ns / 1e3 / total);
+	}
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-b] [-j] [-l latency_us] [-n requests]\n"
+		"  -b  benchmark instead of running the unit tests\n"
+		"  -j  jitter the server latency to reorder responses\n"
+		"  -l  server latency in microseconds (default 20)\n"
+		"  -n  requests per thread (default 1000)\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int count = 1000;
+	bool do_bench = false;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "bjl:n:h")) != -1) {
+		switch (opt) {
+		case 'b':
+			do_bench = true;
+			break;
+		case 'j':
+			loop_jitter = true;
+			break;
+		case 'l':
+			loop_latency_us = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			count = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 2;
+		}
+	}
+
+	srand(1);
+	if (do_bench) {
+		bench(count);
+	} else {
+		run_tests();
+		printf("%s\n", failures ? "FAIL" : "PASS");
+	}
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,43 @@
+/*
+ * Kernel bit operations for a single word bitmap.
+ *
+ * Copyright (c) 2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#ifndef _SHIM_LINUX_BITOPS_H
+#define _SHIM_LINUX_BITOPS_H
+
+#include <linux/kernel.h>
+
+#define BITS_PER_LONG	(8 * sizeof(long))
+
+static inline void set_bit(unsigned int nr, volatile unsigned long *addr)
+{
+	__atomic_fetch_or(addr, 1UL << nr, __ATOMIC_SEQ_CST);
+}
+
+static inline void clear_bit(unsigned int nr, volatile unsigned long *addr)
+{
+	__atomic_fetch_and(addr, ~(1UL << nr), __ATOMIC_SEQ_CST);
+}
+
+static inline unsigned long find_first_zero_bit(const unsigned long *addr,
+						unsigned long size)
+{
+	unsigned long word = ~*addr;
+
+	if (size < BITS_PER_LONG)
+		word &= (1UL << size) - 1;
+	return word ? (unsigned long)__builtin_ctzl(word) : size;
+}
+
+#endif /* _SHIM_LINUX_BITOPS_H */
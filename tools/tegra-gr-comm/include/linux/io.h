@@ -0,0 +1,29 @@
+/*
+ * Mempools are plain memory.
+ *
+ * Copyright (c) 2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#ifndef _SHIM_LINUX_IO_H
+#define _SHIM_LINUX_IO_H
+
+#include <linux/kernel.h>
+
+#define __iomem
+
+#define ioremap_cache(addr, size)	((void *)(uintptr_t)(addr))
+#define iounmap(addr)			do { } while (0)
+
+#define readl(addr)	(*(volatile u32 *)(addr))
+#define rmb()		__atomic_thread_fence(__ATOMIC_ACQUIRE)
+
+#endif /* _SHIM_LINUX_IO_H */
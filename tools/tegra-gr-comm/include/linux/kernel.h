@@ -0,0 +1,106 @@
+/*
+ * Minimal userspace stand-ins for the kernel facilities used by the
+ * graphics virtualization communication framework, so it can be built
+ * and run against a loopback server as plain C.
+ *
+ * Copyright (c) 2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#ifndef _SHIM_LINUX_KERNEL_H
+#define _SHIM_LINUX_KERNEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int32_t s32;
+
+#define likely(x)	__builtin_expect(!!(x), 1)
+#define unlikely(x)	__builtin_expect(!!(x), 0)
+
+#define container_of(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+#define ARRAY_SIZE(a)	(sizeof(a) / sizeof((a)[0]))
+
+#define BUILD_BUG_ON(cond)	_Static_assert(!(cond), #cond)
+
+/* one jiffy is one millisecond */
+#define HZ			1000
+#define msecs_to_jiffies(ms)	((long)(ms))
+
+#define MAX_ERRNO	4095
+#define IS_ERR_VALUE(x)	((unsigned long)(x) >= (unsigned long)-MAX_ERRNO)
+
+static inline void *ERR_PTR(long error)
+{
+	return (void *)error;
+}
+
+static inline long PTR_ERR(const void *ptr)
+{
+	return (long)ptr;
+}
+
+static inline bool IS_ERR_OR_NULL(const void *ptr)
+{
+	return !ptr || IS_ERR_VALUE((unsigned long)ptr);
+}
+
+/* set by the test to silence expected errors */
+extern int shim_quiet;
+
+#define pr_err(fmt, ...) \
+	do { \
+		if (!shim_quiet) \
+			fprintf(stderr, fmt, ##__VA_ARGS__); \
+	} while (0)
+#define pr_info(fmt, ...)	printf(fmt, ##__VA_ARGS__)
+
+/* counted so that tests can check for them */
+extern unsigned int shim_warnings;
+
+#define WARN_ON(cond) ({ \
+	int __c = !!(cond); \
+	if (__c) { \
+		shim_warnings++; \
+		pr_err("WARNING at %s:%d\n", __func__, __LINE__); \
+	} \
+	__c; \
+})
+
+#define dev_err(dev, fmt, ...) \
+	do { (void)(dev); pr_err(fmt, ##__VA_ARGS__); } while (0)
+#define dev_warn(dev, fmt, ...) \
+	do { (void)(dev); pr_err(fmt, ##__VA_ARGS__); } while (0)
+
+/* absolute CLOCK_REALTIME deadline timeout jiffies from now */
+static inline void shim_deadline(struct timespec *ts, long timeout)
+{
+	clock_gettime(CLOCK_REALTIME, ts);
+	ts->tv_sec += timeout / HZ;
+	ts->tv_nsec += (timeout % HZ) * 1000000L;
+	if (ts->tv_nsec >= 1000000000L) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000L;
+	}
+}
+
+#endif /* _SHIM_LINUX_KERNEL_H */
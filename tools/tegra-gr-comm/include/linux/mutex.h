@@ -0,0 +1,57 @@
+/*
+ * Kernel mutexes, semaphores and spinlocks on top of pthreads.
+ *
+ * Copyright (c) 2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#ifndef _SHIM_LINUX_MUTEX_H
+#define _SHIM_LINUX_MUTEX_H
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <linux/kernel.h>
+
+struct mutex {
+	pthread_mutex_t m;
+};
+
+#define mutex_init(l)		pthread_mutex_init(&(l)->m, NULL)
+#define mutex_lock(l)		pthread_mutex_lock(&(l)->m)
+#define mutex_unlock(l)		pthread_mutex_unlock(&(l)->m)
+
+typedef struct {
+	pthread_mutex_t m;
+} spinlock_t;
+
+#define spin_lock_init(l)	pthread_mutex_init(&(l)->m, NULL)
+#define spin_lock(l)		pthread_mutex_lock(&(l)->m)
+#define spin_unlock(l)		pthread_mutex_unlock(&(l)->m)
+
+struct semaphore {
+	sem_t s;
+};
+
+#define sema_init(l, n)		sem_init(&(l)->s, 0, n)
+#define up(l)			sem_post(&(l)->s)
+
+static inline int down_timeout(struct semaphore *sem, long timeout)
+{
+	struct timespec ts;
+
+	shim_deadline(&ts, timeout);
+	while (sem_timedwait(&sem->s, &ts))
+		if (errno != EINTR)
+			return -ETIME;
+	return 0;
+}
+
+#endif /* _SHIM_LINUX_MUTEX_H */
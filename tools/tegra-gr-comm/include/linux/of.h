@@ -0,0 +1,26 @@
+/*
+ * Device tree lookups, answered by the loopback test.
+ *
+ * Copyright (c) 2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#ifndef _SHIM_LINUX_OF_H
+#define _SHIM_LINUX_OF_H
+
+#include <linux/platform_device.h>
+
+int of_property_read_u32_index(const struct device_node *np,
+			       const char *propname, u32 index, u32 *out);
+struct device_node *of_parse_phandle(const struct device_node *np,
+				     const char *propname, int index);
+
+#endif /* _SHIM_LINUX_OF_H */
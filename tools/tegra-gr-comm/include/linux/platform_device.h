@@ -0,0 +1,31 @@
+/*
+ * Just enough of the driver model to hold a device tree node.
+ *
+ * Copyright (c) 2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#ifndef _SHIM_LINUX_PLATFORM_DEVICE_H
+#define _SHIM_LINUX_PLATFORM_DEVICE_H
+
+#include <linux/kernel.h>
+
+struct device_node;
+
+struct device {
+	struct device_node *of_node;
+};
+
+struct platform_device {
+	struct device dev;
+};
+
+#endif /* _SHIM_LINUX_PLATFORM_DEVICE_H */
@@ -0,0 +1,21 @@
+/*
+ * Semaphores live with the other locks in mutex.h.
+ *
+ * Copyright (c) 2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#ifndef _SHIM_LINUX_SEMAPHORE_H
+#define _SHIM_LINUX_SEMAPHORE_H
+
+#include <linux/mutex.h>
+
+#endif /* _SHIM_LINUX_SEMAPHORE_H */
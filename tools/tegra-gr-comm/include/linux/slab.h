@@ -0,0 +1,48 @@
+/*
+ * Kernel allocators on top of malloc.
+ *
+ * Copyright (c) 2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#ifndef _SHIM_LINUX_SLAB_H
+#define _SHIM_LINUX_SLAB_H
+
+#include <stdlib.h>
+#include <linux/kernel.h>
+
+#define GFP_KERNEL		0
+#define SLAB_RECLAIM_ACCOUNT	0
+#define SLAB_MEM_SPREAD		0
+
+#define kmalloc(size, flags)	malloc(size)
+#define kzalloc(size, flags)	calloc(1, size)
+#define kfree(ptr)		free(ptr)
+
+struct kmem_cache {
+	size_t size;
+};
+
+static inline struct kmem_cache *kmem_cache_create(const char *name,
+		size_t size, size_t align, unsigned long flags, void *ctor)
+{
+	struct kmem_cache *cache = malloc(sizeof(*cache));
+
+	if (cache)
+		cache->size = size;
+	return cache;
+}
+
+#define kmem_cache_alloc(cache, flags)	malloc((cache)->size)
+#define kmem_cache_free(cache, ptr)	free(ptr)
+#define kmem_cache_destroy(cache)	free(cache)
+
+#endif /* _SHIM_LINUX_SLAB_H */
@@ -0,0 +1,50 @@
+/*
+ * Hypervisor IVC channels and mempools, backed by the loopback server.
+ *
+ * Copyright (c) 2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#ifndef _SHIM_LINUX_TEGRA_IVC_H
+#define _SHIM_LINUX_TEGRA_IVC_H
+
+#include <linux/kernel.h>
+
+struct device_node;
+
+struct tegra_hv_ivc_cookie {
+	int irq;
+	int peer_vmid;
+	int nframes;
+	int frame_size;
+};
+
+struct tegra_hv_ivm_cookie {
+	uint64_t ipa;
+	uint64_t size;
+	unsigned int peer_vmid;
+	void *reserved;
+};
+
+struct tegra_hv_ivc_cookie *tegra_hv_ivc_reserve(struct device_node *dn,
+		int id, const void *ops);
+int tegra_hv_ivc_unreserve(struct tegra_hv_ivc_cookie *ivck);
+int tegra_hv_ivc_write(struct tegra_hv_ivc_cookie *ivck, const void *buf,
+		int size);
+int tegra_hv_ivc_read(struct tegra_hv_ivc_cookie *ivck, void *buf, int size);
+int tegra_hv_ivc_can_read(struct tegra_hv_ivc_cookie *ivck);
+int tegra_hv_ivc_can_write(struct tegra_hv_ivc_cookie *ivck);
+int tegra_hv_ivc_channel_notified(struct tegra_hv_ivc_cookie *ivck);
+void tegra_hv_ivc_channel_reset(struct tegra_hv_ivc_cookie *ivck);
+struct tegra_hv_ivm_cookie *tegra_hv_mempool_reserve(unsigned int id);
+int tegra_hv_mempool_unreserve(struct tegra_hv_ivm_cookie *ck);
+
+#endif /* _SHIM_LINUX_TEGRA_IVC_H */
@@ -0,0 +1,96 @@
+/*
+ * Kernel wait queues and completions on top of pthread condition
+ * variables. A waiter evaluates its condition with the queue lock held
+ * and wakers take the lock, so no wakeup is lost.
+ *
+ * Copyright (c) 2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#ifndef _SHIM_LINUX_WAIT_H
+#define _SHIM_LINUX_WAIT_H
+
+#include <linux/mutex.h>
+
+typedef struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} wait_queue_head_t;
+
+static inline void init_waitqueue_head(wait_queue_head_t *wq)
+{
+	pthread_mutex_init(&wq->lock, NULL);
+	pthread_cond_init(&wq->cond, NULL);
+}
+
+static inline void wake_up(wait_queue_head_t *wq)
+{
+	pthread_mutex_lock(&wq->lock);
+	pthread_cond_broadcast(&wq->cond);
+	pthread_mutex_unlock(&wq->lock);
+}
+
+/* 0 if condition is still false after timeout, non-zero otherwise */
+#define wait_event_timeout(wq, condition, timeout) \
+({ \
+	long __ret = (timeout); \
+	struct timespec __ts; \
+	shim_deadline(&__ts, __ret); \
+	pthread_mutex_lock(&(wq).lock); \
+	while (!(condition)) { \
+		if (pthread_cond_timedwait(&(wq).cond, &(wq).lock, \
+					   &__ts) == ETIMEDOUT) { \
+			__ret = (condition) ? 1 : 0; \
+			break; \
+		} \
+	} \
+	pthread_mutex_unlock(&(wq).lock); \
+	__ret; \
+})
+
+struct completion {
+	unsigned int done;
+	wait_queue_head_t wait;
+};
+
+static inline void init_completion(struct completion *x)
+{
+	x->done = 0;
+	init_waitqueue_head(&x->wait);
+}
+
+static inline void reinit_completion(struct completion *x)
+{
+	x->done = 0;
+}
+
+static inline void complete(struct completion *x)
+{
+	pthread_mutex_lock(&x->wait.lock);
+	x->done++;
+	pthread_cond_broadcast(&x->wait.cond);
+	pthread_mutex_unlock(&x->wait.lock);
+}
+
+static inline long wait_for_completion_timeout(struct completion *x,
+					       long timeout)
+{
+	long ret = wait_event_timeout(x->wait, x->done, timeout);
+
+	if (ret) {
+		pthread_mutex_lock(&x->wait.lock);
+		x->done--;
+		pthread_mutex_unlock(&x->wait.lock);
+	}
+	return ret;
+}
+
+#endif /* _SHIM_LINUX_WAIT_H */
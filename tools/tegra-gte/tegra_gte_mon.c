@@ -10,8 +10,13 @@
  *
  * Example Usage:
  *	tegra_gte_mon -d <device> -g <global gpio pin> -r -f
+ *
+ * Throughput test, with the monitored pin wired to line 5 of gpiochip1:
+ *	tegra_gte_mon -d <device> -g <global gpio pin> -m 4096 -p \
+ *		-o gpiochip1:5
  */
 
+#define _GNU_SOURCE
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdbool.h>
@@ -23,49 +28,137 @@
 #include <fcntl.h>
 #include <getopt.h>
 #include <inttypes.h>
+#include <pthread.h>
+#include <time.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/types.h>
+#include <linux/gpio.h>
 #include <linux/tegra-gte-ioctl.h>
 
-int monitor_device(const char *device_name,
-		   unsigned int gnum,
-		   unsigned int eventflags,
-		   unsigned int loops)
+struct event_stats {
+	uint64_t events;
+	uint64_t gaps;
+	uint32_t next_seq;
+	bool started;
+	struct timespec last_report;
+	uint64_t last_events;
+};
+
+struct event_source {
+	char *chip;
+	unsigned int line;
+	unsigned int period_us;
+	volatile bool stop;
+};
+
+static uint64_t elapsed_ns(const struct timespec *from,
+			   const struct timespec *to)
 {
-	struct tegra_gte_hts_event_req req = {0};
-	struct tegra_gte_hts_event_data event;
+	return (to->tv_sec - from->tv_sec) * 1000000000ULL +
+		to->tv_nsec - from->tv_nsec;
+}
+
+static void account_event(struct event_stats *st,
+			  const struct tegra_gte_hts_event_data *event,
+			  bool print_stats)
+{
+	struct timespec now;
+	uint64_t ns;
+
+	if (st->started && event->seq != st->next_seq) {
+		st->gaps += (uint32_t)(event->seq - st->next_seq);
+		if (!print_stats)
+			fprintf(stdout, "GAP: %u events dropped\n",
+				(uint32_t)(event->seq - st->next_seq));
+	}
+	st->started = true;
+	st->next_seq = event->seq + 1;
+	st->events++;
+
+	if (!print_stats) {
+		fprintf(stdout, "HW timestamp GPIO EVENT %" PRIu64 "\n",
+			(uint64_t)event->timestamp);
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ns = elapsed_ns(&st->last_report, &now);
+	if (ns >= 1000000000ULL) {
+		fprintf(stdout, "%" PRIu64 " events/s, %" PRIu64
+			" events total, %" PRIu64 " dropped\n",
+			(uint64_t)((st->events - st->last_events) *
+				   1000000000ULL / ns),
+			st->events, st->gaps);
+		st->last_report = now;
+		st->last_events = st->events;
+	}
+}
+
+/*
+ * Hardware event source: toggles a GPIO output line, as fast as possible
+ * or every period_us. Nothing is simulated; the line must be wired to the
+ * monitored pin externally (a loopback jumper), or the monitor sees no
+ * events.
+ */
+static void *event_source_thread(void *arg)
+{
+	struct event_source *src = arg;
+	struct gpiohandle_request req = {0};
+	struct gpiohandle_data data = {0};
 	char *chrdev_name;
-	int fd;
-	int ret;
-	int i = 0;
+	int fd, ret;
 
-	ret = asprintf(&chrdev_name, "/dev/%s", device_name);
+	ret = asprintf(&chrdev_name, "/dev/%s", src->chip);
 	if (ret < 0)
-		return -ENOMEM;
+		return NULL;
 
 	fd = open(chrdev_name, 0);
+	free(chrdev_name);
 	if (fd == -1) {
-		ret = -errno;
-		perror("Error: ");
-		goto exit_close_error;
+		perror("Failed to open event source chip");
+		return NULL;
 	}
 
-	req.global_gpio_pin = gnum;
-	req.eventflags = eventflags;
+	req.lineoffsets[0] = src->line;
+	req.lines = 1;
+	req.flags = GPIOHANDLE_REQUEST_OUTPUT;
+	strcpy(req.consumer_label, "gte-mon-source");
 
-	ret = ioctl(fd, TEGRA_GTE_HTS_CREATE_GPIO_EV_IOCTL, &req);
+	ret = ioctl(fd, GPIO_GET_LINEHANDLE_IOCTL, &req);
+	close(fd);
 	if (ret == -1) {
-		ret = -errno;
-		fprintf(stderr, "Failed to issue GET EVENT "
-			"IOCTL (%d)\n",
-			ret);
-		goto exit_close_error;
+		perror("Failed to request event source line");
+		return NULL;
 	}
 
-	fprintf(stdout, "Monitoring line %d on %s\n", gnum, device_name);
+	while (!src->stop) {
+		data.values[0] = !data.values[0];
+		if (ioctl(req.fd, GPIOHANDLE_SET_LINE_VALUES_IOCTL,
+			  &data) == -1) {
+			perror("Failed to toggle event source line");
+			break;
+		}
+		if (src->period_us)
+			usleep(src->period_us);
+	}
+
+	close(req.fd);
+	return NULL;
+}
+
+static int monitor_fifo(int fd, unsigned int loops, bool print_stats)
+{
+	struct tegra_gte_hts_event_data event[64];
+	struct event_stats st = {0};
+	unsigned int i = 0;
+	int ret, n, j;
+
+	clock_gettime(CLOCK_MONOTONIC, &st.last_report);
 
 	while (1) {
-		ret = read(req.fd, &event, sizeof(event));
+		ret = read(fd, event, print_stats ? sizeof(event) :
+			   sizeof(event[0]));
 		if (ret == -1) {
 			if (errno == -EAGAIN) {
 				fprintf(stderr, "nothing available\n");
@@ -78,20 +171,143 @@ int monitor_device(const char *device_name,
 			}
 		}
 
-		if (ret != sizeof(event)) {
+		if (ret == 0 || ret % sizeof(event[0])) {
 			fprintf(stderr, "Reading event failed\n");
 			ret = -EIO;
 			break;
 		}
 
-		fprintf(stdout, "HW timestamp GPIO EVENT %" PRIu64 "\n",
-			event.timestamp);
+		n = ret / sizeof(event[0]);
+		ret = 0;
+		for (j = 0; j < n; j++)
+			account_event(&st, &event[j], print_stats);
 
-		i++;
-		if (i == loops)
+		i += n;
+		if (loops && i >= loops)
 			break;
 	}
 
+	return ret;
+}
+
+static int monitor_ring(int fd, unsigned int ring_size, unsigned int loops,
+			bool print_stats)
+{
+	struct tegra_gte_hts_ring_hdr *hdr;
+	struct tegra_gte_hts_event_data *ring;
+	struct event_stats st = {0};
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	size_t map_size;
+	uint32_t head, tail;
+	unsigned int i = 0;
+	int ret = 0;
+
+	map_size = 64 + ring_size * sizeof(*ring);
+	hdr = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (hdr == MAP_FAILED) {
+		ret = -errno;
+		perror("Failed to map event ring");
+		return ret;
+	}
+	ring = (void *)((char *)hdr + hdr->data_offset);
+
+	clock_gettime(CLOCK_MONOTONIC, &st.last_report);
+
+	while (!loops || i < loops) {
+		tail = hdr->tail;
+		head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+		if (head == tail) {
+			if (poll(&pfd, 1, -1) == -1) {
+				ret = -errno;
+				perror("Failed to poll event ring");
+				break;
+			}
+			continue;
+		}
+
+		/* take everything available in one go */
+		for (; tail != head; tail++, i++)
+			account_event(&st, &ring[tail & (hdr->size - 1)],
+				      print_stats);
+		__atomic_store_n(&hdr->tail, tail, __ATOMIC_RELEASE);
+	}
+
+	fprintf(stdout, "%" PRIu64 " events, %" PRIu64 " dropped, "
+		"%u ring overflows\n", st.events, st.gaps, hdr->dropped);
+	munmap(hdr, map_size);
+	return ret;
+}
+
+int monitor_device(const char *device_name,
+		   unsigned int gnum,
+		   unsigned int eventflags,
+		   unsigned int loops,
+		   unsigned int ring_size,
+		   bool print_stats,
+		   struct event_source *src)
+{
+	struct tegra_gte_hts_event_ring_req ring_req = {0};
+	struct tegra_gte_hts_event_req req = {0};
+	pthread_t src_thread;
+	bool src_started = false;
+	char *chrdev_name;
+	int event_fd;
+	int fd;
+	int ret;
+
+	ret = asprintf(&chrdev_name, "/dev/%s", device_name);
+	if (ret < 0)
+		return -ENOMEM;
+
+	fd = open(chrdev_name, 0);
+	if (fd == -1) {
+		ret = -errno;
+		perror("Error: ");
+		goto exit_close_error;
+	}
+
+	if (ring_size) {
+		ring_req.global_gpio_pin = gnum;
+		ring_req.eventflags = eventflags;
+		ring_req.ring_size = ring_size;
+		ret = ioctl(fd, TEGRA_GTE_HTS_CREATE_GPIO_EV_RING_IOCTL,
+			    &ring_req);
+		event_fd = ring_req.fd;
+	} else {
+		req.global_gpio_pin = gnum;
+		req.eventflags = eventflags;
+		ret = ioctl(fd, TEGRA_GTE_HTS_CREATE_GPIO_EV_IOCTL, &req);
+		event_fd = req.fd;
+	}
+	if (ret == -1) {
+		ret = -errno;
+		fprintf(stderr, "Failed to issue GET EVENT "
+			"IOCTL (%d)\n",
+			ret);
+		goto exit_close_error;
+	}
+
+	fprintf(stdout, "Monitoring line %d on %s\n", gnum, device_name);
+
+	if (src && src->chip) {
+		if (pthread_create(&src_thread, NULL, event_source_thread,
+				   src) == 0)
+			src_started = true;
+		else
+			fprintf(stderr, "Failed to start event source\n");
+	}
+
+	if (ring_size)
+		ret = monitor_ring(event_fd, ring_size, loops, print_stats);
+	else
+		ret = monitor_fifo(event_fd, loops, print_stats);
+
+	if (src_started) {
+		src->stop = true;
+		pthread_join(src_thread, NULL);
+	}
+	close(event_fd);
+
 exit_close_error:
 	if (close(fd) == -1)
 		perror("Failed to close GPIO character device file");
@@ -108,6 +324,12 @@ void print_usage(char *bin_name)
 		"  -r         Listen for rising edges\n"
 		"  -f         Listen for falling edges\n"
 		" [-c <n>]    Do <n> loops (optional, infinite loop if not stated)\n"
+		" [-m <n>]    Consume events from an mmap'ed ring of <n> events\n"
+		" [-p]        Print throughput once per second instead of events\n"
+		" [-o <chip>:<line>]\n"
+		"             Toggle output <line> of <chip> as event source,\n"
+		"             which must be wired to the monitored pin\n"
+		" [-u <n>]    Toggle the event source every <n> usecs\n"
 		"  -h         This helptext\n"
 		"\n"
 		"Example:\n"
@@ -120,12 +342,16 @@ void print_usage(char *bin_name)
 int main(int argc, char **argv)
 {
 	const char *device_name = NULL;
+	struct event_source src = {0};
 	unsigned int gnum = -1;
 	unsigned int loops = 0;
 	unsigned int eventflags = 0;
+	unsigned int ring_size = 0;
+	bool print_stats = false;
+	char *sep;
 	int c;
 
-	while ((c = getopt(argc, argv, "c:g:d:rfh")) != -1) {
+	while ((c = getopt(argc, argv, "c:g:d:m:o:u:rfph")) != -1) {
 		switch (c) {
 		case 'c':
 			loops = strtoul(optarg, NULL, 10);
@@ -136,12 +362,31 @@ int main(int argc, char **argv)
 		case 'g':
 			gnum = strtoul(optarg, NULL, 10);
 			break;
+		case 'm':
+			ring_size = strtoul(optarg, NULL, 10);
+			break;
+		case 'o':
+			sep = strchr(optarg, ':');
+			if (!sep) {
+				print_usage(argv[0]);
+				return 1;
+			}
+			*sep = '\0';
+			src.chip = optarg;
+			src.line = strtoul(sep + 1, NULL, 10);
+			break;
+		case 'u':
+			src.period_us = strtoul(optarg, NULL, 10);
+			break;
 		case 'r':
 			eventflags |= TEGRA_GTE_EVENT_RISING_EDGE;
 			break;
 		case 'f':
 			eventflags |= TEGRA_GTE_EVENT_FALLING_EDGE;
 			break;
+		case 'p':
+			print_stats = true;
+			break;
 		case 'h':
 			print_usage(argv[0]);
 			return 1;
@@ -153,10 +398,16 @@ int main(int argc, char **argv)
 		return 1;
 	}
 
+	if (ring_size & (ring_size - 1)) {
+		fprintf(stderr, "Ring size must be a power of two\n");
+		return 1;
+	}
+
 	if (!eventflags) {
 		printf("No flags specified, listening on both rising and "
 		       "falling edges\n");
 		eventflags = TEGRA_GTE_EVENT_REQ_BOTH_EDGES;
 	}
-	return monitor_device(device_name, gnum, eventflags, loops);
+	return monitor_device(device_name, gnum, eventflags, loops,
+			      ring_size, print_stats, &src);
 }
@@ -0,0 +1,671 @@
+/*
+ * hv_i2c_loopback - unit test for the hypervisor I2C client
+ * (drivers/i2c/busses/i2c-tegra-hv.c and i2c-tegra-hv-common.c), built in
+ * userspace against hv_i2c_shim.h and a stub I2C server.
+ *
+ * Copyright (c) 2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Example Usage:
+ *	hv_i2c_loopback			run the unit tests
+ *
+ * The server thread answers requests from the IVC queue the way the I2C
+ * server VM does and raises the queue irq for each response. Behind it
+ * sits one register file device: a write sets the register pointer from
+ * its first byte and writes the rest, a read returns registers from the
+ * pointer on. The server can be made to predate I2C_BATCH, answering it
+ * with a response type the client does not know, or to leave batches
+ * unanswered.
+ */
+
+#include "hv_i2c_shim.h"
+
+#include "i2c-tegra-hv-common.c"
+#include "i2c-tegra-hv.c"
+
+int shim_quiet;
+unsigned int shim_warnings;
+
+static int failures;
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s:%d: check failed: %s\n", \
+				__func__, __LINE__, #cond); \
+			failures++; \
+			return -1; \
+		} \
+	} while (0)
+
+/*
+ * Stub I2C server
+ */
+
+#define STUB_NFRAMES		4
+#define STUB_FRAME_SIZE		((int)sizeof(struct i2c_ivc_msg))
+#define STUB_MAX_PAYLOAD	4096
+#define STUB_ADDR		0x50
+#define STUB_TIMEOUT_MS		200
+
+struct stub_ring {
+	struct i2c_ivc_msg frames[STUB_NFRAMES];
+	unsigned int head;	/* frames written */
+	unsigned int tail;	/* frames read */
+};
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t thread;
+	bool stop;
+
+	struct tegra_hv_ivc_cookie cookie;
+	struct stub_ring to_server;
+	struct stub_ring to_guest;
+	irq_handler_t handler;
+	void *dev_id;
+
+	/* predates I2C_BATCH, answers it with old_reply_type */
+	bool old;
+	u32 old_reply_type;
+	/* leaves batches unanswered */
+	bool drop_batch;
+
+	unsigned int requests;
+	unsigned int batches;
+	unsigned int cleanups;
+
+	/* the register file device */
+	u8 regs[256];
+	u8 ptr;
+} stub = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+	.cookie = {
+		.irq = 1,
+		.nframes = STUB_NFRAMES,
+		.frame_size = STUB_FRAME_SIZE,
+	},
+};
+
+static bool ring_full(const struct stub_ring *r)
+{
+	return r->head - r->tail == STUB_NFRAMES;
+}
+
+static bool ring_empty(const struct stub_ring *r)
+{
+	return r->head == r->tail;
+}
+
+/* one message on the bus, returns false if the device does not ack it */
+static bool stub_bus_xfer(u32 addr, bool read, u8 *buf, u32 len)
+{
+	u32 i;
+
+	if (addr != STUB_ADDR)
+		return false;
+
+	if (read) {
+		for (i = 0; i < len; i++)
+			buf[i] = stub.regs[stub.ptr++];
+	} else if (len) {
+		stub.ptr = buf[0];
+		for (i = 1; i < len; i++)
+			stub.regs[stub.ptr++] = buf[i];
+	}
+	return true;
+}
+
+/* answers req in rsp, returns false to leave it unanswered */
+static bool stub_answer(struct i2c_ivc_msg *req, struct i2c_ivc_msg *rsp)
+{
+	struct i2c_ivc_msg_tx_rx_hdr *hdr;
+	u8 *wdata, *rdata;
+	u32 i, num;
+
+	*rsp = *req;
+	i2c_ivc_error_field(rsp) = 0;
+
+	switch (i2c_ivc_msg_type(req)) {
+	case I2C_CLEANUP:
+		stub.cleanups++;
+		i2c_ivc_msg_type(rsp) = I2C_CLEANUP_RESPONSE;
+		break;
+	case I2C_GET_MAX_PAYLOAD:
+		i2c_ivc_msg_type(rsp) = I2C_GET_MAX_PAYLOAD_RESPONSE;
+		i2c_ivc_max_payload_field(rsp) = STUB_MAX_PAYLOAD;
+		break;
+	case I2C_READ:
+	case I2C_WRITE:
+		stub.requests++;
+		i2c_ivc_msg_type(rsp) = i2c_ivc_msg_type(req) == I2C_READ ?
+			I2C_READ_RESPONSE : I2C_WRITE_RESPONSE;
+		if (!stub_bus_xfer(i2c_ivc_message_slave_addr(req),
+				   i2c_ivc_msg_type(req) == I2C_READ,
+				   rsp->body.m.buffer,
+				   i2c_ivc_message_buf_len(req)))
+			i2c_ivc_error_field(rsp) = 1;
+		break;
+	case I2C_BATCH:
+		if (stub.old) {
+			i2c_ivc_msg_type(rsp) = stub.old_reply_type;
+			break;
+		}
+		stub.requests++;
+		stub.batches++;
+		if (stub.drop_batch)
+			return false;
+
+		num = req->body.b.fixed.num_msgs;
+		hdr = req->body.b.msgs;
+		wdata = (u8 *)&hdr[num];
+		rdata = (u8 *)rsp->body.b.msgs;
+		i2c_ivc_msg_type(rsp) = I2C_BATCH_RESPONSE;
+		for (i = 0; i < num; i++, hdr++) {
+			bool read = hdr->flags & HV_I2C_FLAGS_READ;
+			u8 *buf = read ? rdata : wdata;
+
+			if (!stub_bus_xfer(hdr->slave_address, read, buf,
+					   hdr->buf_len)) {
+				i2c_ivc_error_field(rsp) = 1;
+				break;
+			}
+			if (read)
+				rdata += hdr->buf_len;
+			else
+				wdata += hdr->buf_len;
+		}
+		break;
+	default:
+		i2c_ivc_msg_type(rsp) = stub.old_reply_type;
+		break;
+	}
+
+	return true;
+}
+
+static void *stub_server(void *arg)
+{
+	struct i2c_ivc_msg *req = malloc(sizeof(*req));
+	struct i2c_ivc_msg *rsp = malloc(sizeof(*rsp));
+	bool answer;
+
+	pthread_mutex_lock(&stub.lock);
+	while (!stub.stop) {
+		if (ring_empty(&stub.to_server) || ring_full(&stub.to_guest)) {
+			pthread_cond_wait(&stub.cond, &stub.lock);
+			continue;
+		}
+
+		*req = stub.to_server.frames[stub.to_server.tail++ %
+					     STUB_NFRAMES];
+		answer = stub_answer(req, rsp);
+		if (!answer)
+			continue;
+
+		stub.to_guest.frames[stub.to_guest.head++ % STUB_NFRAMES] =
+			*rsp;
+		pthread_mutex_unlock(&stub.lock);
+		stub.handler(stub.cookie.irq, stub.dev_id);
+		pthread_mutex_lock(&stub.lock);
+	}
+	pthread_mutex_unlock(&stub.lock);
+
+	free(req);
+	free(rsp);
+	return NULL;
+}
+
+/*
+ * Kernel interfaces backed by the stub server
+ */
+
+static struct device_node stub_dn = { .name = "i2c-hv" };
+
+struct devres {
+	struct devres *next;
+	unsigned char data[];
+};
+
+static struct devres *devres_list;
+static pthread_mutex_t devres_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void *devm_kzalloc(struct device *dev, size_t size, int flags)
+{
+	struct devres *dr = calloc(1, sizeof(*dr) + size);
+
+	if (!dr)
+		return NULL;
+	pthread_mutex_lock(&devres_lock);
+	dr->next = devres_list;
+	devres_list = dr;
+	pthread_mutex_unlock(&devres_lock);
+	return dr->data;
+}
+
+void devm_kfree(struct device *dev, void *p)
+{
+	struct devres **pp;
+
+	pthread_mutex_lock(&devres_lock);
+	for (pp = &devres_list; *pp; pp = &(*pp)->next) {
+		if ((*pp)->data == p) {
+			struct devres *dr = *pp;
+
+			*pp = dr->next;
+			free(dr);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&devres_lock);
+}
+
+const struct of_device_id *of_match_device(const struct of_device_id *ids,
+					   const struct device *dev)
+{
+	return ids;
+}
+
+struct device_node *of_parse_phandle(const struct device_node *np,
+				     const char *phandle_name, int index)
+{
+	return &stub_dn;
+}
+
+int of_property_read_u32_index(const struct device_node *np,
+			       const char *propname, u32 index, u32 *out)
+{
+	if (strcmp(propname, "ivc_queue"))
+		return -EINVAL;
+	*out = 0;
+	return 0;
+}
+
+int of_property_read_u32(const struct device_node *np, const char *propname,
+			 u32 *out_value)
+{
+	return -EINVAL;
+}
+
+int request_threaded_irq(unsigned int irq, irq_handler_t handler,
+			 irq_handler_t thread_fn, unsigned long flags,
+			 const char *name, void *dev_id)
+{
+	stub.handler = handler;
+	stub.dev_id = dev_id;
+	return 0;
+}
+
+struct tegra_hv_ivc_cookie *tegra_hv_ivc_reserve(struct device_node *dn,
+		int id, const void *ops)
+{
+	return &stub.cookie;
+}
+
+int tegra_hv_ivc_unreserve(struct tegra_hv_ivc_cookie *ivck)
+{
+	return 0;
+}
+
+int tegra_hv_ivc_write(struct tegra_hv_ivc_cookie *ivck, const void *buf,
+		int size)
+{
+	if (size > ivck->frame_size)
+		return -E2BIG;
+
+	pthread_mutex_lock(&stub.lock);
+	if (ring_full(&stub.to_server)) {
+		pthread_mutex_unlock(&stub.lock);
+		return -ENOMEM;
+	}
+	memcpy(&stub.to_server.frames[stub.to_server.head++ % STUB_NFRAMES],
+	       buf, size);
+	pthread_cond_signal(&stub.cond);
+	pthread_mutex_unlock(&stub.lock);
+
+	return size;
+}
+
+int tegra_hv_ivc_can_read(struct tegra_hv_ivc_cookie *ivck)
+{
+	int ret;
+
+	pthread_mutex_lock(&stub.lock);
+	ret = !ring_empty(&stub.to_guest);
+	pthread_mutex_unlock(&stub.lock);
+
+	return ret;
+}
+
+int tegra_hv_ivc_can_write(struct tegra_hv_ivc_cookie *ivck)
+{
+	int ret;
+
+	pthread_mutex_lock(&stub.lock);
+	ret = !ring_full(&stub.to_server);
+	pthread_mutex_unlock(&stub.lock);
+
+	return ret;
+}
+
+int tegra_hv_ivc_read_peek(struct tegra_hv_ivc_cookie *ivck, void *buf,
+		int off, int count)
+{
+	char *frame;
+
+	if (off < 0 || count < 0 || off + count > ivck->frame_size)
+		return -EINVAL;
+
+	pthread_mutex_lock(&stub.lock);
+	if (ring_empty(&stub.to_guest)) {
+		pthread_mutex_unlock(&stub.lock);
+		return -ENOMEM;
+	}
+	frame = (char *)&stub.to_guest.frames[stub.to_guest.tail %
+					      STUB_NFRAMES];
+	if (count)
+		memcpy(buf, frame + off, count);
+	pthread_mutex_unlock(&stub.lock);
+
+	return count;
+}
+
+int tegra_hv_ivc_read_advance(struct tegra_hv_ivc_cookie *ivck)
+{
+	pthread_mutex_lock(&stub.lock);
+	if (!ring_empty(&stub.to_guest))
+		stub.to_guest.tail++;
+	pthread_cond_signal(&stub.cond);
+	pthread_mutex_unlock(&stub.lock);
+
+	return 0;
+}
+
+int tegra_hv_ivc_channel_notified(struct tegra_hv_ivc_cookie *ivck)
+{
+	return 0;
+}
+
+void tegra_hv_ivc_channel_reset(struct tegra_hv_ivc_cookie *ivck)
+{
+}
+
+/* the system workqueue, a single worker for the single work item */
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t thread;
+	struct work_struct *work;
+	bool running;
+	bool stop;
+} wq = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
+static void *wq_worker(void *arg)
+{
+	struct work_struct *work;
+
+	pthread_mutex_lock(&wq.lock);
+	for (;;) {
+		while (!(wq.work && wq.work->pending) && !wq.stop)
+			pthread_cond_wait(&wq.cond, &wq.lock);
+		if (wq.stop)
+			break;
+
+		work = wq.work;
+		work->pending = false;
+		wq.running = true;
+		pthread_mutex_unlock(&wq.lock);
+		work->func(work);
+		pthread_mutex_lock(&wq.lock);
+		wq.running = false;
+		pthread_cond_broadcast(&wq.cond);
+	}
+	pthread_mutex_unlock(&wq.lock);
+
+	return NULL;
+}
+
+bool schedule_work(struct work_struct *work)
+{
+	bool queued;
+
+	pthread_mutex_lock(&wq.lock);
+	queued = !work->pending;
+	wq.work = work;
+	work->pending = true;
+	pthread_cond_broadcast(&wq.cond);
+	pthread_mutex_unlock(&wq.lock);
+
+	return queued;
+}
+
+bool cancel_work_sync(struct work_struct *work)
+{
+	bool pending;
+
+	pthread_mutex_lock(&wq.lock);
+	pending = work->pending;
+	work->pending = false;
+	while (wq.running)
+		pthread_cond_wait(&wq.cond, &wq.lock);
+	pthread_mutex_unlock(&wq.lock);
+
+	return pending;
+}
+
+static struct i2c_adapter *stub_adapter;
+
+int i2c_add_numbered_adapter(struct i2c_adapter *adap)
+{
+	stub_adapter = adap;
+	return 0;
+}
+
+static void stub_start(void)
+{
+	pthread_create(&stub.thread, NULL, stub_server, NULL);
+	pthread_create(&wq.thread, NULL, wq_worker, NULL);
+}
+
+static void stub_stop(void)
+{
+	pthread_mutex_lock(&stub.lock);
+	stub.stop = true;
+	pthread_cond_signal(&stub.cond);
+	pthread_mutex_unlock(&stub.lock);
+	pthread_join(stub.thread, NULL);
+
+	pthread_mutex_lock(&wq.lock);
+	wq.stop = true;
+	pthread_cond_broadcast(&wq.cond);
+	pthread_mutex_unlock(&wq.lock);
+	pthread_join(wq.thread, NULL);
+}
+
+/*
+ * Client side
+ */
+
+static struct resource client_res = { .start = 0x3160000 };
+static struct tegra_hv_i2c_platform_data client_pdata = {
+	.timeout = STUB_TIMEOUT_MS,
+};
+static struct platform_device client_pdev;
+
+static u64 now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* probes a client against the stub as configured, returns the time taken */
+static int client_probe(u64 *ms)
+{
+	u64 start = now_ms();
+	int ret;
+
+	memset(&client_pdev, 0, sizeof(client_pdev));
+	client_pdev.dev.of_node = &stub_dn;
+	client_pdev.dev.platform_data = &client_pdata;
+	client_pdev.res = &client_res;
+
+	pthread_mutex_lock(&stub.lock);
+	stub.requests = 0;
+	stub.batches = 0;
+	stub.cleanups = 0;
+	pthread_mutex_unlock(&stub.lock);
+	shim_warnings = 0;
+	stub_adapter = NULL;
+
+	ret = tegra_hv_i2c_probe(&client_pdev);
+	*ms = now_ms() - start;
+	return ret;
+}
+
+static struct tegra_hv_i2c_dev *client(void)
+{
+	return platform_get_drvdata(&client_pdev);
+}
+
+static void client_remove(void)
+{
+	tegra_hv_i2c_remove(&client_pdev);
+	pthread_mutex_lock(&stub.lock);
+	stub.old = false;
+	stub.drop_batch = false;
+	pthread_mutex_unlock(&stub.lock);
+}
+
+/* a register read: write the register number, repeated start, read */
+static int reg_read(u8 reg, u8 *buf, u16 len)
+{
+	struct i2c_msg msgs[] = {
+		{ .addr = STUB_ADDR, .len = 1, .buf = &reg },
+		{ .addr = STUB_ADDR, .flags = I2C_M_RD, .len = len,
+		  .buf = buf },
+	};
+
+	return stub_adapter->algo->master_xfer(stub_adapter, msgs, 2);
+}
+
+static int reg_write(u16 addr, u8 reg, const u8 *val, u16 len)
+{
+	u8 buf[16];
+	struct i2c_msg msg = { .addr = addr, .len = len + 1, .buf = buf };
+
+	buf[0] = reg;
+	memcpy(buf + 1, val, len);
+	return stub_adapter->algo->master_xfer(stub_adapter, &msg, 1);
+}
+
+/*
+ * Unit tests
+ */
+
+/*
+ * A server that predates I2C_BATCH answers the probe with a response type
+ * the client does not know. That must end the probe at once, without a
+ * warning, a timeout or a channel cleanup, and leave the client on the
+ * per-message path.
+ */
+static int test_old_server(u32 reply_type)
+{
+	static const u8 val[] = { 0xa5, 0x5a };
+	u8 buf[2] = { 0 };
+	u64 ms;
+
+	stub.old = true;
+	stub.old_reply_type = reply_type;
+	CHECK(!client_probe(&ms));
+	CHECK(stub_adapter);
+	CHECK(!client()->batch_xfer);
+	CHECK(!shim_warnings);
+	/* only the one sent at every probe */
+	CHECK(stub.cleanups == 1);
+	CHECK(ms < STUB_TIMEOUT_MS / 2);
+
+	CHECK(reg_write(STUB_ADDR, 0x10, val, 2) == 1);
+	CHECK(reg_read(0x10, buf, 2) == 2);
+	CHECK(!memcmp(buf, val, 2));
+	CHECK(stub.requests == 3);
+	CHECK(!stub.batches);
+	client_remove();
+	return 0;
+}
+
+/* a register read is one request to a server that knows I2C_BATCH */
+static int test_batch(void)
+{
+	static const u8 val[] = { 0x12, 0x34, 0x56 };
+	u8 buf[3] = { 0 };
+	unsigned int requests;
+	u64 ms;
+
+	CHECK(!client_probe(&ms));
+	CHECK(client()->batch_xfer);
+	CHECK(!shim_warnings);
+	CHECK(stub.cleanups == 1);
+
+	CHECK(reg_write(STUB_ADDR, 0x20, val, 3) == 1);
+	requests = stub.requests;
+	CHECK(reg_read(0x20, buf, 3) == 2);
+	CHECK(!memcmp(buf, val, 3));
+	CHECK(stub.requests == requests + 1);
+
+	/* a NAK fails the batch and resets the channel */
+	shim_quiet = 1;
+	CHECK(reg_write(STUB_ADDR + 1, 0x20, val, 1) == -EIO);
+	shim_quiet = 0;
+	CHECK(stub.cleanups == 2);
+	CHECK(reg_read(0x20, buf, 1) == 2);
+	client_remove();
+	return 0;
+}
+
+/* a server that never answers the probe costs a timeout, as before */
+static int test_silent_server(void)
+{
+	u8 buf[1];
+	u64 ms;
+
+	stub.drop_batch = true;
+	shim_quiet = 1;
+	CHECK(!client_probe(&ms));
+	shim_quiet = 0;
+	CHECK(!client()->batch_xfer);
+	CHECK(ms >= STUB_TIMEOUT_MS);
+	CHECK(stub.cleanups == 2);
+	CHECK(reg_read(0x20, buf, 1) == 2);
+	client_remove();
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	stub_start();
+
+	test_old_server(I2C_INVALID);
+	test_old_server(I2C_BATCH);
+	test_batch();
+	test_silent_server();
+
+	stub_stop();
+	printf("%s\n", failures ? "FAIL" : "PASS");
+
+	return failures ? 1 : 0;
+}
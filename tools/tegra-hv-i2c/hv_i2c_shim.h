@@ -0,0 +1,468 @@
+/*
+ * Userspace stand-ins for the kernel facilities used by the hypervisor
+ * I2C client (drivers/i2c/busses/i2c-tegra-hv.c and i2c-tegra-hv-common.c).
+ * Locks, completions and the system workqueue are backed by pthreads so
+ * that responses are handled on another thread, as in the kernel. The
+ * IVC queue, the irq and the I2C core hooks are provided by the test.
+ *
+ * Copyright (c) 2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#ifndef _HV_I2C_SHIM_H
+#define _HV_I2C_SHIM_H
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef uint64_t phys_addr_t;
+typedef uint64_t resource_size_t;
+
+#define __init
+#define __exit
+#define likely(x)		__builtin_expect(!!(x), 1)
+#define unlikely(x)		__builtin_expect(!!(x), 0)
+
+#define EXPORT_SYMBOL(sym)	extern typeof(sym) sym
+#define THIS_MODULE		NULL
+#define MODULE_AUTHOR(s)
+#define MODULE_DESCRIPTION(s)
+#define MODULE_LICENSE(s)
+#define MODULE_DEVICE_TABLE(type, name)
+#define subsys_initcall(fn) \
+	static int (*shim_initcall)(void) __attribute__((unused)) = fn
+#define module_exit(fn) \
+	static void (*shim_exitcall)(void) __attribute__((unused)) = fn
+
+#define container_of(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+#define SZ_4G			0x100000000ULL
+
+#define BUG_ON(cond)		do { if (cond) abort(); } while (0)
+
+#define MAX_ERRNO	4095
+
+static inline void *ERR_PTR(long error)
+{
+	return (void *)error;
+}
+
+static inline long PTR_ERR(const void *ptr)
+{
+	return (long)ptr;
+}
+
+static inline bool IS_ERR(const void *ptr)
+{
+	return (unsigned long)ptr >= (unsigned long)-MAX_ERRNO;
+}
+
+static inline bool IS_ERR_OR_NULL(const void *ptr)
+{
+	return !ptr || IS_ERR(ptr);
+}
+
+/* set by the test to silence expected errors */
+extern int shim_quiet;
+extern unsigned int shim_warnings;
+
+static inline void shim_log(bool show, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (!show)
+		return;
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+}
+
+#define pr_err(fmt, ...)	shim_log(!shim_quiet, fmt, ##__VA_ARGS__)
+#define pr_warn(fmt, ...)	shim_log(!shim_quiet, fmt, ##__VA_ARGS__)
+#define dev_err(dev, fmt, ...) \
+	do { (void)(dev); pr_err(fmt, ##__VA_ARGS__); } while (0)
+#define dev_warn(dev, fmt, ...) \
+	do { (void)(dev); pr_err(fmt, ##__VA_ARGS__); } while (0)
+#define dev_info(dev, fmt, ...)	do { (void)(dev); } while (0)
+#define dev_dbg(dev, fmt, ...)	do { (void)(dev); } while (0)
+
+#define WARN(cond, fmt, ...) ({ \
+	int __c = !!(cond); \
+	if (__c) { \
+		__atomic_fetch_add(&shim_warnings, 1, __ATOMIC_SEQ_CST); \
+		pr_err("WARNING at %s:%d: " fmt, __func__, __LINE__, \
+		       ##__VA_ARGS__); \
+	} \
+	__c; \
+})
+#define WARN_ON(cond)		WARN(cond, "%s\n", #cond)
+
+static inline size_t strlcpy(char *dest, const char *src, size_t size)
+{
+	snprintf(dest, size, "%s", src);
+	return strlen(src);
+}
+
+/*
+ * Time, one jiffy is one millisecond
+ */
+#define msecs_to_jiffies(ms)	((unsigned long)(ms))
+#define msleep(ms)		usleep((ms) * 1000)
+
+static inline void shim_deadline(struct timespec *ts, unsigned long j)
+{
+	clock_gettime(CLOCK_REALTIME, ts);
+	ts->tv_sec += j / 1000;
+	ts->tv_nsec += (j % 1000) * 1000000L;
+	if (ts->tv_nsec >= 1000000000L) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000L;
+	}
+}
+
+static inline unsigned long shim_left(const struct timespec *ts)
+{
+	struct timespec now;
+	long ms;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	ms = (ts->tv_sec - now.tv_sec) * 1000 +
+		(ts->tv_nsec - now.tv_nsec) / 1000000L;
+	return ms > 0 ? ms : 1;
+}
+
+/*
+ * Locks and completions. Spinlocks are mutexes; interrupts are a worker
+ * thread here, so irqsave has nothing to save.
+ */
+typedef struct {
+	pthread_mutex_t m;
+} spinlock_t;
+
+#define spin_lock_init(l)	pthread_mutex_init(&(l)->m, NULL)
+#define spin_lock_irqsave(l, flags) \
+	do { (flags) = 0; pthread_mutex_lock(&(l)->m); } while (0)
+#define spin_unlock_irqrestore(l, flags) \
+	do { (void)(flags); pthread_mutex_unlock(&(l)->m); } while (0)
+
+struct mutex {
+	pthread_mutex_t lock;
+};
+
+#define DEFINE_MUTEX(m)		struct mutex m = { PTHREAD_MUTEX_INITIALIZER }
+#define mutex_lock(m)		pthread_mutex_lock(&(m)->lock)
+#define mutex_unlock(m)		pthread_mutex_unlock(&(m)->lock)
+
+struct completion {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	unsigned int done;
+};
+
+static inline void init_completion(struct completion *x)
+{
+	pthread_mutex_init(&x->lock, NULL);
+	pthread_cond_init(&x->cond, NULL);
+	x->done = 0;
+}
+
+static inline void reinit_completion(struct completion *x)
+{
+	pthread_mutex_lock(&x->lock);
+	x->done = 0;
+	pthread_mutex_unlock(&x->lock);
+}
+
+static inline void complete(struct completion *x)
+{
+	pthread_mutex_lock(&x->lock);
+	x->done++;
+	pthread_cond_broadcast(&x->cond);
+	pthread_mutex_unlock(&x->lock);
+}
+
+static inline unsigned long wait_for_completion_timeout(struct completion *x,
+							unsigned long timeout)
+{
+	struct timespec ts;
+	unsigned long left = 0;
+	int r = 0;
+
+	shim_deadline(&ts, timeout);
+	pthread_mutex_lock(&x->lock);
+	while (!x->done && r != ETIMEDOUT)
+		r = pthread_cond_timedwait(&x->cond, &x->lock, &ts);
+	if (x->done) {
+		x->done--;
+		left = shim_left(&ts);
+	}
+	pthread_mutex_unlock(&x->lock);
+	return left;
+}
+
+/*
+ * System workqueue, one worker thread run by the test
+ */
+struct work_struct {
+	void (*func)(struct work_struct *work);
+	bool pending;
+};
+
+#define INIT_WORK(w, f)		((w)->func = (f), (w)->pending = false)
+
+bool schedule_work(struct work_struct *work);
+bool cancel_work_sync(struct work_struct *work);
+
+/*
+ * Lists, only the hlist the comm layer keeps its queues on
+ */
+struct hlist_node {
+	struct hlist_node *next, **pprev;
+};
+
+struct hlist_head {
+	struct hlist_node *first;
+};
+
+#define HLIST_HEAD(name)	struct hlist_head name = { NULL }
+#define INIT_HLIST_NODE(n)	((n)->next = NULL, (n)->pprev = NULL)
+
+static inline void hlist_add_head(struct hlist_node *n, struct hlist_head *h)
+{
+	n->next = h->first;
+	if (h->first)
+		h->first->pprev = &n->next;
+	h->first = n;
+	n->pprev = &h->first;
+}
+
+static inline void hlist_del(struct hlist_node *n)
+{
+	*n->pprev = n->next;
+	if (n->next)
+		n->next->pprev = n->pprev;
+}
+
+#define hlist_for_each_entry(pos, head, member) \
+	for (pos = (head)->first ? \
+		container_of((head)->first, typeof(*pos), member) : NULL; \
+	     pos; \
+	     pos = pos->member.next ? \
+		container_of(pos->member.next, typeof(*pos), member) : NULL)
+
+/*
+ * Socket buffers, used as plain allocations
+ */
+struct sk_buff {
+	unsigned int len;
+	unsigned char data[];
+};
+
+#define GFP_KERNEL		0
+
+static inline struct sk_buff *alloc_skb(unsigned int size, int flags)
+{
+	return calloc(1, sizeof(struct sk_buff) + size);
+}
+
+static inline void *skb_put(struct sk_buff *skb, unsigned int len)
+{
+	void *tmp = skb->data + skb->len;
+
+	skb->len += len;
+	return tmp;
+}
+
+#define kfree_skb(skb)		free(skb)
+
+/*
+ * Devices and device tree. devm allocations stay on a list until the test
+ * exits: the comm layer keeps its queue state past the unbind of the
+ * device that allocated it.
+ */
+struct device_node {
+	const char *name;
+};
+
+struct device {
+	struct device *parent;
+	struct device_node *of_node;
+	void *platform_data;
+	void *drvdata;
+};
+
+void *devm_kzalloc(struct device *dev, size_t size, int flags);
+void devm_kfree(struct device *dev, void *p);
+
+#define dev_name(dev)			"tegra-hv-i2c"
+#define dev_get_drvdata(dev)		((dev)->drvdata)
+
+struct dev_pm_ops {
+	int (*suspend_noirq)(struct device *dev);
+	int (*resume_noirq)(struct device *dev);
+};
+
+struct of_device_id {
+	const char *compatible;
+	const void *data;
+};
+
+#define of_match_ptr(ptr)	(ptr)
+#define of_node_put(np)		do { } while (0)
+
+const struct of_device_id *of_match_device(const struct of_device_id *ids,
+					   const struct device *dev);
+struct device_node *of_parse_phandle(const struct device_node *np,
+				     const char *phandle_name, int index);
+int of_property_read_u32_index(const struct device_node *np,
+			       const char *propname, u32 index, u32 *out);
+int of_property_read_u32(const struct device_node *np, const char *propname,
+			 u32 *out_value);
+
+#define IORESOURCE_MEM		0x00000200
+
+struct resource {
+	resource_size_t start;
+	resource_size_t end;
+};
+
+struct platform_device {
+	struct device dev;
+	struct resource *res;
+};
+
+struct platform_device_id {
+	const char *name;
+	unsigned long driver_data;
+};
+
+struct device_driver {
+	const char *name;
+	void *owner;
+	const struct of_device_id *of_match_table;
+	const struct dev_pm_ops *pm;
+};
+
+struct platform_driver {
+	int (*probe)(struct platform_device *pdev);
+	int (*remove)(struct platform_device *pdev);
+	void (*late_shutdown)(struct platform_device *pdev);
+	const struct platform_device_id *id_table;
+	struct device_driver driver;
+};
+
+#define platform_set_drvdata(pdev, data)	((pdev)->dev.drvdata = (data))
+#define platform_get_drvdata(pdev)		((pdev)->dev.drvdata)
+#define platform_get_resource(pdev, type, n)	((pdev)->res)
+#define platform_driver_register(drv)		((void)(drv), 0)
+#define platform_driver_unregister(drv)		do { } while (0)
+
+/*
+ * Interrupts, routed by the test
+ */
+typedef int irqreturn_t;
+typedef irqreturn_t (*irq_handler_t)(int, void *);
+
+#define IRQ_HANDLED		1
+
+int request_threaded_irq(unsigned int irq, irq_handler_t handler,
+			 irq_handler_t thread_fn, unsigned long flags,
+			 const char *name, void *dev_id);
+#define disable_irq(irq)	do { } while (0)
+#define enable_irq(irq)		do { } while (0)
+
+/*
+ * Hypervisor IVC queue, backed by the stub server
+ */
+struct tegra_hv_ivc_cookie {
+	int irq;
+	int peer_vmid;
+	int nframes;
+	int frame_size;
+};
+
+struct tegra_hv_ivc_cookie *tegra_hv_ivc_reserve(struct device_node *dn,
+		int id, const void *ops);
+int tegra_hv_ivc_unreserve(struct tegra_hv_ivc_cookie *ivck);
+int tegra_hv_ivc_write(struct tegra_hv_ivc_cookie *ivck, const void *buf,
+		int size);
+int tegra_hv_ivc_can_read(struct tegra_hv_ivc_cookie *ivck);
+int tegra_hv_ivc_can_write(struct tegra_hv_ivc_cookie *ivck);
+int tegra_hv_ivc_read_peek(struct tegra_hv_ivc_cookie *ivck, void *buf,
+		int off, int count);
+int tegra_hv_ivc_read_advance(struct tegra_hv_ivc_cookie *ivck);
+int tegra_hv_ivc_channel_notified(struct tegra_hv_ivc_cookie *ivck);
+void tegra_hv_ivc_channel_reset(struct tegra_hv_ivc_cookie *ivck);
+
+/*
+ * I2C core, just what the adapter driver fills in and calls
+ */
+#define I2C_M_RD		0x0001
+#define I2C_M_TEN		0x0010
+
+#define I2C_FUNC_I2C		0x00000001
+#define I2C_FUNC_10BIT_ADDR	0x00000002
+#define I2C_FUNC_SMBUS_EMUL	0x0eff0008
+
+#define I2C_CLASS_HWMON		(1 << 0)
+
+struct i2c_msg {
+	u16 addr;
+	u16 flags;
+	u16 len;
+	u8 *buf;
+};
+
+struct i2c_adapter;
+
+struct i2c_algorithm {
+	int (*master_xfer)(struct i2c_adapter *adap, struct i2c_msg *msgs,
+			   int num);
+	u32 (*functionality)(struct i2c_adapter *adap);
+};
+
+struct i2c_adapter {
+	void *owner;
+	unsigned int class;
+	const struct i2c_algorithm *algo;
+	void *algo_data;
+	int timeout;
+	int retries;
+	struct device dev;
+	int nr;
+	char name[48];
+	unsigned long bus_clk_rate;
+};
+
+#define i2c_set_adapdata(adap, data)	((adap)->algo_data = (data))
+#define i2c_get_adapdata(adap)		((adap)->algo_data)
+#define i2c_del_adapter(adap)		do { } while (0)
+#define i2c_shutdown_adapter(adap)	do { } while (0)
+#define i2c_shutdown_clear_adapter(adap) do { } while (0)
+
+int i2c_add_numbered_adapter(struct i2c_adapter *adap);
+
+#endif /* _HV_I2C_SHIM_H */
@@ -0,0 +1,562 @@
+/*
+ * Userspace stand-ins for the kernel facilities used by the IVC core
+ * (drivers/platform/tegra/tegra-ivc.c) and the virtual MTD driver
+ * (drivers/mtd/devices/tegra_hv_mtd.c). Locks, completions, wait queues
+ * and the workqueue are backed by pthreads so that the driver runs with
+ * the same concurrency as in the kernel. Hypervisor, irq and MTD core
+ * hooks are provided by the test.
+ *
+ * Copyright (c) 2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#ifndef _MTD_SHIM_H
+#define _MTD_SHIM_H
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef uint64_t dma_addr_t;
+typedef uint64_t phys_addr_t;
+
+#define __user
+#define __iomem
+#define __packed		__attribute__((packed))
+#define __maybe_unused		__attribute__((unused))
+
+#define EXPORT_SYMBOL(sym)	extern typeof(sym) sym
+#define THIS_MODULE		NULL
+#define MODULE_AUTHOR(s)
+#define MODULE_DESCRIPTION(s)
+#define MODULE_LICENSE(s)
+#define MODULE_DEVICE_TABLE(type, name)
+#define module_platform_driver(drv) \
+	static struct platform_driver *shim_driver __attribute__((unused)) = \
+		&(drv)
+
+#define container_of(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+#define min(a, b)		((a) < (b) ? (a) : (b))
+#define max(a, b)		((a) > (b) ? (a) : (b))
+#define min3(a, b, c)		min(min(a, b), c)
+#define ARRAY_SIZE(arr)		(sizeof(arr) / sizeof((arr)[0]))
+
+#define BUG()			abort()
+#define BUG_ON(cond)		do { if (cond) abort(); } while (0)
+
+#define MAX_ERRNO	4095
+
+static inline void *ERR_PTR(long error)
+{
+	return (void *)error;
+}
+
+static inline long PTR_ERR(const void *ptr)
+{
+	return (long)ptr;
+}
+
+static inline bool IS_ERR(const void *ptr)
+{
+	return (unsigned long)ptr >= (unsigned long)-MAX_ERRNO;
+}
+
+static inline bool IS_ERR_OR_NULL(const void *ptr)
+{
+	return !ptr || IS_ERR(ptr);
+}
+
+/*
+ * Logging. The driver prints kernel format strings (u64 as %llx), which
+ * are fine on LP64 but would trip -Wformat, so no format attribute here.
+ */
+extern int shim_quiet;		/* silence expected errors */
+extern int shim_verbose;	/* show info messages too */
+
+static inline void shim_log(bool show, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (!show)
+		return;
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+}
+
+#define pr_err(fmt, ...)	shim_log(!shim_quiet, fmt, ##__VA_ARGS__)
+#define pr_notice(fmt, ...)	shim_log(shim_verbose, fmt, ##__VA_ARGS__)
+#define pr_debug(fmt, ...)	do { } while (0)
+#define dev_err(dev, fmt, ...) \
+	do { (void)(dev); pr_err(fmt, ##__VA_ARGS__); } while (0)
+#define dev_info(dev, fmt, ...) \
+	do { (void)(dev); pr_notice(fmt, ##__VA_ARGS__); } while (0)
+#define dev_dbg(dev, fmt, ...)	do { (void)(dev); } while (0)
+
+/*
+ * Memory ordering, both ends of the queue pair run on their own thread
+ */
+#define ACCESS_ONCE(x)		(*(volatile typeof(x) *)&(x))
+#define mb()			__atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define rmb()			__atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define wmb()			__atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+static inline unsigned long copy_to_user(void *to, const void *from,
+					 unsigned long n)
+{
+	memcpy(to, from, n);
+	return 0;
+}
+
+static inline unsigned long copy_from_user(void *to, const void *from,
+					   unsigned long n)
+{
+	memcpy(to, from, n);
+	return 0;
+}
+
+/*
+ * Devices. devm allocations are tracked by the test and released when the
+ * device is unbound.
+ */
+struct device_node {
+	const char *name;
+};
+
+struct device {
+	struct device *parent;
+	struct device_node *of_node;
+	void *drvdata;
+};
+
+struct dev_pm_ops {
+	int (*suspend)(struct device *dev);
+	int (*resume)(struct device *dev);
+};
+
+struct platform_device {
+	struct device dev;
+};
+
+struct of_device_id {
+	const char *compatible;
+};
+
+struct device_driver {
+	const char *name;
+	void *owner;
+	const struct of_device_id *of_match_table;
+	const struct dev_pm_ops *pm;
+};
+
+struct platform_driver {
+	int (*probe)(struct platform_device *pdev);
+	int (*remove)(struct platform_device *pdev);
+	struct device_driver driver;
+};
+
+#define of_match_ptr(ptr)			(ptr)
+#define dev_get_drvdata(dev)			((dev)->drvdata)
+#define platform_set_drvdata(pdev, data)	((pdev)->dev.drvdata = (data))
+#define platform_get_drvdata(pdev)		((pdev)->dev.drvdata)
+
+#define GFP_KERNEL		0
+#define MEMREMAP_WB		1
+
+void *devm_kzalloc(struct device *dev, size_t size, int flags);
+void *devm_kmalloc(struct device *dev, size_t size, int flags);
+void *devm_memremap(struct device *dev, phys_addr_t offset, size_t size,
+		    unsigned long flags);
+int of_property_read_u32_index(const struct device_node *np,
+			       const char *propname, u32 index, u32 *out);
+
+enum dma_data_direction {
+	DMA_BIDIRECTIONAL,
+	DMA_TO_DEVICE,
+	DMA_FROM_DEVICE,
+};
+
+#define DMA_ERROR_CODE		(~(dma_addr_t)0)
+#define dma_map_single(d, p, s, dir)		((void)(s), DMA_ERROR_CODE)
+#define dma_unmap_single(d, h, s, dir)		do { } while (0)
+#define dma_sync_single_for_cpu(d, h, s, dir)	do { } while (0)
+#define dma_sync_single_for_device(d, h, s, dir) do { } while (0)
+
+/*
+ * IVC core and hypervisor interface, as declared by tegra-ivc.h and
+ * tegra-ivc-instance.h, which are not part of this tree
+ */
+#define IVC_ALIGN		64
+
+struct ivc_channel_header;
+
+struct ivc {
+	struct ivc_channel_header *rx_channel, *tx_channel;
+	uint32_t w_pos, r_pos;
+	void (*notify)(struct ivc *);
+	uint32_t nframes, frame_size;
+	struct device *peer_device;
+	dma_addr_t rx_handle, tx_handle;
+};
+
+int tegra_ivc_init(struct ivc *ivc, uintptr_t rx_base, uintptr_t tx_base,
+		unsigned nframes, unsigned frame_size,
+		struct device *peer_device, void (*notify)(struct ivc *));
+int tegra_ivc_can_read(struct ivc *ivc);
+int tegra_ivc_can_write(struct ivc *ivc);
+int tegra_ivc_read(struct ivc *ivc, void *buf, size_t max_read);
+void *tegra_ivc_read_get_next_frame(struct ivc *ivc);
+int tegra_ivc_read_advance(struct ivc *ivc);
+int tegra_ivc_write(struct ivc *ivc, const void *buf, size_t size);
+void tegra_ivc_channel_reset(struct ivc *ivc);
+int tegra_ivc_channel_notified(struct ivc *ivc);
+unsigned tegra_ivc_total_queue_size(unsigned queue_size);
+
+struct tegra_hv_ivc_cookie {
+	int irq;
+	int peer_vmid;
+	int nframes;
+	int frame_size;
+};
+
+struct tegra_hv_ivm_cookie {
+	uint64_t ipa;
+	uint64_t size;
+	unsigned peer_vmid;
+	void *reserved;
+};
+
+struct tegra_hv_ivc_cookie *tegra_hv_ivc_reserve(struct device_node *dn,
+		int id, const void *ops);
+int tegra_hv_ivc_unreserve(struct tegra_hv_ivc_cookie *ivck);
+int tegra_hv_ivc_write(struct tegra_hv_ivc_cookie *ivck, const void *buf,
+		int size);
+int tegra_hv_ivc_read(struct tegra_hv_ivc_cookie *ivck, void *buf, int size);
+int tegra_hv_ivc_can_read(struct tegra_hv_ivc_cookie *ivck);
+int tegra_hv_ivc_can_write(struct tegra_hv_ivc_cookie *ivck);
+void *tegra_hv_ivc_read_get_next_frame(struct tegra_hv_ivc_cookie *ivck);
+int tegra_hv_ivc_read_advance(struct tegra_hv_ivc_cookie *ivck);
+int tegra_hv_ivc_channel_notified(struct tegra_hv_ivc_cookie *ivck);
+void tegra_hv_ivc_channel_reset(struct tegra_hv_ivc_cookie *ivck);
+struct tegra_hv_ivm_cookie *tegra_hv_mempool_reserve(unsigned id);
+int tegra_hv_mempool_unreserve(struct tegra_hv_ivm_cookie *ivmk);
+
+static inline bool is_tegra_hypervisor_mode(void)
+{
+	return true;
+}
+
+/*
+ * Interrupts, routed by the test
+ */
+typedef int irqreturn_t;
+typedef irqreturn_t (*irq_handler_t)(int, void *);
+
+#define IRQ_HANDLED		1
+
+int devm_request_irq(struct device *dev, unsigned int irq,
+		     irq_handler_t handler, unsigned long flags,
+		     const char *name, void *dev_id);
+void devm_free_irq(struct device *dev, unsigned int irq, void *dev_id);
+void disable_irq(unsigned int irq);
+void enable_irq(unsigned int irq);
+
+/*
+ * Sleeping
+ */
+#define TASK_INTERRUPTIBLE	1
+#define set_current_state(state)	do { } while (0)
+#define msecs_to_jiffies(ms)		(ms)
+#define schedule_timeout(j)		usleep((j) * 1000)
+
+/*
+ * Locks, completions and wait queues
+ */
+struct mutex {
+	pthread_mutex_t lock;
+};
+
+#define mutex_init(m)		pthread_mutex_init(&(m)->lock, NULL)
+#define mutex_lock(m)		pthread_mutex_lock(&(m)->lock)
+#define mutex_unlock(m)		pthread_mutex_unlock(&(m)->lock)
+
+struct completion {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	unsigned int done;
+};
+
+static inline void init_completion(struct completion *x)
+{
+	pthread_mutex_init(&x->lock, NULL);
+	pthread_cond_init(&x->cond, NULL);
+	x->done = 0;
+}
+
+static inline void reinit_completion(struct completion *x)
+{
+	pthread_mutex_lock(&x->lock);
+	x->done = 0;
+	pthread_mutex_unlock(&x->lock);
+}
+
+static inline void complete(struct completion *x)
+{
+	pthread_mutex_lock(&x->lock);
+	if (x->done != UINT_MAX)
+		x->done++;
+	pthread_cond_broadcast(&x->cond);
+	pthread_mutex_unlock(&x->lock);
+}
+
+static inline void wait_for_completion(struct completion *x)
+{
+	pthread_mutex_lock(&x->lock);
+	while (!x->done)
+		pthread_cond_wait(&x->cond, &x->lock);
+	x->done--;
+	pthread_mutex_unlock(&x->lock);
+}
+
+typedef struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} wait_queue_head_t;
+
+static inline void init_waitqueue_head(wait_queue_head_t *wq)
+{
+	pthread_mutex_init(&wq->lock, NULL);
+	pthread_cond_init(&wq->cond, NULL);
+}
+
+/* the condition is evaluated under the wait queue lock */
+#define wait_event(wq, condition) \
+	do { \
+		pthread_mutex_lock(&(wq).lock); \
+		while (!(condition)) \
+			pthread_cond_wait(&(wq).cond, &(wq).lock); \
+		pthread_mutex_unlock(&(wq).lock); \
+	} while (0)
+
+static inline void wake_up_all(wait_queue_head_t *wq)
+{
+	pthread_mutex_lock(&wq->lock);
+	pthread_cond_broadcast(&wq->cond);
+	pthread_mutex_unlock(&wq->lock);
+}
+
+#define wake_up(wq)		wake_up_all(wq)
+
+/*
+ * Workqueue, one worker thread running the single work item the driver
+ * queues
+ */
+struct work_struct {
+	void (*func)(struct work_struct *work);
+};
+
+#define INIT_WORK(w, f)		((w)->func = (f))
+
+struct workqueue_struct {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct work_struct *work;
+	bool queued;
+	bool running;
+	bool stop;
+};
+
+#define WQ_UNBOUND		(1 << 1)
+#define WQ_MEM_RECLAIM		(1 << 3)
+#define WQ_HIGHPRI		(1 << 4)
+#define WORK_CPU_UNBOUND	-1
+
+static inline void *shim_worker(void *arg)
+{
+	struct workqueue_struct *wq = arg;
+
+	pthread_mutex_lock(&wq->lock);
+	for (;;) {
+		while (!wq->queued && !wq->stop)
+			pthread_cond_wait(&wq->cond, &wq->lock);
+		if (!wq->queued)
+			break;
+
+		wq->queued = false;
+		wq->running = true;
+		pthread_mutex_unlock(&wq->lock);
+		wq->work->func(wq->work);
+		pthread_mutex_lock(&wq->lock);
+		wq->running = false;
+		pthread_cond_broadcast(&wq->cond);
+	}
+	pthread_mutex_unlock(&wq->lock);
+	return NULL;
+}
+
+static inline struct workqueue_struct *shim_alloc_workqueue(void)
+{
+	struct workqueue_struct *wq = calloc(1, sizeof(*wq));
+
+	if (!wq)
+		return NULL;
+	pthread_mutex_init(&wq->lock, NULL);
+	pthread_cond_init(&wq->cond, NULL);
+	if (pthread_create(&wq->thread, NULL, shim_worker, wq)) {
+		free(wq);
+		return NULL;
+	}
+	return wq;
+}
+
+#define alloc_workqueue(fmt, flags, max_active, ...) shim_alloc_workqueue()
+
+static inline bool queue_work_on(int cpu, struct workqueue_struct *wq,
+				 struct work_struct *work)
+{
+	bool queued;
+
+	pthread_mutex_lock(&wq->lock);
+	queued = !wq->queued;
+	wq->work = work;
+	wq->queued = true;
+	pthread_cond_broadcast(&wq->cond);
+	pthread_mutex_unlock(&wq->lock);
+	return queued;
+}
+
+static inline void flush_workqueue(struct workqueue_struct *wq)
+{
+	pthread_mutex_lock(&wq->lock);
+	while (wq->queued || wq->running)
+		pthread_cond_wait(&wq->cond, &wq->lock);
+	pthread_mutex_unlock(&wq->lock);
+}
+
+static inline void destroy_workqueue(struct workqueue_struct *wq)
+{
+	flush_workqueue(wq);
+	pthread_mutex_lock(&wq->lock);
+	wq->stop = true;
+	pthread_cond_broadcast(&wq->cond);
+	pthread_mutex_unlock(&wq->lock);
+	pthread_join(wq->thread, NULL);
+	free(wq);
+}
+
+/*
+ * Bitmaps, only touched under the driver's req_lock
+ */
+#define BITS_PER_LONG		(8 * sizeof(long))
+#define BITS_TO_LONGS(n)	(((n) + BITS_PER_LONG - 1) / BITS_PER_LONG)
+#define DECLARE_BITMAP(name, bits)	unsigned long name[BITS_TO_LONGS(bits)]
+
+static inline bool test_bit(unsigned long nr, const unsigned long *addr)
+{
+	return (addr[nr / BITS_PER_LONG] >> (nr % BITS_PER_LONG)) & 1;
+}
+
+static inline void set_bit(unsigned long nr, unsigned long *addr)
+{
+	addr[nr / BITS_PER_LONG] |= 1UL << (nr % BITS_PER_LONG);
+}
+
+static inline bool test_and_clear_bit(unsigned long nr, unsigned long *addr)
+{
+	bool old = test_bit(nr, addr);
+
+	addr[nr / BITS_PER_LONG] &= ~(1UL << (nr % BITS_PER_LONG));
+	return old;
+}
+
+static inline unsigned long find_next_bit(const unsigned long *addr,
+					  unsigned long size,
+					  unsigned long offset)
+{
+	while (offset < size && !test_bit(offset, addr))
+		offset++;
+	return offset;
+}
+
+static inline unsigned long find_first_zero_bit(const unsigned long *addr,
+						unsigned long size)
+{
+	unsigned long bit = 0;
+
+	while (bit < size && test_bit(bit, addr))
+		bit++;
+	return bit;
+}
+
+#define for_each_set_bit(bit, addr, size) \
+	for ((bit) = find_next_bit((addr), (size), 0); \
+	     (bit) < (size); \
+	     (bit) = find_next_bit((addr), (size), (bit) + 1))
+
+/*
+ * MTD core, just the fields the driver fills in
+ */
+#define MTD_NORFLASH		3
+#define MTD_WRITEABLE		0x400
+#define MTD_BIT_WRITEABLE	0x800
+#define MTD_CAP_NORFLASH	(MTD_WRITEABLE | MTD_BIT_WRITEABLE)
+
+#define MTD_ERASE_DONE		0x08
+#define MTD_ERASE_FAILED	0x10
+
+typedef unsigned char u_char;
+
+struct erase_info {
+	uint64_t addr;
+	uint64_t len;
+	u_char state;
+};
+
+struct mtd_info {
+	u_char type;
+	uint32_t flags;
+	uint64_t size;
+	uint32_t erasesize;
+	uint32_t writesize;
+	uint32_t writebufsize;
+	const char *name;
+	struct device dev;
+	int (*_erase)(struct mtd_info *mtd, struct erase_info *instr);
+	int (*_read)(struct mtd_info *mtd, loff_t from, size_t len,
+		     size_t *retlen, u_char *buf);
+	int (*_write)(struct mtd_info *mtd, loff_t to, size_t len,
+		      size_t *retlen, const u_char *buf);
+};
+
+#define mtd_set_of_node(mtd, np)	((mtd)->dev.of_node = (np))
+#define mtd_erase_callback(instr)	do { } while (0)
+
+int mtd_device_parse_register(struct mtd_info *mtd, const char *const *types,
+			      void *parser_data, const void *parts,
+			      int nr_parts);
+
+#endif /* _MTD_SHIM_H */
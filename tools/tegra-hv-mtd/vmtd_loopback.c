@@ -0,0 +1,871 @@
+/*
+ * vmtd_loopback - loopback test and benchmark for the virtual MTD driver
+ * (drivers/mtd/devices/tegra_hv_mtd.c) against a stub storage server,
+ * built in userspace against mtd_shim.h.
+ *
+ * Copyright (c) 2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Example Usage:
+ *	vmtd_loopback				run the loopback tests
+ *	vmtd_loopback -b			read throughput by queue depth
+ *	vmtd_loopback -b -l 500 -n 1024		slower server, 1 MiB read
+ *
+ * The driver is probed as a platform device. Its ivc channel is one end
+ * of a queue pair driven by the IVC core; the other end belongs to the
+ * server thread, which serves a RAM backed flash through the mempool the
+ * way the storage server does. The server answers everything it has read
+ * after one service latency, optionally in reverse order, and can be told
+ * to fail requests or to reset the channel under the driver.
+ */
+
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+
+#include "tegra-ivc.c"
+#include "tegra_hv_mtd.c"
+
+int shim_quiet;
+int shim_verbose;
+
+static int failures;
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s:%d: check failed: %s\n", \
+				__func__, __LINE__, #cond); \
+			failures++; \
+			return -1; \
+		} \
+	} while (0)
+
+#define IVC_ID		7
+#define IVM_ID		3
+#define IVC_IRQ		42
+#define NFRAMES		16
+#define FRAME_SIZE	128
+
+#define FLASH_SIZE	(4 << 20)
+#define ERASE_SIZE	(64 << 10)
+#define MAX_IO		4096
+
+/*
+ * Hypervisor: one queue pair and one mempool
+ */
+static char *shm;
+static size_t queue_size;
+static struct ivc local_ivc, peer_ivc;
+static struct tegra_hv_ivc_cookie cookie = {
+	.irq = IVC_IRQ,
+	.nframes = NFRAMES,
+	.frame_size = FRAME_SIZE,
+};
+static struct tegra_hv_ivm_cookie ivm;
+static char *mempool;
+
+struct tegra_hv_ivc_cookie *tegra_hv_ivc_reserve(struct device_node *dn,
+		int id, const void *ops)
+{
+	return id == IVC_ID ? &cookie : ERR_PTR(-ENODEV);
+}
+
+int tegra_hv_ivc_unreserve(struct tegra_hv_ivc_cookie *ivck)
+{
+	return 0;
+}
+
+int tegra_hv_ivc_write(struct tegra_hv_ivc_cookie *ivck, const void *buf,
+		int size)
+{
+	return tegra_ivc_write(&local_ivc, buf, size);
+}
+
+int tegra_hv_ivc_read(struct tegra_hv_ivc_cookie *ivck, void *buf, int size)
+{
+	return tegra_ivc_read(&local_ivc, buf, size);
+}
+
+int tegra_hv_ivc_can_read(struct tegra_hv_ivc_cookie *ivck)
+{
+	return tegra_ivc_can_read(&local_ivc);
+}
+
+int tegra_hv_ivc_can_write(struct tegra_hv_ivc_cookie *ivck)
+{
+	return tegra_ivc_can_write(&local_ivc);
+}
+
+void *tegra_hv_ivc_read_get_next_frame(struct tegra_hv_ivc_cookie *ivck)
+{
+	return tegra_ivc_read_get_next_frame(&local_ivc);
+}
+
+int tegra_hv_ivc_read_advance(struct tegra_hv_ivc_cookie *ivck)
+{
+	return tegra_ivc_read_advance(&local_ivc);
+}
+
+int tegra_hv_ivc_channel_notified(struct tegra_hv_ivc_cookie *ivck)
+{
+	return tegra_ivc_channel_notified(&local_ivc);
+}
+
+void tegra_hv_ivc_channel_reset(struct tegra_hv_ivc_cookie *ivck)
+{
+	tegra_ivc_channel_reset(&local_ivc);
+}
+
+struct tegra_hv_ivm_cookie *tegra_hv_mempool_reserve(unsigned id)
+{
+	return id == IVM_ID ? &ivm : ERR_PTR(-ENODEV);
+}
+
+int tegra_hv_mempool_unreserve(struct tegra_hv_ivm_cookie *ivmk)
+{
+	return 0;
+}
+
+/*
+ * Interrupts. The server's doorbell runs the driver's handler on the
+ * server thread, unless the line is disabled.
+ */
+static struct {
+	pthread_mutex_t lock;
+	irq_handler_t handler;
+	void *dev_id;
+	bool disabled;
+	bool pending;
+	unsigned long count;
+} irq = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+int devm_request_irq(struct device *dev, unsigned int nr,
+		     irq_handler_t handler, unsigned long flags,
+		     const char *name, void *dev_id)
+{
+	if (nr != IVC_IRQ || irq.handler)
+		return -EINVAL;
+
+	pthread_mutex_lock(&irq.lock);
+	irq.handler = handler;
+	irq.dev_id = dev_id;
+	irq.disabled = false;
+	irq.pending = false;
+	pthread_mutex_unlock(&irq.lock);
+	return 0;
+}
+
+void devm_free_irq(struct device *dev, unsigned int nr, void *dev_id)
+{
+	pthread_mutex_lock(&irq.lock);
+	irq.handler = NULL;
+	pthread_mutex_unlock(&irq.lock);
+}
+
+static void raise_irq(void)
+{
+	pthread_mutex_lock(&irq.lock);
+	if (irq.disabled) {
+		irq.pending = true;
+	} else if (irq.handler) {
+		irq.count++;
+		irq.handler(IVC_IRQ, irq.dev_id);
+	}
+	pthread_mutex_unlock(&irq.lock);
+}
+
+void disable_irq(unsigned int nr)
+{
+	pthread_mutex_lock(&irq.lock);
+	irq.disabled = true;
+	pthread_mutex_unlock(&irq.lock);
+}
+
+void enable_irq(unsigned int nr)
+{
+	bool pending;
+
+	pthread_mutex_lock(&irq.lock);
+	irq.disabled = false;
+	pending = irq.pending;
+	irq.pending = false;
+	pthread_mutex_unlock(&irq.lock);
+
+	if (pending)
+		raise_irq();
+}
+
+/*
+ * Platform device, MTD core and devm
+ */
+static struct device_node np = { .name = "virt-mtd" };
+static struct platform_device pdev = { .dev = { .of_node = &np } };
+static struct mtd_info *mtd;
+
+#define MAX_DEVM	8
+
+static void *devm_ptrs[MAX_DEVM];
+static int devm_count;
+
+void *devm_kzalloc(struct device *dev, size_t size, int flags)
+{
+	void *p;
+
+	if (devm_count == MAX_DEVM)
+		return NULL;
+	p = calloc(1, size);
+	if (p)
+		devm_ptrs[devm_count++] = p;
+	return p;
+}
+
+void *devm_kmalloc(struct device *dev, size_t size, int flags)
+{
+	return devm_kzalloc(dev, size, flags);
+}
+
+void *devm_memremap(struct device *dev, phys_addr_t offset, size_t size,
+		    unsigned long flags)
+{
+	return (void *)(uintptr_t)offset;
+}
+
+int of_property_read_u32_index(const struct device_node *node,
+			       const char *propname, u32 index, u32 *out)
+{
+	if (!strcmp(propname, "ivc") && index == 1)
+		*out = IVC_ID;
+	else if (!strcmp(propname, "mempool") && index == 0)
+		*out = IVM_ID;
+	else
+		return -EINVAL;
+	return 0;
+}
+
+int mtd_device_parse_register(struct mtd_info *m, const char *const *types,
+			      void *parser_data, const void *parts,
+			      int nr_parts)
+{
+	mtd = m;
+	return 0;
+}
+
+/*
+ * Stub storage server
+ */
+static u8 *flash;
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t thread;
+	bool bell;
+	bool stop;
+	bool reset_now;			/* reset the channel while idle */
+	bool established;
+
+	/* behaviour, set while the driver is idle */
+	unsigned int latency_us;	/* service time of one batch */
+	bool reverse;			/* answer each batch last to first */
+	int32_t status;			/* status of data requests */
+	unsigned long reset_at;		/* reset the channel at this request */
+
+	/* statistics */
+	unsigned long requests;
+	unsigned long batches;
+	unsigned int max_batch;
+	unsigned long resets;
+} srv = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
+/* doorbell from the driver's end */
+static void local_notify(struct ivc *ivc)
+{
+	pthread_mutex_lock(&srv.lock);
+	srv.bell = true;
+	pthread_cond_signal(&srv.cond);
+	pthread_mutex_unlock(&srv.lock);
+}
+
+/* doorbell from the server's end */
+static void peer_notify(struct ivc *ivc)
+{
+	raise_irq();
+}
+
+static void serve_config(struct vs_request *vs_req)
+{
+	struct vs_mtd_dev_config *cfg = &vs_req->config_info.mtd_config;
+
+	vs_req->status = 0;
+	vs_req->config_info.virtual_storage_ver = 1;
+	vs_req->config_info.type = VS_MTD_DEV;
+	cfg->max_read_bytes_per_io = MAX_IO;
+	cfg->max_write_bytes_per_io = MAX_IO;
+	cfg->erase_size = ERASE_SIZE;
+	cfg->req_ops_supported = VS_MTD_READ_OP_F | VS_MTD_WRITE_OP_F |
+		VS_MTD_ERASE_OP_F;
+	cfg->size = FLASH_SIZE;
+}
+
+static void serve_data(struct vs_request *vs_req)
+{
+	struct vs_mtd_request *mtd_req = &vs_req->mtddev_req.mtd_req;
+	struct vs_mtd_response *resp = &vs_req->mtddev_resp.mtd_resp;
+	uint64_t offset = mtd_req->offset;
+	uint32_t size = mtd_req->size;
+	char *data = mempool + mtd_req->data_offset;
+	bool has_data = vs_req->mtddev_req.req_op != VS_MTD_ERASE;
+	int32_t status = srv.status;
+
+	if (offset > FLASH_SIZE || size > FLASH_SIZE - offset ||
+	    (has_data && (mtd_req->data_offset > ivm.size ||
+			  size > ivm.size - mtd_req->data_offset)))
+		status = -EINVAL;
+
+	if (status == 0) {
+		switch (vs_req->mtddev_req.req_op) {
+		case VS_MTD_READ:
+			memcpy(data, flash + offset, size);
+			break;
+		case VS_MTD_WRITE:
+			memcpy(flash + offset, data, size);
+			break;
+		case VS_MTD_ERASE:
+			memset(flash + offset, 0xff, size);
+			break;
+		default:
+			status = -EINVAL;
+			break;
+		}
+	}
+
+	vs_req->status = status;
+	resp->status = 0;
+	resp->size = status ? 0 : size;
+}
+
+static void serve_batch(void)
+{
+	struct vs_request batch[NFRAMES];
+	struct vs_request *vs_req;
+	unsigned int n = 0, i;
+
+	while (n < NFRAMES && tegra_ivc_can_read(&peer_ivc)) {
+		if (tegra_ivc_read(&peer_ivc, &batch[n],
+				   sizeof(batch[n])) != sizeof(batch[n]))
+			break;
+		n++;
+	}
+	if (!n)
+		return;
+
+	srv.batches++;
+	srv.max_batch = max(srv.max_batch, n);
+	if (srv.reset_at && srv.requests + n >= srv.reset_at) {
+		/* drop the whole batch, as a restarting server would */
+		srv.reset_at = 0;
+		srv.requests += n;
+		srv.resets++;
+		tegra_ivc_channel_reset(&peer_ivc);
+		return;
+	}
+	srv.requests += n;
+
+	if (srv.latency_us)
+		usleep(srv.latency_us);
+
+	for (i = 0; i < n; i++) {
+		vs_req = &batch[srv.reverse ? n - 1 - i : i];
+		if (vs_req->type == VS_CONFIGINFO_REQ)
+			serve_config(vs_req);
+		else if (vs_req->type == VS_DATA_REQ)
+			serve_data(vs_req);
+		else
+			vs_req->status = -EINVAL;
+
+		/* requests in flight are bounded by the frame count */
+		while (!tegra_ivc_can_write(&peer_ivc))
+			usleep(10);
+		tegra_ivc_write(&peer_ivc, vs_req, sizeof(*vs_req));
+	}
+}
+
+static void *server_thread(void *arg)
+{
+	pthread_mutex_lock(&srv.lock);
+	while (!srv.stop) {
+		if (!srv.bell) {
+			pthread_cond_wait(&srv.cond, &srv.lock);
+			continue;
+		}
+		srv.bell = false;
+		pthread_mutex_unlock(&srv.lock);
+
+		if (srv.reset_now) {
+			srv.reset_now = false;
+			srv.established = false;
+			srv.resets++;
+			tegra_ivc_channel_reset(&peer_ivc);
+		} else if (tegra_ivc_channel_notified(&peer_ivc) == 0) {
+			srv.established = true;
+			serve_batch();
+		}
+
+		pthread_mutex_lock(&srv.lock);
+	}
+	pthread_mutex_unlock(&srv.lock);
+	return NULL;
+}
+
+/*
+ * Device life cycle
+ */
+static struct vmtd_dev *vmtddev;
+static bool probed;
+
+/* Bring up the server and probe the driver with room for depth requests */
+static int bind(unsigned int depth)
+{
+	int ret;
+
+	memset(shm, 0, 2 * queue_size);
+	ret = tegra_ivc_init(&local_ivc, (uintptr_t)shm,
+			     (uintptr_t)shm + queue_size, NFRAMES, FRAME_SIZE,
+			     NULL, local_notify);
+	if (!ret)
+		ret = tegra_ivc_init(&peer_ivc, (uintptr_t)shm + queue_size,
+				     (uintptr_t)shm, NFRAMES, FRAME_SIZE,
+				     NULL, peer_notify);
+	if (ret)
+		return ret;
+
+	ivm.size = depth * MAX_IO;
+	srv.bell = false;
+	srv.stop = false;
+	srv.reset_now = false;
+	srv.established = false;
+	srv.latency_us = 0;
+	srv.reverse = false;
+	srv.status = 0;
+	srv.reset_at = 0;
+	srv.requests = 0;
+	srv.batches = 0;
+	srv.max_batch = 0;
+	srv.resets = 0;
+	if (pthread_create(&srv.thread, NULL, server_thread, NULL))
+		return -ENOMEM;
+
+	/* the server comes up first and waits for the guest */
+	tegra_ivc_channel_reset(&peer_ivc);
+
+	mtd = NULL;
+	irq.count = 0;
+	ret = tegra_virt_mtd_driver.probe(&pdev);
+	vmtddev = platform_get_drvdata(&pdev);
+	probed = ret == 0;
+	return ret;
+}
+
+static void unbind(void)
+{
+	int i;
+
+	if (probed)
+		tegra_virt_mtd_driver.remove(&pdev);
+	probed = false;
+
+	pthread_mutex_lock(&srv.lock);
+	srv.stop = true;
+	pthread_cond_signal(&srv.cond);
+	pthread_mutex_unlock(&srv.lock);
+	pthread_join(srv.thread, NULL);
+
+	for (i = 0; i < devm_count; i++)
+		free(devm_ptrs[i]);
+	devm_count = 0;
+	vmtddev = NULL;
+}
+
+static void fill(u8 *buf, size_t len, unsigned int seed)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = (u8)(i * 7 + seed + (i >> 12));
+}
+
+/*
+ * Tests
+ */
+static int test_config(void)
+{
+	CHECK(bind(4) == 0);
+	CHECK(mtd == &vmtddev->mtd);
+	CHECK(mtd->size == FLASH_SIZE);
+	CHECK(mtd->erasesize == ERASE_SIZE);
+	CHECK(vmtddev->max_requests == 4);
+	CHECK(vmtddev->is_setup);
+	unbind();
+	return 0;
+}
+
+/* unaligned transfers that are not a multiple of the I/O size */
+static int test_read_write(void)
+{
+	size_t len = (1 << 20) + 777, retlen = 0;
+	loff_t off = 4096 + 3;
+	u8 *wbuf = malloc(len), *rbuf = malloc(len);
+
+	CHECK(wbuf && rbuf);
+	fill(wbuf, len, 1);
+
+	CHECK(bind(8) == 0);
+	CHECK(mtd->_write(mtd, off, len, &retlen, wbuf) == 0);
+	CHECK(retlen == len);
+	CHECK(!memcmp(flash + off, wbuf, len));
+
+	retlen = 0;
+	memset(rbuf, 0, len);
+	CHECK(mtd->_read(mtd, off, len, &retlen, rbuf) == 0);
+	CHECK(retlen == len);
+	CHECK(!memcmp(rbuf, wbuf, len));
+	CHECK(srv.max_batch > 1);
+	CHECK(vmtddev->inflight_reqs == 0);
+	unbind();
+
+	free(wbuf);
+	free(rbuf);
+	return 0;
+}
+
+/* responses in reverse order still land in the right place */
+static int test_out_of_order(void)
+{
+	size_t len = 256 << 10, retlen;
+	u8 *rbuf = malloc(len);
+
+	CHECK(rbuf);
+	fill(flash, FLASH_SIZE, 2);
+
+	CHECK(bind(16) == 0);
+	srv.reverse = true;
+	srv.latency_us = 200;
+	CHECK(mtd->_read(mtd, 0, len, &retlen, rbuf) == 0);
+	CHECK(!memcmp(rbuf, flash, len));
+	CHECK(srv.max_batch > 1);
+	unbind();
+
+	free(rbuf);
+	return 0;
+}
+
+static int test_erase(void)
+{
+	struct erase_info instr = {
+		.addr = 2 * ERASE_SIZE,
+		.len = ERASE_SIZE,
+	};
+	size_t retlen;
+	u8 *rbuf = malloc(ERASE_SIZE);
+	u8 before, after;
+	size_t i;
+
+	CHECK(rbuf);
+	fill(flash, FLASH_SIZE, 3);
+	before = flash[instr.addr - 1];
+	after = flash[instr.addr + ERASE_SIZE];
+
+	CHECK(bind(4) == 0);
+	CHECK(mtd->_erase(mtd, &instr) == 0);
+	CHECK(instr.state == MTD_ERASE_DONE);
+	CHECK(mtd->_read(mtd, instr.addr, ERASE_SIZE, &retlen, rbuf) == 0);
+	for (i = 0; i < ERASE_SIZE; i++)
+		CHECK(rbuf[i] == 0xff);
+	CHECK(flash[instr.addr - 1] == before);
+	CHECK(flash[instr.addr + ERASE_SIZE] == after);
+
+	instr.len = FLASH_SIZE;
+	shim_quiet = 1;
+	CHECK(mtd->_erase(mtd, &instr) == -EPERM);
+	shim_quiet = 0;
+	unbind();
+
+	free(rbuf);
+	return 0;
+}
+
+/* failed requests fail the transfer and give their slots back */
+static int test_errors(void)
+{
+	size_t len = 64 << 10, retlen;
+	u8 *rbuf = malloc(len);
+
+	CHECK(rbuf);
+	CHECK(bind(4) == 0);
+
+	shim_quiet = 1;
+	srv.status = -EIO;
+	CHECK(mtd->_read(mtd, 0, len, &retlen, rbuf) == -EIO);
+	CHECK(mtd->_read(mtd, FLASH_SIZE - 1, 2, &retlen, rbuf) == -EPERM);
+	shim_quiet = 0;
+	CHECK(vmtddev->inflight_reqs == 0);
+
+	srv.status = 0;
+	fill(flash, len, 4);
+	CHECK(mtd->_read(mtd, 0, len, &retlen, rbuf) == 0);
+	CHECK(!memcmp(rbuf, flash, len));
+	unbind();
+
+	free(rbuf);
+	return 0;
+}
+
+/*
+ * A server restart resets the channel with requests in flight. They must
+ * fail rather than wait forever, and the channel must come back without
+ * any help from the test.
+ */
+static int test_peer_reset(void)
+{
+	size_t len = 512 << 10, retlen;
+	u8 *rbuf = malloc(len);
+	int ret;
+
+	CHECK(rbuf);
+	fill(flash, FLASH_SIZE, 5);
+
+	CHECK(bind(8) == 0);
+	srv.latency_us = 100;
+	srv.reset_at = srv.requests + 20;
+
+	shim_quiet = 1;
+	ret = mtd->_read(mtd, 0, len, &retlen, rbuf);
+	shim_quiet = 0;
+	CHECK(ret == -EIO);
+	CHECK(srv.resets == 1);
+	CHECK(vmtddev->inflight_reqs == 0);
+
+	CHECK(mtd->_read(mtd, 0, len, &retlen, rbuf) == 0);
+	CHECK(!memcmp(rbuf, flash, len));
+	unbind();
+
+	free(rbuf);
+	return 0;
+}
+
+/*
+ * A server restart while the driver is idle. The driver must answer the
+ * handshake from its interrupt, not wait for the next request to notice.
+ */
+static int test_idle_reset(void)
+{
+	size_t len = 64 << 10, retlen;
+	u8 *rbuf = malloc(len);
+	int i;
+
+	CHECK(rbuf);
+	fill(flash, FLASH_SIZE, 7);
+
+	CHECK(bind(4) == 0);
+	CHECK(mtd->_read(mtd, 0, len, &retlen, rbuf) == 0);
+	CHECK(srv.established);
+
+	pthread_mutex_lock(&srv.lock);
+	srv.reset_now = true;
+	srv.bell = true;
+	pthread_cond_signal(&srv.cond);
+	pthread_mutex_unlock(&srv.lock);
+
+	for (i = 0; i < 1000 && (srv.reset_now || !srv.established); i++)
+		usleep(1000);
+	CHECK(srv.resets == 1);
+	CHECK(srv.established);
+
+	memset(rbuf, 0, len);
+	CHECK(mtd->_read(mtd, len, len, &retlen, rbuf) == 0);
+	CHECK(!memcmp(rbuf, flash + len, len));
+	unbind();
+
+	free(rbuf);
+	return 0;
+}
+
+static int test_suspend_resume(void)
+{
+	const struct dev_pm_ops *pm = tegra_virt_mtd_driver.driver.pm;
+	size_t len = 128 << 10, retlen;
+	u8 *rbuf = malloc(len);
+
+	CHECK(rbuf);
+	fill(flash, FLASH_SIZE, 6);
+
+	CHECK(bind(4) == 0);
+	CHECK(mtd->_read(mtd, 0, len, &retlen, rbuf) == 0);
+	CHECK(pm->suspend(&pdev.dev) == 0);
+	CHECK(vmtd_get_req(vmtddev) == NULL);
+	CHECK(pm->resume(&pdev.dev) == 0);
+
+	memset(rbuf, 0, len);
+	CHECK(mtd->_read(mtd, len, len, &retlen, rbuf) == 0);
+	CHECK(!memcmp(rbuf, flash + len, len));
+	unbind();
+
+	free(rbuf);
+	return 0;
+}
+
+/*
+ * Every interrupt completes msg_complete; the count must not build up
+ * across requests, or waiting for a free frame becomes a busy loop.
+ */
+static int test_msg_complete(void)
+{
+	size_t len = 1 << 20, retlen;
+	u8 *rbuf = malloc(len);
+
+	CHECK(rbuf);
+	CHECK(bind(8) == 0);
+	CHECK(mtd->_read(mtd, 0, len, &retlen, rbuf) == 0);
+	CHECK(irq.count > 2 * NFRAMES);
+	CHECK(vmtddev->msg_complete.done <= vmtddev->max_requests + 1);
+	unbind();
+
+	free(rbuf);
+	return 0;
+}
+
+/*
+ * Benchmark: one large read at each queue depth. Depth 1 is the old
+ * behaviour of one request at a time.
+ */
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int bench(size_t len, unsigned int latency_us)
+{
+	static const unsigned int depths[] = { 1, 2, 4, 8, 16 };
+	u8 *rbuf = malloc(len);
+	size_t retlen;
+	unsigned int i;
+	double t;
+
+	CHECK(rbuf);
+	printf("read %zu KiB in %u byte I/Os, server latency %u us\n",
+	       len >> 10, MAX_IO, latency_us);
+	printf("%6s %10s %10s\n", "depth", "MB/s", "req/batch");
+
+	for (i = 0; i < ARRAY_SIZE(depths); i++) {
+		CHECK(bind(depths[i]) == 0);
+		srv.latency_us = latency_us;
+		srv.requests = 0;
+		srv.batches = 0;
+
+		t = now();
+		CHECK(mtd->_read(mtd, 0, len, &retlen, rbuf) == 0);
+		t = now() - t;
+
+		printf("%6u %10.1f %10.2f\n", vmtddev->max_requests,
+		       len / t / 1e6, (double)srv.requests / srv.batches);
+		unbind();
+	}
+
+	free(rbuf);
+	return 0;
+}
+
+static void watchdog(int sig)
+{
+	static const char msg[] = "FAIL: timed out\n";
+
+	if (write(STDERR_FILENO, msg, sizeof(msg) - 1) < 0)
+		_exit(2);
+	_exit(1);
+}
+
+static int setup(void)
+{
+	queue_size = tegra_ivc_total_queue_size(NFRAMES * FRAME_SIZE);
+	shm = aligned_alloc(4096, (2 * queue_size + 4095) & ~4095UL);
+	mempool = aligned_alloc(4096, NFRAMES * MAX_IO);
+	flash = malloc(FLASH_SIZE);
+	if (!shm || !mempool || !flash)
+		return -ENOMEM;
+
+	ivm.ipa = (uintptr_t)mempool;
+	memset(flash, 0xff, FLASH_SIZE);
+	signal(SIGALRM, watchdog);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	size_t len = FLASH_SIZE;
+	unsigned int latency_us = 100;
+	bool do_bench = false;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "bl:n:v")) != -1) {
+		switch (opt) {
+		case 'b':
+			do_bench = true;
+			break;
+		case 'l':
+			latency_us = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			len = strtoul(optarg, NULL, 0) << 10;
+			break;
+		case 'v':
+			shim_verbose = 1;
+			break;
+		default:
+			fprintf(stderr,
+				"usage: %s [-b] [-l latency_us] [-n KiB] [-v]\n",
+				argv[0]);
+			return 2;
+		}
+	}
+
+	if (setup()) {
+		fprintf(stderr, "setup failed\n");
+		return 1;
+	}
+
+	if (do_bench) {
+		if (len == 0 || len > FLASH_SIZE)
+			len = FLASH_SIZE;
+		alarm(600);
+		return bench(len, latency_us) ? 1 : 0;
+	}
+
+	alarm(60);
+	test_config();
+	test_read_write();
+	test_out_of_order();
+	test_erase();
+	test_errors();
+	test_peer_reset();
+	test_idle_reset();
+	test_suspend_resume();
+	test_msg_complete();
+
+	printf("%s\n", failures ? "FAIL" : "PASS");
+	return failures ? 1 : 0;
+}
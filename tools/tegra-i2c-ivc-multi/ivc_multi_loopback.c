@@ -0,0 +1,1317 @@
+/*
+ * ivc_multi_loopback - unit test for the CamRTC I2C multi driver
+ * (drivers/i2c/busses/i2c-ivc-multi.c), built in userspace against
+ * ivc_multi_shim.h and an emulated CamRTC with sensors behind it.
+ *
+ * Copyright (c) 2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Example Usage:
+ *	ivc_multi_loopback		run the unit tests
+ *
+ * The IVC/RPC layer is replaced by a mock with the same synchronous and
+ * asynchronous semantics: responses are matched by sequence number and
+ * asynchronous callbacks and timeouts run on the CamRTC thread, which
+ * plays the rx tasklet.
+ *
+ * The CamRTC thread decodes I2C_REQUEST_MULTI messages into the register
+ * files of emulated sensors with 16 bit register addresses. Untagged
+ * requests are applied at once. A request tagged with a frame ID is held
+ * until the test advances the emulated frame counter to that frame, and
+ * dropped if that frame has already started. Time is emulated as well:
+ * each frame lasts frame_us, the response to a table follows the frame
+ * start by EMU_XFER_US, or rsp_delay frames later, and an asynchronous
+ * RPC times out when its timeout_ms passes in emulated time before its
+ * response arrives.
+ */
+
+#include "ivc_multi_shim.h"
+
+#include "i2c-ivc-multi.c"
+
+int shim_quiet;
+unsigned int shim_warnings;
+
+static int failures;
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s:%d: check failed: %s\n", \
+				__func__, __LINE__, #cond); \
+			failures++; \
+			return -1; \
+		} \
+	} while (0)
+
+/*
+ * Device tree
+ */
+
+struct emu_prop {
+	const char *name;
+	unsigned int n;
+	u32 val[2];
+};
+
+struct device_node {
+	const char *name;
+	struct device_node *parent;
+	const struct emu_prop *props;
+	struct device_node *phandle;
+};
+
+static struct device_node dt_root = { .name = "/" };
+
+static struct device_node dt_i2c = {
+	.name = "i2c@3180000",
+	.parent = &dt_root,
+	.props = (const struct emu_prop[]) {
+		{ "reg", 2, { 0, 0x3180000 } },
+		{ "nvidia,camrtc-use-multi" },
+		{ NULL },
+	},
+};
+
+static struct device_node dt_mux = {
+	.name = "tca9548@77",
+	.parent = &dt_i2c,
+	.props = (const struct emu_prop[]) {
+		{ "reg", 1, { 0x77 } },
+		{ "nvidia,camrtc-mux-type", 1, { CAMRTC_I2C_MP_TCA9548 } },
+		{ NULL },
+	},
+};
+
+static struct device_node dt_mux_chan = {
+	.name = "i2c@2",
+	.parent = &dt_mux,
+	.props = (const struct emu_prop[]) {
+		{ "reg", 1, { 2 } },
+		{ NULL },
+	},
+};
+
+#define EMU_ADDR_A		0x1a	/* on the bus */
+#define EMU_ADDR_B		0x36	/* behind the multiplexer */
+
+static struct device_node dt_sensor_a = {
+	.name = "imx274_a@1a",
+	.parent = &dt_i2c,
+	.props = (const struct emu_prop[]) {
+		{ "reg", 1, { EMU_ADDR_A } },
+		{ NULL },
+	},
+};
+
+static struct device_node dt_sensor_b = {
+	.name = "ov5693_b@36",
+	.parent = &dt_mux_chan,
+	.props = (const struct emu_prop[]) {
+		{ "reg", 1, { EMU_ADDR_B } },
+		{ NULL },
+	},
+};
+
+static struct device_node dt_chan = {
+	.name = "i2c-multi",
+	.phandle = &dt_i2c,
+};
+
+static const struct emu_prop *emu_prop(const struct device_node *np,
+				       const char *propname)
+{
+	const struct emu_prop *prop;
+
+	if (!np || !np->props)
+		return NULL;
+	for (prop = np->props; prop->name; prop++)
+		if (!strcmp(prop->name, propname))
+			return prop;
+	return NULL;
+}
+
+int of_property_read_u32_index(const struct device_node *np,
+			       const char *propname, u32 index, u32 *out)
+{
+	const struct emu_prop *prop = emu_prop(np, propname);
+
+	if (!prop)
+		return -EINVAL;
+	if (index >= prop->n)
+		return -EOVERFLOW;
+	*out = prop->val[index];
+	return 0;
+}
+
+bool of_property_read_bool(const struct device_node *np,
+			   const char *propname)
+{
+	return emu_prop(np, propname) != NULL;
+}
+
+struct device_node *of_get_parent(const struct device_node *np)
+{
+	return np ? np->parent : NULL;
+}
+
+struct device_node *of_parse_phandle(const struct device_node *np,
+				     const char *phandle_name, int index)
+{
+	if (strcmp(phandle_name, "device") || index)
+		return NULL;
+	return np->phandle;
+}
+
+u32 tegra_i2c_get_reg_base(struct device_node *np)
+{
+	u32 reg_base = 0;
+
+	of_property_read_u32_index(np, "reg", 1, &reg_base);
+	return reg_base;
+}
+
+u32 tegra_i2c_get_clk_freq(struct device_node *np)
+{
+	return 400000;
+}
+
+/*
+ * seq_file, the stats are read straight from the show function
+ */
+
+int single_open(struct file *file, int (*show)(struct seq_file *, void *),
+		void *data)
+{
+	return -ENODEV;
+}
+
+ssize_t seq_read(struct file *file, char *buf, size_t n, long *pos)
+{
+	return -ENODEV;
+}
+
+long seq_lseek(struct file *file, long off, int whence)
+{
+	return -ENODEV;
+}
+
+int single_release(struct inode *inode, struct file *file)
+{
+	return 0;
+}
+
+/*
+ * IVC channel
+ */
+
+struct bus_type tegra_ivc_bus_type = { .name = "tegra-ivc-bus" };
+const struct device_type tegra_ivc_channel_type = { .name = "tegra-ivc" };
+
+static struct tegra_ivc_channel chan = {
+	.dev = { .of_node = &dt_chan },
+};
+
+static int runtime_refs;
+
+int tegra_ivc_channel_runtime_get(struct tegra_ivc_channel *chan)
+{
+	__atomic_fetch_add(&runtime_refs, 1, __ATOMIC_SEQ_CST);
+	return 0;
+}
+
+void tegra_ivc_channel_runtime_put(struct tegra_ivc_channel *chan)
+{
+	__atomic_fetch_sub(&runtime_refs, 1, __ATOMIC_SEQ_CST);
+}
+
+static int runtime_count(void)
+{
+	return __atomic_load_n(&runtime_refs, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * Emulated CamRTC
+ */
+
+#define EMU_NDEVS		2
+#define EMU_MAX_IDS		16
+#define EMU_BUS_ID		3
+#define EMU_XFER_US		1000
+/* the IVC frame of the I2C channel is 128 bytes */
+#define EMU_PAYLOAD_MAX		CAMRTC_I2C_REQUEST_MAX_LEN
+
+struct emu_msg {
+	struct list_head node;
+	u32 seq_num;
+	u32 request_id;
+	u32 request_len;
+	u8 payload[EMU_PAYLOAD_MAX];
+	/* tables held for a frame */
+	u16 frame_id;
+	bool applied;
+	u32 rsp_frame;
+	struct camrtc_rpc_i2c_response rsp;
+};
+
+struct emu_dev {
+	u32 addr;
+	bool present;
+	u16 ptr;
+	u8 regs[0x10000];
+};
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t thread;
+	bool stop;
+
+	struct list_head queue;		/* requests not processed yet */
+	struct list_head held;		/* tables waiting for a frame */
+	unsigned int queued, processed;
+	unsigned int ticks, ticks_done;
+
+	u32 frame;			/* frames started */
+	u64 now_us;			/* start of the current frame */
+	u32 frame_us;
+	u32 rsp_delay;			/* frames from table to response */
+
+	u32 ids[EMU_MAX_IDS];		/* sensor ID to I2C address */
+	unsigned int nids;
+	struct emu_dev devs[EMU_NDEVS];
+
+	/* what the driver sent */
+	unsigned int add_multi;
+	unsigned int add_sensors;
+	unsigned int requests;
+	unsigned int malformed;
+	u8 last_flag;
+	u16 last_frame_id;
+} emu = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+	.frame = 100,
+	.frame_us = 33333,
+	.devs = {
+		{ .addr = EMU_ADDR_A, .present = true },
+		{ .addr = EMU_ADDR_B, .present = true },
+	},
+};
+
+/*
+ * IVC/RPC layer
+ */
+
+struct rpc_tx_desc {
+	struct list_head node;
+	u32 seq_num;
+	bool in_list;
+	bool done;
+	u32 response_id;
+	u32 response_len;
+	void *response;
+	tegra_ivc_rpc_call_callback callback;
+	void *callback_param;
+	int ret_code;
+	u64 deadline_us;
+};
+
+struct tegra_ivc_rpc_data {
+	struct tegra_ivc_rpc_ops *ops;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct list_head tx_list;
+	u32 next_seq_num;
+	unsigned int count_rx_unexpected;
+	unsigned int count_rx_timeout;
+	u32 last_timeout_ms;
+};
+
+static struct tegra_ivc_rpc_data rpc = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
+static void emu_send(u32 seq_num, const struct tegra_ivc_rpc_call_param *param);
+
+int tegra_ivc_rpc_channel_probe(struct tegra_ivc_channel *chan,
+				struct tegra_ivc_rpc_ops *ops)
+{
+	rpc.ops = ops;
+	INIT_LIST_HEAD(&rpc.tx_list);
+	chan->rpc_priv = &rpc;
+	return 0;
+}
+
+int tegra_ivc_rpc_channel_remove(struct tegra_ivc_channel *chan)
+{
+	chan->rpc_priv = NULL;
+	return 0;
+}
+
+void tegra_ivc_rpc_channel_ready(struct tegra_ivc_channel *chan, bool ready)
+{
+	struct tegra_ivc_rpc_data *rpc = chan->rpc_priv;
+
+	if (rpc->ops && rpc->ops->ready)
+		rpc->ops->ready(chan, ready);
+}
+
+void tegra_ivc_rpc_channel_notify(struct tegra_ivc_channel *chan)
+{
+}
+
+int tegra_ivc_rpc_channel_pm_prepare(struct device *dev)
+{
+	return 0;
+}
+
+void tegra_ivc_rpc_channel_pm_complete(struct device *dev)
+{
+}
+
+int tegra_ivc_rpc_channel_pm_suspend(struct device *dev)
+{
+	return 0;
+}
+
+int tegra_ivc_rpc_channel_pm_resume(struct device *dev)
+{
+	return 0;
+}
+
+int tegra_ivc_rpc_call(struct tegra_ivc_channel *chan,
+		       const struct tegra_ivc_rpc_call_param *param)
+{
+	struct tegra_ivc_rpc_data *rpc = chan->rpc_priv;
+	struct rpc_tx_desc *tx_desc;
+	struct timespec ts;
+	u32 timeout_ms, seq_num;
+	u64 now_us;
+	int r = 0;
+	int ret;
+
+	if (rpc == NULL)
+		return TEGRA_IVC_RPC_ERR_PARAM;
+	if (WARN_ON(param->request_len > EMU_PAYLOAD_MAX))
+		return TEGRA_IVC_RPC_ERR_PARAM;
+
+	tx_desc = calloc(1, sizeof(*tx_desc));
+	if (tx_desc == NULL)
+		return TEGRA_IVC_RPC_ERR_MEMORY;
+
+	timeout_ms = param->timeout_ms ? param->timeout_ms : 500;
+
+	pthread_mutex_lock(&emu.lock);
+	now_us = emu.now_us;
+	pthread_mutex_unlock(&emu.lock);
+
+	tx_desc->response_id = param->response_id;
+	tx_desc->response_len = param->response_len;
+	tx_desc->response = param->response;
+	tx_desc->callback = param->callback;
+	tx_desc->callback_param = param->callback_param;
+	tx_desc->deadline_us = now_us + (u64)timeout_ms * 1000;
+
+	pthread_mutex_lock(&rpc->lock);
+	seq_num = ++rpc->next_seq_num;
+	tx_desc->seq_num = seq_num;
+	list_add_tail(&tx_desc->node, &rpc->tx_list);
+	tx_desc->in_list = true;
+	rpc->last_timeout_ms = param->timeout_ms;
+	pthread_mutex_unlock(&rpc->lock);
+
+	/* tx_desc may be gone once the request is sent */
+	emu_send(seq_num, param);
+
+	if (param->callback)
+		return 0;
+
+	/* synchronous calls wait in real time */
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += timeout_ms / 1000;
+	ts.tv_nsec += (timeout_ms % 1000) * 1000000L;
+	if (ts.tv_nsec >= 1000000000L) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
+	}
+
+	pthread_mutex_lock(&rpc->lock);
+	while (!tx_desc->done) {
+		if (r == ETIMEDOUT && tx_desc->in_list)
+			break;
+		if (r == ETIMEDOUT)
+			r = pthread_cond_wait(&rpc->cond, &rpc->lock);
+		else
+			r = pthread_cond_timedwait(&rpc->cond, &rpc->lock,
+						   &ts);
+	}
+	if (tx_desc->done) {
+		ret = tx_desc->ret_code;
+	} else {
+		list_del(&tx_desc->node);
+		tx_desc->in_list = false;
+		rpc->count_rx_timeout++;
+		ret = TEGRA_IVC_RPC_ERR_TIMEOUT;
+	}
+	pthread_mutex_unlock(&rpc->lock);
+
+	free(tx_desc);
+	return ret;
+}
+
+/* CamRTC thread, as the rx tasklet */
+static void rpc_rx(const struct tegra_ivc_rpc_response_frame *rsp)
+{
+	struct rpc_tx_desc *tx_desc;
+	bool found = false;
+
+	pthread_mutex_lock(&rpc.lock);
+	list_for_each_entry(tx_desc, &rpc.tx_list, node) {
+		if (rsp->hdr.seq_num == tx_desc->seq_num) {
+			list_del(&tx_desc->node);
+			tx_desc->in_list = false;
+			found = true;
+			break;
+		}
+	}
+	if (!found)
+		rpc.count_rx_unexpected++;
+	pthread_mutex_unlock(&rpc.lock);
+
+	if (!found)
+		return;
+
+	tx_desc->ret_code = rsp->hdr.ret_code;
+	if (rsp->hdr.response_id == tx_desc->response_id) {
+		if (tx_desc->ret_code >= 0 && tx_desc->response_len > 0) {
+			if (rsp->hdr.response_id ==
+			    TEGRA_IVC_RPC_RSP_RET_CODE) {
+				if (tx_desc->response_len == 4)
+					*(u32 *)tx_desc->response =
+						rsp->hdr.ret_data;
+				else
+					tx_desc->ret_code =
+						TEGRA_IVC_RPC_ERR_PARAM;
+			} else if (tx_desc->response_len !=
+				   rsp->hdr.response_len) {
+				tx_desc->ret_code = TEGRA_IVC_RPC_ERR_PARAM;
+			} else {
+				memcpy(tx_desc->response, rsp->payload8,
+				       tx_desc->response_len);
+			}
+		}
+	} else if (tx_desc->ret_code >= 0) {
+		tx_desc->ret_code = TEGRA_IVC_RPC_ERR_WRONG_RSP;
+	}
+
+	if (tx_desc->callback == NULL) {
+		pthread_mutex_lock(&rpc.lock);
+		tx_desc->done = true;
+		pthread_cond_broadcast(&rpc.cond);
+		pthread_mutex_unlock(&rpc.lock);
+		return;
+	}
+
+	tx_desc->callback(tx_desc->ret_code, rsp, tx_desc->callback_param);
+	free(tx_desc);
+}
+
+/* CamRTC thread, as the rx timer: fire what expires before now_us */
+static void rpc_timers(u64 now_us)
+{
+	struct rpc_tx_desc *tx_desc, *n;
+	struct list_head expired;
+
+	INIT_LIST_HEAD(&expired);
+
+	pthread_mutex_lock(&rpc.lock);
+	list_for_each_entry_safe(tx_desc, n, &rpc.tx_list, node) {
+		if (tx_desc->callback && tx_desc->deadline_us < now_us) {
+			list_del(&tx_desc->node);
+			tx_desc->in_list = false;
+			list_add_tail(&tx_desc->node, &expired);
+			rpc.count_rx_timeout++;
+		}
+	}
+	pthread_mutex_unlock(&rpc.lock);
+
+	list_for_each_entry_safe(tx_desc, n, &expired, node) {
+		tx_desc->callback(TEGRA_IVC_RPC_ERR_TIMEOUT, NULL,
+				  tx_desc->callback_param);
+		free(tx_desc);
+	}
+}
+
+/*
+ * CamRTC
+ */
+
+static void emu_send(u32 seq_num, const struct tegra_ivc_rpc_call_param *param)
+{
+	struct emu_msg *msg = calloc(1, sizeof(*msg));
+
+	msg->seq_num = seq_num;
+	msg->request_id = param->request_id;
+	msg->request_len = param->request_len;
+	memcpy(msg->payload, param->request, param->request_len);
+
+	pthread_mutex_lock(&emu.lock);
+	list_add_tail(&msg->node, &emu.queue);
+	emu.queued++;
+	pthread_cond_broadcast(&emu.cond);
+	pthread_mutex_unlock(&emu.lock);
+}
+
+static void emu_respond(u32 seq_num, int ret_code, u32 response_id,
+			u32 ret_data, const void *payload, u32 len)
+{
+	struct tegra_ivc_rpc_response_frame rsp;
+
+	memset(&rsp, 0, sizeof(rsp));
+	rsp.hdr.rpc_rsp_sign = TEGRA_IVC_RPC_RSP_SIGN;
+	rsp.hdr.seq_num = seq_num;
+	rsp.hdr.ret_code = ret_code;
+	rsp.hdr.ret_data = ret_data;
+	rsp.hdr.response_id = response_id;
+	rsp.hdr.response_len = len;
+	if (len)
+		memcpy(rsp.payload8, payload, len);
+
+	rpc_rx(&rsp);
+}
+
+static struct emu_dev *emu_dev(u32 addr)
+{
+	int i;
+
+	for (i = 0; i < EMU_NDEVS; i++)
+		if (emu.devs[i].addr == addr)
+			return &emu.devs[i];
+	return NULL;
+}
+
+/* emu.lock held: run the transfers of an I2C_REQUEST_MULTI message */
+static void emu_exec(struct emu_msg *msg)
+{
+	struct camrtc_rpc_i2c_response *rsp = &msg->rsp;
+	const u8 *pl = msg->payload;
+	struct emu_dev *dev;
+	u32 pos, flag, len, i;
+
+	rsp->result = CAMRTC_I2C_RESPONSE_RESULT_SUCCESS;
+	rsp->read_len = 0;
+
+	if (pl[0] >= emu.nids) {
+		emu.malformed++;
+		rsp->result = CAMRTC_I2C_RESPONSE_RESULT_DROPPED;
+		return;
+	}
+
+	dev = emu_dev(emu.ids[pl[0]]);
+	if (!dev || !dev->present) {
+		rsp->result = CAMRTC_I2C_RESPONSE_RESULT_NO_ACK;
+		return;
+	}
+
+	for (pos = CAMRTC_I2C_MULTI_HEADER_SIZE; pos < msg->request_len;) {
+		if (pos + CAMRTC_I2C_MULTI_DATA_OFFSET > msg->request_len)
+			goto malformed;
+		flag = pl[pos + CAMRTC_I2C_MULTI_FLAG_OFFSET];
+		len = pl[pos + CAMRTC_I2C_MULTI_LENGTH_OFFSET];
+		pos += CAMRTC_I2C_MULTI_DATA_OFFSET;
+
+		if (flag & CAMRTC_I2C_REQUEST_FLAG_READ) {
+			if (rsp->read_len + len >
+			    CAMRTC_I2C_RESPONSE_MAX_READ_LEN)
+				goto malformed;
+			for (i = 0; i < len; i++)
+				rsp->read_data[rsp->read_len++] =
+					dev->regs[dev->ptr++];
+			continue;
+		}
+
+		/* a write starts with the 16 bit register address */
+		if (len < 2 || pos + len > msg->request_len)
+			goto malformed;
+		dev->ptr = (pl[pos] << 8) | pl[pos + 1];
+		for (i = 2; i < len; i++)
+			dev->regs[dev->ptr++] = pl[pos + i];
+		pos += len;
+	}
+	return;
+
+malformed:
+	emu.malformed++;
+	rsp->result = CAMRTC_I2C_RESPONSE_RESULT_DROPPED;
+}
+
+static void emu_request(struct emu_msg *msg)
+{
+	const struct camrtc_rpc_i2c_add_sensor *add_sensor =
+		(const void *)msg->payload;
+	u32 id;
+
+	switch (msg->request_id) {
+	case CAMRTC_RPC_REQ_I2C_ADD_MULTI_DEV:
+		pthread_mutex_lock(&emu.lock);
+		emu.add_multi++;
+		emu.nids = 0;
+		pthread_mutex_unlock(&emu.lock);
+		emu_respond(msg->seq_num, 0, TEGRA_IVC_RPC_RSP_RET_CODE,
+			    EMU_BUS_ID, NULL, 0);
+		break;
+
+	case CAMRTC_RPC_REQ_I2C_ADD_SENSOR:
+		pthread_mutex_lock(&emu.lock);
+		emu.add_sensors++;
+		if (add_sensor->bus_id != EMU_BUS_ID ||
+		    emu.nids == EMU_MAX_IDS) {
+			emu.malformed++;
+			pthread_mutex_unlock(&emu.lock);
+			emu_respond(msg->seq_num, TEGRA_IVC_RPC_ERR_RSP_PARAM,
+				    TEGRA_IVC_RPC_RSP_RET_CODE, 0, NULL, 0);
+			break;
+		}
+		id = emu.nids++;
+		emu.ids[id] = add_sensor->addr;
+		pthread_mutex_unlock(&emu.lock);
+		emu_respond(msg->seq_num, 0, TEGRA_IVC_RPC_RSP_RET_CODE,
+			    id, NULL, 0);
+		break;
+
+	case CAMRTC_RPC_REQ_I2C_REQUEST_MULTI:
+		pthread_mutex_lock(&emu.lock);
+		emu.requests++;
+		emu.last_flag = msg->payload[1];
+		emu.last_frame_id = msg->payload[2] | (msg->payload[3] << 8);
+		if (emu.last_flag & CAMRTC_I2C_REQUEST_MULTI_FLAG_FRAMEID) {
+			msg->frame_id = emu.last_frame_id;
+			/* that frame has started already */
+			if ((s16)(msg->frame_id - (u16)emu.frame) <= 0) {
+				msg->rsp.result =
+					CAMRTC_I2C_RESPONSE_RESULT_DROPPED;
+			} else {
+				list_add_tail(&msg->node, &emu.held);
+				pthread_mutex_unlock(&emu.lock);
+				return;
+			}
+		} else {
+			emu_exec(msg);
+		}
+		pthread_mutex_unlock(&emu.lock);
+		emu_respond(msg->seq_num, 0, CAMRTC_RPC_RSP_I2C_RESPONSE, 0,
+			    &msg->rsp, sizeof(msg->rsp));
+		break;
+
+	default:
+		emu_respond(msg->seq_num, TEGRA_IVC_RPC_ERR_RSP_UNKNOWN_REQ,
+			    TEGRA_IVC_RPC_RSP_RET_CODE, 0, NULL, 0);
+		break;
+	}
+
+	free(msg);
+}
+
+/* emu.lock held: apply the tables due, return one whose response is due */
+static struct emu_msg *emu_due(void)
+{
+	struct emu_msg *msg;
+
+	list_for_each_entry(msg, &emu.held, node) {
+		if (!msg->applied && msg->frame_id == (u16)emu.frame) {
+			emu_exec(msg);
+			msg->applied = true;
+			msg->rsp_frame = emu.frame + emu.rsp_delay;
+		}
+		if (msg->applied && msg->rsp_frame == emu.frame) {
+			list_del(&msg->node);
+			return msg;
+		}
+	}
+	return NULL;
+}
+
+static void emu_frame_start(void)
+{
+	struct emu_msg *msg;
+	u64 now_us;
+
+	pthread_mutex_lock(&emu.lock);
+	now_us = emu.now_us;
+	pthread_mutex_unlock(&emu.lock);
+
+	/* timers expiring before the responses of this frame */
+	rpc_timers(now_us + EMU_XFER_US);
+
+	pthread_mutex_lock(&emu.lock);
+	while ((msg = emu_due())) {
+		pthread_mutex_unlock(&emu.lock);
+		emu_respond(msg->seq_num, 0, CAMRTC_RPC_RSP_I2C_RESPONSE, 0,
+			    &msg->rsp, sizeof(msg->rsp));
+		free(msg);
+		pthread_mutex_lock(&emu.lock);
+	}
+	pthread_mutex_unlock(&emu.lock);
+}
+
+static void *emu_thread(void *arg)
+{
+	struct emu_msg *msg;
+
+	pthread_mutex_lock(&emu.lock);
+	for (;;) {
+		while (!emu.stop && list_empty(&emu.queue) &&
+		       emu.ticks == emu.ticks_done)
+			pthread_cond_wait(&emu.cond, &emu.lock);
+		if (emu.stop)
+			break;
+
+		if (!list_empty(&emu.queue)) {
+			msg = list_entry(emu.queue.next, struct emu_msg, node);
+			list_del(&msg->node);
+			pthread_mutex_unlock(&emu.lock);
+			emu_request(msg);
+			pthread_mutex_lock(&emu.lock);
+			emu.processed++;
+		} else {
+			emu.frame++;
+			emu.now_us += emu.frame_us;
+			pthread_mutex_unlock(&emu.lock);
+			emu_frame_start();
+			pthread_mutex_lock(&emu.lock);
+			emu.ticks_done++;
+		}
+		pthread_cond_broadcast(&emu.cond);
+	}
+	pthread_mutex_unlock(&emu.lock);
+
+	return NULL;
+}
+
+/* wait until CamRTC has taken all requests sent so far */
+static void emu_sync(void)
+{
+	pthread_mutex_lock(&emu.lock);
+	while (emu.processed != emu.queued)
+		pthread_cond_wait(&emu.cond, &emu.lock);
+	pthread_mutex_unlock(&emu.lock);
+}
+
+/* start n frames, one after the other */
+static void emu_frames(unsigned int n)
+{
+	pthread_mutex_lock(&emu.lock);
+	emu.ticks += n;
+	pthread_cond_broadcast(&emu.cond);
+	while (emu.ticks_done != emu.ticks)
+		pthread_cond_wait(&emu.cond, &emu.lock);
+	pthread_mutex_unlock(&emu.lock);
+}
+
+static u32 emu_frame(void)
+{
+	u32 frame;
+
+	pthread_mutex_lock(&emu.lock);
+	frame = emu.frame;
+	pthread_mutex_unlock(&emu.lock);
+	return frame;
+}
+
+static u8 emu_reg(u32 addr, u16 reg)
+{
+	u8 val;
+
+	pthread_mutex_lock(&emu.lock);
+	val = emu_dev(addr)->regs[reg];
+	pthread_mutex_unlock(&emu.lock);
+	return val;
+}
+
+static void emu_start(void)
+{
+	INIT_LIST_HEAD(&emu.queue);
+	INIT_LIST_HEAD(&emu.held);
+	pthread_create(&emu.thread, NULL, emu_thread, NULL);
+}
+
+static void emu_stop(void)
+{
+	pthread_mutex_lock(&emu.lock);
+	emu.stop = true;
+	pthread_cond_broadcast(&emu.cond);
+	pthread_mutex_unlock(&emu.lock);
+	pthread_join(emu.thread, NULL);
+}
+
+/*
+ * Sensor driver side
+ */
+
+#define REG_WAIT_MS		0xfffe
+#define REG_END			0xffff
+#define FRAME_US		33333
+
+static struct i2c_client client_a = { .dev = { .of_node = &dt_sensor_a } };
+static struct i2c_client client_b = { .dev = { .of_node = &dt_sensor_b } };
+
+static const struct tegra_i2c_rtcpu_config sensor_config = {
+	.reg_bytes = 2,
+};
+
+struct frame_result {
+	int calls;
+	int ret;
+};
+
+/* CamRTC thread */
+static void frame_done(int ret, void *param)
+{
+	struct frame_result *res = param;
+
+	res->calls++;
+	res->ret = ret;
+}
+
+static int queue_table(struct tegra_i2c_rtcpu_sensor *sensor,
+		       const struct reg_8 table[], u32 frame_id,
+		       unsigned int frame_distance, struct frame_result *res)
+{
+	return tegra_i2c_rtcpu_write_table_8_frame(sensor, table, NULL, 0,
+		REG_WAIT_MS, REG_END, frame_id, frame_distance,
+		frame_done, res);
+}
+
+static unsigned int timeouts(void)
+{
+	unsigned int count;
+
+	pthread_mutex_lock(&rpc.lock);
+	count = rpc.count_rx_timeout;
+	pthread_mutex_unlock(&rpc.lock);
+	return count;
+}
+
+static unsigned int unexpected(void)
+{
+	unsigned int count;
+
+	pthread_mutex_lock(&rpc.lock);
+	count = rpc.count_rx_unexpected;
+	pthread_mutex_unlock(&rpc.lock);
+	return count;
+}
+
+static u32 last_timeout_ms(void)
+{
+	u32 timeout_ms;
+
+	pthread_mutex_lock(&rpc.lock);
+	timeout_ms = rpc.last_timeout_ms;
+	pthread_mutex_unlock(&rpc.lock);
+	return timeout_ms;
+}
+
+static bool stats_show(const char *line)
+{
+	struct seq_file seq = { .private = &chan };
+
+	tegra_i2c_ivc_multi_stat_show(&seq, NULL);
+	return strstr(seq.buf, line) != NULL;
+}
+
+/*
+ * Complete whatever a failed test left in flight, the results live in
+ * static storage for that reason.
+ */
+static void emu_drain(void)
+{
+	bool busy;
+	int i;
+
+	shim_quiet = 1;
+	pthread_mutex_lock(&emu.lock);
+	emu.rsp_delay = 0;
+	for (i = 0; i < EMU_NDEVS; i++)
+		emu.devs[i].present = true;
+	pthread_mutex_unlock(&emu.lock);
+	chan.rpc_priv = &rpc;
+
+	for (i = 0; i < 64; i++) {
+		emu_sync();
+		pthread_mutex_lock(&emu.lock);
+		busy = !list_empty(&emu.held);
+		pthread_mutex_unlock(&emu.lock);
+		pthread_mutex_lock(&rpc.lock);
+		busy |= !list_empty(&rpc.tx_list);
+		pthread_mutex_unlock(&rpc.lock);
+		if (!busy)
+			break;
+		emu_frames(1);
+	}
+	shim_quiet = 0;
+}
+
+static int check_idle(void)
+{
+	emu_sync();
+	CHECK(runtime_count() == 0);
+	CHECK(!emu.malformed);
+	CHECK(!shim_warnings);
+	return 0;
+}
+
+static int probe(void)
+{
+	CHECK(!shim_ivc_driver->ops.channel->probe(&chan));
+	shim_ivc_driver->ops.channel->ready(&chan, true);
+	return 0;
+}
+
+/* the synchronous path is unchanged: untagged requests, applied at once */
+static int test_sync(void)
+{
+	static const u8 val[] = { 0x01, 0x02, 0x03 };
+	static const struct reg_8 table[] = {
+		{ 0x3100, 0x05 },
+		{ 0x3101, 0x06 },
+		{ REG_WAIT_MS, 1 },
+		{ 0x3200, 0x07 },
+		{ REG_END, 0 },
+	};
+	static const struct reg_8 override[] = {
+		{ 0x3101, 0x09 },
+	};
+	struct tegra_i2c_rtcpu_sensor *sensor;
+	u8 buf[3] = { 0 };
+
+	emu_drain();
+	sensor = tegra_i2c_rtcpu_register_sensor(&client_a, &sensor_config);
+	CHECK(sensor);
+	CHECK(emu.add_multi == 1);
+	CHECK(emu.add_sensors == 1);
+
+	CHECK(!tegra_i2c_rtcpu_write_reg8(sensor, 0x3000, val, 3));
+	CHECK(!tegra_i2c_rtcpu_read_reg8(sensor, 0x3000, buf, 3));
+	CHECK(!memcmp(buf, val, 3));
+	CHECK(emu_reg(EMU_ADDR_A, 0x3002) == 0x03);
+
+	CHECK(!tegra_i2c_rtcpu_write_table_8(sensor, table, override, 1,
+					     REG_WAIT_MS, REG_END));
+	CHECK(emu_reg(EMU_ADDR_A, 0x3100) == 0x05);
+	CHECK(emu_reg(EMU_ADDR_A, 0x3101) == 0x09);
+	CHECK(emu_reg(EMU_ADDR_A, 0x3200) == 0x07);
+	CHECK(!emu.last_flag);
+	return check_idle();
+}
+
+/* a table is applied at its frame, in one request, with one callback */
+static int test_frame_table(void)
+{
+	static const struct reg_8 table[] = {
+		{ 0x0202, 0x11 },
+		{ 0x0203, 0x22 },
+		{ 0x0205, 0x33 },
+		{ REG_END, 0 },
+	};
+	struct tegra_i2c_rtcpu_sensor *sensor;
+	static struct frame_result res;
+	unsigned int requests;
+	u32 frame_id;
+	u8 buf[4] = { 0 };
+
+	emu_drain();
+	sensor = tegra_i2c_rtcpu_register_sensor(&client_b, &sensor_config);
+	CHECK(sensor);
+	CHECK(!tegra_i2c_rtcpu_set_frame_length(sensor, FRAME_US));
+
+	emu_sync();
+	requests = emu.requests;
+	frame_id = emu_frame() + 3;
+	CHECK(!queue_table(sensor, table, frame_id, 3, &res));
+	/* three frames of 33.333 ms, then the synchronous timeout */
+	CHECK(last_timeout_ms() == 100 + 250);
+	emu_sync();
+	CHECK(emu.requests == requests + 1);
+	CHECK(emu.last_flag == CAMRTC_I2C_REQUEST_MULTI_FLAG_FRAMEID);
+	CHECK(emu.last_frame_id == frame_id);
+
+	/* a synchronous read in between goes out untagged */
+	emu_frames(2);
+	CHECK(!tegra_i2c_rtcpu_read_reg8(sensor, 0x0202, buf, 4));
+	CHECK(!emu.last_flag);
+	CHECK(!buf[0] && !buf[1] && !buf[3]);
+	CHECK(!res.calls);
+	CHECK(runtime_count() == 1);
+
+	emu_frames(1);
+	CHECK(res.calls == 1);
+	CHECK(res.ret == 0);
+	CHECK(emu_reg(EMU_ADDR_B, 0x0202) == 0x11);
+	CHECK(emu_reg(EMU_ADDR_B, 0x0203) == 0x22);
+	CHECK(emu_reg(EMU_ADDR_B, 0x0204) == 0x00);
+	CHECK(emu_reg(EMU_ADDR_B, 0x0205) == 0x33);
+	CHECK(stats_show("Frame tables: 1\n"));
+	CHECK(stats_show("Frame table errors: 0\n"));
+	return check_idle();
+}
+
+/* tables for the next frames are in flight together */
+static int test_frame_pipeline(void)
+{
+	static const struct reg_8 table[] = {
+		{ 0x0100, 0x00 },
+		{ REG_END, 0 },
+	};
+	static const struct reg_8 override[][1] = {
+		{ { 0x0100, 0x01 } },
+		{ { 0x0100, 0x02 } },
+		{ { 0x0100, 0x03 } },
+	};
+	struct tegra_i2c_rtcpu_sensor *sensor;
+	static struct frame_result res[3];
+	u32 frame;
+	int i;
+
+	emu_drain();
+	sensor = tegra_i2c_rtcpu_register_sensor(&client_a, &sensor_config);
+	CHECK(sensor);
+	CHECK(!tegra_i2c_rtcpu_set_frame_length(sensor, FRAME_US));
+
+	frame = emu_frame();
+	for (i = 0; i < 3; i++)
+		CHECK(!tegra_i2c_rtcpu_write_table_8_frame(sensor, table,
+			override[i], 1, REG_WAIT_MS, REG_END,
+			frame + i + 1, i + 1, frame_done, &res[i]));
+	CHECK(runtime_count() == 3);
+
+	for (i = 0; i < 3; i++) {
+		emu_frames(1);
+		CHECK(emu_reg(EMU_ADDR_A, 0x0100) == i + 1);
+		CHECK(res[i].calls == 1);
+		CHECK(res[i].ret == 0);
+		if (i < 2)
+			CHECK(!res[i + 1].calls);
+	}
+	return check_idle();
+}
+
+/* the response timeout covers the frames until the table is applied */
+static int test_frame_timeout(void)
+{
+	static const struct reg_8 table[] = {
+		{ 0x0300, 0x44 },
+		{ REG_END, 0 },
+	};
+	struct tegra_i2c_rtcpu_sensor *sensor;
+	static struct frame_result res;
+	unsigned int count;
+
+	emu_drain();
+	sensor = tegra_i2c_rtcpu_register_sensor(&client_b, &sensor_config);
+	CHECK(sensor);
+	CHECK(!tegra_i2c_rtcpu_set_frame_length(sensor, FRAME_US));
+
+	/* 12 frames is beyond the 250 ms of a synchronous transfer */
+	count = timeouts();
+	CHECK(!queue_table(sensor, table, emu_frame() + 12, 12, &res));
+	emu_frames(12);
+	CHECK(res.calls == 1);
+	CHECK(res.ret == 0);
+	CHECK(timeouts() == count);
+	CHECK(emu_reg(EMU_ADDR_B, 0x0300) == 0x44);
+	CHECK(last_timeout_ms() == 400 + 250);
+
+	/* a response 10 frames late: 67 + 250 ms pass during frame 10 */
+	memset(&res, 0, sizeof(res));
+	pthread_mutex_lock(&emu.lock);
+	emu.rsp_delay = 10;
+	pthread_mutex_unlock(&emu.lock);
+	CHECK(!queue_table(sensor, table, emu_frame() + 2, 2, &res));
+	CHECK(last_timeout_ms() == 67 + 250);
+	emu_frames(9);
+	CHECK(!res.calls);
+	shim_quiet = 1;
+	emu_frames(1);
+	shim_quiet = 0;
+	CHECK(res.calls == 1);
+	CHECK(res.ret == -EIO);
+	CHECK(timeouts() == count + 1);
+	CHECK(runtime_count() == 0);
+
+	/* the late response finds nothing to complete */
+	count = unexpected();
+	emu_frames(2);
+	CHECK(unexpected() == count + 1);
+	CHECK(res.calls == 1);
+	pthread_mutex_lock(&emu.lock);
+	emu.rsp_delay = 0;
+	pthread_mutex_unlock(&emu.lock);
+	CHECK(stats_show("Frame table errors: 1\n"));
+	return check_idle();
+}
+
+/* what a table cannot be queued with, and how a table fails */
+static int test_frame_errors(void)
+{
+	static const struct reg_8 wait_table[] = {
+		{ 0x0400, 0x01 },
+		{ REG_WAIT_MS, 1 },
+		{ 0x0401, 0x02 },
+		{ REG_END, 0 },
+	};
+	static const struct reg_8 table[] = {
+		{ 0x0410, 0x55 },
+		{ REG_END, 0 },
+	};
+	static const u8 val = 0x66;
+	/* 4 + 18 * 5 bytes fit in a request, 19 writes do not */
+	struct reg_8 big[20];
+	struct tegra_i2c_rtcpu_sensor *sensor;
+	static struct frame_result res;
+	unsigned int requests;
+	int i;
+
+	emu_drain();
+	sensor = tegra_i2c_rtcpu_register_sensor(&client_a, &sensor_config);
+	CHECK(sensor);
+
+	/* no frame length, no timeout */
+	CHECK(queue_table(sensor, table, emu_frame() + 1, 1, &res) == -EINVAL);
+	CHECK(tegra_i2c_rtcpu_set_frame_length(sensor, 0) == -EINVAL);
+	CHECK(!tegra_i2c_rtcpu_set_frame_length(sensor, FRAME_US));
+
+	emu_sync();
+	requests = emu.requests;
+	CHECK(queue_table(sensor, table, 0, 1, &res) == -EINVAL);
+	CHECK(queue_table(sensor, table, emu_frame() + 1, U16_MAX + 1,
+			  &res) == -EINVAL);
+	CHECK(queue_table(sensor, wait_table, emu_frame() + 1, 1,
+			  &res) == -EINVAL);
+
+	for (i = 0; i < 19; i++) {
+		big[i].addr = 0x0500 + 2 * i;
+		big[i].val = i + 1;
+	}
+	big[19].addr = REG_END;
+	CHECK(queue_table(sensor, big, emu_frame() + 1, 1, &res) == -E2BIG);
+
+	CHECK(!tegra_i2c_rtcpu_aggregate(sensor, true));
+	CHECK(queue_table(sensor, table, emu_frame() + 1, 1, &res) == -EBUSY);
+	CHECK(!tegra_i2c_rtcpu_aggregate(sensor, false));
+
+	emu_sync();
+	CHECK(emu.requests == requests);
+	CHECK(runtime_count() == 0);
+
+	/* none of them left anything behind for the synchronous path */
+	CHECK(!tegra_i2c_rtcpu_write_reg8(sensor, 0x0420, &val, 1));
+	CHECK(!emu.last_flag);
+	CHECK(emu_reg(EMU_ADDR_A, 0x0400) == 0x00);
+	CHECK(emu_reg(EMU_ADDR_A, 0x0420) == 0x66);
+
+	/* the largest table that fits */
+	big[18].addr = REG_END;
+	CHECK(!queue_table(sensor, big, emu_frame() + 1, 1, &res));
+	emu_frames(1);
+	CHECK(res.calls == 1);
+	CHECK(res.ret == 0);
+	CHECK(emu_reg(EMU_ADDR_A, 0x0500 + 2 * 17) == 18);
+
+	/* too late for its frame */
+	memset(&res, 0, sizeof(res));
+	shim_quiet = 1;
+	CHECK(!queue_table(sensor, table, emu_frame(), 0, &res));
+	emu_sync();
+	shim_quiet = 0;
+	CHECK(res.calls == 1);
+	CHECK(res.ret == -EIO);
+	CHECK(emu_reg(EMU_ADDR_A, 0x0410) == 0x00);
+
+	/* no ACK from the sensor */
+	memset(&res, 0, sizeof(res));
+	pthread_mutex_lock(&emu.lock);
+	emu_dev(EMU_ADDR_A)->present = false;
+	pthread_mutex_unlock(&emu.lock);
+	CHECK(!queue_table(sensor, table, emu_frame() + 1, 1, &res));
+	shim_quiet = 1;
+	emu_frames(1);
+	shim_quiet = 0;
+	pthread_mutex_lock(&emu.lock);
+	emu_dev(EMU_ADDR_A)->present = true;
+	pthread_mutex_unlock(&emu.lock);
+	CHECK(res.calls == 1);
+	CHECK(res.ret == -EIO);
+
+	/* not sent at all: no callback */
+	memset(&res, 0, sizeof(res));
+	chan.rpc_priv = NULL;
+	shim_quiet = 1;
+	CHECK(queue_table(sensor, table, emu_frame() + 1, 1, &res) == -EIO);
+	shim_quiet = 0;
+	chan.rpc_priv = &rpc;
+	emu_frames(1);
+	CHECK(!res.calls);
+	CHECK(emu_reg(EMU_ADDR_A, 0x0410) == 0x00);
+	return check_idle();
+}
+
+/* after CamRTC restarts, queuing a table registers the sensor again */
+static int test_frame_reregister(void)
+{
+	static const struct reg_8 table[] = {
+		{ 0x0600, 0x77 },
+		{ REG_END, 0 },
+	};
+	struct tegra_i2c_rtcpu_sensor *sensor;
+	static struct frame_result res;
+	unsigned int add_multi, add_sensors;
+
+	emu_drain();
+	sensor = tegra_i2c_rtcpu_register_sensor(&client_b, &sensor_config);
+	CHECK(sensor);
+	CHECK(!tegra_i2c_rtcpu_set_frame_length(sensor, FRAME_US));
+
+	shim_ivc_driver->ops.channel->ready(&chan, false);
+	shim_ivc_driver->ops.channel->ready(&chan, true);
+
+	add_multi = emu.add_multi;
+	add_sensors = emu.add_sensors;
+	CHECK(!queue_table(sensor, table, emu_frame() + 1, 1, &res));
+	emu_frames(1);
+	CHECK(emu.add_multi == add_multi + 1);
+	CHECK(emu.add_sensors == add_sensors + 1);
+	CHECK(res.calls == 1);
+	CHECK(res.ret == 0);
+	CHECK(emu_reg(EMU_ADDR_B, 0x0600) == 0x77);
+	return check_idle();
+}
+
+int main(int argc, char *argv[])
+{
+	emu_start();
+
+	if (!probe()) {
+		test_sync();
+		test_frame_table();
+		test_frame_pipeline();
+		test_frame_timeout();
+		test_frame_errors();
+		test_frame_reregister();
+	}
+
+	emu_stop();
+	printf("%s\n", failures ? "FAIL" : "PASS");
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,322 @@
+/*
+ * Userspace stand-ins for the kernel facilities used by the CamRTC I2C
+ * multi driver (drivers/i2c/busses/i2c-ivc-multi.c). The IVC channel,
+ * the IVC/RPC layer, the device tree and the I2C controller lookups are
+ * provided by the test, which answers RPCs from an emulated CamRTC.
+ *
+ * Copyright (c) 2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#ifndef _IVC_MULTI_SHIM_H
+#define _IVC_MULTI_SHIM_H
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int16_t s16;
+
+#define U16_MAX			((u16)~0U)
+#define U32_MAX			((u32)~0U)
+#define USEC_PER_MSEC		1000L
+
+#define __packed		__attribute__((packed))
+#define __rcu
+
+#define EXPORT_SYMBOL(sym)	extern typeof(sym) sym
+#define THIS_MODULE		NULL
+#define MODULE_AUTHOR(s)
+#define MODULE_DESCRIPTION(s)
+#define MODULE_LICENSE(s)
+#define MODULE_DEVICE_TABLE(type, name)
+
+#define container_of(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+#define min_t(type, x, y) ({ \
+	type __x = (x); \
+	type __y = (y); \
+	__x < __y ? __x : __y; \
+})
+#define DIV_ROUND_UP_ULL(ll, d) \
+	(((unsigned long long)(ll) + (d) - 1) / (d))
+
+/* set by the test to silence expected errors */
+extern int shim_quiet;
+extern unsigned int shim_warnings;
+
+static inline void shim_log(bool show, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (!show)
+		return;
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+}
+
+#define pr_err(fmt, ...)	shim_log(!shim_quiet, fmt, ##__VA_ARGS__)
+#define dev_err(dev, fmt, ...) \
+	do { (void)(dev); pr_err(fmt, ##__VA_ARGS__); } while (0)
+#define dev_info(dev, fmt, ...)	do { (void)(dev); } while (0)
+
+#define WARN(cond, fmt, ...) ({ \
+	int __c = !!(cond); \
+	if (__c) { \
+		__atomic_fetch_add(&shim_warnings, 1, __ATOMIC_SEQ_CST); \
+		pr_err("WARNING at %s:%d: " fmt, __func__, __LINE__, \
+		       ##__VA_ARGS__); \
+	} \
+	__c; \
+})
+#define WARN_ON(cond)		WARN(cond, "%s\n", #cond)
+
+/*
+ * Memory. kfree() of a frame table request happens on the CamRTC thread.
+ */
+#define GFP_KERNEL		0
+
+#define kzalloc(size, flags)	calloc(1, size)
+#define kfree(p)		free(p)
+/* only called on a probe failure, which the test does not cause */
+#define devm_kfree(dev, p)	do { (void)(dev); (void)(p); } while (0)
+
+/*
+ * Lists
+ */
+struct list_head {
+	struct list_head *next, *prev;
+};
+
+static inline void INIT_LIST_HEAD(struct list_head *list)
+{
+	list->next = list;
+	list->prev = list;
+}
+
+static inline void list_add_tail(struct list_head *n, struct list_head *head)
+{
+	n->prev = head->prev;
+	n->next = head;
+	head->prev->next = n;
+	head->prev = n;
+}
+
+static inline bool list_empty(const struct list_head *head)
+{
+	return head->next == head;
+}
+
+static inline void list_del(struct list_head *entry)
+{
+	entry->prev->next = entry->next;
+	entry->next->prev = entry->prev;
+}
+
+#define list_entry(ptr, type, member)	container_of(ptr, type, member)
+
+#define list_for_each_entry(pos, head, member) \
+	for (pos = list_entry((head)->next, typeof(*pos), member); \
+	     &pos->member != (head); \
+	     pos = list_entry(pos->member.next, typeof(*pos), member))
+
+#define list_for_each_entry_safe(pos, n, head, member) \
+	for (pos = list_entry((head)->next, typeof(*pos), member), \
+	     n = list_entry(pos->member.next, typeof(*pos), member); \
+	     &pos->member != (head); \
+	     pos = n, n = list_entry(n->member.next, typeof(*n), member))
+
+/*
+ * Delays
+ */
+#define usleep_range(min, max)	usleep(min)
+
+static inline void msleep_range(unsigned int delay_base)
+{
+	usleep_range(delay_base * 1000, delay_base * 1000 + 500);
+}
+
+/*
+ * debugfs and seq_file, the show function prints into a buffer
+ */
+struct dentry;
+
+struct inode {
+	void *i_private;
+};
+
+struct file;
+
+struct seq_file {
+	void *private;
+	char buf[1024];
+	size_t len;
+};
+
+static inline void seq_printf(struct seq_file *m, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	m->len += vsnprintf(m->buf + m->len, sizeof(m->buf) - m->len,
+			    fmt, ap);
+	va_end(ap);
+	if (m->len > sizeof(m->buf) - 1)
+		m->len = sizeof(m->buf) - 1;
+}
+
+struct file_operations {
+	int (*open)(struct inode *inode, struct file *file);
+	ssize_t (*read)(struct file *file, char *buf, size_t n, long *pos);
+	long (*llseek)(struct file *file, long off, int whence);
+	int (*release)(struct inode *inode, struct file *file);
+};
+
+int single_open(struct file *file, int (*show)(struct seq_file *, void *),
+		void *data);
+ssize_t seq_read(struct file *file, char *buf, size_t n, long *pos);
+long seq_lseek(struct file *file, long off, int whence);
+int single_release(struct inode *inode, struct file *file);
+
+static inline struct dentry *debugfs_create_file(const char *name,
+		unsigned int mode, struct dentry *parent, void *data,
+		const struct file_operations *fops)
+{
+	return NULL;
+}
+
+/*
+ * Devices and device tree. A node is a name, a parent and a list of u32
+ * array properties; a property without values is a boolean.
+ */
+struct device_node;
+
+struct device {
+	struct device_node *of_node;
+};
+
+struct of_device_id {
+	const char *compatible;
+};
+
+struct dev_pm_ops {
+	int (*prepare)(struct device *dev);
+	void (*complete)(struct device *dev);
+	int (*suspend)(struct device *dev);
+	int (*resume)(struct device *dev);
+};
+
+#define SET_SYSTEM_SLEEP_PM_OPS(suspend_fn, resume_fn) \
+	.suspend = suspend_fn, \
+	.resume = resume_fn,
+
+struct bus_type {
+	const char *name;
+};
+
+struct device_type {
+	const char *name;
+};
+
+struct device_driver {
+	const char *name;
+	struct bus_type *bus;
+	void *owner;
+	const struct of_device_id *of_match_table;
+	const struct dev_pm_ops *pm;
+};
+
+int of_property_read_u32_index(const struct device_node *np,
+			       const char *propname, u32 index, u32 *out);
+bool of_property_read_bool(const struct device_node *np,
+			   const char *propname);
+struct device_node *of_get_parent(const struct device_node *np);
+struct device_node *of_parse_phandle(const struct device_node *np,
+				     const char *phandle_name, int index);
+
+static inline int of_property_read_u32(const struct device_node *np,
+				       const char *propname, u32 *out)
+{
+	return of_property_read_u32_index(np, propname, 0, out);
+}
+
+/*
+ * I2C, just the client the sensor driver registers with
+ */
+struct i2c_client {
+	struct device dev;
+};
+
+/*
+ * Sensor driver helpers, just the register table entry
+ */
+struct reg_8 {
+	u16 addr;
+	u8 val;
+};
+
+/*
+ * IVC bus and channel
+ */
+struct tegra_ivc_rpc_data;
+
+struct tegra_ivc_channel {
+	struct device dev;
+	struct tegra_ivc_rpc_data *rpc_priv;
+	void *drvdata;
+};
+
+struct tegra_ivc_channel_ops {
+	int (*probe)(struct tegra_ivc_channel *chan);
+	void (*ready)(struct tegra_ivc_channel *chan, bool online);
+	void (*remove)(struct tegra_ivc_channel *chan);
+	void (*notify)(struct tegra_ivc_channel *chan);
+};
+
+struct tegra_ivc_driver {
+	struct device_driver driver;
+	const struct device_type *dev_type;
+	union {
+		const struct tegra_ivc_channel_ops *channel;
+	} ops;
+};
+
+extern struct bus_type tegra_ivc_bus_type;
+extern const struct device_type tegra_ivc_channel_type;
+
+/* the test probes the channel through the driver it would register */
+#define tegra_ivc_subsys_driver_default(drv) \
+	static struct tegra_ivc_driver *shim_ivc_driver \
+		__attribute__((unused)) = &drv
+
+#define tegra_ivc_channel_get_drvdata(chan)	((chan)->drvdata)
+#define tegra_ivc_channel_set_drvdata(chan, data) \
+	((chan)->drvdata = (data))
+
+int tegra_ivc_channel_runtime_get(struct tegra_ivc_channel *chan);
+void tegra_ivc_channel_runtime_put(struct tegra_ivc_channel *chan);
+
+#endif /* _IVC_MULTI_SHIM_H */
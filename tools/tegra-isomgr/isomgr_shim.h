@@ -0,0 +1,202 @@
+/*
+ * Userspace stand-ins for the kernel facilities used by the ISO bandwidth
+ * manager (drivers/platform/tegra/mc/isomgr*.c). The EMC bandwidth manager
+ * and the chip id are provided by the test.
+ *
+ * Copyright (c) 2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#ifndef _ISOMGR_SHIM_H
+#define _ISOMGR_SHIM_H
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int32_t s32;
+typedef int64_t s64;
+
+#define __init
+#define __exit
+#define likely(x)		__builtin_expect(!!(x), 1)
+#define unlikely(x)		__builtin_expect(!!(x), 0)
+
+#define EXPORT_SYMBOL(sym)	extern typeof(sym) sym
+#define fs_initcall(fn) \
+	static int (*shim_initcall)(void) __attribute__((unused)) = fn
+
+#define LINUX_VERSION_CODE	KERNEL_VERSION(4, 14, 0)
+#define KERNEL_VERSION(a, b, c)	(((a) << 16) + ((b) << 8) + (c))
+
+#define ARRAY_SIZE(a)		(sizeof(a) / sizeof((a)[0]))
+#define BUILD_BUG_ON(cond)	_Static_assert(!(cond), #cond)
+#define container_of(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+#define max(a, b)		((a) > (b) ? (a) : (b))
+#define min(a, b)		((a) < (b) ? (a) : (b))
+
+#define MAX_ERRNO		4095
+
+static inline void *ERR_PTR(long error)
+{
+	return (void *)error;
+}
+
+static inline bool IS_ERR_OR_NULL(const void *ptr)
+{
+	return !ptr || (unsigned long)ptr >= (unsigned long)-MAX_ERRNO;
+}
+
+/* set by the test to silence expected errors */
+extern int shim_quiet;
+extern unsigned int shim_warnings;
+
+static inline void shim_log(bool show, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (!show)
+		return;
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+}
+
+#ifndef pr_fmt
+#define pr_fmt(fmt)		fmt
+#endif
+
+#define pr_err(fmt, ...) \
+	shim_log(!shim_quiet, pr_fmt(fmt), ##__VA_ARGS__)
+#define pr_info(fmt, ...)	do { } while (0)
+#define dump_stack()		do { } while (0)
+
+#define WARN_ON(cond) ({ \
+	int __c = !!(cond); \
+	if (__c) \
+		shim_warnings++; \
+	__c; \
+})
+
+/* the lock owner check only compares pointers */
+struct task_struct;
+
+extern __thread char shim_task;
+
+#define current			((struct task_struct *)&shim_task)
+
+struct mutex {
+	pthread_mutex_t lock;
+};
+
+#define mutex_init(m)		pthread_mutex_init(&(m)->lock, NULL)
+#define mutex_lock(m)		pthread_mutex_lock(&(m)->lock)
+#define mutex_unlock(m)		pthread_mutex_unlock(&(m)->lock)
+#define mutex_trylock(m)	(pthread_mutex_trylock(&(m)->lock) == 0)
+
+struct completion {
+	unsigned int done;
+};
+
+#define init_completion(x)	((x)->done = 0)
+
+typedef struct {
+	int refs;
+} refcount_t;
+
+struct kref {
+	refcount_t refcount;
+};
+
+#define refcount_set(r, n)	((r)->refs = (n))
+#define refcount_read(r)	((r)->refs)
+
+static inline bool refcount_inc_not_zero(refcount_t *r)
+{
+	if (!r->refs)
+		return false;
+	r->refs++;
+	return true;
+}
+
+static inline void kref_init(struct kref *kref)
+{
+	kref->refcount.refs = 1;
+}
+
+static inline int kref_put(struct kref *kref,
+			   void (*release)(struct kref *kref))
+{
+	if (--kref->refcount.refs)
+		return 0;
+	release(kref);
+	return 1;
+}
+
+/* sysfs is compiled out, these are for the struct definitions only */
+struct kobject;
+struct clk;
+struct notifier_block;
+
+/* chip id, set by the test */
+enum tegra_chipid {
+	TEGRA_CHIPID_UNKNOWN = 0,
+	TEGRA114 = 0x14,
+	TEGRA124 = 0x40,
+	TEGRA132 = 0x13,
+	TEGRA148 = 0x148,
+	TEGRA210 = 0x21,
+	TEGRA186 = 0x18,
+	TEGRA194 = 0x19,
+};
+
+extern enum tegra_chipid shim_chip_id;
+
+#define tegra_get_chip_id()	shim_chip_id
+
+/* tracepoints, arguments evaluated and dropped */
+static inline void shim_trace(int unused, ...)
+{
+}
+
+#define trace_tegra_isomgr_get_available_iso_bw(...) \
+	shim_trace(0, __VA_ARGS__)
+#define trace_tegra_isomgr_get_imp_time(...) \
+	shim_trace(0, __VA_ARGS__)
+#define trace_tegra_isomgr_get_total_iso_bw(...) \
+	shim_trace(0, __VA_ARGS__)
+#define trace_tegra_isomgr_realize(...) \
+	shim_trace(0, __VA_ARGS__)
+#define trace_tegra_isomgr_register(...) \
+	shim_trace(0, __VA_ARGS__)
+#define trace_tegra_isomgr_reserve(...) \
+	shim_trace(0, __VA_ARGS__)
+#define trace_tegra_isomgr_set_margin(...) \
+	shim_trace(0, __VA_ARGS__)
+#define trace_tegra_isomgr_unregister(...) \
+	shim_trace(0, __VA_ARGS__)
+#define trace_tegra_isomgr_unregister_iso_client(...) \
+	shim_trace(0, __VA_ARGS__)
+
+#endif /* _ISOMGR_SHIM_H */
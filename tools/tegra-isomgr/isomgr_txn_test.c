@@ -0,0 +1,398 @@
+/*
+ * isomgr_txn_test - test for the transactional multi-client commit of the
+ * ISO bandwidth manager (drivers/platform/tegra/mc/isomgr.c), built in
+ * userspace against isomgr_shim.h and a model of the EMC bandwidth
+ * manager.
+ *
+ * Copyright (c) 2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Example Usage:
+ *	isomgr_txn_test			pre-t19x platform ops (t210)
+ *	isomgr_txn_test -c t194		t19x platform ops
+ *
+ * The test drives isomgr the way a test module does: it puts isomgr in
+ * test mode, registers its own clients with test_tegra_isomgr_register()
+ * and commits through test_tegra_isomgr_commit(), which runs the real
+ * path. Sets that do not fit are rejected at staging on t19x and in the
+ * realize pass before t19x; either way the test checks that every client
+ * and the global pool are left as they were and nothing reached the EMC.
+ */
+
+#include <getopt.h>
+
+#include "isomgr.c"
+#include "isomgr-pre_t19x.c"
+#include "isomgr-t19x.c"
+
+int shim_quiet;
+unsigned int shim_warnings;
+__thread char shim_task;
+enum tegra_chipid shim_chip_id = TEGRA210;
+
+tegra_isomgr_handle test_tegra_isomgr_register(enum tegra_iso_client client,
+		u32 dedicated_bw, tegra_isomgr_renegotiate renegotiate,
+		void *priv);
+u32 test_tegra_isomgr_reserve(tegra_isomgr_handle handle, u32 bw, u32 lt);
+u32 test_tegra_isomgr_realize(tegra_isomgr_handle handle);
+int test_tegra_isomgr_commit(struct tegra_isomgr_txn_entry *entries, int n);
+
+static int failures;
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s:%d: check failed: %s\n", \
+				__func__, __LINE__, #cond); \
+			failures++; \
+			return -1; \
+		} \
+	} while (0)
+
+/*
+ * EMC bandwidth manager model: 2 GHz EMC moving 8 bytes per cycle, half
+ * of it usable for ISO. Requests are counted, not applied.
+ */
+#define MAX_EMC_HZ		2000000000UL
+#define BYTES_PER_CYCLE		8
+#define ISO_PERCENT		50
+#define MAX_ISO_BW \
+	(MAX_EMC_HZ / 1000 * BYTES_PER_CYCLE * ISO_PERCENT / 100)
+
+struct tegra_bwmgr_client {
+	unsigned long floor;
+	unsigned long iso;
+	unsigned int floor_requests;
+};
+
+static struct tegra_bwmgr_client bwmgr_clients[TEGRA_BWMGR_CLIENT_COUNT];
+static unsigned int emc_requests;
+
+struct tegra_bwmgr_client *tegra_bwmgr_register(
+		enum tegra_bwmgr_client_id client)
+{
+	return &bwmgr_clients[client];
+}
+
+int tegra_bwmgr_set_emc(struct tegra_bwmgr_client *handle, unsigned long val,
+		enum tegra_bwmgr_request_type req)
+{
+	emc_requests++;
+	if (req == TEGRA_BWMGR_SET_EMC_FLOOR) {
+		handle->floor_requests++;
+		handle->floor = val;
+	} else {
+		handle->iso = val;
+	}
+	return 0;
+}
+
+unsigned long tegra_bwmgr_get_max_emc_rate(void)
+{
+	return MAX_EMC_HZ;
+}
+
+unsigned long bwmgr_freq_to_bw(unsigned long freq)
+{
+	return freq * BYTES_PER_CYCLE;
+}
+
+unsigned long bwmgr_bw_to_freq(unsigned long bw)
+{
+	return (bw + BYTES_PER_CYCLE - 1) / BYTES_PER_CYCLE;
+}
+
+u32 bwmgr_dvfs_latency(u32 ufreq)
+{
+	return 4;
+}
+
+int bwmgr_iso_bw_percentage_max(void)
+{
+	return ISO_PERCENT;
+}
+
+unsigned long bwmgr_get_lowest_iso_emc_freq(long iso_bw,
+		long iso_bw_nvdis, long iso_bw_vi)
+{
+	return iso_bw <= MAX_EMC_HZ * ISO_PERCENT / 100 ? iso_bw : 0;
+}
+
+u32 tegra_bwmgr_get_max_iso_bw(enum tegra_iso_client client)
+{
+	return MAX_ISO_BW;
+}
+
+/*
+ * Snapshot of everything a failed commit must leave alone
+ */
+struct snapshot {
+	struct isomgr_client clients[TEGRA_ISO_CLIENT_COUNT];
+	s32 avail_bw;
+	s32 sleep_bw;
+	s32 lt_mf;
+	unsigned int emc_requests;
+};
+
+static void snapshot(struct snapshot *s)
+{
+	memcpy(s->clients, isomgr_clients, sizeof(s->clients));
+	s->avail_bw = isomgr.avail_bw;
+	s->sleep_bw = isomgr.sleep_bw;
+	s->lt_mf = isomgr.lt_mf;
+	s->emc_requests = emc_requests;
+}
+
+static bool unchanged(const struct snapshot *s)
+{
+	int i;
+
+	for (i = 0; i < TEGRA_ISO_CLIENT_COUNT; i++) {
+		const struct isomgr_client *a = &s->clients[i];
+		const struct isomgr_client *b = &isomgr_clients[i];
+
+		if (a->rsvd_bw != b->rsvd_bw || a->real_bw != b->real_bw ||
+		    a->lti != b->lti || a->lto != b->lto ||
+		    a->rsvd_mf != b->rsvd_mf || a->real_mf != b->real_mf ||
+		    a->sleep_bw != b->sleep_bw || a->realize != b->realize ||
+		    a->kref.refcount.refs != b->kref.refcount.refs)
+			return false;
+	}
+
+	return s->avail_bw == isomgr.avail_bw &&
+		s->sleep_bw == isomgr.sleep_bw &&
+		s->lt_mf == isomgr.lt_mf &&
+		s->emc_requests == emc_requests;
+}
+
+static void renegotiate(void *priv, u32 avail_bw)
+{
+}
+
+#define NCLIENTS	3
+#define DEDI_BW		1000000
+
+static enum tegra_iso_client clients[NCLIENTS];
+static tegra_isomgr_handle handles[NCLIENTS];
+
+static void fill(struct tegra_isomgr_txn_entry *e, u32 bw0, u32 bw1, u32 bw2)
+{
+	u32 bw[NCLIENTS] = { bw0, bw1, bw2 };
+	int i;
+
+	for (i = 0; i < NCLIENTS; i++) {
+		e[i].handle = handles[i];
+		e[i].bw = bw[i];
+		e[i].lt = 1000;
+		e[i].lto = 0;
+	}
+}
+
+static int test_register(void)
+{
+	int i;
+
+	CHECK(!test_mode);
+	/* drops the clients nobody registered, quietly */
+	shim_quiet = 1;
+	CHECK(tegra_isomgr_enable_test_mode() == 0);
+	shim_quiet = 0;
+	CHECK(test_mode);
+
+	for (i = 0; i < NCLIENTS; i++) {
+		handles[i] = test_tegra_isomgr_register(clients[i], DEDI_BW,
+							renegotiate, NULL);
+		CHECK(!IS_ERR_OR_NULL(handles[i]));
+	}
+
+	return 0;
+}
+
+/* client API in test mode: success, nothing touched */
+static int test_commit_test_mode(void)
+{
+	struct tegra_isomgr_txn_entry e[NCLIENTS];
+	struct snapshot s;
+
+	fill(e, 2000000, 2000000, 2000000);
+	snapshot(&s);
+	CHECK(tegra_isomgr_commit(e, NCLIENTS) == 0);
+	CHECK(e[0].lto == 1 && e[1].lto == 1 && e[2].lto == 1);
+	CHECK(unchanged(&s));
+
+	return 0;
+}
+
+static int test_commit(void)
+{
+	struct tegra_isomgr_txn_entry e[NCLIENTS];
+	s32 avail_bw = isomgr.avail_bw;
+	unsigned int floors = isomgr.bwmgr_handle->floor_requests;
+	struct isomgr_client *cp;
+	int i;
+
+	fill(e, 2000000, 2000000, 2000000);
+	CHECK(test_tegra_isomgr_commit(e, NCLIENTS) == 0);
+
+	for (i = 0; i < NCLIENTS; i++) {
+		cp = handles[i];
+		CHECK(cp->real_bw == 2000000);
+		CHECK(cp->real_mf == 2000000 / BYTES_PER_CYCLE);
+		CHECK(!cp->realize);
+		CHECK(e[i].lto == 4);
+		CHECK(cp->kref.refcount.refs == 1);
+	}
+
+	/* a single isomgr EMC floor update for the set */
+	CHECK(isomgr.bwmgr_handle->floor_requests == floors + 1);
+	CHECK(isomgr.lt_mf == 2000000 / BYTES_PER_CYCLE);
+	if (shim_chip_id != TEGRA194)
+		CHECK(isomgr.avail_bw == avail_bw - 3 * 2000000);
+
+	return 0;
+}
+
+/*
+ * Each entry fits on its own, the set does not. Fails at staging on
+ * t19x and in the realize pass before t19x, the third client's realize
+ * running out of avail_bw after two have been applied and have left
+ * avail_bw below where it started.
+ */
+static int test_rollback(void)
+{
+	struct tegra_isomgr_txn_entry e[NCLIENTS];
+	struct snapshot s;
+	int i;
+
+	fill(e, 2500000, 3000000, 3000000);
+	snapshot(&s);
+	shim_quiet = 1;
+	CHECK(test_tegra_isomgr_commit(e, NCLIENTS) == -ENOMEM);
+	shim_quiet = 0;
+	CHECK(unchanged(&s));
+	for (i = 0; i < NCLIENTS; i++)
+		CHECK(e[i].lto == 0);
+
+	/* a smaller set still goes through afterwards */
+	fill(e, 2500000, 2500000, 2500000);
+	CHECK(test_tegra_isomgr_commit(e, NCLIENTS) == 0);
+	fill(e, 2000000, 2000000, 2000000);
+	CHECK(test_tegra_isomgr_commit(e, NCLIENTS) == 0);
+
+	return 0;
+}
+
+/* a client that cannot grow past its dedicated bw fails the whole set */
+static int test_rollback_dedi(void)
+{
+	struct tegra_isomgr_txn_entry e[NCLIENTS];
+	struct isomgr_client *cp = handles[1];
+	struct snapshot s;
+
+	cp->renegotiate = NULL;
+	fill(e, 500000, DEDI_BW + 1, 500000);
+	snapshot(&s);
+	CHECK(test_tegra_isomgr_commit(e, NCLIENTS) == -ENOMEM);
+	cp->renegotiate = renegotiate;
+	CHECK(unchanged(&s));
+
+	return 0;
+}
+
+static int test_invalid(void)
+{
+	struct tegra_isomgr_txn_entry e[NCLIENTS];
+	struct snapshot s;
+
+	snapshot(&s);
+	shim_quiet = 1;
+
+	fill(e, 100, 100, 100);
+	CHECK(test_tegra_isomgr_commit(e, 0) == -EINVAL);
+	CHECK(test_tegra_isomgr_commit(e, TEGRA_ISO_CLIENT_COUNT + 1) ==
+	      -EINVAL);
+
+	e[2].handle = e[0].handle;
+	CHECK(test_tegra_isomgr_commit(e, NCLIENTS) == -EINVAL);
+
+	fill(e, 100, 100, 100);
+	e[1].handle = &isomgr_clients[TEGRA_ISO_CLIENT_EQOS];
+	CHECK(test_tegra_isomgr_commit(e, NCLIENTS) == -EINVAL);
+
+	shim_quiet = 0;
+	CHECK(unchanged(&s));
+
+	return 0;
+}
+
+/* reserve/realize one by one still works next to commit */
+static int test_single(void)
+{
+	struct isomgr_client *cp = handles[0];
+
+	CHECK(test_tegra_isomgr_reserve(handles[0], 1500000, 1000) == 4);
+	CHECK(test_tegra_isomgr_realize(handles[0]) == 4);
+	CHECK(cp->real_bw == 1500000);
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int opt;
+
+	while ((opt = getopt(argc, argv, "c:")) != -1) {
+		switch (opt) {
+		case 'c':
+			if (!strcmp(optarg, "t194")) {
+				shim_chip_id = TEGRA194;
+				break;
+			}
+			if (!strcmp(optarg, "t210")) {
+				shim_chip_id = TEGRA210;
+				break;
+			}
+			/* fall through */
+		default:
+			fprintf(stderr, "usage: %s [-c t210|t194]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	if (shim_chip_id == TEGRA194) {
+		clients[0] = TEGRA_ISO_CLIENT_DISP_0;
+		clients[1] = TEGRA_ISO_CLIENT_DISP_1;
+		clients[2] = TEGRA_ISO_CLIENT_TEGRA_CAMERA;
+	} else {
+		clients[0] = TEGRA_ISO_CLIENT_DISP_0;
+		clients[1] = TEGRA_ISO_CLIENT_DISP_1;
+		clients[2] = TEGRA_ISO_CLIENT_VI_0;
+	}
+
+	isomgr_init();
+	if (test_mode ||
+	    (shim_chip_id != TEGRA194 && isomgr.max_iso_bw != MAX_ISO_BW)) {
+		fprintf(stderr, "isomgr init failed\n");
+		return 1;
+	}
+
+	if (!test_register()) {
+		test_commit_test_mode();
+		test_commit();
+		test_rollback();
+		test_rollback_dedi();
+		test_invalid();
+		test_single();
+	}
+
+	printf("%s\n", failures ? "FAIL" : "PASS");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,1020 @@
+/*
+ * isp_capture_loopback - unit test for the ISP capture channel driver
+ * (drivers/media/platform/tegra/camera/isp), built in userspace against
+ * isp_shim.h and a mock RTCPU standing in for the camera firmware.
+ *
+ * Copyright (c) 2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Example Usage:
+ *	isp_capture_loopback		run the unit tests
+ *
+ * The RTCPU thread takes the messages submitted on the capture IVC
+ * control and capture channels in order, and answers through the
+ * registered callbacks as the capture IVC worker does. Setup, reset and
+ * release always succeed. Capture and program requests complete right
+ * away with a status indication, or are held until the test completes
+ * them; a reset drops the held ones. Surface mappings are counted so
+ * that the tests can check what stays pinned.
+ */
+
+#include "isp_shim.h"
+
+#include "capture_isp.c"
+#include "isp_channel.c"
+
+int shim_quiet;
+unsigned int shim_warnings;
+__thread int shim_sigpending;
+__thread struct wait_queue_entry *shim_cur_wait;
+
+static int failures;
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s:%d: check failed: %s\n", \
+				__func__, __LINE__, #cond); \
+			failures++; \
+			return -1; \
+		} \
+	} while (0)
+
+/* descriptor rings and surfaces, by memory handle */
+#define MEM_CAPTURE_RING	1U
+#define MEM_PROGRAM_RING	2U
+#define MEM_SURFACE		3U
+#define MEM_BAD			4U	/* pinning it fails */
+
+#define QUEUE_DEPTH		4U
+#define SKIP			U32_MAX
+
+static struct isp_capture_descriptor capture_ring[QUEUE_DEPTH];
+static struct isp_program_descriptor program_ring[QUEUE_DEPTH];
+
+/*
+ * Buffer table. Every pinned surface is one mapping, released by
+ * put_mapping().
+ */
+struct capture_buffer_table {
+	struct device *dev;
+};
+
+struct capture_mapping {
+	uint32_t mem;
+};
+
+static int live_mappings;
+
+struct capture_buffer_table *create_buffer_table(struct device *dev)
+{
+	struct capture_buffer_table *tab = calloc(1, sizeof(*tab));
+
+	if (tab)
+		tab->dev = dev;
+	return tab;
+}
+
+void destroy_buffer_table(struct capture_buffer_table *tab)
+{
+	free(tab);
+}
+
+int capture_buffer_request(struct capture_buffer_table *tab, uint32_t memfd,
+			   uint32_t flag)
+{
+	return memfd == MEM_BAD ? -EINVAL : 0;
+}
+
+void put_mapping(struct capture_buffer_table *t, struct capture_mapping *pin)
+{
+	__atomic_fetch_sub(&live_mappings, 1, __ATOMIC_SEQ_CST);
+	free(pin);
+}
+
+void capture_buffer_set_cache_size(struct capture_buffer_table *tab,
+				   uint32_t size)
+{
+}
+
+void capture_buffer_flush_cache(struct capture_buffer_table *tab)
+{
+}
+
+void capture_buffer_get_stats(struct capture_buffer_table *tab,
+			      struct capture_buffer_stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+}
+
+int capture_common_pin_memory(struct device *dev, uint32_t mem,
+			      struct capture_common_buf *unpin_data)
+{
+	memset(unpin_data, 0, sizeof(*unpin_data));
+	if (mem == MEM_CAPTURE_RING)
+		unpin_data->va = capture_ring;
+	else if (mem == MEM_PROGRAM_RING)
+		unpin_data->va = program_ring;
+	else
+		return -EINVAL;
+	unpin_data->iova = (uintptr_t)unpin_data->va;
+	return 0;
+}
+
+void capture_common_unpin_memory(struct capture_common_buf *unpin_data)
+{
+	memset(unpin_data, 0, sizeof(*unpin_data));
+}
+
+int capture_common_pin_and_get_iova(struct capture_buffer_table *buf_ctx,
+		uint32_t mem_handle, uint64_t mem_offset,
+		uint64_t *meminfo_base_address, uint64_t *meminfo_size,
+		struct capture_common_unpins *unpins)
+{
+	struct capture_mapping *pin;
+
+	if (!mem_handle)
+		return 0;
+	if (mem_handle == MEM_BAD ||
+	    unpins->num_unpins >= MAX_PIN_BUFFER_PER_REQUEST)
+		return -EINVAL;
+
+	pin = calloc(1, sizeof(*pin));
+	if (!pin)
+		return -ENOMEM;
+	pin->mem = mem_handle;
+	__atomic_fetch_add(&live_mappings, 1, __ATOMIC_SEQ_CST);
+	unpins->data[unpins->num_unpins++] = pin;
+
+	*meminfo_base_address = ((uint64_t)mem_handle << 32) + mem_offset;
+	*meminfo_size = PAGE_SIZE;
+	return 0;
+}
+
+int capture_common_setup_progress_status_notifier(
+		struct capture_common_status_notifier *status_notifier,
+		uint32_t mem, uint32_t buffer_size, uint32_t mem_offset)
+{
+	return -EINVAL;
+}
+
+int capture_common_set_progress_status(
+		struct capture_common_status_notifier *progress_status_notifier,
+		uint32_t buffer_slot, uint32_t buffer_depth, uint8_t new_val)
+{
+	return 0;
+}
+
+int capture_common_release_progress_status_notifier(
+		struct capture_common_status_notifier *progress_status_notifier)
+{
+	return 0;
+}
+
+/* fences are not used by the tests */
+void *dma_buf_kmap(struct dma_buf *dmabuf, unsigned long page_num)
+{
+	return NULL;
+}
+
+void dma_buf_kunmap(struct dma_buf *dmabuf, unsigned long page_num,
+		    void *vaddr)
+{
+}
+
+/*
+ * Devices
+ */
+static struct platform_device rtcpu_pdev = { .dev = { "rtcpu" } };
+static struct platform_device isp_pdev = { .dev = { "isp" } };
+
+struct device_node *of_find_node_by_path(const char *path)
+{
+	return (struct device_node *)&rtcpu_pdev;
+}
+
+int of_device_is_available(const struct device_node *np)
+{
+	return np != NULL;
+}
+
+struct platform_device *of_find_device_by_node(struct device_node *np)
+{
+	return &rtcpu_pdev;
+}
+
+static int syncpt_alloc(struct platform_device *pdev, const char *name,
+			uint32_t *syncpt_id)
+{
+	static uint32_t next_id = 1;
+
+	*syncpt_id = __atomic_fetch_add(&next_id, 1, __ATOMIC_SEQ_CST);
+	return 0;
+}
+
+static void syncpt_release(struct platform_device *pdev, uint32_t id)
+{
+}
+
+static uint32_t syncpt_gos_table(struct platform_device *pdev,
+				 const dma_addr_t **table)
+{
+	*table = NULL;
+	return 0;
+}
+
+static int syncpt_gos_backing(struct platform_device *pdev, uint32_t id,
+			      dma_addr_t *syncpt_addr, uint32_t *gos_index,
+			      uint32_t *gos_offset)
+{
+	*syncpt_addr = 0x1000U * id;
+	*gos_index = GOS_INDEX_INVALID;
+	*gos_offset = 0;
+	return 0;
+}
+
+static const struct isp_channel_drv_ops isp_ops = {
+	.alloc_syncpt = syncpt_alloc,
+	.release_syncpt = syncpt_release,
+	.get_gos_table = syncpt_gos_table,
+	.get_syncpt_gos_backing = syncpt_gos_backing,
+};
+
+/*
+ * Mock RTCPU
+ */
+#define RT_QUEUE_SIZE		64U
+#define RT_TRANSACTION		0x55U
+#define RT_CHANNEL_ID		7U
+
+enum rt_kind {
+	RT_CONTROL,
+	RT_CAPTURE,
+	RT_FLUSH,	/* complete the held requests */
+};
+
+struct rt_msg {
+	enum rt_kind kind;
+	union {
+		struct CAPTURE_CONTROL_MSG control;
+		struct CAPTURE_MSG capture;
+	};
+};
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t thread;
+	struct rt_msg queue[RT_QUEUE_SIZE];
+	unsigned int head, tail;
+	bool busy;
+	bool stop;
+	/* keep requests until rt_flush() */
+	bool hold;
+	struct CAPTURE_MSG held[2 * QUEUE_DEPTH];
+	unsigned int num_held;
+	tegra_capture_ivc_cb_func control_cb;
+	const void *control_ctx;
+	tegra_capture_ivc_cb_func status_cb;
+	const void *status_ctx;
+	unsigned int captures, programs, dropped;
+	/* unexpected messages */
+	unsigned int bad;
+} rt = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
+static int rt_queue(enum rt_kind kind, const void *msg, size_t len)
+{
+	struct rt_msg *m;
+
+	pthread_mutex_lock(&rt.lock);
+	if (rt.tail - rt.head == RT_QUEUE_SIZE) {
+		pthread_mutex_unlock(&rt.lock);
+		return -ENOMEM;
+	}
+	m = &rt.queue[rt.tail % RT_QUEUE_SIZE];
+	memset(m, 0, sizeof(*m));
+	m->kind = kind;
+	if (msg)
+		memcpy(&m->control, msg, len);
+	rt.tail++;
+	pthread_cond_broadcast(&rt.cond);
+	pthread_mutex_unlock(&rt.lock);
+	return 0;
+}
+
+int tegra_capture_ivc_control_submit(const void *control_desc, size_t len)
+{
+	if (len != sizeof(struct CAPTURE_CONTROL_MSG))
+		return -EINVAL;
+	return rt_queue(RT_CONTROL, control_desc, len);
+}
+
+int tegra_capture_ivc_capture_submit(const void *capture_desc, size_t len)
+{
+	if (len != sizeof(struct CAPTURE_MSG))
+		return -EINVAL;
+	return rt_queue(RT_CAPTURE, capture_desc, len);
+}
+
+int tegra_capture_ivc_register_control_cb(
+		tegra_capture_ivc_cb_func control_resp_cb,
+		uint32_t *trans_id, const void *priv_context)
+{
+	pthread_mutex_lock(&rt.lock);
+	rt.control_cb = control_resp_cb;
+	rt.control_ctx = priv_context;
+	pthread_mutex_unlock(&rt.lock);
+	*trans_id = RT_TRANSACTION;
+	return 0;
+}
+
+int tegra_capture_ivc_notify_chan_id(uint32_t chan_id, uint32_t trans_id)
+{
+	return chan_id == RT_CHANNEL_ID && trans_id == RT_TRANSACTION ?
+		0 : -EINVAL;
+}
+
+int tegra_capture_ivc_register_capture_cb(
+		tegra_capture_ivc_cb_func capture_status_ind_cb,
+		uint32_t chan_id, const void *priv_context)
+{
+	pthread_mutex_lock(&rt.lock);
+	rt.status_cb = capture_status_ind_cb;
+	rt.status_ctx = priv_context;
+	pthread_mutex_unlock(&rt.lock);
+	return 0;
+}
+
+int tegra_capture_ivc_unregister_control_cb(uint32_t id)
+{
+	pthread_mutex_lock(&rt.lock);
+	rt.control_cb = NULL;
+	pthread_mutex_unlock(&rt.lock);
+	return 0;
+}
+
+int tegra_capture_ivc_unregister_capture_cb(uint32_t chan_id)
+{
+	pthread_mutex_lock(&rt.lock);
+	rt.status_cb = NULL;
+	pthread_mutex_unlock(&rt.lock);
+	return 0;
+}
+
+static void rt_status(const struct CAPTURE_MSG *req)
+{
+	tegra_capture_ivc_cb_func cb;
+	const void *ctx;
+	struct CAPTURE_MSG ind;
+
+	memset(&ind, 0, sizeof(ind));
+	ind.header.channel_id = req->header.channel_id;
+	if (req->header.msg_id == CAPTURE_ISP_REQUEST_REQ) {
+		ind.header.msg_id = CAPTURE_ISP_STATUS_IND;
+		ind.capture_isp_status_ind.buffer_index =
+			req->capture_isp_request_req.buffer_index;
+	} else {
+		ind.header.msg_id = CAPTURE_ISP_PROGRAM_STATUS_IND;
+		ind.capture_isp_program_status_ind.buffer_index =
+			req->capture_isp_program_request_req.buffer_index;
+	}
+
+	pthread_mutex_lock(&rt.lock);
+	cb = rt.status_cb;
+	ctx = rt.status_ctx;
+	pthread_mutex_unlock(&rt.lock);
+	if (cb)
+		cb(&ind, ctx);
+	else
+		rt.bad++;
+}
+
+static void rt_control(const struct CAPTURE_CONTROL_MSG *req)
+{
+	tegra_capture_ivc_cb_func cb;
+	const void *ctx;
+	struct CAPTURE_CONTROL_MSG resp;
+
+	memset(&resp, 0, sizeof(resp));
+	resp.header = req->header;
+
+	switch (req->header.msg_id) {
+	case CAPTURE_CHANNEL_ISP_SETUP_REQ:
+		resp.header.msg_id = CAPTURE_CHANNEL_ISP_SETUP_RESP;
+		resp.channel_isp_setup_resp.result = CAPTURE_OK;
+		resp.channel_isp_setup_resp.channel_id = RT_CHANNEL_ID;
+		break;
+	case CAPTURE_CHANNEL_ISP_RESET_REQ:
+		/* pending requests are dropped without a status */
+		pthread_mutex_lock(&rt.lock);
+		rt.dropped += rt.num_held;
+		rt.num_held = 0;
+		pthread_mutex_unlock(&rt.lock);
+		resp.header.msg_id = CAPTURE_CHANNEL_ISP_RESET_RESP;
+		resp.channel_isp_reset_resp.result = CAPTURE_OK;
+		break;
+	case CAPTURE_CHANNEL_ISP_RELEASE_REQ:
+		resp.header.msg_id = CAPTURE_CHANNEL_ISP_RELEASE_RESP;
+		resp.channel_isp_release_resp.result = CAPTURE_OK;
+		break;
+	default:
+		rt.bad++;
+		return;
+	}
+
+	pthread_mutex_lock(&rt.lock);
+	cb = rt.control_cb;
+	ctx = rt.control_ctx;
+	pthread_mutex_unlock(&rt.lock);
+	if (cb)
+		cb(&resp, ctx);
+	else
+		rt.bad++;
+}
+
+static void rt_capture(const struct CAPTURE_MSG *req)
+{
+	bool hold;
+
+	switch (req->header.msg_id) {
+	case CAPTURE_ISP_REQUEST_REQ:
+		rt.captures++;
+		break;
+	case CAPTURE_ISP_PROGRAM_REQUEST_REQ:
+		rt.programs++;
+		break;
+	case CAPTURE_ISP_RESET_BARRIER_IND:
+		return;
+	default:
+		rt.bad++;
+		return;
+	}
+
+	if (req->header.channel_id != RT_CHANNEL_ID)
+		rt.bad++;
+
+	pthread_mutex_lock(&rt.lock);
+	hold = rt.hold;
+	if (hold) {
+		if (rt.num_held < ARRAY_SIZE(rt.held))
+			rt.held[rt.num_held++] = *req;
+		else
+			rt.bad++;
+	}
+	pthread_mutex_unlock(&rt.lock);
+
+	if (!hold)
+		rt_status(req);
+}
+
+static void rt_complete_held(void)
+{
+	struct CAPTURE_MSG held[ARRAY_SIZE(rt.held)];
+	unsigned int i, n;
+
+	pthread_mutex_lock(&rt.lock);
+	n = rt.num_held;
+	memcpy(held, rt.held, n * sizeof(held[0]));
+	rt.num_held = 0;
+	rt.hold = false;
+	pthread_mutex_unlock(&rt.lock);
+
+	for (i = 0; i < n; i++)
+		rt_status(&held[i]);
+}
+
+static void *rt_thread(void *arg)
+{
+	struct rt_msg m;
+
+	pthread_mutex_lock(&rt.lock);
+	for (;;) {
+		while (rt.head == rt.tail && !rt.stop)
+			pthread_cond_wait(&rt.cond, &rt.lock);
+		if (rt.stop)
+			break;
+		m = rt.queue[rt.head % RT_QUEUE_SIZE];
+		rt.head++;
+		rt.busy = true;
+		pthread_mutex_unlock(&rt.lock);
+
+		if (m.kind == RT_CONTROL)
+			rt_control(&m.control);
+		else if (m.kind == RT_CAPTURE)
+			rt_capture(&m.capture);
+		else
+			rt_complete_held();
+
+		pthread_mutex_lock(&rt.lock);
+		rt.busy = false;
+		pthread_cond_broadcast(&rt.cond);
+	}
+	pthread_mutex_unlock(&rt.lock);
+	return NULL;
+}
+
+/* wait until the RTCPU has handled everything submitted so far */
+static void rt_sync(void)
+{
+	pthread_mutex_lock(&rt.lock);
+	while (rt.head != rt.tail || rt.busy)
+		pthread_cond_wait(&rt.cond, &rt.lock);
+	pthread_mutex_unlock(&rt.lock);
+}
+
+static void rt_set_hold(bool hold)
+{
+	pthread_mutex_lock(&rt.lock);
+	rt.hold = hold;
+	pthread_mutex_unlock(&rt.lock);
+}
+
+/* complete the held requests, in submission order */
+static void rt_flush(void)
+{
+	rt_queue(RT_FLUSH, NULL, 0);
+	rt_sync();
+}
+
+static void rt_reset_counts(void)
+{
+	rt_sync();
+	pthread_mutex_lock(&rt.lock);
+	rt.captures = 0;
+	rt.programs = 0;
+	rt.dropped = 0;
+	pthread_mutex_unlock(&rt.lock);
+}
+
+static void rt_start(void)
+{
+	pthread_create(&rt.thread, NULL, rt_thread, NULL);
+}
+
+static void rt_stop(void)
+{
+	pthread_mutex_lock(&rt.lock);
+	rt.stop = true;
+	pthread_cond_broadcast(&rt.cond);
+	pthread_mutex_unlock(&rt.lock);
+	pthread_join(rt.thread, NULL);
+}
+
+/*
+ * Channel file
+ */
+static struct inode chan_inode = { .minor = 0 };
+
+static long chan_ioctl(struct file *f, unsigned int cmd, void *arg)
+{
+	return isp_channel_fops.unlocked_ioctl(f, cmd, (unsigned long)arg);
+}
+
+static int chan_open(struct file *f)
+{
+	memset(f, 0, sizeof(*f));
+	return isp_channel_fops.open(&chan_inode, f);
+}
+
+static int chan_setup(struct file *f)
+{
+	struct isp_capture_setup setup = {
+		.channel_flags = 1,
+		.queue_depth = QUEUE_DEPTH,
+		.request_size = sizeof(capture_ring[0]),
+		.mem = MEM_CAPTURE_RING,
+		.isp_program_queue_depth = QUEUE_DEPTH,
+		.isp_program_request_size = sizeof(program_ring[0]),
+		.isp_program_mem = MEM_PROGRAM_RING,
+	};
+	int err;
+
+	err = chan_open(f);
+	if (err)
+		return err;
+	return chan_ioctl(f, ISP_CAPTURE_SETUP, &setup);
+}
+
+static void chan_close(struct file *f)
+{
+	rt_sync();
+	isp_channel_fops.release(&chan_inode, f);
+}
+
+static ssize_t chan_read(struct file *f, struct isp_capture_event *ev,
+			 size_t len, bool nonblock)
+{
+	f->f_flags = nonblock ? O_NONBLOCK : 0;
+	return isp_channel_fops.read(f, (char *)ev, len, NULL);
+}
+
+static struct isp_capture *chan_capture(struct file *f)
+{
+	return ((struct tegra_isp_channel *)f->private_data)->capture_data;
+}
+
+/* fill in the descriptors, a surface of MEM_BAD fails to pin */
+static struct isp_capture_req_ex entry(uint32_t capture, uint32_t capture_mem,
+				       uint32_t program, uint32_t program_mem)
+{
+	struct isp_capture_req_ex req;
+
+	memset(&req, 0, sizeof(req));
+	req.capture_req.buffer_index = capture;
+	req.program_req.buffer_index = program;
+	if (capture != SKIP)
+		capture_ring[capture].isp_pb2_mem =
+			(uint64_t)capture_mem << 32;
+	if (program != SKIP)
+		program_ring[program].isp_pb1_mem =
+			(uint64_t)program_mem << 32;
+	return req;
+}
+
+static long submit_batch(struct file *f, struct isp_capture_req_ex *reqs,
+			 uint32_t num, struct isp_capture_req_batch *batch)
+{
+	memset(batch, 0, sizeof(*batch));
+	batch->num_reqs = num;
+	batch->reqs = (uintptr_t)reqs;
+	batch->num_captures_submitted = 0xdead;
+	batch->num_programs_submitted = 0xdead;
+	return chan_ioctl(f, ISP_CAPTURE_REQUEST_BATCH, batch);
+}
+
+static bool is_event(const struct isp_capture_event *ev, uint32_t type,
+		     uint32_t buffer_index)
+{
+	return ev->type == type && ev->buffer_index == buffer_index;
+}
+
+#define CAPTURE_DONE		ISP_CAPTURE_EVENT_CAPTURE_DONE
+#define PROGRAM_DONE		ISP_CAPTURE_EVENT_PROGRAM_DONE
+#define EV_SIZE			sizeof(struct isp_capture_event)
+
+/* both halves, either half alone, completions in submission order */
+static int test_batch(void)
+{
+	struct isp_capture_req_ex reqs[4];
+	struct isp_capture_req_batch batch;
+	struct isp_capture_event ev[8];
+	struct file f;
+	int i;
+
+	rt_reset_counts();
+	CHECK(!chan_setup(&f));
+
+	reqs[0] = entry(0, MEM_SURFACE, 0, MEM_SURFACE);
+	reqs[1] = entry(1, MEM_SURFACE, SKIP, 0);
+	reqs[2] = entry(SKIP, 0, 1, MEM_SURFACE);
+	reqs[3] = entry(2, MEM_SURFACE, 2, MEM_SURFACE);
+	CHECK(!submit_batch(&f, reqs, 4, &batch));
+	CHECK(batch.num_captures_submitted == 4);
+	CHECK(batch.num_programs_submitted == 4);
+
+	rt_sync();
+	CHECK(rt.captures == 3 && rt.programs == 3);
+	CHECK(!live_mappings);
+
+	CHECK(chan_read(&f, ev, sizeof(ev), true) == 6 * EV_SIZE);
+	CHECK(is_event(&ev[0], CAPTURE_DONE, 0));
+	CHECK(is_event(&ev[1], PROGRAM_DONE, 0));
+	CHECK(is_event(&ev[2], CAPTURE_DONE, 1));
+	CHECK(is_event(&ev[3], PROGRAM_DONE, 1));
+	CHECK(is_event(&ev[4], CAPTURE_DONE, 2));
+	CHECK(is_event(&ev[5], PROGRAM_DONE, 2));
+	for (i = 1; i < 6; i++)
+		CHECK(ev[i].timestamp >= ev[i - 1].timestamp);
+
+	chan_close(&f);
+	CHECK(!rt.bad);
+	return 0;
+}
+
+/* a failing half stops the batch, the halves before it still complete */
+static int test_batch_partial(void)
+{
+	struct isp_capture_req_ex reqs[3];
+	struct isp_capture_req_batch batch;
+	struct isp_capture_event ev[8];
+	struct file f;
+
+	rt_reset_counts();
+	CHECK(!chan_setup(&f));
+	rt_set_hold(true);
+
+	/* the program half of entry 1 fails after its capture half */
+	reqs[0] = entry(0, MEM_SURFACE, 0, MEM_SURFACE);
+	reqs[1] = entry(1, MEM_SURFACE, 1, MEM_BAD);
+	reqs[2] = entry(2, MEM_SURFACE, 2, MEM_SURFACE);
+	shim_quiet = 1;
+	CHECK(submit_batch(&f, reqs, 3, &batch) == -EINVAL);
+	shim_quiet = 0;
+	CHECK(batch.num_captures_submitted == 2);
+	CHECK(batch.num_programs_submitted == 1);
+
+	rt_sync();
+	CHECK(rt.captures == 2 && rt.programs == 1);
+	CHECK(live_mappings == 3);
+
+	/* the capture half of the second entry fails, after a skipped one */
+	reqs[0] = entry(SKIP, 0, 3, MEM_SURFACE);
+	reqs[1] = entry(3, MEM_BAD, 1, MEM_SURFACE);
+	shim_quiet = 1;
+	CHECK(submit_batch(&f, reqs, 2, &batch) == -EINVAL);
+	shim_quiet = 0;
+	CHECK(batch.num_captures_submitted == 1);
+	CHECK(batch.num_programs_submitted == 1);
+
+	rt_flush();
+	CHECK(rt.captures == 2 && rt.programs == 2);
+	CHECK(!live_mappings);
+
+	CHECK(chan_read(&f, ev, sizeof(ev), true) == 4 * EV_SIZE);
+	CHECK(is_event(&ev[0], CAPTURE_DONE, 0));
+	CHECK(is_event(&ev[1], PROGRAM_DONE, 0));
+	CHECK(is_event(&ev[2], CAPTURE_DONE, 1));
+	CHECK(is_event(&ev[3], PROGRAM_DONE, 3));
+
+	chan_close(&f);
+	CHECK(!rt.bad);
+	return 0;
+}
+
+static int test_batch_limits(void)
+{
+	struct isp_capture_req_ex reqs[ISP_CAPTURE_MAX_BATCH_REQS + 1];
+	struct isp_capture_req_batch batch;
+	struct file f;
+
+	memset(reqs, 0, sizeof(reqs));
+	rt_reset_counts();
+
+	/* not set up yet */
+	CHECK(!chan_open(&f));
+	reqs[0] = entry(0, MEM_SURFACE, SKIP, 0);
+	shim_quiet = 1;
+	CHECK(submit_batch(&f, reqs, 1, &batch) == -ENODEV);
+	shim_quiet = 0;
+	CHECK(batch.num_captures_submitted == 0);
+	CHECK(batch.num_programs_submitted == 0);
+	chan_close(&f);
+
+	CHECK(!chan_setup(&f));
+	CHECK(submit_batch(&f, reqs, 0, &batch) == -EINVAL);
+	CHECK(submit_batch(&f, reqs, ISP_CAPTURE_MAX_BATCH_REQS + 1,
+			   &batch) == -EINVAL);
+	CHECK(submit_batch(&f, NULL, 1, &batch) == -EFAULT);
+	CHECK(chan_ioctl(&f, ISP_CAPTURE_REQUEST_BATCH, NULL) == -EFAULT);
+
+	/* a slot still in use by the RTCPU */
+	rt_set_hold(true);
+	reqs[0] = entry(0, MEM_SURFACE, SKIP, 0);
+	reqs[1] = entry(0, MEM_SURFACE, SKIP, 0);
+	shim_quiet = 1;
+	CHECK(submit_batch(&f, reqs, 2, &batch) == -EBUSY);
+	shim_quiet = 0;
+	CHECK(batch.num_captures_submitted == 1);
+	CHECK(batch.num_programs_submitted == 1);
+	rt_flush();
+
+	rt_sync();
+	CHECK(rt.captures == 1 && !rt.programs);
+	CHECK(!live_mappings);
+	chan_close(&f);
+	CHECK(!rt.bad);
+	return 0;
+}
+
+static int test_events_nonblock(void)
+{
+	struct isp_capture_req_ex reqs[3];
+	struct isp_capture_req_batch batch;
+	struct isp_capture_event ev[4];
+	struct file f;
+
+	CHECK(!chan_setup(&f));
+	CHECK(!isp_channel_fops.poll(&f, NULL));
+	CHECK(chan_read(&f, ev, sizeof(ev), true) == -EAGAIN);
+	CHECK(chan_read(&f, ev, EV_SIZE - 1, true) == -EINVAL);
+
+	reqs[0] = entry(0, MEM_SURFACE, SKIP, 0);
+	reqs[1] = entry(1, MEM_SURFACE, SKIP, 0);
+	reqs[2] = entry(2, MEM_SURFACE, SKIP, 0);
+	CHECK(!submit_batch(&f, reqs, 3, &batch));
+	rt_sync();
+
+	CHECK(isp_channel_fops.poll(&f, NULL) == (POLLIN | POLLRDNORM));
+
+	/* a fault consumes nothing */
+	CHECK(chan_read(&f, NULL, sizeof(ev), true) == -EFAULT);
+
+	/* short buffers get whole events */
+	CHECK(chan_read(&f, ev, 2 * EV_SIZE + 3, true) == 2 * EV_SIZE);
+	CHECK(is_event(&ev[0], CAPTURE_DONE, 0));
+	CHECK(is_event(&ev[1], CAPTURE_DONE, 1));
+	CHECK(chan_read(&f, ev, sizeof(ev), true) == EV_SIZE);
+	CHECK(is_event(&ev[0], CAPTURE_DONE, 2));
+	CHECK(chan_read(&f, ev, sizeof(ev), true) == -EAGAIN);
+	CHECK(!isp_channel_fops.poll(&f, NULL));
+
+	chan_close(&f);
+	return 0;
+}
+
+struct reader {
+	struct file *f;
+	struct isp_capture_event ev[2];
+	ssize_t ret;
+	int *sigpending;
+};
+
+static void *reader_thread(void *arg)
+{
+	struct reader *r = arg;
+
+	__atomic_store_n(&r->sigpending, &shim_sigpending, __ATOMIC_SEQ_CST);
+	r->ret = chan_read(r->f, r->ev, sizeof(r->ev), false);
+	return NULL;
+}
+
+static int test_events_blocking(void)
+{
+	struct isp_capture_req_ex req;
+	struct isp_capture_req_batch batch;
+	struct reader r = { 0 };
+	pthread_t t;
+	struct file f;
+
+	CHECK(!chan_setup(&f));
+	r.f = &f;
+
+	/* a completion wakes the reader */
+	rt_set_hold(true);
+	req = entry(1, MEM_SURFACE, SKIP, 0);
+	CHECK(!submit_batch(&f, &req, 1, &batch));
+	rt_sync();
+	pthread_create(&t, NULL, reader_thread, &r);
+	usleep(10000);
+	rt_flush();
+	pthread_join(t, NULL);
+	CHECK(r.ret == EV_SIZE);
+	CHECK(is_event(&r.ev[0], CAPTURE_DONE, 1));
+
+	/* so does a signal */
+	r.sigpending = NULL;
+	pthread_create(&t, NULL, reader_thread, &r);
+	while (!__atomic_load_n(&r.sigpending, __ATOMIC_SEQ_CST))
+		usleep(1000);
+	usleep(10000);
+	__atomic_store_n(r.sigpending, 1, __ATOMIC_SEQ_CST);
+	wake_up(&chan_capture(&f)->events_wq);
+	pthread_join(t, NULL);
+	CHECK(r.ret == -ERESTARTSYS);
+
+	chan_close(&f);
+	return 0;
+}
+
+#define OVERRUN_REQS		(ISP_CAPTURE_EVENT_RING_SIZE + 44)
+
+/* an overrun is reported once the events kept have been read */
+static int test_events_overrun(void)
+{
+	static struct isp_capture_event ev[OVERRUN_REQS];
+	struct isp_capture_req_ex reqs[QUEUE_DEPTH];
+	struct isp_capture_req_batch batch;
+	struct file f;
+	uint32_t i;
+
+	CHECK(!chan_setup(&f));
+	for (i = 0; i < QUEUE_DEPTH; i++)
+		reqs[i] = entry(i, MEM_SURFACE, SKIP, 0);
+	for (i = 0; i < OVERRUN_REQS; i += QUEUE_DEPTH) {
+		CHECK(!submit_batch(&f, reqs, QUEUE_DEPTH, &batch));
+		rt_sync();
+	}
+
+	CHECK(isp_channel_fops.poll(&f, NULL) ==
+	      (POLLIN | POLLRDNORM | POLLERR));
+	CHECK(chan_read(&f, ev, sizeof(ev), true) ==
+	      ISP_CAPTURE_EVENT_RING_SIZE * EV_SIZE);
+	for (i = 0; i < ISP_CAPTURE_EVENT_RING_SIZE; i++)
+		CHECK(is_event(&ev[i], CAPTURE_DONE, i % QUEUE_DEPTH));
+
+	CHECK(isp_channel_fops.poll(&f, NULL) == POLLERR);
+	CHECK(chan_read(&f, ev, sizeof(ev), true) == -EOVERFLOW);
+	CHECK(chan_read(&f, ev, sizeof(ev), true) == -EAGAIN);
+	CHECK(!isp_channel_fops.poll(&f, NULL));
+
+	chan_close(&f);
+	return 0;
+}
+
+/* pending requests are dropped by a reset, which is an event itself */
+static int test_events_reset(void)
+{
+	struct isp_capture_req_ex reqs[2];
+	struct isp_capture_req_batch batch;
+	struct isp_capture_event ev[4];
+	uint32_t flags = 0;
+	struct file f;
+
+	rt_reset_counts();
+	CHECK(!chan_setup(&f));
+	rt_set_hold(true);
+	reqs[0] = entry(0, MEM_SURFACE, 0, MEM_SURFACE);
+	reqs[1] = entry(1, MEM_SURFACE, SKIP, 0);
+	CHECK(!submit_batch(&f, reqs, 2, &batch));
+	rt_sync();
+	CHECK(live_mappings == 3);
+
+	CHECK(!chan_ioctl(&f, ISP_CAPTURE_RESET, &flags));
+	CHECK(rt.dropped == 3);
+	CHECK(!live_mappings);
+	CHECK(chan_read(&f, ev, sizeof(ev), true) == EV_SIZE);
+	CHECK(is_event(&ev[0], ISP_CAPTURE_EVENT_RESET, U32_MAX));
+
+	/* the slots are free again */
+	rt_set_hold(false);
+	reqs[0] = entry(0, MEM_SURFACE, 0, MEM_SURFACE);
+	CHECK(!submit_batch(&f, reqs, 1, &batch));
+	rt_sync();
+	CHECK(chan_read(&f, ev, sizeof(ev), true) == 2 * EV_SIZE);
+	CHECK(is_event(&ev[0], CAPTURE_DONE, 0));
+	CHECK(is_event(&ev[1], PROGRAM_DONE, 0));
+
+	chan_close(&f);
+	CHECK(!rt.bad);
+	return 0;
+}
+
+/* events left from a released channel are not seen after a new setup */
+static int test_events_setup(void)
+{
+	struct isp_capture_setup setup = {
+		.channel_flags = 1,
+		.queue_depth = QUEUE_DEPTH,
+		.request_size = sizeof(capture_ring[0]),
+		.mem = MEM_CAPTURE_RING,
+		.isp_program_queue_depth = QUEUE_DEPTH,
+		.isp_program_request_size = sizeof(program_ring[0]),
+		.isp_program_mem = MEM_PROGRAM_RING,
+	};
+	struct isp_capture_req_ex req;
+	struct isp_capture_req_batch batch;
+	struct isp_capture_event ev[2];
+	uint32_t flags = 0;
+	struct file f;
+
+	CHECK(!chan_setup(&f));
+	req = entry(0, MEM_SURFACE, SKIP, 0);
+	CHECK(!submit_batch(&f, &req, 1, &batch));
+	rt_sync();
+	CHECK(isp_channel_fops.poll(&f, NULL) & POLLIN);
+
+	CHECK(!chan_ioctl(&f, ISP_CAPTURE_RELEASE, &flags));
+	CHECK(!chan_ioctl(&f, ISP_CAPTURE_SETUP, &setup));
+	CHECK(!isp_channel_fops.poll(&f, NULL));
+	CHECK(chan_read(&f, ev, sizeof(ev), true) == -EAGAIN);
+
+	chan_close(&f);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	rt_start();
+	if (isp_channel_drv_register(&isp_pdev, &isp_ops)) {
+		fprintf(stderr, "isp_channel_drv_register failed\n");
+		return 1;
+	}
+
+	test_batch();
+	test_batch_partial();
+	test_batch_limits();
+	test_events_nonblock();
+	test_events_blocking();
+	test_events_overrun();
+	test_events_reset();
+	test_events_setup();
+
+	isp_channel_drv_unregister(&isp_pdev.dev);
+	rt_stop();
+	if (shim_warnings)
+		failures++;
+	printf("%s\n", failures ? "FAIL" : "PASS");
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,610 @@
+/*
+ * Userspace stand-ins for the kernel facilities used by the ISP capture
+ * channel driver (drivers/media/platform/tegra/camera/isp). Locks, wait
+ * queues and completions are backed by pthreads so that the RTCPU
+ * callbacks run on another thread, as from the capture IVC worker. The
+ * capture IVC transport, the buffer table and the devices are provided
+ * by the test.
+ *
+ * Copyright (c) 2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#ifndef _ISP_SHIM_H
+#define _ISP_SHIM_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <asm/ioctl.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int32_t s32;
+typedef int64_t s64;
+typedef uint32_t __u32;
+typedef uint64_t __u64;
+typedef uint64_t dma_addr_t;
+typedef unsigned int gfp_t;
+
+#define __user
+#define __iomem
+#define __init
+#define __exit
+#define __aligned(n)		__attribute__((aligned(n)))
+#define __packed		__attribute__((packed))
+#define likely(x)		__builtin_expect(!!(x), 1)
+#define unlikely(x)		__builtin_expect(!!(x), 0)
+
+#define U32_C(x)		x##U
+#define U32_MAX			UINT32_MAX
+
+#define EXPORT_SYMBOL(sym)	extern typeof(sym) sym
+#define THIS_MODULE		NULL
+#define subsys_initcall(fn) \
+	static int (*shim_initcall)(void) __attribute__((unused)) = fn
+#define module_exit(fn) \
+	static void (*shim_exitcall)(void) __attribute__((unused)) = fn
+
+#define ARRAY_SIZE(a)		(sizeof(a) / sizeof((a)[0]))
+#define BUILD_BUG_ON(cond)	_Static_assert(!(cond), #cond)
+#define speculation_barrier()	__atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define div64_u64(a, b)		((a) / (b))
+
+#define MAX_ERRNO		4095
+#define ERESTARTSYS		512
+#define ENOIOCTLCMD		515
+
+static inline void *ERR_PTR(long error)
+{
+	return (void *)error;
+}
+
+static inline long PTR_ERR(const void *ptr)
+{
+	return (long)ptr;
+}
+
+static inline bool IS_ERR(const void *ptr)
+{
+	return (unsigned long)ptr >= (unsigned long)-MAX_ERRNO;
+}
+
+static inline bool IS_ERR_OR_NULL(const void *ptr)
+{
+	return !ptr || IS_ERR(ptr);
+}
+
+/* set by the test to silence expected errors */
+extern int shim_quiet;
+extern unsigned int shim_warnings;
+
+static inline void shim_log(bool show, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (!show)
+		return;
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+}
+
+#define pr_err(fmt, ...)	shim_log(!shim_quiet, fmt, ##__VA_ARGS__)
+#define dev_err(dev, fmt, ...) \
+	do { (void)(dev); pr_err(fmt, ##__VA_ARGS__); } while (0)
+#define dev_dbg(dev, fmt, ...)	do { (void)(dev); } while (0)
+
+#define WARN_ON(cond) ({ \
+	int __c = !!(cond); \
+	if (__c) { \
+		__atomic_fetch_add(&shim_warnings, 1, __ATOMIC_SEQ_CST); \
+		pr_err("WARNING at %s:%d: %s\n", __func__, __LINE__, \
+		       #cond); \
+	} \
+	__c; \
+})
+
+/*
+ * Memory. User pointers are plain pointers, a NULL one faults.
+ */
+#define GFP_KERNEL		0
+
+#define PAGE_SHIFT		12
+#define PAGE_SIZE		(1UL << PAGE_SHIFT)
+#define PAGE_MASK		(~(PAGE_SIZE - 1))
+
+#define kzalloc(size, gfp)	calloc(1, size)
+#define kcalloc(n, size, gfp)	calloc(n, size)
+#define kfree(p)		free(p)
+#define vzalloc(size)		calloc(1, size)
+#define vfree(p)		free(p)
+
+static inline unsigned long copy_from_user(void *to, const void *from,
+					   unsigned long n)
+{
+	if (!from)
+		return n;
+	memcpy(to, from, n);
+	return 0;
+}
+
+static inline unsigned long copy_to_user(void *to, const void *from,
+					 unsigned long n)
+{
+	if (!to)
+		return n;
+	memcpy(to, from, n);
+	return 0;
+}
+
+static inline void *memdup_user(const void *src, size_t len)
+{
+	void *p;
+
+	if (!src)
+		return ERR_PTR(-EFAULT);
+	p = malloc(len);
+	if (!p)
+		return ERR_PTR(-ENOMEM);
+	memcpy(p, src, len);
+	return p;
+}
+
+static inline u64 __raw_readq(const volatile void *addr)
+{
+	return *(const volatile u64 *)addr;
+}
+
+static inline void __raw_writeq(u64 val, volatile void *addr)
+{
+	*(volatile u64 *)addr = val;
+}
+
+/*
+ * Time, one jiffy is one millisecond
+ */
+#define HZ			1000
+#define msecs_to_jiffies(ms)	((long)(ms))
+
+static inline u64 ktime_get_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#define arch_counter_get_cntvct()	ktime_get_ns()
+
+static inline void shim_deadline(struct timespec *ts, long j)
+{
+	clock_gettime(CLOCK_REALTIME, ts);
+	ts->tv_sec += j / 1000;
+	ts->tv_nsec += (j % 1000) * 1000000L;
+	if (ts->tv_nsec >= 1000000000L) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000L;
+	}
+}
+
+static inline long shim_left(const struct timespec *ts)
+{
+	struct timespec now;
+	long ms;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	ms = (ts->tv_sec - now.tv_sec) * 1000 +
+		(ts->tv_nsec - now.tv_nsec) / 1000000L;
+	return ms > 0 ? ms : 1;
+}
+
+/*
+ * Locks and atomics
+ */
+struct mutex {
+	pthread_mutex_t lock;
+};
+
+#define DEFINE_MUTEX(m)		struct mutex m = { PTHREAD_MUTEX_INITIALIZER }
+#define mutex_init(m)		pthread_mutex_init(&(m)->lock, NULL)
+#define mutex_lock(m)		pthread_mutex_lock(&(m)->lock)
+#define mutex_lock_interruptible(m) pthread_mutex_lock(&(m)->lock)
+#define mutex_unlock(m)		pthread_mutex_unlock(&(m)->lock)
+
+typedef struct {
+	pthread_mutex_t lock;
+} spinlock_t;
+
+#define spin_lock_init(l)	pthread_mutex_init(&(l)->lock, NULL)
+#define spin_lock_irq(l)	pthread_mutex_lock(&(l)->lock)
+#define spin_unlock_irq(l)	pthread_mutex_unlock(&(l)->lock)
+#define spin_lock_irqsave(l, flags) \
+	do { (flags) = 0; pthread_mutex_lock(&(l)->lock); } while (0)
+#define spin_unlock_irqrestore(l, flags) \
+	do { (void)(flags); pthread_mutex_unlock(&(l)->lock); } while (0)
+
+typedef struct {
+	int counter;
+} atomic_t;
+
+#define atomic_set(v, i) \
+	__atomic_store_n(&(v)->counter, (i), __ATOMIC_SEQ_CST)
+#define atomic_read(v)	__atomic_load_n(&(v)->counter, __ATOMIC_SEQ_CST)
+#define atomic_xchg(v, i) \
+	__atomic_exchange_n(&(v)->counter, (i), __ATOMIC_SEQ_CST)
+
+/*
+ * The task. The test raises a signal on a thread through the address of
+ * its shim_sigpending, then wakes the queue the thread sleeps on.
+ */
+#define TASK_INTERRUPTIBLE	1
+#define current			NULL
+
+extern __thread int shim_sigpending;
+
+#define signal_pending(p) \
+	((void)(p), __atomic_load_n(&shim_sigpending, __ATOMIC_SEQ_CST))
+
+/*
+ * Wait queues. Every wake up bumps a sequence number, a waiter sleeps
+ * until it changes from the value seen in prepare_to_wait().
+ */
+typedef struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	unsigned long seq;
+} wait_queue_head_t;
+
+static inline void init_waitqueue_head(wait_queue_head_t *wq)
+{
+	pthread_mutex_init(&wq->lock, NULL);
+	pthread_cond_init(&wq->cond, NULL);
+	wq->seq = 0;
+}
+
+static inline void wake_up(wait_queue_head_t *wq)
+{
+	pthread_mutex_lock(&wq->lock);
+	wq->seq++;
+	pthread_cond_broadcast(&wq->cond);
+	pthread_mutex_unlock(&wq->lock);
+}
+
+struct wait_queue_entry {
+	wait_queue_head_t *wq;
+	unsigned long seq;
+};
+
+/* the entry schedule() sleeps on */
+extern __thread struct wait_queue_entry *shim_cur_wait;
+
+#define DEFINE_WAIT(name)	struct wait_queue_entry name = { NULL, 0 }
+
+static inline void prepare_to_wait(wait_queue_head_t *wq,
+				   struct wait_queue_entry *wait, int state)
+{
+	pthread_mutex_lock(&wq->lock);
+	wait->wq = wq;
+	wait->seq = wq->seq;
+	pthread_mutex_unlock(&wq->lock);
+	shim_cur_wait = wait;
+}
+
+static inline void finish_wait(wait_queue_head_t *wq,
+			       struct wait_queue_entry *wait)
+{
+	shim_cur_wait = NULL;
+}
+
+static inline void schedule(void)
+{
+	struct wait_queue_entry *wait = shim_cur_wait;
+	wait_queue_head_t *wq = wait->wq;
+
+	pthread_mutex_lock(&wq->lock);
+	while (wq->seq == wait->seq)
+		pthread_cond_wait(&wq->cond, &wq->lock);
+	pthread_mutex_unlock(&wq->lock);
+}
+
+struct completion {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	unsigned int done;
+};
+
+static inline void init_completion(struct completion *x)
+{
+	pthread_mutex_init(&x->lock, NULL);
+	pthread_cond_init(&x->cond, NULL);
+	x->done = 0;
+}
+
+static inline void complete(struct completion *x)
+{
+	pthread_mutex_lock(&x->lock);
+	x->done++;
+	pthread_cond_broadcast(&x->cond);
+	pthread_mutex_unlock(&x->lock);
+}
+
+static inline bool try_wait_for_completion(struct completion *x)
+{
+	bool ret;
+
+	pthread_mutex_lock(&x->lock);
+	ret = x->done != 0;
+	if (ret)
+		x->done--;
+	pthread_mutex_unlock(&x->lock);
+	return ret;
+}
+
+static inline long wait_for_completion_killable_timeout(struct completion *x,
+							long timeout)
+{
+	struct timespec ts;
+	long left = 0;
+	int r = 0;
+
+	shim_deadline(&ts, timeout);
+	pthread_mutex_lock(&x->lock);
+	while (!x->done && r != ETIMEDOUT)
+		r = pthread_cond_timedwait(&x->cond, &x->lock, &ts);
+	if (x->done) {
+		x->done--;
+		left = shim_left(&ts);
+	}
+	pthread_mutex_unlock(&x->lock);
+	return left;
+}
+
+#define wait_for_completion_timeout(x, timeout) \
+	((unsigned long)wait_for_completion_killable_timeout(x, timeout))
+
+static inline int wait_for_completion_killable(struct completion *x)
+{
+	pthread_mutex_lock(&x->lock);
+	while (!x->done)
+		pthread_cond_wait(&x->cond, &x->lock);
+	x->done--;
+	pthread_mutex_unlock(&x->lock);
+	return 0;
+}
+
+/*
+ * kfifo, for one writer and one reader as in the kernel. The indexes
+ * are published with release/acquire in place of the kernel's barriers.
+ */
+#define DECLARE_KFIFO(fifo, type, size) \
+	struct { \
+		unsigned int in; \
+		unsigned int out; \
+		type buf[size]; \
+	} fifo
+
+#define INIT_KFIFO(fifo)	((fifo).in = 0, (fifo).out = 0)
+
+#define kfifo_reset(fifo) do { \
+	__atomic_store_n(&(fifo)->in, 0, __ATOMIC_RELEASE); \
+	__atomic_store_n(&(fifo)->out, 0, __ATOMIC_RELEASE); \
+} while (0)
+
+#define kfifo_len(fifo) \
+	(__atomic_load_n(&(fifo)->in, __ATOMIC_ACQUIRE) - \
+	 __atomic_load_n(&(fifo)->out, __ATOMIC_ACQUIRE))
+
+#define kfifo_is_empty(fifo)	(kfifo_len(fifo) == 0)
+
+#define kfifo_put(fifo, val) ({ \
+	typeof(fifo) __f = (fifo); \
+	unsigned int __in = __atomic_load_n(&__f->in, __ATOMIC_RELAXED); \
+	int __ok = __in - __atomic_load_n(&__f->out, __ATOMIC_ACQUIRE) < \
+		ARRAY_SIZE(__f->buf); \
+	if (__ok) { \
+		__f->buf[__in % ARRAY_SIZE(__f->buf)] = (val); \
+		__atomic_store_n(&__f->in, __in + 1, __ATOMIC_RELEASE); \
+	} \
+	__ok; \
+})
+
+#define kfifo_to_user(fifo, to, len, copied) ({ \
+	typeof(fifo) __f = (fifo); \
+	size_t __esize = sizeof(__f->buf[0]); \
+	unsigned int __out = __atomic_load_n(&__f->out, __ATOMIC_RELAXED); \
+	unsigned int __n = __atomic_load_n(&__f->in, __ATOMIC_ACQUIRE) - \
+		__out; \
+	unsigned int __i; \
+	int __ret = 0; \
+	if ((len) / __esize < __n) \
+		__n = (len) / __esize; \
+	for (__i = 0; __i < __n && !__ret; __i++) \
+		if (copy_to_user((char *)(to) + __i * __esize, \
+				 &__f->buf[(__out + __i) % \
+					   ARRAY_SIZE(__f->buf)], __esize)) \
+			__ret = -EFAULT; \
+	if (__ret) \
+		__n = 0; \
+	__atomic_store_n(&__f->out, __out + __n, __ATOMIC_RELEASE); \
+	*(copied) = __n * __esize; \
+	__ret; \
+})
+
+/*
+ * Devices, character devices and files
+ */
+#define MINORBITS		20
+#define MKDEV(ma, mi)		(((ma) << MINORBITS) | (mi))
+
+struct device {
+	const char *name;
+};
+
+struct platform_device {
+	struct device dev;
+};
+
+struct device_node;
+struct module;
+struct class;
+
+struct device_node *of_find_node_by_path(const char *path);
+int of_device_is_available(const struct device_node *np);
+struct platform_device *of_find_device_by_node(struct device_node *np);
+
+static inline struct device *device_create(struct class *class,
+					   struct device *parent, dev_t devt,
+					   void *drvdata, const char *fmt, ...)
+{
+	return parent;
+}
+
+#define device_destroy(class, devt)	((void)(devt))
+#define class_create(owner, name)	((struct class *)NULL)
+#define class_destroy(class)		do { } while (0)
+#define register_chrdev(major, name, fops)	((void)(fops), 0)
+#define unregister_chrdev(major, name)	do { } while (0)
+
+struct inode {
+	unsigned int minor;
+	void *i_private;
+};
+
+#define iminor(inode)		((inode)->minor)
+
+struct file {
+	void *private_data;
+	unsigned int f_flags;
+};
+
+struct poll_table_struct;
+
+#define poll_wait(filp, wq, p)	do { } while (0)
+
+struct file_operations {
+	struct module *owner;
+	loff_t (*llseek)(struct file *filp, loff_t off, int whence);
+	ssize_t (*read)(struct file *filp, char *buf, size_t len,
+			loff_t *off);
+	unsigned int (*poll)(struct file *filp,
+			     struct poll_table_struct *wait);
+	long (*unlocked_ioctl)(struct file *filp, unsigned int cmd,
+			       unsigned long arg);
+	long (*compat_ioctl)(struct file *filp, unsigned int cmd,
+			     unsigned long arg);
+	int (*open)(struct inode *inode, struct file *filp);
+	int (*release)(struct inode *inode, struct file *filp);
+};
+
+static inline loff_t no_llseek(struct file *filp, loff_t off, int whence)
+{
+	return -ESPIPE;
+}
+
+#define nonseekable_open(inode, filp)	0
+
+/* debugfs is not there, so nothing is created under it */
+struct dentry;
+
+struct seq_file {
+	void *private;
+};
+
+static inline void seq_printf(struct seq_file *s, const char *fmt, ...)
+{
+}
+
+#define single_open(f, show, data)	((void)(show), 0)
+
+static inline ssize_t seq_read(struct file *filp, char *buf, size_t len,
+			       loff_t *off)
+{
+	return 0;
+}
+
+static inline loff_t seq_lseek(struct file *filp, loff_t off, int whence)
+{
+	return 0;
+}
+
+static inline int single_release(struct inode *inode, struct file *filp)
+{
+	return 0;
+}
+
+#define S_IRUGO				0444
+#define debugfs_create_dir(name, parent)	((struct dentry *)NULL)
+#define debugfs_create_file(name, mode, parent, data, fops) \
+	((void)(data), (void)(fops), (struct dentry *)NULL)
+#define debugfs_remove(d)		do { } while (0)
+#define debugfs_remove_recursive(d)	do { } while (0)
+
+/*
+ * DMA, host memory is coherent
+ */
+enum dma_data_direction {
+	DMA_BIDIRECTIONAL = 0,
+	DMA_TO_DEVICE = 1,
+	DMA_FROM_DEVICE = 2,
+};
+
+static inline void *dma_alloc_coherent(struct device *dev, size_t size,
+				       dma_addr_t *handle, gfp_t gfp)
+{
+	void *va = calloc(1, size);
+
+	*handle = (uintptr_t)va;
+	return va;
+}
+
+#define dma_free_coherent(dev, size, va, handle)	free(va)
+#define dma_sync_single_range_for_cpu(dev, addr, off, size, dir) \
+	do { } while (0)
+
+struct dma_buf;
+
+void *dma_buf_kmap(struct dma_buf *dmabuf, unsigned long page_num);
+void dma_buf_kunmap(struct dma_buf *dmabuf, unsigned long page_num,
+		    void *vaddr);
+
+/*
+ * Host1x, the syncpoints are handed out by the channel ops
+ */
+static inline int nvhost_syncpt_read_ext_check(struct platform_device *dev,
+					       u32 id, u32 *val)
+{
+	*val = 0;
+	return 0;
+}
+
+#define nvhost_eventlib_log_submit(pdev, id, thresh, ts)	do { } while (0)
+#define nvhost_module_add_client(pdev, priv)	0
+#define nvhost_module_remove_client(pdev, priv)	do { } while (0)
+#define nvhost_module_busy(pdev)		0
+#define nvhost_module_idle(pdev)		do { } while (0)
+
+#define tegra_platform_is_sim()		0
+
+#endif /* _ISP_SHIM_H */
@@ -0,0 +1,1136 @@
+/*
+ * tipc_loopback - unit test for the Trusty IPC driver
+ * (drivers/trusty/trusty-ipc.c), built in userspace against tipc_shim.h
+ * and a virtio loopback standing in for the secure side.
+ *
+ * Copyright (c) 2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Example Usage:
+ *	tipc_loopback			run the unit tests
+ *
+ * The secure side thread takes messages off the tx virtqueue and answers
+ * on the rx virtqueue, raising the queue callbacks as the virtio transport
+ * does. It serves one "echo" port. Plain messages are echoed back. For a
+ * message with memory references it maps every listed page through its
+ * encoded address, hashes the shared bytes, inverts the writable ones,
+ * and answers with the ids and hashes. It then releases the references
+ * right away, or holds them until the test asks. User pages and dma-bufs
+ * are counted so that the tests can check what stays pinned.
+ */
+
+#include "tipc_shim.h"
+
+#include "trusty-ipc.c"
+
+int shim_quiet;
+unsigned int shim_warnings;
+
+static int failures;
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s:%d: check failed: %s\n", \
+				__func__, __LINE__, #cond); \
+			failures++; \
+			return -1; \
+		} \
+	} while (0)
+
+/*
+ * User pages, pinned by get_user_pages_fast()
+ */
+
+static struct {
+	pthread_mutex_t lock;
+	struct page *pages;
+	int pinned;
+	int dirtied;
+	/* pages to pin before faulting, -1 for no fault */
+	int fault_after;
+} pg = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.fault_after = -1,
+};
+
+int get_user_pages_fast(unsigned long start, int nr_pages, int write,
+			struct page **pages)
+{
+	struct page *p;
+	int i;
+
+	pthread_mutex_lock(&pg.lock);
+	for (i = 0; i < nr_pages; i++) {
+		void *virt = (void *)(start + i * PAGE_SIZE);
+
+		if (!pg.fault_after)
+			break;
+		if (pg.fault_after > 0)
+			pg.fault_after--;
+
+		for (p = pg.pages; p && p->virt != virt; p = p->next)
+			;
+		if (!p) {
+			p = calloc(1, sizeof(*p));
+			p->virt = virt;
+			p->next = pg.pages;
+			pg.pages = p;
+		}
+		p->count++;
+		pg.pinned++;
+		pages[i] = p;
+	}
+	pthread_mutex_unlock(&pg.lock);
+
+	return i ? i : -EFAULT;
+}
+
+void put_page(struct page *page)
+{
+	struct page **pp;
+
+	pthread_mutex_lock(&pg.lock);
+	pg.pinned--;
+	if (!--page->count) {
+		for (pp = &pg.pages; *pp != page; pp = &(*pp)->next)
+			;
+		*pp = page->next;
+		free(page);
+	}
+	pthread_mutex_unlock(&pg.lock);
+}
+
+int set_page_dirty_lock(struct page *page)
+{
+	pthread_mutex_lock(&pg.lock);
+	page->dirty++;
+	pg.dirtied++;
+	pthread_mutex_unlock(&pg.lock);
+	return 1;
+}
+
+/*
+ * One dma-buf. Its pages sit in three scatterlist entries that the IOMMU
+ * maps as one, so nents is 1 and orig_nents is 3.
+ */
+
+#define LB_DMABUF_FD		42
+#define LB_DMABUF_PAGES		8
+
+static struct {
+	struct dma_buf buf;
+	u8 *mem;
+	struct page pages[LB_DMABUF_PAGES];
+	struct scatterlist sgl[3];
+	struct sg_table sgt;
+	int refs;
+	int attached;
+	int mapped;
+} dbuf;
+
+struct dma_buf *dma_buf_get(int fd)
+{
+	if (fd != LB_DMABUF_FD || !dbuf.mem)
+		return ERR_PTR(-EBADF);
+	dbuf.refs++;
+	return &dbuf.buf;
+}
+
+void dma_buf_put(struct dma_buf *dmabuf)
+{
+	dbuf.refs--;
+}
+
+struct dma_buf_attachment *dma_buf_attach(struct dma_buf *dmabuf,
+					  struct device *dev)
+{
+	struct dma_buf_attachment *attach = calloc(1, sizeof(*attach));
+
+	attach->dmabuf = dmabuf;
+	attach->dev = dev;
+	dbuf.attached++;
+	return attach;
+}
+
+void dma_buf_detach(struct dma_buf *dmabuf,
+		    struct dma_buf_attachment *attach)
+{
+	dbuf.attached--;
+	free(attach);
+}
+
+struct sg_table *dma_buf_map_attachment(struct dma_buf_attachment *attach,
+					enum dma_data_direction direction)
+{
+	static const unsigned int split[] = { 0, 2, 5, LB_DMABUF_PAGES };
+	unsigned int i;
+
+	memset(dbuf.sgl, 0, sizeof(dbuf.sgl));
+	for (i = 0; i < ARRAY_SIZE(dbuf.sgl); i++) {
+		dbuf.sgl[i].page = &dbuf.pages[split[i]];
+		dbuf.sgl[i].length = (split[i + 1] - split[i]) * PAGE_SIZE;
+	}
+	dbuf.sgl[ARRAY_SIZE(dbuf.sgl) - 1].end = true;
+	dbuf.sgt.sgl = dbuf.sgl;
+	dbuf.sgt.orig_nents = ARRAY_SIZE(dbuf.sgl);
+	dbuf.sgt.nents = 1;
+	dbuf.mapped++;
+	return &dbuf.sgt;
+}
+
+void dma_buf_unmap_attachment(struct dma_buf_attachment *attach,
+			      struct sg_table *sgt,
+			      enum dma_data_direction direction)
+{
+	dbuf.mapped--;
+}
+
+static void dbuf_init(void)
+{
+	unsigned int i;
+
+	dbuf.mem = aligned_alloc(PAGE_SIZE, LB_DMABUF_PAGES * PAGE_SIZE);
+	dbuf.buf.size = LB_DMABUF_PAGES * PAGE_SIZE;
+	for (i = 0; i < LB_DMABUF_PAGES; i++)
+		dbuf.pages[i].virt = dbuf.mem + i * PAGE_SIZE;
+	for (i = 0; i < LB_DMABUF_PAGES * PAGE_SIZE; i++)
+		dbuf.mem[i] = i * 7;
+}
+
+/*
+ * Trusty core: memory is encoded as its address, plus a read-only bit
+ */
+
+int is_trusty_dev_enabled(void)
+{
+	return 1;
+}
+
+int trusty_encode_page_info(struct ns_mem_page_info *inf,
+			    struct page *page, pgprot_t pgprot)
+{
+	inf->attr = (u64)(uintptr_t)page->virt |
+		    (pgprot_val(pgprot) & SHIM_PAGE_RDONLY);
+	return 0;
+}
+
+/*
+ * Virtio loopback and the secure side
+ */
+
+#define LB_VRING_SIZE		8
+#define LB_ECHO_ADDR		0x200
+#define LB_MAX_HELD		64
+
+enum { LB_RX, LB_TX };
+
+enum lb_cmd {
+	LB_CMD_NONE,
+	LB_CMD_ONLINE,
+	LB_CMD_RELEASE,
+};
+
+struct lb_buf {
+	void *va;
+	unsigned int len;
+	void *token;
+};
+
+struct lb_ring {
+	struct lb_buf bufs[LB_VRING_SIZE];
+	unsigned int head;
+	unsigned int tail;
+};
+
+struct lb_vq {
+	struct virtqueue vq;
+	struct lb_ring avail;	/* added by the driver */
+	struct lb_ring used;	/* returned to the driver */
+};
+
+/* answer to a message with memory references */
+struct lb_shm_reply {
+	u32 status;
+	u32 shm_cnt;
+	u64 id[TIPC_MAX_SHM_CNT];
+	u64 hash[TIPC_MAX_SHM_CNT];
+};
+
+struct lb_held {
+	u32 target;
+	u64 id;
+};
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t thread;
+	bool stop;
+
+	struct virtio_device vdev;
+	struct lb_vq vqs[2];
+	bool alive;
+	bool busy;
+	enum lb_cmd cmd;
+
+	/* hold references until LB_CMD_RELEASE */
+	bool hold_shm;
+	struct lb_held held[LB_MAX_HELD];
+	unsigned int nheld;
+
+	unsigned int shm_refs;
+	unsigned int discs;
+	unsigned int bad;
+} lb = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
+static bool ring_empty(const struct lb_ring *r)
+{
+	return r->head == r->tail;
+}
+
+static bool ring_push(struct lb_ring *r, const struct lb_buf *b)
+{
+	if (r->head - r->tail == LB_VRING_SIZE)
+		return false;
+	r->bufs[r->head++ % LB_VRING_SIZE] = *b;
+	return true;
+}
+
+static struct lb_buf ring_pop(struct lb_ring *r)
+{
+	return r->bufs[r->tail++ % LB_VRING_SIZE];
+}
+
+static struct lb_vq *to_lb_vq(struct virtqueue *vq)
+{
+	return container_of(vq, struct lb_vq, vq);
+}
+
+static int lb_add_buf(struct virtqueue *vq, struct scatterlist *sg,
+		      void *data)
+{
+	struct lb_buf b = { sg->virt, sg->length, data };
+	bool ok;
+
+	pthread_mutex_lock(&lb.lock);
+	ok = ring_push(&to_lb_vq(vq)->avail, &b);
+	pthread_mutex_unlock(&lb.lock);
+	return ok ? 0 : -ENOSPC;
+}
+
+int virtqueue_add_outbuf(struct virtqueue *vq, struct scatterlist sg[],
+			 unsigned int num, void *data, gfp_t gfp)
+{
+	return lb_add_buf(vq, sg, data);
+}
+
+int virtqueue_add_inbuf(struct virtqueue *vq, struct scatterlist sg[],
+			unsigned int num, void *data, gfp_t gfp)
+{
+	return lb_add_buf(vq, sg, data);
+}
+
+bool virtqueue_kick_prepare(struct virtqueue *vq)
+{
+	return true;
+}
+
+bool virtqueue_notify(struct virtqueue *vq)
+{
+	pthread_mutex_lock(&lb.lock);
+	pthread_cond_broadcast(&lb.cond);
+	pthread_mutex_unlock(&lb.lock);
+	return true;
+}
+
+bool virtqueue_kick(struct virtqueue *vq)
+{
+	return virtqueue_notify(vq);
+}
+
+void *virtqueue_get_buf(struct virtqueue *vq, unsigned int *len)
+{
+	struct lb_ring *used = &to_lb_vq(vq)->used;
+	struct lb_buf b = { NULL };
+
+	pthread_mutex_lock(&lb.lock);
+	if (!ring_empty(used))
+		b = ring_pop(used);
+	pthread_mutex_unlock(&lb.lock);
+
+	*len = b.len;
+	return b.token;
+}
+
+void *virtqueue_detach_unused_buf(struct virtqueue *vq)
+{
+	struct lb_vq *lvq = to_lb_vq(vq);
+	struct lb_buf b = { NULL };
+
+	pthread_mutex_lock(&lb.lock);
+	if (!ring_empty(&lvq->avail))
+		b = ring_pop(&lvq->avail);
+	else if (!ring_empty(&lvq->used))
+		b = ring_pop(&lvq->used);
+	pthread_mutex_unlock(&lb.lock);
+
+	return b.token;
+}
+
+unsigned int virtqueue_get_vring_size(struct virtqueue *vq)
+{
+	return LB_VRING_SIZE;
+}
+
+/* queue a message to the driver and raise the rx callback */
+static void lb_send(u32 src, u32 dst, const void *data, size_t len)
+{
+	struct lb_vq *rx = &lb.vqs[LB_RX];
+	struct tipc_msg_hdr *hdr;
+	struct lb_buf b;
+
+	pthread_mutex_lock(&lb.lock);
+	if (ring_empty(&rx->avail) ||
+	    sizeof(*hdr) + len > rx->avail.bufs[rx->avail.tail %
+						LB_VRING_SIZE].len) {
+		lb.bad++;
+		pthread_mutex_unlock(&lb.lock);
+		return;
+	}
+	b = ring_pop(&rx->avail);
+	hdr = b.va;
+	hdr->src = src;
+	hdr->dst = dst;
+	hdr->reserved = 0;
+	hdr->len = len;
+	hdr->flags = 0;
+	memcpy(hdr->data, data, len);
+	b.len = sizeof(*hdr) + len;
+	ring_push(&rx->used, &b);
+	pthread_mutex_unlock(&lb.lock);
+
+	rx->vq.callback(&rx->vq);
+}
+
+static void lb_send_ctrl(u32 type, const void *body, u32 body_len)
+{
+	u8 buf[sizeof(struct tipc_ctrl_msg) + 64];
+	struct tipc_ctrl_msg *msg = (struct tipc_ctrl_msg *)buf;
+
+	msg->type = type;
+	msg->body_len = body_len;
+	if (body_len)
+		memcpy(msg->body, body, body_len);
+	lb_send(LB_ECHO_ADDR, TIPC_CTRL_ADDR, msg, sizeof(*msg) + body_len);
+}
+
+static void lb_release(u32 target, u64 id)
+{
+	struct tipc_shm_release_body body = { .target = target, .id = id };
+
+	lb_send_ctrl(TIPC_CTRL_MSGTYPE_SHM_RELEASE, &body, sizeof(body));
+}
+
+static void lb_handle_ctrl(struct tipc_msg_hdr *hdr)
+{
+	struct tipc_ctrl_msg *msg = (struct tipc_ctrl_msg *)hdr->data;
+	struct tipc_conn_req_body *req;
+	struct tipc_conn_rsp_body rsp;
+
+	switch (msg->type) {
+	case TIPC_CTRL_MSGTYPE_CONN_REQ:
+		req = (struct tipc_conn_req_body *)msg->body;
+		memset(&rsp, 0, sizeof(rsp));
+		rsp.target = hdr->src;
+		if (!strcmp(req->name, "echo")) {
+			rsp.status = NO_ERROR;
+			rsp.remote = LB_ECHO_ADDR;
+			rsp.max_msg_size = PAGE_SIZE;
+			rsp.max_msg_cnt = 1;
+		} else {
+			rsp.status = ERR_NOT_FOUND;
+		}
+		lb_send_ctrl(TIPC_CTRL_MSGTYPE_CONN_RSP, &rsp, sizeof(rsp));
+		break;
+	case TIPC_CTRL_MSGTYPE_DISC_REQ:
+		lb.discs++;
+		break;
+	default:
+		lb.bad++;
+	}
+}
+
+static u64 lb_hash(u64 hash, const u8 *p, size_t len)
+{
+	while (len--) {
+		hash ^= *p++;
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+/* map the pages of one reference, hash them and invert writable ones */
+static int lb_map_ref(struct tipc_shm_ref *ref, u64 *hash)
+{
+	bool writable = ref->flags & TIPC_SHM_WRITABLE;
+	u64 left = ref->size, off = ref->offset, n;
+	u32 i;
+	u8 *p;
+
+	*hash = 0xcbf29ce484222325ULL;
+	if (ref->offset >= PAGE_SIZE ||
+	    ref->page_cnt != DIV_ROUND_UP(ref->offset + ref->size, PAGE_SIZE))
+		return -1;
+
+	for (i = 0; i < ref->page_cnt; i++) {
+		if (!(ref->pages[i] & SHIM_PAGE_RDONLY) != writable)
+			return -1;
+		p = (u8 *)(uintptr_t)(ref->pages[i] & PAGE_MASK) + off;
+		n = left < PAGE_SIZE - off ? left : PAGE_SIZE - off;
+		*hash = lb_hash(*hash, p, n);
+		if (writable)
+			for (off = 0; off < n; off++)
+				p[off] ^= 0xff;
+		left -= n;
+		off = 0;
+	}
+	return 0;
+}
+
+static void lb_handle_shm(struct tipc_msg_hdr *hdr)
+{
+	struct tipc_shm_msg_hdr *shm = (struct tipc_shm_msg_hdr *)hdr->data;
+	u8 buf[sizeof(struct lb_shm_reply) + PAGE_SIZE];
+	struct lb_shm_reply *reply = (struct lb_shm_reply *)buf;
+	size_t pos, len = hdr->len;
+	struct tipc_shm_ref *ref;
+	u32 i;
+
+	memset(reply, 0, sizeof(*reply));
+	pos = sizeof(*shm) + ALIGN((size_t)shm->inline_len, sizeof(u64));
+	if (len < sizeof(*shm) || pos > len ||
+	    shm->shm_cnt > TIPC_MAX_SHM_CNT)
+		goto bad;
+
+	reply->shm_cnt = shm->shm_cnt;
+	for (i = 0; i < shm->shm_cnt; i++) {
+		ref = (struct tipc_shm_ref *)(hdr->data + pos);
+		if (pos + sizeof(*ref) > len ||
+		    pos + sizeof(*ref) + ref->page_cnt * sizeof(u64) > len)
+			goto bad;
+		if (lb_map_ref(ref, &reply->hash[i]))
+			goto bad;
+		reply->id[i] = ref->id;
+		pos += sizeof(*ref) + ref->page_cnt * sizeof(u64);
+	}
+	if (pos != len)
+		goto bad;
+
+	/* release before answering, so the release is seen first */
+	for (i = 0; i < shm->shm_cnt; i++) {
+		lb.shm_refs++;
+		if (!lb.hold_shm) {
+			lb_release(hdr->src, reply->id[i]);
+		} else if (lb.nheld < LB_MAX_HELD) {
+			lb.held[lb.nheld].target = hdr->src;
+			lb.held[lb.nheld++].id = reply->id[i];
+		} else {
+			lb.bad++;
+		}
+	}
+	memcpy(buf + sizeof(*reply), shm->data, shm->inline_len);
+	lb_send(hdr->dst, hdr->src, buf, sizeof(*reply) + shm->inline_len);
+	return;
+
+bad:
+	lb.bad++;
+	reply->status = -1;
+	lb_send(hdr->dst, hdr->src, reply, sizeof(*reply));
+}
+
+static void lb_handle_msg(struct lb_buf *b)
+{
+	struct tipc_msg_hdr *hdr = b->va;
+
+	if (b->len < sizeof(*hdr) || b->len != sizeof(*hdr) + hdr->len) {
+		lb.bad++;
+		return;
+	}
+
+	if (hdr->dst == TIPC_CTRL_ADDR)
+		lb_handle_ctrl(hdr);
+	else if (hdr->dst != LB_ECHO_ADDR)
+		lb.bad++;
+	else if (hdr->flags & TIPC_MSG_FLAG_SHM)
+		lb_handle_shm(hdr);
+	else
+		lb_send(hdr->dst, hdr->src, hdr->data, hdr->len);
+}
+
+static void lb_run_cmd(enum lb_cmd cmd)
+{
+	u32 type = TIPC_CTRL_MSGTYPE_GO_ONLINE;
+	unsigned int i;
+
+	switch (cmd) {
+	case LB_CMD_ONLINE:
+		lb_send_ctrl(type, NULL, 0);
+		break;
+	case LB_CMD_RELEASE:
+		for (i = 0; i < lb.nheld; i++)
+			lb_release(lb.held[i].target, lb.held[i].id);
+		lb.nheld = 0;
+		break;
+	default:
+		break;
+	}
+}
+
+static void *lb_secure_side(void *arg)
+{
+	struct lb_vq *tx = &lb.vqs[LB_TX];
+	enum lb_cmd cmd;
+	struct lb_buf b;
+
+	pthread_mutex_lock(&lb.lock);
+	while (!lb.stop) {
+		if (lb.alive && lb.cmd != LB_CMD_NONE) {
+			cmd = lb.cmd;
+			lb.busy = true;
+			pthread_mutex_unlock(&lb.lock);
+			lb_run_cmd(cmd);
+			pthread_mutex_lock(&lb.lock);
+			lb.cmd = LB_CMD_NONE;
+		} else if (lb.alive && !ring_empty(&tx->avail)) {
+			b = ring_pop(&tx->avail);
+			lb.busy = true;
+			pthread_mutex_unlock(&lb.lock);
+			lb_handle_msg(&b);
+			pthread_mutex_lock(&lb.lock);
+			ring_push(&tx->used, &b);
+			pthread_mutex_unlock(&lb.lock);
+			tx->vq.callback(&tx->vq);
+			pthread_mutex_lock(&lb.lock);
+		} else {
+			pthread_cond_wait(&lb.cond, &lb.lock);
+			continue;
+		}
+		lb.busy = false;
+		pthread_cond_broadcast(&lb.cond);
+	}
+	pthread_mutex_unlock(&lb.lock);
+	return NULL;
+}
+
+/* run a command on the secure side and wait for it and all messages */
+static void lb_command(enum lb_cmd cmd)
+{
+	struct lb_vq *tx = &lb.vqs[LB_TX];
+
+	pthread_mutex_lock(&lb.lock);
+	lb.cmd = cmd;
+	pthread_cond_broadcast(&lb.cond);
+	while (lb.cmd != LB_CMD_NONE || lb.busy || !ring_empty(&tx->avail))
+		pthread_cond_wait(&lb.cond, &lb.lock);
+	pthread_mutex_unlock(&lb.lock);
+}
+
+/* wait until the secure side has handled everything queued to it */
+static void lb_sync(void)
+{
+	lb_command(LB_CMD_NONE);
+}
+
+static void lb_get_config(struct virtio_device *vdev, unsigned int offset,
+			  void *buf, unsigned int len)
+{
+	struct tipc_dev_config config = {
+		.msg_buf_max_size = PAGE_SIZE,
+		.msg_buf_alignment = PAGE_SIZE,
+		.dev_name = "lb",
+	};
+
+	memcpy(buf, (u8 *)&config + offset, len);
+}
+
+static void lb_reset(struct virtio_device *vdev)
+{
+	pthread_mutex_lock(&lb.lock);
+	lb.alive = false;
+	while (lb.busy)
+		pthread_cond_wait(&lb.cond, &lb.lock);
+	pthread_mutex_unlock(&lb.lock);
+}
+
+static int lb_find_vqs(struct virtio_device *vdev, unsigned int nvqs,
+		       struct virtqueue *vqs[], vq_callback_t *callbacks[],
+		       const char * const names[], const bool *ctx,
+		       struct irq_affinity *desc)
+{
+	unsigned int i;
+
+	for (i = 0; i < nvqs; i++) {
+		memset(&lb.vqs[i], 0, sizeof(lb.vqs[i]));
+		lb.vqs[i].vq.callback = callbacks[i];
+		lb.vqs[i].vq.name = names[i];
+		lb.vqs[i].vq.vdev = vdev;
+		vqs[i] = &lb.vqs[i].vq;
+	}
+	return 0;
+}
+
+static void lb_del_vqs(struct virtio_device *vdev)
+{
+}
+
+static const struct virtio_config_ops lb_config_ops = {
+	.get = lb_get_config,
+	.reset = lb_reset,
+	.find_vqs = lb_find_vqs,
+	.del_vqs = lb_del_vqs,
+};
+
+static int lb_probe(u64 features)
+{
+	int ret;
+
+	memset(&lb.vdev, 0, sizeof(lb.vdev));
+	lb.vdev.config = &lb_config_ops;
+	lb.vdev.features = features;
+	lb.hold_shm = false;
+	lb.nheld = 0;
+	lb.shm_refs = 0;
+	lb.bad = 0;
+
+	ret = tipc_virtio_probe(&lb.vdev);
+	if (ret)
+		return ret;
+
+	pthread_mutex_lock(&lb.lock);
+	lb.alive = true;
+	pthread_mutex_unlock(&lb.lock);
+	lb_command(LB_CMD_ONLINE);
+	return 0;
+}
+
+static void lb_remove(void)
+{
+	tipc_virtio_remove(&lb.vdev);
+}
+
+static void lb_start(void)
+{
+	pthread_create(&lb.thread, NULL, lb_secure_side, NULL);
+}
+
+static void lb_stop(void)
+{
+	pthread_mutex_lock(&lb.lock);
+	lb.stop = true;
+	pthread_cond_broadcast(&lb.cond);
+	pthread_mutex_unlock(&lb.lock);
+	pthread_join(lb.thread, NULL);
+}
+
+/*
+ * Client, going through the file operations of the device node
+ */
+
+static struct tipc_virtio_dev *lb_vds(void)
+{
+	return lb.vdev.priv;
+}
+
+static struct tipc_chan *file_chan(struct file *filp)
+{
+	return ((struct tipc_dn_chan *)filp->private_data)->chan;
+}
+
+static int file_open(struct file *filp, const char *port)
+{
+	struct inode inode = { .i_cdev = &lb_vds()->cdev_node.cdev };
+	int ret;
+
+	memset(filp, 0, sizeof(*filp));
+	ret = tipc_fops.open(&inode, filp);
+	if (ret)
+		return ret;
+	return tipc_fops.unlocked_ioctl(filp, TIPC_IOC_CONNECT,
+					(unsigned long)port);
+}
+
+static void file_close(struct file *filp)
+{
+	struct inode inode = { .i_cdev = &lb_vds()->cdev_node.cdev };
+
+	tipc_fops.release(&inode, filp);
+	lb_sync();
+}
+
+static ssize_t file_read(struct file *filp, void *buf, size_t len)
+{
+	struct iovec iov = { buf, len };
+	struct kiocb iocb = { filp };
+	struct iov_iter iter;
+
+	iov_iter_init(&iter, READ, &iov, 1, len);
+	return tipc_fops.read_iter(&iocb, &iter);
+}
+
+static ssize_t file_write(struct file *filp, const void *buf, size_t len)
+{
+	struct iovec iov = { (void *)buf, len };
+	struct kiocb iocb = { filp };
+	struct iov_iter iter;
+
+	iov_iter_init(&iter, WRITE, &iov, 1, len);
+	return tipc_fops.write_iter(&iocb, &iter);
+}
+
+static long send_shm(struct file *filp, const char *inl, struct tipc_shm *shm,
+		     u32 cnt)
+{
+	struct iovec iov = { (void *)inl, strlen(inl) };
+	struct tipc_send_msg_req req = {
+		.iov = (uintptr_t)&iov,
+		.iov_cnt = 1,
+		.shm = (uintptr_t)shm,
+		.shm_cnt = cnt,
+	};
+
+	return tipc_fops.unlocked_ioctl(filp, TIPC_IOC_SEND_MSG,
+					(unsigned long)&req);
+}
+
+/* read the answer to a message with references, and check its inline data */
+static int read_shm_reply(struct file *filp, const char *inl,
+			  struct lb_shm_reply *reply)
+{
+	u8 buf[sizeof(*reply) + PAGE_SIZE];
+	size_t len = strlen(inl);
+
+	CHECK(file_read(filp, buf, sizeof(buf)) == sizeof(*reply) + len);
+	memcpy(reply, buf, sizeof(*reply));
+	CHECK(!memcmp(buf + sizeof(*reply), inl, len));
+	CHECK(!reply->status);
+	return 0;
+}
+
+static u64 hash_of(const void *p, size_t len)
+{
+	return lb_hash(0xcbf29ce484222325ULL, p, len);
+}
+
+static void *alloc_user(size_t pages, u8 seed)
+{
+	u8 *p = aligned_alloc(PAGE_SIZE, pages * PAGE_SIZE);
+	size_t i;
+
+	for (i = 0; i < pages * PAGE_SIZE; i++)
+		p[i] = seed + i * 13;
+	return p;
+}
+
+#define SHM_FEATURES		(1ULL << TIPC_F_SHM_REF)
+
+/* plain messages still go through the txbuf copy */
+static int test_echo(void)
+{
+	struct file f;
+	char buf[16];
+
+	CHECK(!lb_probe(SHM_FEATURES));
+
+	CHECK(file_open(&f, "nope") == -ENOTCONN);
+	file_close(&f);
+
+	CHECK(!file_open(&f, "echo"));
+	CHECK(tipc_fops.poll(&f, NULL) == (POLLOUT | POLLWRNORM));
+	CHECK(file_write(&f, "hello", 5) == 5);
+	CHECK(file_read(&f, buf, sizeof(buf)) == 5);
+	CHECK(!memcmp(buf, "hello", 5));
+	file_close(&f);
+
+	lb_remove();
+	CHECK(!lb.bad);
+	CHECK(!shim_warnings);
+	return 0;
+}
+
+/* user memory is pinned, mapped by the secure side, and unpinned on release */
+static int test_shm_user(void)
+{
+	u8 *ro = alloc_user(11, 1), *rw = alloc_user(3, 2);
+	u8 *rw_copy = malloc(3 * PAGE_SIZE);
+	struct tipc_shm shm[2] = {
+		{ .fd = -1, .addr = (uintptr_t)ro + 100, .size = 40000 },
+		{ .fd = -1, .flags = TIPC_SHM_WRITABLE,
+		  .addr = (uintptr_t)rw, .size = 3 * PAGE_SIZE - 1 },
+	};
+	struct lb_shm_reply reply;
+	struct file f;
+	size_t i;
+
+	memcpy(rw_copy, rw, 3 * PAGE_SIZE);
+	CHECK(!lb_probe(SHM_FEATURES));
+	CHECK(!file_open(&f, "echo"));
+
+	CHECK(send_shm(&f, "req", shm, 2) == 3);
+	CHECK(!read_shm_reply(&f, "req", &reply));
+	CHECK(reply.shm_cnt == 2);
+	CHECK(reply.id[0] && reply.id[1] > reply.id[0]);
+	CHECK(reply.hash[0] == hash_of(ro + 100, 40000));
+	CHECK(reply.hash[1] == hash_of(rw_copy, 3 * PAGE_SIZE - 1));
+	for (i = 0; i < 3 * PAGE_SIZE - 1; i++)
+		CHECK(rw[i] == (u8)~rw_copy[i]);
+	CHECK(rw[i] == rw_copy[i]);
+
+	/* both were released before the answer */
+	CHECK(!pg.pinned);
+	CHECK(pg.dirtied == 3);
+	CHECK(!file_chan(&f)->shm_pages);
+	CHECK(list_empty(&file_chan(&f)->shm_list));
+
+	/* the inline data alone */
+	CHECK(send_shm(&f, "only", NULL, 0) == 4);
+	CHECK(!read_shm_reply(&f, "only", &reply));
+	CHECK(!reply.shm_cnt);
+
+	file_close(&f);
+	lb_remove();
+	CHECK(lb.shm_refs == 2);
+	CHECK(!lb.bad);
+	CHECK(!shim_warnings);
+	pg.dirtied = 0;
+	free(ro);
+	free(rw);
+	free(rw_copy);
+	return 0;
+}
+
+/* a dma-buf is walked over all of its CPU entries, not the mapped ones */
+static int test_shm_dmabuf(void)
+{
+	struct tipc_shm shm = {
+		.fd = LB_DMABUF_FD,
+		.addr = PAGE_SIZE + 10,
+		.size = 5 * PAGE_SIZE,
+	};
+	struct lb_shm_reply reply;
+	struct file f;
+
+	CHECK(!lb_probe(SHM_FEATURES));
+	CHECK(!file_open(&f, "echo"));
+
+	CHECK(send_shm(&f, "dmabuf", &shm, 1) == 6);
+	CHECK(!read_shm_reply(&f, "dmabuf", &reply));
+	CHECK(reply.hash[0] == hash_of(dbuf.mem + PAGE_SIZE + 10,
+				       5 * PAGE_SIZE));
+	CHECK(!dbuf.refs && !dbuf.attached && !dbuf.mapped);
+
+	/* past the end of the buffer */
+	shm.addr = 4 * PAGE_SIZE;
+	CHECK(send_shm(&f, "x", &shm, 1) == -EINVAL);
+	CHECK(!dbuf.refs && !dbuf.attached && !dbuf.mapped);
+
+	shm.fd = LB_DMABUF_FD + 1;
+	shm.addr = 0;
+	CHECK(send_shm(&f, "x", &shm, 1) == -EBADF);
+
+	file_close(&f);
+	lb_remove();
+	CHECK(!pg.pinned);
+	CHECK(!lb.bad);
+	CHECK(!shim_warnings);
+	return 0;
+}
+
+/*
+ * References outlive their channel: they move to the device when the file
+ * is closed, and a release that names a reused address still finds them.
+ */
+static int test_shm_outlives_channel(void)
+{
+	u8 *rw = alloc_user(2, 3);
+	struct tipc_shm shm = {
+		.fd = -1, .flags = TIPC_SHM_WRITABLE,
+		.addr = (uintptr_t)rw, .size = 2 * PAGE_SIZE,
+	};
+	struct lb_shm_reply reply;
+	struct file f;
+	u32 local;
+
+	CHECK(!lb_probe(SHM_FEATURES));
+	lb.hold_shm = true;
+	CHECK(!file_open(&f, "echo"));
+	local = file_chan(&f)->local;
+
+	CHECK(send_shm(&f, "a", &shm, 1) == 1);
+	CHECK(!read_shm_reply(&f, "a", &reply));
+	CHECK(pg.pinned == 2);
+	CHECK(file_chan(&f)->shm_pages == 2);
+
+	file_close(&f);
+	CHECK(pg.pinned == 2);
+	CHECK(!pg.dirtied);
+	CHECK(!list_empty(&lb_vds()->shm_orphans));
+
+	CHECK(!file_open(&f, "echo"));
+	CHECK(file_chan(&f)->local == local);
+	lb_command(LB_CMD_RELEASE);
+	CHECK(!pg.pinned);
+	CHECK(pg.dirtied == 2);
+	CHECK(list_empty(&lb_vds()->shm_orphans));
+
+	file_close(&f);
+	lb_remove();
+	CHECK(!lb.bad);
+	CHECK(!shim_warnings);
+	pg.dirtied = 0;
+	free(rw);
+	return 0;
+}
+
+/* every failure unpins what it pinned */
+static int test_shm_limits(void)
+{
+	u8 *big = alloc_user(512, 4);
+	struct tipc_shm shm[TIPC_MAX_SHM_CNT + 1];
+	struct lb_shm_reply reply;
+	struct file f;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(shm); i++)
+		shm[i] = (struct tipc_shm){
+			.fd = -1, .addr = (uintptr_t)big, .size = 1,
+		};
+
+	CHECK(!lb_probe(SHM_FEATURES));
+	CHECK(!file_open(&f, "echo"));
+
+	CHECK(send_shm(&f, "x", shm, TIPC_MAX_SHM_CNT + 1) == -EINVAL);
+	shm[0].size = 0;
+	CHECK(send_shm(&f, "x", shm, 1) == -EINVAL);
+	shm[0].size = 1;
+	shm[0].flags = 0x80;
+	CHECK(send_shm(&f, "x", shm, 1) == -EINVAL);
+	shm[0].flags = 0;
+
+	/* more pages than the references fit in one message */
+	shm[0].size = 512 * PAGE_SIZE;
+	CHECK(send_shm(&f, "x", &shm[0], 1) == -EMSGSIZE);
+	CHECK(!pg.pinned);
+
+	/* a fault half way through */
+	shm[0].size = 5 * PAGE_SIZE;
+	pg.fault_after = 3;
+	CHECK(send_shm(&f, "x", &shm[0], 1) == -EFAULT);
+	pg.fault_after = -1;
+	CHECK(!pg.pinned);
+
+	/* the per channel limit counts references not yet released */
+	lb.hold_shm = true;
+	shm[0].size = 495 * PAGE_SIZE;
+	for (i = 0; i < TIPC_MAX_SHM_PAGES / 495; i++) {
+		CHECK(send_shm(&f, "x", &shm[0], 1) == 1);
+		CHECK(!read_shm_reply(&f, "x", &reply));
+	}
+	CHECK(pg.pinned == i * 495);
+	CHECK(send_shm(&f, "x", &shm[0], 1) == -ENOSPC);
+	CHECK(pg.pinned == i * 495);
+	lb_command(LB_CMD_RELEASE);
+	CHECK(!pg.pinned);
+	CHECK(!file_chan(&f)->shm_pages);
+	CHECK(send_shm(&f, "x", &shm[0], 1) == 1);
+	CHECK(!read_shm_reply(&f, "x", &reply));
+	lb_command(LB_CMD_RELEASE);
+	CHECK(!pg.pinned);
+
+	file_close(&f);
+	lb_remove();
+	CHECK(!lb.bad);
+	CHECK(!shim_warnings);
+	free(big);
+	return 0;
+}
+
+/* a secure side without the feature is refused before anything is pinned */
+static int test_no_feature(void)
+{
+	u8 *p = alloc_user(1, 5);
+	struct tipc_shm shm = {
+		.fd = -1, .addr = (uintptr_t)p, .size = PAGE_SIZE,
+	};
+	struct file f;
+	char buf[8];
+
+	CHECK(!lb_probe(0));
+	CHECK(!file_open(&f, "echo"));
+	CHECK(send_shm(&f, "x", &shm, 1) == -EOPNOTSUPP);
+	CHECK(!pg.pinned);
+	CHECK(file_write(&f, "hi", 2) == 2);
+	CHECK(file_read(&f, buf, sizeof(buf)) == 2);
+	file_close(&f);
+	lb_remove();
+	CHECK(!lb.shm_refs);
+	CHECK(!lb.bad);
+	free(p);
+	return 0;
+}
+
+/* references never released stay pinned after the device goes away */
+static int test_device_gone(void)
+{
+	u8 *p = alloc_user(2, 6);
+	struct tipc_shm shm = {
+		.fd = -1, .addr = (uintptr_t)p, .size = 2 * PAGE_SIZE,
+	};
+	struct lb_shm_reply reply;
+	struct file f;
+
+	CHECK(!lb_probe(SHM_FEATURES));
+	lb.hold_shm = true;
+	CHECK(!file_open(&f, "echo"));
+	CHECK(send_shm(&f, "x", &shm, 1) == 1);
+	CHECK(!read_shm_reply(&f, "x", &reply));
+	file_close(&f);
+
+	shim_quiet = 1;
+	lb_remove();
+	shim_quiet = 0;
+	CHECK(pg.pinned == 2);
+	CHECK(!lb.bad);
+	CHECK(!shim_warnings);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	dbuf_init();
+	lb_start();
+
+	test_echo();
+	test_shm_user();
+	test_shm_dmabuf();
+	test_shm_outlives_channel();
+	test_shm_limits();
+	test_no_feature();
+	test_device_gone();
+
+	lb_stop();
+	printf("%s\n", failures ? "FAIL" : "PASS");
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,919 @@
+/*
+ * Userspace stand-ins for the kernel facilities used by the Trusty IPC
+ * driver (drivers/trusty/trusty-ipc.c). Locks, wait queues and
+ * completions are backed by pthreads so that the virtqueue callbacks run
+ * on another thread, as in the kernel. The virtqueues, user pages,
+ * dma-bufs and the Trusty memory encoding are provided by the test.
+ *
+ * Copyright (c) 2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#ifndef _TIPC_SHIM_H
+#define _TIPC_SHIM_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int32_t s32;
+typedef int64_t s64;
+typedef int32_t __s32;
+typedef uint32_t __u32;
+typedef uint64_t __u64;
+typedef uint64_t phys_addr_t;
+typedef unsigned int gfp_t;
+
+#define __packed		__attribute__((packed))
+#define __user
+#define __init
+#define __exit
+
+#define LINUX_VERSION_CODE	KERNEL_VERSION(4, 14, 0)
+#define KERNEL_VERSION(a, b, c)	(((a) << 16) + ((b) << 8) + (c))
+
+/* IS_ENABLED() for built-in options only */
+#define __ARG_PLACEHOLDER_1	0,
+#define __take_second_arg(__ignored, val, ...) val
+#define __is_defined(x)		___is_defined(x)
+#define ___is_defined(val)	____is_defined(__ARG_PLACEHOLDER_##val)
+#define ____is_defined(arg1_or_junk) __take_second_arg(arg1_or_junk 1, 0)
+#define IS_ENABLED(option)	__is_defined(option)
+
+#define KBUILD_MODNAME		"trusty-ipc"
+#define EXPORT_SYMBOL(sym)	extern typeof(sym) sym
+#define THIS_MODULE		NULL
+#define MODULE_DESCRIPTION(s)
+#define MODULE_LICENSE(s)
+#define MODULE_DEVICE_TABLE(type, name)
+#define subsys_initcall(fn) \
+	static int (*shim_initcall)(void) __attribute__((unused)) = fn
+#define module_exit(fn) \
+	static void (*shim_exitcall)(void) __attribute__((unused)) = fn
+
+#define ARRAY_SIZE(a)		(sizeof(a) / sizeof((a)[0]))
+#define DIV_ROUND_UP(n, d)	(((n) + (d) - 1) / (d))
+#define ALIGN(x, a)		(((x) + (a) - 1) & ~((typeof(x))(a) - 1))
+#define container_of(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+#define BUG_ON(cond)		do { if (cond) abort(); } while (0)
+
+#define MAX_ERRNO		4095
+#define ERESTARTSYS		512
+
+static inline void *ERR_PTR(long error)
+{
+	return (void *)error;
+}
+
+static inline long PTR_ERR(const void *ptr)
+{
+	return (long)ptr;
+}
+
+static inline bool IS_ERR(const void *ptr)
+{
+	return (unsigned long)ptr >= (unsigned long)-MAX_ERRNO;
+}
+
+static inline bool IS_ERR_OR_NULL(const void *ptr)
+{
+	return !ptr || IS_ERR(ptr);
+}
+
+/* set by the test to silence expected errors */
+extern int shim_quiet;
+extern unsigned int shim_warnings;
+
+static inline void shim_log(bool show, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (!show)
+		return;
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+}
+
+#define pr_err(fmt, ...)	shim_log(!shim_quiet, fmt, ##__VA_ARGS__)
+#define pr_warn(fmt, ...)	shim_log(!shim_quiet, fmt, ##__VA_ARGS__)
+#define dev_err(dev, fmt, ...) \
+	do { (void)(dev); pr_err(fmt, ##__VA_ARGS__); } while (0)
+#define dev_warn(dev, fmt, ...) \
+	do { (void)(dev); pr_warn(fmt, ##__VA_ARGS__); } while (0)
+#define dev_info(dev, fmt, ...)	do { (void)(dev); } while (0)
+#define dev_dbg(dev, fmt, ...)	do { (void)(dev); } while (0)
+
+#define WARN_ON(cond) ({ \
+	int __c = !!(cond); \
+	if (__c) { \
+		__atomic_fetch_add(&shim_warnings, 1, __ATOMIC_SEQ_CST); \
+		pr_err("WARNING at %s:%d: %s\n", __func__, __LINE__, \
+		       #cond); \
+	} \
+	__c; \
+})
+
+/*
+ * Memory
+ */
+#define GFP_KERNEL		0
+
+#define PAGE_SHIFT		12
+#define PAGE_SIZE		(1UL << PAGE_SHIFT)
+#define PAGE_MASK		(~(PAGE_SIZE - 1))
+#define offset_in_page(p)	((unsigned long)(p) & ~PAGE_MASK)
+
+#define kzalloc(size, gfp)	calloc(1, size)
+#define kcalloc(n, size, gfp)	calloc(n, size)
+#define kfree(p)		free(p)
+
+static inline void *alloc_pages_exact(size_t size, gfp_t gfp)
+{
+	return aligned_alloc(PAGE_SIZE, ALIGN(size, PAGE_SIZE));
+}
+
+#define free_pages_exact(va, size)	free(va)
+
+/* user pointers are plain pointers, a NULL one faults */
+#define u64_to_user_ptr(x)	((void *)(uintptr_t)(x))
+
+static inline unsigned long copy_from_user(void *to, const void *from,
+					   unsigned long n)
+{
+	if (!from)
+		return n;
+	memcpy(to, from, n);
+	return 0;
+}
+
+static inline long strncpy_from_user(char *dst, const char *src, long count)
+{
+	long n;
+
+	if (!src)
+		return -EFAULT;
+	n = strnlen(src, count);
+	memcpy(dst, src, n < count ? n + 1 : n);
+	return n;
+}
+
+static inline void *memdup_user(const void *src, size_t len)
+{
+	void *p;
+
+	if (!src)
+		return ERR_PTR(-EFAULT);
+	p = malloc(len);
+	if (!p)
+		return ERR_PTR(-ENOMEM);
+	memcpy(p, src, len);
+	return p;
+}
+
+/*
+ * Pages. A struct page stands for one page of process memory at @virt,
+ * the test hands them out and counts the references.
+ */
+struct page {
+	void *virt;
+	int count;
+	unsigned int dirty;
+	struct page *next;
+};
+
+typedef struct {
+	unsigned long pgprot;
+} pgprot_t;
+
+#define SHIM_PAGE_RDONLY	1
+#define PAGE_KERNEL		((pgprot_t){ 0 })
+#define PAGE_KERNEL_RO		((pgprot_t){ SHIM_PAGE_RDONLY })
+#define pgprot_val(p)		((p).pgprot)
+
+int get_user_pages_fast(unsigned long start, int nr_pages, int write,
+			struct page **pages);
+void put_page(struct page *page);
+int set_page_dirty_lock(struct page *page);
+
+/*
+ * Lists. The links list_empty() reads are written once, as in the kernel,
+ * since wait conditions test it without the lock.
+ */
+struct list_head {
+	struct list_head *next, *prev;
+};
+
+#define LIST_HEAD_INIT(name)	{ &(name), &(name) }
+#define LIST_HEAD(name)		struct list_head name = LIST_HEAD_INIT(name)
+
+static inline void INIT_LIST_HEAD(struct list_head *list)
+{
+	list->next = list;
+	list->prev = list;
+}
+
+static inline void __list_add(struct list_head *n, struct list_head *prev,
+			      struct list_head *next)
+{
+	next->prev = n;
+	n->next = next;
+	n->prev = prev;
+	__atomic_store_n(&prev->next, n, __ATOMIC_RELAXED);
+}
+
+static inline void list_add_tail(struct list_head *n, struct list_head *head)
+{
+	__list_add(n, head->prev, head);
+}
+
+static inline void list_del(struct list_head *entry)
+{
+	entry->next->prev = entry->prev;
+	__atomic_store_n(&entry->prev->next, entry->next, __ATOMIC_RELAXED);
+	entry->next = NULL;
+	entry->prev = NULL;
+}
+
+static inline bool list_empty(const struct list_head *head)
+{
+	return __atomic_load_n(&head->next, __ATOMIC_RELAXED) == head;
+}
+
+static inline void list_splice_tail_init(struct list_head *list,
+					 struct list_head *head)
+{
+	if (list_empty(list))
+		return;
+	list->next->prev = head->prev;
+	__atomic_store_n(&head->prev->next, list->next, __ATOMIC_RELAXED);
+	list->prev->next = head;
+	head->prev = list->prev;
+	INIT_LIST_HEAD(list);
+}
+
+#define list_entry(ptr, type, member)	container_of(ptr, type, member)
+#define list_first_entry(ptr, type, member) \
+	list_entry((ptr)->next, type, member)
+#define list_first_entry_or_null(ptr, type, member) \
+	(!list_empty(ptr) ? list_first_entry(ptr, type, member) : NULL)
+#define list_next_entry(pos, member) \
+	list_entry((pos)->member.next, typeof(*(pos)), member)
+#define list_for_each_entry(pos, head, member) \
+	for (pos = list_first_entry(head, typeof(*pos), member); \
+	     &pos->member != (head); \
+	     pos = list_next_entry(pos, member))
+#define list_for_each_entry_safe(pos, n, head, member) \
+	for (pos = list_first_entry(head, typeof(*pos), member), \
+	     n = list_next_entry(pos, member); \
+	     &pos->member != (head); \
+	     pos = n, n = list_next_entry(n, member))
+
+/*
+ * Time, one jiffy is one millisecond
+ */
+#define msecs_to_jiffies(ms)	((long)(ms))
+
+static inline void shim_deadline(struct timespec *ts, long j)
+{
+	clock_gettime(CLOCK_REALTIME, ts);
+	ts->tv_sec += j / 1000;
+	ts->tv_nsec += (j % 1000) * 1000000L;
+	if (ts->tv_nsec >= 1000000000L) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000L;
+	}
+}
+
+static inline long shim_left(const struct timespec *ts)
+{
+	struct timespec now;
+	long ms;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	ms = (ts->tv_sec - now.tv_sec) * 1000 +
+		(ts->tv_nsec - now.tv_nsec) / 1000000L;
+	return ms > 0 ? ms : 1;
+}
+
+/*
+ * Locks, reference counts and the task. Signals are never pending.
+ */
+struct mutex {
+	pthread_mutex_t lock;
+};
+
+#define DEFINE_MUTEX(m)		struct mutex m = { PTHREAD_MUTEX_INITIALIZER }
+#define mutex_init(m)		pthread_mutex_init(&(m)->lock, NULL)
+#define mutex_lock(m)		pthread_mutex_lock(&(m)->lock)
+#define mutex_unlock(m)		pthread_mutex_unlock(&(m)->lock)
+
+struct kref {
+	int refcount;
+};
+
+static inline void kref_init(struct kref *kref)
+{
+	__atomic_store_n(&kref->refcount, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline void kref_get(struct kref *kref)
+{
+	__atomic_fetch_add(&kref->refcount, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline int kref_put(struct kref *kref,
+			   void (*release)(struct kref *kref))
+{
+	if (__atomic_sub_fetch(&kref->refcount, 1, __ATOMIC_SEQ_CST))
+		return 0;
+	release(kref);
+	return 1;
+}
+
+#define TASK_INTERRUPTIBLE	1
+#define current			NULL
+#define signal_pending(p)	((void)(p), 0)
+
+/*
+ * Wait queues. Every wake up bumps a sequence number, a waiter sleeps
+ * until it changes.
+ */
+typedef struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	unsigned long seq;
+} wait_queue_head_t;
+
+static inline void init_waitqueue_head(wait_queue_head_t *wq)
+{
+	pthread_mutex_init(&wq->lock, NULL);
+	pthread_cond_init(&wq->cond, NULL);
+	wq->seq = 0;
+}
+
+static inline void wake_up_interruptible(wait_queue_head_t *wq)
+{
+	pthread_mutex_lock(&wq->lock);
+	wq->seq++;
+	pthread_cond_broadcast(&wq->cond);
+	pthread_mutex_unlock(&wq->lock);
+}
+
+#define wake_up_interruptible_all(wq)	wake_up_interruptible(wq)
+
+static inline unsigned long shim_wait_seq(wait_queue_head_t *wq)
+{
+	unsigned long seq;
+
+	pthread_mutex_lock(&wq->lock);
+	seq = wq->seq;
+	pthread_mutex_unlock(&wq->lock);
+	return seq;
+}
+
+static inline void shim_wait_change(wait_queue_head_t *wq, unsigned long seq)
+{
+	pthread_mutex_lock(&wq->lock);
+	while (wq->seq == seq)
+		pthread_cond_wait(&wq->cond, &wq->lock);
+	pthread_mutex_unlock(&wq->lock);
+}
+
+#define wait_event_interruptible(wq, condition) ({ \
+	unsigned long __seq; \
+	for (;;) { \
+		__seq = shim_wait_seq(&(wq)); \
+		if (condition) \
+			break; \
+		shim_wait_change(&(wq), __seq); \
+	} \
+	0; \
+})
+
+struct wait_queue_entry {
+	wait_queue_head_t *wq;
+	unsigned long seq;
+};
+
+#define woken_wake_function	NULL
+#define DEFINE_WAIT_FUNC(name, function) \
+	struct wait_queue_entry name = { NULL, 0 }
+
+static inline void add_wait_queue(wait_queue_head_t *wq,
+				  struct wait_queue_entry *wait)
+{
+	wait->wq = wq;
+	wait->seq = shim_wait_seq(wq);
+}
+
+#define remove_wait_queue(wq, wait)	do { } while (0)
+
+static inline long wait_woken(struct wait_queue_entry *wait, unsigned int mode,
+			      long timeout)
+{
+	wait_queue_head_t *wq = wait->wq;
+	struct timespec ts;
+	int r = 0;
+
+	shim_deadline(&ts, timeout);
+	pthread_mutex_lock(&wq->lock);
+	while (wq->seq == wait->seq && r != ETIMEDOUT)
+		r = pthread_cond_timedwait(&wq->cond, &wq->lock, &ts);
+	wait->seq = wq->seq;
+	pthread_mutex_unlock(&wq->lock);
+	return r == ETIMEDOUT ? 0 : shim_left(&ts);
+}
+
+struct completion {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	unsigned int done;
+};
+
+static inline void init_completion(struct completion *x)
+{
+	pthread_mutex_init(&x->lock, NULL);
+	pthread_cond_init(&x->cond, NULL);
+	x->done = 0;
+}
+
+static inline void complete(struct completion *x)
+{
+	pthread_mutex_lock(&x->lock);
+	x->done++;
+	pthread_cond_broadcast(&x->cond);
+	pthread_mutex_unlock(&x->lock);
+}
+
+static inline long
+wait_for_completion_interruptible_timeout(struct completion *x, long timeout)
+{
+	struct timespec ts;
+	long left = 0;
+	int r = 0;
+
+	shim_deadline(&ts, timeout);
+	pthread_mutex_lock(&x->lock);
+	while (!x->done && r != ETIMEDOUT)
+		r = pthread_cond_timedwait(&x->cond, &x->lock, &ts);
+	if (x->done) {
+		x->done--;
+		left = shim_left(&ts);
+	}
+	pthread_mutex_unlock(&x->lock);
+	return left;
+}
+
+/*
+ * IDR, a sorted array; callers hold their own lock
+ */
+struct shim_idr_ent {
+	int id;
+	void *ptr;
+};
+
+struct idr {
+	struct shim_idr_ent *ents;
+	int cnt;
+};
+
+#define DEFINE_IDR(name)	struct idr name = { NULL, 0 }
+#define idr_init(idr)		((idr)->ents = NULL, (idr)->cnt = 0)
+
+static inline int idr_alloc(struct idr *idr, void *ptr, int start, int end,
+			    gfp_t gfp)
+{
+	struct shim_idr_ent *ents;
+	int id = start, i;
+
+	for (i = 0; i < idr->cnt && idr->ents[i].id <= id; i++)
+		if (idr->ents[i].id == id)
+			id++;
+	if (end > 0 && id >= end)
+		return -ENOSPC;
+
+	ents = realloc(idr->ents, (idr->cnt + 1) * sizeof(*ents));
+	if (!ents)
+		return -ENOMEM;
+	memmove(&ents[i + 1], &ents[i], (idr->cnt - i) * sizeof(*ents));
+	ents[i].id = id;
+	ents[i].ptr = ptr;
+	idr->ents = ents;
+	idr->cnt++;
+	return id;
+}
+
+static inline void *idr_find(struct idr *idr, unsigned long id)
+{
+	int i;
+
+	for (i = 0; i < idr->cnt; i++)
+		if (idr->ents[i].id == id)
+			return idr->ents[i].ptr;
+	return NULL;
+}
+
+static inline void *idr_remove(struct idr *idr, unsigned long id)
+{
+	void *ptr;
+	int i;
+
+	for (i = 0; i < idr->cnt; i++) {
+		if (idr->ents[i].id != id)
+			continue;
+		ptr = idr->ents[i].ptr;
+		memmove(&idr->ents[i], &idr->ents[i + 1],
+			(idr->cnt - i - 1) * sizeof(*idr->ents));
+		if (!--idr->cnt) {
+			free(idr->ents);
+			idr->ents = NULL;
+		}
+		return ptr;
+	}
+	return NULL;
+}
+
+static inline int idr_for_each(struct idr *idr,
+			       int (*fn)(int id, void *p, void *data),
+			       void *data)
+{
+	int i, ret;
+
+	for (i = 0; i < idr->cnt; i++) {
+		ret = fn(idr->ents[i].id, idr->ents[i].ptr, data);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+static inline void idr_destroy(struct idr *idr)
+{
+	free(idr->ents);
+	idr_init(idr);
+}
+
+/*
+ * Scatterlists. Entries are plain arrays, the last one is marked.
+ */
+struct scatterlist {
+	struct page *page;
+	void *virt;
+	unsigned int offset;
+	unsigned int length;
+	bool end;
+};
+
+struct sg_table {
+	struct scatterlist *sgl;
+	unsigned int nents;
+	unsigned int orig_nents;
+};
+
+static inline void sg_init_one(struct scatterlist *sg, const void *buf,
+			       unsigned int buflen)
+{
+	memset(sg, 0, sizeof(*sg));
+	sg->virt = (void *)buf;
+	sg->length = buflen;
+	sg->end = true;
+}
+
+static inline struct scatterlist *sg_next(struct scatterlist *sg)
+{
+	return sg->end ? NULL : sg + 1;
+}
+
+struct sg_page_iter {
+	struct scatterlist *sg;
+	unsigned int sg_pgoffset;
+	unsigned int __nents;
+	int __pg_advance;
+};
+
+static inline unsigned int shim_sg_page_count(struct scatterlist *sg)
+{
+	return DIV_ROUND_UP(sg->offset + sg->length, PAGE_SIZE);
+}
+
+static inline void __sg_page_iter_start(struct sg_page_iter *piter,
+					struct scatterlist *sglist,
+					unsigned int nents,
+					unsigned long pgoffset)
+{
+	piter->__pg_advance = 0;
+	piter->__nents = nents;
+	piter->sg = sglist;
+	piter->sg_pgoffset = pgoffset;
+}
+
+static inline bool __sg_page_iter_next(struct sg_page_iter *piter)
+{
+	if (!piter->__nents || !piter->sg)
+		return false;
+
+	piter->sg_pgoffset += piter->__pg_advance;
+	piter->__pg_advance = 1;
+
+	while (piter->sg_pgoffset >= shim_sg_page_count(piter->sg)) {
+		piter->sg_pgoffset -= shim_sg_page_count(piter->sg);
+		piter->sg = sg_next(piter->sg);
+		if (!--piter->__nents || !piter->sg)
+			return false;
+	}
+	return true;
+}
+
+#define sg_page_iter_page(piter) \
+	((piter)->sg->page + (piter)->sg_pgoffset)
+#define for_each_sg_page(sglist, piter, nents, pgoffset) \
+	for (__sg_page_iter_start((piter), (sglist), (nents), (pgoffset)); \
+	     __sg_page_iter_next(piter);)
+
+/*
+ * Devices, character devices and files
+ */
+#define MINORBITS		20
+#define MAJOR(dev)		((unsigned int)((dev) >> MINORBITS))
+#define MKDEV(ma, mi)		(((ma) << MINORBITS) | (mi))
+
+struct device {
+	struct device *parent;
+};
+
+struct device_driver {
+	const char *name;
+	void *owner;
+};
+
+struct class;
+
+static inline struct device *device_create(struct class *class,
+					   struct device *parent, dev_t devt,
+					   void *drvdata, const char *fmt, ...)
+{
+	return parent;
+}
+
+#define device_destroy(class, devt)	do { } while (0)
+#define class_create(owner, name)	((struct class *)NULL)
+#define class_destroy(class)		do { } while (0)
+#define alloc_chrdev_region(dev, first, count, name) (*(dev) = 0, 0)
+#define unregister_chrdev_region(dev, count)	do { } while (0)
+
+struct file_operations;
+
+struct cdev {
+	void *owner;
+	const struct file_operations *ops;
+};
+
+#define cdev_init(cdev, fops)	((cdev)->ops = (fops))
+#define cdev_add(cdev, dev, count) ((void)(dev), 0)
+#define cdev_del(cdev)		do { } while (0)
+
+struct inode {
+	struct cdev *i_cdev;
+};
+
+struct file {
+	void *private_data;
+	unsigned int f_flags;
+};
+
+struct kiocb {
+	struct file *ki_filp;
+};
+
+/* iovec iterators over process memory */
+#define READ			0
+#define WRITE			1
+#define UIO_FASTIOV		8
+
+struct iov_iter {
+	const struct iovec *iov;
+	unsigned long nr_segs;
+	size_t iov_offset;
+	size_t count;
+};
+
+static inline void iov_iter_init(struct iov_iter *i, int direction,
+				 const struct iovec *iov,
+				 unsigned long nr_segs, size_t count)
+{
+	i->iov = iov;
+	i->nr_segs = nr_segs;
+	i->iov_offset = 0;
+	i->count = count;
+}
+
+#define iov_iter_count(i)	((i)->count)
+
+static inline size_t shim_iter_copy(void *addr, size_t bytes,
+				    struct iov_iter *i, bool to)
+{
+	size_t done = 0, n;
+
+	while (done < bytes && i->count && i->nr_segs) {
+		n = i->iov->iov_len - i->iov_offset;
+		if (n > bytes - done)
+			n = bytes - done;
+		if (to)
+			memcpy((char *)i->iov->iov_base + i->iov_offset,
+			       (char *)addr + done, n);
+		else
+			memcpy((char *)addr + done,
+			       (char *)i->iov->iov_base + i->iov_offset, n);
+		done += n;
+		i->count -= n;
+		i->iov_offset += n;
+		if (i->iov_offset == i->iov->iov_len) {
+			i->iov++;
+			i->nr_segs--;
+			i->iov_offset = 0;
+		}
+	}
+	return done;
+}
+
+#define copy_from_iter(addr, bytes, i)	shim_iter_copy(addr, bytes, i, false)
+#define copy_to_iter(addr, bytes, i) \
+	shim_iter_copy((void *)(addr), bytes, i, true)
+
+/* as in 4.14: returns 0, and *iov is NULL if fast_segs were enough */
+static inline int import_iovec(int type, const struct iovec *uvector,
+			       unsigned int nr_segs, unsigned int fast_segs,
+			       struct iovec **iov, struct iov_iter *i)
+{
+	struct iovec *p = *iov;
+	size_t count = 0;
+	unsigned int seg;
+
+	if (nr_segs > UIO_MAXIOV) {
+		*iov = NULL;
+		return -EINVAL;
+	}
+	if (nr_segs && !uvector) {
+		*iov = NULL;
+		return -EFAULT;
+	}
+	if (nr_segs > fast_segs) {
+		p = calloc(nr_segs, sizeof(*p));
+		if (!p) {
+			*iov = NULL;
+			return -ENOMEM;
+		}
+	}
+	if (nr_segs)
+		memcpy(p, uvector, nr_segs * sizeof(*p));
+	for (seg = 0; seg < nr_segs; seg++)
+		count += p[seg].iov_len;
+
+	iov_iter_init(i, type, p, nr_segs, count);
+	*iov = p == *iov ? NULL : p;
+	return 0;
+}
+
+struct poll_table_struct;
+typedef struct poll_table_struct poll_table;
+
+#define poll_wait(filp, wq, p)	do { } while (0)
+
+struct file_operations {
+	void *owner;
+	int (*open)(struct inode *inode, struct file *filp);
+	int (*release)(struct inode *inode, struct file *filp);
+	long (*unlocked_ioctl)(struct file *filp, unsigned int cmd,
+			       unsigned long arg);
+	ssize_t (*read_iter)(struct kiocb *iocb, struct iov_iter *iter);
+	ssize_t (*write_iter)(struct kiocb *iocb, struct iov_iter *iter);
+	unsigned int (*poll)(struct file *filp, poll_table *wait);
+};
+
+/*
+ * dma-buf, backed by the test
+ */
+enum dma_data_direction {
+	DMA_BIDIRECTIONAL = 0,
+};
+
+struct dma_buf {
+	size_t size;
+};
+
+struct dma_buf_attachment {
+	struct dma_buf *dmabuf;
+	struct device *dev;
+};
+
+struct dma_buf *dma_buf_get(int fd);
+void dma_buf_put(struct dma_buf *dmabuf);
+struct dma_buf_attachment *dma_buf_attach(struct dma_buf *dmabuf,
+					  struct device *dev);
+void dma_buf_detach(struct dma_buf *dmabuf,
+		    struct dma_buf_attachment *attach);
+struct sg_table *dma_buf_map_attachment(struct dma_buf_attachment *attach,
+					enum dma_data_direction direction);
+void dma_buf_unmap_attachment(struct dma_buf_attachment *attach,
+			      struct sg_table *sgt,
+			      enum dma_data_direction direction);
+
+/*
+ * Virtio, the queues are backed by the test
+ */
+#define VIRTIO_ID_TRUSTY_IPC	13
+#define VIRTIO_DEV_ANY_ID	0xffffffff
+
+struct virtio_device_id {
+	u32 device;
+	u32 vendor;
+};
+
+struct virtio_device;
+struct virtqueue;
+struct irq_affinity;
+
+typedef void vq_callback_t(struct virtqueue *vq);
+
+struct virtio_config_ops {
+	void (*get)(struct virtio_device *vdev, unsigned int offset,
+		    void *buf, unsigned int len);
+	void (*reset)(struct virtio_device *vdev);
+	int (*find_vqs)(struct virtio_device *vdev, unsigned int nvqs,
+			struct virtqueue *vqs[], vq_callback_t *callbacks[],
+			const char * const names[], const bool *ctx,
+			struct irq_affinity *desc);
+	void (*del_vqs)(struct virtio_device *vdev);
+};
+
+struct virtio_device {
+	struct device dev;
+	const struct virtio_config_ops *config;
+	u64 features;
+	void *priv;
+};
+
+struct virtqueue {
+	vq_callback_t *callback;
+	const char *name;
+	struct virtio_device *vdev;
+	void *priv;
+};
+
+static inline bool virtio_has_feature(const struct virtio_device *vdev,
+				      unsigned int fbit)
+{
+	return vdev->features & (1ULL << fbit);
+}
+
+int virtqueue_add_outbuf(struct virtqueue *vq, struct scatterlist sg[],
+			 unsigned int num, void *data, gfp_t gfp);
+int virtqueue_add_inbuf(struct virtqueue *vq, struct scatterlist sg[],
+			unsigned int num, void *data, gfp_t gfp);
+bool virtqueue_kick_prepare(struct virtqueue *vq);
+bool virtqueue_notify(struct virtqueue *vq);
+bool virtqueue_kick(struct virtqueue *vq);
+void *virtqueue_get_buf(struct virtqueue *vq, unsigned int *len);
+void *virtqueue_detach_unused_buf(struct virtqueue *vq);
+unsigned int virtqueue_get_vring_size(struct virtqueue *vq);
+
+struct virtio_driver {
+	struct device_driver driver;
+	const struct virtio_device_id *id_table;
+	const unsigned int *feature_table;
+	unsigned int feature_table_size;
+	int (*probe)(struct virtio_device *dev);
+	void (*remove)(struct virtio_device *dev);
+};
+
+#define register_virtio_driver(drv)	((void)(drv), 0)
+#define unregister_virtio_driver(drv)	do { } while (0)
+
+#endif /* _TIPC_SHIM_H */